@@ -0,0 +1,105 @@
+/***************************************************************************
+ # Copyright (c) 2015-21, NVIDIA CORPORATION. All rights reserved.
+ #
+ # Redistribution and use in source and binary forms, with or without
+ # modification, are permitted provided that the following conditions
+ # are met:
+ #  * Redistributions of source code must retain the above copyright
+ #    notice, this list of conditions and the following disclaimer.
+ #  * Redistributions in binary form must reproduce the above copyright
+ #    notice, this list of conditions and the following disclaimer in the
+ #    documentation and/or other materials provided with the distribution.
+ #  * Neither the name of NVIDIA CORPORATION nor the names of its
+ #    contributors may be used to endorse or promote products derived
+ #    from this software without specific prior written permission.
+ #
+ # THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS "AS IS" AND ANY
+ # EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ # IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ # PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+ # CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ # EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ # PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ # PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+ # OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ # (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ # OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ **************************************************************************/
+#include "stdafx.h"
+#include "MemoryMappedFile.h"
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace Falcor
+{
+    MemoryMappedFile::SharedPtr MemoryMappedFile::create(const std::filesystem::path& path)
+    {
+        return SharedPtr(new MemoryMappedFile(path));
+    }
+
+#ifdef _WIN32
+    MemoryMappedFile::MemoryMappedFile(const std::filesystem::path& path)
+    {
+        mFile = CreateFileW(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL | FILE_FLAG_RANDOM_ACCESS, nullptr);
+        if (mFile == INVALID_HANDLE_VALUE) throw std::runtime_error("Failed to open file '" + path.string() + "' for memory mapping!");
+
+        LARGE_INTEGER size;
+        if (!GetFileSizeEx(mFile, &size))
+        {
+            CloseHandle(mFile);
+            throw std::runtime_error("Failed to get size of file '" + path.string() + "'!");
+        }
+        mSize = (size_t)size.QuadPart;
+        if (mSize == 0) return;
+
+        mMapping = CreateFileMappingW(mFile, nullptr, PAGE_READONLY, 0, 0, nullptr);
+        if (mMapping) mpData = static_cast<const uint8_t*>(MapViewOfFile(mMapping, FILE_MAP_READ, 0, 0, 0));
+        if (!mpData)
+        {
+            if (mMapping) CloseHandle(mMapping);
+            CloseHandle(mFile);
+            throw std::runtime_error("Failed to memory map file '" + path.string() + "'!");
+        }
+    }
+
+    MemoryMappedFile::~MemoryMappedFile()
+    {
+        if (mpData) UnmapViewOfFile(mpData);
+        if (mMapping) CloseHandle(mMapping);
+        if (mFile != INVALID_HANDLE_VALUE) CloseHandle(mFile);
+    }
+#else
+    MemoryMappedFile::MemoryMappedFile(const std::filesystem::path& path)
+    {
+        mFile = open(path.c_str(), O_RDONLY);
+        if (mFile < 0) throw std::runtime_error("Failed to open file '" + path.string() + "' for memory mapping!");
+
+        struct stat s;
+        if (fstat(mFile, &s) != 0)
+        {
+            close(mFile);
+            throw std::runtime_error("Failed to get size of file '" + path.string() + "'!");
+        }
+        mSize = (size_t)s.st_size;
+        if (mSize == 0) return;
+
+        void* pData = mmap(nullptr, mSize, PROT_READ, MAP_PRIVATE, mFile, 0);
+        if (pData == MAP_FAILED)
+        {
+            close(mFile);
+            throw std::runtime_error("Failed to memory map file '" + path.string() + "'!");
+        }
+        mpData = static_cast<const uint8_t*>(pData);
+    }
+
+    MemoryMappedFile::~MemoryMappedFile()
+    {
+        if (mpData) munmap(const_cast<uint8_t*>(mpData), mSize);
+        if (mFile >= 0) close(mFile);
+    }
+#endif
+}
@@ -0,0 +1,70 @@
+/***************************************************************************
+ # Copyright (c) 2015-21, NVIDIA CORPORATION. All rights reserved.
+ #
+ # Redistribution and use in source and binary forms, with or without
+ # modification, are permitted provided that the following conditions
+ # are met:
+ #  * Redistributions of source code must retain the above copyright
+ #    notice, this list of conditions and the following disclaimer.
+ #  * Redistributions in binary form must reproduce the above copyright
+ #    notice, this list of conditions and the following disclaimer in the
+ #    documentation and/or other materials provided with the distribution.
+ #  * Neither the name of NVIDIA CORPORATION nor the names of its
+ #    contributors may be used to endorse or promote products derived
+ #    from this software without specific prior written permission.
+ #
+ # THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS "AS IS" AND ANY
+ # EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ # IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ # PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+ # CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ # EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ # PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ # PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+ # OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ # (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ # OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ **************************************************************************/
+#pragma once
+#include <filesystem>
+#include <memory>
+
+namespace Falcor
+{
+    /** Read-only memory mapping of a file.
+        The file contents are paged in on demand and stay valid until the object is destroyed.
+    */
+    class dlldecl MemoryMappedFile
+    {
+    public:
+        using SharedPtr = std::shared_ptr<MemoryMappedFile>;
+
+        /** Map a file into memory.
+            \param[in] path Path of the file.
+            \return A new object, or throws an exception if the file could not be mapped.
+        */
+        static SharedPtr create(const std::filesystem::path& path);
+
+        ~MemoryMappedFile();
+
+        /** Get a pointer to the mapped file contents.
+        */
+        const uint8_t* getData() const { return mpData; }
+
+        /** Get the size of the mapped file in bytes.
+        */
+        size_t getSize() const { return mSize; }
+
+    private:
+        MemoryMappedFile(const std::filesystem::path& path);
+
+        const uint8_t* mpData = nullptr;
+        size_t mSize = 0;
+#ifdef _WIN32
+        HANDLE mFile = INVALID_HANDLE_VALUE;
+        HANDLE mMapping = nullptr;
+#else
+        int mFile = -1;
+#endif
+    };
+}
@@ -74,6 +74,7 @@
 #include "Core/BufferTypes/VariablesBufferUI.h"
 
 // Core/Platform
+#include "Core/Platform/MemoryMappedFile.h"
 #include "Core/Platform/OS.h"
 #include "Core/Platform/ProgressBar.h"
 
@@ -122,6 +123,7 @@
 // Utils
 #include "Utils/Math/AABB.h"
 #include "Utils/BinaryFileStream.h"
+#include "Utils/CompressionUtils.h"
 #include "Utils/CryptoUtils.h"
 #include "Utils/Logger.h"
 #include "Utils/NumericRange.h"
@@ -0,0 +1,389 @@
+/***************************************************************************
+ # Copyright (c) 2015-21, NVIDIA CORPORATION. All rights reserved.
+ #
+ # Redistribution and use in source and binary forms, with or without
+ # modification, are permitted provided that the following conditions
+ # are met:
+ #  * Redistributions of source code must retain the above copyright
+ #    notice, this list of conditions and the following disclaimer.
+ #  * Redistributions in binary form must reproduce the above copyright
+ #    notice, this list of conditions and the following disclaimer in the
+ #    documentation and/or other materials provided with the distribution.
+ #  * Neither the name of NVIDIA CORPORATION nor the names of its
+ #    contributors may be used to endorse or promote products derived
+ #    from this software without specific prior written permission.
+ #
+ # THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS "AS IS" AND ANY
+ # EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ # IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ # PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+ # CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ # EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ # PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ # PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+ # OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ # (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ # OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ **************************************************************************/
+#include "stdafx.h"
+#include "EnvMapImportanceBuilder.h"
+#include "Utils/CryptoUtils.h"
+#include "glm/gtc/integer.hpp"
+#include <immintrin.h>
+#include <mutex>
+
+namespace Falcor
+{
+    namespace
+    {
+        /** Specifies the current cache file version.
+            This needs to be incremented every time the file format or the importance map computation changes!
+        */
+        const uint32_t kVersion = 1;
+
+        const char kMagic[8] = { 'F', 'a', 'l', 'c', 'o', 'r', 'I', '$' };
+        const char kCacheExtension[] = ".importance";
+
+        const float kPi = 3.14159265358979323846f;
+        const float3 kLuminanceWeights = float3(0.2126f, 0.7152f, 0.0722f); // Same as luminance() in ColorHelpers.slang.
+
+        struct CacheHeader
+        {
+            char magic[8]{};
+            uint32_t version = 0;
+            uint32_t dimension = 0;
+            uint64_t key = 0;
+            uint32_t mipCount = 0;
+            uint32_t reserved = 0;
+        };
+
+        /** Size, modification time and content hash of a file.
+        */
+        struct FileInfo
+        {
+            uint64_t size = 0;
+            int64_t modifiedTime = 0;
+            SHA1::MD hash{};
+        };
+
+        /** Compute the content hash of a file.
+            Hashes are memoized by path, size and modification time, so each file version is only hashed once per process.
+        */
+        bool hashFile(const std::string& path, FileInfo& info)
+        {
+            static std::mutex sMutex;
+            static std::unordered_map<std::string, FileInfo> sFileInfos;
+
+            std::error_code ec;
+            info.size = std::filesystem::file_size(path, ec);
+            if (ec) return false;
+            auto time = std::filesystem::last_write_time(path, ec);
+            if (ec) return false;
+            info.modifiedTime = (int64_t)time.time_since_epoch().count();
+
+            {
+                std::lock_guard<std::mutex> lock(sMutex);
+                auto it = sFileInfos.find(path);
+                if (it != sFileInfos.end() && it->second.size == info.size && it->second.modifiedTime == info.modifiedTime)
+                {
+                    info.hash = it->second.hash;
+                    return true;
+                }
+            }
+
+            if (!SHA1::computeFile(path, info.hash)) return false;
+
+            std::lock_guard<std::mutex> lock(sMutex);
+            sFileInfos[path] = info;
+            return true;
+        }
+
+        float signNonZero(float x)
+        {
+            return x > 0.f ? 1.f : (x < 0.f ? -1.f : 0.f);
+        }
+
+        /** Port of oct_to_ndir_equal_area_unorm() in MathHelpers.slang.
+        */
+        float3 octToDirEqualArea(float2 p)
+        {
+            p = p * 2.f - 1.f;
+
+            float d = 1.f - (std::abs(p.x) + std::abs(p.y));
+            float r = 1.f - std::abs(d);
+            float phi = (r > 0.f) ? ((std::abs(p.y) - std::abs(p.x)) / r + 1.f) * (kPi / 4.f) : 0.f;
+
+            float f = r * std::sqrt(2.f - r * r);
+            float x = f * signNonZero(p.x) * std::cos(phi);
+            float y = f * signNonZero(p.y) * std::sin(phi);
+            float z = signNonZero(d) * (1.f - r * r);
+
+            return float3(x, y, z);
+        }
+
+        /** Port of world_to_latlong_map() in MathHelpers.slang.
+        */
+        float2 dirToLatLong(float3 dir)
+        {
+            float3 p = glm::normalize(dir);
+            float2 uv;
+            uv.x = std::atan2(p.x, -p.z) * (0.5f / kPi) + 0.5f;
+            uv.y = std::acos(std::clamp(p.y, -1.f, 1.f)) / kPi;
+            return uv;
+        }
+
+        /** Bilinear lookup at mip level 0 with wrap addressing, which matches the default sampler used by the setup pass.
+        */
+        float sampleBilinear(const float* pLuminance, uint32_t width, uint32_t height, float2 uv)
+        {
+            auto wrap = [](int i, uint32_t n) { return (uint32_t)(((i % (int)n) + (int)n) % (int)n); };
+
+            float x = uv.x * width - 0.5f;
+            float y = uv.y * height - 0.5f;
+            float x0 = std::floor(x);
+            float y0 = std::floor(y);
+            float fx = x - x0;
+            float fy = y - y0;
+
+            uint32_t xa = wrap((int)x0, width), xb = wrap((int)x0 + 1, width);
+            uint32_t ya = wrap((int)y0, height), yb = wrap((int)y0 + 1, height);
+            const float* pRowA = pLuminance + (size_t)ya * width;
+            const float* pRowB = pLuminance + (size_t)yb * width;
+
+            float top = pRowA[xa] + fx * (pRowA[xb] - pRowA[xa]);
+            float bottom = pRowB[xa] + fx * (pRowB[xb] - pRowB[xa]);
+            return top + fy * (bottom - top);
+        }
+
+        /** Convert a row of RGBA32Float texels to luminance, four texels at a time.
+        */
+        void luminanceRowRGBA32F(const float* pSrc, float* pDst, uint32_t width)
+        {
+            const __m128 wr = _mm_set1_ps(kLuminanceWeights.r);
+            const __m128 wg = _mm_set1_ps(kLuminanceWeights.g);
+            const __m128 wb = _mm_set1_ps(kLuminanceWeights.b);
+
+            uint32_t x = 0;
+            for (; x + 4 <= width; x += 4)
+            {
+                __m128 t0 = _mm_loadu_ps(pSrc + 4 * x);
+                __m128 t1 = _mm_loadu_ps(pSrc + 4 * x + 4);
+                __m128 t2 = _mm_loadu_ps(pSrc + 4 * x + 8);
+                __m128 t3 = _mm_loadu_ps(pSrc + 4 * x + 12);
+                _MM_TRANSPOSE4_PS(t0, t1, t2, t3); // t0..t2 now hold the r, g and b channels.
+                __m128 l = _mm_add_ps(_mm_add_ps(_mm_mul_ps(t0, wr), _mm_mul_ps(t1, wg)), _mm_mul_ps(t2, wb));
+                _mm_storeu_ps(pDst + x, l);
+            }
+            for (; x < width; x++)
+            {
+                pDst[x] = glm::dot(float3(pSrc[4 * x], pSrc[4 * x + 1], pSrc[4 * x + 2]), kLuminanceWeights);
+            }
+        }
+
+        /** Average 2x2 texels of two source rows into one destination row, four texels at a time.
+        */
+        void downsampleRow(const float* pRow0, const float* pRow1, float* pDst, uint32_t dstWidth)
+        {
+            const __m128 quarter = _mm_set1_ps(0.25f);
+
+            uint32_t x = 0;
+            for (; x + 4 <= dstWidth; x += 4)
+            {
+                __m128 a = _mm_add_ps(_mm_loadu_ps(pRow0 + 2 * x), _mm_loadu_ps(pRow1 + 2 * x));
+                __m128 b = _mm_add_ps(_mm_loadu_ps(pRow0 + 2 * x + 4), _mm_loadu_ps(pRow1 + 2 * x + 4));
+                __m128 even = _mm_shuffle_ps(a, b, _MM_SHUFFLE(2, 0, 2, 0));
+                __m128 odd = _mm_shuffle_ps(a, b, _MM_SHUFFLE(3, 1, 3, 1));
+                _mm_storeu_ps(pDst + x, _mm_mul_ps(_mm_add_ps(even, odd), quarter));
+            }
+            for (; x < dstWidth; x++)
+            {
+                pDst[x] = ((pRow0[2 * x] + pRow1[2 * x]) + (pRow0[2 * x + 1] + pRow1[2 * x + 1])) * 0.25f;
+            }
+        }
+    }
+
+    std::vector<float> EnvMapImportanceBuilder::computeLuminance(const void* pData, ResourceFormat format, uint32_t width, uint32_t height, size_t rowPitch)
+    {
+        assert(pData);
+
+        uint32_t channels = 0;
+        bool isHalf = false;
+        switch (format)
+        {
+        case ResourceFormat::RGBA32Float: channels = 4; break;
+        case ResourceFormat::RGB32Float: channels = 3; break;
+        case ResourceFormat::RGBA16Float: channels = 4; isHalf = true; break;
+        case ResourceFormat::RGB16Float: channels = 3; isHalf = true; break;
+        default: return {};
+        }
+        if (rowPitch == 0) rowPitch = (size_t)width * getFormatBytesPerBlock(format);
+
+        std::vector<float> luminance((size_t)width * height);
+        Threading::parallelFor(0, height, [&](size_t y)
+        {
+            const uint8_t* pRow = static_cast<const uint8_t*>(pData) + y * rowPitch;
+            float* pDst = luminance.data() + (size_t)y * width;
+
+            if (format == ResourceFormat::RGBA32Float)
+            {
+                luminanceRowRGBA32F(reinterpret_cast<const float*>(pRow), pDst, width);
+            }
+            else if (isHalf)
+            {
+                const uint16_t* pSrc = reinterpret_cast<const uint16_t*>(pRow);
+                for (uint32_t x = 0; x < width; x++, pSrc += channels)
+                {
+                    pDst[x] = glm::dot(float3(f16tof32(pSrc[0]), f16tof32(pSrc[1]), f16tof32(pSrc[2])), kLuminanceWeights);
+                }
+            }
+            else
+            {
+                const float* pSrc = reinterpret_cast<const float*>(pRow);
+                for (uint32_t x = 0; x < width; x++, pSrc += channels)
+                {
+                    pDst[x] = glm::dot(float3(pSrc[0], pSrc[1], pSrc[2]), kLuminanceWeights);
+                }
+            }
+        });
+
+        return luminance;
+    }
+
+    EnvMapImportanceBuilder::MipChain EnvMapImportanceBuilder::build(const float* pLuminance, uint32_t width, uint32_t height, uint32_t dimension, uint32_t samples)
+    {
+        assert(pLuminance && width > 0 && height > 0);
+        assert(isPowerOf2(dimension) && dimension > 1);
+        assert(isPowerOf2(samples));
+
+        const uint32_t mipCount = glm::log2(dimension) + 1;
+        const uint32_t samplesX = std::max(1u, (uint32_t)std::sqrt(samples));
+        const uint32_t samplesY = samples / samplesX;
+        const float2 invDimInSamples = 1.f / float2(dimension * samplesX, dimension * samplesY);
+        const float invSamples = 1.f / (samplesX * samplesY);
+
+        MipChain mips(mipCount);
+
+        // Compute the base mip. Each texel averages the luminance over a regular grid of samples in the octahedral map.
+        mips[0].resize((size_t)dimension * dimension);
+        Threading::parallelFor(0, dimension, [&](size_t row)
+        {
+            const uint32_t y = (uint32_t)row;
+            float* pDst = mips[0].data() + (size_t)y * dimension;
+            for (uint32_t x = 0; x < dimension; x++)
+            {
+                float L = 0.f;
+                for (uint32_t sy = 0; sy < samplesY; sy++)
+                {
+                    for (uint32_t sx = 0; sx < samplesX; sx++)
+                    {
+                        float2 p = (float2(x * samplesX + sx, y * samplesY + sy) + 0.5f) * invDimInSamples;
+                        float2 uv = dirToLatLong(octToDirEqualArea(p));
+                        L += sampleBilinear(pLuminance, width, height, uv);
+                    }
+                }
+                pDst[x] = L * invSamples;
+            }
+        });
+
+        // Populate the mip hierarchy with 2x2 box filtering. This matches Texture::generateMips() for power-of-two sizes.
+        for (uint32_t mip = 1; mip < mipCount; mip++)
+        {
+            const uint32_t srcDim = dimension >> (mip - 1);
+            const uint32_t dstDim = dimension >> mip;
+            const std::vector<float>& src = mips[mip - 1];
+            std::vector<float>& dst = mips[mip];
+            dst.resize((size_t)dstDim * dstDim);
+            Threading::parallelFor(0, dstDim, [&](size_t y)
+            {
+                downsampleRow(src.data() + (size_t)(2 * y) * srcDim, src.data() + (size_t)(2 * y + 1) * srcDim, dst.data() + (size_t)y * dstDim, dstDim);
+            });
+        }
+
+        return mips;
+    }
+
+    std::filesystem::path EnvMapImportanceBuilder::getCachePath(const std::string& envMapPath)
+    {
+        return std::filesystem::path(envMapPath + kCacheExtension);
+    }
+
+    bool EnvMapImportanceBuilder::computeCacheKey(const std::string& envMapPath, uint32_t dimension, uint32_t samples, uint64_t& key)
+    {
+        FileInfo info;
+        if (!hashFile(envMapPath, info)) return false;
+
+        SHA1 sha1;
+        sha1.update(info.hash.data(), info.hash.size());
+        sha1.update(&kVersion, sizeof(kVersion));
+        sha1.update(&dimension, sizeof(dimension));
+        sha1.update(&samples, sizeof(samples));
+        SHA1::MD md = sha1.final();
+        std::memcpy(&key, md.data(), sizeof(key));
+        return true;
+    }
+
+    bool EnvMapImportanceBuilder::readCache(const std::filesystem::path& cachePath, uint64_t key, uint32_t dimension, MipChain& mips)
+    {
+        std::ifstream fs(cachePath, std::ios_base::binary);
+        if (!fs) return false;
+
+        CacheHeader header;
+        fs.read(reinterpret_cast<char*>(&header), sizeof(header));
+        if (!fs) return false;
+
+        const uint32_t mipCount = glm::log2(dimension) + 1;
+        if (std::memcmp(header.magic, kMagic, sizeof(kMagic)) != 0 || header.version != kVersion || header.key != key ||
+            header.dimension != dimension || header.mipCount != mipCount)
+        {
+            return false;
+        }
+
+        mips.resize(mipCount);
+        for (uint32_t mip = 0; mip < mipCount; mip++)
+        {
+            const uint32_t mipDim = dimension >> mip;
+            mips[mip].resize((size_t)mipDim * mipDim);
+            fs.read(reinterpret_cast<char*>(mips[mip].data()), mips[mip].size() * sizeof(float));
+            if (!fs)
+            {
+                mips.clear();
+                return false;
+            }
+        }
+
+        return true;
+    }
+
+    bool EnvMapImportanceBuilder::writeCache(const std::filesystem::path& cachePath, uint64_t key, const MipChain& mips)
+    {
+        assert(!mips.empty());
+
+        CacheHeader header;
+        std::memcpy(header.magic, kMagic, sizeof(kMagic));
+        header.version = kVersion;
+        header.dimension = (uint32_t)std::lround(std::sqrt((double)mips[0].size()));
+        header.key = key;
+        header.mipCount = (uint32_t)mips.size();
+
+        // Write to a temporary file first so that concurrent readers never see a partially written cache file.
+        std::filesystem::path tempPath = cachePath;
+        tempPath += ".tmp";
+        bool written = false;
+        {
+            std::ofstream fs(tempPath, std::ios_base::binary | std::ios_base::trunc);
+            if (!fs) return false;
+            fs.write(reinterpret_cast<const char*>(&header), sizeof(header));
+            for (const auto& mip : mips) fs.write(reinterpret_cast<const char*>(mip.data()), mip.size() * sizeof(float));
+            written = fs.good();
+        }
+
+        std::error_code ec;
+        if (written) std::filesystem::rename(tempPath, cachePath, ec);
+        if (!written || ec)
+        {
+            std::filesystem::remove(tempPath, ec);
+            return false;
+        }
+        return true;
+    }
+}
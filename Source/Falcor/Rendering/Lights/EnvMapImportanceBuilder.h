@@ -0,0 +1,102 @@
+/***************************************************************************
+ # Copyright (c) 2015-21, NVIDIA CORPORATION. All rights reserved.
+ #
+ # Redistribution and use in source and binary forms, with or without
+ # modification, are permitted provided that the following conditions
+ # are met:
+ #  * Redistributions of source code must retain the above copyright
+ #    notice, this list of conditions and the following disclaimer.
+ #  * Redistributions in binary form must reproduce the above copyright
+ #    notice, this list of conditions and the following disclaimer in the
+ #    documentation and/or other materials provided with the distribution.
+ #  * Neither the name of NVIDIA CORPORATION nor the names of its
+ #    contributors may be used to endorse or promote products derived
+ #    from this software without specific prior written permission.
+ #
+ # THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS "AS IS" AND ANY
+ # EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ # IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ # PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+ # CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ # EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ # PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ # PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+ # OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ # (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ # OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ **************************************************************************/
+#pragma once
+#include "Core/API/Formats.h"
+#include <filesystem>
+#include <string>
+#include <vector>
+
+namespace Falcor
+{
+    /** CPU builder and disk cache for the hierarchical importance map used by EnvMapSampler.
+
+        The importance map is an equal-area octahedral map of the environment map luminance in the
+        local frame of the environment map, so it does not depend on the env map rotation.
+        Mip 0 holds dimension x dimension texels and each coarser mip the average of 2x2 texels, down to 1x1.
+
+        The cache file is stored next to the environment map and is keyed by the content hash of the
+        environment map file and the importance map parameters.
+    */
+    class dlldecl EnvMapImportanceBuilder
+    {
+    public:
+        /** Importance map texels, one vector per mip level from finest to coarsest.
+        */
+        using MipChain = std::vector<std::vector<float>>;
+
+        /** Convert environment map texels to luminance.
+            \param[in] pData Texel data in scanline order.
+            \param[in] format Texel format.
+            \param[in] width Width in texels.
+            \param[in] height Height in texels.
+            \param[in] rowPitch Size of a row in bytes, or zero if the rows are tightly packed.
+            \return Luminance per texel, or an empty vector if the format is not supported (only float formats are).
+        */
+        static std::vector<float> computeLuminance(const void* pData, ResourceFormat format, uint32_t width, uint32_t height, size_t rowPitch = 0);
+
+        /** Build the importance map. This computes the same map as EnvMapSamplerSetup.cs.slang followed by mip generation.
+            \param[in] pLuminance Luminance of the lat-long environment map in scanline order.
+            \param[in] width Width of the environment map in texels.
+            \param[in] height Height of the environment map in texels.
+            \param[in] dimension Importance map dimension in texels. Must be a power of two larger than one.
+            \param[in] samples Number of samples per importance map texel. Must be a power of two.
+            \return The importance map mip chain.
+        */
+        static MipChain build(const float* pLuminance, uint32_t width, uint32_t height, uint32_t dimension, uint32_t samples);
+
+        /** Get the cache file path for an environment map file.
+        */
+        static std::filesystem::path getCachePath(const std::string& envMapPath);
+
+        /** Compute the cache key. The content hash of the environment map file is memoized as long as its size and modification time don't change.
+            \param[in] envMapPath Full path of the environment map file.
+            \param[in] dimension Importance map dimension in texels.
+            \param[in] samples Number of samples per importance map texel.
+            \param[out] key The cache key.
+            \return True if the environment map file could be hashed.
+        */
+        static bool computeCacheKey(const std::string& envMapPath, uint32_t dimension, uint32_t samples, uint64_t& key);
+
+        /** Read an importance map from the cache.
+            \param[in] cachePath Cache file path.
+            \param[in] key Cache key.
+            \param[in] dimension Importance map dimension in texels.
+            \param[out] mips The importance map mip chain.
+            \return True if the cache file exists and matches the key and dimension.
+        */
+        static bool readCache(const std::filesystem::path& cachePath, uint64_t key, uint32_t dimension, MipChain& mips);
+
+        /** Write an importance map to the cache.
+            \param[in] cachePath Cache file path.
+            \param[in] key Cache key.
+            \param[in] mips The importance map mip chain.
+            \return True if the cache file was written.
+        */
+        static bool writeCache(const std::filesystem::path& cachePath, uint64_t key, const MipChain& mips);
+    };
+}
@@ -27,6 +27,8 @@
  **************************************************************************/
 #include "stdafx.h"
 #include "EnvMapSampler.h"
+#include "EnvMapImportanceBuilder.h"
+#include "Utils/Image/Bitmap.h"
 #include "glm/gtc/integer.hpp"
 
 namespace Falcor
@@ -64,9 +66,6 @@ namespace Falcor
     {
         assert(pEnvMap);
 
-        // Create compute program for the setup phase.
-        mpSetupPass = ComputePass::create(kShaderFilenameSetup, "main");
-
         // Create sampler.
         Sampler::Desc samplerDesc;
         samplerDesc.setFilterMode(Sampler::Filter::Point, Sampler::Filter::Point, Sampler::Filter::Point);
@@ -94,6 +93,11 @@ namespace Falcor
         mpImportanceMap = Texture::create2D(dimension, dimension, ResourceFormat::R32Float, 1, mips, nullptr, Resource::BindFlags::ShaderResource | Resource::BindFlags::RenderTarget | Resource::BindFlags::UnorderedAccess);
         assert(mpImportanceMap);
 
+        if (loadImportanceMap(pRenderContext, dimension, samples)) return true;
+
+        // Fall back to computing the importance map on the GPU.
+        if (!mpSetupPass) mpSetupPass = ComputePass::create(kShaderFilenameSetup, "main");
+
         mpSetupPass["gEnvMap"] = mpEnvMap->getEnvMap();
         mpSetupPass["gImportanceMap"] = mpImportanceMap;
 
@@ -115,4 +119,40 @@ namespace Falcor
         return true;
     }
 
+    bool EnvMapSampler::loadImportanceMap(RenderContext* pRenderContext, uint32_t dimension, uint32_t samples)
+    {
+        const std::string& filename = mpEnvMap->getFilename();
+        if (filename.empty()) return false;
+
+        uint64_t key = 0;
+        bool hasKey = EnvMapImportanceBuilder::computeCacheKey(filename, dimension, samples, key);
+        auto cachePath = EnvMapImportanceBuilder::getCachePath(filename);
+
+        EnvMapImportanceBuilder::MipChain mips;
+        if (!hasKey || !EnvMapImportanceBuilder::readCache(cachePath, key, dimension, mips))
+        {
+            // Decode the environment map with the same memory layout as Texture::createFromFile(). Block compressed (DDS) files are not supported.
+            if (hasSuffix(filename, ".dds", false)) return false;
+            Bitmap::UniqueConstPtr pBitmap = Bitmap::createFromFile(filename, true);
+            if (!pBitmap) return false;
+
+            auto luminance = EnvMapImportanceBuilder::computeLuminance(pBitmap->getData(), pBitmap->getFormat(), pBitmap->getWidth(), pBitmap->getHeight(), pBitmap->getRowPitch());
+            if (luminance.empty()) return false;
+
+            mips = EnvMapImportanceBuilder::build(luminance.data(), pBitmap->getWidth(), pBitmap->getHeight(), dimension, samples);
+
+            if (hasKey && !EnvMapImportanceBuilder::writeCache(cachePath, key, mips))
+            {
+                logWarning("Failed to write environment map importance cache '" + cachePath.string() + "'.");
+            }
+        }
+
+        assert(mips.size() == mpImportanceMap->getMipCount());
+        for (uint32_t mip = 0; mip < (uint32_t)mips.size(); mip++)
+        {
+            pRenderContext->updateSubresourceData(mpImportanceMap.get(), mpImportanceMap->getSubresourceIndex(0, mip), mips[mip].data());
+        }
+
+        return true;
+    }
 }
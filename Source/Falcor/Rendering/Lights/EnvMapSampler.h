@@ -61,9 +61,14 @@ namespace Falcor
 
         bool createImportanceMap(RenderContext* pRenderContext, uint32_t dimension, uint32_t samples);
 
+        /** Fill the importance map from the cache next to the environment map file, or build it on the CPU and update the cache.
+            \return True if the importance map was filled, false if the environment map has no source file or a format the CPU builder doesn't support.
+        */
+        bool loadImportanceMap(RenderContext* pRenderContext, uint32_t dimension, uint32_t samples);
+
         EnvMap::SharedPtr       mpEnvMap;           ///< Environment map.
 
-        ComputePass::SharedPtr  mpSetupPass;        ///< Compute pass for creating the importance map.
+        ComputePass::SharedPtr  mpSetupPass;        ///< Compute pass for creating the importance map. Only created if the importance map can't be built on the CPU.
 
         Texture::SharedPtr      mpImportanceMap;    ///< Hierarchical importance map (luminance).
         Sampler::SharedPtr      mpImportanceSampler;
@@ -101,6 +101,15 @@ namespace Falcor
             "  Triangle count:      " + std::to_string(stats.triangleCount) + "\n";
         widget.text(statsStr);
 
+        if (stats.wideNodeCount > 0)
+        {
+            const std::string wideStatsStr =
+                "  Branching factor:    " + std::to_string(mBranchingFactor) + "\n" +
+                "  Wide tree height:    " + std::to_string(stats.wideTreeHeight) + "\n" +
+                "  Wide node count:     " + std::to_string(stats.wideNodeCount) + "\n";
+            widget.text(wideStatsStr);
+        }
+
         if (auto nodeGroup = widget.group("Node count per level"))
         {
             std::string countStr;
@@ -128,6 +137,11 @@ namespace Falcor
     {
         // Reset all CPU data.
         mNodes.clear();
+        mWideNodes.clear();
+        mBranchingFactor = 2;
+        mTriangleIndices.clear();
+        mTriangleBitmasks.clear();
+        mCPURefitData = CPURefitData();
         mNodeIndices.clear();
         mPerDepthRefitEntryInfo.clear();
         mMaxTriangleCountPerLeaf = 0;
@@ -214,7 +228,24 @@ namespace Falcor
         };
         traverseBVH(evalInternal, evalLeaf);
 
-        mBVHStats.byteSize = (uint32_t)(mNodes.size() * sizeof(mNodes[0]));
+        // Compute the height of the wide BVH. Wide nodes are stored in depth-first order, so the children come after their parent.
+        mBVHStats.wideNodeCount = (uint32_t)mWideNodes.size();
+        mBVHStats.wideTreeHeight = 0;
+        if (!mWideNodes.empty())
+        {
+            std::vector<uint32_t> wideDepth(mWideNodes.size(), 0);
+            for (uint32_t nodeIndex = 0; nodeIndex < mWideNodes.size(); ++nodeIndex)
+            {
+                const PackedWideNode& node = mWideNodes[nodeIndex];
+                for (uint32_t i = 0; i < node.getChildCount(); ++i)
+                {
+                    if (node.isChildLeaf(i)) mBVHStats.wideTreeHeight = std::max(mBVHStats.wideTreeHeight, wideDepth[nodeIndex] + 1);
+                    else wideDepth[node.getChildNodeIndex(i)] = wideDepth[nodeIndex] + 1;
+                }
+            }
+        }
+
+        mBVHStats.byteSize = (uint32_t)(mNodes.size() * sizeof(mNodes[0]) + mWideNodes.size() * sizeof(PackedWideNode));
     }
 
     void LightBVH::updateNodeIndices()
@@ -304,6 +335,24 @@ namespace Falcor
         mIsCpuDataValid = true;
     }
 
+    void LightBVH::uploadWideBuffers(const std::vector<uint64_t>& wideTriangleBitmasks)
+    {
+        assert(!mWideNodes.empty());
+        if (!mpWideNodesBuffer || mpWideNodesBuffer->getElementCount() < mWideNodes.size())
+        {
+            mpWideNodesBuffer = Buffer::createStructured(sizeof(PackedWideNode), (uint32_t)mWideNodes.size(), Resource::BindFlags::ShaderResource, Buffer::CpuAccess::None, nullptr, false);
+            mpWideNodesBuffer->setName("LightBVH::mpWideNodesBuffer");
+        }
+        if (!mpWideTriangleBitmasksBuffer || mpWideTriangleBitmasksBuffer->getElementCount() < wideTriangleBitmasks.size())
+        {
+            mpWideTriangleBitmasksBuffer = Buffer::createStructured(sizeof(uint64_t), (uint32_t)wideTriangleBitmasks.size(), Resource::BindFlags::ShaderResource, Buffer::CpuAccess::None, nullptr, false);
+            mpWideTriangleBitmasksBuffer->setName("LightBVH::mpWideTriangleBitmasksBuffer");
+        }
+
+        mpWideNodesBuffer->setBlob(mWideNodes.data(), 0, mWideNodes.size() * sizeof(PackedWideNode));
+        mpWideTriangleBitmasksBuffer->setBlob(wideTriangleBitmasks.data(), 0, wideTriangleBitmasks.size() * sizeof(wideTriangleBitmasks[0]));
+    }
+
     void LightBVH::syncDataToCPU() const
     {
         if (!mIsValid || mIsCpuDataValid) return;
@@ -325,6 +374,11 @@ namespace Falcor
             var["nodes"] = mpBVHNodesBuffer;
             var["triangleIndices"] = mpTriangleIndicesBuffer;
             var["triangleBitmasks"] = mpTriangleBitmasksBuffer;
+            if (mBranchingFactor > 2)
+            {
+                var["wideNodes"] = mpWideNodesBuffer;
+                var["wideTriangleBitmasks"] = mpWideTriangleBitmasksBuffer;
+            }
         }
     }
 }
@@ -42,6 +42,8 @@ namespace Falcor
 
         This is binary BVH over all emissive triangles as described by Moreau and Clarberg,
         "Importance Sampling of Many Lights on the GPU", Ray Tracing Gems, Ch. 18, 2019.
+        Optionally, the binary BVH is collapsed into a 4- or 8-wide BVH with quantized nodes,
+        which is used for sampling instead. The binary BVH is always kept, as the wide BVH is derived from it.
 
         Before being used, the BVH needs to have been built using LightBVHBuilder::build().
         The data can be both used on the CPU (using traverseBVH() or on the GPU by:
@@ -77,8 +79,25 @@ namespace Falcor
         */
         static SharedPtr create(const LightCollection::SharedConstPtr& pLightCollection);
 
-        /** Refit all the BVH nodes to the underlying geometry, without changing the hierarchy.
+        /** Data kept alongside the BVH for refitting it incrementally on the CPU, see LightBVHBuilder::refit().
+        */
+        struct CPURefitData
+        {
+            std::vector<uint32_t> parentIndices;        ///< Parent node index of each node, or kInvalidIndex for the root node.
+            std::vector<uint32_t> triangleLeafIndices;  ///< Leaf node index of each triangle, or kInvalidIndex if the triangle is not in the BVH. Indexed by global triangle index.
+            std::vector<float> subtreeCosts;            ///< Sum of the SAOH costs of all nodes in the subtree rooted at each node.
+            std::vector<float> buildCostRatios;         ///< Ratio of the subtree cost to the node's own SAOH cost at the time the subtree was built.
+            std::vector<LightCollection::MeshLightTriangle> triangles; ///< Emissive triangles at their current positions. They are transformed on the CPU, without reading back the GPU data.
+            std::vector<float3> objectPositions;        ///< Object-space vertex positions of the emissive triangles, three per triangle.
+            std::vector<uint32_t> wideChildIndices;     ///< Binary node index of each child of each wide node, PackedWideNode::kMaxChildCount entries per wide node. Empty unless a wide BVH is used.
+            std::vector<uint32_t> wideParentIndices;    ///< Index of the wide node that has each binary node as a child, or kInvalidIndex. Empty unless a wide BVH is used.
+
+            static const uint32_t kInvalidIndex = std::numeric_limits<uint32_t>::max();
+        };
+
+        /** Refit all the BVH nodes to the underlying geometry on the GPU, without changing the hierarchy.
             The BVH needs to have been built before trying to refit it.
+            Note that only the binary BVH is refitted. A wide BVH needs to be rebuilt or refitted on the CPU instead (see LightBVHBuilder::refit()).
             \param[in] pRenderContext The render context.
         */
         void refit(RenderContext* pRenderContext);
@@ -101,12 +120,19 @@ namespace Falcor
             uint32_t internalNodeCount = 0;                  ///< Number of internal nodes inside the BVH.
             uint32_t leafNodeCount = 0;                      ///< Number of leaf nodes inside the BVH.
             uint32_t triangleCount = 0;                      ///< Number of triangles inside the BVH.
+            uint32_t wideNodeCount = 0;                      ///< Number of nodes inside the wide BVH, or zero if there is none.
+            uint32_t wideTreeHeight = 0;                     ///< Number of edges on the longest path between the root node and a leaf in the wide BVH.
         };
 
         /** Returns stats.
         */
         const BVHStats& getStats() const { return mBVHStats; }
 
+        /** Returns the branching factor of the BVH used for sampling.
+            \return 2 for the binary BVH, or 4/8 if a wide BVH is used.
+        */
+        uint32_t getBranchingFactor() const { return mBranchingFactor; }
+
         /** Is the BVH valid.
             \return true if the BVH is ready for use.
         */
@@ -130,6 +156,7 @@ namespace Falcor
         void renderStats(Gui::Widgets& widget, const BVHStats& stats) const;
 
         void uploadCPUBuffers(const std::vector<uint32_t>& triangleIndices, const std::vector<uint64_t>& triangleBitmasks);
+        void uploadWideBuffers(const std::vector<uint64_t>& wideTriangleBitmasks);
         void syncDataToCPU() const;
 
         /** Invalidate the BVH.
@@ -150,6 +177,11 @@ namespace Falcor
 
         // CPU resources
         mutable std::vector<PackedNode>       mNodes;                   ///< CPU-side copy of packed BVH nodes.
+        std::vector<PackedWideNode>           mWideNodes;               ///< CPU-side copy of packed wide BVH nodes. Empty if the binary BVH is used for sampling.
+        uint32_t                              mBranchingFactor = 2;     ///< Branching factor of the BVH used for sampling.
+        std::vector<uint32_t>                 mTriangleIndices;         ///< CPU-side copy of the triangle indices. Only kept if the BVH is refitted on the CPU.
+        std::vector<uint64_t>                 mTriangleBitmasks;        ///< CPU-side copy of the triangle bitmasks. Only kept if the BVH is refitted on the CPU.
+        CPURefitData                          mCPURefitData;            ///< Data for refitting on the CPU. Empty unless the BVH was built with CPU refitting enabled.
         std::vector<uint32_t>                 mNodeIndices;             ///< Array of all node indices sorted by tree depth.
         std::vector<RefitEntryInfo>           mPerDepthRefitEntryInfo;  ///< Array containing for each level the number of internal nodes as well as the corresponding offset into 'mpNodeIndicesBuffer'; the very last entry contains the same data, but for all leaf nodes instead.
         uint32_t                              mMaxTriangleCountPerLeaf = 0; ///< After the BVH is built, this contains the maximum light count per leaf node.
@@ -162,6 +194,8 @@ namespace Falcor
         Buffer::SharedPtr                     mpTriangleIndicesBuffer;  ///< Triangle indices sorted by leaf node. Each leaf node refers to a contiguous array of triangle indices.
         Buffer::SharedPtr                     mpTriangleBitmasksBuffer; ///< Array containing the per triangle bit pattern retracing the tree traversal to reach the triangle: 0=left child, 1=right child.
         Buffer::SharedPtr                     mpNodeIndicesBuffer;      ///< Buffer holding all node indices sorted by tree depth. This is used for BVH refit.
+        Buffer::SharedPtr                     mpWideNodesBuffer;        ///< Buffer holding all wide BVH nodes.
+        Buffer::SharedPtr                     mpWideTriangleBitmasksBuffer; ///< Array containing the per triangle child slots retracing the wide tree traversal to reach the triangle.
 
         friend LightBVHBuilder;
     };
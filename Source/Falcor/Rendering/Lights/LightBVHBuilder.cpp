@@ -28,6 +28,8 @@
 #include "stdafx.h"
 #include "LightBVHBuilder.h"
 #include <algorithm>
+#include <array>
+#include <unordered_set>
 
 namespace
 {
@@ -41,6 +43,12 @@ namespace
     const uint32_t kMaxLeafTriangleCount = 1 << PackedNode::kTriangleCountBits;
     const uint32_t kMaxLeafTriangleOffset = 1 << PackedNode::kTriangleOffsetBits;
 
+    // Subtrees with at least this many triangles are built in parallel.
+    const uint32_t kParallelBuildThreshold = 1 << 14;
+
+    // Split heuristics evaluate the three axes in parallel for nodes with at least this many triangles.
+    const uint32_t kParallelSplitThreshold = 1 << 16;
+
     inline float safeACos(float v)
     {
         return std::acos(glm::clamp(v, -1.0f, 1.0f));
@@ -201,6 +209,101 @@ namespace
         return dir;
     }
 
+    /** Bounding cone that is grown by union with other cones.
+        This is used to incrementally compute the bounding cones of the bin prefixes/suffixes in the SAOH sweeps.
+        The union follows Algorithm 1 in the 2018 Sony EGSR light sampling paper (see coneUnion()),
+        but rotates the axis in the plane of the two cone axes directly.
+    */
+    struct BoundingCone
+    {
+        float3 dir = float3(0.f);
+        float cosTheta = 1.f;
+        bool empty = true;
+
+        /** Returns the cosine of the cone angle, or kInvalidCosConeAngle if the cone is empty or invalid.
+        */
+        float getCosTheta() const { return empty ? kInvalidCosConeAngle : cosTheta; }
+
+        void include(const float3& otherDir, float otherCosTheta)
+        {
+            if (empty)
+            {
+                dir = otherDir;
+                cosTheta = otherCosTheta;
+                empty = false;
+                return;
+            }
+            if (cosTheta == kInvalidCosConeAngle) return;
+            if (otherCosTheta == kInvalidCosConeAngle)
+            {
+                cosTheta = kInvalidCosConeAngle;
+                return;
+            }
+
+            const float theta = safeACos(cosTheta);
+            const float otherTheta = safeACos(otherCosTheta);
+            const float cosDiffTheta = glm::dot(dir, otherDir);
+            const float diffTheta = safeACos(cosDiffTheta);
+
+            // Check if one of the cones encloses the other.
+            if (diffTheta + otherTheta <= theta) return;
+            if (diffTheta + theta <= otherTheta)
+            {
+                dir = otherDir;
+                cosTheta = otherCosTheta;
+                return;
+            }
+
+            // Rotate the axis towards the other cone's axis so that the new cone just encloses both.
+            float newTheta = 0.5f * (theta + diffTheta + otherTheta);
+            const float3 ortho = otherDir - dir * cosDiffTheta;
+            const float orthoLength = glm::length(ortho);
+            if (orthoLength < 1e-6f)
+            {
+                // The axes are pointing in opposite directions. Use any axis orthogonal to them.
+                const float3 perp = std::abs(dir.x) < 0.9f ? glm::cross(dir, float3(1.f, 0.f, 0.f)) : glm::cross(dir, float3(0.f, 1.f, 0.f));
+                dir = glm::normalize(perp);
+                newTheta = glm::half_pi<float>() + std::max(theta, otherTheta);
+            }
+            else
+            {
+                const float rotTheta = newTheta - theta;
+                dir = glm::normalize(dir * std::cos(rotTheta) + ortho * (std::sin(rotTheta) / orthoLength));
+            }
+            cosTheta = newTheta < glm::pi<float>() ? std::cos(newTheta) : kInvalidCosConeAngle;
+        }
+    };
+
+    /** Calls a function for each of the three axes, optionally in parallel.
+    */
+    template<typename Func>
+    void forEachAxis(bool parallel, const Func& func)
+    {
+        if (!parallel)
+        {
+            for (uint32_t axis = 0; axis < 3; ++axis) func(axis);
+            return;
+        }
+
+        Threading::parallelFor(0, 3, [&func](size_t axis) { func((uint32_t)axis); }, 1);
+    }
+
+    /** Offsets the right child index of an internal node or the triangle offset of a leaf node.
+        The packed data is patched directly, as unpacking and repacking the node attributes is lossy.
+    */
+    void relocateNode(PackedNode& node, uint32_t nodeOffset, uint32_t triangleOffset)
+    {
+        if (node.isLeaf())
+        {
+            assert((node.data[0].x & (kMaxLeafTriangleOffset - 1)) + triangleOffset < kMaxLeafTriangleOffset);
+            node.data[0].x += triangleOffset; // Triangle offset is stored in the low bits.
+        }
+        else
+        {
+            node.data[0].x += nodeOffset; // Right child index.
+        }
+    }
+
     /** Returns the volume of a bounding box.
         \param[in] epsilon Replace dimensions that are zero by this value.
         \return the volume of the bounding box if it is valid, -inf otherwise.
@@ -221,6 +324,155 @@ namespace
         { (uint32_t)LightBVHBuilder::SplitHeuristic::BinnedSAH, "Binned SAH" },
         { (uint32_t)LightBVHBuilder::SplitHeuristic::BinnedSAOH, "Binned SAOH" }
     };
+
+    const Gui::DropdownList kBranchingFactorList =
+    {
+        { 2, "Binary" },
+        { 4, "4-wide" },
+        { 8, "8-wide" }
+    };
+
+    // Refitted nodes that are at most this many nodes apart are uploaded in a single copy.
+    const uint32_t kMaxUploadGap = 16;
+
+    /** Uploads the given elements of an array to a GPU buffer.
+        Elements that are close to each other are uploaded in a single copy to reduce the number of copies.
+        \param[in] indices Sorted indices of the elements to upload.
+    */
+    template<typename T>
+    void uploadElements(Buffer* pBuffer, const std::vector<T>& data, const std::vector<uint32_t>& indices)
+    {
+        for (size_t i = 0; i < indices.size();)
+        {
+            const uint32_t begin = indices[i];
+            uint32_t end = begin + 1;
+            while (++i < indices.size() && indices[i] <= end + kMaxUploadGap) end = indices[i] + 1;
+            pBuffer->setBlob(data.data() + begin, begin * sizeof(T), (end - begin) * sizeof(T));
+        }
+    }
+
+    /** Stores the emissive triangles and their object-space positions, so that they can be transformed on the CPU when refitting.
+    */
+    void initRefitTriangles(const LightCollection& lightCollection, const std::vector<LightCollection::MeshLightTriangle>& triangles, LightBVH::CPURefitData& refitData)
+    {
+        refitData.triangles = triangles;
+        refitData.objectPositions.assign(3 * triangles.size(), float3(0.f));
+
+        const auto& meshLights = lightCollection.getMeshLights();
+        for (uint32_t lightIdx = 0; lightIdx < (uint32_t)meshLights.size(); lightIdx++)
+        {
+            // Skinned mesh lights are read back from the GPU when they change.
+            const auto worldMatrix = lightCollection.getMeshLightWorldMatrix(lightIdx);
+            if (!worldMatrix) continue;
+
+            const float4x4 invWorldMatrix = glm::inverse(*worldMatrix);
+            const MeshLightData& meshLight = meshLights[lightIdx];
+            for (uint32_t triIdx = meshLight.triangleOffset; triIdx < meshLight.triangleOffset + meshLight.triangleCount; triIdx++)
+            {
+                for (uint32_t j = 0; j < 3; j++) refitData.objectPositions[3 * triIdx + j] = float3(invWorldMatrix * float4(triangles[triIdx].vtx[j].pos, 1.f));
+            }
+        }
+    }
+
+    /** Transforms the triangles of a mesh light from object space to world space.
+        The normals and areas are computed as in the GPU update of the light collection. The orientation of the normals
+        relative to the triangle winding is kept, as it is given by the winding of the mesh instance, which is not animated.
+    */
+    void transformRefitTriangles(const float4x4& worldMatrix, const MeshLightData& meshLight, LightBVH::CPURefitData& refitData)
+    {
+        for (uint32_t triIdx = meshLight.triangleOffset; triIdx < meshLight.triangleOffset + meshLight.triangleCount; triIdx++)
+        {
+            auto& tri = refitData.triangles[triIdx];
+            const bool isFlipped = glm::dot(glm::cross(tri.vtx[1].pos - tri.vtx[0].pos, tri.vtx[2].pos - tri.vtx[0].pos), tri.normal) < 0.f;
+
+            for (uint32_t j = 0; j < 3; j++) tri.vtx[j].pos = float3(worldMatrix * float4(refitData.objectPositions[3 * triIdx + j], 1.f));
+
+            const float3 N = glm::cross(tri.vtx[1].pos - tri.vtx[0].pos, tri.vtx[2].pos - tri.vtx[0].pos);
+            tri.area = 0.5f * glm::length(N);
+            if (tri.area > 0.f) tri.normal = glm::normalize(isFlipped ? -N : N);
+        }
+    }
+
+    /** Returns the number of bits per level in the traversal bitmasks of a wide BVH.
+    */
+    uint32_t getWideBitsPerLevel(uint32_t branchingFactor)
+    {
+        return branchingFactor > 4 ? 3 : 2;
+    }
+
+    /** Packs a wide node from the attributes of its children.
+        The attributes are quantized conservatively, see PackedWideNode.
+    */
+    PackedWideNode packWideNode(const SharedNodeAttributes* attribs, const uint32_t* childRefs, uint32_t childCount)
+    {
+        assert(childCount > 0 && childCount <= PackedWideNode::kMaxChildCount);
+
+        float3 nodeMin(std::numeric_limits<float>::infinity());
+        float3 nodeMax(-std::numeric_limits<float>::infinity());
+        float maxFlux = 0.f;
+        for (uint32_t i = 0; i < childCount; i++)
+        {
+            nodeMin = glm::min(nodeMin, attribs[i].origin - attribs[i].extent);
+            nodeMax = glm::max(nodeMax, attribs[i].origin + attribs[i].extent);
+            maxFlux = std::max(maxFlux, attribs[i].flux);
+        }
+
+        // Use the smallest power-of-two cell size per axis such that 255 cells cover the node.
+        // The exponents are restricted to normal floats, so that the cell size can be decoded by shifting the exponent bits in place.
+        uint3 biasedExponents;
+        float3 scale;
+        for (uint32_t axis = 0; axis < 3; axis++)
+        {
+            const float extent = nodeMax[axis] - nodeMin[axis];
+            const int exponent = extent > 0.f ? (int)std::ceil(std::log2(extent / 255.f)) : -126;
+            uint32_t biasedExponent = (uint32_t)std::clamp(exponent + 127, 1, 254);
+            while (biasedExponent < 254 && nodeMin[axis] + 255.f * asfloat(biasedExponent << 23) < nodeMax[axis]) biasedExponent++;
+            biasedExponents[axis] = biasedExponent;
+            scale[axis] = asfloat(biasedExponent << 23);
+        }
+
+        PackedWideNode node = {};
+        node.setHeader(nodeMin, biasedExponents, childCount);
+
+        for (uint32_t i = 0; i < childCount; i++)
+        {
+            // Round the child AABB outwards. The decoded corners are computed as in PackedWideNode::getChildAttributes().
+            const float3 childMin = attribs[i].origin - attribs[i].extent;
+            const float3 childMax = attribs[i].origin + attribs[i].extent;
+            uint3 qMin, qMax;
+            for (uint32_t axis = 0; axis < 3; axis++)
+            {
+                int lo = std::clamp((int)std::floor((childMin[axis] - nodeMin[axis]) / scale[axis]), 0, 255);
+                while (lo > 0 && nodeMin[axis] + (float)lo * scale[axis] > childMin[axis]) lo--;
+                int hi = std::clamp((int)std::ceil((childMax[axis] - nodeMin[axis]) / scale[axis]), 0, 255);
+                while (hi < 255 && nodeMin[axis] + (float)hi * scale[axis] < childMax[axis]) hi++;
+                qMin[axis] = (uint32_t)lo;
+                qMax[axis] = (uint32_t)hi;
+            }
+
+            // Widen the cone by the quantization error of its direction, so that the decoded cone encloses the original one.
+            uint32_t qConeAngle = PackedWideNode::kInvalidConeAngle;
+            uint32_t packedConeDirection = 0;
+            if (attribs[i].cosConeAngle != kInvalidCosConeAngle)
+            {
+                packedConeDirection = encodeNormal2x8(attribs[i].coneDirection);
+                const float directionError = safeACos(glm::dot(decodeNormal2x8(packedConeDirection), attribs[i].coneDirection));
+                const float coneAngle = safeACos(attribs[i].cosConeAngle) + directionError + 1e-4f;
+                qConeAngle = std::min((uint32_t)std::ceil(coneAngle * (255.f / glm::pi<float>())), PackedWideNode::kInvalidConeAngle);
+            }
+
+            // Store the flux in 1/8 stops relative to the largest child flux. Zero is reserved for children without flux.
+            uint32_t qFlux = 0;
+            if (attribs[i].flux > 0.f)
+            {
+                qFlux = (uint32_t)std::clamp((int)std::round(255.f + 8.f * std::log2(attribs[i].flux / maxFlux)), 1, 255);
+            }
+
+            node.setChild(i, childRefs[i], qMin, qMax, qConeAngle, qFlux, packedConeDirection);
+        }
+
+        return node;
+    }
 }
 
 namespace Falcor
@@ -244,27 +496,58 @@ namespace Falcor
         const auto& triangles = bvh.mpLightCollection->getMeshLightTriangles();
         if (triangles.empty()) return;
 
+        // Build the tree.
+        std::vector<uint32_t> triangleIndices;
+        std::vector<uint64_t> triangleBitmasks;
+        build(triangles, bvh.mNodes, triangleIndices, triangleBitmasks);
+
+        // If there are no non-culled triangles, we're done.
+        if (bvh.mNodes.empty()) return;
+
+        // The BVH is ready, mark it as valid and upload the data.
+        bvh.mIsValid = true;
+        bvh.mMaxTriangleCountPerLeaf = mOptions.maxTriangleCountPerLeaf;
+        bvh.uploadCPUBuffers(triangleIndices, triangleBitmasks);
+
+        // Collapse the binary BVH into a wide BVH for sampling.
+        const bool useCPURefit = mOptions.allowRefitting && mOptions.useCPURefit;
+        if (mOptions.branchingFactor > 2)
+        {
+            std::vector<uint64_t> wideTriangleBitmasks;
+            collapse(mOptions.branchingFactor, bvh.mNodes, triangleIndices, (uint32_t)triangles.size(), bvh.mWideNodes, wideTriangleBitmasks, useCPURefit ? &bvh.mCPURefitData : nullptr);
+            bvh.mBranchingFactor = mOptions.branchingFactor;
+            bvh.uploadWideBuffers(wideTriangleBitmasks);
+        }
+
+        // Keep the CPU data needed for refitting on the CPU.
+        if (useCPURefit)
+        {
+            initRefitData(bvh.mNodes, triangleIndices, (uint32_t)triangles.size(), bvh.mCPURefitData);
+            initRefitTriangles(*bvh.mpLightCollection, triangles, bvh.mCPURefitData);
+            bvh.mTriangleIndices = std::move(triangleIndices);
+            bvh.mTriangleBitmasks = std::move(triangleBitmasks);
+        }
+
+        // Computate metadata.
+        bvh.finalize();
+    }
+
+    void LightBVHBuilder::build(const std::vector<LightCollection::MeshLightTriangle>& triangles, std::vector<PackedNode>& nodes, std::vector<uint32_t>& triangleIndices, std::vector<uint64_t>& triangleBitmasks) const
+    {
+        nodes.clear();
+        triangleIndices.clear();
+        triangleBitmasks.clear();
+
         // Create list of triangles that should be included in BVH.
         // For each triangle, precompute data we need for the build.
-        BuildingData data(bvh.mNodes);
+        BuildingData data;
         data.trianglesData.reserve(triangles.size());
 
         for (size_t i = 0; i < triangles.size(); i++)
         {
             if (!mOptions.usePreintegration || triangles[i].flux > 0.f)
             {
-                LightBVHBuilder::TriangleSortData tri;
-                for (uint32_t j = 0; j < 3; j++)
-                {
-                    tri.bounds |= triangles[i].vtx[j].pos;
-                }
-                tri.center = triangles[i].getCenter();
-                tri.coneDirection = triangles[i].normal;
-                tri.cosConeAngle = 1.f; // Single flat emitter => normal bounding cone angle is zero.
-                tri.flux = triangles[i].flux;
-                tri.triangleIndex = static_cast<uint32_t>(i);
-
-                data.trianglesData.push_back(tri);
+                data.trianglesData.emplace_back(triangles[i], static_cast<uint32_t>(i));
             }
         }
 
@@ -280,39 +563,192 @@ namespace Falcor
         {
             throw std::exception(("Emissive triangle count exceeds the maximum supported (" + std::to_string(kMaxLeafTriangleOffset + kMaxLeafTriangleCount) + ")").c_str());
         }
+        if (mOptions.branchingFactor != 2 && mOptions.branchingFactor != 4 && mOptions.branchingFactor != 8)
+        {
+            throw std::exception(("Unsupported BVH branching factor (" + std::to_string(mOptions.branchingFactor) + "); must be 2, 4 or 8").c_str());
+        }
 
         // Allocate temporary memory for the BVH build.
         // To be grossly conservative, assume each triangle requires two nodes.
         // This is only system RAM and shouldn't be that much, so it's not worth being more careful about it.
         // TODO: Better estimate of how many nodes we will need.
-        data.nodes.clear();
-        data.nodes.reserve(2 * data.trianglesData.size());
-        data.triangleIndices.reserve(data.trianglesData.size());
+        SubtreeData tree;
+        tree.nodes.reserve(2 * data.trianglesData.size());
+        tree.triangleIndices.reserve(data.trianglesData.size());
 
         const uint64_t invalidBitmask = std::numeric_limits<uint64_t>::max();
         data.triangleBitmasks.resize(triangles.size(), invalidBitmask); // This is sized based on input triangle count, as it's indexed by global triangle index.
 
-        // Build the tree.
+        // Build the tree. This also computes the per-node light bounding cones.
         SplitHeuristicFunction splitFunc = getSplitFunction(mOptions.splitHeuristicSelection);
-        buildInternal(mOptions, splitFunc, 0ull, 0, Range(0, static_cast<uint32_t>(data.trianglesData.size())), data);
-        assert(!data.nodes.empty());
+        float cosConeAngle;
+        float3 coneDirection;
+        buildInternal(mOptions, splitFunc, 0ull, 0, Range(0, static_cast<uint32_t>(data.trianglesData.size())), data, tree, cosConeAngle, coneDirection);
+        assert(!tree.nodes.empty());
 
         size_t numValid = 0;
         for (auto mask : data.triangleBitmasks)
             if (mask != invalidBitmask) numValid++;
         assert(numValid == data.trianglesData.size());
 
-        // Compute per-node light bounding cones.
-        float cosConeAngle;
-        computeLightingConesInternal(0, data, cosConeAngle);
+        nodes = std::move(tree.nodes);
+        triangleIndices = std::move(tree.triangleIndices);
+        triangleBitmasks = std::move(data.triangleBitmasks);
+    }
 
-        // The BVH is ready, mark it as valid and upload the data.
-        bvh.mIsValid = true;
-        bvh.mMaxTriangleCountPerLeaf = mOptions.maxTriangleCountPerLeaf;
-        bvh.uploadCPUBuffers(data.triangleIndices, data.triangleBitmasks);
+    void LightBVHBuilder::collapse(uint32_t branchingFactor, const std::vector<PackedNode>& nodes, const std::vector<uint32_t>& triangleIndices, uint32_t triangleCount,
+        std::vector<PackedWideNode>& wideNodes, std::vector<uint64_t>& wideTriangleBitmasks, LightBVH::CPURefitData* pRefitData)
+    {
+        if (branchingFactor != 4 && branchingFactor != 8)
+        {
+            throw std::exception(("Unsupported wide BVH branching factor (" + std::to_string(branchingFactor) + "); must be 4 or 8").c_str());
+        }
 
-        // Computate metadata.
-        bvh.finalize();
+        wideNodes.clear();
+        wideTriangleBitmasks.assign(triangleCount, std::numeric_limits<uint64_t>::max());
+        if (pRefitData)
+        {
+            pRefitData->wideChildIndices.clear();
+            pRefitData->wideParentIndices.assign(nodes.size(), LightBVH::CPURefitData::kInvalidIndex);
+        }
+        if (nodes.empty()) return;
+
+        // The traversal path to each leaf is stored in a 64-bit mask, which limits the depth of the wide BVH.
+        const uint32_t bitsPerLevel = getWideBitsPerLevel(branchingFactor);
+        const uint32_t maxDepth = 64 / bitsPerLevel;
+
+        // Count the triangles below each node. Nodes are stored in depth-first order, so the children come after their parent.
+        std::vector<uint32_t> nodeTriangleCounts(nodes.size());
+        for (size_t nodeIndex = nodes.size(); nodeIndex-- > 0;)
+        {
+            const PackedNode& node = nodes[nodeIndex];
+            nodeTriangleCounts[nodeIndex] = node.isLeaf() ? node.getLeafNode().triangleCount :
+                nodeTriangleCounts[nodeIndex + 1] + nodeTriangleCounts[node.getInternalNode().rightChildIdx];
+        }
+
+        wideNodes.reserve(nodes.size() / (branchingFactor - 1) + 1);
+
+        std::function<uint32_t(uint32_t, uint32_t, uint64_t)> collapseNode = [&](uint32_t nodeIndex, uint32_t depth, uint64_t bitmask)
+        {
+            if (depth >= maxDepth)
+            {
+                throw std::exception(("Wide BVH depth of " + std::to_string(depth + 1) + " reached; maximum of " + std::to_string(maxDepth) + " allowed.").c_str());
+            }
+
+            // Gather the children by opening the internal child with the most triangles until the branching factor is reached.
+            // Opening the largest subtrees first keeps the wide BVH shallow. The children are kept in depth-first order.
+            std::array<uint32_t, PackedWideNode::kMaxChildCount> children;
+            uint32_t childCount = 0;
+            if (nodes[nodeIndex].isLeaf())
+            {
+                // Only happens if the root is a leaf.
+                children[childCount++] = nodeIndex;
+            }
+            else
+            {
+                children[childCount++] = nodeIndex + 1;
+                children[childCount++] = nodes[nodeIndex].getInternalNode().rightChildIdx;
+            }
+
+            while (childCount < branchingFactor)
+            {
+                int openIndex = -1;
+                for (uint32_t i = 0; i < childCount; i++)
+                {
+                    if (nodes[children[i]].isLeaf()) continue;
+                    if (openIndex < 0 || nodeTriangleCounts[children[i]] > nodeTriangleCounts[children[openIndex]]) openIndex = (int)i;
+                }
+                if (openIndex < 0) break;
+
+                const uint32_t openNodeIndex = children[openIndex];
+                for (uint32_t i = childCount; i > (uint32_t)openIndex + 1; i--) children[i] = children[i - 1];
+                children[openIndex] = openNodeIndex + 1;
+                children[openIndex + 1] = nodes[openNodeIndex].getInternalNode().rightChildIdx;
+                childCount++;
+            }
+
+            // Allocate the wide node before its children to store the nodes in depth-first order.
+            const uint32_t wideNodeIndex = (uint32_t)wideNodes.size();
+            assert(wideNodeIndex < (1u << 31));
+            wideNodes.push_back({});
+            if (pRefitData)
+            {
+                auto& wideChildIndices = pRefitData->wideChildIndices;
+                wideChildIndices.resize(wideChildIndices.size() + PackedWideNode::kMaxChildCount, LightBVH::CPURefitData::kInvalidIndex);
+                for (uint32_t i = 0; i < childCount; i++)
+                {
+                    wideChildIndices[wideNodeIndex * PackedWideNode::kMaxChildCount + i] = children[i];
+                    pRefitData->wideParentIndices[children[i]] = wideNodeIndex;
+                }
+            }
+
+            std::array<SharedNodeAttributes, PackedWideNode::kMaxChildCount> attribs;
+            std::array<uint32_t, PackedWideNode::kMaxChildCount> childRefs;
+            for (uint32_t i = 0; i < childCount; i++)
+            {
+                const PackedNode& child = nodes[children[i]];
+                const uint64_t childBitmask = bitmask | ((uint64_t)i << (depth * bitsPerLevel));
+                attribs[i] = child.getNodeAttributes();
+
+                if (child.isLeaf())
+                {
+                    // Leaf children are referenced with the same layout as the binary leaf nodes.
+                    childRefs[i] = child.data[0].x;
+                    const LeafNode leaf = child.getLeafNode();
+                    for (uint32_t j = 0; j < leaf.triangleCount; j++)
+                    {
+                        wideTriangleBitmasks[triangleIndices[leaf.triangleOffset + j]] = childBitmask;
+                    }
+                }
+                else
+                {
+                    childRefs[i] = collapseNode(children[i], depth + 1, childBitmask);
+                }
+            }
+
+            wideNodes[wideNodeIndex] = packWideNode(attribs.data(), childRefs.data(), childCount);
+            return wideNodeIndex;
+        };
+
+        collapseNode(0, 0, 0ull);
+    }
+
+    std::vector<uint32_t> LightBVHBuilder::refitWideNodes(const std::vector<PackedNode>& nodes, const std::vector<uint32_t>& refitNodes, const LightBVH::CPURefitData& refitData,
+        std::vector<PackedWideNode>& wideNodes)
+    {
+        const uint32_t kMaxChildCount = PackedWideNode::kMaxChildCount;
+        assert(refitData.wideParentIndices.size() == nodes.size());
+        assert(refitData.wideChildIndices.size() == wideNodes.size() * kMaxChildCount);
+
+        // Find the wide nodes with refitted children. The binary nodes opened by a wide node are not stored, so they don't affect it.
+        std::vector<uint32_t> wideNodeIndices;
+        for (uint32_t nodeIndex : refitNodes)
+        {
+            const uint32_t wideNodeIndex = refitData.wideParentIndices[nodeIndex];
+            if (wideNodeIndex != LightBVH::CPURefitData::kInvalidIndex) wideNodeIndices.push_back(wideNodeIndex);
+        }
+        std::sort(wideNodeIndices.begin(), wideNodeIndices.end());
+        wideNodeIndices.erase(std::unique(wideNodeIndices.begin(), wideNodeIndices.end()), wideNodeIndices.end());
+
+        // Repack the wide nodes. All children are repacked, as they are quantized relative to the bounds and flux of the node.
+        for (uint32_t wideNodeIndex : wideNodeIndices)
+        {
+            PackedWideNode& wideNode = wideNodes[wideNodeIndex];
+            const uint32_t childCount = wideNode.getChildCount();
+
+            std::array<SharedNodeAttributes, kMaxChildCount> attribs;
+            std::array<uint32_t, kMaxChildCount> childRefs;
+            for (uint32_t i = 0; i < childCount; i++)
+            {
+                const uint32_t nodeIndex = refitData.wideChildIndices[wideNodeIndex * kMaxChildCount + i];
+                assert(nodeIndex < nodes.size());
+                attribs[i] = nodes[nodeIndex].getNodeAttributes();
+                childRefs[i] = wideNode.getChildRef(i);
+            }
+            wideNode = packWideNode(attribs.data(), childRefs.data(), childCount);
+        }
+
+        return wideNodeIndices;
     }
 
     bool LightBVHBuilder::renderUI(Gui::Widgets& widget)
@@ -326,8 +762,21 @@ namespace Falcor
         bool optionsChanged = false;
 
         optionsChanged |= widget.checkbox("Allow refitting", options.allowRefitting);
+        if (options.allowRefitting)
+        {
+            optionsChanged |= widget.checkbox("Refit on CPU", options.useCPURefit);
+            widget.tooltip("Refit the BVH on the CPU, only updating the nodes above lights that have changed.\n"
+                "Subtrees whose relative SAOH cost has degraded beyond the rebuild threshold are rebuilt. This also allows refitting wide BVHs.");
+            if (options.useCPURefit)
+            {
+                optionsChanged |= widget.var("Rebuild threshold", options.rebuildCostThreshold, 0.f, std::numeric_limits<float>::max(), 0.1f);
+                widget.tooltip("Relative SAOH cost growth of a subtree since it was built at which it is rebuilt. Set to zero to disable partial rebuilds.");
+            }
+        }
         optionsChanged |= widget.var("Max triangle count per leaf", options.maxTriangleCountPerLeaf, 1u, kMaxLeafTriangleCount);
         optionsChanged |= widget.dropdown("Split heuristic", kSplitHeuristicList, (uint32_t&)options.splitHeuristicSelection);
+        optionsChanged |= widget.dropdown("Branching factor", kBranchingFactorList, options.branchingFactor);
+        widget.tooltip("Wide BVHs are built by collapsing the binary BVH into nodes with quantized attributes. Wide BVHs are rebuilt instead of refitted, unless refitting on the CPU.");
 
         if (auto splitGroup = widget.group("Split Options", true))
         {
@@ -360,7 +809,35 @@ namespace Falcor
     {
     }
 
-    uint32_t LightBVHBuilder::buildInternal(const Options& options, const SplitHeuristicFunction& splitHeuristic, uint64_t bitmask, uint32_t depth, const Range& triangleRange, BuildingData& data)
+    LightBVHBuilder::TriangleSortData::TriangleSortData(const LightCollection::MeshLightTriangle& triangle, uint32_t triangleIndex)
+    {
+        for (uint32_t j = 0; j < 3; j++)
+        {
+            bounds |= triangle.vtx[j].pos;
+        }
+        center = triangle.getCenter();
+        coneDirection = triangle.normal;
+        cosConeAngle = 1.f; // Single flat emitter => normal bounding cone angle is zero.
+        flux = triangle.flux;
+        this->triangleIndex = triangleIndex;
+    }
+
+    void LightBVHBuilder::SubtreeData::append(const SubtreeData& other)
+    {
+        const uint32_t nodeOffset = (uint32_t)nodes.size();
+        const uint32_t triangleOffset = (uint32_t)triangleIndices.size();
+
+        nodes.reserve(nodes.size() + other.nodes.size());
+        for (PackedNode node : other.nodes)
+        {
+            relocateNode(node, nodeOffset, triangleOffset);
+            nodes.push_back(node);
+        }
+
+        triangleIndices.insert(triangleIndices.end(), other.triangleIndices.begin(), other.triangleIndices.end());
+    }
+
+    uint32_t LightBVHBuilder::buildInternal(const Options& options, const SplitHeuristicFunction& splitHeuristic, uint64_t bitmask, uint32_t depth, const Range& triangleRange, BuildingData& data, SubtreeData& subtree, float& cosConeAngle, float3& coneDirection)
     {
         assert(triangleRange.begin < triangleRange.end);
 
@@ -374,10 +851,8 @@ namespace Falcor
         }
         assert(nodeBounds.valid());
 
-        data.currentNodeFlux = nodeFlux;
-
         bool trySplitting = triangleRange.length() > (options.createLeavesASAP ? options.maxTriangleCountPerLeaf : 1);
-        const SplitResult splitResult = trySplitting ? splitHeuristic(data, triangleRange, nodeBounds, options) : SplitResult();
+        const SplitResult splitResult = trySplitting ? splitHeuristic(data, triangleRange, nodeBounds, nodeFlux, options) : SplitResult();
 
         // If we should split, then create an internal node and split.
         if (splitResult.isValid())
@@ -389,14 +864,13 @@ namespace Falcor
             std::nth_element(std::begin(data.trianglesData) + triangleRange.begin, std::begin(data.trianglesData) + splitResult.triangleIndex, std::begin(data.trianglesData) + triangleRange.end, comp);
 
             // Allocate internal node.
-            assert(data.nodes.size() < std::numeric_limits<uint32_t>::max());
-            const uint32_t nodeIndex = (uint32_t)data.nodes.size();
-            data.nodes.push_back({});
+            assert(subtree.nodes.size() < std::numeric_limits<uint32_t>::max());
+            const uint32_t nodeIndex = (uint32_t)subtree.nodes.size();
+            subtree.nodes.push_back({});
 
             InternalNode node = {};
             node.attribs.setAABB(nodeBounds.minPoint, nodeBounds.maxPoint);
             node.attribs.flux = nodeFlux;
-            // The lighting normal bounding cone will be computed later when all leaf nodes have been created.
 
             if (depth >= kMaxBVHDepth)
             {
@@ -405,13 +879,47 @@ namespace Falcor
                 throw std::exception(("BVH depth of " + std::to_string(depth + 1) + " reached; maximum of " + std::to_string(kMaxBVHDepth) + " allowed.").c_str());
             }
 
-            uint32_t leftIndex = buildInternal(options, splitHeuristic, bitmask | (0ull << depth), depth + 1, Range(triangleRange.begin, splitResult.triangleIndex), data);
-            uint32_t rightIndex = buildInternal(options, splitHeuristic, bitmask | (1ull << depth), depth + 1, Range(splitResult.triangleIndex, triangleRange.end), data);
+            const Range leftRange(triangleRange.begin, splitResult.triangleIndex);
+            const Range rightRange(splitResult.triangleIndex, triangleRange.end);
+            float leftCosConeAngle = kInvalidCosConeAngle, rightCosConeAngle = kInvalidCosConeAngle;
+            float3 leftConeDirection, rightConeDirection;
+            uint32_t leftIndex, rightIndex;
+
+            if (triangleRange.length() >= kParallelBuildThreshold)
+            {
+                // Build the right subtree in a separate task and append it after the left subtree.
+                // This generates the same node order as the sequential depth-first build.
+                // The task group also waits for the task if building the left subtree throws, as the task references local variables.
+                SubtreeData rightSubtree;
+                Threading::TaskGroup rightTask;
+                rightTask.run([&]()
+                {
+                    buildInternal(options, splitHeuristic, bitmask | (1ull << depth), depth + 1, rightRange, data, rightSubtree, rightCosConeAngle, rightConeDirection);
+                });
+                leftIndex = buildInternal(options, splitHeuristic, bitmask | (0ull << depth), depth + 1, leftRange, data, subtree, leftCosConeAngle, leftConeDirection);
+                rightTask.wait();
+
+                rightIndex = (uint32_t)subtree.nodes.size();
+                subtree.append(rightSubtree);
+            }
+            else
+            {
+                leftIndex = buildInternal(options, splitHeuristic, bitmask | (0ull << depth), depth + 1, leftRange, data, subtree, leftCosConeAngle, leftConeDirection);
+                rightIndex = buildInternal(options, splitHeuristic, bitmask | (1ull << depth), depth + 1, rightRange, data, subtree, rightCosConeAngle, rightConeDirection);
+            }
 
             assert(leftIndex == nodeIndex + 1); // The left node should always be placed immediately after the current node.
             node.rightChildIdx = rightIndex;
 
-            data.nodes[nodeIndex].setInternalNode(node);
+            // Compute the lighting normal bounding cone from the children's cones.
+            // TODO: Asserts in coneUnion
+            //coneDirection = coneUnion(leftConeDirection, leftCosConeAngle,
+            coneDirection = coneUnionOld(leftConeDirection, leftCosConeAngle,
+                rightConeDirection, rightCosConeAngle, cosConeAngle);
+            node.attribs.cosConeAngle = cosConeAngle;
+            node.attribs.coneDirection = coneDirection;
+
+            subtree.nodes[nodeIndex].setInternalNode(node);
             return nodeIndex;
         }
         else // No split => create leaf node
@@ -419,9 +927,9 @@ namespace Falcor
             assert(triangleRange.length() <= options.maxTriangleCountPerLeaf);
 
             // Allocate leaf node.
-            assert(data.nodes.size() < std::numeric_limits<uint32_t>::max());
-            const uint32_t nodeIndex = (uint32_t)data.nodes.size();
-            data.nodes.push_back({});
+            assert(subtree.nodes.size() < std::numeric_limits<uint32_t>::max());
+            const uint32_t nodeIndex = (uint32_t)subtree.nodes.size();
+            subtree.nodes.push_back({});
 
             LeafNode node = {};
             node.attribs.setAABB(nodeBounds.minPoint, nodeBounds.maxPoint);
@@ -431,55 +939,25 @@ namespace Falcor
             node.attribs.cosConeAngle = cosTheta;
 
             node.triangleCount = triangleRange.length();
-            node.triangleOffset = (uint32_t)data.triangleIndices.size();
+            node.triangleOffset = (uint32_t)subtree.triangleIndices.size();
             assert(node.triangleCount < kMaxLeafTriangleCount);
             assert(node.triangleOffset < kMaxLeafTriangleOffset);
 
             for (uint32_t triangleIdx = triangleRange.begin, index = 0; triangleIdx < triangleRange.end; ++triangleIdx, ++index)
             {
                 uint32_t globalTriangleIndex = data.trianglesData[triangleIdx].triangleIndex;
-                data.triangleIndices.push_back(globalTriangleIndex);
+                subtree.triangleIndices.push_back(globalTriangleIndex);
                 data.triangleBitmasks[globalTriangleIndex] = bitmask;
             }
-            assert(data.triangleIndices.size() == node.triangleOffset + node.triangleCount);
-
-            data.nodes[nodeIndex].setLeafNode(node);
-            return nodeIndex;
-        }
-    }
-
-    float3 LightBVHBuilder::computeLightingConesInternal(const uint32_t nodeIndex, BuildingData& data, float& cosConeAngle)
-    {
-        if (!data.nodes[nodeIndex].isLeaf())
-        {
-            auto node = data.nodes[nodeIndex].getInternalNode();
-
-            uint32_t leftIndex = nodeIndex + 1;
-            uint32_t rightIndex = node.rightChildIdx;
-
-            float leftNodeCosConeAngle = kInvalidCosConeAngle;
-            float3 leftNodeConeDirection = computeLightingConesInternal(leftIndex, data, leftNodeCosConeAngle);
-            float rightNodeCosConeAngle = kInvalidCosConeAngle;
-            float3 rightNodeConeDirection = computeLightingConesInternal(rightIndex, data, rightNodeCosConeAngle);
+            assert(subtree.triangleIndices.size() == node.triangleOffset + node.triangleCount);
 
-            // TODO: Asserts in coneUnion
-            //float3 coneDirection = coneUnion(leftNodeConeDirection, leftNodeCosConeAngle,
-            float3 coneDirection = coneUnionOld(leftNodeConeDirection, leftNodeCosConeAngle,
-                rightNodeConeDirection, rightNodeCosConeAngle, cosConeAngle);
-
-            // Update bounding cone.
-            node.attribs.cosConeAngle = cosConeAngle;
-            node.attribs.coneDirection = coneDirection;
-            data.nodes[nodeIndex].setNodeAttributes(node.attribs);
+            subtree.nodes[nodeIndex].setLeafNode(node);
 
-            return coneDirection;
-        }
-        else
-        {
-            // Load bounding cone.
-            auto attribs = data.nodes[nodeIndex].getNodeAttributes();
+            // Return the bounding cone as stored in the node.
+            auto attribs = subtree.nodes[nodeIndex].getNodeAttributes();
             cosConeAngle = attribs.cosConeAngle;
-            return attribs.coneDirection;
+            coneDirection = attribs.coneDirection;
+            return nodeIndex;
         }
     }
 
@@ -508,7 +986,7 @@ namespace Falcor
         return coneDirection;
     }
 
-    LightBVHBuilder::SplitResult LightBVHBuilder::computeSplitWithEqual(const BuildingData& /*data*/, const Range& triangleRange, const AABB& nodeBounds, const Options& /*parameters*/)
+    LightBVHBuilder::SplitResult LightBVHBuilder::computeSplitWithEqual(const BuildingData& /*data*/, const Range& triangleRange, const AABB& nodeBounds, float /*nodeFlux*/, const Options& /*parameters*/)
     {
         // Find the largest dimension.
         float3 dimensions = nodeBounds.extent();
@@ -535,7 +1013,7 @@ namespace Falcor
         return cost;
     }
 
-    LightBVHBuilder::SplitResult LightBVHBuilder::computeSplitWithBinnedSAH(const BuildingData& data, const Range& triangleRange, const AABB& nodeBounds, const Options& parameters)
+    LightBVHBuilder::SplitResult LightBVHBuilder::computeSplitWithBinnedSAH(const BuildingData& data, const Range& triangleRange, const AABB& nodeBounds, float nodeFlux, const Options& parameters)
     {
         std::pair<float, SplitResult> overallBestSplit = std::make_pair(std::numeric_limits<float>::infinity(), SplitResult());
         assert(!overallBestSplit.second.isValid());
@@ -556,15 +1034,19 @@ namespace Falcor
         };
 
         assert(parameters.binCount > 1);
-        std::vector<Bin> bins(parameters.binCount);
-        std::vector<float> costs(parameters.binCount - 1);
+        std::array<std::pair<float, SplitResult>, 3> axisSplits;
+        axisSplits.fill(std::make_pair(std::numeric_limits<float>::infinity(), SplitResult()));
 
         /** Helper function that computes the best split along the given dimension using the SAH metric.
             The triangles are binned to n bins, storing only the aggregate parameters (triangle count and bounds).
             Then the cost metric is evaluated for each of the n-1 potential splits.
+            The result is stored in axisSplits, so that the dimensions can be processed in parallel.
         */
-        const auto binAlongDimension = [&bins, &costs, &triangleRange, &data, &parameters, &overallBestSplit, &nodeBounds](uint32_t dimension)
+        const auto binAlongDimension = [&axisSplits, &triangleRange, &data, &parameters, &nodeBounds](uint32_t dimension)
         {
+            std::vector<Bin> bins(parameters.binCount);
+            std::vector<float> costs(parameters.binCount - 1);
+
             // Helper to compute the bin id for a given triangle.
             auto getBinId = [&](const TriangleSortData& td)
             {
@@ -576,9 +1058,6 @@ namespace Falcor
                 return std::min((uint32_t)((p - bmin) * scale), parameters.binCount - 1);
             };
 
-            // Reset the bins.
-            for (Bin& bin : bins) bin = Bin();
-
             // Fill the bins with all triangles.
             for (uint32_t i = triangleRange.begin; i < triangleRange.end; ++i)
             {
@@ -619,11 +1098,7 @@ namespace Falcor
             if (axisBestSplit.second.triangleIndex == triangleRange.begin ||
                 axisBestSplit.second.triangleIndex == triangleRange.end) return;
 
-            if (axisBestSplit.first < overallBestSplit.first)
-            {
-                overallBestSplit = axisBestSplit;
-                assert(triangleRange.begin < overallBestSplit.second.triangleIndex && overallBestSplit.second.triangleIndex < triangleRange.end);
-            }
+            axisSplits[dimension] = axisBestSplit;
         };
 
         if (parameters.splitAlongLargest)
@@ -637,9 +1112,16 @@ namespace Falcor
         }
         else
         {
-            for (uint32_t dimension = 0; dimension < 3; ++dimension)
+            forEachAxis(triangleRange.length() >= kParallelSplitThreshold, binAlongDimension);
+        }
+
+        // Pick the cheapest split. Dimensions are visited in order to make the result independent of the parallel evaluation.
+        for (const auto& axisSplit : axisSplits)
+        {
+            if (axisSplit.second.isValid() && axisSplit.first < overallBestSplit.first)
             {
-                binAlongDimension(dimension);
+                overallBestSplit = axisSplit;
+                assert(triangleRange.begin < overallBestSplit.second.triangleIndex && overallBestSplit.second.triangleIndex < triangleRange.end);
             }
         }
 
@@ -648,7 +1130,7 @@ namespace Falcor
         {
             if (triangleRange.length() <= parameters.maxTriangleCountPerLeaf) return SplitResult();
             logWarning("LightBVHBuilder::computeSplitWithBinnedSAH() was not able to compute a proper split: reverting to LightBVHBuilder::computeSplitWithEqual()");
-            return computeSplitWithEqual(data, triangleRange, nodeBounds, parameters);
+            return computeSplitWithEqual(data, triangleRange, nodeBounds, nodeFlux, parameters);
         }
 
         // If the best split we found is more expensive than the cost of a leaf node (and we can create one), then create a leaf node.
@@ -690,7 +1172,7 @@ namespace Falcor
         return cost;
     }
 
-    LightBVHBuilder::SplitResult LightBVHBuilder::computeSplitWithBinnedSAOH(const BuildingData& data, const Range& triangleRange, const AABB& nodeBounds, const Options& parameters)
+    LightBVHBuilder::SplitResult LightBVHBuilder::computeSplitWithBinnedSAOH(const BuildingData& data, const Range& triangleRange, const AABB& nodeBounds, float nodeFlux, const Options& parameters)
     {
         std::pair<float, SplitResult> overallBestSplit = std::make_pair(std::numeric_limits<float>::infinity(), SplitResult());
         assert(!overallBestSplit.second.isValid());
@@ -722,8 +1204,8 @@ namespace Falcor
         };
 
         assert(parameters.binCount > 1);
-        std::vector<Bin> bins(parameters.binCount);
-        std::vector<float> costs(parameters.binCount - 1);
+        std::array<std::pair<float, SplitResult>, 3> axisSplits;
+        axisSplits.fill(std::make_pair(std::numeric_limits<float>::infinity(), SplitResult()));
 
         /** Helper function that computes the best split along the given dimension using the SAOH metric.
             The triangles are binned to n bins, storing only the aggregate parameters (triangle count, bounds, flux, and cone direction).
@@ -731,9 +1213,13 @@ namespace Falcor
             Note that while the bounds and flux are accurately represented by the aggregated parameters,
             the bounding cones are approximates based on the bins' bounding cones. This is less expensive,
             but also less precise than computing them directly from the triangles.
+            The result is stored in axisSplits, so that the dimensions can be processed in parallel.
         */
-        const auto binAlongDimension = [&bins, &costs, &triangleRange, &data, &parameters, &overallBestSplit, &nodeBounds, largestDimension, dimensions](uint32_t dimension)
+        const auto binAlongDimension = [&axisSplits, &triangleRange, &data, &parameters, &nodeBounds, largestDimension, dimensions](uint32_t dimension)
         {
+            std::vector<Bin> bins(parameters.binCount);
+            std::vector<float> costs(parameters.binCount - 1);
+
             // Helper to compute the bin id for a given triangle.
             auto getBinId = [&](const TriangleSortData& td)
             {
@@ -746,9 +1232,6 @@ namespace Falcor
                 return std::min((uint32_t)((p - bmin) * scale), parameters.binCount - 1);
             };
 
-            // Reset the bins.
-            for (Bin& bin : bins) bin = Bin();
-
             // Fill the bins with all triangles.
             for (uint32_t i = triangleRange.begin; i < triangleRange.end; ++i)
             {
@@ -774,45 +1257,24 @@ namespace Falcor
 
             // First, compute A_j(L) * N_j(L) by sweeping over the bins from left to right.
             // Note that the costs vector has n-1 elements when there are n bins; the i:th elements represents the split between bin i and i+1.
+            // The bounding cone of the union of bins 0..i is grown incrementally. Empty bins don't contribute to it.
             Bin total = Bin();
+            BoundingCone cone;
             for (std::size_t i = 0; i < costs.size(); ++i)
             {
                 total |= bins[i];
-
-                // Compute the bounding cone angle for the union of bins 0..i.
-                float cosTheta = kInvalidCosConeAngle;
-                if (glm::length(total.coneDirection) >= FLT_MIN)
-                {
-                    cosTheta = 1.f;
-                    float3 coneDir = glm::normalize(total.coneDirection);
-                    for (std::size_t j = 0; j <= i; ++j)
-                    {
-                        cosTheta = computeCosConeAngle(coneDir, cosTheta, bins[j].coneDirection, bins[j].cosConeAngle);
-                    }
-                }
-
-                costs[i] = evalSAOH(total.bounds, total.flux, cosTheta, parameters);
+                if (bins[i].triangleCount > 0) cone.include(bins[i].coneDirection, bins[i].cosConeAngle);
+                costs[i] = evalSAOH(total.bounds, total.flux, cone.getCosTheta(), parameters);
             }
 
             // Then, compute A_j(R) * N_j(R) by sweeping over the bins from right to left.
             total = Bin();
+            cone = BoundingCone();
             for (std::size_t i = costs.size(); i > 0; --i)
             {
                 total |= bins[i];
-
-                // Compute the bounding cone angle for the union of bins i..n-1.
-                float cosTheta = kInvalidCosConeAngle;
-                if (glm::length(total.coneDirection) >= FLT_MIN)
-                {
-                    cosTheta = 1.f;
-                    float3 coneDir = glm::normalize(total.coneDirection);
-                    for (std::size_t j = i; j <= costs.size(); ++j)
-                    {
-                        cosTheta = computeCosConeAngle(coneDir, cosTheta, bins[j].coneDirection, bins[j].cosConeAngle);
-                    }
-                }
-
-                costs[i - 1] += evalSAOH(total.bounds, total.flux, cosTheta, parameters);
+                if (bins[i].triangleCount > 0) cone.include(bins[i].coneDirection, bins[i].cosConeAngle);
+                costs[i - 1] += evalSAOH(total.bounds, total.flux, cone.getCosTheta(), parameters);
             }
 
             // Compute the cheapest split along the current dimension.
@@ -834,11 +1296,7 @@ namespace Falcor
             if (axisBestSplit.second.triangleIndex == triangleRange.begin ||
                 axisBestSplit.second.triangleIndex == triangleRange.end) return;
 
-            if (axisBestSplit.first < overallBestSplit.first)
-            {
-                overallBestSplit = axisBestSplit;
-                assert(triangleRange.begin < overallBestSplit.second.triangleIndex && overallBestSplit.second.triangleIndex < triangleRange.end);
-            }
+            axisSplits[dimension] = axisBestSplit;
         };
 
         // Compute the best split.
@@ -848,9 +1306,16 @@ namespace Falcor
         }
         else
         {
-            for (uint32_t dimension = 0; dimension < 3; ++dimension)
+            forEachAxis(triangleRange.length() >= kParallelSplitThreshold, binAlongDimension);
+        }
+
+        // Pick the cheapest split. Dimensions are visited in order to make the result independent of the parallel evaluation.
+        for (const auto& axisSplit : axisSplits)
+        {
+            if (axisSplit.second.isValid() && axisSplit.first < overallBestSplit.first)
             {
-                binAlongDimension(dimension);
+                overallBestSplit = axisSplit;
+                assert(triangleRange.begin < overallBestSplit.second.triangleIndex && overallBestSplit.second.triangleIndex < triangleRange.end);
             }
         }
 
@@ -859,7 +1324,7 @@ namespace Falcor
         {
             if (triangleRange.length() <= parameters.maxTriangleCountPerLeaf) return SplitResult();
             logWarning("LightBVHBuilder::computeSplitWithBinnedSAOH() was not able to compute a proper split: reverting to LightBVHBuilder::computeSplitWithEqual()");
-            return computeSplitWithEqual(data, triangleRange, nodeBounds, parameters);
+            return computeSplitWithEqual(data, triangleRange, nodeBounds, nodeFlux, parameters);
         }
 
         // If the best split we found is more expensive than the cost of a leaf node (and we can create one), then create a leaf node.
@@ -869,7 +1334,7 @@ namespace Falcor
             // Evaluate the cost metric for the node. This requires us to first compute the cone angle.
             float cosTheta = kInvalidCosConeAngle;
             computeLightingCone(triangleRange, data, cosTheta);
-            float leafCost = evalSAOH(nodeBounds, data.currentNodeFlux, cosTheta, parameters);
+            float leafCost = evalSAOH(nodeBounds, nodeFlux, cosTheta, parameters);
             if (leafCost <= overallBestSplit.first) return SplitResult();
         }
 
@@ -892,6 +1357,376 @@ namespace Falcor
         }
     }
 
+    /** Evaluates the SAOH cost metric for a packed node.
+    */
+    static float evalNodeSAOH(const PackedNode& node, const LightBVHBuilder::Options& parameters)
+    {
+        const SharedNodeAttributes attribs = node.getNodeAttributes();
+        float3 aabbMin, aabbMax;
+        attribs.getAABB(aabbMin, aabbMax);
+        return evalSAOH(AABB(aabbMin, aabbMax), attribs.flux, attribs.cosConeAngle, parameters);
+    }
+
+    /** Updates the summed SAOH cost of the subtree rooted at a node. The costs of the children must be up-to-date.
+        \return Ratio of the subtree cost to the node's own cost, which measures the quality of the subtree.
+    */
+    static float updateSubtreeCost(const std::vector<PackedNode>& nodes, uint32_t nodeIndex, LightBVH::CPURefitData& refitData, const LightBVHBuilder::Options& parameters)
+    {
+        const PackedNode& node = nodes[nodeIndex];
+        const float nodeCost = evalNodeSAOH(node, parameters);
+        float subtreeCost = nodeCost;
+        if (!node.isLeaf()) subtreeCost += refitData.subtreeCosts[nodeIndex + 1] + refitData.subtreeCosts[node.getInternalNode().rightChildIdx];
+        refitData.subtreeCosts[nodeIndex] = subtreeCost;
+        return nodeCost > 0.f ? subtreeCost / nodeCost : 1.f;
+    }
+
+    /** Recomputes the attributes of a leaf node from its triangles.
+        This matches the leaf nodes created by LightBVHBuilder::buildInternal().
+    */
+    static void refitLeafNode(PackedNode& packedNode, const std::vector<LightCollection::MeshLightTriangle>& triangles, const std::vector<uint32_t>& triangleIndices)
+    {
+        LeafNode node = packedNode.getLeafNode();
+
+        AABB bounds;
+        float flux = 0.f;
+        float3 coneDirectionSum = float3(0.f);
+        for (uint32_t i = 0; i < node.triangleCount; i++)
+        {
+            const auto& triangle = triangles[triangleIndices[node.triangleOffset + i]];
+            for (uint32_t j = 0; j < 3; j++) bounds |= triangle.vtx[j].pos;
+            flux += triangle.flux;
+            coneDirectionSum += triangle.normal;
+        }
+        node.attribs.setAABB(bounds.minPoint, bounds.maxPoint);
+        node.attribs.flux = flux;
+
+        // We use the average normal as cone direction and grow the cone to include all light normals.
+        node.attribs.coneDirection = float3(0.f);
+        node.attribs.cosConeAngle = kInvalidCosConeAngle;
+        if (glm::length(coneDirectionSum) >= FLT_MIN)
+        {
+            node.attribs.coneDirection = glm::normalize(coneDirectionSum);
+            node.attribs.cosConeAngle = 1.f;
+            for (uint32_t i = 0; i < node.triangleCount; i++)
+            {
+                const float3& normal = triangles[triangleIndices[node.triangleOffset + i]].normal;
+                node.attribs.cosConeAngle = computeCosConeAngle(node.attribs.coneDirection, node.attribs.cosConeAngle, normal, 1.f);
+            }
+        }
+
+        packedNode.setLeafNode(node);
+    }
+
+    /** Recomputes the attributes of an internal node from its children.
+        This matches the internal nodes created by LightBVHBuilder::buildInternal().
+    */
+    static void refitInternalNode(std::vector<PackedNode>& nodes, uint32_t nodeIndex)
+    {
+        InternalNode node = nodes[nodeIndex].getInternalNode();
+        SharedNodeAttributes left = nodes[nodeIndex + 1].getNodeAttributes();
+        SharedNodeAttributes right = nodes[node.rightChildIdx].getNodeAttributes();
+
+        float3 leftMin, leftMax, rightMin, rightMax;
+        left.getAABB(leftMin, leftMax);
+        right.getAABB(rightMin, rightMax);
+        node.attribs.setAABB(glm::min(leftMin, rightMin), glm::max(leftMax, rightMax));
+        node.attribs.flux = left.flux + right.flux;
+        node.attribs.coneDirection = coneUnionOld(left.coneDirection, left.cosConeAngle, right.coneDirection, right.cosConeAngle, node.attribs.cosConeAngle);
+
+        nodes[nodeIndex].setInternalNode(node);
+    }
+
+    LightBVHBuilder::RefitStats LightBVHBuilder::refit(LightBVH& bvh) const
+    {
+        PROFILE("LightBVHBuilder::refit()");
+
+        assert(bvh.isValid());
+        auto& refitData = bvh.mCPURefitData;
+        if (refitData.parentIndices.size() != bvh.mNodes.size())
+        {
+            throw std::exception("LightBVHBuilder::refit() requires a BVH built with CPU refitting enabled");
+        }
+
+        // Gather the triangles of all mesh lights that have changed and transform them by their current instance transforms.
+        // The light collection updates its triangles on the GPU, and reading them back would stall until the GPU has caught up.
+        assert(bvh.mpLightCollection);
+        const auto& meshLights = bvh.mpLightCollection->getMeshLights();
+        const auto& updateStatus = bvh.mpLightCollection->getUpdateStatus();
+        assert(updateStatus.lightsUpdateInfo.size() <= meshLights.size());
+
+        std::vector<uint32_t> dirtyTriangles;
+        bool readBackTriangles = false;
+        for (uint32_t lightIdx = 0; lightIdx < (uint32_t)updateStatus.lightsUpdateInfo.size(); lightIdx++)
+        {
+            if (updateStatus.lightsUpdateInfo[lightIdx] == LightCollection::UpdateFlags::None) continue;
+            const MeshLightData& meshLight = meshLights[lightIdx];
+            for (uint32_t i = 0; i < meshLight.triangleCount; i++) dirtyTriangles.push_back(meshLight.triangleOffset + i);
+
+            if (auto worldMatrix = bvh.mpLightCollection->getMeshLightWorldMatrix(lightIdx)) transformRefitTriangles(*worldMatrix, meshLight, refitData);
+            else readBackTriangles = true;
+        }
+        if (dirtyTriangles.empty()) return RefitStats();
+
+        // The vertices of skinned mesh lights are only available on the GPU.
+        if (readBackTriangles) refitData.triangles = bvh.mpLightCollection->getMeshLightTriangles();
+
+        // The nodes may have been refitted on the GPU before.
+        bvh.syncDataToCPU();
+
+        const uint32_t nodeCount = (uint32_t)bvh.mNodes.size();
+        std::vector<uint32_t> refitNodes;
+        const RefitStats stats = refit(refitData.triangles, dirtyTriangles, bvh.mNodes, bvh.mTriangleIndices, bvh.mTriangleBitmasks, refitData, &refitNodes);
+
+        // The topology changed, so all data is uploaded and the wide BVH is collapsed again.
+        // The stats and the node indices used for GPU refitting need to be updated as well.
+        if (stats.rebuiltSubtreeCount > 0)
+        {
+            bvh.uploadCPUBuffers(bvh.mTriangleIndices, bvh.mTriangleBitmasks);
+            if (bvh.mBranchingFactor > 2)
+            {
+                std::vector<uint64_t> wideTriangleBitmasks;
+                collapse(bvh.mBranchingFactor, bvh.mNodes, bvh.mTriangleIndices, (uint32_t)refitData.triangles.size(), bvh.mWideNodes, wideTriangleBitmasks, &refitData);
+                bvh.uploadWideBuffers(wideTriangleBitmasks);
+            }
+            bvh.finalize();
+            return stats;
+        }
+
+        // Upload the refitted nodes, and update and upload the wide nodes with refitted children.
+        assert(bvh.mNodes.size() == nodeCount);
+        std::sort(refitNodes.begin(), refitNodes.end());
+        uploadElements(bvh.mpBVHNodesBuffer.get(), bvh.mNodes, refitNodes);
+        bvh.mIsCpuDataValid = true;
+
+        if (bvh.mBranchingFactor > 2)
+        {
+            const auto wideNodeIndices = refitWideNodes(bvh.mNodes, refitNodes, refitData, bvh.mWideNodes);
+            uploadElements(bvh.mpWideNodesBuffer.get(), bvh.mWideNodes, wideNodeIndices);
+        }
+
+        return stats;
+    }
+
+    LightBVHBuilder::RefitStats LightBVHBuilder::refit(const std::vector<LightCollection::MeshLightTriangle>& triangles, const std::vector<uint32_t>& dirtyTriangles,
+        std::vector<PackedNode>& nodes, std::vector<uint32_t>& triangleIndices, std::vector<uint64_t>& triangleBitmasks, LightBVH::CPURefitData& refitData,
+        std::vector<uint32_t>* pRefitNodes) const
+    {
+        const uint32_t kInvalidIndex = LightBVH::CPURefitData::kInvalidIndex;
+        assert(refitData.parentIndices.size() == nodes.size());
+        assert(refitData.triangleLeafIndices.size() == triangles.size());
+
+        RefitStats stats;
+        if (pRefitNodes) pRefitNodes->clear();
+        if (nodes.empty()) return stats;
+
+        // Find the leaf nodes containing the dirty triangles and all their ancestors.
+        std::vector<uint32_t> dirtyNodes;
+        for (uint32_t triangleIndex : dirtyTriangles)
+        {
+            assert(triangleIndex < triangles.size());
+            uint32_t leafIndex = refitData.triangleLeafIndices[triangleIndex];
+            if (leafIndex != kInvalidIndex) dirtyNodes.push_back(leafIndex);
+        }
+        std::sort(dirtyNodes.begin(), dirtyNodes.end());
+        dirtyNodes.erase(std::unique(dirtyNodes.begin(), dirtyNodes.end()), dirtyNodes.end());
+        if (dirtyNodes.empty()) return stats;
+
+        std::unordered_set<uint32_t> dirtyNodeSet(dirtyNodes.begin(), dirtyNodes.end());
+        const size_t dirtyLeafCount = dirtyNodes.size();
+        for (size_t i = 0; i < dirtyLeafCount; i++)
+        {
+            for (uint32_t nodeIndex = refitData.parentIndices[dirtyNodes[i]]; nodeIndex != kInvalidIndex; nodeIndex = refitData.parentIndices[nodeIndex])
+            {
+                if (!dirtyNodeSet.insert(nodeIndex).second) break; // The remaining ancestors have been added already.
+                dirtyNodes.push_back(nodeIndex);
+            }
+        }
+
+        // Refit the nodes bottom-up. Nodes are stored in depth-first order, so children have larger indices than their parents.
+        std::sort(dirtyNodes.begin(), dirtyNodes.end(), std::greater<uint32_t>());
+        std::unordered_set<uint32_t> degradedNodes;
+        for (uint32_t nodeIndex : dirtyNodes)
+        {
+            if (nodes[nodeIndex].isLeaf()) refitLeafNode(nodes[nodeIndex], triangles, triangleIndices);
+            else refitInternalNode(nodes, nodeIndex);
+
+            const float costRatio = updateSubtreeCost(nodes, nodeIndex, refitData, mOptions);
+            if (mOptions.rebuildCostThreshold > 0.f && !nodes[nodeIndex].isLeaf() && costRatio > refitData.buildCostRatios[nodeIndex] * mOptions.rebuildCostThreshold)
+            {
+                degradedNodes.insert(nodeIndex);
+            }
+        }
+        stats.refitNodeCount = (uint32_t)dirtyNodes.size();
+        if (degradedNodes.empty())
+        {
+            if (pRefitNodes) *pRefitNodes = std::move(dirtyNodes);
+            return stats;
+        }
+
+        // Rebuild the topmost degraded subtrees. Subtrees are rebuilt from the end of the node list,
+        // so that the node indices of the remaining subtrees are not affected by the relocation.
+        std::vector<uint32_t> rebuildRoots;
+        for (uint32_t nodeIndex : degradedNodes)
+        {
+            bool isTopmost = true;
+            for (uint32_t parentIndex = refitData.parentIndices[nodeIndex]; parentIndex != kInvalidIndex && isTopmost; parentIndex = refitData.parentIndices[parentIndex])
+            {
+                isTopmost = degradedNodes.count(parentIndex) == 0;
+            }
+            if (isTopmost) rebuildRoots.push_back(nodeIndex);
+        }
+        std::sort(rebuildRoots.begin(), rebuildRoots.end(), std::greater<uint32_t>());
+
+        for (uint32_t rootIndex : rebuildRoots)
+        {
+            stats.rebuiltTriangleCount += rebuildSubtree(rootIndex, triangles, nodes, triangleIndices, triangleBitmasks, refitData);
+            stats.rebuiltSubtreeCount++;
+        }
+
+        // Update the parent and leaf indices of the relocated nodes.
+        // The nodes of the rebuilt subtrees are marked by a NaN build cost ratio, which identifies the parents of their root nodes.
+        const auto& buildCostRatios = refitData.buildCostRatios;
+        assert(buildCostRatios.size() == nodes.size());
+        std::vector<uint32_t> rebuildRootParents;
+        refitData.parentIndices.assign(nodes.size(), kInvalidIndex);
+        refitData.triangleLeafIndices.assign(triangles.size(), kInvalidIndex);
+        for (uint32_t nodeIndex = 0; nodeIndex < nodes.size(); nodeIndex++)
+        {
+            if (nodes[nodeIndex].isLeaf())
+            {
+                const LeafNode leaf = nodes[nodeIndex].getLeafNode();
+                for (uint32_t i = 0; i < leaf.triangleCount; i++) refitData.triangleLeafIndices[triangleIndices[leaf.triangleOffset + i]] = nodeIndex;
+            }
+            else
+            {
+                const uint32_t rightChildIndex = nodes[nodeIndex].getInternalNode().rightChildIdx;
+                refitData.parentIndices[nodeIndex + 1] = nodeIndex;
+                refitData.parentIndices[rightChildIndex] = nodeIndex;
+                if (!std::isnan(buildCostRatios[nodeIndex]) && (std::isnan(buildCostRatios[nodeIndex + 1]) || std::isnan(buildCostRatios[rightChildIndex])))
+                {
+                    rebuildRootParents.push_back(nodeIndex);
+                }
+            }
+        }
+
+        // Refit the ancestors of the rebuilt subtrees, as their lighting cones may have changed.
+        dirtyNodes.clear();
+        dirtyNodeSet.clear();
+        for (uint32_t nodeIndex : rebuildRootParents)
+        {
+            for (; nodeIndex != kInvalidIndex && dirtyNodeSet.insert(nodeIndex).second; nodeIndex = refitData.parentIndices[nodeIndex]) dirtyNodes.push_back(nodeIndex);
+        }
+        std::sort(dirtyNodes.begin(), dirtyNodes.end(), std::greater<uint32_t>());
+        for (uint32_t nodeIndex : dirtyNodes) refitInternalNode(nodes, nodeIndex);
+
+        // Recompute all subtree costs, as nodes have been relocated. The rebuilt subtrees start over with their current cost ratios.
+        refitData.subtreeCosts.resize(nodes.size());
+        for (uint32_t nodeIndex = (uint32_t)nodes.size(); nodeIndex-- > 0;)
+        {
+            const float costRatio = updateSubtreeCost(nodes, nodeIndex, refitData, mOptions);
+            if (std::isnan(refitData.buildCostRatios[nodeIndex])) refitData.buildCostRatios[nodeIndex] = costRatio;
+        }
+
+        return stats;
+    }
+
+    uint32_t LightBVHBuilder::rebuildSubtree(uint32_t rootIndex, const std::vector<LightCollection::MeshLightTriangle>& triangles,
+        std::vector<PackedNode>& nodes, std::vector<uint32_t>& triangleIndices, std::vector<uint64_t>& triangleBitmasks, LightBVH::CPURefitData& refitData) const
+    {
+        // The subtree occupies a contiguous range of nodes and triangle indices, as both are stored in depth-first order.
+        // Find the range from the leftmost and rightmost leaves.
+        uint32_t firstLeafIndex = rootIndex, lastLeafIndex = rootIndex;
+        while (!nodes[firstLeafIndex].isLeaf()) firstLeafIndex++;
+        while (!nodes[lastLeafIndex].isLeaf()) lastLeafIndex = nodes[lastLeafIndex].getInternalNode().rightChildIdx;
+
+        const uint32_t nodeBegin = rootIndex;
+        const uint32_t nodeEnd = lastLeafIndex + 1;
+        const LeafNode lastLeaf = nodes[lastLeafIndex].getLeafNode();
+        const Range triangleRange(nodes[firstLeafIndex].getLeafNode().triangleOffset, lastLeaf.triangleOffset + lastLeaf.triangleCount);
+
+        // The traversal path to the subtree root is shared by all its triangles.
+        uint32_t depth = 0;
+        for (uint32_t nodeIndex = rootIndex; refitData.parentIndices[nodeIndex] != LightBVH::CPURefitData::kInvalidIndex; nodeIndex = refitData.parentIndices[nodeIndex]) depth++;
+        assert(depth < kMaxBVHDepth);
+        const uint64_t bitmask = triangleBitmasks[triangleIndices[triangleRange.begin]] & ((1ull << depth) - 1);
+
+        // Build the subtree from its triangles. The bitmasks are updated in place.
+        BuildingData data;
+        data.trianglesData.reserve(triangleRange.length());
+        for (uint32_t i = triangleRange.begin; i < triangleRange.end; i++) data.trianglesData.emplace_back(triangles[triangleIndices[i]], triangleIndices[i]);
+        data.triangleBitmasks = std::move(triangleBitmasks);
+
+        SubtreeData subtree;
+        subtree.nodes.reserve(2 * data.trianglesData.size());
+        subtree.triangleIndices.reserve(data.trianglesData.size());
+        try
+        {
+            float cosConeAngle;
+            float3 coneDirection;
+            buildInternal(mOptions, getSplitFunction(mOptions.splitHeuristicSelection), bitmask, depth, Range(0, triangleRange.length()), data, subtree, cosConeAngle, coneDirection);
+        }
+        catch (...)
+        {
+            triangleBitmasks = std::move(data.triangleBitmasks);
+            throw;
+        }
+        triangleBitmasks = std::move(data.triangleBitmasks);
+        assert(subtree.triangleIndices.size() == triangleRange.length());
+
+        // Patch the right child indices that point past the old subtree and splice in the new subtree.
+        const uint32_t newNodeCount = (uint32_t)subtree.nodes.size();
+        const uint32_t oldNodeCount = nodeEnd - nodeBegin;
+        for (uint32_t nodeIndex = 0; nodeIndex < nodes.size(); nodeIndex++)
+        {
+            if (nodeIndex >= nodeBegin && nodeIndex < nodeEnd) continue;
+            if (!nodes[nodeIndex].isLeaf() && nodes[nodeIndex].getInternalNode().rightChildIdx >= nodeEnd)
+            {
+                relocateNode(nodes[nodeIndex], newNodeCount - oldNodeCount, 0); // Unsigned wrap-around handles a shrinking subtree.
+            }
+        }
+        for (PackedNode& node : subtree.nodes) relocateNode(node, nodeBegin, triangleRange.begin);
+
+        nodes.erase(nodes.begin() + nodeBegin, nodes.begin() + nodeEnd);
+        nodes.insert(nodes.begin() + nodeBegin, subtree.nodes.begin(), subtree.nodes.end());
+        std::copy(subtree.triangleIndices.begin(), subtree.triangleIndices.end(), triangleIndices.begin() + triangleRange.begin);
+
+        // The build cost ratios of the new nodes are computed once all subtrees are rebuilt.
+        auto& buildCostRatios = refitData.buildCostRatios;
+        buildCostRatios.erase(buildCostRatios.begin() + nodeBegin, buildCostRatios.begin() + nodeEnd);
+        buildCostRatios.insert(buildCostRatios.begin() + nodeBegin, newNodeCount, std::numeric_limits<float>::quiet_NaN());
+
+        return triangleRange.length();
+    }
+
+    void LightBVHBuilder::initRefitData(const std::vector<PackedNode>& nodes, const std::vector<uint32_t>& triangleIndices, uint32_t triangleCount, LightBVH::CPURefitData& refitData) const
+    {
+        const uint32_t nodeCount = (uint32_t)nodes.size();
+        refitData.parentIndices.assign(nodeCount, LightBVH::CPURefitData::kInvalidIndex);
+        refitData.triangleLeafIndices.assign(triangleCount, LightBVH::CPURefitData::kInvalidIndex);
+        refitData.subtreeCosts.assign(nodeCount, 0.f);
+        refitData.buildCostRatios.assign(nodeCount, 0.f);
+
+        for (uint32_t nodeIndex = 0; nodeIndex < nodeCount; nodeIndex++)
+        {
+            if (nodes[nodeIndex].isLeaf())
+            {
+                const LeafNode leaf = nodes[nodeIndex].getLeafNode();
+                for (uint32_t i = 0; i < leaf.triangleCount; i++) refitData.triangleLeafIndices[triangleIndices[leaf.triangleOffset + i]] = nodeIndex;
+            }
+            else
+            {
+                refitData.parentIndices[nodeIndex + 1] = nodeIndex;
+                refitData.parentIndices[nodes[nodeIndex].getInternalNode().rightChildIdx] = nodeIndex;
+            }
+        }
+
+        // Nodes are stored in depth-first order, so the children are processed before their parent.
+        for (uint32_t nodeIndex = nodeCount; nodeIndex-- > 0;)
+        {
+            refitData.buildCostRatios[nodeIndex] = updateSubtreeCost(nodes, nodeIndex, refitData, mOptions);
+        }
+    }
+
     SCRIPT_BINDING(LightBVHBuilder)
     {
         pybind11::enum_<LightBVHBuilder::SplitHeuristic> splitHeuristic(m, "SplitHeuristic");
@@ -913,6 +1748,9 @@ namespace Falcor
         options.field(allowRefitting);
         options.field(usePreintegration);
         options.field(useLightingCones);
+        options.field(branchingFactor);
+        options.field(useCPURefit);
+        options.field(rebuildCostThreshold);
 #undef field
     }
 }
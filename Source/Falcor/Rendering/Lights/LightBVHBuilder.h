@@ -36,10 +36,15 @@
 namespace Falcor
 {
     /** Utility class for building 2-way light BVH on the CPU.
+        The binary BVH can optionally be collapsed into a 4- or 8-wide BVH for sampling.
 
         The building process can be customized via the |Options|,
         which are also available in the GUI via the |renderUI()| function.
 
+        Large subtrees are built in parallel, and the split heuristics evaluate
+        the three axes in parallel for large nodes. The result does not depend
+        on the number of threads.
+
         TODO: Rename all things triangle* to light* as the BVH class can be used for other types.
     */
     class dlldecl LightBVHBuilder
@@ -71,6 +76,18 @@ namespace Falcor
             bool           allowRefitting = true;                                ///< Rather than always rebuilding the BVH from scratch, keep the hierarchy but update the bounds and lighting cones.
             bool           usePreintegration = true;                             ///< Use pre-integration for culling out emissive triangles and use their flux when computing the splits. Only valid when using the BinnedSAOH split heuristic.
             bool           useLightingCones = true;                              ///< Use lighting cones when computing the splits. Only valid when using the BinnedSAOH split heuristic.
+            uint32_t       branchingFactor = 2;                                  ///< Branching factor of the BVH used for sampling (2, 4 or 8). Wide BVHs are built by collapsing the binary BVH.
+            bool           useCPURefit = false;                                  ///< Refit the BVH on the CPU, only updating the nodes above lights that have changed. Only valid when 'allowRefitting' is enabled.
+            float          rebuildCostThreshold = 2.f;                           ///< When refitting on the CPU, rebuild subtrees whose relative SAOH cost has grown by more than this factor since they were built. Set to zero to disable partial rebuilds.
+        };
+
+        /** Statistics of an incremental refit on the CPU.
+        */
+        struct RefitStats
+        {
+            uint32_t refitNodeCount = 0;                    ///< Number of nodes whose attributes were recomputed.
+            uint32_t rebuiltSubtreeCount = 0;               ///< Number of subtrees that were rebuilt because their cost had degraded.
+            uint32_t rebuiltTriangleCount = 0;              ///< Number of triangles in the rebuilt subtrees.
         };
 
         /** Creates a new object.
@@ -83,6 +100,78 @@ namespace Falcor
         */
         void build(LightBVH& bvh);
 
+        /** Build the BVH nodes on the CPU without uploading them.
+            This is the CPU part of build(LightBVH&) and is useful for testing and benchmarking.
+            \param[in] triangles Emissive triangles.
+            \param[out] nodes BVH nodes, or an empty list if there are no triangles to include.
+            \param[out] triangleIndices Triangle indices sorted by leaf node.
+            \param[out] triangleBitmasks Per triangle bit pattern retracing the tree traversal to reach the triangle. Indexed by global triangle index.
+        */
+        void build(const std::vector<LightCollection::MeshLightTriangle>& triangles, std::vector<PackedNode>& nodes, std::vector<uint32_t>& triangleIndices, std::vector<uint64_t>& triangleBitmasks) const;
+
+        /** Refit the BVH on the CPU after some of the lights have changed.
+            Only the nodes above the mesh lights flagged in the light collection's update status are refitted,
+            and subtrees whose cost has degraded beyond Options::rebuildCostThreshold are rebuilt.
+            The triangles of the changed mesh lights are transformed on the CPU by their current instance transforms,
+            so the GPU data of the light collection is not read back, unless a changed mesh light is skinned.
+            Only the wide nodes with refitted children are updated, unless subtrees were rebuilt, in which case the wide BVH is collapsed again.
+            The BVH must have been built by a builder with Options::useCPURefit enabled.
+            \param[in,out] bvh The light BVH to refit.
+            \return Refit statistics.
+        */
+        RefitStats refit(LightBVH& bvh) const;
+
+        /** Refit BVH nodes on the CPU without uploading them.
+            This is the CPU part of refit(LightBVH&). It does not access the GPU and can be run on a background thread.
+            The quality of each refitted subtree is measured by the ratio of the summed SAOH cost of its nodes to the cost of its root node.
+            Subtrees are rebuilt in place once this ratio exceeds the ratio at build time by Options::rebuildCostThreshold.
+            Only the topmost degraded subtree on each path is rebuilt.
+            \param[in] triangles Emissive triangles at their current positions.
+            \param[in] dirtyTriangles Global indices of the triangles that have changed since the last build or refit.
+            \param[in,out] nodes BVH nodes.
+            \param[in,out] triangleIndices Triangle indices sorted by leaf node.
+            \param[in,out] triangleBitmasks Per triangle bit pattern retracing the tree traversal to reach the triangle. Indexed by global triangle index.
+            \param[in,out] refitData Refit data created by initRefitData().
+            \param[out] pRefitNodes Optional list of the nodes whose attributes were recomputed. It is only filled in if no subtree was rebuilt.
+            \return Refit statistics.
+        */
+        RefitStats refit(const std::vector<LightCollection::MeshLightTriangle>& triangles, const std::vector<uint32_t>& dirtyTriangles,
+            std::vector<PackedNode>& nodes, std::vector<uint32_t>& triangleIndices, std::vector<uint64_t>& triangleBitmasks, LightBVH::CPURefitData& refitData,
+            std::vector<uint32_t>* pRefitNodes = nullptr) const;
+
+        /** Create the data for refitting a newly built BVH on the CPU.
+            \param[in] nodes BVH nodes.
+            \param[in] triangleIndices Triangle indices sorted by leaf node.
+            \param[in] triangleCount Number of emissive triangles, including the ones that are not in the BVH.
+            \param[out] refitData Refit data.
+        */
+        void initRefitData(const std::vector<PackedNode>& nodes, const std::vector<uint32_t>& triangleIndices, uint32_t triangleCount, LightBVH::CPURefitData& refitData) const;
+
+        /** Collapse a binary BVH into a wide BVH.
+            Each wide node is formed by repeatedly opening the internal child with the most triangles until the
+            branching factor is reached. The leaf nodes and triangle indices of the binary BVH are reused as is.
+            \param[in] branchingFactor Maximum number of children per wide node (4 or 8).
+            \param[in] nodes Nodes of the binary BVH.
+            \param[in] triangleIndices Triangle indices of the binary BVH.
+            \param[in] triangleCount Number of emissive triangles, including the ones that are not in the BVH.
+            \param[out] wideNodes Wide BVH nodes in depth-first order, with the root node located at index 0.
+            \param[out] wideTriangleBitmasks Per triangle child slots retracing the wide tree traversal to reach the triangle, using log2(branchingFactor) bits per level. Indexed by global triangle index.
+            \param[out] pRefitData Optional refit data in which the mapping between the binary and wide nodes is stored for refitWideNodes().
+        */
+        static void collapse(uint32_t branchingFactor, const std::vector<PackedNode>& nodes, const std::vector<uint32_t>& triangleIndices, uint32_t triangleCount,
+            std::vector<PackedWideNode>& wideNodes, std::vector<uint64_t>& wideTriangleBitmasks, LightBVH::CPURefitData* pRefitData = nullptr);
+
+        /** Update the wide nodes whose children have been refitted in the binary BVH.
+            The topology of the binary BVH must not have changed since it was collapsed.
+            \param[in] nodes Nodes of the binary BVH.
+            \param[in] refitNodes Indices of the refitted binary nodes.
+            \param[in] refitData Refit data holding the mapping between the binary and wide nodes, see collapse().
+            \param[in,out] wideNodes Wide BVH nodes.
+            \return Sorted indices of the updated wide nodes.
+        */
+        static std::vector<uint32_t> refitWideNodes(const std::vector<PackedNode>& nodes, const std::vector<uint32_t>& refitNodes, const LightBVH::CPURefitData& refitData,
+            std::vector<PackedWideNode>& wideNodes);
+
         virtual bool renderUI(Gui::Widgets& widget);
 
         const Options& getOptions() const { return mOptions; }
@@ -118,26 +207,40 @@ namespace Falcor
             float cosConeAngle = 1.f;                       ///< Cosine normal bounding cone (half) angle.
             float flux = 0.f;                               ///< Precomputed triangle flux (note, this takes doublesidedness into account).
             uint32_t triangleIndex = MeshLightData::kInvalidIndex; ///< Index into global triangle list.
+
+            TriangleSortData() = default;
+            TriangleSortData(const LightCollection::MeshLightTriangle& triangle, uint32_t triangleIndex);
         };
 
+        /** Data shared by all subtrees during the build. Subtrees only access the triangles in their range.
+        */
         struct BuildingData
         {
-            std::vector<PackedNode>& nodes;                 ///< BVH nodes generated by the builder.
             std::vector<TriangleSortData> trianglesData;    ///< Compact list of triangles to include in build.
-            std::vector<uint32_t> triangleIndices;          ///< Triangle indices sorted by leaf node. Each leaf node refers to a contiguous array of triangle indices.
             std::vector<uint64_t> triangleBitmasks;         ///< Array containing the per triangle bit pattern retracing the tree traversal to reach the triangle: 0=left child, 1=right child; this array gets filled in during the build process. Indexed by global triangle index.
-            float currentNodeFlux = 0.f;                    ///< Used by computeSAOHSplit() as the leaf creation cost.
+        };
+
+        /** Nodes and triangle indices generated for a subtree.
+            Node indices and triangle offsets are relative to the subtree, nodes are stored in depth-first order.
+        */
+        struct SubtreeData
+        {
+            std::vector<PackedNode> nodes;                  ///< BVH nodes generated by the builder.
+            std::vector<uint32_t> triangleIndices;          ///< Triangle indices sorted by leaf node. Each leaf node refers to a contiguous array of triangle indices.
 
-            BuildingData(std::vector<PackedNode>& bvhNodes) : nodes(bvhNodes) {}
+            /** Append the nodes and triangle indices of another subtree, relocating its node indices and triangle offsets.
+            */
+            void append(const SubtreeData& other);
         };
 
         /** Compute the split according to a specified heuristic.
             \param[in] data Prepared light data.
             \param[in] triangleRange Range of triangles to process.
             \param[in] nodeBounds Bounds for the node to be splitted.
+            \param[in] nodeFlux Total flux of the node to be splitted.
             \param[in] parameters Various parameters defining how the building should occur.
         */
-        using SplitHeuristicFunction = std::function<SplitResult(const BuildingData& data, const Range& triangleRange, const AABB& nodeBounds, const Options& parameters)>;
+        using SplitHeuristicFunction = std::function<SplitResult(const BuildingData& data, const Range& triangleRange, const AABB& nodeBounds, float nodeFlux, const Options& parameters)>;
 
         LightBVHBuilder(const Options& options);
 
@@ -145,23 +248,25 @@ namespace Falcor
         */
         bool renderOptions(Gui::Widgets& widget, Options& options) const;
 
-        /** Recursive BVH build.
+        /** Recursive BVH build. Subtrees with many triangles are built in parallel.
+            The lighting cones of internal nodes are computed once their children are built.
             \param[in] splitHeuristic The splitting heuristic to be used.
             \param[in] bitmask Bit pattern retracing the tree traversal to reach the node to be built: 0=left child, 1=right child.
             \param[in] depth Depth of the node to be built
             \param[in] triangleRange Range of triangles to process.
             \param[in,out] data Prepared light data.
-            \return Index of the allocated node.
+            \param[in,out] subtree Subtree to append the generated nodes to.
+            \param[out] cosConeAngle Cosine of the cone angle of the lighting cone for the node, or kInvalidCosConeAngle if the cone is invalid.
+            \param[out] coneDirection Direction of the lighting cone for the node.
+            \return Index of the allocated node in the subtree.
         */
-        uint32_t buildInternal(const Options& options, const SplitHeuristicFunction& splitHeuristic, uint64_t bitmask, uint32_t depth, const Range& triangleRange, BuildingData& data);
+        static uint32_t buildInternal(const Options& options, const SplitHeuristicFunction& splitHeuristic, uint64_t bitmask, uint32_t depth, const Range& triangleRange, BuildingData& data, SubtreeData& subtree, float& cosConeAngle, float3& coneDirection);
 
-        /** Recursive computation of lighting cones for all internal nodes.
-            \param[in] nodeIndex Index of the current node.
-            \param[in,out] data Updated node data.
-            \param[out] cosConeAngle Cosine of the cone angle of the lighting cone for the current node, or kInvalidCosConeAngle if the cone is invalid.
-            \return direction of the lighting cone for the current node.
+        /** Rebuild the subtree rooted at a node in place. The triangles of the subtree are kept.
+            \return Number of triangles in the rebuilt subtree.
         */
-        float3 computeLightingConesInternal(const uint32_t nodeIndex, BuildingData& data, float& cosConeAngle);
+        uint32_t rebuildSubtree(uint32_t rootIndex, const std::vector<LightCollection::MeshLightTriangle>& triangles,
+            std::vector<PackedNode>& nodes, std::vector<uint32_t>& triangleIndices, std::vector<uint64_t>& triangleBitmasks, LightBVH::CPURefitData& refitData) const;
 
         /** Compute lighting cone for a range of triangles.
             \param[in] triangleRange Range of triangles to process.
@@ -172,9 +277,9 @@ namespace Falcor
         static float3 computeLightingCone(const Range& triangleRange, const BuildingData& data, float& cosTheta);
 
         // See the documentation of SplitHeuristicFunction.
-        static SplitResult computeSplitWithEqual(const BuildingData& /*data*/, const Range& triangleRange, const AABB& nodeBounds, const Options& /*parameters*/);
-        static SplitResult computeSplitWithBinnedSAH(const BuildingData& data, const Range& triangleRange, const AABB& nodeBounds, const Options& parameters);
-        static SplitResult computeSplitWithBinnedSAOH(const BuildingData& data, const Range& triangleRange, const AABB& nodeBounds, const Options& parameters);
+        static SplitResult computeSplitWithEqual(const BuildingData& /*data*/, const Range& triangleRange, const AABB& nodeBounds, float /*nodeFlux*/, const Options& /*parameters*/);
+        static SplitResult computeSplitWithBinnedSAH(const BuildingData& data, const Range& triangleRange, const AABB& nodeBounds, float /*nodeFlux*/, const Options& parameters);
+        static SplitResult computeSplitWithBinnedSAOH(const BuildingData& data, const Range& triangleRange, const AABB& nodeBounds, float nodeFlux, const Options& parameters);
 
         static SplitHeuristicFunction getSplitFunction(SplitHeuristic heuristic);
 
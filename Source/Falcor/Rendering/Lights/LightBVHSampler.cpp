@@ -59,7 +59,9 @@ namespace Falcor
         // Check if light collection has changed.
         if (is_set(mpScene->getUpdates(), Scene::UpdateFlags::LightCollectionChanged))
         {
-            if (mOptions.buildOptions.allowRefitting && !mNeedsRebuild) needsRefit = true;
+            // Wide BVHs are collapsed from the binary BVH on the CPU, so they are rebuilt unless the BVH is refitted on the CPU.
+            const auto& buildOptions = mOptions.buildOptions;
+            if (buildOptions.allowRefitting && (buildOptions.useCPURefit || buildOptions.branchingFactor == 2) && !mNeedsRebuild) needsRefit = true;
             else mNeedsRebuild = true;
         }
 
@@ -72,7 +74,8 @@ namespace Falcor
         }
         else if (needsRefit)
         {
-            mpBVH->refit(pRenderContext);
+            if (mOptions.buildOptions.useCPURefit) mpBVHBuilder->refit(*mpBVH);
+            else mpBVH->refit(pRenderContext);
             samplerChanged = true;
         }
 
@@ -91,6 +94,7 @@ namespace Falcor
         defines.add("_USE_UNIFORM_TRIANGLE_SAMPLING", mOptions.useUniformTriangleSampling ? "1" : "0");
         defines.add("_ACTUAL_MAX_TRIANGLES_PER_NODE", std::to_string(mOptions.buildOptions.maxTriangleCountPerLeaf));
         defines.add("_SOLID_ANGLE_BOUND_METHOD", std::to_string((uint32_t)mOptions.solidAngleBoundMethod));
+        defines.add("_BRANCHING_FACTOR", std::to_string(mOptions.buildOptions.branchingFactor));
 
         return defines;
     }
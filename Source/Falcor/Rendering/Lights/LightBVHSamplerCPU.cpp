@@ -0,0 +1,491 @@
+/***************************************************************************
+ # Copyright (c) 2015-21, NVIDIA CORPORATION. All rights reserved.
+ #
+ # Redistribution and use in source and binary forms, with or without
+ # modification, are permitted provided that the following conditions
+ # are met:
+ #  * Redistributions of source code must retain the above copyright
+ #    notice, this list of conditions and the following disclaimer.
+ #  * Redistributions in binary form must reproduce the above copyright
+ #    notice, this list of conditions and the following disclaimer in the
+ #    documentation and/or other materials provided with the distribution.
+ #  * Neither the name of NVIDIA CORPORATION nor the names of its
+ #    contributors may be used to endorse or promote products derived
+ #    from this software without specific prior written permission.
+ #
+ # THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS "AS IS" AND ANY
+ # EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ # IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ # PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+ # CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ # EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ # PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ # PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+ # OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ # (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ # OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ **************************************************************************/
+#include "stdafx.h"
+#include "LightBVHSamplerCPU.h"
+
+namespace Falcor
+{
+    namespace
+    {
+        const uint64_t kInvalidBitmask = std::numeric_limits<uint64_t>::max();
+
+        // The functions below are ports of the shader functions with the same names in LightBVHSampler.slang and GeometryHelpers.slang.
+
+        float cosSubClamped(float sinThetaA, float cosThetaA, float sinThetaB, float cosThetaB)
+        {
+            if (cosThetaA > cosThetaB) return 1.f;
+            return cosThetaA * cosThetaB + sinThetaA * sinThetaB;
+        }
+
+        float sinSubClamped(float sinThetaA, float cosThetaA, float sinThetaB, float cosThetaB)
+        {
+            if (cosThetaA > cosThetaB) return 0.f;
+            return sinThetaA * cosThetaB - cosThetaA * sinThetaB;
+        }
+
+        void boundSphereSubtendedConeAngle(const float3& center, float sqrRadius, float& sinTheta, float& cosTheta)
+        {
+            float centerDistance2 = glm::dot(center, center);
+            if (centerDistance2 < sqrRadius)
+            {
+                sinTheta = 0.f;
+                cosTheta = -1.f;
+            }
+            else
+            {
+                float sin2Theta = sqrRadius / centerDistance2;
+                cosTheta = std::sqrt(1.f - sin2Theta);
+                sinTheta = std::sqrt(sin2Theta);
+            }
+        }
+
+        void boundBoxSubtendedConeAngleCenter(const float3& origin, const float3& aabbMin, const float3& aabbMax, float& sinTheta, float& cosTheta)
+        {
+            const float3 center = (aabbMax + aabbMin) * 0.5f;
+            const float3 extent = (aabbMax - aabbMin) * 0.5f;
+            const float3 dir = center - origin;
+            const float extSqr = glm::dot(extent, extent);
+            const float distSqr = glm::dot(dir, dir);
+
+            const float3 e[4] =
+            {
+                float3(extent.x, extent.y, extent.z),
+                float3(extent.x, extent.y, -extent.z),
+                float3(extent.x, -extent.y, extent.z),
+                float3(extent.x, -extent.y, -extent.z),
+            };
+
+            cosTheta = 1.f;
+            sinTheta = 0.f;
+            for (uint32_t i = 0; i < 4; i++)
+            {
+                float d = std::abs(glm::dot(dir, e[i]));
+                float x = distSqr - d;
+                if (x < 1e-5f)
+                {
+                    cosTheta = -1.f;
+                    sinTheta = 0.f;
+                    return;
+                }
+                float y = std::sqrt(std::max(0.f, distSqr * extSqr - d * d));
+                float z = std::sqrt(x * x + y * y);
+                cosTheta = std::min(cosTheta, x / z);
+                sinTheta = std::max(sinTheta, y / z);
+            }
+        }
+
+        void boundBoxSubtendedConeAngleAverage(const float3& origin, const float3& aabbMin, const float3& aabbMax, float& sinTheta, float& cosTheta)
+        {
+            if (glm::all(glm::greaterThanEqual(origin, aabbMin)) && glm::all(glm::lessThanEqual(origin, aabbMax)))
+            {
+                sinTheta = 0.f;
+                cosTheta = -1.f;
+                return;
+            }
+
+            auto corner = [&](uint32_t i)
+            {
+                return float3((i & 1) ? aabbMin.x : aabbMax.x, (i & 2) ? aabbMin.y : aabbMax.y, (i & 4) ? aabbMin.z : aabbMax.z);
+            };
+
+            float3 dirSum = float3(0.f);
+            for (uint32_t i = 0; i < 8; i++) dirSum += glm::normalize(corner(i) - origin);
+            const float3 coneDir = glm::normalize(dirSum);
+
+            cosTheta = 1.f;
+            for (uint32_t i = 0; i < 8; i++) cosTheta = std::min(cosTheta, glm::dot(glm::normalize(corner(i) - origin), coneDir));
+            sinTheta = std::sqrt(std::max(0.f, 1.f - cosTheta * cosTheta));
+        }
+
+        float computeSquaredMinDistanceToTriangle(const float3 vertices[3], const float3& p)
+        {
+            const float3 n = glm::normalize(glm::cross(vertices[1] - vertices[0], vertices[2] - vertices[0]));
+            const float projDistance = glm::dot(n, p - vertices[0]);
+            const float3 pProj = p - projDistance * n;
+
+            const float3 edges[3] =
+            {
+                glm::normalize(vertices[1] - vertices[0]),
+                glm::normalize(vertices[2] - vertices[1]),
+                glm::normalize(vertices[0] - vertices[2]),
+            };
+            float sqrPlanarDistance = FLT_MAX;
+            uint32_t insideMask = 0;
+            for (uint32_t i = 0; i < 3; i++)
+            {
+                const float3 edgeN = glm::cross(n, edges[i]);
+                const float edgeProjDistance = glm::dot(edgeN, pProj - vertices[i]);
+                if (edgeProjDistance >= 0.f) insideMask |= 1u << i;
+                else sqrPlanarDistance = std::min(edgeProjDistance * edgeProjDistance, sqrPlanarDistance);
+            }
+            if (insideMask == 0x7) sqrPlanarDistance = 0.f;
+            else if (insideMask == 1u << 0) sqrPlanarDistance = glm::dot(pProj - vertices[2], pProj - vertices[2]);
+            else if (insideMask == 1u << 1) sqrPlanarDistance = glm::dot(pProj - vertices[0], pProj - vertices[0]);
+            else if (insideMask == 1u << 2) sqrPlanarDistance = glm::dot(pProj - vertices[1], pProj - vertices[1]);
+
+            return projDistance * projDistance + sqrPlanarDistance;
+        }
+    }
+
+    LightBVHSamplerCPU::LightBVHSamplerCPU(const LightBVHSampler::Options& options, std::vector<LightCollection::MeshLightTriangle> triangles,
+        std::vector<PackedNode> nodes, std::vector<uint32_t> triangleIndices, std::vector<uint64_t> triangleBitmasks)
+        : mOptions(options)
+        , mBranchingFactor(2)
+        , mTriangles(std::move(triangles))
+        , mNodes(std::move(nodes))
+        , mTriangleIndices(std::move(triangleIndices))
+        , mTriangleBitmasks(std::move(triangleBitmasks))
+    {
+        if (mNodes.empty()) throw std::exception("Light BVH is empty");
+    }
+
+    LightBVHSamplerCPU::LightBVHSamplerCPU(const LightBVHSampler::Options& options, uint32_t branchingFactor, std::vector<LightCollection::MeshLightTriangle> triangles,
+        std::vector<PackedWideNode> wideNodes, std::vector<uint32_t> triangleIndices, std::vector<uint64_t> wideTriangleBitmasks)
+        : mOptions(options)
+        , mBranchingFactor(branchingFactor)
+        , mTriangles(std::move(triangles))
+        , mWideNodes(std::move(wideNodes))
+        , mTriangleIndices(std::move(triangleIndices))
+        , mTriangleBitmasks(std::move(wideTriangleBitmasks))
+    {
+        if (mBranchingFactor != 4 && mBranchingFactor != 8) throw std::exception("Wide light BVH branching factor must be 4 or 8");
+        if (mWideNodes.empty()) throw std::exception("Light BVH is empty");
+    }
+
+    bool LightBVHSamplerCPU::sampleTriangle(const float3& posW, const float3& normalW, bool upperHemisphere, float u, float& pdf, uint32_t& triangleIndex) const
+    {
+        float leafPdf;
+        LeafNode leafNode;
+        bool valid = mBranchingFactor > 2 ?
+            traverseWideTree(posW, normalW, upperHemisphere, u, leafPdf, leafNode) :
+            traverseTree(posW, normalW, upperHemisphere, u, leafPdf, leafNode);
+        if (!valid) return false;
+
+        float trianglePdf;
+        if (!pickTriangle(posW, normalW, upperHemisphere, leafNode, u, trianglePdf, triangleIndex)) return false;
+
+        pdf = leafPdf * trianglePdf;
+        return true;
+    }
+
+    float LightBVHSamplerCPU::evalTriangleSelectionPdf(const float3& posW, const float3& normalW, bool upperHemisphere, uint32_t triangleIndex) const
+    {
+        // Unlike the shader, check that the triangle is in the BVH. Culled triangles have an invalid bitmask.
+        if (triangleIndex >= mTriangleBitmasks.size() || mTriangleBitmasks[triangleIndex] == kInvalidBitmask) return 0.f;
+        const uint64_t bitmask = mTriangleBitmasks[triangleIndex];
+
+        LeafNode leafNode;
+        float traversalPdf = mBranchingFactor > 2 ?
+            evalWideBVHTraversalPdf(posW, normalW, upperHemisphere, bitmask, leafNode) :
+            evalBVHTraversalPdf(posW, normalW, upperHemisphere, bitmask, leafNode);
+        if (traversalPdf == 0.f) return 0.f;
+
+        return traversalPdf * evalNodeSamplingPdf(posW, normalW, upperHemisphere, leafNode, triangleIndex);
+    }
+
+    float LightBVHSamplerCPU::boundCosineTerm(const float3& posW, const float3& normalW, const float3& center, const float3& extent, float& cosThetaCone) const
+    {
+        float sinThetaCone = 0.f;
+        switch (mOptions.solidAngleBoundMethod)
+        {
+        case SolidAngleBoundMethod::Sphere:
+            boundSphereSubtendedConeAngle(center - posW, glm::dot(extent, extent), sinThetaCone, cosThetaCone);
+            break;
+        case SolidAngleBoundMethod::BoxToAverage:
+            boundBoxSubtendedConeAngleAverage(posW, center - extent, center + extent, sinThetaCone, cosThetaCone);
+            break;
+        case SolidAngleBoundMethod::BoxToCenter:
+            boundBoxSubtendedConeAngleCenter(posW, center - extent, center + extent, sinThetaCone, cosThetaCone);
+            break;
+        default:
+            cosThetaCone = 0.f;
+            return 0.f;
+        }
+
+        float3 L = glm::normalize(center - posW);
+        float cosThetaL = std::clamp(glm::dot(normalW, L), -1.f, 1.f);
+        float sinThetaL = std::sqrt(1.f - cosThetaL * cosThetaL);
+        return saturate(cosSubClamped(sinThetaL, cosThetaL, sinThetaCone, cosThetaCone));
+    }
+
+    float LightBVHSamplerCPU::computeImportance(const float3& posW, const float3& normalW, bool upperHemisphere, const SharedNodeAttributes& nodeAttribs) const
+    {
+        float flux = mOptions.disableNodeFlux ? 1.f : nodeAttribs.flux;
+        float distance = glm::length(nodeAttribs.origin - posW);
+
+        float NdotL = 1.f;
+        float cosThetaBoundingCone = 0.f;
+        if (mOptions.useLightingCone || (mOptions.useBoundingCone && upperHemisphere))
+        {
+            NdotL = boundCosineTerm(posW, normalW, nodeAttribs.origin, nodeAttribs.extent, cosThetaBoundingCone);
+            if (!(mOptions.useBoundingCone && upperHemisphere)) NdotL = 1.f;
+        }
+
+        float orientationWeight = 1.f;
+        if (mOptions.useLightingCone)
+        {
+            float cosConeAngle = nodeAttribs.cosConeAngle;
+            float3 dirToAabb = (nodeAttribs.origin - posW) / distance;
+            if (cosConeAngle != kInvalidCosConeAngle && cosConeAngle > 0.f)
+            {
+                float sinConeAngle = std::sqrt(std::max(0.f, 1.f - cosConeAngle * cosConeAngle));
+                float cosTheta = glm::dot(nodeAttribs.coneDirection, -dirToAabb);
+                float sinTheta = std::sqrt(std::max(0.f, 1.f - cosTheta * cosTheta));
+                float sinThetaBoundingCone = std::sqrt(std::max(0.f, 1.f - cosThetaBoundingCone * cosThetaBoundingCone));
+
+                float cosTheta0 = cosSubClamped(sinTheta, cosTheta, sinConeAngle, cosConeAngle);
+                float sinTheta0 = sinSubClamped(sinTheta, cosTheta, sinConeAngle, cosConeAngle);
+                float cosThetaPrime = cosSubClamped(sinTheta0, cosTheta0, sinThetaBoundingCone, cosThetaBoundingCone);
+                orientationWeight = std::max(0.f, cosThetaPrime);
+            }
+        }
+
+        float halfRadius = std::max(nodeAttribs.extent.x, std::max(nodeAttribs.extent.y, nodeAttribs.extent.z));
+        distance = std::max(halfRadius, distance);
+
+        return (flux * NdotL) * orientationWeight / (distance * distance);
+    }
+
+    float LightBVHSamplerCPU::computeTriangleImportance(const float3& posW, const float3& normalW, bool upperHemisphere, uint32_t triangleIndex) const
+    {
+        const auto& tri = mTriangles[triangleIndex];
+        const float3 vertices[3] = { tri.vtx[0].pos, tri.vtx[1].pos, tri.vtx[2].pos };
+
+        if (glm::dot(posW - vertices[0], tri.normal) <= 0.f) return 0.f;
+
+        float distSqr = std::max(1e-5f, computeSquaredMinDistanceToTriangle(vertices, posW));
+
+        if (upperHemisphere)
+        {
+            float NdotL = 0.f;
+            for (uint32_t i = 0; i < 3; i++) NdotL = std::max(NdotL, glm::dot(normalW, glm::normalize(vertices[i] - posW)));
+            return saturate(NdotL) / distSqr;
+        }
+        return 1.f / distSqr;
+    }
+
+    bool LightBVHSamplerCPU::traverseTree(const float3& posW, const float3& normalW, bool upperHemisphere, float& u, float& pdf, LeafNode& leafNode) const
+    {
+        pdf = 1.f;
+        uint32_t nodeIndex = 0;
+
+        while (!mNodes[nodeIndex].isLeaf())
+        {
+            uint32_t leftNodeIndex = nodeIndex + 1;
+            uint32_t rightNodeIndex = mNodes[nodeIndex].getInternalNode().rightChildIdx;
+
+            float leftNodeImportance = computeImportance(posW, normalW, upperHemisphere, mNodes[leftNodeIndex].getNodeAttributes());
+            float rightNodeImportance = computeImportance(posW, normalW, upperHemisphere, mNodes[rightNodeIndex].getNodeAttributes());
+
+            float totalImportance = leftNodeImportance + rightNodeImportance;
+            if (totalImportance == 0.f) return false;
+
+            float pLeft = leftNodeImportance / totalImportance;
+            float pRight = 1.f - pLeft;
+
+            if (u < pLeft)
+            {
+                u = u / pLeft;
+                pdf *= pLeft;
+                nodeIndex = leftNodeIndex;
+            }
+            else
+            {
+                u = (u - pLeft) / pRight;
+                pdf *= pRight;
+                nodeIndex = rightNodeIndex;
+            }
+        }
+
+        leafNode = mNodes[nodeIndex].getLeafNode();
+        return true;
+    }
+
+    bool LightBVHSamplerCPU::traverseWideTree(const float3& posW, const float3& normalW, bool upperHemisphere, float& u, float& pdf, LeafNode& leafNode) const
+    {
+        pdf = 1.f;
+        uint32_t nodeIndex = 0;
+
+        while (true)
+        {
+            const PackedWideNode& node = mWideNodes[nodeIndex];
+            const uint32_t childCount = node.getChildCount();
+
+            float importance[PackedWideNode::kMaxChildCount];
+            float totalImportance = 0.f;
+            for (uint32_t i = 0; i < childCount; i++)
+            {
+                importance[i] = computeImportance(posW, normalW, upperHemisphere, node.getChildAttributes(i));
+                totalImportance += importance[i];
+            }
+            if (totalImportance == 0.f) return false;
+
+            float uScaled = u * totalImportance;
+            float cdf = 0.f;
+            float childCdf = 0.f;
+            uint32_t childIndex = 0;
+            for (uint32_t i = 0; i < childCount; i++)
+            {
+                if (importance[i] == 0.f) continue;
+                childIndex = i;
+                childCdf = cdf;
+                cdf += importance[i];
+                if (uScaled < cdf) break;
+            }
+
+            u = saturate((uScaled - childCdf) / importance[childIndex]);
+            pdf *= importance[childIndex] / totalImportance;
+
+            if (node.isChildLeaf(childIndex))
+            {
+                leafNode = node.getChildLeafNode(childIndex);
+                return true;
+            }
+            nodeIndex = node.getChildNodeIndex(childIndex);
+        }
+    }
+
+    bool LightBVHSamplerCPU::pickTriangle(const float3& posW, const float3& normalW, bool upperHemisphere, const LeafNode& node, float u, float& pdf, uint32_t& triangleIndex) const
+    {
+        if (mOptions.useUniformTriangleSampling)
+        {
+            uint32_t idx = std::min((uint32_t)(u * node.triangleCount), node.triangleCount - 1);
+            triangleIndex = mTriangleIndices[node.triangleOffset + idx];
+            pdf = 1.f / (float)node.triangleCount;
+            return true;
+        }
+
+        float pdfs[1 << PackedNode::kTriangleCountBits];
+        float totalImportance = 0.f;
+        for (uint32_t i = 0; i < node.triangleCount; i++)
+        {
+            pdfs[i] = computeTriangleImportance(posW, normalW, upperHemisphere, mTriangleIndices[node.triangleOffset + i]);
+            totalImportance += pdfs[i];
+        }
+        if (totalImportance == 0.f) return false;
+
+        float uScaled = u * totalImportance;
+        float cdf = 0.f;
+        uint32_t idx = 0;
+        for (; idx < node.triangleCount; idx++)
+        {
+            cdf += pdfs[idx];
+            if (uScaled < cdf) break;
+        }
+
+        idx = std::min(idx, node.triangleCount - 1);
+        triangleIndex = mTriangleIndices[node.triangleOffset + idx];
+        pdf = pdfs[idx] / totalImportance;
+        return true;
+    }
+
+    float LightBVHSamplerCPU::evalBVHTraversalPdf(const float3& posW, const float3& normalW, bool upperHemisphere, uint64_t bitmask, LeafNode& leafNode) const
+    {
+        float traversalPdf = 1.f;
+        uint32_t nodeIndex = 0;
+
+        while (!mNodes[nodeIndex].isLeaf())
+        {
+            uint32_t leftNodeIndex = nodeIndex + 1;
+            uint32_t rightNodeIndex = mNodes[nodeIndex].getInternalNode().rightChildIdx;
+
+            float leftNodeImportance = computeImportance(posW, normalW, upperHemisphere, mNodes[leftNodeIndex].getNodeAttributes());
+            float rightNodeImportance = computeImportance(posW, normalW, upperHemisphere, mNodes[rightNodeIndex].getNodeAttributes());
+
+            float totalImportance = leftNodeImportance + rightNodeImportance;
+            if (totalImportance == 0.f) return 0.f;
+
+            float pLeft = leftNodeImportance / totalImportance;
+            if ((bitmask & 0x1) == 0)
+            {
+                traversalPdf *= pLeft;
+                nodeIndex = leftNodeIndex;
+            }
+            else
+            {
+                traversalPdf *= 1.f - pLeft;
+                nodeIndex = rightNodeIndex;
+            }
+            bitmask >>= 1;
+        }
+
+        leafNode = mNodes[nodeIndex].getLeafNode();
+        return traversalPdf;
+    }
+
+    float LightBVHSamplerCPU::evalWideBVHTraversalPdf(const float3& posW, const float3& normalW, bool upperHemisphere, uint64_t bitmask, LeafNode& leafNode) const
+    {
+        const uint32_t bitsPerLevel = mBranchingFactor > 4 ? 3 : 2;
+        float traversalPdf = 1.f;
+        uint32_t nodeIndex = 0;
+
+        while (true)
+        {
+            const PackedWideNode& node = mWideNodes[nodeIndex];
+            const uint32_t childCount = node.getChildCount();
+            const uint32_t childIndex = (uint32_t)(bitmask & ((1ull << bitsPerLevel) - 1));
+            if (childIndex >= childCount) return 0.f;
+
+            float childImportance = 0.f;
+            float totalImportance = 0.f;
+            for (uint32_t i = 0; i < childCount; i++)
+            {
+                float importance = computeImportance(posW, normalW, upperHemisphere, node.getChildAttributes(i));
+                if (i == childIndex) childImportance = importance;
+                totalImportance += importance;
+            }
+            if (totalImportance == 0.f) return 0.f;
+
+            traversalPdf *= childImportance / totalImportance;
+
+            if (node.isChildLeaf(childIndex))
+            {
+                leafNode = node.getChildLeafNode(childIndex);
+                return traversalPdf;
+            }
+            nodeIndex = node.getChildNodeIndex(childIndex);
+            bitmask >>= bitsPerLevel;
+        }
+    }
+
+    float LightBVHSamplerCPU::evalNodeSamplingPdf(const float3& posW, const float3& normalW, bool upperHemisphere, const LeafNode& node, uint32_t triangleIndex) const
+    {
+        if (mOptions.useUniformTriangleSampling) return 1.f / (float)node.triangleCount;
+
+        float triangleImportance = 0.f;
+        float totalImportance = 0.f;
+        for (uint32_t i = 0; i < node.triangleCount; i++)
+        {
+            uint32_t localTriangleIndex = mTriangleIndices[node.triangleOffset + i];
+            float importance = computeTriangleImportance(posW, normalW, upperHemisphere, localTriangleIndex);
+            if (triangleIndex == localTriangleIndex) triangleImportance = importance;
+            totalImportance += importance;
+        }
+        return totalImportance == 0.f ? 0.f : triangleImportance / totalImportance;
+    }
+}
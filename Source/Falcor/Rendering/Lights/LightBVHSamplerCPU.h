@@ -0,0 +1,107 @@
+/***************************************************************************
+ # Copyright (c) 2015-21, NVIDIA CORPORATION. All rights reserved.
+ #
+ # Redistribution and use in source and binary forms, with or without
+ # modification, are permitted provided that the following conditions
+ # are met:
+ #  * Redistributions of source code must retain the above copyright
+ #    notice, this list of conditions and the following disclaimer.
+ #  * Redistributions in binary form must reproduce the above copyright
+ #    notice, this list of conditions and the following disclaimer in the
+ #    documentation and/or other materials provided with the distribution.
+ #  * Neither the name of NVIDIA CORPORATION nor the names of its
+ #    contributors may be used to endorse or promote products derived
+ #    from this software without specific prior written permission.
+ #
+ # THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS "AS IS" AND ANY
+ # EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ # IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ # PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+ # CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ # EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ # PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ # PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+ # OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ # (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ # OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ **************************************************************************/
+#pragma once
+#include "LightBVHSampler.h"
+#include <vector>
+
+namespace Falcor
+{
+    /** CPU reference implementation of the light BVH traversal in LightBVHSampler.slang.
+
+        The class mirrors the shader's sampling and PDF evaluation for both the binary and the wide BVH.
+        This allows validating the sampling PDFs without a GPU, for example of a wide BVH against the binary BVH it was collapsed from.
+        The nodes are unpacked with the same code as on the GPU, but results may differ slightly due to floating-point precision.
+    */
+    class dlldecl LightBVHSamplerCPU
+    {
+    public:
+        /** Creates a reference sampler for a binary BVH (see LightBVHBuilder::build()).
+            \param[in] options Sampler options. Only the traversal options are used.
+            \param[in] triangles Emissive triangles.
+            \param[in] nodes Nodes of the binary BVH.
+            \param[in] triangleIndices Triangle indices sorted by leaf node.
+            \param[in] triangleBitmasks Per triangle bit pattern retracing the tree traversal to reach the triangle.
+        */
+        LightBVHSamplerCPU(const LightBVHSampler::Options& options, std::vector<LightCollection::MeshLightTriangle> triangles,
+            std::vector<PackedNode> nodes, std::vector<uint32_t> triangleIndices, std::vector<uint64_t> triangleBitmasks);
+
+        /** Creates a reference sampler for a wide BVH (see LightBVHBuilder::collapse()).
+            \param[in] options Sampler options. Only the traversal options are used.
+            \param[in] branchingFactor Branching factor the wide BVH was collapsed with (4 or 8).
+            \param[in] triangles Emissive triangles.
+            \param[in] wideNodes Nodes of the wide BVH.
+            \param[in] triangleIndices Triangle indices of the binary BVH the wide BVH was collapsed from.
+            \param[in] wideTriangleBitmasks Per triangle child slots retracing the wide tree traversal to reach the triangle.
+        */
+        LightBVHSamplerCPU(const LightBVHSampler::Options& options, uint32_t branchingFactor, std::vector<LightCollection::MeshLightTriangle> triangles,
+            std::vector<PackedWideNode> wideNodes, std::vector<uint32_t> triangleIndices, std::vector<uint64_t> wideTriangleBitmasks);
+
+        /** Samples a triangle using the BVH.
+            \param[in] posW Shading point in world space.
+            \param[in] normalW Normal at the shading point in world space.
+            \param[in] upperHemisphere True if only upper hemisphere should be considered.
+            \param[in] u Uniform random number.
+            \param[out] pdf Probability of the sampled triangle, only valid if true is returned.
+            \param[out] triangleIndex Index of the sampled triangle, only valid if true is returned.
+            \return True if a triangle was sampled, false otherwise.
+        */
+        bool sampleTriangle(const float3& posW, const float3& normalW, bool upperHemisphere, float u, float& pdf, uint32_t& triangleIndex) const;
+
+        /** Evaluates the probability of selecting a triangle.
+            \param[in] posW Shading point in world space.
+            \param[in] normalW Normal at the shading point in world space.
+            \param[in] upperHemisphere True if only upper hemisphere should be considered.
+            \param[in] triangleIndex Index of the triangle.
+            \return Probability of selecting the triangle, or zero if the triangle is not in the BVH.
+        */
+        float evalTriangleSelectionPdf(const float3& posW, const float3& normalW, bool upperHemisphere, uint32_t triangleIndex) const;
+
+        uint32_t getBranchingFactor() const { return mBranchingFactor; }
+
+    private:
+        float computeImportance(const float3& posW, const float3& normalW, bool upperHemisphere, const SharedNodeAttributes& nodeAttribs) const;
+        float computeTriangleImportance(const float3& posW, const float3& normalW, bool upperHemisphere, uint32_t triangleIndex) const;
+        float boundCosineTerm(const float3& posW, const float3& normalW, const float3& center, const float3& extent, float& cosThetaCone) const;
+
+        bool traverseTree(const float3& posW, const float3& normalW, bool upperHemisphere, float& u, float& pdf, LeafNode& leafNode) const;
+        bool traverseWideTree(const float3& posW, const float3& normalW, bool upperHemisphere, float& u, float& pdf, LeafNode& leafNode) const;
+        bool pickTriangle(const float3& posW, const float3& normalW, bool upperHemisphere, const LeafNode& node, float u, float& pdf, uint32_t& triangleIndex) const;
+
+        float evalBVHTraversalPdf(const float3& posW, const float3& normalW, bool upperHemisphere, uint64_t bitmask, LeafNode& leafNode) const;
+        float evalWideBVHTraversalPdf(const float3& posW, const float3& normalW, bool upperHemisphere, uint64_t bitmask, LeafNode& leafNode) const;
+        float evalNodeSamplingPdf(const float3& posW, const float3& normalW, bool upperHemisphere, const LeafNode& node, uint32_t triangleIndex) const;
+
+        LightBVHSampler::Options mOptions;
+        uint32_t mBranchingFactor = 2;
+        std::vector<LightCollection::MeshLightTriangle> mTriangles;
+        std::vector<PackedNode> mNodes;
+        std::vector<PackedWideNode> mWideNodes;
+        std::vector<uint32_t> mTriangleIndices;
+        std::vector<uint64_t> mTriangleBitmasks;                ///< Traversal bitmasks of the binary or wide BVH.
+    };
+}
@@ -45,14 +45,11 @@ namespace Falcor
             { (uint32_t)Animation::Behavior::Oscillate, "Oscillate" },
         };
 
-        // Bezier form hermite spline
-        float3 interpolateHermite(const float3& p0, const float3& p1, const float3& p2, const float3& p3, float t)
-        {
-            float3 b0 = p1;
-            float3 b1 = p1 + (p2 - p0) * 0.5f / 3.f;
-            float3 b2 = p2 - (p3 - p1) * 0.5f / 3.f;
-            float3 b3 = p2;
+        const size_t kAnimationGrainSize = 16;  ///< Number of animations per task in batched evaluation.
 
+        // Bezier form hermite spline. The inner control points are offset by the precomputed tangents.
+        float3 interpolateBezier(const float3& b0, const float3& b1, const float3& b2, const float3& b3, float t)
+        {
             float3 q0 = lerp(b0, b1, t);
             float3 q1 = lerp(b1, b2, t);
             float3 q2 = lerp(b2, b3, t);
@@ -64,13 +61,8 @@ namespace Falcor
         }
 
         // Bezier hermite slerp
-        glm::quat interpolateHermite(const glm::quat& r0, const glm::quat& r1, const glm::quat& r2, const glm::quat& r3, float t)
+        glm::quat interpolateBezier(const glm::quat& b0, const glm::quat& b1, const glm::quat& b2, const glm::quat& b3, float t)
         {
-            glm::quat b0 = r1;
-            glm::quat b1 = r1 + (r2 - r0) * 0.5f / 3.0f;
-            glm::quat b2 = r2 - (r3 - r1) * 0.5f / 3.0f;
-            glm::quat b3 = r2;
-
             glm::quat q0 = slerp(b0, b1, t);
             glm::quat q1 = slerp(b1, b2, t);
             glm::quat q2 = slerp(b2, b3, t);
@@ -92,16 +84,28 @@ namespace Falcor
             return result;
         }
 
-        Animation::Keyframe interpolateHermite(const Animation::Keyframe& k0, const Animation::Keyframe& k1, const Animation::Keyframe& k2, const Animation::Keyframe& k3, float t)
+        template<typename Tangents>
+        Animation::Keyframe interpolateHermite(const Animation::Keyframe& k1, const Tangents& t1, const Animation::Keyframe& k2, const Tangents& t2, float t)
         {
             assert(t >= 0.f && t <= 1.f);
             Animation::Keyframe result;
-            result.translation = interpolateHermite(k0.translation, k1.translation, k2.translation, k3.translation, t);
+            result.translation = interpolateBezier(k1.translation, k1.translation + t1.translation, k2.translation - t2.translation, k2.translation, t);
             result.scaling = lerp(k1.scaling, k2.scaling, t);
-            result.rotation = interpolateHermite(k0.rotation, k1.rotation, k2.rotation, k3.rotation, t);
+            result.rotation = interpolateBezier(k1.rotation, k1.rotation + t1.rotation, k2.rotation - t2.rotation, k2.rotation, t);
             result.time = glm::lerp(k1.time, k2.time, (double)t);
             return result;
         }
+
+        // Compose translation * rotation * scaling without full matrix products.
+        glm::mat4 composeTransform(const Animation::Keyframe& k)
+        {
+            glm::mat4 transform = mat4_cast(k.rotation);
+            transform[0] *= k.scaling.x;
+            transform[1] *= k.scaling.y;
+            transform[2] *= k.scaling.z;
+            transform[3] = float4(k.translation, 1.f);
+            return transform;
+        }
     }
 
     Animation::SharedPtr Animation::create(const std::string& name, uint32_t nodeID, double duration)
@@ -115,7 +119,38 @@ namespace Falcor
         , mDuration(duration)
     {}
 
+    void Animation::setEnableWarping(bool enableWarping)
+    {
+        mEnableWarping = enableWarping;
+        updateTangents();
+    }
+
     glm::mat4 Animation::animate(double currentTime)
+    {
+        size_t frameHint = mFrameHint.load(std::memory_order_relaxed);
+        glm::mat4 transform = animate(currentTime, frameHint);
+        mFrameHint.store(frameHint, std::memory_order_relaxed);
+        return transform;
+    }
+
+    void Animation::animate(const std::vector<SharedPtr>& animations, const std::vector<double>& times, std::vector<glm::mat4>& transforms)
+    {
+        const size_t sampleCount = times.size();
+        transforms.resize(animations.size() * sampleCount);
+
+        Threading::parallelFor(0, animations.size(), [&](size_t i)
+        {
+            const Animation& animation = *animations[i];
+            size_t frameHint = animation.mFrameHint.load(std::memory_order_relaxed);
+            for (size_t j = 0; j < sampleCount; j++)
+            {
+                transforms[i * sampleCount + j] = animation.animate(times[j], frameHint);
+            }
+            animation.mFrameHint.store(frameHint, std::memory_order_relaxed);
+        }, kAnimationGrainSize);
+    }
+
+    glm::mat4 Animation::animate(double currentTime, size_t& frameHint) const
     {
         // Calculate the sample time.
         double time = currentTime;
@@ -133,7 +168,7 @@ namespace Falcor
         if (isLinearPreInfinity && mKeyframes.size() > 1)
         {
             const auto& k0 = mKeyframes.front();
-            auto k1 = interpolate(mInterpolationMode, k0.time + kEpsilonTime);
+            auto k1 = interpolate(mInterpolationMode, k0.time + kEpsilonTime, frameHint);
             double segmentDuration = k1.time - k0.time;
             float t = (float)((time - k0.time) / segmentDuration);
             interpolated = interpolateLinear(k0, k1, t);
@@ -141,53 +176,60 @@ namespace Falcor
         else if (isLinearPostInfinity && mKeyframes.size() > 1)
         {
             const auto& k1 = mKeyframes.back();
-            auto k0 = interpolate(mInterpolationMode, k1.time - kEpsilonTime);
+            auto k0 = interpolate(mInterpolationMode, k1.time - kEpsilonTime, frameHint);
             double segmentDuration = k1.time - k0.time;
             float t = (float)((time - k0.time) / segmentDuration);
             interpolated = interpolateLinear(k0, k1, t);
         }
         else
         {
-            interpolated = interpolate(mInterpolationMode, time);
+            interpolated = interpolate(mInterpolationMode, time, frameHint);
         }
 
-        glm::mat4 T = translate(interpolated.translation);
-        glm::mat4 R = mat4_cast(interpolated.rotation);
-        glm::mat4 S = scale(interpolated.scaling);
-        glm::mat4 transform = T * R * S;
-
-        return transform;
+        return composeTransform(interpolated);
     }
 
-    Animation::Keyframe Animation::interpolate(InterpolationMode mode, double time) const
+    size_t Animation::findFrameIndex(double time, size_t frameHint) const
     {
-        assert(!mKeyframes.empty());
-
-        // Validate cached frame index.
-        size_t frameIndex = clamp(mCachedFrameIndex, (size_t)0, mKeyframes.size() - 1);
-        if (time < mKeyframes[frameIndex].time) frameIndex = 0;
-
-        // Find frame index.
-        while (frameIndex < mKeyframes.size() - 1)
+        // Find the last keyframe at or before the given time, or the first keyframe if there is none.
+        // Check the hinted keyframe and the one after it first, as consecutive evaluations usually hit the same or the next segment.
+        const size_t count = mKeyframes.size();
+        if (frameHint < count && mKeyframes[frameHint].time <= time)
         {
-            if (mKeyframes[frameIndex + 1].time > time) break;
-            frameIndex++;
+            if (frameHint + 1 == count || time < mKeyframes[frameHint + 1].time) return frameHint;
+            if (frameHint + 2 == count || time < mKeyframes[frameHint + 2].time) return frameHint + 1;
         }
 
-        // Cache frame index;
-        mCachedFrameIndex = frameIndex;
+        // Binary search on the side of the hint that contains the time.
+        auto first = mKeyframes.begin(), last = mKeyframes.end();
+        if (frameHint < count)
+        {
+            if (mKeyframes[frameHint].time <= time) first += frameHint + 2;
+            else last = first + frameHint;
+        }
+        auto it = std::upper_bound(first, last, time, [](double t, const Keyframe& k) { return t < k.time; });
+        return it == mKeyframes.begin() ? 0 : (size_t)(it - mKeyframes.begin()) - 1;
+    }
 
+    size_t Animation::getAdjacentFrame(size_t frame, int32_t offset) const
+    {
         // Compute index of adjacent frame including optional warping.
-        auto adjacentFrame = [this] (size_t frame, int32_t offset = 1)
-        {
-            size_t count = mKeyframes.size();
-            return mEnableWarping ? (frame + count + offset) % count : clamp(frame + offset, (size_t)0, count - 1);
-        };
+        int64_t count = (int64_t)mKeyframes.size();
+        int64_t adjacent = (int64_t)frame + offset;
+        return (size_t)(mEnableWarping ? ((adjacent % count) + count) % count : clamp(adjacent, (int64_t)0, count - 1));
+    }
+
+    Animation::Keyframe Animation::interpolate(InterpolationMode mode, double time, size_t& frameHint) const
+    {
+        assert(!mKeyframes.empty());
+
+        size_t frameIndex = findFrameIndex(time, frameHint);
+        frameHint = frameIndex;
 
         if (mode == InterpolationMode::Linear || mKeyframes.size() < 4)
         {
             size_t i0 = frameIndex;
-            size_t i1 = adjacentFrame(i0);
+            size_t i1 = getAdjacentFrame(i0, 1);
 
             const Keyframe& k0 = mKeyframes[i0];
             const Keyframe& k1 = mKeyframes[i1];
@@ -200,21 +242,18 @@ namespace Falcor
         }
         else if (mode == InterpolationMode::Hermite)
         {
+            assert(mTangents.size() == mKeyframes.size());
             size_t i1 = frameIndex;
-            size_t i0 = adjacentFrame(i1, -1);
-            size_t i2 = adjacentFrame(i1, 1);
-            size_t i3 = adjacentFrame(i1, 2);
+            size_t i2 = getAdjacentFrame(i1, 1);
 
-            const Keyframe& k0 = mKeyframes[i0];
             const Keyframe& k1 = mKeyframes[i1];
             const Keyframe& k2 = mKeyframes[i2];
-            const Keyframe& k3 = mKeyframes[i3];
 
             double segmentDuration = k2.time - k1.time;
             if (mEnableWarping && segmentDuration < 0.0) segmentDuration += mDuration;
             float t = (float)clamp(segmentDuration > 0.0 ? (time - k1.time) / segmentDuration : 1.0, 0.0, 1.0);
 
-            return interpolateHermite(k0, k1, k2, k3, t);
+            return interpolateHermite(k1, mTangents[i1], k2, mTangents[i2], t);
         }
         else
         {
@@ -222,11 +261,25 @@ namespace Falcor
         }
     }
 
+    void Animation::updateTangents()
+    {
+        mTangents.resize(mKeyframes.size());
+        for (size_t i = 0; i < mKeyframes.size(); i++) updateTangent(i);
+    }
+
+    void Animation::updateTangent(size_t frame)
+    {
+        const Keyframe& prev = mKeyframes[getAdjacentFrame(frame, -1)];
+        const Keyframe& next = mKeyframes[getAdjacentFrame(frame, 1)];
+        mTangents[frame].translation = (next.translation - prev.translation) * 0.5f / 3.f;
+        mTangents[frame].rotation = (next.rotation - prev.rotation) * 0.5f / 3.0f;
+    }
+
     // Calculates the sample time within the keyframe range if the current time lies outside and
     // the animation does not behave linearly. If the animation behaves linearly, then the
     // current time is returned. This function should not be used if the current time lies
     // within the range of defined keyframe times.
-    double Animation::calcSampleTime(double currentTime)
+    double Animation::calcSampleTime(double currentTime) const
     {
         double modifiedTime = currentTime;
         double firstKeyframeTime = mKeyframes.front().time;
@@ -260,39 +313,25 @@ namespace Falcor
     void Animation::addKeyframe(const Keyframe& keyframe)
     {
         assert(keyframe.time <= mDuration);
+        assert(mTangents.size() == mKeyframes.size());
+
+        // Find the first keyframe at or after the new keyframe. Importers add keyframes in order, so this is usually the end.
+        auto it = std::lower_bound(mKeyframes.begin(), mKeyframes.end(), keyframe.time, [](const Keyframe& k, double time) { return k.time < time; });
+        size_t frame = it - mKeyframes.begin();
 
-        if (mKeyframes.size() == 0 || mKeyframes[0].time > keyframe.time)
+        // If we already have a key-frame at the same time, replace it
+        if (it != mKeyframes.end() && it->time == keyframe.time)
         {
-            mKeyframes.insert(mKeyframes.begin(), keyframe);
-            return;
+            *it = keyframe;
         }
         else
         {
-            for (size_t i = 0; i < mKeyframes.size(); i++)
-            {
-                auto& current = mKeyframes[i];
-                // If we already have a key-frame at the same time, replace it
-                if (current.time == keyframe.time)
-                {
-                    current = keyframe;
-                    return;
-                }
-
-                // If this is not the last frame, Check if we are in between frames
-                if (i < mKeyframes.size() - 1)
-                {
-                    auto& Next = mKeyframes[i + 1];
-                    if (current.time < keyframe.time && Next.time > keyframe.time)
-                    {
-                        mKeyframes.insert(mKeyframes.begin() + i + 1, keyframe);
-                        return;
-                    }
-                }
-            }
-
-            // If we got here, need to push it to the end of the list
-            mKeyframes.push_back(keyframe);
+            mKeyframes.insert(it, keyframe);
+            mTangents.insert(mTangents.begin() + frame, Tangents());
         }
+
+        // Only the tangents of the new keyframe and its neighbors depend on it.
+        for (int32_t offset = -1; offset <= 1; offset++) updateTangent(getAdjacentFrame(frame, offset));
     }
 
     const Animation::Keyframe& Animation::getKeyframe(double time) const
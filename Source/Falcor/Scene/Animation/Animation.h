@@ -26,6 +26,7 @@
  # OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
  **************************************************************************/
 #pragma once
+#include <atomic>
 #include <vector>
 
 namespace Falcor
@@ -113,7 +114,7 @@ namespace Falcor
 
         /** Enable/disable warping.
         */
-        void setEnableWarping(bool enableWarping) { mEnableWarping = enableWarping; }
+        void setEnableWarping(bool enableWarping);
 
         /** Add a keyframe.
             If there's already a keyframe at the requested time, this call will override the existing frame.
@@ -140,6 +141,15 @@ namespace Falcor
         */
         glm::mat4 animate(double currentTime);
 
+        /** Compute a batch of animations at several time samples.
+            The animations are evaluated in parallel. Each animation carries its keyframe search hint from one time sample to the next,
+            so sorting the time samples in ascending order makes the keyframe search constant time per sample.
+            \param[in] animations Animations to evaluate.
+            \param[in] times Time samples in seconds.
+            \param[out] transforms Transform matrices. Resized to hold the times.size() transforms of each animation, stored consecutively per animation.
+        */
+        static void animate(const std::vector<SharedPtr>& animations, const std::vector<double>& times, std::vector<glm::mat4>& transforms);
+
         /* Render the UI.
         */
         void renderUI(Gui::Widgets& widget);
@@ -147,8 +157,21 @@ namespace Falcor
     private:
         Animation(const std::string& name, uint32_t nodeID, double duration);
 
-        Keyframe interpolate(InterpolationMode mode, double time) const;
-        double calcSampleTime(double currentTime);
+        /** Hermite tangents of a keyframe, precomputed from the adjacent keyframes and scaled to Bezier control point offsets.
+        */
+        struct Tangents
+        {
+            float3 translation = float3(0, 0, 0);
+            glm::quat rotation = glm::quat(0, 0, 0, 0);
+        };
+
+        glm::mat4 animate(double currentTime, size_t& frameHint) const;
+        Keyframe interpolate(InterpolationMode mode, double time, size_t& frameHint) const;
+        size_t findFrameIndex(double time, size_t frameHint) const;
+        size_t getAdjacentFrame(size_t frame, int32_t offset) const;
+        double calcSampleTime(double currentTime) const;
+        void updateTangents();
+        void updateTangent(size_t frame);
 
         std::string mName;
         uint32_t mNodeID;
@@ -161,7 +184,8 @@ namespace Falcor
         bool mEnableWarping = false;
 
         std::vector<Keyframe> mKeyframes;
-        mutable size_t mCachedFrameIndex = 0;
+        std::vector<Tangents> mTangents;                // Hermite tangents per keyframe. Updated when the keyframes or the warping mode change.
+        mutable std::atomic<size_t> mFrameHint{ 0 };    // Keyframe index of the last evaluation. Only used as a search hint, so races are benign.
 
         friend class SceneCache;
     };
@@ -28,6 +28,7 @@
 #include "stdafx.h"
 #include "AnimationController.h"
 #include <fstream>
+#include <xmmintrin.h>
 
 namespace Falcor
 {
@@ -37,9 +38,53 @@ namespace Falcor
         const std::string kInverseTransposeWorldMatrices = "inverseTransposeWorldMatrices";
         const std::string kPrevWorldMatrices = "prevWorldMatrices";
         const std::string kPrevInverseTransposeWorldMatrices = "prevInverseTransposeWorldMatrices";
+
+        const size_t kMinParallelNodeCount = 1024;  ///< Scene graph levels with fewer nodes are updated serially.
+        const size_t kNodeGrainSize = 256;          ///< Number of nodes per task when updating a level in parallel.
+        const size_t kMaxUploadGap = 16;            ///< Spans of changed matrices separated by at most this many unchanged matrices are uploaded together.
+
+        /** Compute a * b. Each column of the result is a linear combination of the columns of a, computed with SSE.
+            The result may alias b.
+        */
+        void multiply(const float4x4& a, const float4x4& b, float4x4& result)
+        {
+            const __m128 a0 = _mm_loadu_ps(&a[0][0]);
+            const __m128 a1 = _mm_loadu_ps(&a[1][0]);
+            const __m128 a2 = _mm_loadu_ps(&a[2][0]);
+            const __m128 a3 = _mm_loadu_ps(&a[3][0]);
+            for (int i = 0; i < 4; i++)
+            {
+                const float* pb = &b[i][0];
+                __m128 c = _mm_mul_ps(a0, _mm_set1_ps(pb[0]));
+                c = _mm_add_ps(c, _mm_mul_ps(a1, _mm_set1_ps(pb[1])));
+                c = _mm_add_ps(c, _mm_mul_ps(a2, _mm_set1_ps(pb[2])));
+                c = _mm_add_ps(c, _mm_mul_ps(a3, _mm_set1_ps(pb[3])));
+                _mm_storeu_ps(&result[i][0], c);
+            }
+        }
+
+        /** Compute the inverse transpose of a matrix.
+            Affine matrices take a fast path, where the upper 3x3 part is inverted with cofactors and the translation is transformed.
+        */
+        float4x4 inverseTranspose(const float4x4& m)
+        {
+            if (m[0][3] != 0.f || m[1][3] != 0.f || m[2][3] != 0.f || m[3][3] != 1.f) return transpose(inverse(m));
+
+            const float3 c0(m[0]), c1(m[1]), c2(m[2]), t(m[3]);
+            const float3 r0 = cross(c1, c2), r1 = cross(c2, c0), r2 = cross(c0, c1);
+            const float invDet = 1.f / dot(c0, r0);
+
+            // The rows of the inverse of the 3x3 part are r0, r1, r2 divided by the determinant, which are the columns of its inverse transpose.
+            float4x4 result;
+            result[0] = float4(r0 * invDet, -dot(r0, t) * invDet);
+            result[1] = float4(r1 * invDet, -dot(r1, t) * invDet);
+            result[2] = float4(r2 * invDet, -dot(r2, t) * invDet);
+            result[3] = float4(0.f, 0.f, 0.f, 1.f);
+            return result;
+        }
     }
 
-    AnimationController::AnimationController(Scene* pScene, const StaticVertexVector& staticVertexData, const DynamicVertexVector& dynamicVertexData, const std::vector<Animation::SharedPtr>& animations)
+    AnimationController::AnimationController(Scene* pScene, const PackedStaticVertexData* pStaticVertexData, size_t staticVertexCount, const DynamicVertexVector& dynamicVertexData, const std::vector<Animation::SharedPtr>& animations)
         : mpScene(pScene)
         , mAnimations(animations)
         , mNodesEdited(pScene->mSceneGraph.size())
@@ -47,7 +92,10 @@ namespace Falcor
         , mGlobalMatrices(pScene->mSceneGraph.size())
         , mInvTransposeGlobalMatrices(pScene->mSceneGraph.size())
         , mMatricesChanged(pScene->mSceneGraph.size())
+        , mPrevMatricesChanged(pScene->mSceneGraph.size())
     {
+        initSceneGraphLevels();
+
         // Create GPU resources.
         assert(mLocalMatrices.size() * 4 <= std::numeric_limits<uint32_t>::max());
         uint32_t float4Count = (uint32_t)mLocalMatrices.size() * 4;
@@ -61,7 +109,7 @@ namespace Falcor
         mpPrevInvTransposeWorldMatricesBuffer = Buffer::createStructured(sizeof(float4), float4Count, Resource::BindFlags::ShaderResource, Buffer::CpuAccess::None, nullptr, false);
         mpPrevInvTransposeWorldMatricesBuffer->setName("AnimationController::mpPrevInvTransposeWorldMatricesBuffer");
 
-        createSkinningPass(staticVertexData, dynamicVertexData);
+        createSkinningPass(pStaticVertexData, staticVertexCount, dynamicVertexData);
 
         // Determine length of global animation loop.
         for (const auto& pAnimation : mAnimations)
@@ -70,9 +118,9 @@ namespace Falcor
         }
     }
 
-    AnimationController::UniquePtr AnimationController::create(Scene* pScene, const StaticVertexVector& staticVertexData, const DynamicVertexVector& dynamicVertexData, const std::vector<Animation::SharedPtr>& animations)
+    AnimationController::UniquePtr AnimationController::create(Scene* pScene, const PackedStaticVertexData* pStaticVertexData, size_t staticVertexCount, const DynamicVertexVector& dynamicVertexData, const std::vector<Animation::SharedPtr>& animations)
     {
-        return UniquePtr(new AnimationController(pScene, staticVertexData, dynamicVertexData, animations));
+        return UniquePtr(new AnimationController(pScene, pStaticVertexData, staticVertexCount, dynamicVertexData, animations));
     }
 
     void AnimationController::addAnimatedVertexCaches(std::vector<CachedCurve>&& cachedCurves, std::vector<CachedMesh>&& cachedMeshes)
@@ -103,6 +151,39 @@ namespace Falcor
         }
     }
 
+    void AnimationController::initSceneGraphLevels()
+    {
+        const auto& sceneGraph = mpScene->mSceneGraph;
+        const uint32_t kUnknownLevel = uint32_t(-1);
+
+        // Compute the depth of each node, walking up to the first node with a known depth.
+        std::vector<uint32_t> levels(sceneGraph.size(), kUnknownLevel);
+        std::vector<uint32_t> path;
+        uint32_t levelCount = 0;
+        for (uint32_t i = 0; i < (uint32_t)sceneGraph.size(); i++)
+        {
+            uint32_t node = i;
+            while (node != SceneBuilder::kInvalidNode && levels[node] == kUnknownLevel)
+            {
+                path.push_back(node);
+                node = sceneGraph[node].parent;
+            }
+            uint32_t level = node == SceneBuilder::kInvalidNode ? 0 : levels[node] + 1;
+            for (auto it = path.rbegin(); it != path.rend(); ++it) levels[*it] = level++;
+            path.clear();
+            levelCount = std::max(levelCount, levels[i] + 1);
+        }
+
+        // Sort the nodes by level, keeping the node order within each level.
+        mLevelOffsets.assign(levelCount + 1, 0);
+        for (uint32_t level : levels) mLevelOffsets[level + 1]++;
+        for (uint32_t level = 0; level < levelCount; level++) mLevelOffsets[level + 1] += mLevelOffsets[level];
+
+        mLevelNodes.resize(sceneGraph.size());
+        std::vector<uint32_t> offsets(mLevelOffsets.begin(), mLevelOffsets.end() - 1);
+        for (uint32_t i = 0; i < (uint32_t)sceneGraph.size(); i++) mLevelNodes[offsets[levels[i]]++] = i;
+    }
+
     void AnimationController::initLocalMatrices()
     {
         for (size_t i = 0; i < mLocalMatrices.size(); i++)
@@ -115,7 +196,7 @@ namespace Falcor
     {
         PROFILE("animate");
 
-        std::fill(mMatricesChanged.begin(), mMatricesChanged.end(), false);
+        std::fill(mMatricesChanged.begin(), mMatricesChanged.end(), 0);
 
         // Check for edited scene nodes and update local matrices.
         auto &sceneGraph = mpScene->mSceneGraph;
@@ -201,41 +282,63 @@ namespace Falcor
 
     void AnimationController::updateLocalMatrices(double time)
     {
-        for (auto& pAnimation : mAnimations)
+        std::vector<glm::mat4> transforms;
+        Animation::animate(mAnimations, { time }, transforms);
+
+        for (size_t i = 0; i < mAnimations.size(); i++)
         {
-            uint32_t nodeID = pAnimation->getNodeID();
-            mLocalMatrices[nodeID] = pAnimation->animate(time);
+            uint32_t nodeID = mAnimations[i]->getNodeID();
+            mLocalMatrices[nodeID] = transforms[i];
             mMatricesChanged[nodeID] = true;
         }
     }
 
     void AnimationController::updateWorldMatrices(bool updateAll)
     {
-        auto &sceneGraph = mpScene->mSceneGraph;
+        const auto& sceneGraph = mpScene->mSceneGraph;
 
-        for (size_t i = 0; i < mGlobalMatrices.size(); i++)
+        auto updateNode = [&](uint32_t i)
         {
+            const uint32_t parent = sceneGraph[i].parent;
+
             // Propagate matrix change flag to children.
-            if (sceneGraph[i].parent != SceneBuilder::kInvalidNode)
+            if (parent != SceneBuilder::kInvalidNode)
             {
-                mMatricesChanged[i] = mMatricesChanged[i] || mMatricesChanged[sceneGraph[i].parent];
+                mMatricesChanged[i] |= mMatricesChanged[parent];
             }
 
-            if (!mMatricesChanged[i] && !updateAll) continue;
+            if (!mMatricesChanged[i] && !updateAll) return;
 
-            mGlobalMatrices[i] = mLocalMatrices[i];
-
-            if (mpScene->mSceneGraph[i].parent != SceneBuilder::kInvalidNode)
+            if (parent != SceneBuilder::kInvalidNode)
             {
-                mGlobalMatrices[i] = mGlobalMatrices[sceneGraph[i].parent] * mGlobalMatrices[i];
+                multiply(mGlobalMatrices[parent], mLocalMatrices[i], mGlobalMatrices[i]);
+            }
+            else
+            {
+                mGlobalMatrices[i] = mLocalMatrices[i];
             }
 
-            mInvTransposeGlobalMatrices[i] = transpose(inverse(mGlobalMatrices[i]));
+            mInvTransposeGlobalMatrices[i] = inverseTranspose(mGlobalMatrices[i]);
 
             if (mpSkinningPass)
             {
-                mSkinningMatrices[i] = mGlobalMatrices[i] * sceneGraph[i].localToBindSpace;
-                mInvTransposeSkinningMatrices[i] = transpose(inverse(mSkinningMatrices[i]));
+                multiply(mGlobalMatrices[i], sceneGraph[i].localToBindSpace, mSkinningMatrices[i]);
+                mInvTransposeSkinningMatrices[i] = inverseTranspose(mSkinningMatrices[i]);
+            }
+        };
+
+        // Nodes only depend on their parent, which is on the previous level. The nodes of each level are updated in parallel.
+        for (size_t level = 0; level + 1 < mLevelOffsets.size(); level++)
+        {
+            const uint32_t* pNodes = mLevelNodes.data() + mLevelOffsets[level];
+            const size_t nodeCount = mLevelOffsets[level + 1] - mLevelOffsets[level];
+            if (nodeCount < kMinParallelNodeCount)
+            {
+                for (size_t j = 0; j < nodeCount; j++) updateNode(pNodes[j]);
+            }
+            else
+            {
+                Threading::parallelFor(0, nodeCount, [&](size_t j) { updateNode(pNodes[j]); }, kNodeGrainSize);
             }
         }
     }
@@ -247,26 +350,34 @@ namespace Falcor
             // Upload all matrices.
             mpWorldMatricesBuffer->setBlob(mGlobalMatrices.data(), 0, mpWorldMatricesBuffer->getSize());
             mpInvTransposeWorldMatricesBuffer->setBlob(mInvTransposeGlobalMatrices.data(), 0, mpInvTransposeWorldMatricesBuffer->getSize());
+            std::fill(mPrevMatricesChanged.begin(), mPrevMatricesChanged.end(), 0);
+            return;
         }
-        else
+
+        // Upload changed matrices only.
+        // The buffers are swapped every update, so the current buffer holds the matrices from two updates ago.
+        // Matrices that changed in the previous update are therefore uploaded as well.
+        auto isDirty = [this](size_t i) { return (mMatricesChanged[i] | mPrevMatricesChanged[i]) != 0; };
+        const size_t matrixCount = mGlobalMatrices.size();
+        for (size_t i = 0; i < matrixCount;)
         {
-            // Upload changed matrices only.
-            for (size_t i = 0; i < mGlobalMatrices.size();)
+            // Find the next span of dirty matrices, merging spans separated by small gaps.
+            while (i < matrixCount && !isDirty(i)) ++i;
+            if (i == matrixCount) break;
+            size_t offset = i, end = ++i;
+            for (; i < matrixCount && i - end <= kMaxUploadGap; ++i)
             {
-                // Detect ranges of consecutive matrices that have all changed or not.
-                size_t offset = i;
-                bool changed = mMatricesChanged[i];
-                while (i < mGlobalMatrices.size() && mMatricesChanged[i] == changed) ++i;
-
-                // Upload range of changed matrices.
-                if (changed)
-                {
-                    size_t count = i - offset;
-                    mpWorldMatricesBuffer->setBlob(&mGlobalMatrices[offset], offset * sizeof(float4x4), count * sizeof(float4x4));
-                    mpInvTransposeWorldMatricesBuffer->setBlob(&mInvTransposeGlobalMatrices[offset], offset * sizeof(float4x4), count * sizeof(float4x4));
-                }
+                if (isDirty(i)) end = i + 1;
             }
+            i = end;
+
+            // Upload span of matrices.
+            size_t count = end - offset;
+            mpWorldMatricesBuffer->setBlob(&mGlobalMatrices[offset], offset * sizeof(float4x4), count * sizeof(float4x4));
+            mpInvTransposeWorldMatricesBuffer->setBlob(&mInvTransposeGlobalMatrices[offset], offset * sizeof(float4x4), count * sizeof(float4x4));
         }
+
+        mPrevMatricesChanged = mMatricesChanged;
     }
 
     void AnimationController::bindBuffers()
@@ -296,12 +407,12 @@ namespace Falcor
         return m;
     }
 
-    void AnimationController::createSkinningPass(const std::vector<PackedStaticVertexData>& staticVertexData, const std::vector<DynamicVertexData>& dynamicVertexData)
+    void AnimationController::createSkinningPass(const PackedStaticVertexData* pStaticVertexData, size_t staticVertexCount, const std::vector<DynamicVertexData>& dynamicVertexData)
     {
         // We always copy the static data, to initialize the non-skinned vertices.
         const Buffer::SharedPtr& pVB = mpScene->mpVao->getVertexBuffer(Scene::kStaticDataBufferIndex);
-        assert(pVB->getSize() == staticVertexData.size() * sizeof(staticVertexData[0]));
-        pVB->setBlob(staticVertexData.data(), 0, pVB->getSize());
+        assert(pVB->getSize() == staticVertexCount * sizeof(PackedStaticVertexData));
+        pVB->setBlob(pStaticVertexData, 0, pVB->getSize());
 
         if (!dynamicVertexData.empty())
         {
@@ -318,7 +429,7 @@ namespace Falcor
             for (size_t i = 0; i < dynamicVertexData.size(); i++)
             {
                 uint32_t staticIndex = dynamicVertexData[i].staticIndex;
-                prevVertexData[i].position = staticVertexData[staticIndex].position;
+                prevVertexData[i].position = pStaticVertexData[staticIndex].position;
             }
 
             // Initialize mesh bind transforms
@@ -330,9 +441,9 @@ namespace Falcor
             }
 
             // Bind vertex data.
-            assert(staticVertexData.size() <= std::numeric_limits<uint32_t>::max());
+            assert(staticVertexCount <= std::numeric_limits<uint32_t>::max());
             assert(dynamicVertexData.size() <= std::numeric_limits<uint32_t>::max());
-            mpSkinningStaticVertexData = Buffer::createStructured(block["staticData"], (uint32_t)staticVertexData.size(), ResourceBindFlags::ShaderResource, Buffer::CpuAccess::None, staticVertexData.data(), false);
+            mpSkinningStaticVertexData = Buffer::createStructured(block["staticData"], (uint32_t)staticVertexCount, ResourceBindFlags::ShaderResource, Buffer::CpuAccess::None, pStaticVertexData, false);
             mpSkinningStaticVertexData->setName("AnimationController::mpSkinningStaticVertexData");
             mpSkinningDynamicVertexData = Buffer::createStructured(block["dynamicData"], (uint32_t)dynamicVertexData.size(), ResourceBindFlags::ShaderResource, Buffer::CpuAccess::None, dynamicVertexData.data(), false);
             mpSkinningDynamicVertexData->setName("AnimationController::mpSkinningDynamicVertexData");
@@ -45,13 +45,17 @@ namespace Falcor
         static const uint32_t kInvalidBoneID = -1;
         ~AnimationController() = default;
 
-        using StaticVertexVector = std::vector<PackedStaticVertexData>;
         using DynamicVertexVector = std::vector<DynamicVertexData>;
 
         /** Create a new object.
+            \param[in] pScene Scene.
+            \param[in] pStaticVertexData Static vertex data of all meshes. Only needs to be valid during the call.
+            \param[in] staticVertexCount Number of static vertices.
+            \param[in] dynamicVertexData Dynamic vertex data of all skinned meshes.
+            \param[in] animations List of animations.
             \return A new object, or throws an exception if creation failed.
         */
-        static UniquePtr create(Scene* pScene, const StaticVertexVector& staticVertexData, const DynamicVertexVector& dynamicVertexData, const std::vector<Animation::SharedPtr>& animations);
+        static UniquePtr create(Scene* pScene, const PackedStaticVertexData* pStaticVertexData, size_t staticVertexCount, const DynamicVertexVector& dynamicVertexData, const std::vector<Animation::SharedPtr>& animations);
 
         /** Add animated vertex caches (curves and meshes) to the controller.
         */
@@ -101,7 +105,7 @@ namespace Falcor
 
         /** Check if a matrix changed since last frame.
         */
-        bool isMatrixChanged(size_t matrixID) const { return mMatricesChanged[matrixID]; }
+        bool isMatrixChanged(size_t matrixID) const { return mMatricesChanged[matrixID] != 0; }
 
         /** Get the local matrices.
             These represent the current local transform for each scene graph node.
@@ -133,8 +137,9 @@ namespace Falcor
 
     private:
         friend class SceneBuilder;
-        AnimationController(Scene* pScene, const StaticVertexVector& staticVertexData, const DynamicVertexVector& dynamicVertexData, const std::vector<Animation::SharedPtr>& animations);
+        AnimationController(Scene* pScene, const PackedStaticVertexData* pStaticVertexData, size_t staticVertexCount, const DynamicVertexVector& dynamicVertexData, const std::vector<Animation::SharedPtr>& animations);
 
+        void initSceneGraphLevels();
         void initLocalMatrices();
         void updateLocalMatrices(double time);
         void updateWorldMatrices(bool updateAll = false);
@@ -142,7 +147,7 @@ namespace Falcor
 
         void bindBuffers();
 
-        void createSkinningPass(const std::vector<PackedStaticVertexData>& staticVertexData, const std::vector<DynamicVertexData>& dynamicVertexData);
+        void createSkinningPass(const PackedStaticVertexData* pStaticVertexData, size_t staticVertexCount, const std::vector<DynamicVertexData>& dynamicVertexData);
         void executeSkinningPass(RenderContext* pContext, bool initPrev = false);
 
         // Animation
@@ -151,7 +156,10 @@ namespace Falcor
         std::vector<float4x4> mLocalMatrices;
         std::vector<float4x4> mGlobalMatrices;
         std::vector<float4x4> mInvTransposeGlobalMatrices;
-        std::vector<bool> mMatricesChanged;         ///< Flag per matrix, true if matrix changed since last frame.
+        std::vector<uint8_t> mMatricesChanged;      ///< Flag per matrix, true if matrix changed since last frame. Bytes rather than bits, so that nodes can be updated in parallel.
+        std::vector<uint8_t> mPrevMatricesChanged;  ///< Flag per matrix, true if matrix changed in the frame before. These are stale in the buffer that is swapped in.
+        std::vector<uint32_t> mLevelNodes;          ///< Scene graph nodes sorted by their depth in the scene graph.
+        std::vector<uint32_t> mLevelOffsets;        ///< Offset of each level in mLevelNodes, plus the total node count.
 
         bool mFirstUpdate = true;       ///< True if this is the first update.
         bool mEnabled = true;           ///< True if animations are enabled.
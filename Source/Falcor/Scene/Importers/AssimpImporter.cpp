@@ -36,8 +36,6 @@
 #include "Core/API/Device.h"
 #include "Scene/SceneBuilder.h"
 
-#include <execution>
-
 namespace Falcor
 {
     namespace
@@ -516,8 +514,7 @@ namespace Falcor
 
             // Pre-process meshes.
             std::vector<SceneBuilder::ProcessedMesh> processedMeshes(meshCount);
-            auto range = NumericRange<uint32_t>(0, meshCount);
-            std::for_each(std::execution::par, range.begin(), range.end(), [&] (uint32_t i) {
+            Threading::parallelFor(0, meshCount, [&] (size_t i) {
                 const aiMesh* pAiMesh = pScene->mMeshes[i];
                 const uint32_t perFaceIndexCount = pAiMesh->mFaces[0].mNumIndices;
 
@@ -586,7 +583,7 @@ namespace Falcor
                 mesh.pMaterial = data.materialMap.at(pAiMesh->mMaterialIndex);
 
                 processedMeshes[i] = data.builder.processMesh(mesh);
-            });
+            }, 1);
 
             // Add meshes to the scene.
             // We retain a deterministic order of the meshes in the global scene buffer by adding
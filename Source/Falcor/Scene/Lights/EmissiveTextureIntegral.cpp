@@ -0,0 +1,402 @@
+/***************************************************************************
+ # Copyright (c) 2015-21, NVIDIA CORPORATION. All rights reserved.
+ #
+ # Redistribution and use in source and binary forms, with or without
+ # modification, are permitted provided that the following conditions
+ # are met:
+ #  * Redistributions of source code must retain the above copyright
+ #    notice, this list of conditions and the following disclaimer.
+ #  * Redistributions in binary form must reproduce the above copyright
+ #    notice, this list of conditions and the following disclaimer in the
+ #    documentation and/or other materials provided with the distribution.
+ #  * Neither the name of NVIDIA CORPORATION nor the names of its
+ #    contributors may be used to endorse or promote products derived
+ #    from this software without specific prior written permission.
+ #
+ # THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS "AS IS" AND ANY
+ # EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ # IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ # PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+ # CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ # EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ # PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ # PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+ # OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ # (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ # OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ **************************************************************************/
+#include "stdafx.h"
+#include "EmissiveTextureIntegral.h"
+#include "Utils/Color/ColorHelpers.slang"
+#include "Utils/Image/Bitmap.h"
+#include <fstream>
+#include <map>
+#include <mutex>
+
+namespace Falcor
+{
+    namespace
+    {
+        /** Specifies the current cache file version.
+            This needs to be incremented every time the file format or the texel decoding changes!
+        */
+        const uint32_t kVersion = 1;
+
+        const char kMagic[8] = { 'F', 'a', 'l', 'c', 'o', 'r', 'E', '$' };
+
+        /** Cache directory (subdirectory in the application data directory).
+        */
+        const std::string kCacheDirectory = "NVIDIA/Falcor/EmissiveTextureCache";
+
+        struct CacheHeader
+        {
+            char magic[8]{};
+            uint32_t version = 0;
+            uint32_t width = 0;
+            uint32_t height = 0;
+            uint32_t reserved = 0;
+        };
+
+        /** Decode a texel to linear RGB the way the texture unit does. Missing channels are zero.
+            Returns false if the format is not supported.
+        */
+        bool decodeTexel(const uint8_t* pTexel, ResourceFormat format, bool isSrgb, float3& rgb)
+        {
+            auto unorm8 = [isSrgb](uint8_t v) { float f = v / 255.f; return isSrgb ? sRGBToLinear(f) : f; };
+            auto half = [](const uint8_t* p) { uint16_t v; std::memcpy(&v, p, sizeof(v)); return f16tof32(v); };
+            auto single = [](const uint8_t* p) { float v; std::memcpy(&v, p, sizeof(v)); return v; };
+
+            switch (format)
+            {
+            case ResourceFormat::RGBA32Float:
+            case ResourceFormat::RGB32Float:
+                rgb = float3(single(pTexel), single(pTexel + 4), single(pTexel + 8));
+                return true;
+            case ResourceFormat::RGBA16Float:
+            case ResourceFormat::RGB16Float:
+                rgb = float3(half(pTexel), half(pTexel + 2), half(pTexel + 4));
+                return true;
+            case ResourceFormat::BGRA8Unorm:
+            case ResourceFormat::BGRX8Unorm:
+                rgb = float3(unorm8(pTexel[2]), unorm8(pTexel[1]), unorm8(pTexel[0]));
+                return true;
+            case ResourceFormat::RGBA8Unorm:
+                rgb = float3(unorm8(pTexel[0]), unorm8(pTexel[1]), unorm8(pTexel[2]));
+                return true;
+            case ResourceFormat::RG8Unorm:
+                rgb = float3(unorm8(pTexel[0]), unorm8(pTexel[1]), 0.f);
+                return true;
+            case ResourceFormat::R8Unorm:
+                rgb = float3(unorm8(pTexel[0]), 0.f, 0.f);
+                return true;
+            case ResourceFormat::R16Unorm:
+            {
+                uint16_t v;
+                std::memcpy(&v, pTexel, sizeof(v));
+                rgb = float3(v / 65535.f, 0.f, 0.f);
+                return true;
+            }
+            default:
+                return false;
+            }
+        }
+
+        int wrapCoord(int x, int n, Sampler::AddressMode mode)
+        {
+            switch (mode)
+            {
+            case Sampler::AddressMode::Wrap:
+                return ((x % n) + n) % n;
+            case Sampler::AddressMode::Mirror:
+            {
+                int period = ((x % (2 * n)) + 2 * n) % (2 * n);
+                return period < n ? period : 2 * n - 1 - period;
+            }
+            case Sampler::AddressMode::MirrorOnce:
+                x = x < 0 ? -x - 1 : x;
+                return std::min(x, n - 1);
+            case Sampler::AddressMode::Border:
+                return (x < 0 || x >= n) ? -1 : x;
+            default:
+                return std::clamp(x, 0, n - 1);
+            }
+        }
+
+        float cross2(const float2& a, const float2& b)
+        {
+            return a.x * b.y - a.y * b.x;
+        }
+    }
+
+    EmissiveTextureIntegral::SharedConstPtr EmissiveTextureIntegral::create(uint32_t width, uint32_t height, const std::vector<float3>& texels)
+    {
+        if (width == 0 || height == 0 || texels.size() != (size_t)width * height) throw std::exception("EmissiveTextureIntegral::create() - Invalid texture dimensions");
+
+        // Box filter down to the max base resolution.
+        uint32_t factor = 1;
+        while (div_round_up(width, factor) > kMaxBaseDim || div_round_up(height, factor) > kMaxBaseDim) factor *= 2;
+
+        Level level;
+        level.width = div_round_up(width, factor);
+        level.height = div_round_up(height, factor);
+        level.texels.resize((size_t)level.width * level.height);
+        for (uint32_t y = 0; y < level.height; y++)
+        {
+            for (uint32_t x = 0; x < level.width; x++)
+            {
+                float3 sum = float3(0.f);
+                uint32_t count = 0;
+                for (uint32_t sy = y * factor; sy < std::min((y + 1) * factor, height); sy++)
+                {
+                    for (uint32_t sx = x * factor; sx < std::min((x + 1) * factor, width); sx++)
+                    {
+                        sum += texels[(size_t)sy * width + sx];
+                        count++;
+                    }
+                }
+                level.texels[(size_t)y * level.width + x] = sum / (float)count;
+            }
+        }
+
+        return SharedConstPtr(new EmissiveTextureIntegral(std::move(level)));
+    }
+
+    EmissiveTextureIntegral::SharedConstPtr EmissiveTextureIntegral::createFromFile(const std::string& filename, bool isSrgb)
+    {
+        // Objects in use are shared by content. Entries expire when the last user releases the object.
+        static std::mutex sMutex;
+        static std::map<SHA1::MD, std::weak_ptr<const EmissiveTextureIntegral>> sCache;
+
+        SHA1::MD key;
+        bool hasKey = computeCacheKey(filename, isSrgb, key);
+        std::filesystem::path cachePath;
+        if (hasKey)
+        {
+            {
+                std::lock_guard<std::mutex> lock(sMutex);
+                if (auto it = sCache.find(key); it != sCache.end())
+                {
+                    if (auto pIntegral = it->second.lock()) return pIntegral;
+                }
+            }
+
+            cachePath = getCachePath(key);
+            if (auto pIntegral = readCache(cachePath))
+            {
+                std::lock_guard<std::mutex> lock(sMutex);
+                sCache[key] = pIntegral;
+                return pIntegral;
+            }
+        }
+
+        // Load with the same memory layout as Texture::createFromFile(). Block compressed (DDS) files are not supported.
+        if (hasSuffix(filename, ".dds", false)) return nullptr;
+        Bitmap::UniqueConstPtr pBitmap = Bitmap::createFromFile(filename, true);
+        if (!pBitmap) return nullptr;
+
+        const uint32_t width = pBitmap->getWidth();
+        const uint32_t height = pBitmap->getHeight();
+        const ResourceFormat format = pBitmap->getFormat();
+        const uint32_t texelSize = getFormatBytesPerBlock(format);
+
+        std::vector<float3> texels((size_t)width * height);
+        for (uint32_t y = 0; y < height; y++)
+        {
+            const uint8_t* pRow = pBitmap->getData() + (size_t)y * pBitmap->getRowPitch();
+            for (uint32_t x = 0; x < width; x++)
+            {
+                if (!decodeTexel(pRow + (size_t)x * texelSize, format, isSrgb, texels[(size_t)y * width + x])) return nullptr;
+            }
+        }
+
+        auto pIntegral = create(width, height, texels);
+        if (!hasKey) return pIntegral;
+
+        if (!pIntegral->writeCache(cachePath))
+        {
+            logWarning("Failed to write emissive texture cache '" + cachePath.string() + "'.");
+        }
+
+        std::lock_guard<std::mutex> lock(sMutex);
+        sCache[key] = pIntegral;
+        return pIntegral;
+    }
+
+    bool EmissiveTextureIntegral::computeCacheKey(const std::string& filename, bool isSrgb, SHA1::MD& key)
+    {
+        SHA1::MD fileHash;
+        if (!SHA1::computeFile(filename, fileHash)) return false;
+
+        SHA1 sha1;
+        sha1.update(fileHash.data(), fileHash.size());
+        sha1.update(&kVersion, sizeof(kVersion));
+        const uint32_t maxBaseDim = kMaxBaseDim;
+        sha1.update(&maxBaseDim, sizeof(maxBaseDim));
+        sha1.update(&isSrgb, sizeof(isSrgb));
+        key = sha1.final();
+        return true;
+    }
+
+    std::filesystem::path EmissiveTextureIntegral::getCachePath(const SHA1::MD& key)
+    {
+        return std::filesystem::path(getAppDataDirectory()) / kCacheDirectory / SHA1::toHexString(key);
+    }
+
+    EmissiveTextureIntegral::SharedConstPtr EmissiveTextureIntegral::readCache(const std::filesystem::path& cachePath)
+    {
+        std::ifstream fs(cachePath, std::ios_base::binary);
+        if (!fs) return nullptr;
+
+        CacheHeader header;
+        fs.read(reinterpret_cast<char*>(&header), sizeof(header));
+        if (!fs) return nullptr;
+
+        if (std::memcmp(header.magic, kMagic, sizeof(kMagic)) != 0 || header.version != kVersion ||
+            header.width == 0 || header.height == 0 || header.width > kMaxBaseDim || header.height > kMaxBaseDim)
+        {
+            return nullptr;
+        }
+
+        Level level;
+        level.width = header.width;
+        level.height = header.height;
+        level.texels.resize((size_t)level.width * level.height);
+        fs.read(reinterpret_cast<char*>(level.texels.data()), level.texels.size() * sizeof(float3));
+        if (!fs) return nullptr;
+
+        return SharedConstPtr(new EmissiveTextureIntegral(std::move(level)));
+    }
+
+    bool EmissiveTextureIntegral::writeCache(const std::filesystem::path& cachePath) const
+    {
+        const Level& base = mLevels[0];
+
+        CacheHeader header;
+        std::memcpy(header.magic, kMagic, sizeof(kMagic));
+        header.version = kVersion;
+        header.width = base.width;
+        header.height = base.height;
+
+        std::error_code ec;
+        std::filesystem::create_directories(cachePath.parent_path(), ec);
+        if (ec) return false;
+
+        // Write to a temporary file first so that concurrent readers never see a partially written cache file.
+        std::filesystem::path tempPath = cachePath;
+        tempPath += ".tmp";
+        bool written = false;
+        {
+            std::ofstream fs(tempPath, std::ios_base::binary | std::ios_base::trunc);
+            if (!fs) return false;
+            fs.write(reinterpret_cast<const char*>(&header), sizeof(header));
+            fs.write(reinterpret_cast<const char*>(base.texels.data()), base.texels.size() * sizeof(float3));
+            written = fs.good();
+        }
+
+        if (written) std::filesystem::rename(tempPath, cachePath, ec);
+        if (!written || ec)
+        {
+            std::filesystem::remove(tempPath, ec);
+            return false;
+        }
+        return true;
+    }
+
+    EmissiveTextureIntegral::EmissiveTextureIntegral(Level&& baseLevel)
+    {
+        mLevels.push_back(std::move(baseLevel));
+
+        // Build the pyramid down to 1x1. Odd dimensions are rounded up so that every texel contributes.
+        while (mLevels.back().width > 1 || mLevels.back().height > 1)
+        {
+            const Level& src = mLevels.back();
+            Level dst;
+            dst.width = std::max(1u, (src.width + 1) / 2);
+            dst.height = std::max(1u, (src.height + 1) / 2);
+            dst.texels.resize((size_t)dst.width * dst.height);
+            for (uint32_t y = 0; y < dst.height; y++)
+            {
+                const uint32_t y0 = std::min(2 * y, src.height - 1), y1 = std::min(2 * y + 1, src.height - 1);
+                for (uint32_t x = 0; x < dst.width; x++)
+                {
+                    const uint32_t x0 = std::min(2 * x, src.width - 1), x1 = std::min(2 * x + 1, src.width - 1);
+                    dst.texels[(size_t)y * dst.width + x] = 0.25f * (
+                        src.texels[(size_t)y0 * src.width + x0] + src.texels[(size_t)y0 * src.width + x1] +
+                        src.texels[(size_t)y1 * src.width + x0] + src.texels[(size_t)y1 * src.width + x1]);
+                }
+            }
+            mLevels.push_back(std::move(dst));
+        }
+    }
+
+    float3 EmissiveTextureIntegral::fetch(const Level& level, int x, int y, Sampler::AddressMode addressModeU, Sampler::AddressMode addressModeV) const
+    {
+        x = wrapCoord(x, (int)level.width, addressModeU);
+        y = wrapCoord(y, (int)level.height, addressModeV);
+        if (x < 0 || y < 0) return float3(0.f); // Border color is black.
+        return level.texels[(size_t)y * level.width + x];
+    }
+
+    float3 EmissiveTextureIntegral::integrateTriangle(const float2 uv[3], Sampler::AddressMode addressModeU, Sampler::AddressMode addressModeV) const
+    {
+        for (uint32_t i = 0; i < 3; i++)
+        {
+            if (!glm::all(glm::isfinite(uv[i]))) return getAverage();
+        }
+
+        const float2 uvMin = glm::min(uv[0], glm::min(uv[1], uv[2]));
+        const float2 uvMax = glm::max(uv[0], glm::max(uv[1], uv[2]));
+
+        // Pick the finest level at which the triangle's bounding box covers at most kMaxTexelsPerTriangle texels.
+        // If the triangle spans many repetitions of the texture even at the coarsest level, its average is the texture average.
+        uint32_t levelIdx = 0;
+        float2 texelMin, texelMax;
+        for (;; levelIdx++)
+        {
+            if (levelIdx == mLevels.size()) return getAverage();
+            const float2 dim = float2(mLevels[levelIdx].width, mLevels[levelIdx].height);
+            texelMin = glm::floor(uvMin * dim - 0.5f);
+            texelMax = glm::ceil(uvMax * dim - 0.5f);
+            const float texelCount = (texelMax.x - texelMin.x + 1.f) * (texelMax.y - texelMin.y + 1.f);
+            if (texelCount <= kMaxTexelsPerTriangle) break;
+        }
+
+        // Sum up the texels whose centers are inside the triangle.
+        const Level& level = mLevels[levelIdx];
+        const float2 dim = float2(level.width, level.height);
+        const float2 p[3] = { uv[0] * dim, uv[1] * dim, uv[2] * dim };
+        const float area = cross2(p[1] - p[0], p[2] - p[0]);
+
+        float3 sum = float3(0.f);
+        uint32_t count = 0;
+        if (area != 0.f)
+        {
+            const float sign = area > 0.f ? 1.f : -1.f;
+            for (int y = (int)texelMin.y; y <= (int)texelMax.y; y++)
+            {
+                for (int x = (int)texelMin.x; x <= (int)texelMax.x; x++)
+                {
+                    const float2 c = float2(x + 0.5f, y + 0.5f);
+                    if (sign * cross2(p[1] - p[0], c - p[0]) >= 0.f &&
+                        sign * cross2(p[2] - p[1], c - p[1]) >= 0.f &&
+                        sign * cross2(p[0] - p[2], c - p[2]) >= 0.f)
+                    {
+                        sum += fetch(level, x, y, addressModeU, addressModeV);
+                        count++;
+                    }
+                }
+            }
+        }
+        if (count > 0) return sum / (float)count;
+
+        // The triangle is degenerate or too small to cover a texel center. Average the texels at the vertices instead.
+        const Level& base = mLevels[0];
+        const float2 baseDim = float2(base.width, base.height);
+        for (uint32_t i = 0; i < 3; i++)
+        {
+            const int2 texel = int2(glm::floor(uv[i] * baseDim));
+            sum += fetch(base, texel.x, texel.y, addressModeU, addressModeV);
+        }
+        return sum / 3.f;
+    }
+}
@@ -0,0 +1,129 @@
+/***************************************************************************
+ # Copyright (c) 2015-21, NVIDIA CORPORATION. All rights reserved.
+ #
+ # Redistribution and use in source and binary forms, with or without
+ # modification, are permitted provided that the following conditions
+ # are met:
+ #  * Redistributions of source code must retain the above copyright
+ #    notice, this list of conditions and the following disclaimer.
+ #  * Redistributions in binary form must reproduce the above copyright
+ #    notice, this list of conditions and the following disclaimer in the
+ #    documentation and/or other materials provided with the distribution.
+ #  * Neither the name of NVIDIA CORPORATION nor the names of its
+ #    contributors may be used to endorse or promote products derived
+ #    from this software without specific prior written permission.
+ #
+ # THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS "AS IS" AND ANY
+ # EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ # IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ # PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+ # CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ # EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ # PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ # PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+ # OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ # (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ # OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ **************************************************************************/
+#pragma once
+#include "Core/API/Sampler.h"
+#include "Utils/CryptoUtils.h"
+#include <filesystem>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace Falcor
+{
+    /** CPU-side pre-integration data for an emissive texture.
+
+        The texture is stored as a pyramid of linear RGB radiance, which is used to compute the average
+        emitted radiance over a triangle in texture space without accessing the GPU. This allows the emissive
+        triangles to be prepared on a worker thread at scene load time (see LightCollection).
+
+        The finest level of the pyramid is limited to kMaxBaseDim texels per side. Objects created from file
+        are shared between all users for as long as any reference is held. The finest level is also written to a
+        disk cache in the application data directory, keyed by the content hash of the texture file, so that
+        textures are only decoded once across runs.
+    */
+    class dlldecl EmissiveTextureIntegral
+    {
+    public:
+        using SharedConstPtr = std::shared_ptr<const EmissiveTextureIntegral>;
+
+        static const uint32_t kMaxBaseDim = 1024;               ///< Max texels per side of the finest pyramid level.
+        static const uint32_t kMaxTexelsPerTriangle = 4096;     ///< Max texels visited when integrating a triangle.
+
+        /** Create from linear RGB texels.
+            \param[in] width Width in texels.
+            \param[in] height Height in texels.
+            \param[in] texels Texels in scanline order, top row first (width * height elements).
+            \return New object, or throws an exception if the dimensions are invalid.
+        */
+        static SharedConstPtr create(uint32_t width, uint32_t height, const std::vector<float3>& texels);
+
+        /** Get the pre-integration data for an image file. The result is read from the disk cache if available.
+            \param[in] filename Full path of the image file.
+            \param[in] isSrgb True if the texture is sampled as sRGB.
+            \return The pre-integration data, or nullptr if the file could not be loaded or its format is not supported (e.g. block compressed).
+        */
+        static SharedConstPtr createFromFile(const std::string& filename, bool isSrgb);
+
+        /** Compute the cache key for an image file.
+            \param[in] filename Full path of the image file.
+            \param[in] isSrgb True if the texture is sampled as sRGB.
+            \param[out] key The cache key.
+            \return True if the file could be hashed.
+        */
+        static bool computeCacheKey(const std::string& filename, bool isSrgb, SHA1::MD& key);
+
+        /** Get the cache file path for a cache key.
+        */
+        static std::filesystem::path getCachePath(const SHA1::MD& key);
+
+        /** Read pre-integration data from the cache.
+            \param[in] cachePath Cache file path.
+            \return The pre-integration data, or nullptr if the cache file does not exist or is invalid.
+        */
+        static SharedConstPtr readCache(const std::filesystem::path& cachePath);
+
+        /** Write the pre-integration data to the cache.
+            \param[in] cachePath Cache file path.
+            \return True if the cache file was written.
+        */
+        bool writeCache(const std::filesystem::path& cachePath) const;
+
+        /** Compute the average radiance over a triangle in texture space.
+            The radiance is averaged over all texels whose centers are covered by the triangle at a pyramid level
+            chosen so that at most kMaxTexelsPerTriangle texels are visited. If no texel center is covered, the
+            average of the texels at the three vertices is returned, which matches the GPU integrator.
+            \param[in] uv Texture coordinates of the triangle vertices.
+            \param[in] addressModeU Texture address mode in U.
+            \param[in] addressModeV Texture address mode in V.
+            \return Average radiance (linear RGB).
+        */
+        float3 integrateTriangle(const float2 uv[3], Sampler::AddressMode addressModeU = Sampler::AddressMode::Wrap, Sampler::AddressMode addressModeV = Sampler::AddressMode::Wrap) const;
+
+        /** Returns the average radiance over the whole texture.
+        */
+        float3 getAverage() const { return mLevels.back().texels[0]; }
+
+        uint32_t getWidth() const { return mLevels[0].width; }
+        uint32_t getHeight() const { return mLevels[0].height; }
+        uint32_t getLevelCount() const { return (uint32_t)mLevels.size(); }
+
+    private:
+        struct Level
+        {
+            uint32_t width = 0;
+            uint32_t height = 0;
+            std::vector<float3> texels;
+        };
+
+        EmissiveTextureIntegral(Level&& baseLevel);
+
+        float3 fetch(const Level& level, int x, int y, Sampler::AddressMode addressModeU, Sampler::AddressMode addressModeV) const;
+
+        std::vector<Level> mLevels;         ///< Pyramid levels, finest level first. The last level is 1x1.
+    };
+}
@@ -29,6 +29,7 @@
 #include "LightCollection.h"
 #include "LightCollectionShared.slang"
 #include "Scene/Scene.h"
+#include "Utils/Color/ColorHelpers.slang"
 #include <sstream>
 
 namespace Falcor
@@ -43,12 +44,207 @@ namespace Falcor
         const char kBuildTriangleListFile[] = "Scene/Lights/BuildTriangleList.cs.slang";
         const char kUpdateTriangleVerticesFile[] = "Scene/Lights/UpdateTriangleVertices.cs.slang";
         const char kFinalizeIntegrationFile[] = "Scene/Lights/FinalizeIntegration.cs.slang";
+
+        // Mesh lights are built in parallel on the CPU in batches of at least this many triangles.
+        const uint32_t kCPUBuildBatchSize = 16384;
+
+        /** Returns the global vertex indices of a triangle. This matches Scene::getIndices() in Scene.slang.
+        */
+        bool getTriangleIndices(const LightCollection::CPUBuildInput& input, const LightCollection::CPUBuildInput::MeshLight& meshLight, uint32_t triangleIndex, uint3& vtxIndices)
+        {
+            if (input.indexCount == 0)
+            {
+                vtxIndices = uint3(triangleIndex * 3) + uint3(0, 1, 2);
+            }
+            else if (meshLight.use16BitIndices)
+            {
+                size_t end = (size_t)meshLight.ibOffset * 2 + (size_t)triangleIndex * 3 + 3;
+                if (end > input.indexCount * 2) return false;
+                const uint16_t* pIndices = reinterpret_cast<const uint16_t*>(input.pIndexData + meshLight.ibOffset) + triangleIndex * 3;
+                vtxIndices = uint3(pIndices[0], pIndices[1], pIndices[2]);
+            }
+            else
+            {
+                size_t end = (size_t)meshLight.ibOffset + (size_t)triangleIndex * 3 + 3;
+                if (end > input.indexCount) return false;
+                const uint32_t* pIndices = input.pIndexData + meshLight.ibOffset + triangleIndex * 3;
+                vtxIndices = uint3(pIndices[0], pIndices[1], pIndices[2]);
+            }
+            vtxIndices += meshLight.vbOffset;
+            return glm::all(glm::lessThan(vtxIndices, uint3((uint32_t)std::min(input.vertexCount, (size_t)std::numeric_limits<uint32_t>::max()))));
+        }
     }
 
-    LightCollection::SharedPtr LightCollection::create(RenderContext* pRenderContext, const std::shared_ptr<Scene>& pScene)
+    LightCollection::SharedPtr LightCollection::create(RenderContext* pRenderContext, const std::shared_ptr<Scene>& pScene, Threading::Future<CPUBuildResult> cpuBuild)
     {
         SharedPtr ptr = SharedPtr(new LightCollection());
-        return ptr->init(pRenderContext, pScene) ? ptr : nullptr;
+        return ptr->init(pRenderContext, pScene, std::move(cpuBuild)) ? ptr : nullptr;
+    }
+
+    LightCollection::CPUBuildInput LightCollection::prepareCPUBuild(const Scene& scene)
+    {
+        // The mesh lights are set up the same way as in setupMeshLights(). The light collection checks that they match before using the result.
+        CPUBuildInput input;
+        std::map<Texture*, uint32_t> textureIndices;
+        const auto& globalMatrices = scene.getAnimationController()->getGlobalMatrices();
+
+        for (uint32_t meshInstanceID = 0; meshInstanceID < scene.getMeshInstanceCount(); meshInstanceID++)
+        {
+            const MeshInstanceData& instanceData = scene.getMeshInstance(meshInstanceID);
+            const MeshDesc& meshData = scene.getMesh(instanceData.meshID);
+
+            auto pMaterial = scene.getMaterial(instanceData.materialID)->toBasicMaterial();
+            if (!pMaterial || !pMaterial->isEmissive()) continue;
+
+            // The vertices of skinned meshes are only available on the GPU.
+            if (instanceData.hasDynamicData()) return {};
+
+            CPUBuildInput::MeshLight meshLight;
+            meshLight.meshInstanceID = meshInstanceID;
+            meshLight.triangleCount = meshData.getTriangleCount();
+            meshLight.vbOffset = instanceData.vbOffset;
+            meshLight.ibOffset = instanceData.ibOffset;
+            meshLight.use16BitIndices = meshData.use16BitIndices();
+            meshLight.isWorldFrontFaceCW = instanceData.isWorldFrontFaceCW();
+            meshLight.worldMatrix = globalMatrices[instanceData.globalMatrixID];
+            meshLight.emissiveColor = pMaterial->getEmissiveColor();
+            meshLight.emissiveFactor = pMaterial->getEmissiveFactor();
+
+            if (auto pTexture = pMaterial->getEmissiveTexture())
+            {
+                auto it = textureIndices.find(pTexture.get());
+                if (it == textureIndices.end())
+                {
+                    it = textureIndices.emplace(pTexture.get(), (uint32_t)input.textures.size()).first;
+                    input.textures.push_back({ pTexture->getSourceFilename(), isSrgbFormat(pTexture->getFormat()) });
+                }
+                meshLight.textureIndex = it->second;
+
+                if (auto pSampler = pMaterial->getDefaultTextureSampler())
+                {
+                    input.addressModeU = pSampler->getAddressModeU();
+                    input.addressModeV = pSampler->getAddressModeV();
+                }
+            }
+
+            input.meshLights.push_back(meshLight);
+        }
+
+        return input;
+    }
+
+    LightCollection::CPUBuildResult LightCollection::buildCPU(const CPUBuildInput& input)
+    {
+        CPUBuildResult result;
+
+        // Load the emissive textures. Each texture is pre-integrated once and shared between all mesh lights using it.
+        std::vector<Threading::Future<EmissiveTextureIntegral::SharedConstPtr>> textureTasks;
+        for (const auto& texture : input.textures)
+        {
+            textureTasks.push_back(Threading::async([&texture]() { return EmissiveTextureIntegral::createFromFile(texture.filename, texture.isSrgb); }));
+        }
+        // All tasks are waited on before checking the results, as they reference the input.
+        std::vector<EmissiveTextureIntegral::SharedConstPtr> textureIntegrals;
+        for (auto& task : textureTasks) textureIntegrals.push_back(task.get());
+        for (size_t i = 0; i < textureIntegrals.size(); i++)
+        {
+            if (!textureIntegrals[i])
+            {
+                result.error = "Emissive texture '" + input.textures[i].filename + "' cannot be integrated on the CPU.";
+                return result;
+            }
+        }
+
+        // Allocate the triangles and split the mesh lights into batches.
+        std::vector<std::pair<uint32_t, uint32_t>> batches; // Mesh light ranges [first, last).
+        uint32_t triangleCount = 0;
+        uint32_t batchTriangleCount = 0;
+        for (uint32_t lightIdx = 0; lightIdx < (uint32_t)input.meshLights.size(); lightIdx++)
+        {
+            if (batches.empty() || batchTriangleCount >= kCPUBuildBatchSize)
+            {
+                batches.push_back({ lightIdx, lightIdx });
+                batchTriangleCount = 0;
+            }
+            batches.back().second = lightIdx + 1;
+            batchTriangleCount += input.meshLights[lightIdx].triangleCount;
+            triangleCount += input.meshLights[lightIdx].triangleCount;
+
+            result.meshInstanceIDs.push_back(input.meshLights[lightIdx].meshInstanceID);
+            result.worldMatrices.push_back(input.meshLights[lightIdx].worldMatrix);
+        }
+        result.triangles.resize(triangleCount);
+
+        // Build the triangles. This follows BuildTriangleList.cs.slang and FinalizeIntegration.cs.slang.
+        auto buildBatch = [&](uint32_t firstLight, uint32_t lastLight, uint32_t triangleOffset)
+        {
+            for (uint32_t lightIdx = firstLight; lightIdx < lastLight; lightIdx++)
+            {
+                const auto& meshLight = input.meshLights[lightIdx];
+                const EmissiveTextureIntegral* pIntegral = meshLight.textureIndex != MeshLightData::kInvalidIndex ? textureIntegrals[meshLight.textureIndex].get() : nullptr;
+
+                for (uint32_t triangleIndex = 0; triangleIndex < meshLight.triangleCount; triangleIndex++)
+                {
+                    uint3 vtxIndices;
+                    if (!getTriangleIndices(input, meshLight, triangleIndex, vtxIndices)) return false;
+
+                    EmissiveTriangle tri;
+                    for (uint32_t j = 0; j < 3; j++)
+                    {
+                        const PackedStaticVertexData& v = input.pVertexData[vtxIndices[j]];
+                        tri.posW[j] = float3(meshLight.worldMatrix * float4(v.position, 1.f));
+                        tri.texCoords[j] = v.texCrd;
+                    }
+
+                    float3 N = glm::cross(tri.posW[1] - tri.posW[0], tri.posW[2] - tri.posW[0]);
+                    tri.area = 0.5f * glm::length(N);
+                    if (meshLight.isWorldFrontFaceCW) N = -N;
+                    tri.normal = glm::normalize(N);
+                    tri.materialID = 0; // Not stored in MeshLightTriangle.
+                    tri.lightIdx = lightIdx;
+
+                    // Round-trip through the packed format so that the data is identical to what is read back from the GPU.
+                    PackedEmissiveTriangle packed;
+                    packed.pack(tri);
+                    tri = packed.unpack();
+
+                    MeshLightTriangle& meshLightTri = result.triangles[triangleOffset++];
+                    meshLightTri.lightIdx = tri.lightIdx;
+                    meshLightTri.normal = tri.normal;
+                    meshLightTri.area = tri.area;
+                    for (uint32_t j = 0; j < 3; j++)
+                    {
+                        meshLightTri.vtx[j].pos = tri.posW[j];
+                        meshLightTri.vtx[j].uv = tri.texCoords[j];
+                    }
+
+                    // Pre-compute the flux assuming diffuse emitters integrated per side (hemisphere).
+                    float3 averageEmissiveColor = pIntegral ? pIntegral->integrateTriangle(tri.texCoords, input.addressModeU, input.addressModeV) : meshLight.emissiveColor;
+                    meshLightTri.averageRadiance = averageEmissiveColor * meshLight.emissiveFactor;
+                    meshLightTri.flux = luminance(meshLightTri.averageRadiance) * tri.area * (float)M_PI;
+                }
+            }
+            return true;
+        };
+
+        std::vector<Threading::Future<bool>> batchTasks;
+        uint32_t triangleOffset = 0;
+        for (const auto& [firstLight, lastLight] : batches)
+        {
+            batchTasks.push_back(Threading::async([&buildBatch, firstLight = firstLight, lastLight = lastLight, triangleOffset]() { return buildBatch(firstLight, lastLight, triangleOffset); }));
+            for (uint32_t lightIdx = firstLight; lightIdx < lastLight; lightIdx++) triangleOffset += input.meshLights[lightIdx].triangleCount;
+        }
+
+        bool success = true;
+        for (auto& task : batchTasks) success = task.get() && success;
+        if (!success)
+        {
+            result.error = "Mesh light vertex indices are out of range.";
+            return result;
+        }
+
+        result.valid = true;
+        return result;
     }
 
     bool LightCollection::update(RenderContext* pRenderContext, UpdateStatus* pUpdateStatus)
@@ -58,11 +254,8 @@ namespace Falcor
         auto pScene = mpScene.lock();
         if (!pScene) return false;
 
-        if (pUpdateStatus)
-        {
-            pUpdateStatus->lightsUpdateInfo.clear();
-            pUpdateStatus->lightsUpdateInfo.reserve(mMeshLights.size());
-        }
+        mUpdateStatus.lightsUpdateInfo.clear();
+        mUpdateStatus.lightsUpdateInfo.reserve(mMeshLights.size());
 
         // Update transform matrices and check for updates.
         // TODO: Move per-mesh instance update flags into Scene. Return just a list of mesh lights that have changed.
@@ -79,9 +272,11 @@ namespace Falcor
 
             // Store update status.
             if (updateFlags != UpdateFlags::None) updatedLights.push_back(lightIdx);
-            if (pUpdateStatus) pUpdateStatus->lightsUpdateInfo.push_back(updateFlags);
+            mUpdateStatus.lightsUpdateInfo.push_back(updateFlags);
         }
 
+        if (pUpdateStatus) *pUpdateStatus = mUpdateStatus;
+
         // Update light data if needed.
         if (!updatedLights.empty())
         {
@@ -92,7 +287,7 @@ namespace Falcor
         return false;
     }
 
-    bool LightCollection::init(RenderContext* pRenderContext, const std::shared_ptr<Scene>& pScene)
+    bool LightCollection::init(RenderContext* pRenderContext, const std::shared_ptr<Scene>& pScene, Threading::Future<CPUBuildResult> cpuBuild)
     {
         assert(pScene);
         mpScene = pScene;
@@ -113,7 +308,7 @@ namespace Falcor
         mpStagingFence = GpuFence::create();
 
         // Now build the mesh light data.
-        build(pRenderContext, *pScene);
+        build(pRenderContext, *pScene, std::move(cpuBuild));
 
         return true;
     }
@@ -226,7 +421,7 @@ namespace Falcor
         return true;
     }
 
-    void LightCollection::build(RenderContext* pRenderContext, const Scene& scene)
+    void LightCollection::build(RenderContext* pRenderContext, const Scene& scene, Threading::Future<CPUBuildResult> cpuBuild)
     {
         prepareMeshData(scene);
 
@@ -244,22 +439,33 @@ namespace Falcor
         {
             TimeReport timeReport;
 
-            // Prepare GPU buffers.
-            prepareTriangleData(pRenderContext, scene);
-            timeReport.measure("LightCollection::build preparation");
+            // Use the triangles built on the CPU at load time if available. This avoids the GPU build and the readback.
+            bool builtOnCPU = false;
+            if (cpuBuild.isValid())
+            {
+                builtOnCPU = initFromCPUBuild(scene, cpuBuild.get());
+                timeReport.measure("LightCollection::build wait for CPU build");
+            }
+
+            if (!builtOnCPU)
+            {
+                // Prepare GPU buffers.
+                prepareTriangleData(pRenderContext, scene);
+                timeReport.measure("LightCollection::build preparation");
+
+                // Pre-integrate emissive triangles.
+                // TODO: We might want to redo this in update() for animated meshes or after scale changes as that affects the flux.
+                integrateEmissive(pRenderContext, scene);
 
-            // Pre-integrate emissive triangles.
-            // TODO: We might want to redo this in update() for animated meshes or after scale changes as that affects the flux.
-            integrateEmissive(pRenderContext, scene);
+                timeReport.measure("LightCollection::build integrate emissive");
 
-            timeReport.measure("LightCollection::build integrate emissive");
+                mCPUInvalidData = CPUOutOfDateFlags::All;
+                mStagingBufferValid = false;
+                prepareSyncCPUData(pRenderContext);
+            }
 
             // Build list of active triangles.
-            mCPUInvalidData = CPUOutOfDateFlags::All;
-            mStagingBufferValid = false;
             mStatsValid = false;
-
-            prepareSyncCPUData(pRenderContext);
             updateActiveTriangleList();
 
             timeReport.measure("LightCollection::build finalize");
@@ -267,18 +473,78 @@ namespace Falcor
         }
     }
 
-    void LightCollection::prepareTriangleData(RenderContext* pRenderContext, const Scene& scene)
+    bool LightCollection::initFromCPUBuild(const Scene& scene, CPUBuildResult&& cpuBuild)
+    {
+        if (!cpuBuild.valid)
+        {
+            logInfo("LightCollection: " + cpuBuild.error + " Using the GPU build.");
+            return false;
+        }
+
+        // Check that the CPU build matches the mesh lights and that no mesh light has moved since the build was started.
+        bool match = cpuBuild.meshInstanceIDs.size() == mMeshLights.size() && cpuBuild.triangles.size() == mTriangleCount;
+        const auto& globalMatrices = scene.getAnimationController()->getGlobalMatrices();
+        for (size_t lightIdx = 0; match && lightIdx < mMeshLights.size(); lightIdx++)
+        {
+            const MeshInstanceData& instanceData = scene.getMeshInstance(mMeshLights[lightIdx].meshInstanceID);
+            match = cpuBuild.meshInstanceIDs[lightIdx] == mMeshLights[lightIdx].meshInstanceID && cpuBuild.worldMatrices[lightIdx] == globalMatrices[instanceData.globalMatrixID];
+        }
+        if (!match)
+        {
+            logInfo("LightCollection: Scene changed since the CPU build was started. Using the GPU build.");
+            return false;
+        }
+
+        // Upload the triangle data.
+        std::vector<PackedEmissiveTriangle> triangleData(mTriangleCount);
+        std::vector<EmissiveFlux> fluxData(mTriangleCount);
+        for (uint32_t triIdx = 0; triIdx < mTriangleCount; triIdx++)
+        {
+            const auto& meshLightTri = cpuBuild.triangles[triIdx];
+
+            EmissiveTriangle tri;
+            for (uint32_t j = 0; j < 3; j++)
+            {
+                tri.posW[j] = meshLightTri.vtx[j].pos;
+                tri.texCoords[j] = meshLightTri.vtx[j].uv;
+            }
+            tri.normal = meshLightTri.normal;
+            tri.area = meshLightTri.area;
+            tri.materialID = mMeshLights[meshLightTri.lightIdx].materialID;
+            tri.lightIdx = meshLightTri.lightIdx;
+            triangleData[triIdx].pack(tri);
+
+            fluxData[triIdx].flux = meshLightTri.flux;
+            fluxData[triIdx].averageRadiance = meshLightTri.averageRadiance;
+        }
+        createTriangleBuffers(triangleData.data(), fluxData.data());
+
+        mMeshLightTriangles = std::move(cpuBuild.triangles);
+        mCPUInvalidData = CPUOutOfDateFlags::None;
+        mStagingBufferValid = true;
+
+        return true;
+    }
+
+    void LightCollection::createTriangleBuffers(const PackedEmissiveTriangle* pTriangleData, const EmissiveFlux* pFluxData)
     {
         assert(mTriangleCount > 0);
 
-        // Create GPU buffers.
-        mpTriangleData = Buffer::createStructured(mpTriangleListBuilder["gTriangleData"], mTriangleCount, ResourceBindFlags::ShaderResource | ResourceBindFlags::UnorderedAccess, Buffer::CpuAccess::None, nullptr, false);
+        mpTriangleData = Buffer::createStructured(mpTriangleListBuilder["gTriangleData"], mTriangleCount, ResourceBindFlags::ShaderResource | ResourceBindFlags::UnorderedAccess, Buffer::CpuAccess::None, pTriangleData, false);
         mpTriangleData->setName("LightCollection::mpTriangleData");
         if (mpTriangleData->getStructSize() != sizeof(PackedEmissiveTriangle)) throw std::exception("Struct PackedEmissiveTriangle size mismatch between CPU/GPU");
 
-        mpFluxData = Buffer::createStructured(mpFinalizeIntegration["gFluxData"], mTriangleCount, ResourceBindFlags::ShaderResource | ResourceBindFlags::UnorderedAccess, Buffer::CpuAccess::None, nullptr, false);
+        mpFluxData = Buffer::createStructured(mpFinalizeIntegration["gFluxData"], mTriangleCount, ResourceBindFlags::ShaderResource | ResourceBindFlags::UnorderedAccess, Buffer::CpuAccess::None, pFluxData, false);
         mpFluxData->setName("LightCollection::mpFluxData");
         if (mpFluxData->getStructSize() != sizeof(EmissiveFlux)) throw std::exception("Struct EmissiveFlux size mismatch between CPU/GPU");
+    }
+
+    void LightCollection::prepareTriangleData(RenderContext* pRenderContext, const Scene& scene)
+    {
+        assert(mTriangleCount > 0);
+
+        // Create GPU buffers.
+        createTriangleBuffers(nullptr, nullptr);
 
         // Compute triangle data (vertices, uv-coordinates, materialID) for all mesh lights.
         buildTriangleList(pRenderContext, scene);
@@ -691,6 +957,16 @@ namespace Falcor
         mCPUInvalidData = CPUOutOfDateFlags::None;
     }
 
+    std::optional<float4x4> LightCollection::getMeshLightWorldMatrix(uint32_t lightIdx) const
+    {
+        auto pScene = mpScene.lock();
+        assert(pScene && lightIdx < mMeshLights.size());
+
+        const MeshInstanceData& instanceData = pScene->getMeshInstance(mMeshLights[lightIdx].meshInstanceID);
+        if (instanceData.hasDynamicData()) return std::nullopt;
+        return pScene->getAnimationController()->getGlobalMatrices()[instanceData.globalMatrixID];
+    }
+
     uint64_t LightCollection::getMemoryUsageInBytes() const
     {
         uint64_t m = 0;
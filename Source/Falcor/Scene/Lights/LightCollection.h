@@ -28,10 +28,15 @@
 #pragma once
 #include "RenderGraph/BasePasses/ComputePass.h"
 #include "MeshLightData.slang"
+#include "EmissiveTextureIntegral.h"
+#include "Scene/SceneTypes.slang"
+#include <optional>
 
 namespace Falcor
 {
     class Scene;
+    struct PackedEmissiveTriangle;
+    struct EmissiveFlux;
 
     /** Class that holds a collection of mesh lights for a scene.
 
@@ -104,15 +109,85 @@ namespace Falcor
         };
 
 
+        /** Scene data for building the mesh light triangles on the CPU.
+            The data is captured from the scene at load time, so that the triangles can be built on a worker thread
+            while the GPU resources are created, without reading back any GPU buffers (see Scene::Scene()).
+        */
+        struct CPUBuildInput
+        {
+            struct MeshLight
+            {
+                uint32_t meshInstanceID = 0;                    ///< Global mesh instance ID.
+                uint32_t triangleCount = 0;                     ///< Number of triangles.
+                uint32_t vbOffset = 0;                          ///< Offset into the vertex data.
+                uint32_t ibOffset = 0;                          ///< Offset into the index data in 32-bit words.
+                bool use16BitIndices = false;                   ///< True if the indices are in 16-bit format.
+                bool isWorldFrontFaceCW = false;                ///< True if the front-facing side has clockwise winding in world space.
+                float4x4 worldMatrix;                           ///< Object to world transform.
+                float3 emissiveColor = float3(0.f);             ///< Emissive color of the material (if not textured).
+                float emissiveFactor = 1.f;                     ///< Emissive factor of the material.
+                uint32_t textureIndex = MeshLightData::kInvalidIndex; ///< Index into 'textures', or kInvalidIndex if the emission is uniform.
+            };
+
+            struct EmissiveTexture
+            {
+                std::string filename;                           ///< Full path of the texture file.
+                bool isSrgb = false;                            ///< True if the texture is sampled as sRGB.
+            };
+
+            std::vector<MeshLight> meshLights;                  ///< Mesh lights in the same order as LightCollection::getMeshLights().
+            std::vector<EmissiveTexture> textures;              ///< Emissive textures.
+            Sampler::AddressMode addressModeU = Sampler::AddressMode::Wrap;
+            Sampler::AddressMode addressModeV = Sampler::AddressMode::Wrap;
+
+            // Mesh data. It is either owned, or referenced in a memory-mapped scene cache file kept alive by pMeshDataFile.
+            std::vector<uint32_t> indexData;                    ///< Vertex indices (owned).
+            std::vector<PackedStaticVertexData> vertexData;     ///< Vertex attributes (owned).
+            MemoryMappedFile::SharedPtr pMeshDataFile;          ///< Mapped file holding the mesh data, if any.
+            const uint32_t* pIndexData = nullptr;               ///< Vertex indices for all meshes. Non-indexed meshes are assumed if indexCount is zero.
+            size_t indexCount = 0;                              ///< Number of elements in pIndexData.
+            const PackedStaticVertexData* pVertexData = nullptr; ///< Vertex attributes for all meshes.
+            size_t vertexCount = 0;                             ///< Number of elements in pVertexData.
+        };
+
+        /** Mesh light triangles built on the CPU.
+        */
+        struct CPUBuildResult
+        {
+            bool valid = false;                                 ///< False if the build failed (e.g. unsupported emissive texture). The GPU build is used instead.
+            std::string error;                                  ///< Reason the build failed. The build does not log, as it runs on a worker thread.
+            std::vector<uint32_t> meshInstanceIDs;              ///< Mesh instance ID per mesh light.
+            std::vector<float4x4> worldMatrices;                ///< World matrix per mesh light the triangles were built with.
+            std::vector<MeshLightTriangle> triangles;           ///< Pre-processed mesh light triangles.
+        };
+
         ~LightCollection() = default;
 
         /** Creates a light collection for the given scene.
             Note that update() must be called before the collection is ready to use.
             \param[in] pRenderContext The render context.
             \param[in] pScene The scene.
+            \param[in] cpuBuild Optional result of a CPU build started with buildCPU(). If it is valid and matches the scene's
+                        current state, the mesh light triangles are taken from it instead of being computed and read back from the GPU.
             \return Ptr to the created object, or nullptr if an error occured.
         */
-        static SharedPtr create(RenderContext* pRenderContext, const std::shared_ptr<Scene>& pScene);
+        static SharedPtr create(RenderContext* pRenderContext, const std::shared_ptr<Scene>& pScene, Threading::Future<CPUBuildResult> cpuBuild = {});
+
+        /** Capture the scene data needed to build the mesh light triangles on the CPU.
+            The caller is responsible for setting up the mesh data, which the scene does not keep after initialization.
+            \param[in] scene The scene.
+            \return The build input. It has no mesh lights if the scene has no emissive geometry or the emissive geometry cannot be built on the CPU (e.g. skinned meshes).
+        */
+        static CPUBuildInput prepareCPUBuild(const Scene& scene);
+
+        /** Build the mesh light triangles on the CPU.
+            This computes the world-space vertices, normals, areas and flux of all emissive triangles the same way as the GPU build.
+            Textured emission is integrated using EmissiveTextureIntegral. The function does not access the scene or the GPU,
+            and can be run on any thread.
+            \param[in] input Build input created by prepareCPUBuild().
+            \return The build result.
+        */
+        static CPUBuildResult buildCPU(const CPUBuildInput& input);
 
         /** Updates the light collection to the current state of the scene.
             \param[in] pRenderContext The render context.
@@ -121,6 +196,10 @@ namespace Falcor
         */
         bool update(RenderContext* pRenderContext, UpdateStatus* pUpdateStatus = nullptr);
 
+        /** Returns the per mesh light update flags from the last call to update().
+        */
+        const UpdateStatus& getUpdateStatus() const { return mUpdateStatus; }
+
         /** Bind the light collection data to a given shader var
             \param[in] var The shader variable to set the data into.
             \return True if successful, false otherwise.
@@ -150,6 +229,14 @@ namespace Falcor
         */
         const std::vector<MeshLightData>& getMeshLights() const { return mMeshLights; }
 
+        /** Returns the current object-to-world transform of a mesh light.
+            The transform is taken from the scene's animation controller, and matches the triangle data on the GPU after update().
+            This allows updating a CPU copy of the triangles without reading back the GPU data.
+            \param[in] lightIdx Index of the mesh light.
+            \return The transform, or std::nullopt if the mesh light is skinned and its vertices are only available on the GPU.
+        */
+        std::optional<float4x4> getMeshLightWorldMatrix(uint32_t lightIdx) const;
+
         /** Prepare for syncing the CPU data.
             If the mesh light triangles will be accessed with getMeshLightTriangles()
             performance can be improved by calling this function ahead of time.
@@ -174,10 +261,12 @@ namespace Falcor
     protected:
         LightCollection() = default;
 
-        bool init(RenderContext* pRenderContext, const std::shared_ptr<Scene>& pScene);
+        bool init(RenderContext* pRenderContext, const std::shared_ptr<Scene>& pScene, Threading::Future<CPUBuildResult> cpuBuild);
         bool initIntegrator(const Scene& scene);
         bool setupMeshLights(const Scene& scene);
-        void build(RenderContext* pRenderContext, const Scene& scene);
+        void build(RenderContext* pRenderContext, const Scene& scene, Threading::Future<CPUBuildResult> cpuBuild);
+        bool initFromCPUBuild(const Scene& scene, CPUBuildResult&& cpuBuild);
+        void createTriangleBuffers(const PackedEmissiveTriangle* pTriangleData, const EmissiveFlux* pFluxData);
         void prepareTriangleData(RenderContext* pRenderContext, const Scene& scene);
         void prepareMeshData(const Scene& scene);
         void integrateEmissive(RenderContext* pRenderContext, const Scene& scene);
@@ -194,6 +283,7 @@ namespace Falcor
 
         std::vector<MeshLightData>              mMeshLights;            ///< List of all mesh lights.
         uint32_t                                mTriangleCount = 0;     ///< Total number of triangles in all mesh lights (= mMeshLightTriangles.size()). This may include culled triangles.
+        UpdateStatus                            mUpdateStatus;          ///< Update flags of all mesh lights from the last call to update().
 
         mutable std::vector<MeshLightTriangle>  mMeshLightTriangles;    ///< List of all pre-processed mesh light triangles.
         mutable std::vector<uint32_t>           mActiveTriangleList;    ///< List of active (non-culled) emissive triangles.
@@ -30,6 +30,7 @@
 #include "Core/Program/GraphicsProgram.h"
 #include "Core/Program/ProgramVars.h"
 #include "Utils/Color/ColorHelpers.slang"
+#include "Utils/Math/HashUtils.h"
 
 namespace Falcor
 {
@@ -694,6 +695,45 @@ namespace Falcor
         return true;
     }
 
+    uint64_t BasicMaterial::computeHash() const
+    {
+        // Hash the same properties as compared in operator==.
+        uint64_t hash = 0;
+
+#define hash_field(_a) hashCombine(hash, mData._a)
+        hash_field(baseColor);
+        hash_field(specular);
+        hash_field(emissive);
+        hash_field(emissiveFactor);
+        hash_field(alphaThreshold);
+        hash_field(IoR);
+        hash_field(diffuseTransmission);
+        hash_field(specularTransmission);
+        hash_field(transmission);
+        hash_field(volumeAbsorption);
+        hash_field(volumeAnisotropy);
+        hash_field(volumeScattering);
+        hash_field(flags);
+        hash_field(type);
+        hash_field(displacementScale);
+        hash_field(displacementOffset);
+#undef hash_field
+
+#define hash_texture(_a) hashCombine(hash, mResources._a.get())
+        hash_texture(baseColor);
+        hash_texture(specular);
+        hash_texture(emissive);
+        hash_texture(normalMap);
+        hash_texture(transmission);
+        hash_texture(displacementMap);
+#undef hash_texture
+
+        hashCombine(hash, mResources.samplerState.get());
+        hashCombine(hash, mTextureTransform.getMatrix());
+
+        return hash;
+    }
+
     void BasicMaterial::setFlags(uint32_t flags)
     {
         if (mData.flags != flags)
@@ -77,6 +77,11 @@ namespace Falcor
         */
         bool isEqual(const Material::SharedPtr& pOther) const override;
 
+        /** Compute a hash of the material properties.
+            \return Hash of all material properties *except* the name, consistent with operator==.
+        */
+        uint64_t computeHash() const override;
+
         /** Get information about a texture slot.
             \param[in] slot The texture slot.
         */
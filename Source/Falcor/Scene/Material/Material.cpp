@@ -27,6 +27,7 @@
  **************************************************************************/
 #include "stdafx.h"
 #include "Material.h"
+#include "Utils/Math/HashUtils.h"
 
 namespace Falcor
 {
@@ -70,6 +71,13 @@ namespace Falcor
         return dim;
     }
 
+    uint64_t Material::computeHash() const
+    {
+        uint64_t hash = 0;
+        hashCombine(hash, getType());
+        return hash;
+    }
+
     void Material::markUpdates(UpdateFlags updates)
     {
         mUpdates |= updates;
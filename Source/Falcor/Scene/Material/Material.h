@@ -113,6 +113,13 @@ namespace Falcor
         */
         virtual bool isEqual(const Material::SharedPtr& pOther) const = 0;
 
+        /** Compute a hash of the material properties.
+            Materials for which isEqual() returns true have identical hashes, which allows finding duplicates without
+            comparing all pairs of materials. Textures and samplers are hashed by identity, like in isEqual().
+            \return Hash of all material properties *except* the name.
+        */
+        virtual uint64_t computeHash() const;
+
         /** Get information about a texture slot.
             \param[in] slot The texture slot.
             \return Info about the slot. If the slot doesn't exist isEnabled() returns false.
@@ -27,11 +27,46 @@
  **************************************************************************/
 #include "stdafx.h"
 #include "MaterialTextureLoader.h"
+#include "Utils/Math/HashUtils.h"
+#include <filesystem>
+#include <fstream>
 
 namespace Falcor
 {
-    MaterialTextureLoader::MaterialTextureLoader(bool useSrgb)
+    namespace
+    {
+        uint64_t hashFile(const std::string& path)
+        {
+            std::ifstream stream(path, std::ios::binary);
+            std::vector<char> buffer(1 << 20);
+            uint64_t hash = 0;
+            while (stream)
+            {
+                stream.read(buffer.data(), buffer.size());
+                hash = hashBytes(buffer.data(), (size_t)stream.gcount(), hash);
+            }
+            return hash;
+        }
+
+        bool compareFiles(const std::string& pathA, const std::string& pathB)
+        {
+            std::ifstream streamA(pathA, std::ios::binary), streamB(pathB, std::ios::binary);
+            if (!streamA || !streamB) return false;
+            std::vector<char> bufferA(1 << 20), bufferB(1 << 20);
+            while (streamA && streamB)
+            {
+                streamA.read(bufferA.data(), bufferA.size());
+                streamB.read(bufferB.data(), bufferB.size());
+                if (streamA.gcount() != streamB.gcount()) return false;
+                if (std::memcmp(bufferA.data(), bufferB.data(), (size_t)streamA.gcount()) != 0) return false;
+            }
+            return streamA.eof() && streamB.eof();
+        }
+    }
+
+    MaterialTextureLoader::MaterialTextureLoader(bool useSrgb, bool compressTextures)
         : mUseSrgb(useSrgb)
+        , mCompressTextures(compressTextures)
     {
     }
 
@@ -57,20 +92,68 @@ namespace Falcor
         }
 
         bool srgb = mUseSrgb && pMaterial->getTextureSlotInfo(slot).srgb;
-        TextureKey textureKey{fullPath, srgb};
+        auto compression = AsyncTextureLoader::Compression::None;
+        if (mCompressTextures && slot != Material::TextureSlot::Displacement)
+        {
+            compression = slot == Material::TextureSlot::Normal ? AsyncTextureLoader::Compression::Normal : AsyncTextureLoader::Compression::Color;
+        }
+        TextureKey textureKey{resolveDuplicateFile(fullPath), srgb, compression};
 
         // Load texture if not already requested before.
         if (mRequestedTextures.find(textureKey) == mRequestedTextures.end())
         {
-            mRequestedTextures[textureKey] = mAsyncTextureLoader.loadFromFile(fullPath, true, srgb);
+            mRequestedTextures[textureKey] = compression == AsyncTextureLoader::Compression::None
+                ? mAsyncTextureLoader.loadFromFile(fullPath, true, srgb)
+                : mAsyncTextureLoader.loadCompressedFromFile(fullPath, srgb, compression);
         }
 
         // Store assignment to material for later.
         mTextureAssignments.emplace_back(TextureAssignment{ pMaterial, slot, textureKey });
     }
 
+    const std::string& MaterialTextureLoader::resolveDuplicateFile(const std::string& path)
+    {
+        if (auto it = mResolvedFiles.find(path); it != mResolvedFiles.end()) return it->second;
+
+        std::error_code ec;
+        uint64_t size = std::filesystem::file_size(path, ec);
+        if (ec) return mResolvedFiles[path] = path;
+
+        // Only files of the same size can be identical. Hash the contents of all files with this size
+        // (lazily, as most files have a unique size) and compare them against the new file.
+        auto& files = mFilesBySize[size];
+        if (!files.empty())
+        {
+            uint64_t hash = hashFile(path);
+            for (auto& file : files)
+            {
+                if (!file.hasHash)
+                {
+                    file.hash = hashFile(file.path);
+                    file.hasHash = true;
+                }
+                // Confirm hash matches byte by byte, so that a hash collision can't bind the wrong texture.
+                if (file.hash == hash && compareFiles(path, file.path))
+                {
+                    logDebug("MaterialTextureLoader - Texture file '" + path + "' is identical to '" + file.path + "'.");
+                    mDuplicateFileCount++;
+                    return mResolvedFiles[path] = file.path;
+                }
+            }
+            files.push_back(FileInfo{ path, hash, true });
+        }
+        else
+        {
+            files.push_back(FileInfo{ path });
+        }
+
+        return mResolvedFiles[path] = path;
+    }
+
     void MaterialTextureLoader::assignTextures()
     {
+        if (mDuplicateFileCount > 0) logInfo("MaterialTextureLoader - Skipped loading " + std::to_string(mDuplicateFileCount) + " texture files with duplicate contents.");
+
         // Wait for all textures to be loaded.
         std::map<TextureKey, Texture::SharedPtr> loadedTextures;
         for (auto &[key, texture] : mRequestedTextures)
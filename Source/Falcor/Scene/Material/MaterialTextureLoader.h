@@ -39,11 +39,24 @@ namespace Falcor
         material assignment is stored. When the client destroys the instance of the
         `MaterialTextureLoader`, it blocks until all textures are loaded and assigns
         them to the materials.
+
+        Each texture is only loaded once, even if it is referenced by multiple materials
+        or stored in multiple files with identical contents. Files are compared by a
+        content hash, which is only computed for files that have the same size as another
+        requested file.
+
+        If texture compression is enabled, textures are transcoded to block-compressed formats
+        with full mip-chains (see AsyncTextureLoader::loadCompressedFromFile). Displacement maps
+        are always loaded uncompressed to preserve their precision.
     */
     class MaterialTextureLoader
     {
     public:
-        MaterialTextureLoader(bool useSrgb);
+        /** Constructor.
+            \param[in] useSrgb Load color textures using sRGB formats.
+            \param[in] compressTextures Transcode textures to block-compressed formats and cache them on disk.
+        */
+        MaterialTextureLoader(bool useSrgb, bool compressTextures = false);
         ~MaterialTextureLoader();
 
         /** Request loading a material texture.
@@ -56,9 +69,27 @@ namespace Falcor
     private:
         void assignTextures();
 
+        /** Returns the path of the first requested file with contents identical to the given file.
+            \param[in] path Full path of a texture file.
+            \return Path of the identical file, or 'path' if there is none.
+        */
+        const std::string& resolveDuplicateFile(const std::string& path);
+
         bool mUseSrgb;
+        bool mCompressTextures;
+
+        struct FileInfo
+        {
+            std::string path;
+            uint64_t hash = 0;
+            bool hasHash = false;
+        };
+
+        std::unordered_map<uint64_t, std::vector<FileInfo>> mFilesBySize;     ///< Requested files with unique contents, grouped by file size.
+        std::unordered_map<std::string, std::string> mResolvedFiles;           ///< Map from requested files to the files with identical contents they resolve to.
+        size_t mDuplicateFileCount = 0;
 
-        using TextureKey = std::pair<std::string, bool>; // filename, srgb
+        using TextureKey = std::tuple<std::string, bool, AsyncTextureLoader::Compression>; // filename, srgb, compression
 
         struct TextureAssignment
         {
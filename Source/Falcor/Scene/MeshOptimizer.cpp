@@ -0,0 +1,236 @@
+/***************************************************************************
+ # Copyright (c) 2015-21, NVIDIA CORPORATION. All rights reserved.
+ #
+ # Redistribution and use in source and binary forms, with or without
+ # modification, are permitted provided that the following conditions
+ # are met:
+ #  * Redistributions of source code must retain the above copyright
+ #    notice, this list of conditions and the following disclaimer.
+ #  * Redistributions in binary form must reproduce the above copyright
+ #    notice, this list of conditions and the following disclaimer in the
+ #    documentation and/or other materials provided with the distribution.
+ #  * Neither the name of NVIDIA CORPORATION nor the names of its
+ #    contributors may be used to endorse or promote products derived
+ #    from this software without specific prior written permission.
+ #
+ # THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS "AS IS" AND ANY
+ # EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ # IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ # PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+ # CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ # EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ # PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ # PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+ # OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ # (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ # OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ **************************************************************************/
+#include "stdafx.h"
+#include "MeshOptimizer.h"
+
+namespace Falcor
+{
+    namespace
+    {
+        const uint32_t kInvalidIndex = 0xffffffff;
+
+        /** Spread the lower 10 bits of x so that there are two zero bits between each bit.
+        */
+        uint32_t expandBits(uint32_t x)
+        {
+            x = (x | (x << 16)) & 0x030000ff;
+            x = (x | (x << 8)) & 0x0300f00f;
+            x = (x | (x << 4)) & 0x030c30c3;
+            x = (x | (x << 2)) & 0x09249249;
+            return x;
+        }
+
+        /** Compute the 30-bit Morton code of a point in the unit cube.
+        */
+        uint32_t mortonCode(const float3& p)
+        {
+            uint3 q = uint3(glm::clamp(p * 1024.f, float3(0.f), float3(1023.f)));
+            return (expandBits(q.x) << 2) | (expandBits(q.y) << 1) | expandBits(q.z);
+        }
+    }
+
+    void MeshOptimizer::optimizeVertexCache(std::vector<uint32_t>& indices, uint32_t vertexCount, uint32_t cacheSize)
+    {
+        assert(indices.size() % 3 == 0);
+        const uint32_t triangleCount = (uint32_t)(indices.size() / 3);
+        if (triangleCount == 0) return;
+
+        // Build vertex-triangle adjacency. The live count of a vertex is its number of remaining triangles.
+        std::vector<uint32_t> liveCount(vertexCount, 0);
+        for (uint32_t index : indices)
+        {
+            assert(index < vertexCount);
+            liveCount[index]++;
+        }
+
+        std::vector<uint32_t> adjacencyOffsets(vertexCount + 1, 0);
+        for (uint32_t v = 0; v < vertexCount; v++) adjacencyOffsets[v + 1] = adjacencyOffsets[v] + liveCount[v];
+
+        std::vector<uint32_t> adjacency(indices.size());
+        {
+            std::vector<uint32_t> offsets(adjacencyOffsets.begin(), adjacencyOffsets.end() - 1);
+            for (uint32_t t = 0; t < triangleCount; t++)
+            {
+                for (uint32_t k = 0; k < 3; k++) adjacency[offsets[indices[3 * t + k]]++] = t;
+            }
+        }
+
+        std::vector<uint32_t> cacheTime(vertexCount, 0);
+        std::vector<bool> emitted(triangleCount, false);
+        std::vector<uint32_t> deadEnd;
+        std::vector<uint32_t> candidates;
+        std::vector<uint32_t> output;
+        output.reserve(indices.size());
+
+        uint32_t timeStamp = cacheSize + 1;
+        uint32_t cursor = 0; // Next triangle in input order to check when the fanning sequence hits a dead end.
+
+        // Returns the next vertex to fan around, or kInvalidIndex if all triangles have been emitted.
+        auto skipDeadEnd = [&]()
+        {
+            while (!deadEnd.empty())
+            {
+                uint32_t v = deadEnd.back();
+                deadEnd.pop_back();
+                if (liveCount[v] > 0) return v;
+            }
+            while (cursor < triangleCount)
+            {
+                uint32_t t = cursor++;
+                if (!emitted[t]) return indices[3 * t];
+            }
+            return kInvalidIndex;
+        };
+
+        uint32_t fanningVertex = indices[0];
+        while (fanningVertex != kInvalidIndex)
+        {
+            // Emit all remaining triangles around the fanning vertex.
+            candidates.clear();
+            for (uint32_t i = adjacencyOffsets[fanningVertex]; i < adjacencyOffsets[fanningVertex + 1]; i++)
+            {
+                uint32_t t = adjacency[i];
+                if (emitted[t]) continue;
+
+                for (uint32_t k = 0; k < 3; k++)
+                {
+                    uint32_t v = indices[3 * t + k];
+                    output.push_back(v);
+                    deadEnd.push_back(v);
+                    candidates.push_back(v);
+                    liveCount[v]--;
+                    if (timeStamp - cacheTime[v] > cacheSize) cacheTime[v] = timeStamp++;
+                }
+                emitted[t] = true;
+            }
+
+            // Pick the candidate that is still in the cache after fanning around it and is oldest.
+            uint32_t bestVertex = kInvalidIndex;
+            int64_t bestPriority = -1;
+            for (uint32_t v : candidates)
+            {
+                if (liveCount[v] == 0) continue;
+                int64_t priority = 0;
+                if (timeStamp - cacheTime[v] + 2 * liveCount[v] <= cacheSize) priority = timeStamp - cacheTime[v];
+                if (priority > bestPriority)
+                {
+                    bestPriority = priority;
+                    bestVertex = v;
+                }
+            }
+
+            fanningVertex = bestVertex != kInvalidIndex ? bestVertex : skipDeadEnd();
+        }
+
+        assert(output.size() == indices.size());
+        indices = std::move(output);
+    }
+
+    void MeshOptimizer::sortTrianglesSpatially(std::vector<uint32_t>& indices, const std::vector<float3>& positions)
+    {
+        assert(indices.size() % 3 == 0);
+        const uint32_t triangleCount = (uint32_t)(indices.size() / 3);
+        if (triangleCount == 0) return;
+
+        // Compute the bounds of the triangle centroids.
+        std::vector<float3> centroids(triangleCount);
+        float3 minPos(std::numeric_limits<float>::max());
+        float3 maxPos(-std::numeric_limits<float>::max());
+        for (uint32_t t = 0; t < triangleCount; t++)
+        {
+            centroids[t] = (positions[indices[3 * t]] + positions[indices[3 * t + 1]] + positions[indices[3 * t + 2]]) / 3.f;
+            minPos = glm::min(minPos, centroids[t]);
+            maxPos = glm::max(maxPos, centroids[t]);
+        }
+
+        // Sort triangles by the Morton codes of their centroids. Uniform scaling keeps the curve's aspect ratio.
+        const float extent = glm::compMax(maxPos - minPos);
+        const float scale = extent > 0.f ? 1.f / extent : 0.f;
+
+        std::vector<std::pair<uint32_t, uint32_t>> keys(triangleCount);
+        for (uint32_t t = 0; t < triangleCount; t++) keys[t] = { mortonCode((centroids[t] - minPos) * scale), t };
+        std::sort(keys.begin(), keys.end());
+
+        std::vector<uint32_t> output(indices.size());
+        for (uint32_t i = 0; i < triangleCount; i++)
+        {
+            uint32_t t = keys[i].second;
+            for (uint32_t k = 0; k < 3; k++) output[3 * i + k] = indices[3 * t + k];
+        }
+        indices = std::move(output);
+    }
+
+    std::vector<uint32_t> MeshOptimizer::optimizeVertexFetch(std::vector<uint32_t>& indices, uint32_t vertexCount)
+    {
+        std::vector<uint32_t> remap(vertexCount, kInvalidIndex);
+        std::vector<uint32_t> newToOld;
+        newToOld.reserve(vertexCount);
+
+        for (uint32_t& index : indices)
+        {
+            assert(index < vertexCount);
+            if (remap[index] == kInvalidIndex)
+            {
+                remap[index] = (uint32_t)newToOld.size();
+                newToOld.push_back(index);
+            }
+            index = remap[index];
+        }
+
+        // Keep unreferenced vertices at the end.
+        for (uint32_t v = 0; v < vertexCount; v++)
+        {
+            if (remap[v] == kInvalidIndex) newToOld.push_back(v);
+        }
+
+        return newToOld;
+    }
+
+    float MeshOptimizer::computeACMR(const std::vector<uint32_t>& indices, uint32_t vertexCount, uint32_t cacheSize)
+    {
+        const size_t triangleCount = indices.size() / 3;
+        if (triangleCount == 0) return 0.f;
+
+        // A vertex is in the FIFO cache if it was inserted less than cacheSize insertions ago.
+        std::vector<uint64_t> insertTime(vertexCount, 0);
+        uint64_t time = cacheSize + 1;
+        uint64_t misses = 0;
+
+        for (uint32_t index : indices)
+        {
+            assert(index < vertexCount);
+            if (time - insertTime[index] > cacheSize)
+            {
+                insertTime[index] = time++;
+                misses++;
+            }
+        }
+
+        return (float)((double)misses / triangleCount);
+    }
+}
@@ -0,0 +1,76 @@
+/***************************************************************************
+ # Copyright (c) 2015-21, NVIDIA CORPORATION. All rights reserved.
+ #
+ # Redistribution and use in source and binary forms, with or without
+ # modification, are permitted provided that the following conditions
+ # are met:
+ #  * Redistributions of source code must retain the above copyright
+ #    notice, this list of conditions and the following disclaimer.
+ #  * Redistributions in binary form must reproduce the above copyright
+ #    notice, this list of conditions and the following disclaimer in the
+ #    documentation and/or other materials provided with the distribution.
+ #  * Neither the name of NVIDIA CORPORATION nor the names of its
+ #    contributors may be used to endorse or promote products derived
+ #    from this software without specific prior written permission.
+ #
+ # THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS "AS IS" AND ANY
+ # EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ # IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ # PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+ # CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ # EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ # PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ # PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+ # OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ # (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ # OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ **************************************************************************/
+#pragma once
+#include "Falcor.h"
+
+namespace Falcor
+{
+    /** Utility functions for optimizing the triangle and vertex order of indexed triangle meshes.
+        All functions operate on triangle lists.
+    */
+    class dlldecl MeshOptimizer
+    {
+    public:
+        /** Default size of the simulated post-transform vertex cache.
+        */
+        static const uint32_t kDefaultCacheSize = 16;
+
+        /** Reorder triangles for post-transform vertex cache efficiency.
+            This implements Tipsify [Sander et al. 2007, "Fast Triangle Reordering for Vertex Locality and Reduced Overdraw"].
+            The algorithm runs in linear time. Triangles are fanned around vertices in the cache, and when none is
+            suitable, the algorithm continues with the first remaining triangle in the input order. This keeps the
+            coarse ordering of the input (e.g. after sortTrianglesSpatially()).
+            \param[in,out] indices Triangle list indices. Triangles are reordered, vertex order within triangles is preserved.
+            \param[in] vertexCount Number of vertices. All indices must be smaller than this.
+            \param[in] cacheSize Size of the vertex cache to optimize for.
+        */
+        static void optimizeVertexCache(std::vector<uint32_t>& indices, uint32_t vertexCount, uint32_t cacheSize = kDefaultCacheSize);
+
+        /** Reorder triangles along a Morton curve through their centroids.
+            \param[in,out] indices Triangle list indices. Triangles are reordered, vertex order within triangles is preserved.
+            \param[in] positions Vertex positions.
+        */
+        static void sortTrianglesSpatially(std::vector<uint32_t>& indices, const std::vector<float3>& positions);
+
+        /** Renumber vertices in the order they are first referenced by the index buffer.
+            \param[in,out] indices Triangle list indices. The indices are remapped to the new vertex order.
+            \param[in] vertexCount Number of vertices. All indices must be smaller than this.
+            \return Returns the original index of each new vertex. Unreferenced vertices are moved to the end.
+        */
+        static std::vector<uint32_t> optimizeVertexFetch(std::vector<uint32_t>& indices, uint32_t vertexCount);
+
+        /** Compute the average cache miss ratio (ACMR), i.e. the number of transformed vertices per triangle,
+            by simulating a FIFO post-transform vertex cache.
+            \param[in] indices Triangle list indices.
+            \param[in] vertexCount Number of vertices. All indices must be smaller than this.
+            \param[in] cacheSize Size of the simulated vertex cache.
+            \return Returns the ACMR, in the range [0.5, 3] for typical meshes, or 0 if there are no triangles.
+        */
+        static float computeACMR(const std::vector<uint32_t>& indices, uint32_t vertexCount, uint32_t cacheSize = kDefaultCacheSize);
+    };
+}
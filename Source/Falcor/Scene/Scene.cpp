@@ -170,22 +170,33 @@ namespace Falcor
 
         // Setup volume grid -> id map.
         for (size_t i = 0; i < mGrids.size(); ++i) mGridIDs.emplace(mGrids[i], (uint32_t)i);
+        for (const auto& pGridVolume : mGridVolumes)
+        {
+            for (const auto& pSequence : pGridVolume->getAllStreamingGridSequences())
+            {
+                mStreamingGridSequenceIDs.emplace(pSequence, (uint32_t)(mGrids.size() + mStreamingGridSequenceIDs.size()));
+            }
+        }
 
         // Set default SDF grid config.
         setDefaultSDFGridConfig();
 
         // Create vertex array objects for meshes and curves.
-        createMeshVao(sceneData.meshDrawCount, sceneData.meshIndexData, sceneData.meshStaticData, sceneData.meshDynamicData);
+        createMeshVao(sceneData.meshDrawCount, sceneData.getMeshIndexData(), sceneData.getMeshIndexCount(), sceneData.getMeshVertexCount());
         createCurveVao(mCurveIndexData, mCurveStaticData);
 
         // Create animation controller.
-        mpAnimationController = AnimationController::create(this, sceneData.meshStaticData, sceneData.meshDynamicData, sceneData.animations);
+        mpAnimationController = AnimationController::create(this, sceneData.getMeshStaticData(), sceneData.getMeshVertexCount(), sceneData.meshDynamicData, sceneData.animations);
 
         // Must be placed after curve data/AABB creation.
         mpAnimationController->addAnimatedVertexCaches(std::move(sceneData.cachedCurves), std::move(sceneData.cachedMeshes));
 
         // Finalize scene.
         finalize();
+
+        // Build the emissive triangles on the CPU while the GPU resources are being set up, if requested.
+        // Otherwise they are built on the GPU when the light collection is first used.
+        if (sceneData.prebuildLightCollection) startLightCollectionBuild(sceneData);
     }
 
     Scene::SharedPtr Scene::create(const std::string& filename)
@@ -207,7 +218,7 @@ namespace Falcor
         defines.add("SCENE_SDF_GRID_MAX_LOD_COUNT",  std::to_string(mSDFGridMaxLODCount));
         defines.add("SCENE_MATERIAL_COUNT", std::to_string(mMaterials.size()));
         defines.add("MONOCHROME", mMonochromeMode ? "1" : "0");
-        defines.add("SCENE_GRID_COUNT", std::to_string(mGrids.size()));
+        defines.add("SCENE_GRID_COUNT", std::to_string(mGrids.size() + mStreamingGridSequenceIDs.size()));
         defines.add("SCENE_HAS_INDEXED_VERTICES", hasIndexBuffer() ? "1" : "0");
         defines.add("SCENE_HAS_16BIT_INDICES", mHas16BitIndices ? "1" : "0");
         defines.add("SCENE_HAS_32BIT_INDICES", mHas32BitIndices ? "1" : "0");
@@ -221,7 +232,7 @@ namespace Falcor
     {
         if (!mpLightCollection)
         {
-            mpLightCollection = LightCollection::create(pContext, shared_from_this());
+            mpLightCollection = LightCollection::create(pContext, shared_from_this(), std::move(mLightCollectionBuild));
             mpLightCollection->setShaderData(mpSceneBlock["lightCollection"]);
 
             mSceneStats.emissiveMemoryInBytes = mpLightCollection->getMemoryUsageInBytes();
@@ -294,10 +305,10 @@ namespace Falcor
         pContext->raytrace(pProgram, pVars.get(), dispatchDims.x, dispatchDims.y, dispatchDims.z);
     }
 
-    void Scene::createMeshVao(uint32_t drawCount, const std::vector<uint32_t>& indexData, const std::vector<PackedStaticVertexData>& staticData, const std::vector<DynamicVertexData>& dynamicData)
+    void Scene::createMeshVao(uint32_t drawCount, const uint32_t* pIndexData, size_t indexCount, size_t vertexCount)
     {
         // Create the index buffer.
-        size_t ibSize = sizeof(uint32_t) * indexData.size();
+        size_t ibSize = sizeof(uint32_t) * indexCount;
         if (ibSize > std::numeric_limits<uint32_t>::max())
         {
             throw std::exception("Index buffer size exceeds 4GB");
@@ -307,11 +318,10 @@ namespace Falcor
         if (ibSize > 0)
         {
             ResourceBindFlags ibBindFlags = Resource::BindFlags::Index | ResourceBindFlags::ShaderResource;
-            pIB = Buffer::create(ibSize, ibBindFlags, Buffer::CpuAccess::None, indexData.data());
+            pIB = Buffer::create(ibSize, ibBindFlags, Buffer::CpuAccess::None, pIndexData);
         }
 
         // Create the vertex data structured buffer.
-        const size_t vertexCount = (uint32_t)staticData.size();
         size_t staticVbSize = sizeof(PackedStaticVertexData) * vertexCount;
         if (staticVbSize > std::numeric_limits<uint32_t>::max())
         {
@@ -974,6 +984,28 @@ namespace Falcor
         mFinalized = true;
     }
 
+    void Scene::startLightCollectionBuild(SceneData& sceneData)
+    {
+        auto pInput = std::make_shared<LightCollection::CPUBuildInput>(LightCollection::prepareCPUBuild(*this));
+        if (pInput->meshLights.empty()) return;
+
+        // Move the mesh data to the build. It is released as soon as the build has finished.
+        pInput->pMeshDataFile = sceneData.pMeshDataFile;
+        pInput->indexCount = sceneData.getMeshIndexCount();
+        pInput->vertexCount = sceneData.getMeshVertexCount();
+        pInput->indexData = std::move(sceneData.meshIndexData);
+        pInput->vertexData = std::move(sceneData.meshStaticData);
+        pInput->pIndexData = pInput->pMeshDataFile ? sceneData.pMappedMeshIndexData : pInput->indexData.data();
+        pInput->pVertexData = pInput->pMeshDataFile ? sceneData.pMappedMeshStaticData : pInput->vertexData.data();
+
+        mLightCollectionBuild = Threading::async([pInput]() mutable
+        {
+            auto result = LightCollection::buildCPU(*pInput);
+            pInput.reset();
+            return result;
+        });
+    }
+
     void Scene::initializeCameras()
     {
         for (auto& camera : mCameras)
@@ -1245,6 +1277,13 @@ namespace Falcor
             s.gridVoxelCount += pGrid->getVoxelCount();
             s.gridMemoryInBytes += pGrid->getGridSizeInBytes();
         }
+
+        // Streamed sequences only contribute their currently resident frames.
+        for (const auto& [pSequence, id] : mStreamingGridSequenceIDs)
+        {
+            s.gridCount += pSequence->getResidentFrameCount();
+            s.gridMemoryInBytes += pSequence->getResidentBytes();
+        }
     }
 
     bool Scene::updateAnimatable(Animatable& animatable, const AnimationController& controller, bool force)
@@ -1368,16 +1407,38 @@ namespace Falcor
             }
         }
 
+        // Look up the grid ID of a volume's grid slot. Streamed sequences bind their current frame to the slot of the sequence.
+        auto getGridID = [this] (const GridVolume& gridVolume, GridVolume::GridSlot slot)
+        {
+            const auto& pGrid = gridVolume.getGrid(slot);
+            if (!pGrid) return kInvalidGrid;
+            const auto& pSequence = gridVolume.getStreamingGridSequence(slot);
+            return pSequence ? mStreamingGridSequenceIDs.at(pSequence) : mGridIDs.at(pGrid);
+        };
+
         // Upload volumes and clear updates.
+        auto gridsVar = mpSceneBlock["grids"];
         uint32_t volumeIndex = 0;
         for (const auto& pGridVolume : mGridVolumes)
         {
             if (forceUpdate || pGridVolume->getUpdates() != GridVolume::UpdateFlags::None)
             {
+                // Bind the current frames of streamed sequences.
+                if (forceUpdate || is_set(pGridVolume->getUpdates(), GridVolume::UpdateFlags::GridsChanged))
+                {
+                    for (uint32_t slotIndex = 0; slotIndex < (uint32_t)GridVolume::GridSlot::Count; ++slotIndex)
+                    {
+                        auto slot = (GridVolume::GridSlot)slotIndex;
+                        const auto& pSequence = pGridVolume->getStreamingGridSequence(slot);
+                        const auto& pGrid = pGridVolume->getGrid(slot);
+                        if (pSequence && pGrid) pGrid->setShaderData(gridsVar[mStreamingGridSequenceIDs.at(pSequence)]);
+                    }
+                }
+
                 // Fetch copy of volume data.
                 auto data = pGridVolume->getData();
-                data.densityGrid = pGridVolume->getDensityGrid() ? mGridIDs.at(pGridVolume->getDensityGrid()) : kInvalidGrid;
-                data.emissionGrid = pGridVolume->getEmissionGrid() ? mGridIDs.at(pGridVolume->getEmissionGrid()) : kInvalidGrid;
+                data.densityGrid = getGridID(*pGridVolume, GridVolume::GridSlot::Density);
+                data.emissionGrid = getGridID(*pGridVolume, GridVolume::GridSlot::Emission);
                 // Merge grid and volume transforms.
                 const auto& densityGrid = pGridVolume->getDensityGrid();
                 if (densityGrid)
@@ -902,6 +902,7 @@ namespace Falcor
             std::vector<Node> sceneGraph;                           ///< Scene graph nodes.
             std::vector<Animation::SharedPtr> animations;           ///< List of animations.
             Metadata metadata;                                      ///< Scene meadata.
+            bool prebuildLightCollection = false;                   ///< Build the mesh light triangles on the CPU while the scene is created. See SceneBuilder::Flags::PrebuildLightCollection.
 
             // Mesh data
             std::vector<MeshDesc> meshDesc;                         ///< List of mesh descriptors.
@@ -921,6 +922,19 @@ namespace Falcor
             std::vector<PackedStaticVertexData> meshStaticData;     ///< Vertex attributes for all meshes in packed format.
             std::vector<DynamicVertexData> meshDynamicData;         ///< Additional vertex attributes for dynamic (skinned) meshes.
 
+            // Mesh data referenced in a memory-mapped scene cache file.
+            // If pMeshDataFile is set, meshIndexData and meshStaticData are empty and the data is accessed through the pointers below.
+            MemoryMappedFile::SharedPtr pMeshDataFile;              ///< Mapped file holding the mesh index and vertex data.
+            const uint32_t* pMappedMeshIndexData = nullptr;         ///< Vertex indices in the mapped file.
+            size_t mappedMeshIndexCount = 0;                        ///< Number of elements in pMappedMeshIndexData.
+            const PackedStaticVertexData* pMappedMeshStaticData = nullptr; ///< Vertex attributes in the mapped file.
+            size_t mappedMeshVertexCount = 0;                       ///< Number of elements in pMappedMeshStaticData.
+
+            const uint32_t* getMeshIndexData() const { return pMeshDataFile ? pMappedMeshIndexData : meshIndexData.data(); }
+            size_t getMeshIndexCount() const { return pMeshDataFile ? mappedMeshIndexCount : meshIndexData.size(); }
+            const PackedStaticVertexData* getMeshStaticData() const { return pMeshDataFile ? pMappedMeshStaticData : meshStaticData.data(); }
+            size_t getMeshVertexCount() const { return pMeshDataFile ? mappedMeshVertexCount : meshStaticData.size(); }
+
             // Curve data
             std::vector<CurveDesc> curveDesc;                       ///< List of curve descriptors.
             std::vector<AABB> curveBBs;                             ///< List of curve bounding boxes in object space. Each curve consists of many segments, each with its own AABB. The bounding boxes here are the unions of those.
@@ -952,7 +966,7 @@ namespace Falcor
 
         static SharedPtr create(SceneData&& sceneData, bool monochromeMode = false);
 
-        void createMeshVao(uint32_t drawCount, const std::vector<uint32_t>& indexData, const std::vector<PackedStaticVertexData>& staticData, const std::vector<DynamicVertexData>& dynamicData);
+        void createMeshVao(uint32_t drawCount, const uint32_t* pIndexData, size_t indexCount, size_t vertexCount);
         void createCurveVao(const std::vector<uint32_t>& indexData, const std::vector<StaticCurveVertexData>& staticData);
 
         /** Sets the default SDF grid config.
@@ -999,6 +1013,11 @@ namespace Falcor
         */
         void finalize();
 
+        /** Start building the mesh light triangles on a worker thread from the CPU-side mesh data.
+            This takes ownership of the mesh index and vertex data in sceneData. See LightCollection::buildCPU().
+        */
+        void startLightCollectionBuild(SceneData& sceneData);
+
         /** Create the draw list for rasterization.
         */
         void createDrawList();
@@ -1141,7 +1160,9 @@ namespace Falcor
         std::vector<GridVolume::SharedPtr> mGridVolumes;            ///< All loaded grid volumes.
         std::vector<Grid::SharedPtr> mGrids;                        ///< All loaded grids.
         std::unordered_map<Grid::SharedPtr, uint32_t> mGridIDs;     ///< Lookup table for grid IDs.
+        std::unordered_map<StreamingGridSequence::SharedPtr, uint32_t> mStreamingGridSequenceIDs; ///< Lookup table for the grid IDs of streamed sequences. The current frame of each sequence is bound to a grid slot after the static grids.
         LightCollection::SharedPtr mpLightCollection;               ///< Class for managing emissive geometry. This is created lazily upon first use.
+        Threading::Future<LightCollection::CPUBuildResult> mLightCollectionBuild; ///< Mesh light triangles built on the CPU at load time. Consumed when the light collection is created.
         EnvMap::SharedPtr mpEnvMap;                                 ///< Environment map or nullptr if not loaded.
         bool mEnvMapChanged = false;                                ///< Flag indicating that the environment map has changed since last frame.
         uint32_t mActiveLightCount = 0;                             ///< Number of currently active analytic lights.
@@ -29,6 +29,7 @@
 #include "SceneBuilder.h"
 #include "SceneCache.h"
 #include "Importer.h"
+#include "MeshOptimizer.h"
 #include "Utils/Math/MathConstants.slangh"
 #include "Utils/Image/TextureAnalyzer.h"
 #include "Utils/Timing/TimeReport.h"
@@ -44,10 +45,19 @@ namespace Falcor
         // The target is max 16M triangles per BLAS (= approx 0.5GB post-compaction). Note that this is not a strict limit.
         const size_t kMaxTrianglesPerBLAS = 1ull << 24;
 
+        // Parameters of the binned SAH used for partitioning mesh groups.
+        // The costs are relative to the cost of one BVH traversal step inside a BLAS.
+        const uint32_t kSAHBinCount = 16;
+        const float kSAHInstanceCost = 4.f;     // Cost of entering a BLAS through the TLAS.
+        const float kSAHOverlapCost = 1.f;      // Additional cost per unit of overlap probability between the two sides of a split.
+
         // Texture coordinates for textured emissive materials are quantized for performance reasons.
         // We'll log a warning if the maximum quantization error exceeds this value.
         const float kMaxTexelError = 0.5f;
 
+        // Number of vertices per task when transforming vertices in parallel. Smaller meshes are transformed on the calling thread.
+        const size_t kParallelVertexGrainSize = 1 << 14;
+
         int largestAxis(const float3& v)
         {
             if (v.x >= v.y && v.x >= v.z) return 0;
@@ -138,6 +148,118 @@ namespace Falcor
             return true;
         }
 
+        /** Open-addressing hash map used to find identical vertices in processMesh().
+            The map only stores hashes and vertex indices. Entries with matching hash are confirmed with
+            a caller-provided comparison, so hash collisions never merge distinct vertices.
+        */
+        class VertexHashMap
+        {
+        public:
+            static const uint32_t kInvalidIndex = 0xffffffff;
+
+            VertexHashMap(size_t expectedCount)
+            {
+                size_t capacity = 16;
+                while (capacity < 2 * expectedCount) capacity *= 2;
+                mEntries.resize(capacity, { 0, kInvalidIndex });
+            }
+
+            /** Find a vertex.
+                \param[in] hash Vertex hash.
+                \param[in] isEqual Predicate called with the index of each candidate vertex with matching hash.
+                \return Index of the first candidate for which isEqual returns true, or kInvalidIndex if there is none.
+            */
+            template<typename Pred>
+            uint32_t find(uint32_t hash, const Pred& isEqual) const
+            {
+                const size_t mask = mEntries.size() - 1;
+                for (size_t slot = hash & mask;; slot = (slot + 1) & mask)
+                {
+                    const auto& entry = mEntries[slot];
+                    if (entry.index == kInvalidIndex) return kInvalidIndex;
+                    if (entry.hash == hash && isEqual(entry.index)) return entry.index;
+                }
+            }
+
+            /** Insert a vertex. The map is grown to keep the load factor below 0.5.
+            */
+            void insert(uint32_t hash, uint32_t index)
+            {
+                if (2 * (mSize + 1) > mEntries.size()) grow();
+                insertEntry({ hash, index });
+                mSize++;
+            }
+
+        private:
+            struct Entry
+            {
+                uint32_t hash;
+                uint32_t index;
+            };
+
+            void insertEntry(const Entry& entry)
+            {
+                const size_t mask = mEntries.size() - 1;
+                size_t slot = entry.hash & mask;
+                while (mEntries[slot].index != kInvalidIndex) slot = (slot + 1) & mask;
+                mEntries[slot] = entry;
+            }
+
+            void grow()
+            {
+                std::vector<Entry> entries(mEntries.size() * 2, { 0, kInvalidIndex });
+                std::swap(entries, mEntries);
+                for (const auto& entry : entries)
+                {
+                    if (entry.index != kInvalidIndex) insertEntry(entry);
+                }
+            }
+
+            std::vector<Entry> mEntries;
+            size_t mSize = 0;
+        };
+
+        /** Compute the hash of a vertex for use with VertexHashMap.
+            Vertices that compare equal with compareVertices() are only guaranteed to have the same hash if their
+            thresholded attributes lie in the same cell of the quantization grid. The grid is much coarser than the
+            comparison threshold, so near-identical vertices that straddle a cell boundary are rare. They are kept
+            as separate vertices, which is harmless.
+        */
+        uint32_t hashVertex(const SceneBuilder::Mesh::Vertex& v, uint32_t origIndex)
+        {
+            const float kQuantizationScale = 1024.f; // Quantization grid for attributes compared with a threshold.
+
+            uint64_t h = origIndex;
+            auto combine = [&h](uint32_t x)
+            {
+                h = (h ^ x) * 0x9e3779b97f4a7c15ull;
+                h ^= h >> 32;
+            };
+            // Attributes compared exactly are hashed on their bit patterns. Adding zero maps -0 to +0.
+            auto hashExact = [&combine](float x)
+            {
+                x += 0.f;
+                uint32_t bits;
+                std::memcpy(&bits, &x, sizeof(bits));
+                combine(bits);
+            };
+            auto hashQuantized = [&combine](float x)
+            {
+                int32_t q = std::isfinite(x) ? (int32_t)std::floor(glm::clamp(x, -1e6f, 1e6f) * kQuantizationScale) : 0;
+                combine((uint32_t)q);
+            };
+
+            for (int i = 0; i < 3; i++) hashExact(v.position[i]);
+            hashExact(v.tangent.w);
+            for (int i = 0; i < 4; i++) combine(v.boneIDs[i]);
+            for (int i = 0; i < 3; i++) hashQuantized(v.normal[i]);
+            for (int i = 0; i < 3; i++) hashQuantized(v.tangent[i]);
+            for (int i = 0; i < 2; i++) hashQuantized(v.texCrd[i]);
+            for (int i = 0; i < 4; i++) hashQuantized(v.boneWeights[i]);
+
+            return (uint32_t)(h ^ (h >> 29));
+        }
+
         std::vector<uint32_t> compact16BitIndices(const std::vector<uint32_t>& indices)
         {
             if (indices.empty()) return {};
@@ -154,7 +276,7 @@ namespace Falcor
 
         SceneCache::Key computeSceneCacheKey(const std::string& scenePath, SceneBuilder::Flags buildFlags)
         {
-            SceneBuilder::Flags cacheFlags = buildFlags & (~(SceneBuilder::Flags::UseCache | SceneBuilder::Flags::RebuildCache));
+            SceneBuilder::Flags cacheFlags = buildFlags & (~(SceneBuilder::Flags::UseCache | SceneBuilder::Flags::RebuildCache | SceneBuilder::Flags::PrebuildLightCollection));
             SHA1 sha1;
             sha1.update(scenePath.data(), scenePath.size());
             sha1.update(&cacheFlags, sizeof(cacheFlags));
@@ -165,6 +287,7 @@ namespace Falcor
 
     SceneBuilder::SceneBuilder(Flags flags)
         : mFlags(flags)
+        , mMaxTrianglesPerBLAS(kMaxTrianglesPerBLAS)
     {
         mpFence = GpuFence::create();
     }
@@ -201,7 +324,9 @@ namespace Falcor
         {
             try
             {
-                pBuilder->mpScene = Scene::create(SceneCache::readCache(pBuilder->mSceneCacheKey));
+                auto sceneData = SceneCache::readCache(pBuilder->mSceneCacheKey, !is_set(buildFlags, Flags::AssumeLinearSpaceTextures), is_set(buildFlags, Flags::CompressTextures));
+                sceneData.prebuildLightCollection = is_set(buildFlags, Flags::PrebuildLightCollection);
+                pBuilder->mpScene = Scene::create(std::move(sceneData));
                 return pBuilder;
             }
             catch (const std::exception& e)
@@ -215,11 +340,21 @@ namespace Falcor
 
     bool SceneBuilder::import(const std::string& filename, const InstanceMatrices& instances, const Dictionary& dict)
     {
+        addDependency(filename);
         bool success = Importer::import(filename, *this, instances, dict);
         mSceneData.filename = filename;
         return success;
     }
 
+    void SceneBuilder::addDependency(const std::string& filename)
+    {
+        std::string fullPath;
+        if (findFileInDataDirectories(filename, fullPath))
+        {
+            mSceneCacheDependencies.push_back({ fullPath, SceneCache::SectionFlags::All });
+        }
+    }
+
 
     Scene::SharedPtr SceneBuilder::getScene(bool monochromeMode)
     {
@@ -241,6 +376,13 @@ namespace Falcor
             auto nodeID = addNode(dummyNode);
             addMeshInstance(nodeID, meshID);
         }
+        if (mVertexCacheStats.triangleCount > 0)
+        {
+            const auto& stats = mVertexCacheStats;
+            logInfo("Optimized vertex cache for " + std::to_string(stats.meshCount) + " meshes, average ACMR " +
+                std::to_string(stats.missesBefore / stats.triangleCount) + " before and " + std::to_string(stats.missesAfter / stats.triangleCount) + " after optimization");
+        }
+
         // Post-process the scene data.
         TimeReport timeReport;
 
@@ -286,11 +428,32 @@ namespace Falcor
         // Write scene cache if requested.
         if (mWriteSceneCache)
         {
-            SceneCache::writeCache(mSceneData, mSceneCacheKey);
+            if (mSceneData.pEnvMap)
+            {
+                const auto& filename = mSceneData.pEnvMap->getEnvMap()->getSourceFilename();
+                if (!filename.empty()) mSceneCacheDependencies.push_back({ filename, SceneCache::SectionFlags::Scene });
+            }
+            for (const auto& pGrid : mSceneData.grids)
+            {
+                if (!pGrid->getSourceFilename().empty()) mSceneCacheDependencies.push_back({ pGrid->getSourceFilename(), SceneCache::SectionFlags::Grids });
+            }
+            for (const auto& pGridVolume : mSceneData.gridVolumes)
+            {
+                for (const auto& pSequence : pGridVolume->getAllStreamingGridSequences())
+                {
+                    for (uint32_t frame = 0; frame < pSequence->getFrameCount(); ++frame)
+                    {
+                        const auto& filename = pSequence->getSourceFilename(frame);
+                        if (!filename.empty()) mSceneCacheDependencies.push_back({ filename, SceneCache::SectionFlags::Grids });
+                    }
+                }
+            }
+            SceneCache::writeCache(mSceneData, mSceneCacheKey, mSceneCacheDependencies);
             timeReport.measure("Writing cache");
         }
 
         // Create the scene object.
+        mSceneData.prebuildLightCollection = is_set(mFlags, Flags::PrebuildLightCollection);
         mpScene = Scene::create(std::move(mSceneData), monochromeMode);
         mSceneData = {};
 
@@ -422,17 +585,17 @@ namespace Falcor
         // Build new vertex/index buffers by merging identical vertices.
         // The search is based on the topology defined by the original index buffer.
         //
-        // A linked-list of vertices is built for each original vertex index.
-        // We iterate over all vertices and first check if a vertex is identical to any of the other vertices
-        // using the same original vertex index. If not, a new vertex is inserted and added to the list.
-        // The 'heads' array point to the first vertex in each list, and each vertex has an associated next-pointer.
-        // This ensures that adding to the linked lists do not require any dynamic memory allocation.
+        // Only vertices using the same original vertex index are merged. Vertices are looked up in a hash map
+        // keyed on the original index and the vertex attributes, and candidates with matching hash are checked
+        // with compareVertices(). This keeps the cost linear even if an original vertex index is referenced
+        // by many distinct vertices (e.g. per-face normals around a vertex with a large fan).
         //
-        const uint32_t invalidIndex = 0xffffffff;
-        std::vector<std::pair<Mesh::Vertex, uint32_t>> vertices;
+        std::vector<Mesh::Vertex> vertices;
         vertices.reserve(mesh.vertexCount);
         std::vector<uint32_t> indices(mesh.indexCount);
-        std::vector<uint32_t> heads(mesh.vertexCount, invalidIndex);
+        std::vector<uint32_t> origIndices; // Original vertex index of each new vertex.
+        origIndices.reserve(mesh.vertexCount);
+        VertexHashMap vertexMap(mesh.vertexCount);
 
         if (pAttributeIndices)
         {
@@ -446,35 +609,28 @@ namespace Falcor
                 const Mesh::Vertex v = mesh.getVertex(face, vert);
                 const uint32_t origIndex = mesh.pIndices[face * 3 + vert];
 
-                // Iterate over vertex list to check if it already exists.
-                assert(origIndex < heads.size());
-                uint32_t index = heads[origIndex];
-                bool found = false;
-
-                while (index != invalidIndex)
+                // Check if the vertex already exists.
+                assert(origIndex < mesh.vertexCount);
+                const uint32_t hash = hashVertex(v, origIndex);
+                uint32_t index = vertexMap.find(hash, [&](uint32_t i)
                 {
-                    if (compareVertices(v, vertices[index].first))
-                    {
-                        found = true;
-                        break;
-                    }
-                    index = vertices[index].second;
-                }
+                    return origIndices[i] == origIndex && compareVertices(v, vertices[i]);
+                });
 
                 // Insert new vertex if we couldn't find it.
-                if (!found)
+                if (index == VertexHashMap::kInvalidIndex)
                 {
                     assert(vertices.size() < std::numeric_limits<uint32_t>::max());
                     index = (uint32_t)vertices.size();
-                    vertices.push_back({ v, heads[origIndex] });
+                    vertices.push_back(v);
+                    origIndices.push_back(origIndex);
+                    vertexMap.insert(hash, index);
 
                     if (pAttributeIndices)
                     {
                         pAttributeIndices->push_back(mesh.getAttributeIndices(face, vert));
                         assert(vertices.size() == pAttributeIndices->size());
                     }
-
-                    heads[origIndex] = index;
                 }
 
                 // Store new vertex index.
@@ -494,11 +650,43 @@ namespace Falcor
         size_t zeroCount = 0;
         for (const auto& v : vertices)
         {
-            validateVertex(v.first, invalidCount, zeroCount);
+            validateVertex(v, invalidCount, zeroCount);
         }
         if (invalidCount > 0) logWarning("The mesh '" + mesh.name + "' has inf/nan vertex attributes at " + std::to_string(invalidCount) + " vertices. Please fix the asset.");
         if (zeroCount > 0) logWarning("The mesh '" + mesh.name + "' has zero-length normals/tangents at " + std::to_string(zeroCount) + " vertices. Please fix the asset.");
 
+        // Reorder triangles for vertex cache efficiency and vertices for vertex fetch locality.
+        // Triangles are optionally sorted spatially first, which the vertex cache optimization uses as its initial order.
+        if (!is_set(mFlags, Flags::DontOptimizeVertexCache))
+        {
+            const uint32_t uniqueVertexCount = (uint32_t)vertices.size();
+            processedMesh.acmrBefore = MeshOptimizer::computeACMR(indices, uniqueVertexCount);
+
+            if (is_set(mFlags, Flags::UseSpatialTriangleOrder))
+            {
+                std::vector<float3> positions(vertices.size());
+                for (size_t i = 0; i < vertices.size(); i++) positions[i] = vertices[i].position;
+                MeshOptimizer::sortTrianglesSpatially(indices, positions);
+            }
+            MeshOptimizer::optimizeVertexCache(indices, uniqueVertexCount);
+            processedMesh.acmrAfter = MeshOptimizer::computeACMR(indices, uniqueVertexCount);
+
+            // Reorder vertices (and the attribute indices they were created from) to match the new indices.
+            auto vertexOrder = MeshOptimizer::optimizeVertexFetch(indices, uniqueVertexCount);
+            std::vector<Mesh::Vertex> orderedVertices(vertices.size());
+            for (size_t i = 0; i < vertexOrder.size(); i++) orderedVertices[i] = vertices[vertexOrder[i]];
+            vertices = std::move(orderedVertices);
+
+            if (pAttributeIndices)
+            {
+                MeshAttributeIndices orderedAttributeIndices(pAttributeIndices->size());
+                for (size_t i = 0; i < vertexOrder.size(); i++) orderedAttributeIndices[i] = (*pAttributeIndices)[vertexOrder[i]];
+                *pAttributeIndices = std::move(orderedAttributeIndices);
+            }
+
+            logDebug("Mesh with name '" + mesh.name + "' has vertex cache ACMR " + std::to_string(processedMesh.acmrBefore) + " before and " + std::to_string(processedMesh.acmrAfter) + " after optimization");
+        }
+
         // If the non-indexed vertices build flag is set, we will de-index the data below.
         const bool isIndexed = !is_set(mFlags, Flags::NonIndexedVertices);
         const uint32_t vertexCount = isIndexed ? (uint32_t)vertices.size() : mesh.indexCount;
@@ -521,7 +709,7 @@ namespace Falcor
         {
             uint32_t index = isIndexed ? i : indices[i];
             assert(index < vertices.size());
-            const Mesh::Vertex& v = vertices[index].first;
+            const Mesh::Vertex& v = vertices[index];
 
             StaticVertexData s;
             s.position = v.position;
@@ -578,6 +766,15 @@ namespace Falcor
         spec.staticVertexCount = (uint32_t)mesh.staticData.size();
         spec.dynamicVertexCount = (uint32_t)mesh.dynamicData.size();
 
+        if (mesh.acmrAfter > 0.f)
+        {
+            const uint64_t triangleCount = mesh.indexCount / 3;
+            mVertexCacheStats.meshCount++;
+            mVertexCacheStats.triangleCount += triangleCount;
+            mVertexCacheStats.missesBefore += mesh.acmrBefore * triangleCount;
+            mVertexCacheStats.missesAfter += mesh.acmrAfter * triangleCount;
+        }
+
         spec.indexData = std::move(mesh.indexData);
         spec.staticData = std::move(mesh.staticData);
         spec.dynamicData = std::move(mesh.dynamicData);
@@ -731,14 +928,17 @@ namespace Falcor
         assert(pMaterial);
 
         // Reuse previously added materials
-        if (auto it = std::find(mSceneData.materials.begin(), mSceneData.materials.end(), pMaterial); it != mSceneData.materials.end())
+        if (auto it = mMaterialIDs.find(pMaterial.get()); it != mMaterialIDs.end())
         {
-            return (uint32_t)std::distance(mSceneData.materials.begin(), it);
+            assert(mSceneData.materials[it->second] == pMaterial);
+            return it->second;
         }
 
         mSceneData.materials.push_back(pMaterial);
         assert(mSceneData.materials.size() <= std::numeric_limits<uint32_t>::max());
-        return (uint32_t)mSceneData.materials.size() - 1;
+        uint32_t materialID = (uint32_t)mSceneData.materials.size() - 1;
+        mMaterialIDs[pMaterial.get()] = materialID;
+        return materialID;
     }
 
     Material::SharedPtr SceneBuilder::getMaterial(const std::string& name) const
@@ -752,8 +952,12 @@ namespace Falcor
 
     void SceneBuilder::loadMaterialTexture(const Material::SharedPtr& pMaterial, Material::TextureSlot slot, const std::string& filename)
     {
-        if (!mpMaterialTextureLoader) mpMaterialTextureLoader.reset(new MaterialTextureLoader(!is_set(mFlags, Flags::AssumeLinearSpaceTextures)));
+        if (!mpMaterialTextureLoader) mpMaterialTextureLoader.reset(new MaterialTextureLoader(!is_set(mFlags, Flags::AssumeLinearSpaceTextures), is_set(mFlags, Flags::CompressTextures)));
         mpMaterialTextureLoader->loadTexture(pMaterial, slot, filename);
+
+        // Textures are loaded from file when reading the scene cache, modifying them only refreshes the material section.
+        std::string fullPath;
+        if (findFileInDataDirectories(filename, fullPath)) mSceneCacheDependencies.push_back({ fullPath, SceneCache::SectionFlags::Materials });
     }
 
     void SceneBuilder::waitForMaterialTextureLoading()
@@ -1460,15 +1664,19 @@ namespace Falcor
                 glm::mat3 invTranspose3x3 = (glm::mat3)glm::transpose(glm::inverse(transform));
                 glm::mat3 transform3x3 = (glm::mat3)transform;
 
-                for (auto& v : mesh.staticData)
+                Threading::parallelForChunks(0, mesh.staticData.size(), [&](size_t begin, size_t end)
                 {
-                    float4 p = transform * float4(v.position, 1.f);
-                    v.position = p.xyz;
-                    v.normal = glm::normalize(invTranspose3x3 * v.normal);
-                    v.tangent.xyz = glm::normalize(transform3x3 * v.tangent.xyz);
-                    // TODO: We should flip the sign of v.tangent.w if flippedWinding is true.
-                    // Leaving that out for now for consistency with the shader code that needs the same fix.
-                }
+                    for (size_t i = begin; i < end; i++)
+                    {
+                        auto& v = mesh.staticData[i];
+                        float4 p = transform * float4(v.position, 1.f);
+                        v.position = p.xyz;
+                        v.normal = glm::normalize(invTranspose3x3 * v.normal);
+                        v.tangent.xyz = glm::normalize(transform3x3 * v.tangent.xyz);
+                        // TODO: We should flip the sign of v.tangent.w if flippedWinding is true.
+                        // Leaving that out for now for consistency with the shader code that needs the same fix.
+                    }
+                }, kParallelVertexGrainSize);
 
                 transformedMeshCount++;
             }
@@ -1573,8 +1781,9 @@ namespace Falcor
 
     void SceneBuilder::calculateMeshBoundingBoxes()
     {
-        for (auto& mesh : mMeshes)
+        Threading::parallelFor(0, mMeshes.size(), [this](size_t meshID)
         {
+            auto& mesh = mMeshes[meshID];
             assert(!mesh.staticData.empty());
             assert((size_t)mesh.vertexCount == mesh.staticData.size());
 
@@ -1585,7 +1794,7 @@ namespace Falcor
             }
 
             mesh.boundingBox = meshBB;
-        }
+        }, 1);
     }
 
     void SceneBuilder::createMeshGroups()
@@ -1780,6 +1989,7 @@ namespace Falcor
             spec.materialId = mesh.materialId;
             spec.isStatic = mesh.isStatic;
             spec.isFrontFaceCW = mesh.isFrontFaceCW;
+            spec.isDisplaced = mesh.isDisplaced;
             spec.instances = mesh.instances;
             assert(mesh.hasDynamicData == false);
             assert(mesh.dynamicVertexCount == 0);
@@ -1882,7 +2092,71 @@ namespace Falcor
     void SceneBuilder::splitNonIndexedMesh(const MeshSpec& mesh, MeshSpec& leftMesh, MeshSpec& rightMesh, const int axis, const float pos)
     {
         assert(mesh.indexCount == 0 && mesh.indexData.empty());
-        throw std::exception("SceneBuilder::splitNonIndexedMesh() not implemented");
+        assert(mesh.staticData.size() == mesh.vertexCount);
+
+        // Iterate over the triangles. Each triangle has its own three vertices.
+        const size_t triangleCount = mesh.getTriangleCount();
+        for (size_t i = 0; i < triangleCount * 3; i += 3)
+        {
+            // Compute the centroid and add the triangle to the left or right side.
+            float centroid = 0.f;
+            for (size_t j = 0; j < 3; j++)
+            {
+                centroid += mesh.staticData[i + j].position[axis];
+            }
+            centroid /= 3.f;
+
+            auto& dstMesh = centroid < pos ? leftMesh : rightMesh;
+            dstMesh.staticData.insert(dstMesh.staticData.end(), mesh.staticData.begin() + i, mesh.staticData.begin() + i + 3);
+        }
+
+        auto finalizeMesh = [](MeshSpec& m)
+        {
+            m.indexCount = 0;
+            m.vertexCount = (uint32_t)m.staticData.size();
+            m.staticVertexCount = m.vertexCount;
+
+            m.boundingBox = AABB();
+            for (auto& v : m.staticData) m.boundingBox.include(v.position);
+        };
+
+        finalizeMesh(leftMesh);
+        finalizeMesh(rightMesh);
+    }
+
+    bool SceneBuilder::isSplittable(uint32_t meshID) const
+    {
+        const auto& mesh = mMeshes[meshID];
+        if (mesh.isDynamic() || mesh.topology != Vao::Topology::TriangleList) return false;
+
+        // Meshes animated by vertex caches reference the original vertices.
+        for (const auto& cachedMesh : mSceneData.cachedMeshes)
+        {
+            if (cachedMesh.meshID == meshID) return false;
+        }
+        return true;
+    }
+
+    float SceneBuilder::computeMedianCentroid(const MeshSpec& mesh, const int axis) const
+    {
+        const size_t triangleCount = mesh.getTriangleCount();
+        assert(triangleCount > 0);
+
+        std::vector<float> centroids(triangleCount);
+        for (size_t i = 0; i < triangleCount; i++)
+        {
+            float centroid = 0.f;
+            for (size_t j = 0; j < 3; j++)
+            {
+                uint32_t index = mesh.indexCount > 0 ? mesh.getIndex(i * 3 + j) : (uint32_t)(i * 3 + j);
+                centroid += mesh.staticData[index].position[axis];
+            }
+            centroids[i] = centroid / 3.f;
+        }
+
+        auto median = centroids.begin() + triangleCount / 2;
+        std::nth_element(centroids.begin(), median, centroids.end());
+        return *median;
     }
 
     size_t SceneBuilder::countTriangles(const MeshGroup& meshGroup) const
@@ -1910,22 +2184,23 @@ namespace Falcor
         assert(!meshGroup.meshList.empty());
         triangleCount = countTriangles(meshGroup);
 
-        if (triangleCount <= kMaxTrianglesPerBLAS)
+        if (triangleCount <= mMaxTrianglesPerBLAS)
         {
             return false;
         }
         else if (meshGroup.meshList.size() == 1)
         {
-            // Issue warning if single mesh exceeds the triangle count limit.
-            // TODO: Implement mesh splitting to handle this case.
-            const auto& mesh = mMeshes[meshGroup.meshList[0]];
+            // A single mesh exceeding the triangle count limit is split if possible. Otherwise issue a warning.
+            const uint32_t meshID = meshGroup.meshList[0];
+            const auto& mesh = mMeshes[meshID];
             assert(mesh.getTriangleCount() == triangleCount);
-            logWarning("Mesh '" + mesh.name + "' has " + std::to_string(triangleCount) + " triangles, expect extraneous GPU memory usage.");
+            if (isSplittable(meshID)) return true;
 
+            logWarning("Mesh '" + mesh.name + "' has " + std::to_string(triangleCount) + " triangles and cannot be split, expect extraneous GPU memory usage.");
             return false;
         }
         assert(meshGroup.meshList.size() > 1);
-        assert(triangleCount > kMaxTrianglesPerBLAS);
+        assert(triangleCount > mMaxTrianglesPerBLAS);
 
         return true;
     }
@@ -1938,11 +2213,11 @@ namespace Falcor
 
         // Early out if splitting is not needed or possible.
         size_t triangleCount = 0;
-        if (!needsSplit(meshGroup, triangleCount)) return MeshGroupList{ std::move(meshGroup) };
+        if (!needsSplit(meshGroup, triangleCount) || meshGroup.meshList.size() == 1) return MeshGroupList{ std::move(meshGroup) };
 
         // Each new group holds at least one mesh, or if multiple, up to the target number of triangles.
         assert(triangleCount > 0);
-        size_t targetGroupCount = div_round_up(triangleCount, kMaxTrianglesPerBLAS);
+        size_t targetGroupCount = div_round_up(triangleCount, mMaxTrianglesPerBLAS);
         size_t targetTrianglesPerGroup = triangleCount / targetGroupCount;
 
         triangleCount = 0;
@@ -1975,7 +2250,7 @@ namespace Falcor
 
         // Early out if splitting is not needed or possible.
         size_t triangleCount = 0;
-        if (!needsSplit(meshGroup, triangleCount)) return MeshGroupList{ std::move(meshGroup) };
+        if (!needsSplit(meshGroup, triangleCount) || meshGroup.meshList.size() == 1) return MeshGroupList{ std::move(meshGroup) };
 
         // Sort the meshes by centroid along the largest axis.
         AABB bb = calculateBoundingBox(meshGroup);
@@ -2028,6 +2303,8 @@ namespace Falcor
         // This function recursively splits a mesh group at the midpoint along the largest axis.
         // Individual meshes that straddle the splitting plane are split into two halves.
         // This will ensure minimal spatial overlaps between groups.
+        // Groups consisting of a single oversized mesh are split at the median triangle centroid instead,
+        // which guarantees progress also for meshes with very uneven triangle distributions.
 
         // Early out if splitting is not needed or possible.
         size_t triangleCount = 0;
@@ -2036,7 +2313,7 @@ namespace Falcor
         // Find the midpoint along the largest axis.
         AABB bb = calculateBoundingBox(meshGroup);
         const int axis = largestAxis(bb.extent());
-        const float pos = bb.center()[axis];
+        const float pos = meshGroup.meshList.size() == 1 ? computeMedianCentroid(mMeshes[meshGroup.meshList[0]], axis) : bb.center()[axis];
 
         // Partition all meshes by the splitting plane.
         std::vector<uint32_t> leftMeshes, rightMeshes;
@@ -2049,7 +2326,11 @@ namespace Falcor
         }
 
         // If either side contains all meshes, do not split further.
-        if (leftMeshes.empty() || rightMeshes.empty()) return MeshGroupList{ std::move(meshGroup) };
+        if (leftMeshes.empty() || rightMeshes.empty())
+        {
+            if (meshGroup.meshList.size() == 1) logWarning("Mesh '" + mMeshes[meshGroup.meshList[0]].name + "' has " + std::to_string(triangleCount) + " triangles and cannot be split further, expect extraneous GPU memory usage.");
+            return MeshGroupList{ std::move(meshGroup) };
+        }
 
         // Recursively split the left and right mesh groups.
         MeshGroup leftGroup{ std::move(leftMeshes), meshGroup.isStatic };
@@ -2067,6 +2348,203 @@ namespace Falcor
         return leftList;
     }
 
+    SceneBuilder::MeshGroupList SceneBuilder::splitMeshGroupSAH(MeshGroup& meshGroup) const
+    {
+        // This function implements a recursive top-down BVH builder to partition a mesh group
+        // using a binned surface area heuristic (SAH) evaluated on the mesh bounding boxes.
+        //
+        // The cost of a split estimates the cost per ray of traversing the two resulting groups.
+        // A ray enters each side with a probability proportional to its surface area. Entering a side costs
+        // the TLAS instance overhead for each BLAS it will be split into (given the triangle budget), plus the
+        // traversal of a BLAS with that number of triangles. Overlap between the sides is penalized explicitly,
+        // as rays in the overlapping region need to traverse both BLASes.
+        //
+        // Individual meshes are not split. Groups that cannot be split further are returned as is.
+
+        // Early out if splitting is not needed or possible.
+        size_t triangleCount = 0;
+        if (!needsSplit(meshGroup, triangleCount) || meshGroup.meshList.size() == 1) return MeshGroupList{ std::move(meshGroup) };
+
+        const AABB bb = calculateBoundingBox(meshGroup);
+        const float area = bb.area();
+
+        AABB centroidBB;
+        for (auto meshID : meshGroup.meshList) centroidBB.include(mMeshes[meshID].boundingBox.center());
+
+        auto evalCost = [&](const AABB& leftBB, size_t leftTriangles, const AABB& rightBB, size_t rightTriangles)
+        {
+            auto evalSide = [&](const AABB& sideBB, size_t sideTriangles)
+            {
+                float p = area > 0.f ? sideBB.area() / area : 1.f;
+                float blasCount = (float)div_round_up(sideTriangles, mMaxTrianglesPerBLAS);
+                return p * (kSAHInstanceCost * blasCount + std::log2((float)sideTriangles / blasCount + 1.f));
+            };
+
+            AABB overlapBB = leftBB & rightBB;
+            float overlap = overlapBB.valid() && area > 0.f ? overlapBB.area() / area : 0.f;
+            return evalSide(leftBB, leftTriangles) + evalSide(rightBB, rightTriangles) + kSAHOverlapCost * overlap;
+        };
+
+        struct Bin
+        {
+            AABB bb;
+            size_t triangleCount = 0;
+            size_t meshCount = 0;
+        };
+
+        auto getBinIndex = [&](uint32_t meshID, int axis)
+        {
+            float extent = centroidBB.extent()[axis];
+            float t = (mMeshes[meshID].boundingBox.center()[axis] - centroidBB.minPoint[axis]) / extent;
+            return std::min((uint32_t)(t * kSAHBinCount), kSAHBinCount - 1);
+        };
+
+        // Find the best split over all axes and bin boundaries.
+        float bestCost = std::numeric_limits<float>::infinity();
+        int bestAxis = -1;
+        uint32_t bestSplit = 0;
+
+        for (int axis = 0; axis < 3; axis++)
+        {
+            if (!(centroidBB.extent()[axis] > 0.f)) continue;
+
+            std::array<Bin, kSAHBinCount> bins;
+            for (auto meshID : meshGroup.meshList)
+            {
+                auto& bin = bins[getBinIndex(meshID, axis)];
+                bin.bb.include(mMeshes[meshID].boundingBox);
+                bin.triangleCount += mMeshes[meshID].getTriangleCount();
+                bin.meshCount++;
+            }
+
+            // Sweep from the right to accumulate the right side of each split.
+            std::array<Bin, kSAHBinCount> rightBins;
+            Bin right;
+            for (uint32_t i = kSAHBinCount - 1; i > 0; i--)
+            {
+                right.bb.include(bins[i].bb);
+                right.triangleCount += bins[i].triangleCount;
+                right.meshCount += bins[i].meshCount;
+                rightBins[i] = right;
+            }
+
+            // Sweep from the left and evaluate the split in front of each bin.
+            Bin left;
+            for (uint32_t i = 1; i < kSAHBinCount; i++)
+            {
+                left.bb.include(bins[i - 1].bb);
+                left.triangleCount += bins[i - 1].triangleCount;
+                left.meshCount += bins[i - 1].meshCount;
+                if (left.meshCount == 0 || rightBins[i].meshCount == 0) continue;
+
+                float cost = evalCost(left.bb, left.triangleCount, rightBins[i].bb, rightBins[i].triangleCount);
+                if (cost < bestCost)
+                {
+                    bestCost = cost;
+                    bestAxis = axis;
+                    bestSplit = i;
+                }
+            }
+        }
+
+        // If all mesh centroids coincide, no split is possible.
+        if (bestAxis < 0) return MeshGroupList{ std::move(meshGroup) };
+
+        // Partition the meshes and recursively split the left and right mesh groups.
+        MeshGroup leftGroup{ {}, meshGroup.isStatic, meshGroup.isDisplaced };
+        MeshGroup rightGroup{ {}, meshGroup.isStatic, meshGroup.isDisplaced };
+        for (auto meshID : meshGroup.meshList)
+        {
+            if (getBinIndex(meshID, bestAxis) < bestSplit) leftGroup.meshList.push_back(meshID);
+            else rightGroup.meshList.push_back(meshID);
+        }
+        assert(!leftGroup.meshList.empty() && !rightGroup.meshList.empty());
+
+        MeshGroupList leftList = splitMeshGroupSAH(leftGroup);
+        MeshGroupList rightList = splitMeshGroupSAH(rightGroup);
+
+        // Move elements into a single list and return.
+        leftList.insert(
+            leftList.end(),
+            std::make_move_iterator(rightList.begin()),
+            std::make_move_iterator(rightList.end()));
+
+        return leftList;
+    }
+
+    SceneBuilder::MeshGroupStats SceneBuilder::computeMeshGroupStats(const MeshGroupList& meshGroups) const
+    {
+        auto getGlobalTransform = [this](uint32_t nodeID)
+        {
+            glm::mat4 transform = glm::identity<glm::mat4>();
+            while (nodeID != kInvalidNode)
+            {
+                assert(nodeID < mSceneGraph.size());
+                transform = mSceneGraph[nodeID].transform * transform;
+                nodeID = mSceneGraph[nodeID].parent;
+            }
+            return transform;
+        };
+
+        MeshGroupStats stats;
+        stats.groupCount = meshGroups.size();
+
+        AABB sceneBB;
+        std::vector<AABB> instanceBBs;
+        for (const auto& meshGroup : meshGroups)
+        {
+            stats.maxTriangleCount = std::max(stats.maxTriangleCount, countTriangles(meshGroup));
+            const AABB bb = calculateBoundingBox(meshGroup);
+
+            // Static groups are pre-transformed to world space and have a single instance.
+            // Other groups are instanced by the nodes of their meshes, which are the same for all meshes in a group.
+            if (meshGroup.isStatic)
+            {
+                instanceBBs.push_back(bb);
+            }
+            else
+            {
+                for (auto nodeID : mMeshes[meshGroup.meshList[0]].instances) instanceBBs.push_back(bb.transform(getGlobalTransform(nodeID)));
+            }
+        }
+
+        for (const auto& bb : instanceBBs) sceneBB.include(bb);
+        stats.instanceCount = instanceBBs.size();
+
+        const float sceneArea = sceneBB.valid() ? sceneBB.area() : 0.f;
+        if (sceneArea > 0.f)
+        {
+            double overlap = 0.0;
+            for (const auto& bb : instanceBBs) overlap += bb.area() / sceneArea;
+            stats.overlapFactor = (float)overlap;
+        }
+
+        return stats;
+    }
+
+    void SceneBuilder::compareMeshGroupSplitters() const
+    {
+        auto evalSplitter = [&](const std::string& name, auto splitFunc)
+        {
+            MeshGroupList groups;
+            for (auto meshGroup : mMeshGroups)
+            {
+                auto splitGroups = splitFunc(meshGroup);
+                groups.insert(groups.end(), std::make_move_iterator(splitGroups.begin()), std::make_move_iterator(splitGroups.end()));
+            }
+            const MeshGroupStats stats = computeMeshGroupStats(groups);
+            logInfo(padStringToLength(name, 10) + std::to_string(stats.groupCount) + " groups, " + std::to_string(stats.instanceCount) + " instances, max "
+                + std::to_string(stats.maxTriangleCount) + " triangles per group, TLAS overlap factor " + std::to_string(stats.overlapFactor));
+        };
+
+        // The midpoint splitter splits individual meshes and is not evaluated.
+        logInfo("Mesh group partitioning with a limit of " + std::to_string(mMaxTrianglesPerBLAS) + " triangles per group:");
+        evalSplitter("  None:", [](MeshGroup& meshGroup) { return MeshGroupList{ meshGroup }; });
+        evalSplitter("  Simple:", [this](MeshGroup& meshGroup) { return splitMeshGroupSimple(meshGroup); });
+        evalSplitter("  Median:", [this](MeshGroup& meshGroup) { return splitMeshGroupMedian(meshGroup); });
+        evalSplitter("  SAH:", [this](MeshGroup& meshGroup) { return splitMeshGroupSAH(meshGroup); });
+    }
+
     void SceneBuilder::optimizeGeometry()
     {
         // This function optimizes the geometry for raytracing performance and memory usage.
@@ -2079,14 +2557,23 @@ namespace Falcor
         //  - Split large mesh groups (BLASes) into multiple smaller ones.
         //  - Split large meshes into smaller to reduce spatial overlap between BLASes.
         //  - Sort meshes into BLASes based on spatial locality.
+        //
+        // Mesh groups are partitioned with a binned SAH over the mesh bounding boxes. Groups that still exceed
+        // the limit (single oversized meshes, or meshes with coincident centroids) are split by the midpoint splitter,
+        // which splits individual meshes.
+
+        if (is_set(mFlags, Flags::CompareMeshGroupSplitters)) compareMeshGroupSplitters();
 
         MeshGroupList optimizedGroups;
 
         for (auto& meshGroup : mMeshGroups)
         {
-            //auto groups = splitMeshGroupSimple(meshGroup);
-            //auto groups = splitMeshGroupMedian(meshGroup);
-            auto groups = splitMeshGroupMidpointMeshes(meshGroup);
+            MeshGroupList groups;
+            for (auto& group : splitMeshGroupSAH(meshGroup))
+            {
+                auto splitGroups = splitMeshGroupMidpointMeshes(group);
+                groups.insert(groups.end(), std::make_move_iterator(splitGroups.begin()), std::make_move_iterator(splitGroups.end()));
+            }
 
             if (groups.size() > 1) logWarning("SceneBuilder::optimizeGeometry() performance warning - Mesh group was split into " + std::to_string(groups.size()) + " groups");
 
@@ -2096,6 +2583,13 @@ namespace Falcor
                 std::make_move_iterator(groups.end()));
         }
 
+        if (optimizedGroups.size() > mMeshGroups.size())
+        {
+            const MeshGroupStats stats = computeMeshGroupStats(optimizedGroups);
+            logInfo("Mesh group partitioning: " + std::to_string(stats.groupCount) + " groups, " + std::to_string(stats.instanceCount) + " instances, max "
+                + std::to_string(stats.maxTriangleCount) + " triangles per group, TLAS overlap factor " + std::to_string(stats.overlapFactor));
+        }
+
         mMeshGroups = std::move(optimizedGroups);
     }
 
@@ -2322,19 +2816,25 @@ namespace Falcor
         std::vector<uint32_t> idMap(mSceneData.materials.size());
 
         // Find unique set of materials.
+        // Materials are bucketed by hash, so that each material is only compared against the unique materials with the same hash.
+        // The buckets store indices into uniqueMaterials in insertion order, so the result is identical to a linear search.
+        std::unordered_map<uint64_t, std::vector<uint32_t>> buckets;
+        buckets.reserve(mSceneData.materials.size());
         for (uint32_t id = 0; id < mSceneData.materials.size(); ++id)
         {
             const auto& pMaterial = mSceneData.materials[id];
-            auto it = std::find_if(uniqueMaterials.begin(), uniqueMaterials.end(), [&pMaterial](const auto& m) { return m->isEqual(pMaterial); });
-            if (it == uniqueMaterials.end())
+            auto& bucket = buckets[pMaterial->computeHash()];
+            auto it = std::find_if(bucket.begin(), bucket.end(), [&](uint32_t uniqueID) { return uniqueMaterials[uniqueID]->isEqual(pMaterial); });
+            if (it == bucket.end())
             {
                 idMap[id] = (uint32_t)uniqueMaterials.size();
+                bucket.push_back(idMap[id]);
                 uniqueMaterials.push_back(pMaterial);
             }
             else
             {
-                logInfo("Removing duplicate material '" + pMaterial->getName() + "' (duplicate of '" + (*it)->getName() + "')");
-                idMap[id] = (uint32_t)std::distance(uniqueMaterials.begin(), it);
+                logInfo("Removing duplicate material '" + pMaterial->getName() + "' (duplicate of '" + uniqueMaterials[*it]->getName() + "')");
+                idMap[id] = *it;
             }
         }
 
@@ -2344,12 +2844,20 @@ namespace Falcor
             mesh.materialId = idMap[mesh.materialId];
         }
 
+        for (auto& curve : mCurves)
+        {
+            curve.materialId = idMap[curve.materialId];
+        }
+
         for (auto& sdfGridInstance : mSceneData.sdfGridInstances)
         {
             sdfGridInstance.materialID = idMap[sdfGridInstance.materialID];
         }
 
         mSceneData.materials = uniqueMaterials;
+
+        mMaterialIDs.clear();
+        for (uint32_t id = 0; id < mSceneData.materials.size(); ++id) mMaterialIDs[mSceneData.materials[id].get()] = id;
     }
 
     void SceneBuilder::collectVolumeGrids()
@@ -2721,6 +3229,11 @@ namespace Falcor
         flags.value("DontOptimizeGraph", SceneBuilder::Flags::DontOptimizeGraph);
         flags.value("DontOptimizeMaterials", SceneBuilder::Flags::DontOptimizeMaterials);
         flags.value("DontUseDisplacement", SceneBuilder::Flags::DontUseDisplacement);
+        flags.value("DontOptimizeVertexCache", SceneBuilder::Flags::DontOptimizeVertexCache);
+        flags.value("UseSpatialTriangleOrder", SceneBuilder::Flags::UseSpatialTriangleOrder);
+        flags.value("CompressTextures", SceneBuilder::Flags::CompressTextures);
+        flags.value("CompareMeshGroupSplitters", SceneBuilder::Flags::CompareMeshGroupSplitters);
+        flags.value("PrebuildLightCollection", SceneBuilder::Flags::PrebuildLightCollection);
         flags.value("UseCache", SceneBuilder::Flags::UseCache);
         flags.value("RebuildCache", SceneBuilder::Flags::RebuildCache);
         ScriptBindings::addEnumBinaryOperators(flags);
@@ -2745,6 +3258,7 @@ namespace Falcor
             }
             return pSceneBuilder->import(filename, instanceMatrices, Dictionary(dict));
         }, "filename"_a, "dict"_a = pybind11::dict(), "instances"_a = std::vector<Transform>());
+        sceneBuilder.def("addDependency", [] (SceneBuilder* pSceneBuilder, const std::string& filename) { pSceneBuilder->addDependency(filename); }, "filename"_a);
         sceneBuilder.def("addTriangleMesh", &SceneBuilder::addTriangleMesh, "triangleMesh"_a, "material"_a);
         sceneBuilder.def("addSDFGrid", &SceneBuilder::addSDFGrid, "sdfGrid"_a, "material"_a);
         sceneBuilder.def("addMaterial", &SceneBuilder::addMaterial, "material"_a);
@@ -62,6 +62,11 @@ namespace Falcor
             DontOptimizeGraph           = 0x1000, ///< Don't optimize the scene graph to remove unnecessary nodes.
             DontOptimizeMaterials       = 0x2000, ///< Don't optimize materials by removing constant textures. The optimizations are lossless so should generally be enabled.
             DontUseDisplacement         = 0x4000, ///< Don't use displacement mapping.
+            DontOptimizeVertexCache     = 0x8000, ///< Don't reorder triangles and vertices within meshes for vertex cache efficiency and memory locality.
+            UseSpatialTriangleOrder     = 0x10000, ///< Order triangles within meshes along a Morton curve before optimizing for the vertex cache. This improves spatial locality for BLAS builds and ray traversal. Ignored if DontOptimizeVertexCache is set.
+            CompressTextures            = 0x20000, ///< Transcode material textures to block-compressed formats with full mip-chains. Transcoded textures are cached on disk.
+            CompareMeshGroupSplitters   = 0x40000, ///< Partition the mesh groups with the simple, median and SAH splitters and log the TLAS overlap factor of each. Used for offline evaluation, increases load time.
+            PrebuildLightCollection     = 0x80000, ///< Build the emissive triangles of the light collection on the CPU while the scene is created, instead of on the GPU when the light collection is first used.
 
             UseCache                    = 0x10000000, ///< Enable scene caching. This caches the runtime scene representation on disk to reduce load time.
             RebuildCache                = 0x20000000, ///< Rebuild scene cache.
@@ -253,6 +258,8 @@ namespace Falcor
             std::vector<uint32_t> indexData;    ///< Vertex indices in either 32-bit or 16-bit format packed tightly, or empty if non-indexed.
             std::vector<StaticVertexData> staticData;
             std::vector<DynamicVertexData> dynamicData;
+            float acmrBefore = 0.f;             ///< Average vertex cache miss ratio before optimizing the vertex cache, or zero if not optimized.
+            float acmrAfter = 0.f;              ///< Average vertex cache miss ratio after optimizing the vertex cache, or zero if not optimized.
         };
 
         using MeshAttributeIndices = std::vector<Mesh::VertexAttributeIndices>;
@@ -323,6 +330,14 @@ namespace Falcor
         */
         bool import(const std::string& filename, const InstanceMatrices& instances = InstanceMatrices(), const Dictionary& dict = Dictionary());
 
+        /** Add a file the scene depends on. The content of the file is hashed into the scene cache,
+            modifying the file invalidates the cache and the scene is re-imported.
+            Imported scene files, material textures, the environment map and grid files are added automatically.
+            Modified textures, environment maps and grid files are reloaded without re-importing the scene.
+            \param filename The filename. Can also include a full path or relative path from a data directory.
+        */
+        void addDependency(const std::string& filename);
+
         /** Get the scene. Make sure to add all the objects before calling this function
             \return nullptr if something went wrong, otherwise a new Scene object
         */
@@ -694,16 +709,27 @@ namespace Falcor
         Scene::SceneData mSceneData;
         Scene::SharedPtr mpScene;
         SceneCache::Key mSceneCacheKey;
+        SceneCache::DependencyList mSceneCacheDependencies; ///< Files the scene is imported from.
         bool mWriteSceneCache = false;  ///< True if scene cache should be written after import.
 
         SceneGraph mSceneGraph;
         const Flags mFlags;
+        size_t mMaxTrianglesPerBLAS;    ///< Target max number of triangles per mesh group (BLAS). Groups exceeding it are split in optimizeGeometry().
+
+        struct
+        {
+            uint32_t meshCount = 0;         ///< Number of meshes with optimized vertex cache.
+            uint64_t triangleCount = 0;     ///< Number of triangles in these meshes.
+            double missesBefore = 0.0;      ///< Number of simulated vertex cache misses before optimization.
+            double missesAfter = 0.0;       ///< Number of simulated vertex cache misses after optimization.
+        } mVertexCacheStats;
 
         MeshList mMeshes;
         MeshGroupList mMeshGroups; ///< Groups of meshes. Each group represents all the geometries in a BLAS for ray tracing.
 
         CurveList mCurves;
 
+        std::unordered_map<const Material*, uint32_t> mMaterialIDs; ///< Map from added materials to their IDs in mSceneData.materials.
         std::unique_ptr<MaterialTextureLoader> mpMaterialTextureLoader;
         GpuFence::SharedPtr mpFence;
 
@@ -723,6 +749,14 @@ namespace Falcor
         void splitIndexedMesh(const MeshSpec& mesh, MeshSpec& leftMesh, MeshSpec& rightMesh, const int axis, const float pos);
         void splitNonIndexedMesh(const MeshSpec& mesh, MeshSpec& leftMesh, MeshSpec& rightMesh, const int axis, const float pos);
 
+        /** Check if a mesh can be split by splitMesh().
+        */
+        bool isSplittable(uint32_t meshID) const;
+
+        /** Compute the median of the triangle centroids of a mesh along the given axis.
+        */
+        float computeMedianCentroid(const MeshSpec& mesh, const int axis) const;
+
         // Mesh group helpers
         size_t countTriangles(const MeshGroup& meshGroup) const;
         AABB calculateBoundingBox(const MeshGroup& meshGroup) const;
@@ -730,6 +764,28 @@ namespace Falcor
         MeshGroupList splitMeshGroupSimple(MeshGroup& meshGroup) const;
         MeshGroupList splitMeshGroupMedian(MeshGroup& meshGroup) const;
         MeshGroupList splitMeshGroupMidpointMeshes(MeshGroup& meshGroup);
+        MeshGroupList splitMeshGroupSAH(MeshGroup& meshGroup) const;
+
+        /** Statistics of a mesh group partitioning, see computeMeshGroupStats().
+        */
+        struct MeshGroupStats
+        {
+            size_t groupCount = 0;          ///< Number of mesh groups (BLASes).
+            size_t instanceCount = 0;       ///< Number of TLAS instances.
+            size_t maxTriangleCount = 0;    ///< Largest number of triangles in a mesh group.
+            float overlapFactor = 0.f;      ///< Sum of the surface areas of all TLAS instance bounds divided by the surface area of the scene bounds.
+        };
+
+        /** Compute statistics of a mesh group partitioning.
+            The overlap factor is the expected number of TLAS instances whose bounds are entered by a random ray
+            that enters the scene bounds. It is 1 for a single BLAS and grows with the overlap between instances.
+            Instances are evaluated with the initial transforms of their nodes.
+        */
+        MeshGroupStats computeMeshGroupStats(const MeshGroupList& meshGroups) const;
+
+        /** Partition the current mesh groups with each of the splitters that don't modify meshes and log the statistics.
+        */
+        void compareMeshGroupSplitters() const;
 
         // Post processing
         void prepareDisplacementMaps();
@@ -760,6 +816,7 @@ namespace Falcor
         void calculateCurveBoundingBoxes();
 
         friend class SceneCache;
+        friend struct SceneBuilderTestAccess; ///< Gives the unit tests access to the geometry optimization helpers.
     };
 
     enum_class_operators(SceneBuilder::Flags);
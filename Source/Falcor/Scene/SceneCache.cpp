@@ -28,8 +28,9 @@
 #include "stdafx.h"
 #include "SceneCache.h"
 #include "Material/MaterialTextureLoader.h"
+#include "Utils/CompressionUtils.h"
 
-#include <lz4_stream/lz4_stream.h>
+#include <mutex>
 
 namespace Falcor
 {
@@ -38,23 +39,127 @@ namespace Falcor
         /** Specfies the current cache file version.
             This needs to be incremented every time the file format changes!
         */
-        const uint32_t kVersion = 17;
+        const uint32_t kVersion = 21;
 
         /** Scene cache directory (subdirectory in the application data directory).
         */
         const std::string kDirectory = "NVIDIA/Falcor/SceneCache";
 
-        const size_t kBlockSize = 1 * 1024 * 1024;
+        /** Directory of the section files (subdirectory in the scene cache directory).
+        */
+        const std::string kSectionDirectory = "Sections";
+
+        /** Uncompressed size of the independently compressed frames in section files.
+        */
+        const size_t kFrameSize = 1 * 1024 * 1024;
+
+        /** Alignment of uncompressed chunks in section files.
+        */
+        const uint64_t kChunkAlignment = 64;
 
         const char* kMagic = "FalcorS$";
+        const char* kSectionMagic = "FalcorS#";
+
         struct Header
         {
             uint8_t magic[8]{};
             uint32_t version{};
+            uint32_t chunkCount{};          ///< Number of uncompressed chunks (section files only).
+            uint64_t chunkTableOffset{};    ///< Offset of the chunk table in bytes (section files only).
+            uint32_t frameCount{};          ///< Number of compressed frames (section files only).
+            uint32_t reserved{};
+            uint64_t frameTableOffset{};    ///< Offset of the frame table in bytes (section files only).
+
+            Header() = default;
+
+            Header(const char* pMagic)
+                : version(kVersion)
+            {
+                std::memcpy(magic, pMagic, sizeof(Header::magic));
+            }
+
+            bool isValid(const char* pMagic) const
+            {
+                return std::memcmp(magic, pMagic, sizeof(Header::magic)) == 0 && version == kVersion;
+            }
+        };
+
+        /** Size, modification time and content hash of a file.
+        */
+        struct FileInfo
+        {
+            uint64_t size = 0;
+            int64_t modifiedTime = 0;
+            SceneCache::Key hash{};
+        };
+
+        bool getFileInfo(const std::string& path, FileInfo& info)
+        {
+            std::error_code ec;
+            info.size = std::filesystem::file_size(path, ec);
+            if (ec) return false;
+            auto time = std::filesystem::last_write_time(path, ec);
+            if (ec) return false;
+            info.modifiedTime = (int64_t)time.time_since_epoch().count();
+            return true;
+        }
+
+        /** Compute the content hash of a file.
+            Hashes are memoized by path, size and modification time, so each file version is only hashed once per process.
+        */
+        bool hashFile(const std::string& path, FileInfo& info)
+        {
+            static std::mutex sMutex;
+            static std::unordered_map<std::string, FileInfo> sFileInfos;
+
+            if (!getFileInfo(path, info)) return false;
+
+            {
+                std::lock_guard<std::mutex> lock(sMutex);
+                auto it = sFileInfos.find(path);
+                if (it != sFileInfos.end() && it->second.size == info.size && it->second.modifiedTime == info.modifiedTime)
+                {
+                    info.hash = it->second.hash;
+                    return true;
+                }
+            }
+
+            if (!SHA1::computeFile(path, info.hash)) return false;
+
+            std::lock_guard<std::mutex> lock(sMutex);
+            sFileInfos[path] = info;
+            return true;
+        }
+
+        SceneCache::SectionFlags getSectionFlag(SceneCache::Section section)
+        {
+            return (SceneCache::SectionFlags)(1u << (uint32_t)section);
+        }
 
-            bool isValid() const
+        /** Sections that are refreshed in place when a dependency is modified.
+            The grid section is re-serialized from the reloaded grid files. The scene and material sections
+            only store the paths of the environment map and the material textures, which are loaded from file
+            when reading the cache, so their content stays valid and only the section keys change.
+        */
+        const SceneCache::SectionFlags kRefreshableSections = SceneCache::SectionFlags::Scene | SceneCache::SectionFlags::Materials | SceneCache::SectionFlags::Grids;
+
+        /** Location of an uncompressed chunk in a section file.
+        */
+        struct ChunkDesc
+        {
+            uint64_t offset = 0;
+            uint64_t size = 0;
+        };
+
+        /** Read-only stream buffer over a memory region.
+        */
+        class MemoryStreamBuffer : public std::streambuf
+        {
+        public:
+            MemoryStreamBuffer(const uint8_t* data, size_t size)
             {
-                return std::memcmp(magic, kMagic, sizeof(Header::magic)) == 0 && version == kVersion;
+                char* p = const_cast<char*>(reinterpret_cast<const char*>(data));
+                setg(p, p, p + size);
             }
         };
     }
@@ -108,8 +213,46 @@ namespace Falcor
             if (hasValue) write(opt.value());
         }
 
+        /** Write an array as uncompressed chunk.
+            Only the chunk index is written to the stream. The data is written after the stream and
+            needs to stay valid until the section is written.
+        */
+        template<typename T>
+        void writeChunk(const T* data, size_t count)
+        {
+            static_assert(std::is_trivially_copyable<T>::value);
+            write((uint32_t)mChunks.size());
+            mChunks.push_back({ data, count * sizeof(T) });
+        }
+
+        template<typename T>
+        void writeChunk(const std::vector<T>& vec)
+        {
+            writeChunk(vec.data(), vec.size());
+        }
+
+        /** Write a chunk whose data is produced while the section is written.
+            This avoids keeping the data of all chunks in memory at the same time.
+            \param[in] writeFunc Function writing the chunk data to the given stream.
+        */
+        void writeChunk(std::function<void(std::ostream&)> writeFunc)
+        {
+            write((uint32_t)mChunks.size());
+            mChunks.push_back({ nullptr, 0, std::move(writeFunc) });
+        }
+
+        struct Chunk
+        {
+            const void* data;
+            size_t size;
+            std::function<void(std::ostream&)> writeFunc;   ///< Function producing the data, if not given by data and size.
+        };
+
+        const std::vector<Chunk>& getChunks() const { return mChunks; }
+
     private:
         std::ostream& mStream;
+        std::vector<Chunk> mChunks;
     };
 
     /** Wrapper around std::istream to ease serialization of basic types.
@@ -119,6 +262,12 @@ namespace Falcor
     public:
         InputStream(std::istream& stream) : mStream(stream) {}
 
+        InputStream(std::istream& stream, const MemoryMappedFile::SharedPtr& pFile, std::vector<ChunkDesc> chunks)
+            : mStream(stream)
+            , mpFile(pFile)
+            , mChunks(std::move(chunks))
+        {}
+
         void read(void* data, size_t len)
         {
             mStream.read(reinterpret_cast<char*>(data), len);
@@ -168,11 +317,250 @@ namespace Falcor
             if (hasValue) opt = read<T>();
         }
 
+        /** Read an uncompressed chunk without copying.
+            The returned pointer references the memory-mapped section file, see getMappedFile().
+        */
+        template<typename T>
+        void readChunk(const T*& data, size_t& count)
+        {
+            static_assert(std::is_trivially_copyable<T>::value);
+            auto index = read<uint32_t>();
+            if (!mpFile || index >= mChunks.size()) throw std::runtime_error("Found invalid chunk in cache!");
+
+            const auto& chunk = mChunks[index];
+            if (chunk.offset + chunk.size > mpFile->getSize() || chunk.size % sizeof(T) != 0) throw std::runtime_error("Found invalid chunk in cache!");
+            data = reinterpret_cast<const T*>(mpFile->getData() + chunk.offset);
+            count = chunk.size / sizeof(T);
+        }
+
+        /** Read an uncompressed chunk into a vector.
+        */
+        template<typename T>
+        void readChunk(std::vector<T>& vec)
+        {
+            const T* data;
+            size_t count;
+            readChunk(data, count);
+            vec.assign(data, data + count);
+        }
+
+        const MemoryMappedFile::SharedPtr& getMappedFile() const { return mpFile; }
+
     private:
         std::istream& mStream;
+        MemoryMappedFile::SharedPtr mpFile;
+        std::vector<ChunkDesc> mChunks;
+    };
+
+    /** Scene cache index. Lists the dependencies and the keys of the section files.
+    */
+    struct SceneCache::Index
+    {
+        struct Entry
+        {
+            std::string path;
+            SectionFlags sections = SectionFlags::None;
+            uint64_t size = 0;
+            int64_t modifiedTime = 0;
+            Key hash{};
+        };
+
+        std::vector<Entry> dependencies;
+        std::array<Key, (size_t)Section::Count> sectionKeys{};
+        bool modified = false;      ///< True if dependency entries were updated after reading the index (not serialized).
+    };
+
+    /** Section file loaded into memory. The compressed stream is decompressed, chunks reference the mapped file.
+    */
+    struct SceneCache::SectionData
+    {
+        std::filesystem::path path;
+        MemoryMappedFile::SharedPtr pFile;
+        std::vector<ChunkDesc> chunks;
+        std::vector<uint8_t> stream;
     };
 
     bool SceneCache::hasValidCache(const Key& key)
+    {
+        Index index;
+        if (!readIndex(key, index)) return false;
+
+        // Only some sections can be refreshed without re-importing the scene.
+        std::set<std::string> stalePaths;
+        SectionFlags staleSections = updateDependencies(index, stalePaths);
+        if (is_set(staleSections, ~kRefreshableSections)) return false;
+
+        for (const auto& sectionKey : index.sectionKeys)
+        {
+            if (!std::filesystem::exists(getSectionPath(sectionKey))) return false;
+        }
+
+        return true;
+    }
+
+    void SceneCache::writeCache(const Scene::SceneData& sceneData, const Key& key, const DependencyList& dependencies)
+    {
+        auto cachePath = getCachePath(key);
+
+        logInfo("Writing scene cache to " + cachePath.string());
+
+        // Hash the dependencies. Entries referring to the same file are merged.
+        std::map<std::string, SectionFlags> dependencySections;
+        for (const auto& dependency : dependencies) dependencySections[dependency.path] |= dependency.sections;
+
+        Index index;
+        for (const auto& [path, sections] : dependencySections)
+        {
+            FileInfo info;
+            if (!hashFile(path, info))
+            {
+                logWarning("Failed to hash scene cache dependency '" + path + "'. Changes to the file will not invalidate the cache.");
+                continue;
+            }
+            index.dependencies.push_back({ path, sections, info.size, info.modifiedTime, info.hash });
+        }
+
+        // Write sections.
+        for (uint32_t i = 0; i < (uint32_t)Section::Count; ++i)
+        {
+            Section section = (Section)i;
+            index.sectionKeys[i] = computeSectionKey(key, index, section);
+            writeSection(index.sectionKeys[i], [&](OutputStream& stream)
+            {
+                switch (section)
+                {
+                case Section::Scene: writeSceneSection(stream, sceneData); break;
+                case Section::Meshes: writeMeshSection(stream, sceneData); break;
+                case Section::Materials: writeMaterialSection(stream, sceneData); break;
+                case Section::Grids: writeGridSection(stream, sceneData); break;
+                case Section::Animations: writeAnimationSection(stream, sceneData); break;
+                default: should_not_get_here();
+                }
+            });
+        }
+
+        // Remove sections of the previous cache that have been replaced.
+        Index prevIndex;
+        if (readIndex(key, prevIndex))
+        {
+            for (uint32_t i = 0; i < (uint32_t)Section::Count; ++i)
+            {
+                std::error_code ec;
+                if (prevIndex.sectionKeys[i] != index.sectionKeys[i]) std::filesystem::remove(getSectionPath(prevIndex.sectionKeys[i]), ec);
+            }
+        }
+
+        writeIndex(key, index);
+    }
+
+    Scene::SceneData SceneCache::readCache(const Key& key, bool useSrgb, bool compressTextures)
+    {
+        auto cachePath = getCachePath(key);
+
+        logInfo("Loading scene cache from " + cachePath.string());
+
+        Index index;
+        if (!readIndex(key, index)) throw std::runtime_error("Failed to read scene cache index '" + cachePath.string() + "'!");
+        const auto cachedSectionKeys = index.sectionKeys;
+
+        // Check dependencies. Modified grid files, textures and environment maps are reloaded, any other modification requires a re-import.
+        std::set<std::string> stalePaths;
+        SectionFlags staleSections = updateDependencies(index, stalePaths);
+        if (is_set(staleSections, ~kRefreshableSections)) throw std::runtime_error("Scene cache '" + cachePath.string() + "' is out of date!");
+        if (!stalePaths.empty()) logInfo("Refreshing " + std::to_string(stalePaths.size()) + " modified file(s) in scene cache");
+
+        Scene::SceneData sceneData;
+        auto getSectionKey = [&cachedSectionKeys](Section section) { return cachedSectionKeys[(size_t)section]; };
+
+        // Load and decompress all sections in parallel. The sections are deserialized in order below.
+        // Exceptions must not escape the parallel loop, they are rethrown afterwards.
+        std::array<SectionData, (size_t)Section::Count> sections;
+        std::array<std::exception_ptr, (size_t)Section::Count> exceptions;
+        Threading::parallelFor(0, sections.size(), [&](size_t i)
+        {
+            try
+            {
+                sections[i] = loadSection(cachedSectionKeys[i]);
+            }
+            catch (...)
+            {
+                exceptions[i] = std::current_exception();
+            }
+        }, 1);
+        for (const auto& pException : exceptions)
+        {
+            if (pException) std::rethrow_exception(pException);
+        }
+        auto getSection = [&sections](Section section) -> const SectionData& { return sections[(size_t)section]; };
+
+        readSection(getSection(Section::Scene), [&](InputStream& stream) { readSceneSection(stream, sceneData); });
+        readSection(getSection(Section::Grids), [&](InputStream& stream) { readGridSection(stream, sceneData, stalePaths); });
+
+        // Material textures are loaded asynchronously to allow loading other data
+        // in parallel while loading textures from files and uploading them to the GPU.
+        // Due to the current implementation, we need to make sure no other GPU operations (transfers)
+        // are executed while loading material textures. Due to this, we load volume grids and the envmap
+        // before material textures, as they upload buffers to the GPU when created.
+        // Make sure no other GPU operations are executed until calling pMaterialTextureLoader.reset()
+        // further down which blocks until all textures are loaded.
+        auto pMaterialTextureLoader = std::make_unique<MaterialTextureLoader>(useSrgb, compressTextures);
+
+        readSection(getSection(Section::Materials), [&](InputStream& stream) { readMaterialSection(stream, sceneData, *pMaterialTextureLoader); });
+        readSection(getSection(Section::Animations), [&](InputStream& stream) { readAnimationSection(stream, sceneData); });
+        readSection(getSection(Section::Meshes), [&](InputStream& stream) { readMeshSection(stream, sceneData); });
+
+        pMaterialTextureLoader.reset();
+
+        // Write back the refreshed sections and the updated dependencies.
+        // Failing to do so only affects the next load, so errors are not propagated.
+        try
+        {
+            for (uint32_t i = 0; i < (uint32_t)Section::Count; ++i)
+            {
+                Section section = (Section)i;
+                if (!is_set(staleSections, getSectionFlag(section))) continue;
+
+                // Missing files are not rehashed, the section key only changes if a file was modified.
+                auto& sectionKey = index.sectionKeys[i];
+                sectionKey = computeSectionKey(key, index, section);
+                if (sectionKey == getSectionKey(section)) continue;
+
+                if (section == Section::Grids)
+                {
+                    writeSection(sectionKey, [&](OutputStream& stream) { writeGridSection(stream, sceneData); });
+                }
+                else
+                {
+                    // The section content is unchanged, store it under the new key.
+                    std::filesystem::copy_file(getSectionPath(getSectionKey(section)), getSectionPath(sectionKey), std::filesystem::copy_options::overwrite_existing);
+                }
+
+                std::error_code ec;
+                std::filesystem::remove(getSectionPath(getSectionKey(section)), ec);
+            }
+            if (index.modified) writeIndex(key, index);
+        }
+        catch (const std::exception& e)
+        {
+            logWarning(std::string("Failed to update scene cache: ") + e.what());
+        }
+
+        return sceneData;
+    }
+
+    std::filesystem::path SceneCache::getCachePath(const Key& key)
+    {
+        return std::filesystem::path(getAppDataDirectory()) / kDirectory / SHA1::toHexString(key);
+    }
+
+    std::filesystem::path SceneCache::getSectionPath(const Key& sectionKey)
+    {
+        return std::filesystem::path(getAppDataDirectory()) / kDirectory / kSectionDirectory / SHA1::toHexString(sectionKey);
+    }
+
+    // Index
+
+    bool SceneCache::readIndex(const Key& key, Index& index)
     {
         auto cachePath = getCachePath(key);
         if (!std::filesystem::exists(cachePath)) return false;
@@ -184,15 +572,28 @@ namespace Falcor
         // Verify header.
         Header header;
         fs.read(reinterpret_cast<char*>(&header), sizeof(header));
-        return !fs.eof() && header.isValid();
+        if (fs.eof() || !header.isValid(kMagic)) return false;
+
+        InputStream stream(fs);
+        index.dependencies.resize(stream.read<uint32_t>());
+        for (auto& entry : index.dependencies)
+        {
+            stream.read(entry.path);
+            stream.read(entry.sections);
+            stream.read(entry.size);
+            stream.read(entry.modifiedTime);
+            stream.read(entry.hash);
+        }
+        stream.read(index.sectionKeys);
+        index.modified = false;
+
+        return !fs.fail();
     }
 
-    void SceneCache::writeCache(const Scene::SceneData& sceneData, const Key& key)
+    void SceneCache::writeIndex(const Key& key, const Index& index)
     {
         auto cachePath = getCachePath(key);
 
-        logInfo("Writing scene cache to " + cachePath.string());
-
         // Create directories if not existing.
         std::filesystem::create_directories(cachePath.parent_path());
 
@@ -200,53 +601,198 @@ namespace Falcor
         std::ofstream fs(cachePath.c_str(), std::ios_base::binary);
         if (fs.bad()) throw std::runtime_error("Failed to create scene cache file '" + cachePath.string() + "'!");
 
-        // Write header (uncompressed).
-        Header header;
-        std::memcpy(header.magic, kMagic, sizeof(Header::magic));
-        header.version = kVersion;
+        // Write header and index (uncompressed).
+        Header header(kMagic);
         fs.write(reinterpret_cast<const char*>(&header), sizeof(header));
 
-        // Write cache (compressed).
-        lz4_stream::basic_ostream<kBlockSize> zs(fs);
-        OutputStream stream(zs);
-        writeSceneData(stream, sceneData);
+        OutputStream stream(fs);
+        stream.write((uint32_t)index.dependencies.size());
+        for (const auto& entry : index.dependencies)
+        {
+            stream.write(entry.path);
+            stream.write(entry.sections);
+            stream.write(entry.size);
+            stream.write(entry.modifiedTime);
+            stream.write(entry.hash);
+        }
+        stream.write(index.sectionKeys);
         if (fs.bad()) throw std::runtime_error("Failed to write scene cache file to '" + cachePath.string() + "'!");
     }
 
-    Scene::SceneData SceneCache::readCache(const Key& key)
+    SceneCache::SectionFlags SceneCache::updateDependencies(Index& index, std::set<std::string>& stalePaths)
     {
-        auto cachePath = getCachePath(key);
+        SectionFlags staleSections = SectionFlags::None;
 
-        logInfo("Loading scene cache from " + cachePath.string());
+        for (auto& entry : index.dependencies)
+        {
+            // Files with unchanged size and modification time are assumed to be unmodified.
+            FileInfo info;
+            if (!getFileInfo(entry.path, info))
+            {
+                logInfo("Scene cache dependency '" + entry.path + "' is missing");
+                staleSections |= entry.sections;
+                stalePaths.insert(entry.path);
+                continue;
+            }
+            if (info.size == entry.size && info.modifiedTime == entry.modifiedTime) continue;
+
+            // Compare content hashes of touched files.
+            if (!hashFile(entry.path, info))
+            {
+                staleSections |= entry.sections;
+                stalePaths.insert(entry.path);
+                continue;
+            }
+            if (info.hash != entry.hash)
+            {
+                logInfo("Scene cache dependency '" + entry.path + "' was modified");
+                staleSections |= entry.sections;
+                stalePaths.insert(entry.path);
+            }
+
+            entry.size = info.size;
+            entry.modifiedTime = info.modifiedTime;
+            entry.hash = info.hash;
+            index.modified = true;
+        }
+
+        return staleSections;
+    }
+
+    SceneCache::Key SceneCache::computeSectionKey(const Key& key, const Index& index, Section section)
+    {
+        // The section key is computed from the cache key and the content of all files affecting the section.
+        SHA1 sha1;
+        sha1.update(&kVersion, sizeof(kVersion));
+        sha1.update(key.data(), key.size());
+        sha1.update(&section, sizeof(section));
+        for (const auto& entry : index.dependencies)
+        {
+            if (!is_set(entry.sections, getSectionFlag(section))) continue;
+            sha1.update(entry.path.data(), entry.path.size());
+            sha1.update(entry.hash.data(), entry.hash.size());
+        }
+        return sha1.final();
+    }
+
+    // Sections
+
+    void SceneCache::writeSection(const Key& sectionKey, const std::function<void(OutputStream&)>& writeFunc)
+    {
+        auto sectionPath = getSectionPath(sectionKey);
+
+        // Serialize section.
+        std::ostringstream ss(std::ios_base::binary);
+        std::vector<OutputStream::Chunk> chunks;
+        {
+            OutputStream stream(ss);
+            writeFunc(stream);
+            chunks = stream.getChunks();
+        }
+
+        // Compress the serialized stream in independent frames.
+        const std::string data = ss.str();
+        std::vector<ParallelLZ4::Frame> frames;
+        auto compressedData = ParallelLZ4::compress(data.data(), data.size(), frames, kFrameSize);
+
+        // Create directories if not existing.
+        std::filesystem::create_directories(sectionPath.parent_path());
 
         // Open file.
-        std::ifstream fs(cachePath.c_str(), std::ios_base::binary);
-        if (fs.bad()) throw std::runtime_error("Failed to open scene cache file '" + cachePath.string() + "'!");
+        std::ofstream fs(sectionPath.c_str(), std::ios_base::binary);
+        if (fs.bad()) throw std::runtime_error("Failed to create scene cache file '" + sectionPath.string() + "'!");
 
-        // Read header (uncompressed).
-        Header header;
-        fs.read(reinterpret_cast<char*>(&header), sizeof(header));
-        if (!header.isValid()) throw std::runtime_error("Invalid header in scene cache file '" + cachePath.string() + "'!");
+        // Write header (uncompressed). The header is rewritten once the chunk and frame tables are known.
+        Header header(kSectionMagic);
+        fs.write(reinterpret_cast<const char*>(&header), sizeof(header));
 
-        // Read cache (compressed).
-        lz4_stream::basic_istream<kBlockSize, kBlockSize> zs(fs);
-        InputStream stream(zs);
-        auto sceneData = readSceneData(stream);
-        if (fs.bad()) throw std::runtime_error("Failed to read scene cache file from '" + cachePath.string() + "'!");
-        return sceneData;
+        // Write compressed frames. Frame offsets are relative to the end of the header.
+        fs.write(reinterpret_cast<const char*>(compressedData.data()), compressedData.size());
+
+        // Write chunks (uncompressed). Chunks are aligned to allow direct access through a memory mapping.
+        std::vector<ChunkDesc> chunkTable;
+        const char padding[kChunkAlignment] = {};
+        for (const auto& chunk : chunks)
+        {
+            uint64_t offset = (uint64_t)fs.tellp();
+            uint64_t alignedOffset = align_to(kChunkAlignment, offset);
+            fs.write(padding, alignedOffset - offset);
+            if (chunk.writeFunc)
+            {
+                chunk.writeFunc(fs);
+                chunkTable.push_back({ alignedOffset, (uint64_t)fs.tellp() - alignedOffset });
+            }
+            else
+            {
+                fs.write(reinterpret_cast<const char*>(chunk.data), chunk.size);
+                chunkTable.push_back({ alignedOffset, chunk.size });
+            }
+        }
+
+        // Write chunk and frame tables and update header.
+        header.chunkCount = (uint32_t)chunkTable.size();
+        header.chunkTableOffset = (uint64_t)fs.tellp();
+        fs.write(reinterpret_cast<const char*>(chunkTable.data()), chunkTable.size() * sizeof(ChunkDesc));
+        header.frameCount = (uint32_t)frames.size();
+        header.frameTableOffset = (uint64_t)fs.tellp();
+        fs.write(reinterpret_cast<const char*>(frames.data()), frames.size() * sizeof(ParallelLZ4::Frame));
+        fs.seekp(0);
+        fs.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        if (fs.bad()) throw std::runtime_error("Failed to write scene cache file to '" + sectionPath.string() + "'!");
     }
 
-    std::filesystem::path SceneCache::getCachePath(const Key& key)
+    SceneCache::SectionData SceneCache::loadSection(const Key& sectionKey)
     {
-        std::stringstream ss;
-        ss << std::hex << std::setfill('0') << std::setw(2);
-        for (auto c : key) ss << (int)c;
-        return std::filesystem::path(getAppDataDirectory()) / kDirectory / ss.str();
+        SectionData section;
+        section.path = getSectionPath(sectionKey);
+
+        // Map file. Chunks are accessed directly in the mapped memory.
+        section.pFile = MemoryMappedFile::create(section.path);
+        const uint8_t* pData = section.pFile->getData();
+        const size_t size = section.pFile->getSize();
+
+        // Read header, chunk table and frame table (uncompressed).
+        Header header;
+        if (size < sizeof(header)) throw std::runtime_error("Invalid header in scene cache file '" + section.path.string() + "'!");
+        std::memcpy(&header, pData, sizeof(header));
+        if (!header.isValid(kSectionMagic) ||
+            header.chunkTableOffset < sizeof(header) || header.chunkTableOffset + header.chunkCount * sizeof(ChunkDesc) > size ||
+            header.frameTableOffset < sizeof(header) || header.frameTableOffset + header.frameCount * sizeof(ParallelLZ4::Frame) > size)
+        {
+            throw std::runtime_error("Invalid header in scene cache file '" + section.path.string() + "'!");
+        }
+
+        section.chunks.resize(header.chunkCount);
+        std::memcpy(section.chunks.data(), pData + header.chunkTableOffset, section.chunks.size() * sizeof(ChunkDesc));
+
+        std::vector<ParallelLZ4::Frame> frames(header.frameCount);
+        std::memcpy(frames.data(), pData + header.frameTableOffset, frames.size() * sizeof(ParallelLZ4::Frame));
+
+        // Decompress frames. The compressed stream is located between the header and the first chunk.
+        size_t streamEnd = section.chunks.empty() ? header.chunkTableOffset : std::min(section.chunks[0].offset, header.chunkTableOffset);
+        section.stream.resize(ParallelLZ4::getDecompressedSize(frames));
+        try
+        {
+            ParallelLZ4::decompress(pData + sizeof(header), streamEnd - sizeof(header), frames, section.stream.data());
+        }
+        catch (const std::exception& e)
+        {
+            throw std::runtime_error("Failed to read scene cache file from '" + section.path.string() + "': " + e.what());
+        }
+
+        return section;
     }
 
-    // SceneData
+    void SceneCache::readSection(const SectionData& section, const std::function<void(InputStream&)>& readFunc)
+    {
+        MemoryStreamBuffer buffer(section.stream.data(), section.stream.size());
+        std::istream fs(&buffer);
+        InputStream stream(fs, section.pFile, section.chunks);
+        readFunc(stream);
+        if (fs.fail()) throw std::runtime_error("Failed to read scene cache file from '" + section.path.string() + "'!");
+    }
 
-    void SceneCache::writeSceneData(OutputStream& stream, const Scene::SceneData& sceneData)
+    void SceneCache::writeSceneSection(OutputStream& stream, const Scene::SceneData& sceneData)
     {
         writeMarker(stream, "Filename");
         stream.write(sceneData.filename);
@@ -264,23 +810,11 @@ namespace Falcor
         stream.write((uint32_t)sceneData.lights.size());
         for (const auto& pLight : sceneData.lights) writeLight(stream, pLight);
 
-        writeMarker(stream, "Grids");
-        stream.write((uint32_t)sceneData.grids.size());
-        for (const auto& pGrid : sceneData.grids) writeGrid(stream, pGrid);
-
-        writeMarker(stream, "GridVolumes");
-        stream.write((uint32_t)sceneData.gridVolumes.size());
-        for (const auto& pGridVolume : sceneData.gridVolumes) writeGridVolume(stream, pGridVolume, sceneData.grids);
-
         writeMarker(stream, "EnvMap");
         bool hasEnvMap = sceneData.pEnvMap != nullptr;
         stream.write(hasEnvMap);
         if (hasEnvMap) writeEnvMap(stream, sceneData.pEnvMap);
 
-        writeMarker(stream, "Materials");
-        stream.write((uint32_t)sceneData.materials.size());
-        for (const auto& pMaterial : sceneData.materials) writeMaterial(stream, pMaterial);
-
         writeMarker(stream, "SceneGraph");
         stream.write((uint32_t)sceneData.sceneGraph.size());
         for (const auto& node : sceneData.sceneGraph)
@@ -292,16 +826,53 @@ namespace Falcor
             stream.write(node.localToBindSpace);
         }
 
-        writeMarker(stream, "Animations");
-        stream.write((uint32_t)sceneData.animations.size());
-        for (const auto& pAnimation : sceneData.animations)
+        writeMarker(stream, "Metadata");
+        writeMetadata(stream, sceneData.metadata);
+
+        writeMarker(stream, "End");
+    }
+
+    void SceneCache::readSceneSection(InputStream& stream, Scene::SceneData& sceneData)
+    {
+        readMarker(stream, "Filename");
+        stream.read(sceneData.filename);
+
+        readMarker(stream, "RenderSettings");
+        stream.read(sceneData.renderSettings);
+
+        readMarker(stream, "Cameras");
+        sceneData.cameras.resize(stream.read<uint32_t>());
+        for (auto& pCamera : sceneData.cameras) pCamera = readCamera(stream);
+        stream.read(sceneData.selectedCamera);
+        stream.read(sceneData.cameraSpeed);
+
+        readMarker(stream, "Lights");
+        sceneData.lights.resize(stream.read<uint32_t>());
+        for (auto& pLight : sceneData.lights) pLight = readLight(stream);
+
+        readMarker(stream, "EnvMap");
+        auto hasEnvMap = stream.read<bool>();
+        if (hasEnvMap) sceneData.pEnvMap = readEnvMap(stream);
+
+        readMarker(stream, "SceneGraph");
+        sceneData.sceneGraph.resize(stream.read<uint32_t>());
+        for (auto &node : sceneData.sceneGraph)
         {
-            writeAnimation(stream, pAnimation);
+            stream.read(node.name);
+            stream.read(node.parent);
+            stream.read(node.transform);
+            stream.read(node.meshBind);
+            stream.read(node.localToBindSpace);
         }
 
-        writeMarker(stream, "Metadata");
-        writeMetadata(stream, sceneData.metadata);
+        readMarker(stream, "Metadata");
+        sceneData.metadata = readMetadata(stream);
 
+        readMarker(stream, "End");
+    }
+
+    void SceneCache::writeMeshSection(OutputStream& stream, const Scene::SceneData& sceneData)
+    {
         writeMarker(stream, "Meshes");
         stream.write(sceneData.meshDesc);
         stream.write(sceneData.meshNames);
@@ -331,16 +902,16 @@ namespace Falcor
         stream.write(sceneData.has16BitIndices);
         stream.write(sceneData.has32BitIndices);
         stream.write(sceneData.meshDrawCount);
-        stream.write(sceneData.meshIndexData);
-        stream.write(sceneData.meshStaticData);
-        stream.write(sceneData.meshDynamicData);
+        stream.writeChunk(sceneData.getMeshIndexData(), sceneData.getMeshIndexCount());
+        stream.writeChunk(sceneData.getMeshStaticData(), sceneData.getMeshVertexCount());
+        stream.writeChunk(sceneData.meshDynamicData);
 
         writeMarker(stream, "Curves");
         stream.write(sceneData.curveDesc);
         stream.write(sceneData.curveBBs);
         stream.write(sceneData.curveInstanceData);
-        stream.write(sceneData.curveIndexData);
-        stream.write(sceneData.curveStaticData);
+        stream.writeChunk(sceneData.curveIndexData);
+        stream.writeChunk(sceneData.curveStaticData);
 
         stream.write((uint32_t)sceneData.cachedCurves.size());
         for (const auto& cachedCurve : sceneData.cachedCurves)
@@ -359,69 +930,8 @@ namespace Falcor
         writeMarker(stream, "End");
     }
 
-    Scene::SceneData SceneCache::readSceneData(InputStream& stream)
+    void SceneCache::readMeshSection(InputStream& stream, Scene::SceneData& sceneData)
     {
-        Scene::SceneData sceneData;
-
-        readMarker(stream, "Filename");
-        stream.read(sceneData.filename);
-
-        readMarker(stream, "RenderSettings");
-        stream.read(sceneData.renderSettings);
-
-        readMarker(stream, "Cameras");
-        sceneData.cameras.resize(stream.read<uint32_t>());
-        for (auto& pCamera : sceneData.cameras) pCamera = readCamera(stream);
-        stream.read(sceneData.selectedCamera);
-        stream.read(sceneData.cameraSpeed);
-
-        readMarker(stream, "Lights");
-        sceneData.lights.resize(stream.read<uint32_t>());
-        for (auto& pLight : sceneData.lights) pLight = readLight(stream);
-
-        readMarker(stream, "Grids");
-        sceneData.grids.resize(stream.read<uint32_t>());
-        for (auto& pGrid : sceneData.grids) pGrid = readGrid(stream);
-
-        readMarker(stream, "GridVolumes");
-        sceneData.gridVolumes.resize(stream.read<uint32_t>());
-        for (auto& pGridVolume : sceneData.gridVolumes) pGridVolume = readGridVolume(stream, sceneData.grids);
-
-        readMarker(stream, "EnvMap");
-        auto hasEnvMap = stream.read<bool>();
-        if (hasEnvMap) sceneData.pEnvMap = readEnvMap(stream);
-
-        // Material textures are loaded asynchronously to allow loading other data
-        // in parallel while loading textures from files and uploading them to the GPU.
-        // Due to the current implementation, we need to make sure no other GPU operations (transfers)
-        // are executed while loading material textures. Due to this, we load volume grids and the envmap
-        // before material textures, as they upload buffers to the GPU when created.
-        // Make sure no other GPU operations are executed until calling pMaterialTextureLoader.reset()
-        // further down which blocks until all textures are loaded.
-        auto pMaterialTextureLoader = std::make_unique<MaterialTextureLoader>(true);
-
-        readMarker(stream, "Materials");
-        sceneData.materials.resize(stream.read<uint32_t>());
-        for (auto& pMaterial : sceneData.materials) pMaterial = readMaterial(stream, *pMaterialTextureLoader);
-
-        readMarker(stream, "SceneGraph");
-        sceneData.sceneGraph.resize(stream.read<uint32_t>());
-        for (auto &node : sceneData.sceneGraph)
-        {
-            stream.read(node.name);
-            stream.read(node.parent);
-            stream.read(node.transform);
-            stream.read(node.meshBind);
-            stream.read(node.localToBindSpace);
-        }
-
-        readMarker(stream, "Animations");
-        sceneData.animations.resize(stream.read<uint32_t>());
-        for (auto& pAnimation : sceneData.animations) pAnimation = readAnimation(stream);
-
-        readMarker(stream, "Metadata");
-        sceneData.metadata = readMetadata(stream);
-
         readMarker(stream, "Meshes");
         stream.read(sceneData.meshDesc);
         stream.read(sceneData.meshNames);
@@ -451,16 +961,18 @@ namespace Falcor
         stream.read(sceneData.has16BitIndices);
         stream.read(sceneData.has32BitIndices);
         stream.read(sceneData.meshDrawCount);
-        stream.read(sceneData.meshIndexData);
-        stream.read(sceneData.meshStaticData);
-        stream.read(sceneData.meshDynamicData);
+        // Index and static vertex data are referenced in the mapped file until uploaded to the GPU.
+        stream.readChunk(sceneData.pMappedMeshIndexData, sceneData.mappedMeshIndexCount);
+        stream.readChunk(sceneData.pMappedMeshStaticData, sceneData.mappedMeshVertexCount);
+        sceneData.pMeshDataFile = stream.getMappedFile();
+        stream.readChunk(sceneData.meshDynamicData);
 
         readMarker(stream, "Curves");
         stream.read(sceneData.curveDesc);
         stream.read(sceneData.curveBBs);
         stream.read(sceneData.curveInstanceData);
-        stream.read(sceneData.curveIndexData);
-        stream.read(sceneData.curveStaticData);
+        stream.readChunk(sceneData.curveIndexData);
+        stream.readChunk(sceneData.curveStaticData);
 
         sceneData.cachedCurves.resize(stream.read<uint32_t>());
         for (auto& cachedCurve : sceneData.cachedCurves)
@@ -477,10 +989,76 @@ namespace Falcor
         stream.read(sceneData.customPrimitiveAABBs);
 
         readMarker(stream, "End");
+    }
 
-        pMaterialTextureLoader.reset();
+    void SceneCache::writeMaterialSection(OutputStream& stream, const Scene::SceneData& sceneData)
+    {
+        writeMarker(stream, "Materials");
+        stream.write((uint32_t)sceneData.materials.size());
+        for (const auto& pMaterial : sceneData.materials) writeMaterial(stream, pMaterial);
 
-        return sceneData;
+        writeMarker(stream, "End");
+    }
+
+    void SceneCache::readMaterialSection(InputStream& stream, Scene::SceneData& sceneData, MaterialTextureLoader& materialTextureLoader)
+    {
+        readMarker(stream, "Materials");
+        sceneData.materials.resize(stream.read<uint32_t>());
+        for (auto& pMaterial : sceneData.materials) pMaterial = readMaterial(stream, materialTextureLoader);
+
+        readMarker(stream, "End");
+    }
+
+    void SceneCache::writeGridSection(OutputStream& stream, const Scene::SceneData& sceneData)
+    {
+        writeMarker(stream, "Grids");
+        stream.write((uint32_t)sceneData.grids.size());
+        for (const auto& pGrid : sceneData.grids) writeGrid(stream, pGrid);
+
+        writeMarker(stream, "GridVolumes");
+        stream.write((uint32_t)sceneData.gridVolumes.size());
+        for (const auto& pGridVolume : sceneData.gridVolumes) writeGridVolume(stream, pGridVolume, sceneData.grids);
+
+        writeMarker(stream, "End");
+    }
+
+    void SceneCache::readGridSection(InputStream& stream, Scene::SceneData& sceneData, const std::set<std::string>& refreshPaths)
+    {
+        readMarker(stream, "Grids");
+        sceneData.grids.resize(stream.read<uint32_t>());
+        for (auto& pGrid : sceneData.grids) pGrid = readGrid(stream, refreshPaths);
+
+        readMarker(stream, "GridVolumes");
+        sceneData.gridVolumes.resize(stream.read<uint32_t>());
+        for (auto& pGridVolume : sceneData.gridVolumes)
+        {
+            pGridVolume = readGridVolume(stream, sceneData.grids, refreshPaths);
+            // Refreshed grids may have changed bounds.
+            if (!refreshPaths.empty()) pGridVolume->updateBounds();
+        }
+
+        readMarker(stream, "End");
+    }
+
+    void SceneCache::writeAnimationSection(OutputStream& stream, const Scene::SceneData& sceneData)
+    {
+        writeMarker(stream, "Animations");
+        stream.write((uint32_t)sceneData.animations.size());
+        for (const auto& pAnimation : sceneData.animations)
+        {
+            writeAnimation(stream, pAnimation);
+        }
+
+        writeMarker(stream, "End");
+    }
+
+    void SceneCache::readAnimationSection(InputStream& stream, Scene::SceneData& sceneData)
+    {
+        readMarker(stream, "Animations");
+        sceneData.animations.resize(stream.read<uint32_t>());
+        for (auto& pAnimation : sceneData.animations) pAnimation = readAnimation(stream);
+
+        readMarker(stream, "End");
     }
 
     // Metadata
@@ -753,13 +1331,20 @@ namespace Falcor
                 stream.write(id);
             }
         }
+        for (const auto& pSequence : pGridVolume->mStreamingGrids)
+        {
+            stream.write(pSequence != nullptr);
+            if (pSequence) writeStreamingGridSequence(stream, pSequence);
+        }
         stream.write(pGridVolume->mGridFrame);
         stream.write(pGridVolume->mGridFrameCount);
         stream.write(pGridVolume->mBounds);
         stream.write(pGridVolume->mData);
+        stream.write(pGridVolume->mFrameRate);
+        stream.write(pGridVolume->mPlaybackEnabled);
     }
 
-    GridVolume::SharedPtr SceneCache::readGridVolume(InputStream& stream, const std::vector<Grid::SharedPtr>& grids)
+    GridVolume::SharedPtr SceneCache::readGridVolume(InputStream& stream, const std::vector<Grid::SharedPtr>& grids, const std::set<std::string>& refreshPaths)
     {
         GridVolume::SharedPtr pGridVolume = GridVolume::create("");
 
@@ -777,29 +1362,105 @@ namespace Falcor
                 pGrid = id == uint32_t(-1) ? nullptr : grids[id];
             }
         }
+        for (auto& pSequence : pGridVolume->mStreamingGrids)
+        {
+            if (stream.read<bool>()) pSequence = readStreamingGridSequence(stream, refreshPaths);
+        }
         stream.read(pGridVolume->mGridFrame);
         stream.read(pGridVolume->mGridFrameCount);
         stream.read(pGridVolume->mBounds);
         stream.read(pGridVolume->mData);
+        stream.read(pGridVolume->mFrameRate);
+        stream.read(pGridVolume->mPlaybackEnabled);
+
+        // Load the current frames of streamed sequences.
+        pGridVolume->updateStreamedGrids();
 
         return pGridVolume;
     }
 
+    // StreamingGridSequence
+
+    void SceneCache::writeStreamingGridSequence(OutputStream& stream, const StreamingGridSequence::SharedPtr& pSequence)
+    {
+        stream.write(pSequence->mGridname);
+        stream.write(pSequence->mMaxResidentBytes);
+        stream.write(pSequence->mPrefetchFrameCount);
+        stream.write((uint32_t)pSequence->mFrames.size());
+        for (uint32_t frame = 0; frame < (uint32_t)pSequence->mFrames.size(); ++frame)
+        {
+            stream.write(pSequence->mFrames[frame].sourceFilename);
+
+            // Frames are read one at a time while the section is written, so the sequence never needs to be fully resident.
+            // Frames that fail to load are written as empty chunks.
+            stream.writeChunk([pSequence, frame] (std::ostream& os)
+            {
+                auto handle = pSequence->readGridHandle(frame);
+                if (handle) os.write(reinterpret_cast<const char*>(handle.data()), handle.size());
+            });
+        }
+    }
+
+    StreamingGridSequence::SharedPtr SceneCache::readStreamingGridSequence(InputStream& stream, const std::set<std::string>& refreshPaths)
+    {
+        auto gridname = stream.read<std::string>();
+        auto pSequence = StreamingGridSequence::SharedPtr(new StreamingGridSequence(gridname));
+        stream.read(pSequence->mMaxResidentBytes);
+        stream.read(pSequence->mPrefetchFrameCount);
+
+        // Frames reference the NanoVDB grids in the memory-mapped section file.
+        // Frames whose source file was modified are loaded from the source file instead.
+        pSequence->mpCacheFile = stream.getMappedFile();
+        pSequence->mFrames.resize(stream.read<uint32_t>());
+        for (auto& frame : pSequence->mFrames)
+        {
+            stream.read(frame.sourceFilename);
+            stream.readChunk(frame.pCachedData, frame.cachedSize);
+            if (refreshPaths.find(frame.sourceFilename) != refreshPaths.end() || frame.cachedSize == 0)
+            {
+                frame.pCachedData = nullptr;
+                frame.cachedSize = 0;
+                frame.failed = frame.sourceFilename.empty();
+            }
+        }
+
+        return pSequence;
+    }
+
     // Grid
 
     void SceneCache::writeGrid(OutputStream& stream, const Grid::SharedPtr& pGrid)
     {
+        stream.write(pGrid->mSourceFilename);
+        stream.write(pGrid->mGridname);
+
         const nanovdb::HostBuffer& buffer = pGrid->mGridHandle.buffer();
-        stream.write((uint64_t)buffer.size());
-        stream.write(buffer.data(), buffer.size());
+        stream.writeChunk(buffer.data(), buffer.size());
     }
 
-    Grid::SharedPtr SceneCache::readGrid(InputStream& stream)
+    Grid::SharedPtr SceneCache::readGrid(InputStream& stream, const std::set<std::string>& refreshPaths)
     {
-        uint64_t size = stream.read<uint64_t>();
+        auto sourceFilename = stream.read<std::string>();
+        auto gridname = stream.read<std::string>();
+
+        const uint8_t* data;
+        size_t size;
+        stream.readChunk(data, size);
+
+        // Reload the grid if the source file was modified.
+        if (refreshPaths.find(sourceFilename) != refreshPaths.end())
+        {
+            auto pGrid = Grid::createFromFile(sourceFilename, gridname);
+            if (!pGrid) throw std::runtime_error("Failed to reload grid '" + gridname + "' from '" + sourceFilename + "'!");
+            return pGrid;
+        }
+
         auto buffer = nanovdb::HostBuffer::create(size);
-        stream.read(buffer.data(), buffer.size());
-        return Grid::SharedPtr(new Grid(nanovdb::GridHandle<nanovdb::HostBuffer>(std::move(buffer))));
+        std::memcpy(buffer.data(), data, size);
+        auto pGrid = Grid::SharedPtr(new Grid(nanovdb::GridHandle<nanovdb::HostBuffer>(std::move(buffer))));
+        pGrid->mSourceFilename = sourceFilename;
+        pGrid->mGridname = gridname;
+        return pGrid;
     }
 
     // EnvMap
@@ -864,6 +1525,7 @@ namespace Falcor
         stream.read(pAnimation->mInterpolationMode);
         stream.read(pAnimation->mEnableWarping);
         stream.read(pAnimation->mKeyframes);
+        pAnimation->updateTangents();
         return pAnimation;
     }
 
@@ -31,19 +31,73 @@
 #include "Utils/CryptoUtils.h"
 
 #include <filesystem>
+#include <functional>
+#include <set>
 
 namespace Falcor
 {
     /** Helper class for reading and writing scene cache files.
         The scene cache is used to heavily reduce load times of more complex assets.
         The cache stores a binary representation of `Scene::SceneData` which contains everything to re-create a `Scene`.
+
+        The cache for a given key consists of an index file and a set of section files.
+        The index lists the files the scene was imported from (dependencies) together with their content hashes.
+        Each section holds a part of the scene data and is stored in a file named after a hash of the cache key
+        and the content hashes of the dependencies affecting the section. A modified dependency thus only invalidates
+        the sections it affects. Stale grid sections are refreshed in place by reloading the modified grid files,
+        other stale sections require the scene to be re-imported.
+
+        Section files are memory-mapped for reading. Large arrays (mesh indices and vertices, curve data and
+        grid buffers) are stored as uncompressed 64-byte aligned chunks after the compressed section stream.
+        Mesh index and vertex data is uploaded to the GPU directly from the mapped file.
     */
     class dlldecl SceneCache
     {
     public:
         using Key = SHA1::MD;
 
+        /** Scene cache sections.
+        */
+        enum class Section : uint32_t
+        {
+            Scene,          ///< Render settings, cameras, lights, environment map, scene graph and metadata.
+            Meshes,         ///< Meshes, curves and custom primitives.
+            Materials,      ///< Materials.
+            Grids,          ///< Volume grids and grid volumes.
+            Animations,     ///< Animations.
+
+            Count
+        };
+
+        /** Flags specifying a set of scene cache sections.
+        */
+        enum class SectionFlags : uint32_t
+        {
+            None        = 0x0,
+            Scene       = 0x1,
+            Meshes      = 0x2,
+            Materials   = 0x4,
+            Grids       = 0x8,
+            Animations  = 0x10,
+
+            All         = 0x1f,
+        };
+
+        /** File the scene data was created from.
+            Stale scene, material and grid sections are refreshed when reading the cache. Files restricted to these
+            sections (environment maps, material textures and grid files) are reloaded without re-importing the scene.
+            All other files affect all sections.
+        */
+        struct Dependency
+        {
+            std::string path;                           ///< Full path of the file.
+            SectionFlags sections = SectionFlags::All;  ///< Sections affected by changes to the file.
+        };
+
+        using DependencyList = std::vector<Dependency>;
+
         /** Check if there is a valid scene cache for a given cache key.
+            The cache is valid if all sections are up-to-date or can be refreshed without re-importing the scene.
             \param[in] key Cache key.
             \return Returns true if a valid cache exists.
         */
@@ -52,23 +106,51 @@ namespace Falcor
         /** Write a scene cache.
             \param[in] sceneData Scene data.
             \param[in] key Cache key.
+            \param[in] dependencies Files the scene data was created from.
         */
-        static void writeCache(const Scene::SceneData& sceneData, const Key& key);
+        static void writeCache(const Scene::SceneData& sceneData, const Key& key, const DependencyList& dependencies);
 
         /** Read a scene cache.
+            Stale scene, material and grid sections are refreshed and written back to the cache.
             \param[in] key Cache key.
+            \param[in] useSrgb Load color textures in sRGB space (see SceneBuilder::Flags::AssumeLinearSpaceTextures).
+            \param[in] compressTextures Compress textures (see SceneBuilder::Flags::CompressTextures).
             \return Returns the loaded scene data.
         */
-        static Scene::SceneData readCache(const Key& key);
+        static Scene::SceneData readCache(const Key& key, bool useSrgb, bool compressTextures);
 
     private:
         class OutputStream;
         class InputStream;
+        struct Index;
+        struct SectionData;
 
         static std::filesystem::path getCachePath(const Key& key);
+        static std::filesystem::path getSectionPath(const Key& sectionKey);
+
+        static bool readIndex(const Key& key, Index& index);
+        static void writeIndex(const Key& key, const Index& index);
+        static SectionFlags updateDependencies(Index& index, std::set<std::string>& stalePaths);
+        static Key computeSectionKey(const Key& key, const Index& index, Section section);
 
-        static void writeSceneData(OutputStream& stream, const Scene::SceneData& sceneData);
-        static Scene::SceneData readSceneData(InputStream& stream);
+        static void writeSection(const Key& sectionKey, const std::function<void(OutputStream&)>& writeFunc);
+        static SectionData loadSection(const Key& sectionKey);
+        static void readSection(const SectionData& section, const std::function<void(InputStream&)>& readFunc);
+
+        static void writeSceneSection(OutputStream& stream, const Scene::SceneData& sceneData);
+        static void readSceneSection(InputStream& stream, Scene::SceneData& sceneData);
+
+        static void writeMeshSection(OutputStream& stream, const Scene::SceneData& sceneData);
+        static void readMeshSection(InputStream& stream, Scene::SceneData& sceneData);
+
+        static void writeMaterialSection(OutputStream& stream, const Scene::SceneData& sceneData);
+        static void readMaterialSection(InputStream& stream, Scene::SceneData& sceneData, MaterialTextureLoader& materialTextureLoader);
+
+        static void writeGridSection(OutputStream& stream, const Scene::SceneData& sceneData);
+        static void readGridSection(InputStream& stream, Scene::SceneData& sceneData, const std::set<std::string>& refreshPaths);
+
+        static void writeAnimationSection(OutputStream& stream, const Scene::SceneData& sceneData);
+        static void readAnimationSection(InputStream& stream, Scene::SceneData& sceneData);
 
         static void writeMetadata(OutputStream& stream, const Scene::Metadata& metadata);
         static Scene::Metadata readMetadata(InputStream& stream);
@@ -85,10 +167,13 @@ namespace Falcor
         static void readBasicMaterial(InputStream& stream, MaterialTextureLoader& materialTextureLoader, const BasicMaterial::SharedPtr& pMaterial);
 
         static void writeGridVolume(OutputStream& stream, const GridVolume::SharedPtr& pVolume, const std::vector<Grid::SharedPtr>& grids);
-        static GridVolume::SharedPtr readGridVolume(InputStream& stream, const std::vector<Grid::SharedPtr>& grids);
+        static GridVolume::SharedPtr readGridVolume(InputStream& stream, const std::vector<Grid::SharedPtr>& grids, const std::set<std::string>& refreshPaths);
+
+        static void writeStreamingGridSequence(OutputStream& stream, const StreamingGridSequence::SharedPtr& pSequence);
+        static StreamingGridSequence::SharedPtr readStreamingGridSequence(InputStream& stream, const std::set<std::string>& refreshPaths);
 
         static void writeGrid(OutputStream& stream, const Grid::SharedPtr& pGrid);
-        static Grid::SharedPtr readGrid(InputStream& stream);
+        static Grid::SharedPtr readGrid(InputStream& stream, const std::set<std::string>& refreshPaths);
 
         static void writeEnvMap(OutputStream& stream, const EnvMap::SharedPtr& pEnvMap);
         static EnvMap::SharedPtr readEnvMap(InputStream& stream);
@@ -102,4 +187,6 @@ namespace Falcor
         static void writeMarker(OutputStream& stream, const std::string& id);
         static void readMarker(InputStream& stream, const std::string& id);
     };
+
+    enum_class_operators(SceneCache::SectionFlags);
 }
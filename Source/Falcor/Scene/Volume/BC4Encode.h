@@ -26,6 +26,7 @@
  # OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
  **************************************************************************/
 #pragma once
+#include <emmintrin.h>
 
 // this file exposes a single function, CompressAlphaDxt5, which encodes a 4x4 set of uint8 alpha values into a single 64 bit BC4 encoded block
 static void CompressAlphaDxt5(uint8_t* tile, void* block);
@@ -61,35 +62,36 @@ static void FixRange(int& min, int& max, int steps)
 
 static int FitCodes(uint8_t const* tile, uint8_t const* codes, uint8_t* indices)
 {
-    // fit each alpha value to the codebook
-    int err = 0;
-    for (int i = 0; i < 16; ++i)
+    // fit all 16 alpha values to the codebook at once (SSE2 version of the libsquish loop)
+    // the absolute difference is minimized instead of the squared one, which selects the same codes
+    const __m128i values = _mm_loadu_si128(reinterpret_cast<const __m128i*>(tile));
+    __m128i least = _mm_set1_epi8(-1);
+    __m128i index = _mm_setzero_si128();
+    for (int j = 0; j < 8; ++j)
     {
-        // find the least error and corresponding index
-        int value = (int)(tile[i]);
-        int least = INT_MAX;
-        int index = 0;
-        for (int j = 0; j < 8; ++j)
-        {
-            // get the squared error from this code
-            int dist = (int)value - (int)codes[j];
-            dist *= dist;
-
-            // compare with the best so far
-            if (dist < least)
-            {
-                least = dist;
-                index = j;
-            }
-        }
-
-        // save this index and accumulate the error
-        indices[i] = (uint8_t)index;
-        err += least;
+        // get the error from this code
+        const __m128i code = _mm_set1_epi8((char)codes[j]);
+        const __m128i dist = _mm_or_si128(_mm_subs_epu8(values, code), _mm_subs_epu8(code, values));
+
+        // compare with the best so far, keeping the first code on ties
+        const __m128i newLeast = _mm_min_epu8(least, dist);
+        const __m128i better = _mm_andnot_si128(_mm_cmpeq_epi8(newLeast, least), _mm_set1_epi8(-1));
+        index = _mm_or_si128(_mm_and_si128(better, _mm_set1_epi8((char)j)), _mm_andnot_si128(better, index));
+        least = newLeast;
     }
 
+    // save the indices
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(indices), index);
+
+    // accumulate the squared error
+    const __m128i lo = _mm_unpacklo_epi8(least, _mm_setzero_si128());
+    const __m128i hi = _mm_unpackhi_epi8(least, _mm_setzero_si128());
+    __m128i err = _mm_add_epi32(_mm_madd_epi16(lo, lo), _mm_madd_epi16(hi, hi));
+    err = _mm_add_epi32(err, _mm_shuffle_epi32(err, _MM_SHUFFLE(1, 0, 3, 2)));
+    err = _mm_add_epi32(err, _mm_shuffle_epi32(err, _MM_SHUFFLE(2, 3, 0, 1)));
+
     // return the total error
-    return err;
+    return _mm_cvtsi128_si32(err);
 }
 
 static void WriteAlphaBlock(int alpha0, int alpha1, uint8_t const* indices, void* block)
@@ -31,8 +31,69 @@ namespace Falcor
 {
     struct BrickedGrid
     {
+        static const uint32_t kMaxAtlasPages = 4;                   ///< Maximum number of atlas pages. Must match kGridMaxAtlasPages in Grid.slang.
+        static const uint32_t kMaxAtlasPageDim = 256;               ///< Maximum size of an atlas page in bricks, limited by the 8-bit brick coordinates in the indirection texture.
+        static const uint64_t kMaxAtlasPageBytes = 1ull << 30;      ///< Maximum size of an atlas page in bytes.
+
         Texture::SharedPtr range;
-        Texture::SharedPtr indirection;
-        Texture::SharedPtr atlas;
+        Texture::SharedPtr indirection;                             ///< Brick coordinates in xyz and the atlas page in w.
+        std::vector<Texture::SharedPtr> atlasPages;
+    };
+
+    /** Bricked grid in host memory, as produced by the grid converters before it is uploaded to the GPU.
+    */
+    struct BrickedGridData
+    {
+        struct AtlasPage
+        {
+            uint3 dim = uint3(0);                           ///< Size of the page in voxels.
+            std::vector<uint8_t> data;
+        };
+
+        struct Stats
+        {
+            uint32_t brickCount = 0;                        ///< Number of leaves with a non-constant range, which need a brick in the atlas.
+            uint32_t uniqueBrickCount = 0;                  ///< Number of distinct bricks after identical bricks are merged.
+            uint32_t droppedBrickCount = 0;                 ///< Number of distinct bricks that did not fit into the atlas and were replaced by their majorant.
+            uint64_t atlasCapacity = 0;                     ///< Number of bricks the atlas pages can hold.
+
+            /** Get the fraction of the atlas that is in use.
+            */
+            float getOccupancy() const { return atlasCapacity > 0 ? float(uniqueBrickCount - droppedBrickCount) / atlasCapacity : 0.f; }
+
+            /** Get the ratio of bricks to distinct bricks.
+            */
+            float getDedupRatio() const { return uniqueBrickCount > 0 ? float(brickCount) / uniqueBrickCount : 1.f; }
+        };
+
+        uint3 brickDim = uint3(0);                          ///< Size of the range and indirection textures in bricks.
+        ResourceFormat atlasFormat = ResourceFormat::Unknown;
+        std::vector<uint32_t> range;                        ///< Range texture data, including the 4 mip levels.
+        std::vector<uint32_t> indirection;                  ///< Indirection texture data.
+        std::vector<AtlasPage> atlasPages;                  ///< Atlas texture data of each page.
+        Stats stats;
+
+        /** Get the size of the host data in bytes.
+        */
+        uint64_t getSizeInBytes() const
+        {
+            uint64_t size = range.size() * sizeof(uint32_t) + indirection.size() * sizeof(uint32_t);
+            for (const auto& page : atlasPages) size += page.data.size();
+            return size;
+        }
+
+        /** Create the GPU textures. Must be called from the main thread.
+        */
+        BrickedGrid createTextures() const
+        {
+            BrickedGrid bricks;
+            bricks.range = Texture::create3D(brickDim.x, brickDim.y, brickDim.z, ResourceFormat::RG16Float, 4, range.data(), ResourceBindFlags::ShaderResource, false);
+            bricks.indirection = Texture::create3D(brickDim.x, brickDim.y, brickDim.z, ResourceFormat::RGBA8Uint, 1, indirection.data(), ResourceBindFlags::ShaderResource, false);
+            for (const auto& page : atlasPages)
+            {
+                bricks.atlasPages.push_back(Texture::create3D(page.dim.x, page.dim.y, page.dim.z, atlasFormat, 1, page.data.data(), ResourceBindFlags::ShaderResource, false));
+            }
+            return bricks;
+        }
     };
 }
@@ -36,6 +36,13 @@
 #pragma warning(default:4146 4244 4267 4275 4996)
 #include <glm/gtc/type_ptr.hpp>
 #include "GridConverter.h"
+#include "Utils/CryptoUtils.h"
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <mutex>
+#include <sstream>
+#include <thread>
 
 
 namespace Falcor
@@ -56,43 +63,214 @@ namespace Falcor
         {
             return int3(c[0], c[1], c[2]);
         }
+
+        using NanoVDBGridConverter = NanoVDBConverterBC4;
+
+        const std::string kBrickCacheDirectory = "NVIDIA/Falcor/GridCache";
+        const uint32_t kBrickCacheVersion = 2; // Increment when the brick conversion changes to invalidate cached bricks.
+        const char kBrickCacheMagic[4] = { 'F', 'B', 'R', 'K' };
+        const uint64_t kBrickCacheMaxSize = 4ull << 30; // Least recently used files are removed when the cache grows larger than this.
+
+        struct BrickCacheHeader
+        {
+            char magic[4];
+            uint32_t version;
+            SHA1::MD key;
+            uint3 brickDim;
+            ResourceFormat atlasFormat;
+            uint64_t rangeCount;
+            uint64_t indirectionCount;
+            uint64_t atlasPageCount;
+            BrickedGridData::Stats stats;
+        };
+
+        struct BrickCachePageHeader
+        {
+            uint3 dim;
+            uint64_t size;
+        };
+
+        bool readBrickCache(const std::filesystem::path& cachePath, const SHA1::MD& key, BrickedGridData& data)
+        {
+            std::error_code ec;
+            const uint64_t fileSize = std::filesystem::file_size(cachePath, ec);
+            if (ec) return false;
+
+            try
+            {
+                std::ifstream fs(cachePath, std::ios_base::binary);
+                if (!fs) return false;
+
+                BrickCacheHeader header;
+                fs.read(reinterpret_cast<char*>(&header), sizeof(header));
+                if (!fs || std::memcmp(header.magic, kBrickCacheMagic, sizeof(kBrickCacheMagic)) != 0 || header.version != kBrickCacheVersion || header.key != key) return false;
+
+                // Validate all sizes against the file size before allocating, so that a truncated or corrupt file is rejected.
+                uint64_t remaining = fileSize - sizeof(header);
+                if (header.atlasPageCount > BrickedGrid::kMaxAtlasPages) return false;
+                if (header.rangeCount > remaining / sizeof(uint32_t)) return false;
+                remaining -= header.rangeCount * sizeof(uint32_t);
+                if (header.indirectionCount > remaining / sizeof(uint32_t)) return false;
+                remaining -= header.indirectionCount * sizeof(uint32_t);
+
+                data.brickDim = header.brickDim;
+                data.atlasFormat = header.atlasFormat;
+                data.stats = header.stats;
+                data.range.resize(header.rangeCount);
+                data.indirection.resize(header.indirectionCount);
+                fs.read(reinterpret_cast<char*>(data.range.data()), data.range.size() * sizeof(uint32_t));
+                fs.read(reinterpret_cast<char*>(data.indirection.data()), data.indirection.size() * sizeof(uint32_t));
+                data.atlasPages.resize(header.atlasPageCount);
+                for (auto& page : data.atlasPages)
+                {
+                    BrickCachePageHeader pageHeader;
+                    fs.read(reinterpret_cast<char*>(&pageHeader), sizeof(pageHeader));
+                    if (!fs || remaining < sizeof(pageHeader) || pageHeader.size > remaining - sizeof(pageHeader)) break;
+                    remaining -= sizeof(pageHeader) + pageHeader.size;
+                    page.dim = pageHeader.dim;
+                    page.data.resize(pageHeader.size);
+                    fs.read(reinterpret_cast<char*>(page.data.data()), page.data.size());
+                }
+                if (fs && remaining == 0)
+                {
+                    // Mark the file as recently used for the cache eviction.
+                    std::filesystem::last_write_time(cachePath, std::filesystem::file_time_type::clock::now(), ec);
+                    return true;
+                }
+            }
+            catch (const std::exception& e)
+            {
+                logWarning("Failed to read grid cache file '" + cachePath.string() + "': " + e.what());
+            }
+
+            data = {};
+            return false;
+        }
+
+        /** Remove the least recently used grid cache files until the cache fits into kBrickCacheMaxSize.
+        */
+        void trimBrickCache(const std::filesystem::path& cacheDirectory)
+        {
+            // Grids of a streamed sequence are written concurrently. Serialize trimming to not remove the same files twice.
+            static std::mutex sMutex;
+            std::lock_guard<std::mutex> lock(sMutex);
+
+            struct CacheFile
+            {
+                std::filesystem::path path;
+                std::filesystem::file_time_type lastUsed;
+                uint64_t size;
+            };
+
+            std::vector<CacheFile> files;
+            uint64_t totalSize = 0;
+            std::error_code ec;
+            for (auto it = std::filesystem::directory_iterator(cacheDirectory, ec); !ec && it != std::filesystem::directory_iterator(); it.increment(ec))
+            {
+                std::error_code fileEc;
+                if (!it->is_regular_file(fileEc) || it->path().extension() != ".bricks") continue;
+                CacheFile file = { it->path(), it->last_write_time(fileEc), it->file_size(fileEc) };
+                if (fileEc) continue;
+                totalSize += file.size;
+                files.push_back(file);
+            }
+            if (totalSize <= kBrickCacheMaxSize) return;
+
+            std::sort(files.begin(), files.end(), [](const CacheFile& a, const CacheFile& b) { return a.lastUsed < b.lastUsed; });
+            for (const auto& file : files)
+            {
+                if (totalSize <= kBrickCacheMaxSize) break;
+                if (std::filesystem::remove(file.path, ec)) totalSize -= file.size;
+            }
+        }
+
+        void writeBrickCache(const std::filesystem::path& cachePath, const SHA1::MD& key, const BrickedGridData& data)
+        {
+            BrickCacheHeader header = {};
+            std::memcpy(header.magic, kBrickCacheMagic, sizeof(kBrickCacheMagic));
+            header.version = kBrickCacheVersion;
+            header.key = key;
+            header.brickDim = data.brickDim;
+            header.atlasFormat = data.atlasFormat;
+            header.rangeCount = data.range.size();
+            header.indirectionCount = data.indirection.size();
+            header.atlasPageCount = data.atlasPages.size();
+            header.stats = data.stats;
+
+            // Write to a temporary file first so that readers never see a partially written file.
+            // Grids of a streamed sequence are converted concurrently, so the temporary file is unique per thread.
+            std::filesystem::path tmpPath = cachePath;
+            tmpPath += "." + std::to_string(std::hash<std::thread::id>()(std::this_thread::get_id())) + ".tmp";
+            bool written = false;
+            std::error_code ec;
+            std::filesystem::create_directories(cachePath.parent_path(), ec);
+            {
+                std::ofstream fs(tmpPath, std::ios_base::binary | std::ios_base::trunc);
+                fs.write(reinterpret_cast<const char*>(&header), sizeof(header));
+                fs.write(reinterpret_cast<const char*>(data.range.data()), data.range.size() * sizeof(uint32_t));
+                fs.write(reinterpret_cast<const char*>(data.indirection.data()), data.indirection.size() * sizeof(uint32_t));
+                for (const auto& page : data.atlasPages)
+                {
+                    BrickCachePageHeader pageHeader = { page.dim, page.data.size() };
+                    fs.write(reinterpret_cast<const char*>(&pageHeader), sizeof(pageHeader));
+                    fs.write(reinterpret_cast<const char*>(page.data.data()), page.data.size());
+                }
+                written = fs.good();
+            }
+
+            if (written) std::filesystem::rename(tmpPath, cachePath, ec);
+            if (!written || ec)
+            {
+                logWarning("Failed to write grid cache file '" + cachePath.string() + "'");
+                std::filesystem::remove(tmpPath, ec);
+                return;
+            }
+
+            trimBrickCache(cachePath.parent_path());
+        }
+
+        /** Convert a grid to bricks, or read the bricks from the grid cache if the same grid was converted before.
+            The cache key is the hash of the NanoVDB grid buffer, so it is independent of where the grid was loaded from.
+            \param[in] handle NanoVDB grid handle.
+            \param[in] useCache Read and write the grid cache. Procedural grids are cheap to convert and are not cached.
+        */
+        BrickedGridData convertToBricks(const nanovdb::GridHandle<nanovdb::HostBuffer>& handle, bool useCache)
+        {
+            if (!useCache) return NanoVDBGridConverter(handle.grid<float>()).convertToHost();
+
+            SHA1 sha1;
+            sha1.update(handle.data(), handle.size());
+            sha1.update(&kBrickCacheVersion, sizeof(kBrickCacheVersion));
+            const ResourceFormat atlasFormat = ResourceFormat::BC4Unorm;
+            sha1.update(&atlasFormat, sizeof(atlasFormat));
+            const SHA1::MD key = sha1.final();
+
+            std::filesystem::path cachePath = std::filesystem::path(getAppDataDirectory()) / kBrickCacheDirectory / (SHA1::toHexString(key) + ".bricks");
+
+            BrickedGridData data;
+            if (readBrickCache(cachePath, key, data)) return data;
+
+            data = NanoVDBGridConverter(handle.grid<float>()).convertToHost();
+            writeBrickCache(cachePath, key, data);
+            return data;
+        }
     }
 
     Grid::SharedPtr Grid::createSphere(float radius, float voxelSize, float blendRange)
     {
         auto handle = nanovdb::createFogVolumeSphere(radius, nanovdb::Vec3R(0.0), voxelSize, blendRange);
-        return SharedPtr(new Grid(std::move(handle)));
+        return SharedPtr(new Grid(std::move(handle), true, false));
     }
 
     Grid::SharedPtr Grid::createBox(float width, float height, float depth, float voxelSize, float blendRange)
     {
         auto handle = nanovdb::createFogVolumeBox(width, height, depth, nanovdb::Vec3R(0.0), voxelSize, blendRange);
-        return SharedPtr(new Grid(std::move(handle)));
+        return SharedPtr(new Grid(std::move(handle), true, false));
     }
 
     Grid::SharedPtr Grid::createFromFile(const std::string& filename, const std::string& gridname)
     {
-        std::string fullpath;
-        if (!findFileInDataDirectories(filename, fullpath))
-        {
-            logWarning("Error when loading grid. Can't find grid file '" + filename + "'");
-            return nullptr;
-        }
-
-        auto ext = getExtensionFromFile(fullpath);
-        if (ext == "nvdb")
-        {
-            return createFromNanoVDBFile(fullpath, gridname);
-        }
-        else if (ext == "vdb")
-        {
-            return createFromOpenVDBFile(fullpath, gridname);
-        }
-        else
-        {
-            logWarning("Error when loading grid. Unsupported grid file '" + filename + "'");
-            return nullptr;
-        }
+        return loadFromFile(filename, gridname, true);
     }
 
     void Grid::renderUI(Gui::Widgets& widget)
@@ -103,16 +281,24 @@ namespace Falcor
             << "Maximum index: " << to_string(getMaxIndex()) << std::endl
             << "Minimum value: " << getMinValue() << std::endl
             << "Maximum value: " << getMaxValue() << std::endl
-            << "Memory: " << formatByteSize(getGridSizeInBytes()) << std::endl;
+            << "Memory: " << formatByteSize(getGridSizeInBytes()) << std::endl
+            << "Bricks: " << mBrickStats.brickCount << " (" << mBrickStats.uniqueBrickCount << " unique, " << std::fixed << std::setprecision(2) << mBrickStats.getDedupRatio() << "x dedup)" << std::endl
+            << "Atlas: " << mBrickedGrid.atlasPages.size() << " pages, " << std::setprecision(1) << mBrickStats.getOccupancy() * 100.f << "% occupied" << std::endl;
+        if (mBrickStats.droppedBrickCount > 0) oss << "Dropped bricks: " << mBrickStats.droppedBrickCount << std::endl;
         widget.text(oss.str());
     }
 
     void Grid::setShaderData(const ShaderVar& var)
     {
+        assert(mpBuffer);
         var["buf"] = mpBuffer;
         var["rangeTex"] = mBrickedGrid.range;
         var["indirectionTex"] = mBrickedGrid.indirection;
-        var["atlasTex"] = mBrickedGrid.atlas;
+        auto atlasVar = var["atlasTex"];
+        for (uint32_t page = 0; page < BrickedGrid::kMaxAtlasPages; ++page)
+        {
+            atlasVar[page] = page < mBrickedGrid.atlasPages.size() ? mBrickedGrid.atlasPages[page] : nullptr;
+        }
         var["minIndex"] = getMinIndex();
         var["minValue"] = getMinValue();
         var["maxIndex"] = getMaxIndex();
@@ -147,12 +333,17 @@ namespace Falcor
     uint64_t Grid::getGridSizeInBytes() const
     {
         const uint64_t nvdb = mpBuffer ? mpBuffer->getSize() : (uint64_t)0;
-        const uint64_t bricks = (mBrickedGrid.range ? mBrickedGrid.range->getTextureSizeInBytes() : (uint64_t)0) +
-            (mBrickedGrid.indirection ? mBrickedGrid.indirection->getTextureSizeInBytes() : (uint64_t)0) +
-            (mBrickedGrid.atlas ? mBrickedGrid.atlas->getTextureSizeInBytes() : (uint64_t)0);
+        uint64_t bricks = (mBrickedGrid.range ? mBrickedGrid.range->getTextureSizeInBytes() : (uint64_t)0) +
+            (mBrickedGrid.indirection ? mBrickedGrid.indirection->getTextureSizeInBytes() : (uint64_t)0);
+        for (const auto& pPage : mBrickedGrid.atlasPages) bricks += pPage->getTextureSizeInBytes();
         return nvdb + bricks;
     }
 
+    uint64_t Grid::getHostSizeInBytes() const
+    {
+        return mGridHandle.size() + mBrickedGridData.getSizeInBytes();
+    }
+
     AABB Grid::getWorldBounds() const
     {
         auto bounds = mpFloatGrid->worldBBox();
@@ -185,7 +376,7 @@ namespace Falcor
         return glm::translate(float4x4(invAffine), -translation);
     }
 
-    Grid::Grid(nanovdb::GridHandle<nanovdb::HostBuffer> gridHandle)
+    Grid::Grid(nanovdb::GridHandle<nanovdb::HostBuffer> gridHandle, bool createResources, bool useBrickCache)
         : mGridHandle(std::move(gridHandle))
         , mpFloatGrid(mGridHandle.grid<float>())
         , mAccessor(mpFloatGrid->getAccessor())
@@ -195,6 +386,16 @@ namespace Falcor
             nanovdb::gridStats(*mpFloatGrid);
         }
 
+        mBrickedGridData = convertToBricks(mGridHandle, useBrickCache);
+        mBrickStats = mBrickedGridData.stats;
+
+        if (createResources) this->createResources();
+    }
+
+    void Grid::createResources()
+    {
+        if (mpBuffer) return;
+
         // Keep both NanoVDB and brick textures resident in GPU memory for simplicity for now (~15% increased footprint).
         mpBuffer = Buffer::createStructured(
             sizeof(uint32_t),
@@ -203,42 +404,78 @@ namespace Falcor
             Buffer::CpuAccess::None,
             mGridHandle.data()
         );
-        using NanoVDBGridConverter = NanoVDBConverterBC4;
-        mBrickedGrid = NanoVDBGridConverter(mpFloatGrid).convert();
+        mBrickedGrid = mBrickedGridData.createTextures();
+        mBrickedGridData = {};
+    }
+
+    Grid::SharedPtr Grid::loadFromFile(const std::string& filename, const std::string& gridname, bool createResources)
+    {
+        std::string fullpath;
+        if (!findFileInDataDirectories(filename, fullpath))
+        {
+            logWarning("Error when loading grid. Can't find grid file '" + filename + "'");
+            return nullptr;
+        }
+
+        auto handle = readGridHandle(fullpath, gridname);
+        if (!handle) return nullptr;
+
+        auto pGrid = SharedPtr(new Grid(std::move(handle), createResources));
+        pGrid->mSourceFilename = fullpath;
+        pGrid->mGridname = gridname;
+        return pGrid;
     }
 
-    Grid::SharedPtr Grid::createFromNanoVDBFile(const std::string& path, const std::string& gridname)
+    nanovdb::GridHandle<nanovdb::HostBuffer> Grid::readGridHandle(const std::string& path, const std::string& gridname)
+    {
+        auto ext = getExtensionFromFile(path);
+        if (ext == "nvdb")
+        {
+            return readNanoVDBFile(path, gridname);
+        }
+        else if (ext == "vdb")
+        {
+            return readOpenVDBFile(path, gridname);
+        }
+        else
+        {
+            logWarning("Error when loading grid. Unsupported grid file '" + path + "'");
+            return {};
+        }
+    }
+
+    nanovdb::GridHandle<nanovdb::HostBuffer> Grid::readNanoVDBFile(const std::string& path, const std::string& gridname)
     {
         if (!nanovdb::io::hasGrid(path, gridname))
         {
             logWarning("Error when loading grid. Can't find grid '" + gridname + "' in '" + path + "'");
-            return nullptr;
+            return {};
         }
 
         auto handle = nanovdb::io::readGrid(path, gridname);
         if (!handle)
         {
             logWarning("Error when loading grid.");
-            return nullptr;
+            return {};
         }
 
         auto floatGrid = handle.grid<float>();
         if (!floatGrid || floatGrid->gridType() != nanovdb::GridType::Float)
         {
             logWarning("Error when loading grid. Grid '" + gridname + "' in '" + path + "' is not of type float");
-            return nullptr;
+            return {};
         }
 
         if (floatGrid->isEmpty())
         {
             logWarning("Grid '" + gridname + "' in '" + path + "' is empty");
-            return nullptr;
+            return {};
         }
 
-        return SharedPtr(new Grid(std::move(handle)));
+        return handle;
     }
 
-    Grid::SharedPtr Grid::createFromOpenVDBFile(const std::string& path, const std::string& gridname)
+    nanovdb::GridHandle<nanovdb::HostBuffer> Grid::readOpenVDBFile(const std::string& path, const std::string& gridname)
     {
         openvdb::initialize();
 
@@ -260,25 +497,23 @@ namespace Falcor
         if (!baseGrid)
         {
             logWarning("Error when loading grid. Can't find grid '" + gridname + "' in '" + path + "'");
-            return nullptr;
+            return {};
         }
 
         if (!baseGrid->isType<openvdb::FloatGrid>())
         {
             logWarning("Error when loading grid. Grid '" + gridname + "' in '" + path + "' is not of type float");
-            return nullptr;
+            return {};
         }
 
         if (baseGrid->empty())
         {
             logWarning("Grid '" + gridname + "' in '" + path + "' is empty");
-            return nullptr;
+            return {};
         }
 
         openvdb::FloatGrid::Ptr floatGrid = openvdb::gridPtrCast<openvdb::FloatGrid>(baseGrid);
-        auto handle = nanovdb::openToNanoVDB(floatGrid);
-
-        return SharedPtr(new Grid(std::move(handle)));
+        return nanovdb::openToNanoVDB(floatGrid);
     }
 
 
@@ -290,6 +525,17 @@ namespace Falcor
         grid.def_property_readonly("maxIndex", &Grid::getMaxIndex);
         grid.def_property_readonly("minValue", &Grid::getMinValue);
         grid.def_property_readonly("maxValue", &Grid::getMaxValue);
+        grid.def_property_readonly("brickStats", [](const Grid& grid) {
+            const auto& stats = grid.getBrickStats();
+            pybind11::dict d;
+            d["brickCount"] = stats.brickCount;
+            d["uniqueBrickCount"] = stats.uniqueBrickCount;
+            d["droppedBrickCount"] = stats.droppedBrickCount;
+            d["atlasCapacity"] = stats.atlasCapacity;
+            d["occupancy"] = stats.getOccupancy();
+            d["dedupRatio"] = stats.getDedupRatio();
+            return d;
+        });
 
         grid.def("getValue", &Grid::getValue, "ijk"_a);
 
@@ -71,6 +71,11 @@ namespace Falcor
         */
         void renderUI(Gui::Widgets& widget);
 
+        /** Get the full path of the file the grid was loaded from.
+            \return Returns the path, or an empty string if the grid was not loaded from a file.
+        */
+        const std::string& getSourceFilename() const { return mSourceFilename; }
+
         /** Bind the grid to a given shader var.
             \param[in] var The shader variable to set the data into.
         */
@@ -100,6 +105,14 @@ namespace Falcor
         */
         uint64_t getGridSizeInBytes() const;
 
+        /** Get the size of the grid in bytes as allocated in host memory.
+        */
+        uint64_t getHostSizeInBytes() const;
+
+        /** Get statistics of the brick atlas, such as the atlas occupancy and the ratio of merged identical bricks.
+        */
+        const BrickedGridData::Stats& getBrickStats() const { return mBrickStats; }
+
         /** Get the grid's bounds in world space.
         */
         AABB getWorldBounds() const;
@@ -123,10 +136,33 @@ namespace Falcor
         glm::mat4 getInvTransform() const;
 
     private:
-        Grid(nanovdb::GridHandle<nanovdb::HostBuffer> gridHandle);
+        /** Create a grid from a NanoVDB grid handle.
+            \param[in] gridHandle NanoVDB grid handle.
+            \param[in] createResources Create the GPU resources. If false, the grid is converted to bricks in host memory only,
+                        which allows creating grids on worker threads. createResources() needs to be called on the main thread before use.
+            \param[in] useBrickCache Read and write converted bricks from the grid cache on disk.
+        */
+        Grid(nanovdb::GridHandle<nanovdb::HostBuffer> gridHandle, bool createResources = true, bool useBrickCache = true);
+
+        /** Create the GPU resources, if not done already. Must be called from the main thread.
+        */
+        void createResources();
+
+        /** Create a grid from a file. See createFromFile() and the constructor.
+        */
+        static SharedPtr loadFromFile(const std::string& filename, const std::string& gridname, bool createResources);
+
+        /** Read a float grid from a file into a NanoVDB grid handle.
+            \param[in] path Full path of the file.
+            \param[in] gridname Name of the grid to load.
+            \return The grid handle, or an empty handle if the grid failed to load.
+        */
+        static nanovdb::GridHandle<nanovdb::HostBuffer> readGridHandle(const std::string& path, const std::string& gridname);
+        static nanovdb::GridHandle<nanovdb::HostBuffer> readNanoVDBFile(const std::string& path, const std::string& gridname);
+        static nanovdb::GridHandle<nanovdb::HostBuffer> readOpenVDBFile(const std::string& path, const std::string& gridname);
 
-        static SharedPtr createFromNanoVDBFile(const std::string& path, const std::string& gridname);
-        static SharedPtr createFromOpenVDBFile(const std::string& path, const std::string& gridname);
+        std::string mSourceFilename;
+        std::string mGridname;
 
         // Host data.
         nanovdb::GridHandle<nanovdb::HostBuffer> mGridHandle;
@@ -135,7 +171,10 @@ namespace Falcor
         // Device data.
         Buffer::SharedPtr mpBuffer;
         BrickedGrid mBrickedGrid;
+        BrickedGridData mBrickedGridData;   ///< Host copy of the bricks until the GPU resources are created.
+        BrickedGridData::Stats mBrickStats;
 
         friend class SceneCache;
+        friend class StreamingGridSequence;
     };
 }
@@ -26,12 +26,13 @@
  # OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
  **************************************************************************/
 #pragma once
-#include <execution>
 #pragma warning(disable:4244 4267)
 #include <nanovdb/NanoVDB.h>
 #pragma warning(default:4244 4267)
+#include <emmintrin.h>
+#include <string_view>
+#include <unordered_map>
 #include "BC4Encode.h"
-#include "Utils/NumericRange.h"
 #include "BrickedGrid.h"
 
 namespace Falcor
@@ -48,18 +49,49 @@ namespace Falcor
         NanoVDBToBricksConverter(const nanovdb::FloatGrid* grid);
         NanoVDBToBricksConverter(const NanoVDBToBricksConverter& rhs) = delete;
         
+        /** Convert the grid to bricks and upload them to the GPU.
+        */
         BrickedGrid convert();
 
+        /** Convert the grid to bricks in host memory. Can be called from any thread.
+            The converter can only be used once, as the data is moved into the result.
+        */
+        BrickedGridData convertToHost();
+
     private:
         const static uint kBrickSize = 8; // Must be 8, to match both NanoVDB leaf size.
         const static int kBC4Compress = kBitsPerTexel == 4;
 
+        // Layout of an encoded brick: kBrickSize slices of kBrickRows rows. A row is a row of texels, or a row of 4x4 blocks with BC4.
+        const static uint kBrickRows = kBC4Compress ? kBrickSize / 4 : kBrickSize;
+        const static uint kBrickRowBytes = kBC4Compress ? (kBrickSize / 4) * sizeof(uint64_t) : kBrickSize * sizeof(TexelType);
+        const static uint kBrickBytes = kBrickSize * kBrickRows * kBrickRowBytes;
+
+        /** Non-empty bricks of a slice of leaves, in the order they are found.
+        */
+        struct Slice
+        {
+            std::vector<uint8_t> bricks;    ///< Encoded bricks, kBrickBytes each.
+            std::vector<size_t> hashes;     ///< Hash of each encoded brick.
+            uint32_t firstBrick = 0;        ///< Index of the first brick of the slice among all bricks.
+        };
+
         void convertSlice(int z);
+        void deduplicateBricks();
+        void allocateAtlasPages();
+        void placeSlice(int z);
         void computeMip(int mip);
+        void encodeBrick(const float* data, float minorant, float majorant, uint8_t* dst);
 
-        inline uint3 getAtlasSizeBricks() const { return mAtlasSizeBricks; }
-        inline uint3 getAtlasSizePixels() const { return mAtlasSizeBricks * kBrickSize; }
-        inline uint getAtlasMaxBrick() const { return mAtlasSizeBricks.x * mAtlasSizeBricks.y * mAtlasSizeBricks.z; }
+        /** Choose the size of an atlas page in bricks. The first 2 dimensions are powers of 2.
+        */
+        uint3 getAtlasPageSizeBricks(uint32_t brickCount) const
+        {
+            uint approxdim = std::min(1u << uint(log2f((float)brickCount + 1.f) / 3.f), BrickedGrid::kMaxAtlasPageDim);
+            uint lastdim = (brickCount + approxdim * approxdim - 1) / (approxdim * approxdim);
+            if (lastdim > mMaxAtlasPageSizeBricks.z) return uint3(mMaxAtlasPageSizeBricks.x, mMaxAtlasPageSizeBricks.y, (brickCount + mMaxAtlasPageSizeBricks.x * mMaxAtlasPageSizeBricks.y - 1) / (mMaxAtlasPageSizeBricks.x * mMaxAtlasPageSizeBricks.y));
+            return uint3(approxdim, approxdim, std::max(lastdim, 1u));
+        }
 
         inline ResourceFormat getAtlasFormat() {
             switch (kBitsPerTexel) {
@@ -81,27 +113,69 @@ namespace Falcor
             return float2(f16tof32(data16[0]), f16tof32(data16[1]));
         }
 
-        inline void expandMinorantMajorant(float value, float& min_inout, float& maj_inout)
+        /** Expand the minorant/majorant with a box of voxels in a leaf. The box is given by inclusive voxel bounds.
+            The leaf voxels are stored x-major, so full z rows are 8 consecutive floats. NaNs are ignored.
+        */
+        static inline void expandMinorantMajorant(const float* data, int3 lo, int3 hi, __m128& min_inout, __m128& maj_inout)
         {
-            if (value < min_inout) min_inout = value;
-            if (value > maj_inout) maj_inout = value;
+            for (int x = lo.x; x <= hi.x; ++x)
+            {
+                for (int y = lo.y; y <= hi.y; ++y)
+                {
+                    const float* row = data + x * kBrickSize * kBrickSize + y * kBrickSize;
+                    if (lo.z == 0 && hi.z == kBrickSize - 1)
+                    {
+                        __m128 v0 = _mm_loadu_ps(row), v1 = _mm_loadu_ps(row + 4);
+                        min_inout = _mm_min_ps(v1, _mm_min_ps(v0, min_inout));
+                        maj_inout = _mm_max_ps(v1, _mm_max_ps(v0, maj_inout));
+                    }
+                    else
+                    {
+                        for (int z = lo.z; z <= hi.z; ++z)
+                        {
+                            __m128 v = _mm_set1_ps(row[z]);
+                            min_inout = _mm_min_ps(v, min_inout);
+                            maj_inout = _mm_max_ps(v, maj_inout);
+                        }
+                    }
+                }
+            }
+        }
+
+        /** Quantize the voxels of a leaf to 8 bits, keeping the leaf order.
+        */
+        static inline void quantizeBrick(const float* data, float minorant, float invRange, uint8_t* dst)
+        {
+            const __m128 offset = _mm_set1_ps(minorant), scale = _mm_set1_ps(invRange);
+            auto quantize4 = [&](const float* src) { return _mm_cvttps_epi32(_mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(src), offset), scale)); };
+            for (int i = 0; i < kBrickSize * kBrickSize * kBrickSize; i += 16)
+            {
+                __m128i lo = _mm_packs_epi32(quantize4(data + i), quantize4(data + i + 4));
+                __m128i hi = _mm_packs_epi32(quantize4(data + i + 8), quantize4(data + i + 12));
+                _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i), _mm_packus_epi16(lo, hi));
+            }
         }
 
         const nanovdb::FloatGrid* mpFloatGrid;
-        uint3 mAtlasSizeBricks;
         int3 mLeafDim[4];
         int3 mBBMin, mBBMax, mPixDim;
         uint32_t mLeafCount[4];
         std::vector<uint32_t> mRangeData;
-        std::vector<uint32_t> mPtrData;
-        std::vector<TexelType> mAtlasData;
-        std::atomic_uint32_t mNonEmptyCount;
+        std::vector<uint32_t> mPtrData;             ///< Brick index within the slice plus one (0 for constant leaves) until the bricks are placed.
+        std::vector<Slice> mSlices;
+        std::vector<const uint8_t*> mBricks;        ///< Encoded data of each brick.
+        std::vector<uint32_t> mBrickSlots;          ///< Atlas slot of each brick.
+        std::vector<uint32_t> mSlotBricks;          ///< Brick that owns the data of each atlas slot.
+        uint3 mMaxAtlasPageSizeBricks;
+        uint32_t mMaxAtlasPageBrickCount;
+        std::vector<uint3> mAtlasPageSizeBricks;
+        std::vector<std::vector<uint8_t>> mAtlasPages;
+        BrickedGridData::Stats mStats;
     };
 
     template <typename TexelType, unsigned int kBitsPerTexel>
     NanoVDBToBricksConverter<TexelType, kBitsPerTexel>::NanoVDBToBricksConverter(const nanovdb::FloatGrid* grid)
     {
-        mNonEmptyCount.store(0);
         mpFloatGrid = grid;
         auto& voxelbox = mpFloatGrid->indexBBox();
         mBBMin = (int3(voxelbox.min().x(), voxelbox.min().y(), voxelbox.min().z())) & (~7);
@@ -113,28 +187,23 @@ namespace Falcor
             mLeafDim[i] = mPixDim / (8 << i);
             mLeafCount[i] = (mLeafDim[i].x * mLeafDim[i].y * mLeafDim[i].z) + (i ? mLeafCount[i - 1] : 0); // Cumulative leaf count up the mips.
         }
-        uint leafCount = grid->tree().nodeCount(0);
-        uint approxdim = 1u << uint(log2f((float)leafCount + 1.f) / 3.f); // Choose the first 2 dimensions to be powers of 2.
-        uint lastdim = (leafCount + approxdim * approxdim - 1) / (approxdim * approxdim);
-        mAtlasSizeBricks = uint3(approxdim, approxdim, lastdim);
-        uint3 atlasSizePixels = getAtlasSizePixels();
-        uint leafTexelCount = atlasSizePixels.x * atlasSizePixels.y * atlasSizePixels.z;
         mRangeData.resize(mLeafCount[3]);
         mPtrData.resize(mLeafCount[0]);
-        mAtlasData.resize(kBC4Compress ? (leafTexelCount / 16) : leafTexelCount);
+        mSlices.resize(mLeafDim[0].z);
+
+        // Atlas pages are limited by the 8-bit brick coordinates of the indirection texture and by the size of a single resource.
+        uint32_t maxPageDepth = std::clamp<uint32_t>((uint32_t)(BrickedGrid::kMaxAtlasPageBytes / ((uint64_t)kBrickBytes * BrickedGrid::kMaxAtlasPageDim * BrickedGrid::kMaxAtlasPageDim)), 1u, BrickedGrid::kMaxAtlasPageDim);
+        mMaxAtlasPageSizeBricks = uint3(BrickedGrid::kMaxAtlasPageDim, BrickedGrid::kMaxAtlasPageDim, maxPageDepth);
+        mMaxAtlasPageBrickCount = mMaxAtlasPageSizeBricks.x * mMaxAtlasPageSizeBricks.y * mMaxAtlasPageSizeBricks.z;
     }
 
     template <typename TexelType, unsigned int kBitsPerTexel>
     void NanoVDBToBricksConverter<TexelType, kBitsPerTexel>::convertSlice(int z)
     {
-        uint3 atlasSizePixels = getAtlasSizePixels();
-        uint brickMax = getAtlasMaxBrick();
-        uint bricksPerSlice = mAtlasSizeBricks.x * mAtlasSizeBricks.y;
-        uint pixelsPerSlice = atlasSizePixels.x * atlasSizePixels.y;
-
         size_t offset = z * mLeafDim[0].x * mLeafDim[0].y;
         uint32_t* rangedst = mRangeData.data() + offset;
         uint32_t* ptrdst = mPtrData.data() + offset;
+        Slice& slice = mSlices[z];
         auto a = mpFloatGrid->getAccessor();
         for (int y = 0; y < mLeafDim[0].y; ++y)
         {
@@ -144,99 +213,228 @@ namespace Falcor
                 auto val = a.getValue(ijk);
                 auto leaf = a.probeLeaf(ijk);
                 float minorant = val, majorant = val;
-                uint myleaf = 0;
                 if (leaf)
                 {
-                    // Nanovdb only stores minorant/majorant for active voxels, but we need all of them... Grab the central 8x8x8 first the quick way.
-                    const float* data = leaf->voxels();
-                    for (int i = 0; i < kBrickSize * kBrickSize * kBrickSize; ++i) expandMinorantMajorant(data[i], minorant, majorant);
-                    // We also need the 1-halo from neighbouring bricks. Fetch them in an order that maximises nanovdb's internal cache reuse.
-                    for (int j = -1; j <= kBrickSize; ++j) for (int i = 0; i < kBrickSize; ++i) expandMinorantMajorant(a.getValue(ijk + nanovdb::Coord(i, j, -1)), minorant, majorant);
-                    for (int j = -1; j <= kBrickSize; ++j) for (int i = 0; i < kBrickSize; ++i) expandMinorantMajorant(a.getValue(ijk + nanovdb::Coord(i, j, kBrickSize)), minorant, majorant);
-                    for (int j = 0; j < kBrickSize; ++j) for (int i = 0; i < kBrickSize; ++i) expandMinorantMajorant(a.getValue(ijk + nanovdb::Coord(i, -1, j)), minorant, majorant);
-                    for (int j = 0; j < kBrickSize; ++j) for (int i = 0; i < kBrickSize; ++i) expandMinorantMajorant(a.getValue(ijk + nanovdb::Coord(i, kBrickSize, j)), minorant, majorant);
-                    for (int j = -1; j <= kBrickSize; ++j) for (int i = 0; i < kBrickSize; ++i) expandMinorantMajorant(a.getValue(ijk + nanovdb::Coord(-1, j, i)), minorant, majorant);
-                    for (int j = -1; j <= kBrickSize; ++j) for (int i = 0; i < kBrickSize; ++i) expandMinorantMajorant(a.getValue(ijk + nanovdb::Coord(kBrickSize, j, i)), minorant, majorant);
-                    for (int j = -1; j <= kBrickSize; ++j) expandMinorantMajorant(a.getValue(ijk + nanovdb::Coord(-1, j, -1)), minorant, majorant);
-                    for (int j = -1; j <= kBrickSize; ++j) expandMinorantMajorant(a.getValue(ijk + nanovdb::Coord(kBrickSize, j, -1)), minorant, majorant);
-                    for (int j = -1; j <= kBrickSize; ++j) expandMinorantMajorant(a.getValue(ijk + nanovdb::Coord(-1, j, kBrickSize)), minorant, majorant);
-                    for (int j = -1; j <= kBrickSize; ++j) expandMinorantMajorant(a.getValue(ijk + nanovdb::Coord(kBrickSize, j, kBrickSize)), minorant, majorant);
-
-                    if (minorant != majorant) myleaf = mNonEmptyCount.fetch_add(1);
+                    // Nanovdb only stores minorant/majorant for active voxels, but we need all of them... Take the central 8x8x8 first.
+                    __m128 min4 = _mm_set1_ps(val), maj4 = _mm_set1_ps(val);
+                    expandMinorantMajorant(leaf->voxels(), int3(0), int3(kBrickSize - 1), min4, maj4);
+
+                    // We also need the 1-halo, which is read straight from the voxel arrays of the 26 neighbouring leaves.
+                    // A missing neighbour is covered by a single tile value, so one lookup is enough for it.
+                    for (int dz = -1; dz <= 1; ++dz) for (int dy = -1; dy <= 1; ++dy) for (int dx = -1; dx <= 1; ++dx)
+                    {
+                        if (dx == 0 && dy == 0 && dz == 0) continue;
+                        nanovdb::Coord neighbourijk = ijk + nanovdb::Coord(dx * kBrickSize, dy * kBrickSize, dz * kBrickSize);
+                        if (auto neighbour = a.probeLeaf(neighbourijk))
+                        {
+                            // Voxels of the neighbour that touch this leaf: the far face along -1, the near face along +1, everything along 0.
+                            int3 d(dx, dy, dz), lo, hi;
+                            for (int i = 0; i < 3; ++i)
+                            {
+                                lo[i] = d[i] < 0 ? kBrickSize - 1 : 0;
+                                hi[i] = d[i] > 0 ? 0 : kBrickSize - 1;
+                            }
+                            expandMinorantMajorant(neighbour->voxels(), lo, hi, min4, maj4);
+                        }
+                        else
+                        {
+                            __m128 v = _mm_set1_ps(a.getValue(neighbourijk));
+                            min4 = _mm_min_ps(v, min4);
+                            maj4 = _mm_max_ps(v, maj4);
+                        }
+                    }
+
+                    min4 = _mm_min_ps(min4, _mm_shuffle_ps(min4, min4, _MM_SHUFFLE(1, 0, 3, 2)));
+                    min4 = _mm_min_ps(min4, _mm_shuffle_ps(min4, min4, _MM_SHUFFLE(2, 3, 0, 1)));
+                    maj4 = _mm_max_ps(maj4, _mm_shuffle_ps(maj4, maj4, _MM_SHUFFLE(1, 0, 3, 2)));
+                    maj4 = _mm_max_ps(maj4, _mm_shuffle_ps(maj4, maj4, _MM_SHUFFLE(2, 3, 0, 1)));
+                    minorant = _mm_cvtss_f32(min4);
+                    majorant = _mm_cvtss_f32(maj4);
+
                 }
-                if (majorant == minorant || myleaf >= brickMax || leaf == nullptr)
+                if (majorant == minorant || leaf == nullptr)
                 {
                     *rangedst++ = f32tof16(majorant) + (f32tof16(majorant) << 16); // force identical major and minor
                     *ptrdst++ = 0;
                 }
                 else
                 {
-                    const float* data = leaf->voxels();
                     majorant = f16tof32(f32tof16(majorant) + 1);
                     minorant = f16tof32(f32tof16(minorant));
                     *rangedst++ = f32tof16(majorant) + (f32tof16(minorant) << 16);
-                    uint32_t atlasx = myleaf % mAtlasSizeBricks.x;
-                    uint32_t atlasy = (myleaf / mAtlasSizeBricks.x) % mAtlasSizeBricks.y;
-                    uint32_t atlasz = myleaf / bricksPerSlice;
-                    *ptrdst++ = (atlasx + (atlasy << 8) + (atlasz << 16));
-
-                    if (!kBC4Compress) {
-                        float invRange = ((1 << kBitsPerTexel) - 1.f) / (majorant - minorant);
-                        TexelType* atlasdst = (TexelType*)mAtlasData.data() + atlasx * kBrickSize + atlasy * (atlasSizePixels.x * kBrickSize) + atlasz * (pixelsPerSlice * kBrickSize);
-                        for (int pixz = 0; pixz < kBrickSize; ++pixz)
+
+                    // Encode the brick now. It is placed in the atlas once all bricks are known and duplicates are removed.
+                    size_t brick = slice.hashes.size();
+                    slice.bricks.resize((brick + 1) * kBrickBytes);
+                    uint8_t* brickdst = slice.bricks.data() + brick * kBrickBytes;
+                    encodeBrick(leaf->voxels(), minorant, majorant, brickdst);
+                    slice.hashes.push_back(std::hash<std::string_view>()(std::string_view((const char*)brickdst, kBrickBytes)));
+                    *ptrdst++ = (uint32_t)brick + 1;
+                } // non empty brick?
+            } // x brick loop
+        } // y brick loop
+    }
+
+    template <typename TexelType, unsigned int kBitsPerTexel>
+    void NanoVDBToBricksConverter<TexelType, kBitsPerTexel>::encodeBrick(const float* data, float minorant, float majorant, uint8_t* dst)
+    {
+        if (!kBC4Compress) {
+            float invRange = ((1 << kBitsPerTexel) - 1.f) / (majorant - minorant);
+            TexelType* texeldst = (TexelType*)dst;
+            for (int pixz = 0; pixz < kBrickSize; ++pixz)
+            {
+                for (int pixy = 0; pixy < kBrickSize; ++pixy)
+                {
+                    for (int pixx = 0; pixx < kBrickSize; ++pixx)
+                    {
+                        float f = data[pixx * kBrickSize * kBrickSize + pixy * kBrickSize + pixz];
+                        *texeldst++ = TexelType((f - minorant) * invRange);
+                    }
+                }
+            }
+        }
+        else {
+            // BC4 compression: quantize the whole brick in leaf order first, then gather the 4x4 tiles from the bytes.
+            float invRange = (255.f) / (majorant - minorant);
+            uint8_t quantized[kBrickSize * kBrickSize * kBrickSize];
+            quantizeBrick(data, minorant, invRange, quantized);
+            uint64_t* blockdst = (uint64_t*)dst;
+            for (int pixz = 0; pixz < kBrickSize; ++pixz)
+            {
+                for (int tiley = 0; tiley < kBrickSize; tiley += 4)
+                {
+                    for (int tilex = 0; tilex < kBrickSize; tilex += 4) {
+                        uint8_t tilevals[4][4];
+                        for (int pixy = 0; pixy < 4; ++pixy)
                         {
-                            for (int pixy = 0; pixy < kBrickSize; ++pixy)
+                            for (int pixx = 0; pixx < 4; ++pixx)
                             {
-                                for (int pixx = 0; pixx < kBrickSize; ++pixx)
-                                {
-                                    float f = data[pixx * kBrickSize * kBrickSize + pixy * kBrickSize + pixz];
-                                    *atlasdst++ = TexelType((f - minorant) * invRange);
-                                }
-                                atlasdst += (atlasSizePixels.x - kBrickSize); // next scanline
+                                tilevals[pixy][pixx] = quantized[(pixx + tilex) * (kBrickSize * kBrickSize) + (pixy + tiley) * kBrickSize + pixz];
                             }
-                            atlasdst += (pixelsPerSlice - (atlasSizePixels.x * kBrickSize)); // next slice
                         }
+                        CompressAlphaDxt5((uint8_t*)&tilevals[0][0], blockdst);
+                        blockdst++;
                     }
-                    else {
-                        // BC4 compression:
-                        float invRange = (255.f) / (majorant - minorant);
-                        uint64_t* atlasdst = ((uint64_t*)mAtlasData.data() + atlasx * (kBrickSize / 4) + atlasy * ((atlasSizePixels.x / 4) * kBrickSize / 4) + atlasz * (pixelsPerSlice / 16 * kBrickSize));
-                        for (int pixz = 0; pixz < kBrickSize; ++pixz)
-                        {
-                            for (int tiley = 0; tiley < kBrickSize; tiley += 4)
-                            {
-                                for (int tilex = 0; tilex < kBrickSize; tilex += 4) {
-                                    uint8_t tilevals[4][4];
-                                    uint8_t tileminorant = 255, tilemajorant = 0;
-                                    for (int pixy = 0; pixy < 4; ++pixy)
-                                    {
-                                        for (int pixx = 0; pixx < 4; ++pixx)
-                                        {
-                                            float f = data[(pixx + tilex) * (kBrickSize * kBrickSize) + (pixy + tiley) * kBrickSize + pixz];
-                                            uint8_t voxel = uint8_t((f - minorant) * invRange);
-                                            tileminorant = std::min(tileminorant, voxel);
-                                            tilemajorant = std::max(tilemajorant, voxel);
-                                            tilevals[pixy][pixx] = voxel;
-                                        }
-                                    }
-                                    CompressAlphaDxt5((uint8_t*)&tilevals[0][0], atlasdst);
-                                    atlasdst++;
-                                }
-                                atlasdst += (atlasSizePixels.x / 4 - kBrickSize / 4); // next scanline
-                            }
-                            atlasdst += (pixelsPerSlice / 16 - (atlasSizePixels.x / 4 * kBrickSize / 4)); // next slice
-                        } // z slice loop
-                    } // bc4 compress?
-                } // non empty brick?
-            } // x brick loop
-        } // y brick loop
+                }
+            } // z slice loop
+        } // bc4 compress?
+    }
+
+    template <typename TexelType, unsigned int kBitsPerTexel>
+    void NanoVDBToBricksConverter<TexelType, kBitsPerTexel>::deduplicateBricks()
+    {
+        // Bricks are numbered in slice order, so the result does not depend on how the slices were scheduled.
+        uint32_t brickCount = 0;
+        for (auto& slice : mSlices)
+        {
+            slice.firstBrick = brickCount;
+            brickCount += (uint32_t)slice.hashes.size();
+        }
+        mBricks.reserve(brickCount);
+        mBrickSlots.reserve(brickCount);
+
+        // Identical bricks, e.g. fully saturated ones, share an atlas slot. Their ranges are stored separately, so only the encoded data has to match.
+        std::unordered_multimap<size_t, uint32_t> slotsByHash;
+        slotsByHash.reserve(brickCount);
+        for (const auto& slice : mSlices)
+        {
+            for (size_t i = 0; i < slice.hashes.size(); ++i)
+            {
+                const uint8_t* brick = slice.bricks.data() + i * kBrickBytes;
+                uint32_t slot = (uint32_t)mSlotBricks.size();
+                auto range = slotsByHash.equal_range(slice.hashes[i]);
+                for (auto it = range.first; it != range.second; ++it)
+                {
+                    if (std::memcmp(mBricks[mSlotBricks[it->second]], brick, kBrickBytes) == 0)
+                    {
+                        slot = it->second;
+                        break;
+                    }
+                }
+                if (slot == mSlotBricks.size())
+                {
+                    slotsByHash.emplace(slice.hashes[i], slot);
+                    mSlotBricks.push_back((uint32_t)mBricks.size());
+                }
+                mBricks.push_back(brick);
+                mBrickSlots.push_back(slot);
+            }
+        }
+
+        mStats.brickCount = brickCount;
+        mStats.uniqueBrickCount = (uint32_t)mSlotBricks.size();
+    }
+
+    template <typename TexelType, unsigned int kBitsPerTexel>
+    void NanoVDBToBricksConverter<TexelType, kBitsPerTexel>::allocateAtlasPages()
+    {
+        // Fill pages of the maximum size, followed by a smaller last page. There is always at least one page, as empty leaves point at brick 0.
+        uint32_t remaining = std::max(mStats.uniqueBrickCount, 1u);
+        while (remaining > 0 && mAtlasPageSizeBricks.size() < BrickedGrid::kMaxAtlasPages)
+        {
+            uint32_t pageBrickCount = std::min(remaining, mMaxAtlasPageBrickCount);
+            uint3 pageSize = getAtlasPageSizeBricks(pageBrickCount);
+            uint3 pageSizePixels = pageSize * kBrickSize;
+            size_t pageTexelCount = (size_t)pageSizePixels.x * pageSizePixels.y * pageSizePixels.z;
+            mAtlasPageSizeBricks.push_back(pageSize);
+            mAtlasPages.emplace_back((kBC4Compress ? (pageTexelCount / 16) * sizeof(uint64_t) : pageTexelCount * sizeof(TexelType)));
+            mStats.atlasCapacity += (uint64_t)pageSize.x * pageSize.y * pageSize.z;
+            remaining -= pageBrickCount;
+        }
+        mStats.droppedBrickCount = remaining;
+    }
+
+    template <typename TexelType, unsigned int kBitsPerTexel>
+    void NanoVDBToBricksConverter<TexelType, kBitsPerTexel>::placeSlice(int z)
+    {
+        size_t offset = z * mLeafDim[0].x * mLeafDim[0].y;
+        uint32_t* rangedst = mRangeData.data() + offset;
+        uint32_t* ptrdst = mPtrData.data() + offset;
+        const Slice& slice = mSlices[z];
+        for (int i = 0; i < mLeafDim[0].x * mLeafDim[0].y; ++i, ++rangedst, ++ptrdst)
+        {
+            if (*ptrdst == 0) continue;
+
+            uint32_t brick = slice.firstBrick + *ptrdst - 1;
+            uint32_t slot = mBrickSlots[brick];
+            uint32_t page = slot / mMaxAtlasPageBrickCount;
+            if (page >= mAtlasPages.size())
+            {
+                // The atlas pages are full. Fall back to a constant majorant.
+                uint32_t majorant = *rangedst & 0xffff;
+                *rangedst = majorant + (majorant << 16);
+                *ptrdst = 0;
+                continue;
+            }
+
+            uint3 pageSize = mAtlasPageSizeBricks[page];
+            uint32_t pageslot = slot % mMaxAtlasPageBrickCount;
+            uint32_t atlasx = pageslot % pageSize.x;
+            uint32_t atlasy = (pageslot / pageSize.x) % pageSize.y;
+            uint32_t atlasz = pageslot / (pageSize.x * pageSize.y);
+            *ptrdst = (atlasx + (atlasy << 8) + (atlasz << 16) + (page << 24));
+
+            // Only the first of identical bricks copies its data.
+            if (mSlotBricks[slot] != brick) continue;
+            size_t rowPitch = (size_t)pageSize.x * kBrickRowBytes;
+            size_t slicePitch = rowPitch * pageSize.y * kBrickRows;
+            uint8_t* atlasdst = mAtlasPages[page].data() + atlasx * kBrickRowBytes + atlasy * kBrickRows * rowPitch + atlasz * kBrickSize * slicePitch;
+            const uint8_t* brickdata = mBricks[brick];
+            for (uint pixz = 0; pixz < kBrickSize; ++pixz)
+            {
+                for (uint row = 0; row < kBrickRows; ++row)
+                {
+                    std::memcpy(atlasdst + pixz * slicePitch + row * rowPitch, brickdata + (pixz * kBrickRows + row) * kBrickRowBytes, kBrickRowBytes);
+                }
+            }
+        }
     }
 
     template <typename TexelType, unsigned int kBitsPerTexel>
     void NanoVDBToBricksConverter<TexelType, kBitsPerTexel>::computeMip(int mip)
     {
-        uint32_t* rangedst = mRangeData.data() + mLeafCount[mip - 1];
-        uint32_t* rangesrc = mRangeData.data() + ((mip > 1) ? mLeafCount[mip - 2] : 0);
+        const uint32_t* rangesrcbase = mRangeData.data() + ((mip > 1) ? mLeafCount[mip - 2] : 0);
+        uint32_t* rangedstbase = mRangeData.data() + mLeafCount[mip - 1];
         int3 leafdim_src = mLeafDim[mip - 1];
         uint32_t rowstride_src = leafdim_src.x;
         uint32_t slicestride_src = leafdim_src.y * rowstride_src;
@@ -245,42 +443,62 @@ namespace Falcor
         uint32_t rowstride_tgt = leafdim_tgt.x;
         uint32_t slicestride_tgt = leafdim_tgt.y * rowstride_tgt;
 
-        for (int z = 0; z < leafdim_tgt.z; ++z, rangesrc += slicestride_src)
+        // Each target row reads two rows from each of two source slices, so rows can be computed independently.
+        Threading::parallelFor(0, (size_t)leafdim_tgt.z * leafdim_tgt.y, [&](size_t row)
         {
-            for (int y = 0; y < leafdim_tgt.y; ++y, rangesrc += rowstride_src)
+            uint32_t z = uint32_t(row / leafdim_tgt.y), y = uint32_t(row % leafdim_tgt.y);
+            const uint32_t* rangesrc = rangesrcbase + 2 * z * slicestride_src + 2 * y * rowstride_src;
+            uint32_t* rangedst = rangedstbase + z * slicestride_tgt + y * rowstride_tgt;
+            for (int x = 0; x < leafdim_tgt.x; ++x, rangesrc += 2)
             {
-                for (int x = 0; x < leafdim_tgt.x; ++x, rangesrc += 2)
-                {
-                    float2 majmin_dst = combineMajMin(
-                        combineMajMin(
-                            combineMajMin(unpackMajMin(rangesrc), unpackMajMin(rangesrc + 1)),
-                            combineMajMin(unpackMajMin(rangesrc + rowstride_src), unpackMajMin(rangesrc + 1 + rowstride_src))
-                        ),
-                        combineMajMin(
-                            combineMajMin(unpackMajMin(rangesrc + slicestride_src), unpackMajMin(rangesrc + slicestride_src + 1)),
-                            combineMajMin(unpackMajMin(rangesrc + slicestride_src + rowstride_src), unpackMajMin(rangesrc + slicestride_src + 1 + rowstride_src))
-                        )
-                    );
-                    *rangedst++ = f32tof16(majmin_dst.x) + (f32tof16(majmin_dst.y) << 16);
-                } // x
-            } // y
-        } // z
+                float2 majmin_dst = combineMajMin(
+                    combineMajMin(
+                        combineMajMin(unpackMajMin(rangesrc), unpackMajMin(rangesrc + 1)),
+                        combineMajMin(unpackMajMin(rangesrc + rowstride_src), unpackMajMin(rangesrc + 1 + rowstride_src))
+                    ),
+                    combineMajMin(
+                        combineMajMin(unpackMajMin(rangesrc + slicestride_src), unpackMajMin(rangesrc + slicestride_src + 1)),
+                        combineMajMin(unpackMajMin(rangesrc + slicestride_src + rowstride_src), unpackMajMin(rangesrc + slicestride_src + 1 + rowstride_src))
+                    )
+                );
+                *rangedst++ = f32tof16(majmin_dst.x) + (f32tof16(majmin_dst.y) << 16);
+            } // x
+        }, 16);
     }
 
-    template <typename TexelType, unsigned int kBitsPerTexel> typename
+    template <typename TexelType, unsigned int kBitsPerTexel>
     BrickedGrid NanoVDBToBricksConverter<TexelType, kBitsPerTexel>::convert()
+    {
+        return convertToHost().createTextures();
+    }
+
+    template <typename TexelType, unsigned int kBitsPerTexel>
+    BrickedGridData NanoVDBToBricksConverter<TexelType, kBitsPerTexel>::convertToHost()
     {
         auto t0 = CpuTimer::getCurrentTimePoint();
-        auto range = NumericRange<int>(0, mLeafDim[0].z);
-        std::for_each(std::execution::par, range.begin(), range.end(), [&](int z) { convertSlice(z); });
-        for (int mip = 1; mip < 4; ++mip) computeMip(mip);
+        Threading::parallelFor(0, mLeafDim[0].z, [&](size_t z) { convertSlice((int)z); }, 1);
+        deduplicateBricks();
+        allocateAtlasPages();
+        Threading::parallelFor(0, mLeafDim[0].z, [&](size_t z) { placeSlice((int)z); }, 1);
+        for (int mip = 1; mip < 4; ++mip) computeMip(mip); // Each mip is computed in parallel from the previous one.
         double dt = CpuTimer::calcDuration(t0, CpuTimer::getCurrentTimePoint());
-        logInfo("converted in " + std::to_string(dt) + "ms: mNonEmptyCount " + std::to_string(mNonEmptyCount) + " vs max " + std::to_string(getAtlasMaxBrick()) + "\n");
+        logInfo("converted in " + std::to_string(dt) + "ms: " + std::to_string(mStats.brickCount) + " bricks, " + std::to_string(mStats.uniqueBrickCount) + " unique, " +
+            std::to_string(mAtlasPages.size()) + " atlas pages with " + std::to_string(mStats.atlasCapacity) + " bricks\n");
+        if (mStats.droppedBrickCount > 0)
+        {
+            logWarning("Grid brick atlas is full. " + std::to_string(mStats.droppedBrickCount) + " of " + std::to_string(mStats.uniqueBrickCount) + " unique bricks are replaced by their majorant.");
+        }
 
-        BrickedGrid bricks;
-        bricks.range = Texture::create3D(mLeafDim[0].x, mLeafDim[0].y, mLeafDim[0].z, ResourceFormat::RG16Float, 4, mRangeData.data(), ResourceBindFlags::ShaderResource, false);
-        bricks.indirection = Texture::create3D(mLeafDim[0].x, mLeafDim[0].y, mLeafDim[0].z, ResourceFormat::RGBA8Uint, 1, mPtrData.data(), ResourceBindFlags::ShaderResource, false);
-        bricks.atlas = Texture::create3D(getAtlasSizePixels().x, getAtlasSizePixels().y, getAtlasSizePixels().z, getAtlasFormat(), 1, mAtlasData.data(), ResourceBindFlags::ShaderResource, false);
-        return bricks;
+        BrickedGridData data;
+        data.brickDim = uint3(mLeafDim[0]);
+        data.atlasFormat = getAtlasFormat();
+        data.range = std::move(mRangeData);
+        data.indirection = std::move(mPtrData);
+        for (size_t page = 0; page < mAtlasPages.size(); ++page)
+        {
+            data.atlasPages.push_back({ mAtlasPageSizeBricks[page] * kBrickSize, std::move(mAtlasPages[page]) });
+        }
+        data.stats = mStats;
+        return data;
     }
 }
@@ -44,6 +44,36 @@ namespace Falcor
         const float kMaxAnisotropy = 0.99f;
         const double kMinFrameRate = 1.0;
         const double kMaxFrameRate = 1000.0;
+
+        const std::string kSlotNames[] = { "Density", "Emission" };
+
+        bool findGridFiles(const std::string& path, std::vector<std::string>& files)
+        {
+            std::string fullpath;
+            if (!findFileInDataDirectories(path, fullpath))
+            {
+                logWarning("Cannot find directory '" + path + "'");
+                return false;
+            }
+            if (!std::filesystem::is_directory(fullpath))
+            {
+                logWarning("'" + path + "' is not a directory");
+                return false;
+            }
+
+            // Enumerate grid files.
+            files.clear();
+            for (auto p : std::filesystem::directory_iterator(fullpath))
+            {
+                if (p.path().extension() == ".nvdb" || p.path().extension() == ".vdb") files.push_back(p.path().string());
+            }
+
+            // Sort by length first, then alpha-numerically.
+            auto cmp = [](const std::string& a, const std::string& b) { return a.length() != b.length() ? a.length() < b.length() : a < b; };
+            std::sort(files.begin(), files.end(), cmp);
+
+            return true;
+        }
     }
 
     static_assert(sizeof(GridVolumeData) % 16 == 0, "GridVolumeData size should be a multiple of 16");
@@ -94,6 +124,14 @@ namespace Falcor
             if (widget.var("Emission scale", emissionScale, 0.f, std::numeric_limits<float>::max(), 0.01f)) setEmissionScale(emissionScale);
         }
 
+        for (uint32_t slotIndex = 0; slotIndex < (uint32_t)GridSlot::Count; ++slotIndex)
+        {
+            if (const auto& pSequence = mStreamingGrids[slotIndex])
+            {
+                if (auto group = widget.group(kSlotNames[slotIndex] + " Grid Streaming")) pSequence->renderUI(group);
+            }
+        }
+
         float3 albedo = getAlbedo();
         if (widget.var("Albedo", albedo, 0.f, 1.f, 0.01f)) setAlbedo(albedo);
 
@@ -137,30 +175,23 @@ namespace Falcor
 
     uint32_t GridVolume::loadGridSequence(GridSlot slot, const std::string& path, const std::string& gridname, bool keepEmpty)
     {
-        std::string fullpath;
-        if (!findFileInDataDirectories(path, fullpath))
-        {
-            logWarning("Cannot find directory '" + path + "'");
-            return 0;
-        }
-        if (!std::filesystem::is_directory(fullpath))
-        {
-            logWarning("'" + path + "' is not a directory");
-            return 0;
-        }
-
-        // Enumerate grid files.
         std::vector<std::string> files;
-        for (auto p : std::filesystem::directory_iterator(fullpath))
-        {
-            if (p.path().extension() == ".nvdb" || p.path().extension() == ".vdb") files.push_back(p.path().string());
-        }
+        if (!findGridFiles(path, files)) return 0;
+        return loadGridSequence(slot, files, gridname, keepEmpty);
+    }
 
-        // Sort by length first, then alpha-numerically.
-        auto cmp = [](const std::string& a, const std::string& b) { return a.length() != b.length() ? a.length() < b.length() : a < b; };
-        std::sort(files.begin(), files.end(), cmp);
+    uint32_t GridVolume::streamGridSequence(GridSlot slot, const std::vector<std::string>& filenames, const std::string& gridname)
+    {
+        auto pSequence = StreamingGridSequence::create(filenames, gridname);
+        setStreamingGridSequence(slot, pSequence);
+        return pSequence->getFrameCount();
+    }
 
-        return loadGridSequence(slot, files, gridname, keepEmpty);
+    uint32_t GridVolume::streamGridSequence(GridSlot slot, const std::string& path, const std::string& gridname)
+    {
+        std::vector<std::string> files;
+        if (!findGridFiles(path, files)) return 0;
+        return streamGridSequence(slot, files, gridname);
     }
 
     void GridVolume::setGridSequence(GridSlot slot, const GridSequence& grids)
@@ -168,15 +199,42 @@ namespace Falcor
         uint32_t slotIndex = (uint32_t)slot;
         assert(slotIndex >= 0 && slotIndex < (uint32_t)GridSlot::Count);
 
-        if (mGrids[slotIndex] != grids)
+        if (mGrids[slotIndex] != grids || mStreamingGrids[slotIndex])
         {
             mGrids[slotIndex] = grids;
+            mStreamingGrids[slotIndex] = nullptr;
+            mStreamedGrids[slotIndex] = nullptr;
+            updateSequence();
+            updateBounds();
+            markUpdates(UpdateFlags::GridsChanged);
+        }
+    }
+
+    void GridVolume::setStreamingGridSequence(GridSlot slot, const StreamingGridSequence::SharedPtr& pSequence)
+    {
+        uint32_t slotIndex = (uint32_t)slot;
+        assert(slotIndex >= 0 && slotIndex < (uint32_t)GridSlot::Count);
+
+        if (mStreamingGrids[slotIndex] != pSequence)
+        {
+            mGrids[slotIndex].clear();
+            mStreamingGrids[slotIndex] = pSequence;
+            mStreamedGrids[slotIndex] = nullptr;
             updateSequence();
+            updateStreamedGrids();
             updateBounds();
             markUpdates(UpdateFlags::GridsChanged);
         }
     }
 
+    const StreamingGridSequence::SharedPtr& GridVolume::getStreamingGridSequence(GridSlot slot) const
+    {
+        uint32_t slotIndex = (uint32_t)slot;
+        assert(slotIndex >= 0 && slotIndex < (uint32_t)GridSlot::Count);
+
+        return mStreamingGrids[slotIndex];
+    }
+
     const GridVolume::GridSequence& GridVolume::getGridSequence(GridSlot slot) const
     {
         uint32_t slotIndex = (uint32_t)slot;
@@ -197,6 +255,8 @@ namespace Falcor
         uint32_t slotIndex = (uint32_t)slot;
         assert(slotIndex >= 0 && slotIndex < (uint32_t)GridSlot::Count);
 
+        if (mStreamingGrids[slotIndex]) return mStreamedGrids[slotIndex];
+
         const auto& gridSequence = mGrids[slotIndex];
         uint32_t gridIndex = std::min(mGridFrame, (uint32_t)gridSequence.size() - 1);
         return gridSequence.empty() ? kNullGrid : gridSequence[gridIndex];
@@ -212,11 +272,19 @@ namespace Falcor
         return std::vector<Grid::SharedPtr>(uniqueGrids.begin(), uniqueGrids.end());
     }
 
+    std::vector<StreamingGridSequence::SharedPtr> GridVolume::getAllStreamingGridSequences() const
+    {
+        std::vector<StreamingGridSequence::SharedPtr> sequences;
+        std::copy_if(mStreamingGrids.begin(), mStreamingGrids.end(), std::back_inserter(sequences), [] (const auto& pSequence) { return pSequence != nullptr; });
+        return sequences;
+    }
+
     void GridVolume::setGridFrame(uint32_t gridFrame)
     {
         if (mGridFrame != gridFrame)
         {
             mGridFrame = gridFrame;
+            updateStreamedGrids();
             markUpdates(UpdateFlags::GridsChanged);
             updateBounds();
         }
@@ -238,7 +306,18 @@ namespace Falcor
         if (mPlaybackEnabled && frameCount > 0)
         {
             uint32_t frameIndex = (uint32_t)std::floor(std::max(0.0, currentTime) * mFrameRate) % frameCount;
+
+            // Track the direction and speed of playback to prefetch the frames of streamed sequences that are needed next.
+            int64_t step = (int64_t)std::floor(std::max(0.0, currentTime) * mFrameRate) - (int64_t)std::floor(std::max(0.0, mPlaybackTime) * mFrameRate);
+            if (step != 0) mPlaybackStep = (int32_t)std::clamp<int64_t>(step, -(int64_t)frameCount, (int64_t)frameCount);
+            mPlaybackTime = currentTime;
+
             setGridFrame(frameIndex);
+
+            for (const auto& pSequence : mStreamingGrids)
+            {
+                if (pSequence && pSequence->getFrameCount() > 0) pSequence->prefetch(std::min(mGridFrame, pSequence->getFrameCount() - 1), mPlaybackStep);
+            }
         }
     }
 
@@ -318,9 +397,23 @@ namespace Falcor
     {
         mGridFrameCount = 1;
         for (const auto& grids : mGrids) mGridFrameCount = std::max(mGridFrameCount, (uint32_t)grids.size());
+        for (const auto& pSequence : mStreamingGrids)
+        {
+            if (pSequence) mGridFrameCount = std::max(mGridFrameCount, pSequence->getFrameCount());
+        }
         setGridFrame(std::min(mGridFrame, mGridFrameCount - 1));
     }
 
+    void GridVolume::updateStreamedGrids()
+    {
+        for (uint32_t slotIndex = 0; slotIndex < (uint32_t)GridSlot::Count; ++slotIndex)
+        {
+            const auto& pSequence = mStreamingGrids[slotIndex];
+            uint32_t frameCount = pSequence ? pSequence->getFrameCount() : 0;
+            mStreamedGrids[slotIndex] = frameCount > 0 ? pSequence->getFrame(std::min(mGridFrame, frameCount - 1)) : nullptr;
+        }
+    }
+
     void GridVolume::updateBounds()
     {
         AABB bounds;
@@ -358,6 +451,7 @@ namespace Falcor
     {
         SCRIPT_BINDING_DEPENDENCY(Animatable)
         SCRIPT_BINDING_DEPENDENCY(Grid)
+        SCRIPT_BINDING_DEPENDENCY(StreamingGridSequence)
 
         pybind11::class_<GridVolume, Animatable, GridVolume::SharedPtr> volume(m, "GridVolume");
         volume.def_property("name", &GridVolume::getName, &GridVolume::setName);
@@ -381,6 +475,13 @@ namespace Falcor
         volume.def("loadGridSequence",
             pybind11::overload_cast<GridVolume::GridSlot, const std::string&, const std::string&, bool>(&GridVolume::loadGridSequence),
             "slot"_a, "path"_a, "gridnames"_a, "keepEmpty"_a = true);
+        volume.def("streamGridSequence",
+            pybind11::overload_cast<GridVolume::GridSlot, const std::vector<std::string>&, const std::string&>(&GridVolume::streamGridSequence),
+            "slot"_a, "filenames"_a, "gridname"_a);
+        volume.def("streamGridSequence",
+            pybind11::overload_cast<GridVolume::GridSlot, const std::string&, const std::string&>(&GridVolume::streamGridSequence),
+            "slot"_a, "path"_a, "gridname"_a);
+        volume.def("getStreamingGridSequence", &GridVolume::getStreamingGridSequence, "slot"_a);
 
         pybind11::enum_<GridVolume::GridSlot> gridSlot(volume, "GridSlot");
         gridSlot.value("Density", GridVolume::GridSlot::Density);
@@ -27,6 +27,7 @@
  **************************************************************************/
 #pragma once
 #include "Grid.h"
+#include "StreamingGridSequence.h"
 #include "GridVolumeData.slang"
 #include "Scene/Animation/Animatable.h"
 
@@ -36,7 +37,8 @@ namespace Falcor
         The absorbing/scattering medium is defined by a density voxel grid and additional parameters.
         The emission is defined by an emission voxel grid and additional parameters.
         Grids are stored in grid slots (density, emission) and can either be static, using one grid per slot,
-        or dynamic, using a sequence of grids per slot.
+        or dynamic, using a sequence of grids per slot. Long sequences can be streamed, in which case only
+        a bounded number of frames is resident at a time (see StreamingGridSequence).
     */
     class dlldecl GridVolume : public Animatable
     {
@@ -129,10 +131,40 @@ namespace Falcor
         */
         uint32_t loadGridSequence(GridSlot slot, const std::string& path, const std::string& gridname, bool keepEmpty = true);
 
+        /** Stream a sequence of grids from files to a grid slot.
+            Frames are loaded on demand and ahead of playback instead of loading all frames up front.
+            Frames that fail to load are treated as empty grids.
+            Note: This will replace any existing grid sequence for that slot.
+            \param[in] slot Grid slot.
+            \param[in] filenames Filenames of the grids. Can also include a full path or relative path from a data directory.
+            \param[in] gridname Name of the grid to load.
+            \return Returns the length of the sequence.
+        */
+        uint32_t streamGridSequence(GridSlot slot, const std::vector<std::string>& filenames, const std::string& gridname);
+
+        /** Stream a sequence of grids from a directory to a grid slot.
+            Note: This will replace any existing grid sequence for that slot.
+            \param[in] slot Grid slot.
+            \param[in] path Directory containing grid files. Can also include a full path or relative path from a data directory.
+            \param[in] gridname Name of the grid to load.
+            \return Returns the length of the sequence.
+        */
+        uint32_t streamGridSequence(GridSlot slot, const std::string& path, const std::string& gridname);
+
         /** Set the grid sequence for the specified slot.
         */
         void setGridSequence(GridSlot slot, const GridSequence& grids);
 
+        /** Set a streamed grid sequence for the specified slot.
+            Note: This will replace any existing grid sequence for that slot.
+        */
+        void setStreamingGridSequence(GridSlot slot, const StreamingGridSequence::SharedPtr& pSequence);
+
+        /** Get the streamed grid sequence for the specified slot.
+            \return The sequence, or nullptr if the slot is not streamed.
+        */
+        const StreamingGridSequence::SharedPtr& getStreamingGridSequence(GridSlot slot) const;
+
         /** Get the grid sequence for the specified slot.
         */
         const GridSequence& getGridSequence(GridSlot slot) const;
@@ -147,9 +179,14 @@ namespace Falcor
         const Grid::SharedPtr& getGrid(GridSlot slot) const;
 
         /** Get a list of all grids used for this volume.
+            Grids of streamed sequences are not included, as they change during playback.
         */
         std::vector<Grid::SharedPtr> getAllGrids() const;
 
+        /** Get a list of all streamed grid sequences used for this volume.
+        */
+        std::vector<StreamingGridSequence::SharedPtr> getAllStreamingGridSequences() const;
+
         /** Sets the current frame of the grid sequence to use.
         */
         void setGridFrame(uint32_t gridFrame);
@@ -261,6 +298,7 @@ namespace Falcor
         GridVolume(const std::string& name);
 
         void updateSequence();
+        void updateStreamedGrids();
         void updateBounds();
 
         void markUpdates(UpdateFlags updates);
@@ -268,10 +306,14 @@ namespace Falcor
 
         std::string mName;
         std::array<GridSequence, (size_t)GridSlot::Count> mGrids;
+        std::array<StreamingGridSequence::SharedPtr, (size_t)GridSlot::Count> mStreamingGrids;
+        std::array<Grid::SharedPtr, (size_t)GridSlot::Count> mStreamedGrids;   ///< Current grids of the streamed sequences.
         uint32_t mGridFrame = 0;
         uint32_t mGridFrameCount = 1;
         double mFrameRate = 30.f;
         bool mPlaybackEnabled = false;
+        double mPlaybackTime = 0.0;     ///< Time of the last playback update.
+        int32_t mPlaybackStep = 1;      ///< Number of frames advanced by the last playback update. Used to prefetch streamed frames.
         AABB mBounds;
         GridVolumeData mData;
         mutable UpdateFlags mUpdates = UpdateFlags::None;
@@ -0,0 +1,264 @@
+/***************************************************************************
+ # Copyright (c) 2015-21, NVIDIA CORPORATION. All rights reserved.
+ #
+ # Redistribution and use in source and binary forms, with or without
+ # modification, are permitted provided that the following conditions
+ # are met:
+ #  * Redistributions of source code must retain the above copyright
+ #    notice, this list of conditions and the following disclaimer.
+ #  * Redistributions in binary form must reproduce the above copyright
+ #    notice, this list of conditions and the following disclaimer in the
+ #    documentation and/or other materials provided with the distribution.
+ #  * Neither the name of NVIDIA CORPORATION nor the names of its
+ #    contributors may be used to endorse or promote products derived
+ #    from this software without specific prior written permission.
+ #
+ # THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS "AS IS" AND ANY
+ # EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ # IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ # PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+ # CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ # EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ # PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ # PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+ # OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ # (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ # OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ **************************************************************************/
+#include "stdafx.h"
+#include "StreamingGridSequence.h"
+
+namespace Falcor
+{
+    StreamingGridSequence::SharedPtr StreamingGridSequence::create(const std::vector<std::string>& filenames, const std::string& gridname)
+    {
+        auto pSequence = SharedPtr(new StreamingGridSequence(gridname));
+        pSequence->mFrames.resize(filenames.size());
+        for (size_t i = 0; i < filenames.size(); ++i)
+        {
+            auto& frame = pSequence->mFrames[i];
+            if (!findFileInDataDirectories(filenames[i], frame.sourceFilename))
+            {
+                logWarning("Error when loading grid. Can't find grid file '" + filenames[i] + "'");
+                frame.failed = true;
+            }
+        }
+        return pSequence;
+    }
+
+    StreamingGridSequence::~StreamingGridSequence()
+    {
+        // Wait for pending loads. The loaded grids are discarded.
+        for (uint32_t frame : mPendingFrames)
+        {
+            try
+            {
+                mFrames[frame].pending.get();
+            }
+            catch (const std::exception&)
+            {
+            }
+        }
+    }
+
+    void StreamingGridSequence::renderUI(Gui::Widgets& widget)
+    {
+        std::ostringstream oss;
+        oss << "Frame count: " << getFrameCount() << std::endl
+            << "Resident frames: " << mResidentFrameCount << std::endl
+            << "Resident memory: " << formatByteSize(mResidentBytes) << std::endl
+            << "Loaded frames: " << mStats.loadCount << " (" << mStats.prefetchCount << " prefetched)" << std::endl
+            << "Stalls: " << mStats.stallCount << " (" << std::fixed << std::setprecision(1) << mStats.stallTime << " ms)" << std::endl
+            << "Evicted frames: " << mStats.evictionCount << std::endl;
+        widget.text(oss.str());
+
+        uint32_t maxResidentMB = (uint32_t)std::min<uint64_t>(mMaxResidentBytes >> 20, std::numeric_limits<uint32_t>::max());
+        if (widget.var("Memory budget (MB)", maxResidentMB, 0u, std::numeric_limits<uint32_t>::max(), 64.f)) setMaxResidentBytes((uint64_t)maxResidentMB << 20);
+        widget.var("Prefetch frames", mPrefetchFrameCount, 0u, 64u);
+    }
+
+    Grid::SharedPtr StreamingGridSequence::getFrame(uint32_t frame)
+    {
+        collectLoads();
+
+        auto& f = mFrames.at(frame);
+        mCurrentFrame = frame;
+        f.lastUse = ++mUseCounter;
+
+        if (f.pGrid)
+        {
+            mStats.hitCount++;
+        }
+        else if (!f.failed)
+        {
+            // Playback is ahead of the loads. Load the frame on the calling thread if it is not pending already.
+            auto startTime = CpuTimer::getCurrentTimePoint();
+            if (!f.pending.isValid()) startLoad(frame);
+            mPendingFrames.erase(std::find(mPendingFrames.begin(), mPendingFrames.end(), frame));
+            finishLoad(frame);
+            mStats.stallCount++;
+            mStats.stallTime += CpuTimer::calcDuration(startTime, CpuTimer::getCurrentTimePoint());
+        }
+
+        trim();
+        return f.pGrid;
+    }
+
+    void StreamingGridSequence::prefetch(uint32_t frame, int32_t step)
+    {
+        collectLoads();
+
+        const int64_t frameCount = (int64_t)mFrames.size();
+        if (frameCount == 0) return;
+
+        // Only load as many frames ahead as are expected to fit within the budget, based on the average size of the resident frames.
+        // Frames that playback has already passed are evicted first, as frames ahead of playback are marked as recently used.
+        const uint64_t frameSize = mResidentFrameCount > 0 ? mResidentBytes / mResidentFrameCount : 0;
+        if (step == 0) step = 1;
+
+        for (uint32_t i = 1; i <= mPrefetchFrameCount; ++i)
+        {
+            if ((i + 1) * frameSize > mMaxResidentBytes) break;
+
+            int64_t index = ((int64_t)frame + (int64_t)step * i) % frameCount;
+            if (index < 0) index += frameCount;
+            if (index == frame) break;
+
+            auto& f = mFrames[index];
+            f.lastUse = mUseCounter;
+            if (f.pGrid || f.failed || f.pending.isValid()) continue;
+
+            startLoad((uint32_t)index);
+            mStats.prefetchCount++;
+        }
+    }
+
+    void StreamingGridSequence::setMaxResidentBytes(uint64_t maxResidentBytes)
+    {
+        mMaxResidentBytes = maxResidentBytes;
+        trim();
+    }
+
+    nanovdb::GridHandle<nanovdb::HostBuffer> StreamingGridSequence::readGridHandle(uint32_t frame) const
+    {
+        const auto& f = mFrames.at(frame);
+        if (f.pGrid)
+        {
+            // Copy resident frames instead of loading them again.
+            const auto& handle = f.pGrid->getGridHandle();
+            return readGridHandle(f.sourceFilename, handle.data(), handle.size(), mGridname);
+        }
+        return readGridHandle(f.sourceFilename, f.pCachedData, f.cachedSize, mGridname);
+    }
+
+    nanovdb::GridHandle<nanovdb::HostBuffer> StreamingGridSequence::readGridHandle(const std::string& sourceFilename, const uint8_t* pCachedData, size_t cachedSize, const std::string& gridname)
+    {
+        if (pCachedData)
+        {
+            // Copy the grid out of memory, usually the memory-mapped scene cache. Only the pages of this frame are read from disk.
+            auto buffer = nanovdb::HostBuffer::create(cachedSize);
+            std::memcpy(buffer.data(), pCachedData, cachedSize);
+            return nanovdb::GridHandle<nanovdb::HostBuffer>(std::move(buffer));
+        }
+        if (sourceFilename.empty()) return {};
+        return Grid::readGridHandle(sourceFilename, gridname);
+    }
+
+    void StreamingGridSequence::startLoad(uint32_t frame)
+    {
+        auto& f = mFrames[frame];
+        assert(!f.pGrid && !f.pending.isValid());
+
+        // The task only captures copies, so it can outlive the sequence. The cache file is kept mapped while the task runs.
+        f.pending = Threading::async([sourceFilename = f.sourceFilename, pCachedData = f.pCachedData, cachedSize = f.cachedSize, gridname = mGridname, pCacheFile = mpCacheFile]()
+        {
+            auto handle = readGridHandle(sourceFilename, pCachedData, cachedSize, gridname);
+            if (!handle) return Grid::SharedPtr();
+
+            auto pGrid = Grid::SharedPtr(new Grid(std::move(handle), false));
+            pGrid->mSourceFilename = sourceFilename;
+            pGrid->mGridname = gridname;
+            return pGrid;
+        });
+        mPendingFrames.push_back(frame);
+    }
+
+    void StreamingGridSequence::finishLoad(uint32_t frame)
+    {
+        auto& f = mFrames[frame];
+        try
+        {
+            f.pGrid = f.pending.get();
+        }
+        catch (const std::exception& e)
+        {
+            logWarning("Error when loading grid '" + mGridname + "' from '" + f.sourceFilename + "': " + e.what());
+        }
+        f.pending = {};
+
+        if (!f.pGrid)
+        {
+            f.failed = true;
+            return;
+        }
+
+        f.pGrid->createResources();
+        f.sizeInBytes = f.pGrid->getHostSizeInBytes() + f.pGrid->getGridSizeInBytes();
+        mResidentBytes += f.sizeInBytes;
+        mResidentFrameCount++;
+        mStats.loadCount++;
+    }
+
+    void StreamingGridSequence::collectLoads()
+    {
+        bool loaded = false;
+        for (auto it = mPendingFrames.begin(); it != mPendingFrames.end();)
+        {
+            if (!mFrames[*it].pending.isRunning())
+            {
+                finishLoad(*it);
+                it = mPendingFrames.erase(it);
+                loaded = true;
+            }
+            else ++it;
+        }
+        if (loaded) trim();
+    }
+
+    void StreamingGridSequence::trim()
+    {
+        while (mResidentBytes > mMaxResidentBytes)
+        {
+            // Evict the least recently used frame, except for the current frame.
+            Frame* pEvict = nullptr;
+            for (uint32_t i = 0; i < (uint32_t)mFrames.size(); ++i)
+            {
+                auto& f = mFrames[i];
+                if (f.pGrid && i != mCurrentFrame && (!pEvict || f.lastUse < pEvict->lastUse)) pEvict = &f;
+            }
+            if (!pEvict) break;
+
+            // The GPU resources are released once the GPU is done with them.
+            pEvict->pGrid = nullptr;
+            mResidentBytes -= pEvict->sizeInBytes;
+            pEvict->sizeInBytes = 0;
+            mResidentFrameCount--;
+            mStats.evictionCount++;
+        }
+    }
+
+    SCRIPT_BINDING(StreamingGridSequence)
+    {
+        SCRIPT_BINDING_DEPENDENCY(Grid)
+
+        pybind11::class_<StreamingGridSequence, StreamingGridSequence::SharedPtr> sequence(m, "StreamingGridSequence");
+        sequence.def_property_readonly("frameCount", &StreamingGridSequence::getFrameCount);
+        sequence.def_property_readonly("gridname", &StreamingGridSequence::getGridname);
+        sequence.def_property_readonly("residentBytes", &StreamingGridSequence::getResidentBytes);
+        sequence.def_property_readonly("residentFrameCount", &StreamingGridSequence::getResidentFrameCount);
+        sequence.def_property("maxResidentBytes", &StreamingGridSequence::getMaxResidentBytes, &StreamingGridSequence::setMaxResidentBytes);
+        sequence.def_property("prefetchFrameCount", &StreamingGridSequence::getPrefetchFrameCount, &StreamingGridSequence::setPrefetchFrameCount);
+        sequence.def("getFrame", &StreamingGridSequence::getFrame, "frame"_a);
+        sequence.def_static("create", &StreamingGridSequence::create, "filenames"_a, "gridname"_a);
+    }
+}
@@ -0,0 +1,171 @@
+/***************************************************************************
+ # Copyright (c) 2015-21, NVIDIA CORPORATION. All rights reserved.
+ #
+ # Redistribution and use in source and binary forms, with or without
+ # modification, are permitted provided that the following conditions
+ # are met:
+ #  * Redistributions of source code must retain the above copyright
+ #    notice, this list of conditions and the following disclaimer.
+ #  * Redistributions in binary form must reproduce the above copyright
+ #    notice, this list of conditions and the following disclaimer in the
+ #    documentation and/or other materials provided with the distribution.
+ #  * Neither the name of NVIDIA CORPORATION nor the names of its
+ #    contributors may be used to endorse or promote products derived
+ #    from this software without specific prior written permission.
+ #
+ # THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS "AS IS" AND ANY
+ # EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ # IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ # PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+ # CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ # EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ # PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ # PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+ # OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ # (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ # OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ **************************************************************************/
+#pragma once
+#include "Grid.h"
+
+namespace Falcor
+{
+    /** Sequence of grids that is streamed from files during playback.
+        Only a bounded set of frames is resident at a time. Loaded frames are kept in a least-recently-used cache
+        that is trimmed to a budget of resident bytes, and upcoming frames are loaded on the thread pool ahead of playback.
+        Frames restored from the scene cache are read from the memory-mapped cache file instead of the source files.
+        Files are read and converted to bricks on worker threads. GPU resources are created on the main thread
+        when a loaded frame is first requested.
+    */
+    class dlldecl StreamingGridSequence
+    {
+    public:
+        using SharedPtr = std::shared_ptr<StreamingGridSequence>;
+
+        static const uint64_t kDefaultMaxResidentBytes = 4ull << 30;
+        static const uint32_t kDefaultPrefetchFrameCount = 4;
+
+        /** Streaming statistics.
+        */
+        struct Stats
+        {
+            uint64_t loadCount = 0;         ///< Number of frames loaded.
+            uint64_t prefetchCount = 0;     ///< Number of frames loaded ahead of playback.
+            uint64_t hitCount = 0;          ///< Number of frame requests served by a resident frame.
+            uint64_t stallCount = 0;        ///< Number of frame requests that had to wait for the frame to load.
+            uint64_t evictionCount = 0;     ///< Number of frames evicted from the cache.
+            double stallTime = 0.0;         ///< Total time spent waiting for frames to load in milliseconds.
+        };
+
+        /** Create a streamed sequence from files.
+            Only the file names are resolved here, frames are loaded on demand.
+            \param[in] filenames Filenames of the grids. Can also include a full path or relative path from a data directory.
+            \param[in] gridname Name of the grid to load from each file.
+            \return A new sequence.
+        */
+        static SharedPtr create(const std::vector<std::string>& filenames, const std::string& gridname);
+
+        ~StreamingGridSequence();
+
+        /** Render the UI.
+        */
+        void renderUI(Gui::Widgets& widget);
+
+        /** Get the number of frames in the sequence.
+        */
+        uint32_t getFrameCount() const { return (uint32_t)mFrames.size(); }
+
+        /** Get the name of the grid loaded from each file.
+        */
+        const std::string& getGridname() const { return mGridname; }
+
+        /** Get the full path of the file a frame is loaded from.
+            \return Returns the path, or an empty string if the file was not found.
+        */
+        const std::string& getSourceFilename(uint32_t frame) const { return mFrames.at(frame).sourceFilename; }
+
+        /** Get the grid of a frame, loading it if it is not resident.
+            Must be called from the main thread, as it creates the GPU resources of newly loaded frames.
+            \param[in] frame Frame index.
+            \return The grid, or nullptr if the frame failed to load.
+        */
+        Grid::SharedPtr getFrame(uint32_t frame);
+
+        /** Start loading the frames following the current frame in the direction of playback.
+            Frames are loaded in the background as long as they fit within the budget of resident bytes.
+            \param[in] frame Current frame.
+            \param[in] step Number of frames playback advances per update. Negative when playing backwards.
+        */
+        void prefetch(uint32_t frame, int32_t step);
+
+        /** Set the budget of resident bytes (host and GPU memory) for loaded frames.
+            Frames are evicted in least-recently-used order when the budget is exceeded.
+            The most recently requested frame is always kept resident, even if it exceeds the budget on its own.
+        */
+        void setMaxResidentBytes(uint64_t maxResidentBytes);
+
+        /** Get the budget of resident bytes.
+        */
+        uint64_t getMaxResidentBytes() const { return mMaxResidentBytes; }
+
+        /** Get the number of bytes (host and GPU memory) used by the resident frames.
+        */
+        uint64_t getResidentBytes() const { return mResidentBytes; }
+
+        /** Get the number of resident frames.
+        */
+        uint32_t getResidentFrameCount() const { return mResidentFrameCount; }
+
+        /** Set the number of frames to load ahead of playback.
+        */
+        void setPrefetchFrameCount(uint32_t prefetchFrameCount) { mPrefetchFrameCount = prefetchFrameCount; }
+
+        /** Get the number of frames to load ahead of playback.
+        */
+        uint32_t getPrefetchFrameCount() const { return mPrefetchFrameCount; }
+
+        /** Get the streaming statistics.
+        */
+        const Stats& getStats() const { return mStats; }
+
+    private:
+        struct Frame
+        {
+            std::string sourceFilename;             ///< Full path of the source file, or empty if not found.
+            const uint8_t* pCachedData = nullptr;   ///< NanoVDB grid in the memory-mapped scene cache, if any.
+            size_t cachedSize = 0;
+            Grid::SharedPtr pGrid;                  ///< Loaded grid, or nullptr if not resident.
+            Threading::Future<Grid::SharedPtr> pending; ///< Pending load.
+            uint64_t lastUse = 0;                   ///< Value of the use counter when the frame was last requested.
+            uint64_t sizeInBytes = 0;               ///< Resident bytes of the loaded grid.
+            bool failed = false;                    ///< True if the frame failed to load.
+        };
+
+        StreamingGridSequence(const std::string& gridname) : mGridname(gridname) {}
+
+        /** Read the NanoVDB grid of a frame into a grid handle, either from the scene cache or from the source file.
+            Used by the scene cache to serialize frames one at a time.
+        */
+        nanovdb::GridHandle<nanovdb::HostBuffer> readGridHandle(uint32_t frame) const;
+        static nanovdb::GridHandle<nanovdb::HostBuffer> readGridHandle(const std::string& sourceFilename, const uint8_t* pCachedData, size_t cachedSize, const std::string& gridname);
+
+        void startLoad(uint32_t frame);
+        void finishLoad(uint32_t frame);
+        void collectLoads();
+        void trim();
+
+        std::string mGridname;
+        std::vector<Frame> mFrames;
+        MemoryMappedFile::SharedPtr mpCacheFile;    ///< Mapped scene cache file holding cached frames.
+        uint64_t mMaxResidentBytes = kDefaultMaxResidentBytes;
+        uint32_t mPrefetchFrameCount = kDefaultPrefetchFrameCount;
+        uint64_t mResidentBytes = 0;
+        uint32_t mResidentFrameCount = 0;
+        std::vector<uint32_t> mPendingFrames;       ///< Frames with a pending load.
+        uint64_t mUseCounter = 0;
+        uint32_t mCurrentFrame = 0;
+        Stats mStats;
+
+        friend class SceneCache;
+    };
+}
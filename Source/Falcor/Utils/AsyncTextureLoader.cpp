@@ -27,92 +27,818 @@
  **************************************************************************/
 #include "stdafx.h"
 #include "AsyncTextureLoader.h"
+#include "Utils/Image/ImageIO.h"
+#include "Utils/CryptoUtils.h"
+#include "Utils/Math/Float16.h"
+#include "Utils/Color/ColorHelpers.slang"
+#include <array>
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <sstream>
+#include <thread>
 
 namespace Falcor
 {
     namespace
     {
-        constexpr size_t kUploadsPerFlush = 16; ///< Number of texture uploads before issuing a flush (to keep upload heap from growing).
+        const bool kTopDown = true; // Memory layout when loading from file
+
+        const std::string kCacheDirectory = "NVIDIA/Falcor/TextureCache";
+        const uint32_t kCacheVersion = 1; // Increment when the transcoding changes to invalidate cached textures.
+
+        using Clock = std::chrono::steady_clock;
+
+        double getElapsedSeconds(Clock::time_point start)
+        {
+            return std::chrono::duration<double>(Clock::now() - start).count();
+        }
+
+        bool readFile(const std::string& path, std::vector<uint8_t>& data)
+        {
+            std::ifstream stream(path, std::ios::binary | std::ios::ate);
+            if (!stream) return false;
+
+            std::streamsize size = stream.tellg();
+            if (size <= 0) return false;
+
+            data.resize((size_t)size);
+            stream.seekg(0);
+            return (bool)stream.read(reinterpret_cast<char*>(data.data()), size);
+        }
+
+        enum class ChannelType
+        {
+            Unorm8,
+            Unorm16,
+            Float16,
+            Float32,
+            Unsupported,
+        };
+
+        ChannelType getChannelType(ResourceFormat format)
+        {
+            switch (format)
+            {
+            case ResourceFormat::R8Unorm:
+            case ResourceFormat::RG8Unorm:
+            case ResourceFormat::BGRA8Unorm:
+            case ResourceFormat::BGRX8Unorm:
+                return ChannelType::Unorm8;
+            case ResourceFormat::R16Unorm:
+                return ChannelType::Unorm16;
+            case ResourceFormat::RGBA16Float:
+                return ChannelType::Float16;
+            case ResourceFormat::RGB32Float:
+            case ResourceFormat::RGBA32Float:
+                return ChannelType::Float32;
+            default:
+                return ChannelType::Unsupported;
+            }
+        }
+
+        float srgbUnormToLinear(uint8_t v)
+        {
+            static const auto kTable = []()
+            {
+                std::array<float, 256> table;
+                for (uint32_t i = 0; i < 256; i++) table[i] = sRGBToLinear(i / 255.f);
+                return table;
+            }();
+            return kTable[v];
+        }
+
+        bool hasOpaqueAlpha(const Bitmap& bitmap)
+        {
+            const ResourceFormat format = bitmap.getFormat();
+            if (getFormatChannelCount(format) < 4) return true;
+
+            const size_t pixelCount = (size_t)bitmap.getWidth() * bitmap.getHeight();
+            switch (getChannelType(format))
+            {
+            case ChannelType::Unorm8:
+                for (size_t i = 0; i < pixelCount; i++) if (bitmap.getData()[i * 4 + 3] != 255) return false;
+                return true;
+            case ChannelType::Float16:
+            {
+                const auto pData = reinterpret_cast<const glm::detail::hdata*>(bitmap.getData());
+                for (size_t i = 0; i < pixelCount; i++) if (glm::detail::toFloat32(pData[i * 4 + 3]) != 1.f) return false;
+                return true;
+            }
+            case ChannelType::Float32:
+            {
+                const auto pData = reinterpret_cast<const float*>(bitmap.getData());
+                for (size_t i = 0; i < pixelCount; i++) if (pData[i * 4 + 3] != 1.f) return false;
+                return true;
+            }
+            default:
+                return false;
+            }
+        }
+
+        void writeCache(const std::filesystem::path& cachePath, const ImageIO::DDSImage& image)
+        {
+            // Write to a temporary file first so that other processes never see a partially written file.
+            // Several threads or processes may transcode the same texture at once, so the temporary file is unique per thread.
+            std::filesystem::path tmpPath = cachePath;
+            tmpPath += "." + std::to_string(std::hash<std::thread::id>()(std::this_thread::get_id())) + ".tmp";
+
+            try
+            {
+                std::filesystem::create_directories(cachePath.parent_path());
+                ImageIO::saveToDDS(tmpPath.string(), image);
+                std::filesystem::rename(tmpPath, cachePath);
+            }
+            catch (const std::exception& e)
+            {
+                logWarning("Failed to write texture cache file '" + cachePath.string() + "' (" + e.what() + ")");
+                std::error_code ec;
+                std::filesystem::remove(tmpPath, ec);
+            }
+        }
+
+        void logStage(std::string& msg, const char* name, const AsyncTextureLoader::Stats::Stage& stage)
+        {
+            msg += "\n  " + std::string(name) + ": " + std::to_string(stage.itemCount) + " textures, " + formatByteSize(stage.byteCount) +
+                " in " + std::to_string(stage.busyTime) + " s (" + formatByteSize((size_t)stage.getThroughput()) + "/s), max queue size " + std::to_string(stage.maxQueueSize);
+        }
     }
 
-    AsyncTextureLoader::AsyncTextureLoader(size_t threadCount)
+    struct AsyncTextureLoader::Request
     {
-        runWorkers(threadCount);
+        std::string fullpath;
+        bool generateMipLevels;
+        bool loadAsSrgb;
+        Resource::BindFlags bindFlags;
+        Compression compression;
+        Priority priority;
+        uint64_t sequence;
+        Queue* pQueue = nullptr;                            ///< Queue the request is currently waiting in, or nullptr if it is being processed.
+        std::vector<std::promise<Texture::SharedPtr>> promises;
+
+        // Result.
+        bool done = false;
+        Texture::SharedPtr pTexture;
+
+        // Intermediate data passed between the stages.
+        std::vector<uint8_t> fileData;
+        Bitmap::UniqueConstPtr pBitmap;
+        ImageIO::DDSImage ddsImage;
+        bool isDDS = false;
+        ResourceFormat format = ResourceFormat::Unknown;    ///< Texture format.
+        uint32_t width = 0;
+        uint32_t height = 0;
+        uint32_t mipCount = 1;
+        std::vector<uint8_t> mipData;                       ///< Packed mip-chain if mips were generated on the CPU.
+        bool transcode = false;                             ///< True if the texture is compressed and written to the texture cache.
+        ImageIO::CompressionMode compressionMode = ImageIO::CompressionMode::None;
+        std::filesystem::path cachePath;
+        uint64_t byteSize = 0;                              ///< Number of bytes of intermediate data currently held.
+    };
+
+    AsyncTextureLoader::AsyncTextureLoader(const Options& options)
+        : mOptions(options)
+    {
+        for (uint32_t i = 0; i < std::max(1u, mOptions.readThreadCount); i++)
+        {
+            mThreads.emplace_back(&AsyncTextureLoader::runReadThread, this);
+        }
+        mThreads.emplace_back(&AsyncTextureLoader::runUploadThread, this);
     }
 
     AsyncTextureLoader::~AsyncTextureLoader()
     {
+        {
+            std::unique_lock<std::mutex> lock(mMutex);
+            mCondition.wait(lock, [&] () { return mPendingCount == 0 && mRunningTasks == 0; });
+        }
+
         terminateWorkers();
 
         gpDevice->flushAndSync();
+
+        if (mStats.requestCount > 0)
+        {
+            std::string msg = "AsyncTextureLoader: " + std::to_string(mStats.requestCount) + " requests (" + std::to_string(mStats.duplicateCount) + " duplicates, " +
+                std::to_string(mStats.failedCount) + " failed, " + std::to_string(mStats.cacheHitCount) + " cache hits), " + std::to_string(mStats.flushCount) + " flushes.";
+            logStage(msg, "read", mStats.read);
+            logStage(msg, "decode", mStats.decode);
+            logStage(msg, "mips", mStats.mips);
+            logStage(msg, "transcode", mStats.transcode);
+            logStage(msg, "upload", mStats.upload);
+            logInfo(msg);
+        }
     }
 
-    std::future<Texture::SharedPtr> AsyncTextureLoader::loadFromFile(const std::string& filename, bool generateMipLevels, bool loadAsSrgb, Resource::BindFlags bindFlags)
+    std::vector<uint8_t> AsyncTextureLoader::generateMipChain(const Bitmap& bitmap, bool isSrgb, uint32_t mipCount)
+    {
+        const ResourceFormat format = bitmap.getFormat();
+        const ChannelType type = getChannelType(format);
+        const uint32_t channelCount = getFormatChannelCount(format);
+        const uint32_t colorChannelCount = channelCount == 4 ? 3 : channelCount;
+        assert(type != ChannelType::Unsupported);
+
+        size_t totalSize = 0;
+        for (uint32_t mip = 0; mip < mipCount; mip++)
+        {
+            uint32_t w = std::max(1u, bitmap.getWidth() >> mip);
+            uint32_t h = std::max(1u, bitmap.getHeight() >> mip);
+            totalSize += (size_t)getFormatRowPitch(format, w) * h;
+        }
+
+        std::vector<uint8_t> data(totalSize);
+        std::memcpy(data.data(), bitmap.getData(), bitmap.getSize());
+        uint8_t* pDst = data.data() + bitmap.getSize();
+
+        // Convert mip 0 to linear float values.
+        uint32_t srcWidth = bitmap.getWidth();
+        uint32_t srcHeight = bitmap.getHeight();
+        const size_t valueCount = (size_t)srcWidth * srcHeight * channelCount;
+        std::vector<float> src(valueCount);
+        for (size_t i = 0; i < valueCount; i++)
+        {
+            bool isColor = (i % channelCount) < colorChannelCount;
+            switch (type)
+            {
+            case ChannelType::Unorm8:
+            {
+                uint8_t v = bitmap.getData()[i];
+                src[i] = isSrgb && isColor ? srgbUnormToLinear(v) : v / 255.f;
+                break;
+            }
+            case ChannelType::Unorm16:
+                src[i] = reinterpret_cast<const uint16_t*>(bitmap.getData())[i] / 65535.f;
+                break;
+            case ChannelType::Float16:
+                src[i] = glm::detail::toFloat32(reinterpret_cast<const glm::detail::hdata*>(bitmap.getData())[i]);
+                break;
+            case ChannelType::Float32:
+                src[i] = reinterpret_cast<const float*>(bitmap.getData())[i];
+                break;
+            }
+        }
+
+        struct Tap
+        {
+            uint32_t i0, i1;
+            float w1;
+        };
+
+        auto computeTaps = [](uint32_t srcSize, uint32_t dstSize)
+        {
+            std::vector<Tap> taps(dstSize);
+            float scale = (float)srcSize / dstSize;
+            for (uint32_t i = 0; i < dstSize; i++)
+            {
+                float pos = std::max((i + 0.5f) * scale - 0.5f, 0.f);
+                uint32_t i0 = std::min((uint32_t)pos, srcSize - 1);
+                taps[i] = { i0, std::min(i0 + 1, srcSize - 1), pos - (float)i0 };
+            }
+            return taps;
+        };
+
+        std::vector<float> dst;
+        for (uint32_t mip = 1; mip < mipCount; mip++)
+        {
+            const uint32_t dstWidth = std::max(1u, srcWidth >> 1);
+            const uint32_t dstHeight = std::max(1u, srcHeight >> 1);
+            const auto tapsX = computeTaps(srcWidth, dstWidth);
+            const auto tapsY = computeTaps(srcHeight, dstHeight);
+
+            dst.resize((size_t)dstWidth * dstHeight * channelCount);
+            for (uint32_t y = 0; y < dstHeight; y++)
+            {
+                const Tap& ty = tapsY[y];
+                const float* pRow0 = src.data() + (size_t)ty.i0 * srcWidth * channelCount;
+                const float* pRow1 = src.data() + (size_t)ty.i1 * srcWidth * channelCount;
+                float* pOut = dst.data() + (size_t)y * dstWidth * channelCount;
+                for (uint32_t x = 0; x < dstWidth; x++)
+                {
+                    const Tap& tx = tapsX[x];
+                    for (uint32_t c = 0; c < channelCount; c++)
+                    {
+                        float top = glm::mix(pRow0[tx.i0 * channelCount + c], pRow0[tx.i1 * channelCount + c], tx.w1);
+                        float bottom = glm::mix(pRow1[tx.i0 * channelCount + c], pRow1[tx.i1 * channelCount + c], tx.w1);
+                        *pOut++ = glm::mix(top, bottom, ty.w1);
+                    }
+                }
+            }
+
+            // Encode the mip in the source format.
+            const size_t count = dst.size();
+            for (size_t i = 0; i < count; i++)
+            {
+                float v = dst[i];
+                switch (type)
+                {
+                case ChannelType::Unorm8:
+                    if (isSrgb && (i % channelCount) < colorChannelCount) v = linearToSRGB(v);
+                    pDst[i] = (uint8_t)(glm::clamp(v, 0.f, 1.f) * 255.f + 0.5f);
+                    break;
+                case ChannelType::Unorm16:
+                    reinterpret_cast<uint16_t*>(pDst)[i] = (uint16_t)(glm::clamp(v, 0.f, 1.f) * 65535.f + 0.5f);
+                    break;
+                case ChannelType::Float16:
+                    reinterpret_cast<glm::detail::hdata*>(pDst)[i] = glm::detail::toFloat16(v);
+                    break;
+                case ChannelType::Float32:
+                    reinterpret_cast<float*>(pDst)[i] = v;
+                    break;
+                }
+            }
+
+            pDst += (size_t)getFormatRowPitch(format, dstWidth) * dstHeight;
+            std::swap(src, dst);
+            srcWidth = dstWidth;
+            srcHeight = dstHeight;
+        }
+
+        assert(pDst == data.data() + data.size());
+        return data;
+    }
+
+    ImageIO::CompressionMode AsyncTextureLoader::selectCompressionMode(const Bitmap& bitmap, Compression compression, bool useBC7)
+    {
+        using CompressionMode = ImageIO::CompressionMode;
+
+        // Block compressed textures must have dimensions that are a multiple of the block size.
+        if (bitmap.getWidth() % 4 != 0 || bitmap.getHeight() % 4 != 0) return CompressionMode::None;
+
+        switch (bitmap.getFormat())
+        {
+        case ResourceFormat::R8Unorm:
+            return CompressionMode::BC4;
+        case ResourceFormat::RG8Unorm:
+            return CompressionMode::BC5;
+        case ResourceFormat::BGRA8Unorm:
+        case ResourceFormat::BGRX8Unorm:
+            if (compression == Compression::Normal) return CompressionMode::BC5;
+            if (useBC7) return CompressionMode::BC7;
+            return bitmap.getFormat() == ResourceFormat::BGRX8Unorm || hasOpaqueAlpha(bitmap) ? CompressionMode::BC1 : CompressionMode::BC3;
+        case ResourceFormat::RGB32Float:
+        case ResourceFormat::RGBA16Float:
+        case ResourceFormat::RGBA32Float:
+            // BC6H has no alpha channel.
+            return compression == Compression::Color && hasOpaqueAlpha(bitmap) ? CompressionMode::BC6 : CompressionMode::None;
+        default:
+            // Keep 16-bit unorm data at full precision.
+            return CompressionMode::None;
+        }
+    }
+
+    std::future<Texture::SharedPtr> AsyncTextureLoader::loadFromFile(const std::string& filename, bool generateMipLevels, bool loadAsSrgb, Resource::BindFlags bindFlags, Priority priority)
+    {
+        return request(filename, generateMipLevels, loadAsSrgb, bindFlags, Compression::None, priority);
+    }
+
+    std::future<Texture::SharedPtr> AsyncTextureLoader::loadCompressedFromFile(const std::string& filename, bool loadAsSrgb, Compression compression, Priority priority)
+    {
+        return request(filename, true, loadAsSrgb, Resource::BindFlags::ShaderResource, compression, priority);
+    }
+
+    AsyncTextureLoader::Stats AsyncTextureLoader::getStats() const
     {
         std::lock_guard<std::mutex> lock(mMutex);
-        mRequestQueue.push(Request{filename, generateMipLevels, loadAsSrgb, bindFlags});
-        mCondition.notify_one();
-        return mRequestQueue.back().promise.get_future();
+        return mStats;
     }
 
-    void AsyncTextureLoader::runWorkers(size_t threadCount)
+    std::future<Texture::SharedPtr> AsyncTextureLoader::request(const std::string& filename, bool generateMipLevels, bool loadAsSrgb, Resource::BindFlags bindFlags, Compression compression, Priority priority)
     {
-        // Create a barrier to synchronize worker threads before issuing a global flush.
-        auto barrier = std::make_shared<Barrier>(threadCount, [&] () {
-            gpDevice->flushAndSync();
-            mFlushPending = false;
-            mUploadCounter = 0;
-        });
+        std::promise<Texture::SharedPtr> promise;
+        auto future = promise.get_future();
+
+        std::string fullpath;
+        if (findFileInDataDirectories(filename, fullpath) == false)
+        {
+            logWarning("Error when loading image file. Can't find image file '" + filename + "'");
+            promise.set_value(nullptr);
+            return future;
+        }
+
+        std::string key = fullpath + "|" + (generateMipLevels ? "1" : "0") + (loadAsSrgb ? "1" : "0") + "|" + std::to_string((uint32_t)bindFlags) + "|" + std::to_string((uint32_t)compression);
+
+        std::lock_guard<std::mutex> lock(mMutex);
+        mStats.requestCount++;
+
+        auto& pRequest = mRequests[key];
+        if (pRequest)
+        {
+            mStats.duplicateCount++;
+            if (pRequest->done)
+            {
+                promise.set_value(pRequest->pTexture);
+                return future;
+            }
+
+            pRequest->promises.push_back(std::move(promise));
+
+            // Raise the priority of the pending request. The old queue entry is skipped when it is popped.
+            if (priority > pRequest->priority)
+            {
+                pRequest->priority = priority;
+                if (pRequest->pQueue) pRequest->pQueue->push(QueueEntry{ priority, pRequest->sequence, pRequest });
+            }
+            return future;
+        }
+
+        pRequest = std::make_shared<Request>();
+        pRequest->fullpath = fullpath;
+        pRequest->generateMipLevels = generateMipLevels;
+        pRequest->loadAsSrgb = loadAsSrgb;
+        pRequest->bindFlags = bindFlags;
+        pRequest->compression = compression;
+        pRequest->priority = priority;
+        pRequest->sequence = mSequence++;
+        pRequest->promises.push_back(std::move(promise));
+
+        mPendingCount++;
+        push(mReadQueue, mStats.read, pRequest);
+        mCondition.notify_all();
+        return future;
+    }
+
+    bool AsyncTextureLoader::loadFromCache(Request& request)
+    {
+        // The cache key covers the contents of the source file and all flags that affect the transcoded texture.
+        SHA1 sha1;
+        sha1.update(request.fileData.data(), request.fileData.size());
+        sha1.update(&kCacheVersion, sizeof(kCacheVersion));
+        sha1.update(&request.loadAsSrgb, sizeof(request.loadAsSrgb));
+        sha1.update(&request.compression, sizeof(request.compression));
+        sha1.update(&mOptions.useBC7, sizeof(mOptions.useBC7));
+
+        std::filesystem::path cacheDirectory = mOptions.cacheDirectory.empty() ? std::filesystem::path(getAppDataDirectory()) / kCacheDirectory : std::filesystem::path(mOptions.cacheDirectory);
+        request.cachePath = std::filesystem::absolute(cacheDirectory) / (SHA1::toHexString(sha1.final()) + ".dds");
+
+        std::vector<uint8_t> cacheData;
+        if (!readFile(request.cachePath.string(), cacheData)) return false;
+
+        try
+        {
+            // The cached texture stores the final (possibly sRGB) format.
+            request.ddsImage = ImageIO::loadDDSFromMemory(cacheData.data(), cacheData.size(), false);
+            request.isDDS = true;
+            return true;
+        }
+        catch (const std::exception& e)
+        {
+            logWarning("Failed to load texture cache file '" + request.cachePath.string() + "' (" + e.what() + "). Transcoding again.");
+            return false;
+        }
+    }
 
-        // Start worker threads.
-        for (size_t i = 0; i < threadCount; ++i)
+    void AsyncTextureLoader::runReadThread()
+    {
+        while (true)
         {
-            mThreads.emplace_back([&, barrier] () {
-                while (true)
+            // Wait until there is a request to read and the downstream stages have capacity.
+            std::unique_lock<std::mutex> lock(mMutex);
+            mCondition.wait(lock, [&] () {
+                bool hasCapacity = mTexturesInFlight == 0 || (mTexturesInFlight < mOptions.maxTexturesInFlight && mBytesInFlight < mOptions.maxBytesInFlight);
+                return mTerminate || (!mReadQueue.empty() && hasCapacity);
+            });
+
+            if (mTerminate) break;
+
+            RequestPtr pRequest = pop(mReadQueue);
+            if (!pRequest) continue;
+            mTexturesInFlight++;
+            mStats.peakTexturesInFlight = std::max(mStats.peakTexturesInFlight, mTexturesInFlight);
+
+            lock.unlock();
+
+            auto startTime = Clock::now();
+            bool success = readFile(pRequest->fullpath, pRequest->fileData);
+            if (!success) logWarning("Error when loading image file. Can't read image file '" + pRequest->fullpath + "'");
+            double time = getElapsedSeconds(startTime);
+
+            lock.lock();
+
+            mStats.read.itemCount++;
+            mStats.read.byteCount += pRequest->fileData.size();
+            mStats.read.busyTime += time;
+            pRequest->byteSize = pRequest->fileData.size();
+            mBytesInFlight += pRequest->byteSize;
+            mStats.peakBytesInFlight = std::max(mStats.peakBytesInFlight, mBytesInFlight);
+
+            if (!success)
+            {
+                complete(pRequest, nullptr);
+                continue;
+            }
+
+            push(mDecodeQueue, mStats.decode, pRequest);
+            dispatchTask(&AsyncTextureLoader::decode);
+        }
+    }
+
+    void AsyncTextureLoader::decode()
+    {
+        RequestPtr pRequest;
+        {
+            std::lock_guard<std::mutex> lock(mMutex);
+            pRequest = pop(mDecodeQueue);
+        }
+        if (!pRequest) return;
+
+        auto startTime = Clock::now();
+        uint64_t byteSize = 0;
+        bool cacheHit = false;
+        try
+        {
+            const bool isSourceDDS = hasSuffix(pRequest->fullpath, ".dds", false);
+            if (pRequest->compression != Compression::None && !isSourceDDS && loadFromCache(*pRequest))
+            {
+                cacheHit = true;
+                byteSize = pRequest->ddsImage.dataSize;
+            }
+            else if (isSourceDDS)
+            {
+                pRequest->ddsImage = ImageIO::loadDDSFromMemory(pRequest->fileData.data(), pRequest->fileData.size(), pRequest->loadAsSrgb);
+                pRequest->isDDS = true;
+                byteSize = pRequest->ddsImage.dataSize;
+            }
+            else
+            {
+                pRequest->pBitmap = Bitmap::createFromMemory(pRequest->fileData.data(), pRequest->fileData.size(), pRequest->fullpath, kTopDown);
+                if (pRequest->pBitmap)
                 {
-                    // Wait on condition until more work is ready.
-                    std::unique_lock<std::mutex> lock(mMutex);
-                    mCondition.wait(lock, [&] () { return mTerminate || !mRequestQueue.empty() || mFlushPending; });
+                    ResourceFormat format = pRequest->pBitmap->getFormat();
+                    pRequest->format = pRequest->loadAsSrgb ? linearToSrgbFormat(format) : format;
+                    pRequest->width = pRequest->pBitmap->getWidth();
+                    pRequest->height = pRequest->pBitmap->getHeight();
+                    byteSize = pRequest->pBitmap->getSize();
+                }
+            }
+        }
+        catch (const std::exception& e)
+        {
+            logWarning("Error when loading image file '" + pRequest->fullpath + "' (" + e.what() + ")");
+        }
+        std::vector<uint8_t>().swap(pRequest->fileData);
+        bool success = pRequest->isDDS || pRequest->pBitmap;
 
-                    // Sync thread if a flush is pending.
-                    if (mFlushPending)
-                    {
-                        lock.unlock();
-                        barrier->wait();
-                        mCondition.notify_one();
-                        continue;
-                    }
+        // Decide if the mips should be generated on the CPU. Transcoding always generates the mips on the CPU.
+        bool generateMips = false;
+        if (pRequest->pBitmap && pRequest->generateMipLevels)
+        {
+            pRequest->mipCount = bitScanReverse(pRequest->width | pRequest->height) + 1;
+            bool canGenerateMips = getChannelType(pRequest->pBitmap->getFormat()) != ChannelType::Unsupported;
+            pRequest->transcode = pRequest->compression != Compression::None && canGenerateMips;
+            if (pRequest->transcode) pRequest->compressionMode = selectCompressionMode(*pRequest->pBitmap, pRequest->compression, mOptions.useBC7);
+            generateMips = pRequest->transcode || (mOptions.generateMipsOnCPU && pRequest->mipCount > 1 && canGenerateMips);
+        }
+        double time = getElapsedSeconds(startTime);
 
-                    // Terminate thread unless there is more work to do.
-                    if (mTerminate && mRequestQueue.empty() && !mFlushPending) break;
+        std::lock_guard<std::mutex> lock(mMutex);
+        mStats.decode.itemCount++;
+        mStats.decode.byteCount += byteSize;
+        mStats.decode.busyTime += time;
+        if (cacheHit) mStats.cacheHitCount++;
+        mBytesInFlight = mBytesInFlight - pRequest->byteSize + byteSize;
+        mStats.peakBytesInFlight = std::max(mStats.peakBytesInFlight, mBytesInFlight);
+        pRequest->byteSize = byteSize;
 
-                    // Go back waiting if queue is currently empty.
-                    if (mRequestQueue.empty()) continue;
+        if (!success)
+        {
+            complete(pRequest, nullptr);
+        }
+        else if (generateMips)
+        {
+            push(mMipQueue, mStats.mips, pRequest);
+            dispatchTask(&AsyncTextureLoader::generateMips);
+        }
+        else
+        {
+            push(mUploadQueue, mStats.upload, pRequest);
+            mCondition.notify_all();
+        }
+    }
 
-                    // Pop next loading request from queue.
-                    auto request = std::move(mRequestQueue.front());
-                    mRequestQueue.pop();
+    void AsyncTextureLoader::generateMips()
+    {
+        RequestPtr pRequest;
+        {
+            std::lock_guard<std::mutex> lock(mMutex);
+            pRequest = pop(mMipQueue);
+        }
+        if (!pRequest) return;
 
-                    lock.unlock();
+        auto startTime = Clock::now();
+        uint64_t byteSize = pRequest->byteSize;
+        try
+        {
+            pRequest->mipData = generateMipChain(*pRequest->pBitmap, isSrgbFormat(pRequest->format), pRequest->mipCount);
+            byteSize = pRequest->mipData.size();
+            pRequest->pBitmap.reset();
+        }
+        catch (const std::exception& e)
+        {
+            // Fall back to generating the mips on the GPU.
+            logWarning("Failed to generate mips on the CPU for image file '" + pRequest->fullpath + "' (" + e.what() + ")");
+        }
+        double time = getElapsedSeconds(startTime);
 
-                    // Load the textures (this part is running in parallel).
-                    Texture::SharedPtr pTexture = Texture::createFromFile(request.filename, request.generateMipLevels, request.loadAsSrgb, request.bindFlags);
-                    request.promise.set_value(pTexture);
+        std::lock_guard<std::mutex> lock(mMutex);
+        mStats.mips.itemCount++;
+        mStats.mips.byteCount += byteSize;
+        mStats.mips.busyTime += time;
+        mBytesInFlight = mBytesInFlight - pRequest->byteSize + byteSize;
+        mStats.peakBytesInFlight = std::max(mStats.peakBytesInFlight, mBytesInFlight);
+        pRequest->byteSize = byteSize;
 
-                    lock.lock();
+        if (pRequest->transcode && !pRequest->mipData.empty())
+        {
+            push(mTranscodeQueue, mStats.transcode, pRequest);
+            dispatchTask(&AsyncTextureLoader::transcode);
+        }
+        else
+        {
+            push(mUploadQueue, mStats.upload, pRequest);
+            mCondition.notify_all();
+        }
+    }
 
-                    // Issue a global flush if necessary.
-                    // TODO: It would be better to check the size of the upload heap instead.
-                    if (!mTerminate && ++mUploadCounter >= kUploadsPerFlush)
-                    {
-                        mFlushPending = true;
-                        mCondition.notify_all();
-                    }
+    void AsyncTextureLoader::transcode()
+    {
+        RequestPtr pRequest;
+        {
+            std::lock_guard<std::mutex> lock(mMutex);
+            pRequest = pop(mTranscodeQueue);
+        }
+        if (!pRequest) return;
+
+        auto startTime = Clock::now();
+
+        ImageIO::DDSImage image;
+        image.type = Resource::Type::Texture2D;
+        image.format = pRequest->format;
+        image.width = pRequest->width;
+        image.height = pRequest->height;
+        image.depth = 1;
+        image.arraySize = 1;
+        image.mipLevels = pRequest->mipCount;
+        auto pMipData = std::make_shared<std::vector<uint8_t>>(std::move(pRequest->mipData));
+        image.pData = std::shared_ptr<const uint8_t>(pMipData, pMipData->data());
+        image.dataSize = pMipData->size();
+
+        try
+        {
+            pRequest->ddsImage = ImageIO::compressImage(image, pRequest->compressionMode);
+            writeCache(pRequest->cachePath, pRequest->ddsImage);
+        }
+        catch (const std::exception& e)
+        {
+            // Upload the uncompressed mip-chain instead.
+            logWarning("Failed to compress image file '" + pRequest->fullpath + "' (" + e.what() + ")");
+            pRequest->ddsImage = image;
+        }
+        pRequest->isDDS = true;
+        pRequest->mipData = {};
+        uint64_t byteSize = pRequest->ddsImage.dataSize;
+        double time = getElapsedSeconds(startTime);
+
+        std::lock_guard<std::mutex> lock(mMutex);
+        mStats.transcode.itemCount++;
+        mStats.transcode.byteCount += byteSize;
+        mStats.transcode.busyTime += time;
+        mBytesInFlight = mBytesInFlight - pRequest->byteSize + byteSize;
+        mStats.peakBytesInFlight = std::max(mStats.peakBytesInFlight, mBytesInFlight);
+        pRequest->byteSize = byteSize;
 
-                    mCondition.notify_one();
+        push(mUploadQueue, mStats.upload, pRequest);
+        mCondition.notify_all();
+    }
+
+    void AsyncTextureLoader::runUploadThread()
+    {
+        uint32_t uploadCount = 0;
+        uint64_t uploadBytes = 0;
+
+        while (true)
+        {
+            std::unique_lock<std::mutex> lock(mMutex);
+            mCondition.wait(lock, [&] () { return mTerminate || !mUploadQueue.empty(); });
+
+            RequestPtr pRequest = pop(mUploadQueue);
+            if (!pRequest)
+            {
+                if (mTerminate) break;
+                continue;
+            }
+
+            lock.unlock();
+
+            auto startTime = Clock::now();
+            Texture::SharedPtr pTexture;
+            try
+            {
+                const auto& request = *pRequest;
+                if (request.isDDS)
+                {
+                    pTexture = ImageIO::createTextureFromDDS(request.ddsImage, request.bindFlags);
                 }
-            });
+                else if (!request.mipData.empty())
+                {
+                    pTexture = Texture::create2D(request.width, request.height, request.format, 1, request.mipCount, request.mipData.data(), request.bindFlags);
+                }
+                else
+                {
+                    pTexture = Texture::create2D(request.width, request.height, request.format, 1, request.generateMipLevels ? Texture::kMaxPossible : 1, request.pBitmap->getData(), request.bindFlags);
+                }
+            }
+            catch (const std::exception& e)
+            {
+                logWarning("Error when creating texture for image file '" + pRequest->fullpath + "' (" + e.what() + ")");
+            }
+            if (pTexture) pTexture->setSourceFilename(pRequest->fullpath);
+
+            // Issue a global flush if necessary.
+            bool flush = false;
+            uploadBytes += pRequest->byteSize;
+            if (++uploadCount >= mOptions.maxUploadsPerFlush || uploadBytes >= mOptions.maxUploadBytesPerFlush)
+            {
+                gpDevice->flushAndSync();
+                uploadCount = 0;
+                uploadBytes = 0;
+                flush = true;
+            }
+            double time = getElapsedSeconds(startTime);
+
+            lock.lock();
+            mStats.upload.itemCount++;
+            mStats.upload.byteCount += pRequest->byteSize;
+            mStats.upload.busyTime += time;
+            if (flush) mStats.flushCount++;
+            complete(pRequest, pTexture);
+        }
+    }
+
+    void AsyncTextureLoader::push(Queue& queue, Stats::Stage& stage, const RequestPtr& pRequest)
+    {
+        pRequest->pQueue = &queue;
+        queue.push(QueueEntry{ pRequest->priority, pRequest->sequence, pRequest });
+        stage.maxQueueSize = std::max(stage.maxQueueSize, queue.size());
+    }
+
+    AsyncTextureLoader::RequestPtr AsyncTextureLoader::pop(Queue& queue)
+    {
+        while (!queue.empty())
+        {
+            QueueEntry entry = queue.top();
+            queue.pop();
+
+            // Skip entries left behind when the priority of a request was raised.
+            const RequestPtr& pRequest = entry.pRequest;
+            if (pRequest->pQueue != &queue || entry.priority != pRequest->priority) continue;
+
+            pRequest->pQueue = nullptr;
+            return pRequest;
         }
+        return nullptr;
+    }
+
+    void AsyncTextureLoader::complete(const RequestPtr& pRequest, const Texture::SharedPtr& pTexture)
+    {
+        // Called with the mutex locked.
+        pRequest->done = true;
+        pRequest->pTexture = pTexture;
+        for (auto& promise : pRequest->promises) promise.set_value(pTexture);
+        pRequest->promises.clear();
+
+        pRequest->fileData = {};
+        pRequest->pBitmap.reset();
+        pRequest->ddsImage = {};
+        pRequest->mipData = {};
+
+        if (!pTexture) mStats.failedCount++;
+        mBytesInFlight -= pRequest->byteSize;
+        pRequest->byteSize = 0;
+        mTexturesInFlight--;
+        mPendingCount--;
+        mCondition.notify_all();
+    }
+
+    void AsyncTextureLoader::dispatchTask(void (AsyncTextureLoader::*func)())
+    {
+        // Called with the mutex locked. Each task pops the highest priority request from its stage queue when it starts.
+        mRunningTasks++;
+        Threading::dispatchTask([this, func] () {
+            try
+            {
+                (this->*func)();
+            }
+            catch (const std::exception& e)
+            {
+                logError("AsyncTextureLoader task failed: " + std::string(e.what()));
+            }
+
+            // Notify while holding the lock so the loader can't be destroyed before the task is done with it.
+            std::lock_guard<std::mutex> lock(mMutex);
+            mRunningTasks--;
+            mCondition.notify_all();
+        });
     }
 
     void AsyncTextureLoader::terminateWorkers()
@@ -31,15 +31,87 @@
 
 namespace Falcor
 {
-    /** Utility class to load textures asynchronously using multiple worker threads.
+    /** Utility class to load textures asynchronously.
+
+        Textures are loaded in a staged pipeline:
+        - Read: dedicated I/O threads read the file contents into memory.
+        - Decode: the image is decoded (FreeImage or DDS) on the shared thread pool.
+        - Mips: the mip-chain is optionally generated on the CPU on the shared thread pool.
+        - Transcode: the texture is optionally block compressed on the shared thread pool and written to the texture cache.
+        - Upload: a single upload thread creates the texture and uploads the data.
+
+        The number of textures and bytes in flight between the read and upload stages is bounded,
+        so the stage queues cannot grow without limit when reading is faster than uploading.
+        Requests for the same file with the same flags are deduplicated, and requests with higher
+        priority are processed first in every stage.
     */
     class dlldecl AsyncTextureLoader
     {
     public:
+        /** Request priority. Requests of higher priority are processed first.
+        */
+        enum class Priority : uint32_t
+        {
+            Low,        ///< Background loading.
+            Normal,     ///< Default priority.
+            High,       ///< Textures that are needed immediately (e.g. UI or visible materials).
+        };
+
+        /** Block compression applied by loadCompressedFromFile().
+        */
+        enum class Compression : uint32_t
+        {
+            None,       ///< Load the texture as stored in the file.
+            Color,      ///< Compress to BC1/BC3 (or BC7), BC4, BC5 or BC6H depending on the image format.
+            Normal,     ///< Compress to BC5, keeping only the red and green channels (tangent space normal maps).
+        };
+
+        struct Options
+        {
+            uint32_t readThreadCount = 2;                   ///< Number of dedicated I/O threads.
+            uint32_t maxTexturesInFlight = 64;              ///< Maximum number of textures between the read and upload stages.
+            uint64_t maxBytesInFlight = 1ull << 30;         ///< Maximum number of bytes held between the read and upload stages.
+            uint32_t maxUploadsPerFlush = 16;               ///< Maximum number of texture uploads before issuing a flush (to keep upload heap from growing).
+            uint64_t maxUploadBytesPerFlush = 256ull << 20; ///< Maximum number of uploaded bytes before issuing a flush.
+            bool generateMipsOnCPU = true;                  ///< Generate mips for uncompressed 8-bit and float formats on the CPU instead of the GPU.
+            bool useBC7 = false;                            ///< Compress 8-bit color textures to BC7 instead of BC1/BC3. Higher quality, but much slower to encode.
+            std::string cacheDirectory;                     ///< Directory of the transcoded texture cache. If empty, a directory in the app data directory is used.
+        };
+
+        /** Throughput counters of the loading pipeline.
+        */
+        struct Stats
+        {
+            struct Stage
+            {
+                uint64_t itemCount = 0;     ///< Number of textures processed by the stage.
+                uint64_t byteCount = 0;     ///< Number of bytes produced by the stage.
+                double busyTime = 0.0;      ///< Accumulated processing time in seconds (summed over all threads of the stage).
+                size_t maxQueueSize = 0;    ///< Peak number of textures waiting for the stage.
+
+                /** Get the throughput in bytes per second of processing time.
+                */
+                double getThroughput() const { return busyTime > 0.0 ? byteCount / busyTime : 0.0; }
+            };
+
+            Stage read;
+            Stage decode;
+            Stage mips;
+            Stage transcode;
+            Stage upload;
+            uint64_t requestCount = 0;      ///< Number of calls to loadFromFile().
+            uint64_t duplicateCount = 0;    ///< Number of requests that were served from an earlier request for the same texture.
+            uint64_t failedCount = 0;       ///< Number of textures that failed to load.
+            uint64_t cacheHitCount = 0;     ///< Number of compressed textures that were loaded from the texture cache.
+            uint64_t flushCount = 0;        ///< Number of flushes issued by the upload stage.
+            uint32_t peakTexturesInFlight = 0;  ///< Peak number of textures between the read and upload stages.
+            uint64_t peakBytesInFlight = 0;     ///< Peak number of bytes held between the read and upload stages.
+        };
+
         /** Constructor.
-            \param[in] threadCount Number of worker threads.
+            \param[in] options Pipeline options.
         */
-        AsyncTextureLoader(size_t threadCount = std::thread::hardware_concurrency());
+        AsyncTextureLoader(const Options& options = Options());
 
         /** Destructor.
             Blocks until all textures are loaded.
@@ -47,33 +119,105 @@ namespace Falcor
         ~AsyncTextureLoader();
 
         /** Request loading a texture.
+            If the same file has already been requested with the same flags, the earlier request is reused.
             \param[in] filename Filename of the image. Can also include a full path or relative path from a data directory.
             \param[in] generateMipLevels Whether the mip-chain should be generated.
             \param[in] loadAsSrgb Load the texture using sRGB format. Only valid for 3 or 4 component textures.
             \param[in] bindFlags The bind flags to create the texture with.
+            \param[in] priority Request priority. A duplicate request with higher priority raises the priority of the pending request.
             \return A future to a new texture, or nullptr if the texture failed to load.
         */
-        std::future<Texture::SharedPtr> loadFromFile(const std::string& filename, bool generateMipLevels, bool loadAsSrgb, Resource::BindFlags bindFlags = Resource::BindFlags::ShaderResource);
+        std::future<Texture::SharedPtr> loadFromFile(const std::string& filename, bool generateMipLevels, bool loadAsSrgb, Resource::BindFlags bindFlags = Resource::BindFlags::ShaderResource, Priority priority = Priority::Normal);
+
+        /** Request loading a block-compressed texture with a full mip-chain.
+            The first time a texture is requested, the image is decoded, mips are generated and the mip-chain is
+            compressed on the CPU. The result is stored as a DDS file in the texture cache, keyed by the contents
+            of the source file and the load flags, so later requests skip decoding, mip generation and compression.
+            Images that can't be compressed (e.g. 16-bit unorm data or dimensions that are not a multiple of 4)
+            are cached with an uncompressed mip-chain. DDS files are loaded as stored.
+            \param[in] filename Filename of the image. Can also include a full path or relative path from a data directory.
+            \param[in] loadAsSrgb Load the texture using sRGB format. Only valid for 3 or 4 component textures.
+            \param[in] compression Compression to apply.
+            \param[in] priority Request priority.
+            \return A future to a new texture, or nullptr if the texture failed to load.
+        */
+        std::future<Texture::SharedPtr> loadCompressedFromFile(const std::string& filename, bool loadAsSrgb, Compression compression, Priority priority = Priority::Normal);
+
+        /** Get the pipeline throughput counters.
+        */
+        Stats getStats() const;
+
+        /** Generate the full mip-chain of an uncompressed image on the CPU. This is the mip stage of the pipeline.
+            Each mip is filtered from the previous one by sampling bilinearly at the texel centers, which is what the GPU mip generation does
+            (a 2x2 box filter for even dimensions). The color channels of sRGB formats are filtered in linear space.
+            \param[in] bitmap Source image (mip 0). Must be an 8-bit unorm, 16-bit unorm, 16-bit float or 32-bit float format.
+            \param[in] isSrgb True if the color channels are sRGB encoded.
+            \param[in] mipCount Number of mips to generate, including mip 0.
+            \return Data of all mips packed contiguously, as expected by Texture::create2D().
+        */
+        static std::vector<uint8_t> generateMipChain(const Bitmap& bitmap, bool isSrgb, uint32_t mipCount);
+
+        /** Select the block compression mode for a decoded image. This is used by the transcode stage of the pipeline.
+            \param[in] bitmap Decoded image.
+            \param[in] compression Requested compression.
+            \param[in] useBC7 Compress 8-bit color images to BC7 instead of BC1/BC3.
+            \return The compression mode, or CompressionMode::None if the image should be kept uncompressed.
+        */
+        static ImageIO::CompressionMode selectCompressionMode(const Bitmap& bitmap, Compression compression, bool useBC7);
 
     private:
-        void runWorkers(size_t threadCount);
-        void terminateWorkers();
+        struct Request;
+        using RequestPtr = std::shared_ptr<Request>;
 
-        struct Request
+        /** Queue entry of a pipeline stage. Entries are ordered by priority, then by submission order.
+        */
+        struct QueueEntry
         {
-            std::string filename;
-            bool generateMipLevels;
-            bool loadAsSrgb;
-            Resource::BindFlags bindFlags;
-            std::promise<Texture::SharedPtr> promise;
+            Priority priority;
+            uint64_t sequence;
+            RequestPtr pRequest;
+
+            bool operator<(const QueueEntry& other) const
+            {
+                // Inverted for std::priority_queue, which pops the largest element.
+                if (priority != other.priority) return priority < other.priority;
+                return sequence > other.sequence;
+            }
         };
 
-        std::queue<Request> mRequestQueue;      ///< Texture loading request queue.
-        std::condition_variable mCondition;     ///< Condition variable for workers to wait on.
-        std::mutex mMutex;                      ///< Mutex for synchronizing access to shared resources.
-        std::vector<std::thread> mThreads;      ///< Worker threads.
+        using Queue = std::priority_queue<QueueEntry>;
+
+        std::future<Texture::SharedPtr> request(const std::string& filename, bool generateMipLevels, bool loadAsSrgb, Resource::BindFlags bindFlags, Compression compression, Priority priority);
+        bool loadFromCache(Request& request);
+        void runReadThread();
+        void runUploadThread();
+        void decode();
+        void generateMips();
+        void transcode();
+        void push(Queue& queue, Stats::Stage& stage, const RequestPtr& pRequest);
+        RequestPtr pop(Queue& queue);
+        void complete(const RequestPtr& pRequest, const Texture::SharedPtr& pTexture);
+        void dispatchTask(void (AsyncTextureLoader::*func)());
+        void terminateWorkers();
+
+        Options mOptions;
+
+        std::unordered_map<std::string, RequestPtr> mRequests; ///< All requests by key (filename and flags).
+        Queue mReadQueue;                       ///< Requests waiting to be read.
+        Queue mDecodeQueue;                     ///< Requests waiting to be decoded.
+        Queue mMipQueue;                        ///< Requests waiting for CPU mip generation.
+        Queue mTranscodeQueue;                  ///< Requests waiting to be compressed and written to the texture cache.
+        Queue mUploadQueue;                     ///< Requests waiting to be uploaded.
+        uint64_t mSequence = 0;                 ///< Submission counter for FIFO ordering within a priority.
+        uint32_t mTexturesInFlight = 0;         ///< Number of textures between the read and upload stages.
+        uint64_t mBytesInFlight = 0;            ///< Number of bytes held between the read and upload stages.
+        uint32_t mPendingCount = 0;             ///< Number of requests that are not completed yet.
+        uint32_t mRunningTasks = 0;             ///< Number of decode/mip tasks running on the thread pool.
+        Stats mStats;
+
+        mutable std::mutex mMutex;              ///< Mutex for synchronizing access to shared resources.
+        std::condition_variable mCondition;     ///< Condition variable for threads to wait on.
+        std::vector<std::thread> mThreads;      ///< Read and upload threads.
         bool mTerminate = false;                ///< Flag to terminate worker threads.
-        bool mFlushPending = false;             ///< Flag to indicate a flush is pending.
-        uint32_t mUploadCounter = 0;            ///< Counter to issue a flush every few uploads.
     };
 }
@@ -0,0 +1,150 @@
+/***************************************************************************
+ # Copyright (c) 2015-21, NVIDIA CORPORATION. All rights reserved.
+ #
+ # Redistribution and use in source and binary forms, with or without
+ # modification, are permitted provided that the following conditions
+ # are met:
+ #  * Redistributions of source code must retain the above copyright
+ #    notice, this list of conditions and the following disclaimer.
+ #  * Redistributions in binary form must reproduce the above copyright
+ #    notice, this list of conditions and the following disclaimer in the
+ #    documentation and/or other materials provided with the distribution.
+ #  * Neither the name of NVIDIA CORPORATION nor the names of its
+ #    contributors may be used to endorse or promote products derived
+ #    from this software without specific prior written permission.
+ #
+ # THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS "AS IS" AND ANY
+ # EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ # IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ # PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+ # CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ # EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ # PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ # PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+ # OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ # (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ # OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ **************************************************************************/
+#include "stdafx.h"
+#include "CompressionUtils.h"
+
+#include <lz4.h>
+#include <atomic>
+#include <exception>
+#include <mutex>
+
+namespace Falcor
+{
+    namespace
+    {
+        /** Run func(index) for all indices in [0, count) on up to threadCount threads (including the calling thread).
+            The work is spread over the thread pool. The first exception thrown by any invocation is rethrown on the calling thread.
+        */
+        template<typename Func>
+        void parallelFor(size_t count, uint32_t threadCount, const Func& func)
+        {
+            if (threadCount == 0)
+            {
+                Threading::parallelFor(0, count, func, 1);
+                return;
+            }
+            threadCount = (uint32_t)std::max<size_t>(1, std::min<size_t>(threadCount, count));
+
+            std::atomic<size_t> next = 0;
+            std::exception_ptr pException;
+            std::mutex exceptionMutex;
+
+            auto worker = [&]()
+            {
+                try
+                {
+                    for (size_t i = next++; i < count; i = next++) func(i);
+                }
+                catch (...)
+                {
+                    std::lock_guard<std::mutex> lock(exceptionMutex);
+                    if (!pException) pException = std::current_exception();
+                    next = count;
+                }
+            };
+
+            Threading::TaskGroup group;
+            for (uint32_t i = 1; i < threadCount; ++i) group.run(worker);
+            worker();
+            group.wait();
+
+            if (pException) std::rethrow_exception(pException);
+        }
+    }
+
+    std::vector<uint8_t> ParallelLZ4::compress(const void* data, size_t size, std::vector<Frame>& frames, size_t frameSize, uint32_t threadCount)
+    {
+        assert(frameSize > 0 && frameSize <= LZ4_MAX_INPUT_SIZE);
+
+        const size_t frameCount = div_round_up(size, frameSize);
+        const uint8_t* pSrc = static_cast<const uint8_t*>(data);
+
+        // Compress frames into separate buffers.
+        std::vector<std::vector<uint8_t>> compressedFrames(frameCount);
+        frames.resize(frameCount);
+
+        parallelFor(frameCount, threadCount, [&](size_t i)
+        {
+            const size_t offset = i * frameSize;
+            const int srcSize = (int)std::min(frameSize, size - offset);
+            auto& dst = compressedFrames[i];
+            dst.resize(LZ4_compressBound(srcSize));
+            int compressedSize = LZ4_compress_default(reinterpret_cast<const char*>(pSrc + offset), reinterpret_cast<char*>(dst.data()), srcSize, (int)dst.size());
+            if (compressedSize <= 0) throw std::runtime_error("Failed to compress LZ4 frame!");
+            dst.resize(compressedSize);
+            frames[i].compressedSize = (uint32_t)compressedSize;
+            frames[i].size = (uint32_t)srcSize;
+        });
+
+        // Concatenate frames.
+        uint64_t offset = 0;
+        for (auto& frame : frames)
+        {
+            frame.offset = offset;
+            offset += frame.compressedSize;
+        }
+
+        std::vector<uint8_t> compressedData(offset);
+        parallelFor(frameCount, threadCount, [&](size_t i)
+        {
+            std::memcpy(compressedData.data() + frames[i].offset, compressedFrames[i].data(), frames[i].compressedSize);
+        });
+
+        return compressedData;
+    }
+
+    void ParallelLZ4::decompress(const void* compressedData, size_t compressedSize, const std::vector<Frame>& frames, void* data, uint32_t threadCount)
+    {
+        const uint8_t* pSrc = static_cast<const uint8_t*>(compressedData);
+        uint8_t* pDst = static_cast<uint8_t*>(data);
+
+        // Compute destination offsets.
+        std::vector<uint64_t> offsets(frames.size());
+        uint64_t offset = 0;
+        for (size_t i = 0; i < frames.size(); ++i)
+        {
+            if (frames[i].offset + frames[i].compressedSize > compressedSize) throw std::runtime_error("Invalid LZ4 frame table!");
+            offsets[i] = offset;
+            offset += frames[i].size;
+        }
+
+        parallelFor(frames.size(), threadCount, [&](size_t i)
+        {
+            const auto& frame = frames[i];
+            int size = LZ4_decompress_safe(reinterpret_cast<const char*>(pSrc + frame.offset), reinterpret_cast<char*>(pDst + offsets[i]), (int)frame.compressedSize, (int)frame.size);
+            if (size != (int)frame.size) throw std::runtime_error("Failed to decompress LZ4 frame!");
+        });
+    }
+
+    uint64_t ParallelLZ4::getDecompressedSize(const std::vector<Frame>& frames)
+    {
+        uint64_t size = 0;
+        for (const auto& frame : frames) size += frame.size;
+        return size;
+    }
+}
@@ -0,0 +1,75 @@
+/***************************************************************************
+ # Copyright (c) 2015-21, NVIDIA CORPORATION. All rights reserved.
+ #
+ # Redistribution and use in source and binary forms, with or without
+ # modification, are permitted provided that the following conditions
+ # are met:
+ #  * Redistributions of source code must retain the above copyright
+ #    notice, this list of conditions and the following disclaimer.
+ #  * Redistributions in binary form must reproduce the above copyright
+ #    notice, this list of conditions and the following disclaimer in the
+ #    documentation and/or other materials provided with the distribution.
+ #  * Neither the name of NVIDIA CORPORATION nor the names of its
+ #    contributors may be used to endorse or promote products derived
+ #    from this software without specific prior written permission.
+ #
+ # THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS "AS IS" AND ANY
+ # EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ # IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ # PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+ # CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ # EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ # PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ # PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+ # OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ # (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ # OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ **************************************************************************/
+#pragma once
+#include <cstdint>
+#include <vector>
+
+namespace Falcor
+{
+    /** Helper for LZ4 compression of large buffers.
+        The data is split into frames that are compressed independently. This allows compressing and decompressing
+        the frames in parallel, and decoding any subset of frames given the frame table.
+    */
+    class dlldecl ParallelLZ4
+    {
+    public:
+        static const size_t kDefaultFrameSize = 4 * 1024 * 1024;
+
+        /** Location of a compressed frame.
+        */
+        struct Frame
+        {
+            uint64_t offset = 0;            ///< Offset of the compressed frame in bytes.
+            uint32_t compressedSize = 0;    ///< Size of the compressed frame in bytes.
+            uint32_t size = 0;              ///< Size of the uncompressed frame in bytes.
+        };
+
+        /** Compress data.
+            \param[in] data Data to compress.
+            \param[in] size Size of data in bytes.
+            \param[out] frames Frame table.
+            \param[in] frameSize Uncompressed size of a frame in bytes. The last frame may be smaller.
+            \param[in] threadCount Number of threads to use, or 0 to use the whole thread pool.
+            \return Returns the compressed frames, stored back to back.
+        */
+        static std::vector<uint8_t> compress(const void* data, size_t size, std::vector<Frame>& frames, size_t frameSize = kDefaultFrameSize, uint32_t threadCount = 0);
+
+        /** Decompress data. Throws an exception if a frame fails to decode.
+            \param[in] compressedData Compressed frames.
+            \param[in] compressedSize Size of compressed data in bytes.
+            \param[in] frames Frame table.
+            \param[out] data Buffer receiving the decompressed data. Must be large enough to hold getDecompressedSize(frames) bytes.
+            \param[in] threadCount Number of threads to use, or 0 to use the whole thread pool.
+        */
+        static void decompress(const void* compressedData, size_t compressedSize, const std::vector<Frame>& frames, void* data, uint32_t threadCount = 0);
+
+        /** Get the total size of the decompressed data in bytes.
+        */
+        static uint64_t getDecompressedSize(const std::vector<Frame>& frames);
+    };
+}
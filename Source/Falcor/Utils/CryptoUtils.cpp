@@ -29,9 +29,18 @@
 #include "CryptoUtils.h"
 
 #include <openssl/sha.h>
+#include <fstream>
+#include <iomanip>
+#include <sstream>
+#include <vector>
 
 namespace Falcor
 {
+    namespace
+    {
+        const size_t kFileBlockSize = 4 * 1024 * 1024;
+    }
+
     SHA1::SHA1()
     {
         mpCtx = malloc(sizeof(SHA_CTX));
@@ -61,4 +70,29 @@ namespace Falcor
         ::SHA1(reinterpret_cast<const unsigned char*>(data), len, md.data());
         return md;
     }
+
+    bool SHA1::computeFile(const std::string& path, MD& md)
+    {
+        std::ifstream fs(path, std::ios_base::binary);
+        if (!fs) return false;
+
+        SHA1 sha1;
+        std::vector<char> buffer(kFileBlockSize);
+        while (fs)
+        {
+            fs.read(buffer.data(), buffer.size());
+            sha1.update(buffer.data(), (size_t)fs.gcount());
+        }
+        if (fs.bad()) return false;
+        md = sha1.final();
+        return true;
+    }
+
+    std::string SHA1::toHexString(const MD& md)
+    {
+        std::stringstream ss;
+        ss << std::hex << std::setfill('0');
+        for (auto c : md) ss << std::setw(2) << (int)c;
+        return ss.str();
+    }
 }
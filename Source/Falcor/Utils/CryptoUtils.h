@@ -28,6 +28,7 @@
 #pragma once
 #include <array>
 #include <cstdint>
+#include <string>
 
 namespace Falcor
 {
@@ -59,6 +60,19 @@ namespace Falcor
         */
         static MD compute(const void* data, size_t len);
 
+        /** Compute SHA-1 hash over the content of a file.
+            \param[in] path File path.
+            \param[out] md The message digest.
+            \return Returns true if the file could be read.
+        */
+        static bool computeFile(const std::string& path, MD& md);
+
+        /** Convert a message digest to a string of hexadecimal digits, e.g. for use as a file name.
+            \param[in] md Message digest.
+            \return Returns the digest as a 40 character lowercase hex string.
+        */
+        static std::string toHexString(const MD& md);
+
     private:
         void* mpCtx;
     };
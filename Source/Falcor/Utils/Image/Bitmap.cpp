@@ -188,52 +188,19 @@ namespace Falcor
         return Bitmap::UniqueConstPtr(new Bitmap(width, height, format, pData));
     }
 
-    Bitmap::UniqueConstPtr Bitmap::createFromFile(const std::string& filename, bool isTopDown)
+    /** Converts a loaded FreeImage bitmap to a layout that can be stored in a Bitmap.
+        \param[in] pDib Loaded image. Ownership is transferred to the function.
+        \param[in] filename Filename used for error messages.
+        \param[out] format Resource format of the converted image.
+        \param[out] bpp Bits per pixel of the converted image.
+        \return The converted image, or nullptr if the image cannot be represented (the input is released in that case).
+    */
+    static FIBITMAP* convertDib(FIBITMAP* pDib, const std::string& filename, ResourceFormat& format, uint32_t& bpp)
     {
-        std::string fullpath;
-        if (findFileInDataDirectories(filename, fullpath) == false)
-        {
-            logWarning("Error when loading image file. Can't find image file '" + filename + "'");
-            return nullptr;
-        }
-
-        FREE_IMAGE_FORMAT fifFormat = FIF_UNKNOWN;
-
-        fifFormat = FreeImage_GetFileType(fullpath.c_str(), 0);
-        if (fifFormat == FIF_UNKNOWN)
-        {
-            // Can't get the format from the file. Use file extension
-            fifFormat = FreeImage_GetFIFFromFilename(fullpath.c_str());
-
-            if (fifFormat == FIF_UNKNOWN)
-            {
-                genWarning("Image type unknown", filename);
-                return nullptr;
-            }
-        }
-
-        // Check the library supports loading this image type
-        if (FreeImage_FIFSupportsReading(fifFormat) == false)
-        {
-            genWarning("Library doesn't support the file format", filename);
-            return nullptr;
-        }
-
-        // Read the DIB
-        FIBITMAP* pDib = FreeImage_Load(fifFormat, fullpath.c_str());
-        if (pDib == nullptr)
-        {
-            genWarning("Can't read image file", filename);
-            return nullptr;
-        }
-
-        // Create the bitmap
-        const uint32_t height = FreeImage_GetHeight(pDib);
-        const uint32_t width = FreeImage_GetWidth(pDib);
-
-        if (height == 0 || width == 0 || FreeImage_GetBits(pDib) == nullptr)
+        if (FreeImage_GetHeight(pDib) == 0 || FreeImage_GetWidth(pDib) == 0 || FreeImage_GetBits(pDib) == nullptr)
         {
             genWarning("Invalid image", filename);
+            FreeImage_Unload(pDib);
             return nullptr;
         }
 
@@ -252,8 +219,8 @@ namespace Falcor
             }
         }
 
-        ResourceFormat format = ResourceFormat::Unknown;
-        uint32_t bpp = FreeImage_GetBPP(pDib);
+        format = ResourceFormat::Unknown;
+        bpp = FreeImage_GetBPP(pDib);
         switch(bpp)
         {
         case 128:
@@ -282,6 +249,7 @@ namespace Falcor
             break;
         default:
             genWarning("Unknown bits-per-pixel", filename);
+            FreeImage_Unload(pDib);
             return nullptr;
         }
 
@@ -301,10 +269,103 @@ namespace Falcor
             pDib = pNew;
         }
 
+        return pDib;
+    }
+
+    Bitmap::UniqueConstPtr Bitmap::createFromFile(const std::string& filename, bool isTopDown)
+    {
+        std::string fullpath;
+        if (findFileInDataDirectories(filename, fullpath) == false)
+        {
+            logWarning("Error when loading image file. Can't find image file '" + filename + "'");
+            return nullptr;
+        }
+
+        FREE_IMAGE_FORMAT fifFormat = FIF_UNKNOWN;
+
+        fifFormat = FreeImage_GetFileType(fullpath.c_str(), 0);
+        if (fifFormat == FIF_UNKNOWN)
+        {
+            // Can't get the format from the file. Use file extension
+            fifFormat = FreeImage_GetFIFFromFilename(fullpath.c_str());
+
+            if (fifFormat == FIF_UNKNOWN)
+            {
+                genWarning("Image type unknown", filename);
+                return nullptr;
+            }
+        }
+
+        // Check the library supports loading this image type
+        if (FreeImage_FIFSupportsReading(fifFormat) == false)
+        {
+            genWarning("Library doesn't support the file format", filename);
+            return nullptr;
+        }
+
+        // Read the DIB
+        FIBITMAP* pDib = FreeImage_Load(fifFormat, fullpath.c_str());
+        if (pDib == nullptr)
+        {
+            genWarning("Can't read image file", filename);
+            return nullptr;
+        }
+
+        ResourceFormat format;
+        uint32_t bpp;
+        pDib = convertDib(pDib, filename, format, bpp);
+        if (pDib == nullptr) return nullptr;
+
+        // PFM images are loaded y-flipped, fix this by inverting the isTopDown flag.
+        if (fifFormat == FIF_PFM) isTopDown = !isTopDown;
+
+        UniqueConstPtr pBmp = UniqueConstPtr(new Bitmap(FreeImage_GetWidth(pDib), FreeImage_GetHeight(pDib), format));
+        FreeImage_ConvertToRawBits(pBmp->getData(), pDib, pBmp->getRowPitch(), bpp, FI_RGBA_RED_MASK, FI_RGBA_GREEN_MASK, FI_RGBA_BLUE_MASK, isTopDown);
+        FreeImage_Unload(pDib);
+        return pBmp;
+    }
+
+    Bitmap::UniqueConstPtr Bitmap::createFromMemory(const void* pData, size_t size, const std::string& filename, bool isTopDown)
+    {
+        FIMEMORY* pMemory = FreeImage_OpenMemory(static_cast<BYTE*>(const_cast<void*>(pData)), (DWORD)size);
+        if (pMemory == nullptr)
+        {
+            genWarning("Can't open memory stream", filename);
+            return nullptr;
+        }
+
+        FREE_IMAGE_FORMAT fifFormat = FreeImage_GetFileTypeFromMemory(pMemory, 0);
+        if (fifFormat == FIF_UNKNOWN)
+        {
+            // Can't get the format from the data. Use file extension
+            fifFormat = FreeImage_GetFIFFromFilename(filename.c_str());
+        }
+
+        if (fifFormat == FIF_UNKNOWN || FreeImage_FIFSupportsReading(fifFormat) == false)
+        {
+            genWarning(fifFormat == FIF_UNKNOWN ? "Image type unknown" : "Library doesn't support the file format", filename);
+            FreeImage_CloseMemory(pMemory);
+            return nullptr;
+        }
+
+        // Read the DIB. The memory stream only wraps the caller's buffer, so it can be closed once the image is decoded.
+        FIBITMAP* pDib = FreeImage_LoadFromMemory(fifFormat, pMemory);
+        FreeImage_CloseMemory(pMemory);
+        if (pDib == nullptr)
+        {
+            genWarning("Can't read image file", filename);
+            return nullptr;
+        }
+
+        ResourceFormat format;
+        uint32_t bpp;
+        pDib = convertDib(pDib, filename, format, bpp);
+        if (pDib == nullptr) return nullptr;
+
         // PFM images are loaded y-flipped, fix this by inverting the isTopDown flag.
         if (fifFormat == FIF_PFM) isTopDown = !isTopDown;
 
-        UniqueConstPtr pBmp = UniqueConstPtr(new Bitmap(width, height, format));
+        UniqueConstPtr pBmp = UniqueConstPtr(new Bitmap(FreeImage_GetWidth(pDib), FreeImage_GetHeight(pDib), format));
         FreeImage_ConvertToRawBits(pBmp->getData(), pDib, pBmp->getRowPitch(), bpp, FI_RGBA_RED_MASK, FI_RGBA_GREEN_MASK, FI_RGBA_BLUE_MASK, isTopDown);
         FreeImage_Unload(pDib);
         return pBmp;
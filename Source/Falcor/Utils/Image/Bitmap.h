@@ -75,6 +75,15 @@ namespace Falcor
         */
         static UniqueConstPtr createFromFile(const std::string& filename, bool isTopDown);
 
+        /** Create a new object from an encoded image file that has already been read into memory.
+            \param[in] pData Pointer to the file contents. The data is only accessed during the call.
+            \param[in] size Size of the file contents in bytes.
+            \param[in] filename Filename of the image. Used to detect the image type if it can't be determined from the data, and for error messages.
+            \param[in] isTopDown Control the memory layout of the image. If true, the top-left pixel is the first pixel in the buffer, otherwise the bottom-left pixel is first.
+            \return If decoding was successful, a new object. Otherwise, nullptr.
+        */
+        static UniqueConstPtr createFromMemory(const void* pData, size_t size, const std::string& filename, bool isTopDown);
+
         /** Store a memory buffer to a file.
             \param[in] filename Output filename. Can include a path - absolute or relative to the executable directory.
             \param[in] width The width of the image.
@@ -76,6 +76,18 @@ namespace Falcor
             ApiImage image;
         };
 
+        void initImportData(ImportData& data, bool loadAsSrgb)
+        {
+            const auto& meta = data.image.scratchImage.GetMetadata();
+            ResourceFormat format = getResourceFormat(meta.format);
+            data.format = loadAsSrgb ? linearToSrgbFormat(format) : format;
+            data.width = (uint32_t)meta.width;
+            data.height = (uint32_t)meta.height;
+            data.depth = (uint32_t)meta.depth;
+            data.arraySize = (uint32_t)meta.arraySize;
+            data.mipLevels = (uint32_t)meta.mipLevels;
+        }
+
         ImportData loadDDS(const std::string& filename, bool loadAsSrgb)
         {
             assert(hasSuffix(filename, ".dds", false));
@@ -92,16 +104,84 @@ namespace Falcor
                 throw std::exception(("Failed to load file: '" + filename + "'").c_str());
             }
 
+            initImportData(data, loadAsSrgb);
+            return data;
+        }
+
+        /** Creates a DDS image that takes ownership of the loaded scratch image (no copy of the pixel data is made).
+        */
+        ImageIO::DDSImage createDDSImage(ImportData&& data)
+        {
+            ImageIO::DDSImage image;
             const auto& meta = data.image.scratchImage.GetMetadata();
-            ResourceFormat format = getResourceFormat(meta.format);
-            data.format = loadAsSrgb ? linearToSrgbFormat(format) : format;
-            data.width = (uint32_t)meta.width;
-            data.height = (uint32_t)meta.height;
-            data.depth = (uint32_t)meta.depth;
-            data.arraySize = (uint32_t)meta.arraySize;
-            data.mipLevels = (uint32_t)meta.mipLevels;
+            switch (meta.dimension)
+            {
+            case DirectX::TEX_DIMENSION_TEXTURE1D:
+                image.type = Resource::Type::Texture1D;
+                break;
+            case DirectX::TEX_DIMENSION_TEXTURE2D:
+                image.type = meta.IsCubemap() ? Resource::Type::TextureCube : Resource::Type::Texture2D;
+                break;
+            case DirectX::TEX_DIMENSION_TEXTURE3D:
+                image.type = Resource::Type::Texture3D;
+                break;
+            default:
+                throw std::exception("Unsupported DDS resource dimension.");
+            }
 
-            return data;
+            image.format = data.format;
+            image.width = data.width;
+            image.height = data.height;
+            image.depth = data.depth;
+            image.arraySize = image.type == Resource::Type::TextureCube ? data.arraySize / 6 : data.arraySize;
+            image.mipLevels = data.mipLevels;
+            image.dataSize = data.image.scratchImage.GetPixelsSize();
+
+            auto pScratchImage = std::make_shared<DirectX::ScratchImage>(std::move(data.image.scratchImage));
+            image.pData = std::shared_ptr<const uint8_t>(pScratchImage, pScratchImage->GetPixels());
+            return image;
+        }
+
+        DirectX::TexMetadata getMetadata(const ImageIO::DDSImage& image)
+        {
+            DirectX::TexMetadata meta = {};
+            meta.width = image.width;
+            meta.height = image.height;
+            meta.depth = image.depth;
+            meta.arraySize = image.type == Resource::Type::TextureCube ? image.arraySize * 6 : image.arraySize;
+            meta.mipLevels = image.mipLevels;
+            meta.format = getDxgiFormat(image.format);
+
+            switch (image.type)
+            {
+            case Resource::Type::Texture1D:
+                meta.dimension = DirectX::TEX_DIMENSION_TEXTURE1D;
+                break;
+            case Resource::Type::TextureCube:
+                meta.miscFlags |= DirectX::TEX_MISC_TEXTURECUBE;
+                // No break, cubes are also Texture2Ds
+            case Resource::Type::Texture2D:
+                meta.dimension = DirectX::TEX_DIMENSION_TEXTURE2D;
+                break;
+            case Resource::Type::Texture3D:
+                meta.dimension = DirectX::TEX_DIMENSION_TEXTURE3D;
+                break;
+            default:
+                throw std::exception("Invalid resource dimension.");
+            }
+
+            return meta;
+        }
+
+        /** Copies a decoded image into a scratch image. Both use the same packed subresource layout.
+        */
+        void initScratchImage(const ImageIO::DDSImage& image, DirectX::ScratchImage& scratchImage)
+        {
+            if (FAILED(scratchImage.Initialize(getMetadata(image))) || scratchImage.GetPixelsSize() != image.dataSize)
+            {
+                throw std::exception("Failed to initialize image with the given dimensions and format.");
+            }
+            std::memcpy(scratchImage.GetPixels(), image.pData.get(), image.dataSize);
         }
 
         void validateSavePath(const std::string& filename)
@@ -267,37 +347,58 @@ namespace Falcor
     Texture::SharedPtr ImageIO::loadTextureFromDDS(const std::string& filename, bool loadAsSrgb)
     {
         ImportData data = loadDDS(filename, loadAsSrgb);
+        std::string fullpath = data.fullpath;
 
-        const auto& scratchImage = data.image.scratchImage;
-        const auto& meta = scratchImage.GetMetadata();
+        Texture::SharedPtr pTex = createTextureFromDDS(createDDSImage(std::move(data)));
+        if (pTex != nullptr)
+        {
+            pTex->setSourceFilename(fullpath);
+        }
 
-        Texture::SharedPtr pTex;
-        switch (meta.dimension)
+        return pTex;
+    }
+
+    ImageIO::DDSImage ImageIO::loadDDSFromMemory(const void* pData, size_t size, bool loadAsSrgb)
+    {
+        ImportData data;
+        DirectX::DDS_FLAGS flags = DirectX::DDS_FLAGS_NONE;
+        if (FAILED(DirectX::LoadFromDDSMemory(pData, size, flags, nullptr, data.image.scratchImage)))
         {
-        case DirectX::TEX_DIMENSION_TEXTURE1D:
-            pTex = Texture::create1D(data.width, data.format, data.arraySize, data.mipLevels, scratchImage.GetPixels());
-            break;
-        case DirectX::TEX_DIMENSION_TEXTURE2D:
-            if (meta.IsCubemap())
-            {
-                pTex = Texture::createCube(data.width, data.height, data.format, data.arraySize / 6, data.mipLevels, scratchImage.GetPixels());
-            }
-            else
-            {
-                pTex = Texture::create2D(data.width, data.height, data.format, data.arraySize, data.mipLevels, scratchImage.GetPixels());
-            }
-            break;
-        case DirectX::TEX_DIMENSION_TEXTURE3D:
-            pTex = Texture::create3D(data.width, data.height, data.depth, data.format, data.mipLevels, scratchImage.GetPixels());
-            break;
+            throw std::exception("Failed to decode DDS data.");
         }
 
-        if (pTex != nullptr)
+        initImportData(data, loadAsSrgb);
+        return createDDSImage(std::move(data));
+    }
+
+    Texture::SharedPtr ImageIO::createTextureFromDDS(const DDSImage& image, Resource::BindFlags bindFlags)
+    {
+        const uint8_t* pData = image.pData.get();
+
+        switch (image.type)
         {
-            pTex->setSourceFilename(data.fullpath);
+        case Resource::Type::Texture1D:
+            return Texture::create1D(image.width, image.format, image.arraySize, image.mipLevels, pData, bindFlags);
+        case Resource::Type::Texture2D:
+            return Texture::create2D(image.width, image.height, image.format, image.arraySize, image.mipLevels, pData, bindFlags);
+        case Resource::Type::TextureCube:
+            return Texture::createCube(image.width, image.height, image.format, image.arraySize, image.mipLevels, pData, bindFlags);
+        case Resource::Type::Texture3D:
+            return Texture::create3D(image.width, image.height, image.depth, image.format, image.mipLevels, pData, bindFlags);
+        default:
+            return nullptr;
         }
+    }
 
-        return pTex;
+    ImageIO::DDSImage ImageIO::compressImage(const DDSImage& image, CompressionMode mode)
+    {
+        if (mode == CompressionMode::None) return image;
+
+        ImportData data;
+        initScratchImage(image, data.image.scratchImage);
+        compress(data.image, mode);
+        initImportData(data, false);
+        return createDDSImage(std::move(data));
     }
 
     void ImageIO::saveToDDS(const std::string& filename, const Bitmap& bitmap, CompressionMode mode, bool generateMips)
@@ -314,6 +415,13 @@ namespace Falcor
         exportDDS(filename, image, mode, generateMips);
     }
 
+    void ImageIO::saveToDDS(const std::string& filename, const DDSImage& image)
+    {
+        ApiImage apiImage;
+        initScratchImage(image, apiImage.scratchImage);
+        exportDDS(filename, apiImage, CompressionMode::None, false);
+    }
+
     void ImageIO::saveToDDS(CopyContext* pContext, const std::string& filename, const Texture::SharedPtr& pTexture, CompressionMode mode, bool generateMips)
     {
         // DirectXTex version
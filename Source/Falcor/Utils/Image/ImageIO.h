@@ -76,6 +76,21 @@ namespace Falcor
             None
         };
 
+        /** DDS file decoded into memory. Holds all array slices and mips in the layout expected by the Texture::create*() functions.
+        */
+        struct DDSImage
+        {
+            Resource::Type type = Resource::Type::Texture2D;
+            ResourceFormat format = ResourceFormat::Unknown;
+            uint32_t width = 0;
+            uint32_t height = 0;
+            uint32_t depth = 0;
+            uint32_t arraySize = 0;                 ///< Number of array slices. For cube maps this is the number of cubes.
+            uint32_t mipLevels = 0;
+            std::shared_ptr<const uint8_t> pData;   ///< Pixel data of all subresources.
+            size_t dataSize = 0;                    ///< Size of the pixel data in bytes.
+        };
+
         /** Load a DDS file to a Bitmap. If the file contains an image array and/or mips, only the first image will be loaded.
             Throws an exception if file cannot be found or there is a loading error.
             \param[in] filename Path of file to load.
@@ -91,6 +106,30 @@ namespace Falcor
         */
         static Texture::SharedPtr loadTextureFromDDS(const std::string& filename, bool loadAsSrgb);
 
+        /** Decode a DDS file that has already been read into memory. Does not access the GPU.
+            Throws an exception if there is a decoding error.
+            \param[in] pData Pointer to the file contents. The data is only accessed during the call.
+            \param[in] size Size of the file contents in bytes.
+            \param[in] loadAsSrgb If true, convert the image format property to a corresponding sRGB format if available. Image data is not changed.
+            \return Decoded image containing all array slices and mips.
+        */
+        static DDSImage loadDDSFromMemory(const void* pData, size_t size, bool loadAsSrgb);
+
+        /** Create a texture from a decoded DDS image.
+            \param[in] image Decoded image.
+            \param[in] bindFlags The bind flags to create the texture with.
+            \return Texture object containing image data, or nullptr if the image has an unsupported dimension.
+        */
+        static Texture::SharedPtr createTextureFromDDS(const DDSImage& image, Resource::BindFlags bindFlags = Resource::BindFlags::ShaderResource);
+
+        /** Block compress a decoded image on the CPU. All array slices and mips are compressed.
+            Throws an exception if the image is already compressed or there is a compression error.
+            \param[in] image Uncompressed image.
+            \param[in] mode Block compression mode. If None, the image is returned as-is.
+            \return Compressed image.
+        */
+        static DDSImage compressImage(const DDSImage& image, CompressionMode mode);
+
         /** Saves a bitmap to a DDS file.
             Throws an exception of filename is invalid or the image cannot be saved.
             \param[in] filename Filename to save to.
@@ -112,6 +151,13 @@ namespace Falcor
             \param[in] if true, generate and save full mipmap chain; requires the caller to have initialized COM.
         */
         static void saveToDDS(CopyContext* pContext, const std::string& filename, const Texture::SharedPtr& pTexture, CompressionMode mode = CompressionMode::None, bool generateMips = false);
+
+        /** Saves a decoded image to a DDS file. All array slices and mips are saved.
+            Throws an exception if filename is invalid or the image cannot be saved.
+            \param[in] filename Filename to save to.
+            \param[in] image Image to save.
+        */
+        static void saveToDDS(const std::string& filename, const DDSImage& image);
     };
 
 }
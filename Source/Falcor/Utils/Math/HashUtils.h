@@ -0,0 +1,121 @@
+/***************************************************************************
+ # Copyright (c) 2015-21, NVIDIA CORPORATION. All rights reserved.
+ #
+ # Redistribution and use in source and binary forms, with or without
+ # modification, are permitted provided that the following conditions
+ # are met:
+ #  * Redistributions of source code must retain the above copyright
+ #    notice, this list of conditions and the following disclaimer.
+ #  * Redistributions in binary form must reproduce the above copyright
+ #    notice, this list of conditions and the following disclaimer in the
+ #    documentation and/or other materials provided with the distribution.
+ #  * Neither the name of NVIDIA CORPORATION nor the names of its
+ #    contributors may be used to endorse or promote products derived
+ #    from this software without specific prior written permission.
+ #
+ # THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS "AS IS" AND ANY
+ # EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ # IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ # PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+ # CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ # EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ # PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ # PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+ # OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ # (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ # OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ **************************************************************************/
+#pragma once
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <type_traits>
+
+namespace Falcor
+{
+    /** Utilities for computing 64-bit (non-cryptographic) hashes on the CPU.
+        Hashes of values are stable across runs and platforms of the same endianness.
+    */
+
+    /** Finalization mix of MurmurHash3 (64-bit). Maps a 64-bit value to a well-distributed 64-bit hash.
+    */
+    inline uint64_t hashMix64(uint64_t h)
+    {
+        h ^= h >> 33;
+        h *= 0xff51afd7ed558ccdull;
+        h ^= h >> 33;
+        h *= 0xc4ceb9fe1a85ec53ull;
+        h ^= h >> 33;
+        return h;
+    }
+
+    /** Combine an integer or enum value into a hash (64-bit variant of boost::hash_combine).
+        \param[in,out] seed Hash to update.
+        \param[in] value Value to combine into the hash.
+    */
+    template<typename T, std::enable_if_t<std::is_integral_v<T> || std::is_enum_v<T>, bool> = true>
+    inline void hashCombine(uint64_t& seed, T value)
+    {
+        seed ^= hashMix64((uint64_t)value) + 0x9e3779b97f4a7c15ull + (seed << 6) + (seed >> 2);
+    }
+
+    /** Hash a block of memory.
+        \param[in] data Pointer to the data.
+        \param[in] size Size of the data in bytes.
+        \param[in] seed Hash to continue from. Use the default to start a new hash.
+        \return Hash of the data.
+    */
+    inline uint64_t hashBytes(const void* data, size_t size, uint64_t seed = 0)
+    {
+        const uint8_t* p = static_cast<const uint8_t*>(data);
+        uint64_t h = seed ^ (size * 0x9e3779b97f4a7c15ull);
+
+        // Process 8 bytes at a time, then the remaining bytes padded with zeros.
+        for (; size >= 8; p += 8, size -= 8)
+        {
+            uint64_t word;
+            std::memcpy(&word, p, 8);
+            h = (h ^ hashMix64(word)) * 0x100000001b3ull;
+        }
+        if (size > 0)
+        {
+            uint64_t word = 0;
+            std::memcpy(&word, p, size);
+            h = (h ^ hashMix64(word)) * 0x100000001b3ull;
+        }
+        return hashMix64(h);
+    }
+
+    /** Combine a float into a hash. The hash is consistent with float comparison, i.e. -0 and +0 hash to the same value.
+    */
+    inline void hashCombine(uint64_t& seed, float value)
+    {
+        value += 0.f; // Map -0 to +0.
+        uint32_t bits;
+        std::memcpy(&bits, &value, sizeof(bits));
+        hashCombine(seed, (uint64_t)bits);
+    }
+
+    /** Combine the components of a float vector into a hash.
+    */
+    template<typename VecT, std::enable_if_t<std::is_same_v<typename VecT::value_type, float>, bool> = true>
+    inline void hashCombine(uint64_t& seed, const VecT& v)
+    {
+        for (int i = 0; i < (int)VecT::length(); i++) hashCombine(seed, v[i]);
+    }
+
+    /** Combine the identity (address) of an object into a hash. Note that the hash is only stable for the lifetime of the object.
+    */
+    template<typename T>
+    inline void hashCombine(uint64_t& seed, const T* ptr)
+    {
+        hashCombine(seed, (uint64_t)reinterpret_cast<uintptr_t>(ptr));
+    }
+
+    /** Combine a string into a hash.
+    */
+    inline void hashCombine(uint64_t& seed, const std::string& str)
+    {
+        hashCombine(seed, hashBytes(str.data(), str.size()));
+    }
+}
@@ -27,6 +27,8 @@
  **************************************************************************/
 #pragma once
 #include "Utils/Math/Vector.h"
+#include "Utils/Color/ColorUtils.h"
+#include <cmath>
 
 /** Host-side utility functions for format conversion.
 
@@ -69,6 +71,22 @@ namespace Falcor
         return normalize(n);
     }
 
+    /** Encode a normal packed as 2x 8-bit snorms in the octahedral mapping. The high 16 bits are unused.
+    */
+    inline uint encodeNormal2x8(float3 normal)
+    {
+        float2 octNormal = ndir_to_oct_snorm(normal);
+        return glm::packSnorm2x8(octNormal);
+    }
+
+    /** Decode a normal packed as 2x 8-bit snorms in the octahedral mapping.
+    */
+    inline float3 decodeNormal2x8(uint packedNormal)
+    {
+        float2 octNormal = glm::unpackSnorm2x8((glm::uint16)packedNormal);
+        return oct_to_ndir_snorm(octNormal);
+    }
+
     /** Encode a normal packed as 2x 16-bit snorms in the octahedral mapping.
     */
     inline uint encodeNormal2x16(float3 normal)
@@ -84,4 +102,70 @@ namespace Falcor
         float2 octNormal = glm::unpackSnorm2x16(packedNormal);
         return oct_to_ndir_snorm(octNormal);
     }
+
+    /** Encode an RGB color into a 32-bit LogLuv HDR format.
+        See encodeLogLuvHDR() in PackedFormats.slang for details.
+    */
+    inline uint32_t encodeLogLuvHDR(float3 color)
+    {
+        float3 XYZ = RGBtoXYZ_Rec709(color);
+
+        float logY = 409.6f * (std::log2(XYZ.y) + 20.f); // -inf if Y==0
+        uint32_t Le = (uint32_t)glm::clamp(logY, 0.f, 16383.f);
+        if (Le == 0) return 0;
+
+        float invDenom = 1.f / (-2.f * XYZ.x + 12.f * XYZ.y + 3.f * (XYZ.x + XYZ.y + XYZ.z));
+        float2 uv = float2(4.f, 9.f) * float2(XYZ.x, XYZ.y) * invDenom;
+        uint2 uve = uint2(glm::clamp(820.f * uv, 0.f, 511.f));
+
+        return (Le << 18) | (uve.x << 9) | uve.y;
+    }
+
+    /** Decode an RGB color stored in a 32-bit LogLuv HDR format.
+    */
+    inline float3 decodeLogLuvHDR(uint32_t packedColor)
+    {
+        uint32_t Le = packedColor >> 18;
+        if (Le == 0) return float3(0.f);
+
+        float logY = (float(Le) + 0.5f) / 409.6f - 20.f;
+        float Y = std::pow(2.f, logY);
+
+        uint2 uve = uint2(packedColor >> 9, packedColor) & 0x1ffu;
+        float2 uv = (float2(uve) + 0.5f) / 820.f;
+
+        float invDenom = 1.f / (6.f * uv.x - 16.f * uv.y + 12.f);
+        float2 xy = float2(9.f, 4.f) * uv * invDenom;
+
+        float s = Y / xy.y;
+        float3 XYZ = { s * xy.x, Y, s * (1.f - xy.x - xy.y) };
+
+        return glm::max(XYZtoRGB_Rec709(XYZ), 0.f);
+    }
+
+    /** Encode three non-negative floats in 64 bits using a 21-bit logarithmic encoding per component.
+        See encodeLogFloat3x21() in PackedFormats.slang for details.
+    */
+    inline uint2 encodeLogFloat3x21(float3 v)
+    {
+        uint3 c(0);
+        for (int i = 0; i < 3; i++)
+        {
+            if (v[i] > 0.f) c[i] = (uint32_t)glm::clamp((std::log2(v[i]) + 64.f) * 16384.f + 0.5f, 0.f, 2097151.f);
+        }
+        return uint2(c.x | (c.y << 21), (c.y >> 11) | (c.z << 10));
+    }
+
+    /** Decode three floats stored with encodeLogFloat3x21().
+    */
+    inline float3 decodeLogFloat3x21(uint2 packed)
+    {
+        uint3 c(packed.x & 0x1fffff, (packed.x >> 21) | ((packed.y & 0x3ff) << 11), (packed.y >> 10) & 0x1fffff);
+        float3 v;
+        for (int i = 0; i < 3; i++)
+        {
+            v[i] = c[i] == 0 ? 0.f : std::exp2(float(c[i]) / 16384.f - 64.f);
+        }
+        return v;
+    }
 }
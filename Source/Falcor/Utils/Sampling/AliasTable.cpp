@@ -30,119 +30,334 @@
 
 namespace Falcor
 {
-    AliasTable::SharedPtr AliasTable::create(std::vector<float> weights, std::mt19937& rng)
+    namespace
     {
-        return SharedPtr(new AliasTable(std::move(weights), rng));
+        // Inputs are processed in chunks of fixed size so that the result (including the rounding of the prefix sums)
+        // does not depend on the number of threads.
+        const size_t kChunkSize = 1 << 16;
+
+        // Inputs smaller than this are built on the calling thread.
+        const size_t kParallelThreshold = 1 << 16;
+
+        // Largest float below 1.
+        const float kOneMinusEpsilon = 0x1.fffffep-1f;
+
+        /** Run func(i) for i in [0..count), optionally spread over the thread pool.
+        */
+        template<typename Func>
+        void parallelFor(size_t count, bool parallel, const Func& func)
+        {
+            if (!parallel)
+            {
+                for (size_t i = 0; i < count; i++) func(i);
+                return;
+            }
+            Threading::parallelFor(0, count, func, 1);
+        }
+
+        /** Sum the inputs in double precision, chunk by chunk.
+        */
+        template<typename T>
+        double sumWeights(const T* pWeights, size_t count, bool parallel)
+        {
+            size_t chunkCount = (count + kChunkSize - 1) / kChunkSize;
+            std::vector<double> chunkSums(chunkCount, 0.0);
+            parallelFor(chunkCount, parallel, [&](size_t c)
+            {
+                double sum = 0.0;
+                for (size_t i = c * kChunkSize; i < std::min(count, (c + 1) * kChunkSize); i++) sum += pWeights[i];
+                chunkSums[c] = sum;
+            });
+
+            double sum = 0.0;
+            for (double s : chunkSums) sum += s;
+            return sum;
+        }
+
+        /** Build an alias table.
+
+            This is the sweeping algorithm from Hübschle-Schneider and Sanders 2019, "Parallel Weighted Random Sampling".
+            Items are split into a list of light items (weight below average) and a list of heavy items, both in
+            index order. Sweeping over the light items, each one is paired with the current heavy item, which gives
+            away the deficit of the light item. Once the remaining weight of the heavy item drops below average, it is
+            paired with the next heavy item in the same way.
+
+            With D_i the prefix sum of the light item deficits and E_j the prefix sum of the heavy item excesses, the
+            heavy item paired with light item i is j(i) = #{t >= 1 : E_t < D_i}, and heavy item j is retired while
+            processing the light item i where E_(j+1) < D_(i+1) first holds. This lets us split the sweep into
+            independent parts by binary search, and the result is the same as for the sequential sweep.
+            Heavy items that are not retired by the end of the sweep have average weight up to rounding and are
+            mapped to themselves in a final pass.
+
+            \param[in] pWeights Item weights.
+            \param[in] count Number of items.
+            \param[in] weightSum Sum of the item weights.
+            \param[in] indexOffset Offset added to all indices written to the table.
+            \param[out] pItems Table items, item i is written at position i.
+            \param[in] parallel Spread the work over multiple threads.
+        */
+        template<typename T>
+        void buildAliasTable(const T* pWeights, size_t count, double weightSum, uint32_t indexOffset, AliasTable::Item* pItems, bool parallel)
+        {
+            if (count == 0) return;
+
+            const double avgWeight = weightSum / double(count);
+            auto selfItem = [&](size_t i) { return AliasTable::Item{ 1.f, indexOffset + (uint32_t)i, indexOffset + (uint32_t)i, 0 }; };
+
+            // Handle the degenerate case of all weights being zero by sampling uniformly.
+            if (!(avgWeight > 0.0))
+            {
+                for (size_t i = 0; i < count; i++) pItems[i] = selfItem(i);
+                return;
+            }
+
+            // Split the items into light and heavy items, preserving index order.
+            size_t chunkCount = (count + kChunkSize - 1) / kChunkSize;
+            std::vector<size_t> chunkLightCount(chunkCount + 1, 0);
+            parallelFor(chunkCount, parallel, [&](size_t c)
+            {
+                size_t n = 0;
+                for (size_t i = c * kChunkSize; i < std::min(count, (c + 1) * kChunkSize); i++) n += pWeights[i] < avgWeight ? 1 : 0;
+                chunkLightCount[c + 1] = n;
+            });
+            for (size_t c = 0; c < chunkCount; c++) chunkLightCount[c + 1] += chunkLightCount[c];
+
+            const size_t lightCount = chunkLightCount[chunkCount];
+            const size_t heavyCount = count - lightCount;
+
+            // Lights or heavies only means all weights are equal up to rounding.
+            if (lightCount == 0 || heavyCount == 0)
+            {
+                for (size_t i = 0; i < count; i++) pItems[i] = selfItem(i);
+                return;
+            }
+
+            // Scatter the indices and compute the deficit/excess of each item.
+            std::vector<uint32_t> lights(lightCount);
+            std::vector<uint32_t> heavies(heavyCount);
+            std::vector<double> D(lightCount + 1, 0.0);  // D[i] = sum of the deficits of lights [0..i).
+            std::vector<double> E(heavyCount + 1, 0.0);  // E[j] = sum of the excesses of heavies [0..j).
+            std::vector<double> chunkD(chunkCount + 1, 0.0);
+            std::vector<double> chunkE(chunkCount + 1, 0.0);
+            parallelFor(chunkCount, parallel, [&](size_t c)
+            {
+                size_t l = chunkLightCount[c];
+                size_t h = c * kChunkSize - l;
+                double d = 0.0, e = 0.0;
+                for (size_t i = c * kChunkSize; i < std::min(count, (c + 1) * kChunkSize); i++)
+                {
+                    if (pWeights[i] < avgWeight)
+                    {
+                        lights[l] = (uint32_t)i;
+                        D[++l] = (d += avgWeight - pWeights[i]);
+                    }
+                    else
+                    {
+                        heavies[h] = (uint32_t)i;
+                        E[++h] = (e += pWeights[i] - avgWeight);
+                    }
+                }
+                chunkD[c + 1] = d;
+                chunkE[c + 1] = e;
+            });
+            for (size_t c = 0; c < chunkCount; c++)
+            {
+                chunkD[c + 1] += chunkD[c];
+                chunkE[c + 1] += chunkE[c];
+            }
+            parallelFor(chunkCount, parallel, [&](size_t c)
+            {
+                size_t lBegin = chunkLightCount[c], lEnd = chunkLightCount[c + 1];
+                size_t hBegin = c * kChunkSize - lBegin, hEnd = std::min(count, (c + 1) * kChunkSize) - lEnd;
+                for (size_t l = lBegin; l < lEnd; l++) D[l + 1] += chunkD[c];
+                for (size_t h = hBegin; h < hEnd; h++) E[h + 1] += chunkE[c];
+            });
+
+            // Index of the heavy item paired with light item i. The last heavy item is never retired.
+            auto heavyIndex = [&](size_t i) { return (size_t)(std::lower_bound(E.begin() + 1, E.begin() + heavyCount, D[i]) - (E.begin() + 1)); };
+
+            // Split the sweep into parts of similar work (lights processed plus heavies retired).
+            size_t partCount = parallel ? std::max<size_t>(1, std::min<size_t>(chunkCount, 4 * ((size_t)Threading::getThreadCount() + 1))) : 1;
+            std::vector<size_t> partLightBegin(partCount + 1, lightCount);
+            for (size_t p = 0; p < partCount; p++)
+            {
+                size_t target = (lightCount + heavyCount) * p / partCount;
+                size_t lo = 0, hi = lightCount;
+                while (lo < hi)
+                {
+                    size_t mid = (lo + hi) / 2;
+                    if (mid + heavyIndex(mid) < target) lo = mid + 1;
+                    else hi = mid;
+                }
+                partLightBegin[p] = lo;
+            }
+
+            auto threshold = [avgWeight](double w) { return (float)std::clamp(w / avgWeight, 0.0, 1.0); };
+
+            parallelFor(partCount, parallel, [&](size_t p)
+            {
+                size_t j = heavyIndex(partLightBegin[p]);
+                for (size_t i = partLightBegin[p]; i < partLightBegin[p + 1]; i++)
+                {
+                    uint32_t l = lights[i];
+                    pItems[l] = { threshold(pWeights[l]), indexOffset + heavies[j], indexOffset + l, 0 };
+
+                    // Retire heavy items whose remaining weight dropped below average.
+                    while (j + 1 < heavyCount && E[j + 1] < D[i + 1])
+                    {
+                        uint32_t h = heavies[j];
+                        double remaining = avgWeight + E[j + 1] - D[i + 1];
+                        pItems[h] = { threshold(remaining), indexOffset + heavies[j + 1], indexOffset + h, 0 };
+                        j++;
+                    }
+                }
+            });
+
+            // The remaining heavy items have average weight.
+            for (size_t j = heavyIndex(lightCount); j < heavyCount; j++) pItems[heavies[j]] = selfItem(heavies[j]);
+        }
+
+        uint32_t sampleTable(const AliasTable::Item* pItems, uint32_t first, uint32_t count, float u, float rnd)
+        {
+            uint32_t index = first + std::min(count - 1, (uint32_t)(u * count));
+            const AliasTable::Item& item = pItems[index];
+            return rnd >= item.threshold ? item.indexA : item.indexB;
+        }
+    }
+
+    AliasTable::SharedPtr AliasTable::create(std::vector<float> weights, std::mt19937& rng, const Options& options)
+    {
+        return SharedPtr(new AliasTable(std::move(weights), options));
     }
 
     void AliasTable::setShaderData(const ShaderVar& var) const
     {
         var["items"] = mpItems;
         var["weights"] = mpWeights;
+        var["blockItems"] = mpBlockItems;
         var["count"] = mCount;
         var["weightSum"] = (float)mWeightSum;
+        var["blockCount"] = mBlockCount;
+        var["blockSize"] = mBlockSize;
     }
 
-    // This builds an alias table via the O(N) algorithm from Vose 1991, "A linear algorithm for generating random
-    // numbers with a given distribution," IEEE Transactions on Software Engineering 17(9), 972-975.
-    //
-    // Basic idea:  creating each alias table entry combines one overweighted sample and one underweighted sample
-    // into one alias table entry plus a residual sample (the overweighted sample minus some of its weight).
-    // 
-    // By first separating all inputs into 2 temporary buffer (one overweighted set, with weights above the
-    // average; one underweighted set, with weights below average), we can simply walk through the lists once,
-    // merging the first elements in each temporary buffer.  The residual sample is interted into either the
-    // overweighted or underweighted set, depending on its residual weight.
-    //
-    // The main complexity is dealing with corner cases, thanks to numerical precision issues, where you don't
-    // have 2 valid entries to combine.  By definition, in these corner cases, all remaining unhandled samples
-    // actually have the average weight (within numerical precision limits)
-    AliasTable::AliasTable(std::vector<float> weights, std::mt19937& rng)
+    AliasTable::AliasTable(std::vector<float> weights, const Options& options)
         : mCount((uint32_t)weights.size())
     {
-        // Use >= since we reserve 0xFFFFFFFFu as an invalid flag marker during construction.
+        // Use >= since we reserve 0xFFFFFFFFu as an invalid flag marker.
         if (weights.size() >= std::numeric_limits<uint32_t>::max()) throw std::exception("Too many entries for alias table.");
 
-        std::uniform_int_distribution<uint32_t> rngDist;
-
         mpWeights = Buffer::createStructured(sizeof(float), mCount, Resource::BindFlags::ShaderResource, Buffer::CpuAccess::None, weights.data());
 
-        // Our working set / intermediate buffers (underweight & overweight); initialize to "invalid"
-        std::vector<uint32_t> lowIdx(mCount, 0xFFFFFFFFu);
-        std::vector<uint32_t> highIdx(mCount, 0xFFFFFFFFu);
+        if (options.blockSize == 0 || options.blockSize >= mCount)
+        {
+            // Flat table.
+            bool parallel = weights.size() >= kParallelThreshold;
+            mWeightSum = sumWeights(weights.data(), weights.size(), parallel);
+
+            std::vector<AliasTable::Item> items(mCount);
+            buildAliasTable(weights.data(), weights.size(), mWeightSum, 0, items.data(), parallel);
+            mpItems = Buffer::createStructured(sizeof(AliasTable::Item), mCount, Resource::BindFlags::ShaderResource, Buffer::CpuAccess::None, items.data());
+            return;
+        }
+
+        // Two-level table.
+        mBlockSize = options.blockSize;
+        mBlockCount = (mCount + mBlockSize - 1) / mBlockSize;
+        mWeights = std::move(weights);
+        mItems.resize(mCount);
+        mBlockWeights.resize(mBlockCount);
 
-        // Sum element weights, use double to minimize precision issues
-        mWeightSum = 0.0;
-        for (float f : weights) mWeightSum += f;
+        std::vector<uint32_t> blocks(mBlockCount);
+        for (uint32_t i = 0; i < mBlockCount; i++) blocks[i] = i;
+        buildBlocks(blocks);
+        buildBlockTable();
 
-        // Find the average weight
-        float avgWeight = float(mWeightSum / double(mCount));
+        mpItems = Buffer::createStructured(sizeof(AliasTable::Item), mCount, Resource::BindFlags::ShaderResource, Buffer::CpuAccess::None, mItems.data());
+        mpBlockItems = Buffer::createStructured(sizeof(AliasTable::Item), mBlockCount, Resource::BindFlags::ShaderResource, Buffer::CpuAccess::None, mBlockItems.data());
+    }
+
+    void AliasTable::updateWeights(const std::vector<uint32_t>& indices, const std::vector<float>& weights)
+    {
+        if (mBlockSize == 0) throw std::exception("AliasTable::updateWeights() requires a two-level table.");
+        if (indices.size() != weights.size()) throw std::exception("AliasTable::updateWeights() index and weight counts don't match.");
 
-        // Initialize working set. Inset inputs into our lists of above-average or below-average weight elements.
-        int lowCount = 0;
-        int highCount = 0;
-        for (uint32_t i = 0; i < mCount; ++i)
+        std::vector<bool> dirty(mBlockCount, false);
+        for (size_t i = 0; i < indices.size(); i++)
         {
-            if (weights[i] < avgWeight)
-                lowIdx[lowCount++] = i;
-            else
-                highIdx[highCount++] = i;
+            if (indices[i] >= mCount) throw std::exception("AliasTable::updateWeights() index out of range.");
+            mWeights[indices[i]] = weights[i];
+            dirty[indices[i] / mBlockSize] = true;
         }
 
-        // Create alias table entries by merging above- and below-average samples
-        std::vector<AliasTable::Item> items(mCount);
-        for (uint32_t i = 0; i < mCount; ++i)
+        std::vector<uint32_t> blocks;
+        for (uint32_t i = 0; i < mBlockCount; i++)
         {
-            // Usual case:  We have an above-average and below-average sample we can combine into one alias table entry
-            if ((lowIdx[i] != 0xFFFFFFFFu) && (highIdx[i] != 0xFFFFFFFFu))
-            {
-                // Create an alias table tuple: 
-                items[i] = { weights[lowIdx[i]] / avgWeight, highIdx[i], lowIdx[i], 0 };  
-
-                // We've removed some weight from element highIdx[i]; update it's weight, then re-enter it
-                // on the end of either the above-average or below-average lists.
-                float updatedWeight = (weights[lowIdx[i]] + weights[highIdx[i]]) - avgWeight;
-                weights[highIdx[i]] = updatedWeight;
-                if (updatedWeight < avgWeight)
-                    lowIdx[lowCount++] = highIdx[i];
-                else
-                    highIdx[highCount++] = highIdx[i];
-            }
+            if (dirty[i]) blocks.push_back(i);
+        }
+        if (blocks.empty()) return;
 
-            // The next two cases can only occur towards the end of table creation, because either:
-            //    (a) all the remaining possible alias table entries have weight *exactly* equal to avgWeight,
-            //        which means these alias table entries only have one input item that is selected
-            //        with 100% probability
-            //    (b) all the remaining alias table entires have *almost* avgWeight, but due to (compounding)
-            //        precision issues throughout the process, they don't have *quite* that value.  In this case
-            //        treating these entries as having exactly avgWeight (as in case (a)) is the only right
-            //        thing to do mathematically (other than re-generating the alias table using higher precision
-            //        or trying to reduce catasrophic numerical cancellation in the "updatedWeight" computation above).
-            else if (highIdx[i] != 0xFFFFFFFFu)
-            {
-                items[i] = { 1.0f, highIdx[i], highIdx[i], 0 };
-            }
-            else if (lowIdx[i] != 0xFFFFFFFFu)
-            {
-                items[i] = { 1.0f, lowIdx[i], lowIdx[i], 0 };
-            }
+        buildBlocks(blocks);
+        buildBlockTable();
 
-            // If there is neither a highIdx[i] or lowIdx[i] for some array element(s).  By construction, 
-            // this cannot occur (without some logic bug above).
-            else
-            {
-                assert(false); // Should not occur
-            }
+        // Upload runs of consecutive dirty blocks.
+        for (size_t i = 0; i < blocks.size();)
+        {
+            size_t j = i + 1;
+            while (j < blocks.size() && blocks[j] == blocks[j - 1] + 1) j++;
+
+            uint32_t first = blocks[i] * mBlockSize;
+            uint32_t last = std::min(mCount, (blocks[j - 1] + 1) * mBlockSize);
+            mpWeights->setBlob(mWeights.data() + first, first * sizeof(float), (last - first) * sizeof(float));
+            mpItems->setBlob(mItems.data() + first, first * sizeof(AliasTable::Item), (last - first) * sizeof(AliasTable::Item));
+            i = j;
+        }
+        mpBlockItems->setBlob(mBlockItems.data(), 0, mBlockItems.size() * sizeof(AliasTable::Item));
+    }
+
+    uint32_t AliasTable::sample(float3 rnd) const
+    {
+        if (mBlockSize == 0) throw std::exception("AliasTable::sample() requires a two-level table.");
+
+        // Pick a block and reuse the part of rnd.y not needed for the threshold test.
+        uint32_t blockIndex = std::min(mBlockCount - 1, (uint32_t)(rnd.x * mBlockCount));
+        const Item& block = mBlockItems[blockIndex];
+        float u = rnd.y;
+        if (rnd.y >= block.threshold)
+        {
+            blockIndex = block.indexA;
+            u = (rnd.y - block.threshold) / (1.f - block.threshold);
         }
+        else
+        {
+            blockIndex = block.indexB;
+            u = rnd.y / block.threshold;
+        }
+        u = std::min(u, kOneMinusEpsilon);
+
+        uint32_t first = blockIndex * mBlockSize;
+        uint32_t count = std::min(mCount - first, mBlockSize);
+        return sampleTable(mItems.data(), first, count, rnd.z, u);
+    }
 
-        // TODO: We can simplify the alias table to implicitly store indexB (aka lowIdx[i]), so the AliasTable::Item
-        // structure would be 1 float + 1 uint32_t, rather than 128 bits.  This, of course, would change usage in shaders
-        // and elsewhere.  To do this, here you'd need to sort elements by indexB so that when looking up mpItems[j],
-        // indexB==j.  This works since, by construction, only one element in the table has indexB==j (for any j
-        // in [0...mCount-1]).  Alternatively, during the loop above, you could directly enter elements into the
-        // correct location in the alias table.
+    void AliasTable::buildBlocks(const std::vector<uint32_t>& blocks)
+    {
+        // Local tables reference items by their global index.
+        parallelFor(blocks.size(), blocks.size() * mBlockSize >= kParallelThreshold, [&](size_t i)
+        {
+            uint32_t first = blocks[i] * mBlockSize;
+            uint32_t count = std::min(mCount - first, mBlockSize);
+            double blockWeight = sumWeights(mWeights.data() + first, count, false);
+            mBlockWeights[blocks[i]] = blockWeight;
+            buildAliasTable(mWeights.data() + first, count, blockWeight, first, mItems.data() + first, false);
+        });
+    }
 
-        // Stash the alias table in our GPU buffer
-        mpItems = Buffer::createStructured(sizeof(AliasTable::Item), mCount, Resource::BindFlags::ShaderResource, Buffer::CpuAccess::None, items.data());
+    void AliasTable::buildBlockTable()
+    {
+        bool parallel = mBlockCount >= kParallelThreshold;
+        mWeightSum = sumWeights(mBlockWeights.data(), mBlockWeights.size(), parallel);
+        mBlockItems.resize(mBlockCount);
+        buildAliasTable(mBlockWeights.data(), mBlockWeights.size(), mWeightSum, 0, mBlockItems.data(), parallel);
     }
 }
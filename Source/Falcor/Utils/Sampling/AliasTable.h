@@ -31,25 +31,54 @@
 namespace Falcor
 {
     /** Implements the alias method for sampling from a discrete probability distribution.
+
+        The table is built in parallel for large inputs. Optionally, the weights can be split into fixed-size
+        blocks, each with its own local alias table, and a top-level alias table over the block weights
+        (a two-level table). Two-level tables keep the table entries of an item close to the item itself and
+        allow updating a few weights by only rebuilding the affected blocks (see updateWeights()).
+        Two-level tables need to be sampled with three random numbers (see AliasTable.slang).
     */
     class dlldecl AliasTable
     {
     public:
         using SharedPtr = std::shared_ptr<AliasTable>;
 
+        /** Table options.
+        */
+        struct Options
+        {
+            uint32_t blockSize = 0;         ///< Number of items per block of a two-level table. Use 0 to create a flat table. Tables with no more items than a block are always flat.
+        };
+
         /** Create an alias table.
             The weights don't need to be normalized to sum up to 1.
             \param[in] weights The weights we'd like to sample each entry proportional to.
-            \param[in] rng The random number generator to use when creating the table.
+            \param[in] rng Unused. The table is built deterministically by a parallel sweep. The parameter is kept for compatibility.
+            \param[in] options Table options.
             \returns The alias table.
         */
-        static SharedPtr create(std::vector<float> weights, std::mt19937& rng);
+        static SharedPtr create(std::vector<float> weights, std::mt19937& rng, const Options& options = Options());
 
         /** Bind the alias table data to a given shader var.
             \param[in] var The shader variable to set the data into.
         */
         void setShaderData(const ShaderVar& var) const;
 
+        /** Update a subset of the weights of a two-level table.
+            Only the local tables of the blocks containing the updated items and the top-level table are rebuilt,
+            and only the changed ranges are uploaded. Throws an exception if the table is not a two-level table.
+            \param[in] indices Indices of the items to update.
+            \param[in] weights New weights, one per index.
+        */
+        void updateWeights(const std::vector<uint32_t>& indices, const std::vector<float>& weights);
+
+        /** Sample the table on the CPU. This matches AliasTable::sample(float3) in AliasTable.slang.
+            Only two-level tables keep a CPU copy of the table, so this throws an exception for flat tables.
+            \param[in] rnd Three uniform random numbers in [0..1).
+            \return Returns the sampled item index.
+        */
+        uint32_t sample(float3 rnd) const;
+
         /** Get the number of weights in the table.
         */
         uint32_t getCount() const { return mCount; }
@@ -58,21 +87,41 @@ namespace Falcor
         */
         double getWeightSum() const { return mWeightSum; }
 
-    private:
-        AliasTable(std::vector<float> weights, std::mt19937& rng);
+        /** Get the number of items per block, or 0 for flat tables.
+        */
+        uint32_t getBlockSize() const { return mBlockSize; }
+
+        /** Get the number of blocks, or 0 for flat tables.
+        */
+        uint32_t getBlockCount() const { return mBlockCount; }
 
         // Item structure for the mpItems buffer.
         struct Item
         {
             float threshold;                ///< If rand() < threshold, pick indexB (else pick indexA)
             uint32_t indexA;                ///< The "redirect" index, if uniform sampling would overweight indexB.
-            uint32_t indexB;                ///< The original / permutation index, sampled uniformly in [0...mCount-1]
+            uint32_t indexB;                ///< The original index. Item i is stored at position i in the table.
             uint32_t _pad;
         };
 
+    private:
+        AliasTable(std::vector<float> weights, const Options& options);
+
+        void buildBlocks(const std::vector<uint32_t>& blocks);
+        void buildBlockTable();
+
         uint32_t mCount;                    ///< Number of items in the alias table.
         double mWeightSum;                  ///< Total weight of all elements used to create the alias table.
+        uint32_t mBlockSize = 0;            ///< Number of items per block (two-level tables only).
+        uint32_t mBlockCount = 0;           ///< Number of blocks (two-level tables only).
         Buffer::SharedPtr mpItems;          ///< Buffer containing table items.
         Buffer::SharedPtr mpWeights;        ///< Buffer containing item weights.
+        Buffer::SharedPtr mpBlockItems;     ///< Buffer containing top-level table items (two-level tables only).
+
+        // CPU copies kept for incremental updates (two-level tables only).
+        std::vector<float> mWeights;
+        std::vector<Item> mItems;
+        std::vector<double> mBlockWeights;
+        std::vector<Item> mBlockItems;
     };
 }
@@ -28,68 +28,400 @@
 #include "stdafx.h"
 #include "Threading.h"
 
+#include <deque>
+
 namespace Falcor
 {
+    struct Threading::Task::State
+    {
+        std::function<void(void)> func;
+        std::atomic<bool> done = false;
+        std::exception_ptr pException;
+        std::mutex mutex;
+        std::condition_variable condition;
+    };
+
     namespace
     {
-        struct ThreadingData
+        using TaskState = Threading::Task::State;
+
+        /** Time a waiting thread sleeps before checking for new tasks to help with.
+        */
+        const auto kWaitInterval = std::chrono::microseconds(200);
+
+        struct TaskQueue
+        {
+            std::mutex mutex;
+            std::deque<std::shared_ptr<TaskState>> tasks;
+        };
+
+        struct ThreadPool
         {
-            bool initialized = false;
+            uint32_t workerCount = 0;
             std::vector<std::thread> threads;
-            uint32_t current;
-        } gData;
+            std::vector<std::unique_ptr<TaskQueue>> queues;     ///< One queue per worker, followed by the shared queue.
+            std::mutex sleepMutex;                              ///< Protects terminate and increments of queuedCount.
+            std::condition_variable sleepCondition;             ///< Signaled when tasks are queued or the pool terminates.
+            std::condition_variable idleCondition;              ///< Signaled when the last pending task finishes.
+            std::atomic<size_t> queuedCount = 0;                ///< Number of tasks in the queues.
+            std::atomic<size_t> pendingCount = 0;               ///< Number of tasks queued or running.
+            bool terminate = false;
+
+            TaskQueue& getSharedQueue() { return *queues.back(); }
+        };
+
+        std::mutex gPoolMutex;
+        std::atomic<ThreadPool*> gpPool = nullptr;
+
+        thread_local uint32_t tWorkerIndex = Threading::kInvalidWorkerIndex;
+
+        /** Pop a task. Workers take the newest task from their own queue first, then the oldest task from the shared queue
+            and finally steal the oldest task from another worker.
+        */
+        std::shared_ptr<TaskState> popTask(ThreadPool& pool)
+        {
+            const uint32_t workerCount = pool.workerCount;
+            const uint32_t self = tWorkerIndex;
+
+            auto popFrom = [&pool](TaskQueue& queue, bool newest) -> std::shared_ptr<TaskState>
+            {
+                std::lock_guard<std::mutex> lock(queue.mutex);
+                if (queue.tasks.empty()) return nullptr;
+                std::shared_ptr<TaskState> pTask;
+                if (newest)
+                {
+                    pTask = std::move(queue.tasks.back());
+                    queue.tasks.pop_back();
+                }
+                else
+                {
+                    pTask = std::move(queue.tasks.front());
+                    queue.tasks.pop_front();
+                }
+                pool.queuedCount--;
+                return pTask;
+            };
+
+            if (pool.queuedCount == 0) return nullptr;
+
+            if (self != Threading::kInvalidWorkerIndex)
+            {
+                if (auto pTask = popFrom(*pool.queues[self], true)) return pTask;
+            }
+            if (auto pTask = popFrom(pool.getSharedQueue(), false)) return pTask;
+
+            const uint32_t first = self != Threading::kInvalidWorkerIndex ? self + 1 : 0;
+            for (uint32_t i = 0; i < workerCount; i++)
+            {
+                uint32_t victim = (first + i) % workerCount;
+                if (victim == self) continue;
+                if (auto pTask = popFrom(*pool.queues[victim], false)) return pTask;
+            }
+
+            return nullptr;
+        }
+
+        void pushTask(ThreadPool& pool, std::shared_ptr<TaskState> pTask)
+        {
+            TaskQueue& queue = tWorkerIndex != Threading::kInvalidWorkerIndex ? *pool.queues[tWorkerIndex] : pool.getSharedQueue();
+            pool.pendingCount++;
+            {
+                // Count the task before it becomes visible, so that popTask() never decrements the count below zero.
+                std::lock_guard<std::mutex> sleepLock(pool.sleepMutex);
+                pool.queuedCount++;
+                std::lock_guard<std::mutex> queueLock(queue.mutex);
+                queue.tasks.push_back(std::move(pTask));
+            }
+            pool.sleepCondition.notify_one();
+        }
+
+        void executeTask(ThreadPool& pool, const std::shared_ptr<TaskState>& pTask)
+        {
+            {
+                ScratchArena::Scope scratchScope(Threading::getScratchArena());
+                try
+                {
+                    pTask->func();
+                }
+                catch (...)
+                {
+                    pTask->pException = std::current_exception();
+                }
+                pTask->func = nullptr;
+            }
+
+            {
+                std::lock_guard<std::mutex> lock(pTask->mutex);
+                pTask->done = true;
+            }
+            pTask->condition.notify_all();
+
+            if (--pool.pendingCount == 0)
+            {
+                std::lock_guard<std::mutex> lock(pool.sleepMutex);
+                pool.idleCondition.notify_all();
+            }
+        }
+
+        void workerMain(ThreadPool& pool, uint32_t workerIndex)
+        {
+            tWorkerIndex = workerIndex;
+
+            while (true)
+            {
+                if (auto pTask = popTask(pool))
+                {
+                    executeTask(pool, pTask);
+                    continue;
+                }
+
+                std::unique_lock<std::mutex> lock(pool.sleepMutex);
+                pool.sleepCondition.wait(lock, [&pool]() { return pool.terminate || pool.queuedCount > 0; });
+                if (pool.terminate && pool.queuedCount == 0) break;
+            }
+        }
+
+        ThreadPool& getPool()
+        {
+            if (ThreadPool* pPool = gpPool.load(std::memory_order_acquire)) return *pPool;
+            Threading::start();
+            return *gpPool.load(std::memory_order_acquire);
+        }
+    }
+
+    void* ScratchArena::allocate(size_t size, size_t alignment)
+    {
+        assert(alignment > 0 && (alignment & (alignment - 1)) == 0);
+
+        while (true)
+        {
+            if (mBlockIndex == mBlocks.size())
+            {
+                Block block;
+                block.size = std::max(mBlockSize, size + alignment);
+                block.pData.reset(new uint8_t[block.size]);
+                mBlocks.push_back(std::move(block));
+            }
+
+            Block& block = mBlocks[mBlockIndex];
+            uintptr_t base = reinterpret_cast<uintptr_t>(block.pData.get());
+            uintptr_t address = (base + mOffset + alignment - 1) & ~(uintptr_t)(alignment - 1);
+            if (address + size <= base + block.size)
+            {
+                mOffset = address + size - base;
+                return reinterpret_cast<void*>(address);
+            }
+
+            // Continue in the next block. Blocks that are too small for this allocation are skipped.
+            mBlockIndex++;
+            mOffset = 0;
+        }
     }
 
     void Threading::start(uint32_t threadCount)
     {
-        if (gData.initialized) return;
+        std::lock_guard<std::mutex> lock(gPoolMutex);
+        if (gpPool.load()) return;
 
-        gData.threads.resize(threadCount);
-        gData.initialized = true;
+        if (threadCount == 0) threadCount = std::max(1u, getLogicalThreadCount() - 1);
+
+        ThreadPool* pPool = new ThreadPool();
+        pPool->workerCount = threadCount;
+        for (uint32_t i = 0; i <= threadCount; i++) pPool->queues.push_back(std::make_unique<TaskQueue>());
+        for (uint32_t i = 0; i < threadCount; i++) pPool->threads.emplace_back(workerMain, std::ref(*pPool), i);
+
+        gpPool.store(pPool, std::memory_order_release);
     }
 
     void Threading::shutdown()
     {
-        for (auto& t : gData.threads)
+        std::lock_guard<std::mutex> lock(gPoolMutex);
+        ThreadPool* pPool = gpPool.load();
+        if (!pPool) return;
+
+        finish();
+
         {
-            if (t.joinable()) t.join();
+            std::lock_guard<std::mutex> sleepLock(pPool->sleepMutex);
+            pPool->terminate = true;
         }
+        pPool->sleepCondition.notify_all();
+
+        for (auto& t : pPool->threads) t.join();
 
-        gData.initialized = false;
+        gpPool.store(nullptr);
+        delete pPool;
     }
 
-    Threading::Task Threading::dispatchTask(const std::function<void(void)>& func)
+    void Threading::finish()
     {
-        assert(gData.initialized);
+        assert(tWorkerIndex == kInvalidWorkerIndex);
+
+        ThreadPool* pPool = gpPool.load(std::memory_order_acquire);
+        if (!pPool) return;
 
-        std::thread& t = gData.threads[gData.current];
-        if (t.joinable()) t.join();
-        t = std::thread(func);
-        gData.current = (gData.current + 1) % gData.threads.size();
+        while (pPool->pendingCount > 0)
+        {
+            if (auto pTask = popTask(*pPool))
+            {
+                executeTask(*pPool, pTask);
+                continue;
+            }
 
-        return Task();
+            std::unique_lock<std::mutex> lock(pPool->sleepMutex);
+            pPool->idleCondition.wait_for(lock, kWaitInterval, [pPool]() { return pPool->pendingCount == 0; });
+        }
     }
 
-    void Threading::finish()
+    uint32_t Threading::getThreadCount()
+    {
+        return getPool().workerCount;
+    }
+
+    uint32_t Threading::getWorkerIndex()
+    {
+        return tWorkerIndex;
+    }
+
+    ScratchArena& Threading::getScratchArena()
+    {
+        thread_local ScratchArena tArena;
+        return tArena;
+    }
+
+    Threading::Task Threading::dispatchTask(const std::function<void(void)>& func)
+    {
+        auto pState = std::make_shared<Task::State>();
+        pState->func = func;
+        pushTask(getPool(), pState);
+        return Task(std::move(pState));
+    }
+
+    void Threading::parallelForChunks(size_t begin, size_t end, const std::function<void(size_t, size_t)>& func, size_t grainSize)
     {
-        for (auto& t : gData.threads)
+        if (end <= begin) return;
+        if (grainSize == 0) grainSize = getDefaultGrainSize(end - begin);
+
+        const size_t chunkCount = div_round_up(end - begin, grainSize);
+        const size_t helperCount = std::min<size_t>(chunkCount - 1, getThreadCount());
+        if (helperCount == 0)
         {
-            if (t.joinable()) t.join();
+            func(begin, end);
+            return;
         }
+
+        // Chunks are handed out dynamically to the calling thread and the helper tasks.
+        std::atomic<size_t> nextChunk = 0;
+        std::exception_ptr pException;
+        std::mutex exceptionMutex;
+
+        auto worker = [&]()
+        {
+            try
+            {
+                for (size_t chunk = nextChunk++; chunk < chunkCount; chunk = nextChunk++)
+                {
+                    const size_t chunkBegin = begin + chunk * grainSize;
+                    func(chunkBegin, std::min(end, chunkBegin + grainSize));
+                }
+            }
+            catch (...)
+            {
+                std::lock_guard<std::mutex> lock(exceptionMutex);
+                if (!pException) pException = std::current_exception();
+                nextChunk = chunkCount;
+            }
+        };
+
+        TaskGroup group;
+        for (size_t i = 0; i < helperCount; i++) group.run(worker);
+        worker();
+        group.wait();
+
+        if (pException) std::rethrow_exception(pException);
     }
 
-    Threading::Task::Task()
+    size_t Threading::getDefaultGrainSize(size_t count)
     {
+        // Aim for a few chunks per thread to balance the load.
+        const size_t chunkCount = 4 * ((size_t)getThreadCount() + 1);
+        return std::max<size_t>(1, count / chunkCount);
     }
 
-    bool Threading::Task::isRunning()
+    bool Threading::Task::isRunning() const
     {
-        logError("Threading::Task::isRunning() not implemented");
-        return true;
+        return mpState && !mpState->done;
     }
 
     void Threading::Task::finish()
     {
-        logError("Threading::Task::finish() not implemented");
+        if (!mpState) return;
+
+        // Help with other tasks until this one is done.
+        ThreadPool& pool = getPool();
+        while (!mpState->done)
+        {
+            if (auto pTask = popTask(pool))
+            {
+                executeTask(pool, pTask);
+                continue;
+            }
+
+            std::unique_lock<std::mutex> lock(mpState->mutex);
+            mpState->condition.wait_for(lock, kWaitInterval, [this]() { return mpState->done.load(); });
+        }
+
+        if (mpState->pException) std::rethrow_exception(mpState->pException);
+    }
+
+    Threading::TaskGroup::~TaskGroup()
+    {
+        try
+        {
+            wait();
+        }
+        catch (const std::exception& e)
+        {
+            logError("Threading::TaskGroup - Unhandled exception in task: " + std::string(e.what()));
+        }
+        catch (...)
+        {
+            logError("Threading::TaskGroup - Unhandled exception in task");
+        }
+    }
+
+    void Threading::TaskGroup::run(const std::function<void(void)>& func)
+    {
+        Task task = dispatchTask(func);
+        std::lock_guard<std::mutex> lock(mMutex);
+        mTasks.push_back(std::move(task));
+    }
+
+    void Threading::TaskGroup::wait()
+    {
+        std::exception_ptr pException;
+        while (true)
+        {
+            std::vector<Task> tasks;
+            {
+                std::lock_guard<std::mutex> lock(mMutex);
+                if (mTasks.empty()) break;
+                tasks.swap(mTasks);
+            }
+
+            for (auto& task : tasks)
+            {
+                try
+                {
+                    task.finish();
+                }
+                catch (...)
+                {
+                    if (!pException) pException = std::current_exception();
+                }
+            }
+        }
+
+        if (pException) std::rethrow_exception(pException);
     }
 }
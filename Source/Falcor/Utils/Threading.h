@@ -26,58 +26,294 @@
  # OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
  **************************************************************************/
 #pragma once
-#include <thread>
-#include <mutex>
+#include <algorithm>
+#include <atomic>
 #include <condition_variable>
+#include <cstddef>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <thread>
+#include <type_traits>
+#include <vector>
 
 namespace Falcor
 {
-    class dlldecl Threading
+    /** Bump allocator for short-lived temporary memory.
+        Memory is allocated from blocks that are kept for reuse. Allocations are not freed individually,
+        they are released all at once by reset() or at the end of a Scope.
+        Each thread has its own arena, see Threading::getScratchArena().
+    */
+    class dlldecl ScratchArena
     {
     public:
-        const static uint32_t kDefaultThreadCount = 16;
+        static const size_t kDefaultBlockSize = 1 << 20;
 
-        /** Handle to a dispatched task
+        ScratchArena(size_t blockSize = kDefaultBlockSize) : mBlockSize(blockSize) {}
+        ScratchArena(const ScratchArena&) = delete;
+        ScratchArena& operator=(const ScratchArena&) = delete;
 
-            TODO: Implementation
+        /** Allocate memory.
+            \param[in] size Size in bytes.
+            \param[in] alignment Alignment in bytes. Must be a power of two.
+            \return Pointer to the memory, which is valid until it is released by reset() or the end of the enclosing scope.
         */
-        class Task
+        void* allocate(size_t size, size_t alignment = alignof(std::max_align_t));
+
+        /** Allocate an uninitialized array.
+            \param[in] count Number of elements.
+            \return Pointer to the first element.
+        */
+        template<typename T>
+        T* allocate(size_t count)
+        {
+            static_assert(std::is_trivially_destructible_v<T>, "ScratchArena doesn't call destructors");
+            return static_cast<T*>(allocate(count * sizeof(T), alignof(T)));
+        }
+
+        /** Release all allocations. The memory blocks are kept for reuse.
+        */
+        void reset() { mBlockIndex = 0; mOffset = 0; }
+
+        /** Releases the allocations made during its lifetime when it goes out of scope.
+        */
+        class Scope
         {
         public:
+            Scope(ScratchArena& arena) : mArena(arena), mBlockIndex(arena.mBlockIndex), mOffset(arena.mOffset) {}
+            ~Scope() { mArena.mBlockIndex = mBlockIndex; mArena.mOffset = mOffset; }
+
+            Scope(const Scope&) = delete;
+            Scope& operator=(const Scope&) = delete;
+
+        private:
+            ScratchArena& mArena;
+            size_t mBlockIndex;
+            size_t mOffset;
+        };
+
+    private:
+        struct Block
+        {
+            std::unique_ptr<uint8_t[]> pData;
+            size_t size = 0;
+        };
+
+        size_t mBlockSize;
+        std::vector<Block> mBlocks;
+        size_t mBlockIndex = 0;     ///< Index of the block allocations are made from.
+        size_t mOffset = 0;         ///< Offset of the next allocation in the current block.
+    };
+
+    /** Global work-stealing thread pool.
+
+        Each worker thread has its own task queue. Tasks dispatched from a worker are pushed to its queue and
+        executed in LIFO order, tasks dispatched from other threads go to a shared queue. Idle workers steal
+        tasks from the other queues. Threads waiting for a task execute other pending tasks in the meantime,
+        so tasks can dispatch and wait for nested tasks without deadlocking the pool.
+
+        The pool is started on first use if start() has not been called.
+    */
+    class dlldecl Threading
+    {
+    public:
+        static const uint32_t kInvalidWorkerIndex = uint32_t(-1);
+
+        /** Handle to a dispatched task.
+        */
+        class dlldecl Task
+        {
+        public:
+            struct State;   ///< Opaque task state.
+
+            /** Create an empty handle.
+            */
+            Task() = default;
+
+            /** Check if the handle refers to a task.
+            */
+            bool isValid() const { return mpState != nullptr; }
+
             /** Check if task is still executing
             */
-            bool isRunning();
+            bool isRunning() const;
 
-            /** Wait for task to finish executing
+            /** Wait for task to finish executing.
+                The calling thread executes other pending tasks while waiting.
+                Rethrows the exception thrown by the task, if any.
             */
             void finish();
 
         private:
-            Task();
+            Task(std::shared_ptr<State> pState) : mpState(std::move(pState)) {}
+
+            std::shared_ptr<State> mpState;
+
             friend class Threading;
         };
 
+        /** Handle to a task returning a value.
+        */
+        template<typename T>
+        class Future
+        {
+        public:
+            Future() = default;
+
+            bool isValid() const { return mTask.isValid(); }
+            bool isRunning() const { return mTask.isRunning(); }
+
+            /** Wait for the task to finish and return its result. Must be called at most once.
+                Rethrows the exception thrown by the task, if any.
+            */
+            T get()
+            {
+                mTask.finish();
+                if constexpr (!std::is_void_v<T>) return std::move(**mpResult);
+            }
+
+        private:
+            using Storage = std::optional<std::conditional_t<std::is_void_v<T>, char, T>>;
+
+            Future(Task task, std::shared_ptr<Storage> pResult) : mTask(std::move(task)), mpResult(std::move(pResult)) {}
+
+            Task mTask;
+            std::shared_ptr<Storage> mpResult;
+
+            friend class Threading;
+        };
+
+        /** Group of tasks that are waited on together.
+            Tasks may add more tasks to the group while it is being waited on.
+        */
+        class dlldecl TaskGroup
+        {
+        public:
+            TaskGroup() = default;
+            TaskGroup(const TaskGroup&) = delete;
+            TaskGroup& operator=(const TaskGroup&) = delete;
+
+            /** Waits for all tasks. Exceptions thrown by the tasks are logged and discarded.
+            */
+            ~TaskGroup();
+
+            /** Dispatch a task as part of the group.
+            */
+            void run(const std::function<void(void)>& func);
+
+            /** Wait for all tasks in the group to finish.
+                Rethrows the first exception thrown by any of the tasks after all tasks have finished.
+            */
+            void wait();
+
+        private:
+            std::mutex mMutex;
+            std::vector<Task> mTasks;
+        };
+
         /** Initializes the global thread pool
-            \param[in] threadCount Number of threads in the pool
+            \param[in] threadCount Number of worker threads in the pool, or zero to use one less than the number of logical threads (the dispatching thread usually takes part in the work).
         */
-        static void start(uint32_t threadCount = kDefaultThreadCount);
+        static void start(uint32_t threadCount = 0);
 
-        /** Waits for all currently executing threads to finish
+        /** Waits for all dispatched tasks to finish. Must not be called from a task.
         */
         static void finish();
 
-        /** Waits for all currently executing threads to finish and shuts down the thread pool
+        /** Waits for all dispatched tasks to finish and shuts down the thread pool
         */
         static void shutdown();
 
         /** Returns the maximum number of concurrent threads supported by the hardware
         */
-        static uint32_t getLogicalThreadCount() { return std::thread::hardware_concurrency(); }
+        static uint32_t getLogicalThreadCount() { return std::max(1u, std::thread::hardware_concurrency()); }
+
+        /** Returns the number of worker threads in the pool.
+        */
+        static uint32_t getThreadCount();
+
+        /** Returns the index of the calling worker thread in [0, getThreadCount()), or kInvalidWorkerIndex if called from a thread outside the pool.
+        */
+        static uint32_t getWorkerIndex();
+
+        /** Returns the scratch arena of the calling thread.
+            Allocations made by a task are released when the task finishes.
+        */
+        static ScratchArena& getScratchArena();
 
         /** Starts a task on an available thread.
             \return Handle to the task
         */
         static Task dispatchTask(const std::function<void(void)>& func);
+
+        /** Starts a task returning a value on an available thread.
+            \param[in] func Function to execute. It is copied into the task.
+            \return Handle to the task result.
+        */
+        template<typename Func>
+        static Future<std::invoke_result_t<std::decay_t<Func>>> async(Func&& func)
+        {
+            using T = std::invoke_result_t<std::decay_t<Func>>;
+            auto pResult = std::make_shared<typename Future<T>::Storage>();
+            Task task = dispatchTask([pResult, func = std::forward<Func>(func)]() mutable
+            {
+                if constexpr (std::is_void_v<T>) func();
+                else pResult->emplace(func());
+            });
+            return Future<T>(std::move(task), std::move(pResult));
+        }
+
+        /** Call func(chunkBegin, chunkEnd) for consecutive chunks of [begin, end) in parallel.
+            The calling thread takes part in the work. The first exception thrown by func is rethrown after all running chunks have finished.
+            \param[in] begin First index.
+            \param[in] end One past the last index.
+            \param[in] func Function to call for each chunk.
+            \param[in] grainSize Number of indices per chunk (the last chunk may be smaller), or zero to choose a size based on the thread count.
+        */
+        static void parallelForChunks(size_t begin, size_t end, const std::function<void(size_t, size_t)>& func, size_t grainSize = 0);
+
+        /** Call func(i) for all i in [begin, end) in parallel. See parallelForChunks().
+        */
+        template<typename Func>
+        static void parallelFor(size_t begin, size_t end, const Func& func, size_t grainSize = 0)
+        {
+            parallelForChunks(begin, end, [&func](size_t chunkBegin, size_t chunkEnd) { for (size_t i = chunkBegin; i < chunkEnd; i++) func(i); }, grainSize);
+        }
+
+        /** Reduce [begin, end) in parallel.
+            The range is split into chunks of grainSize indices. The partial results of the chunks are combined in order on
+            the calling thread, so for a given grain size the result does not depend on the number of threads.
+            \param[in] begin First index.
+            \param[in] end One past the last index.
+            \param[in] identity Result for an empty range.
+            \param[in] func Function T(chunkBegin, chunkEnd) computing the partial result for a chunk.
+            \param[in] reduce Function T(T, T) combining two partial results.
+            \param[in] grainSize Number of indices per chunk, or zero to choose a size based on the thread count.
+            \return The reduced result.
+        */
+        template<typename T, typename Func, typename Reduce>
+        static T parallelReduce(size_t begin, size_t end, const T& identity, const Func& func, const Reduce& reduce, size_t grainSize = 0)
+        {
+            if (end <= begin) return identity;
+            if (grainSize == 0) grainSize = getDefaultGrainSize(end - begin);
+
+            const size_t chunkCount = (end - begin + grainSize - 1) / grainSize;
+            std::vector<std::optional<T>> partials(chunkCount);
+            parallelFor(0, chunkCount, [&](size_t chunk)
+            {
+                const size_t chunkBegin = begin + chunk * grainSize;
+                partials[chunk].emplace(func(chunkBegin, std::min(end, chunkBegin + grainSize)));
+            }, 1);
+
+            T result = identity;
+            for (auto& partial : partials) result = reduce(result, *partial);
+            return result;
+        }
+
+    private:
+        static size_t getDefaultGrainSize(size_t count);
     };
 
     /** Simple thread barrier class.
@@ -0,0 +1,1277 @@
+/***************************************************************************
+ # Copyright (c) 2022, Daqi Lin.  All rights reserved.
+ **************************************************************************/
+#include "PathReuseCPU.h"
+#include "Utils/Threading.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <limits>
+#include <stdexcept>
+
+namespace Falcor
+{
+    namespace
+    {
+        // Constants mirroring the shader configuration.
+        const uint32_t kNeighborOffsetCount = 8192;         ///< Matches kNeighborOffsetCount in ReSTIRPTPass.cpp.
+        const uint32_t kMaximumPathLength = 15;             ///< Matches kMaximumPathLength in StaticParams.slang.
+        const float kMinCosTheta = 1e-6f;                   ///< Matches kMinCosTheta in IBxDF.slang.
+        const float kMinGGXAlpha = 0.01f * 0.01f;           ///< ROUGHNESS_THRESHOLD squared, see BxDF.slang.
+        const float kRayTMax = std::numeric_limits<float>::max();
+
+        // Sampled lobe flags (SampledBSDFFlags in IBxDF.slang).
+        const uint32_t kDiffuseReflection = 0x1;
+        const uint32_t kSpecularReflection = 0x4;
+
+        // Light sample types (PathTracer::LightSampleType).
+        const uint32_t kLightTypeEnvMap = 0;
+        const uint32_t kLightTypeAnalytic = 2;
+
+        /** Decoding of the packed ReSTIRPathFlags (see PathReservoir.slang).
+        */
+        struct PathFlags
+        {
+            uint32_t flags;
+
+            uint32_t pathLength() const { return flags & 0xf; }
+            uint32_t rcVertexLength() const { return (flags >> 4) & 0xf; }
+            bool isDeltaEvent(bool beforeRcVertex) const { return (flags >> (beforeRcVertex ? 8 : 9)) & 1; }
+            bool isTransmissionEvent(bool beforeRcVertex) const { return (flags >> (beforeRcVertex ? 10 : 11)) & 1; }
+            bool isSpecularBounce(bool beforeRcVertex) const { return (flags >> (beforeRcVertex ? 26 : 27)) & 1; }
+            bool lastVertexNEE() const { return (flags >> 16) & 1; }
+            uint32_t lightType() const { return (flags >> 18) & 3; }
+        };
+
+        float toScalar(const float3& color)
+        {
+            return glm::dot(color, float3(0.299f, 0.587f, 0.114f)); // luminance, matches PathReservoir::toScalar
+        }
+
+        float luminance(const float3& rgb)
+        {
+            return glm::dot(rgb, float3(0.2126f, 0.7152f, 0.0722f));
+        }
+
+        bool anyNonFinite(const float3& v)
+        {
+            return !std::isfinite(v.x) || !std::isfinite(v.y) || !std::isfinite(v.z);
+        }
+
+        bool anyPositive(const float3& v) { return v.x > 0.f || v.y > 0.f || v.z > 0.f; }
+        bool allZero(const float3& v) { return v.x == 0.f && v.y == 0.f && v.z == 0.f; }
+
+        bool isJacobianInvalid(float jacobian)
+        {
+            return jacobian <= 0.f || std::isnan(jacobian) || std::isinf(jacobian);
+        }
+
+        bool hasFlag(const ReuseSurfaceData& s, ReuseSurfaceFlags flag)
+        {
+            return (s.flags & (uint32_t)flag) != 0;
+        }
+
+        uint32_t interleave_32bit(uint2 v)
+        {
+            uint32_t x = v.x & 0x0000ffff;
+            uint32_t y = v.y & 0x0000ffff;
+
+            x = (x | (x << 8)) & 0x00FF00FF;
+            x = (x | (x << 4)) & 0x0F0F0F0F;
+            x = (x | (x << 2)) & 0x33333333;
+            x = (x | (x << 1)) & 0x55555555;
+
+            y = (y | (y << 8)) & 0x00FF00FF;
+            y = (y | (y << 4)) & 0x0F0F0F0F;
+            y = (y | (y << 2)) & 0x33333333;
+            y = (y | (y << 1)) & 0x55555555;
+
+            return x | (y << 1);
+        }
+
+        uint2 blockCipherTEA(uint32_t v0, uint32_t v1, uint32_t iterations = 16)
+        {
+            uint32_t sum = 0;
+            const uint32_t delta = 0x9e3779b9;
+            const uint32_t k[4] = { 0xa341316c, 0xc8013ea4, 0xad90777d, 0x7e95761e };
+            for (uint32_t i = 0; i < iterations; i++)
+            {
+                sum += delta;
+                v0 += ((v1 << 4) + k[0]) ^ (v1 + sum) ^ ((v1 >> 5) + k[1]);
+                v1 += ((v0 << 4) + k[2]) ^ (v0 + sum) ^ ((v0 >> 5) + k[3]);
+            }
+            return uint2(v0, v1);
+        }
+
+        float asfloat(int32_t i) { float f; std::memcpy(&f, &i, sizeof(f)); return f; }
+        int32_t asint(float f) { int32_t i; std::memcpy(&i, &f, sizeof(i)); return i; }
+
+        /** Same as computeRayOrigin() in GeometryHelpers.slang.
+        */
+        float3 computeRayOrigin(const float3& pos, const float3& normal)
+        {
+            const float origin = 1.f / 32.f;
+            const float fScale = 1.f / 65536.f;
+            const float iScale = 256.f;
+
+            float3 result;
+            for (int i = 0; i < 3; i++)
+            {
+                int32_t iOff = int32_t(normal[i] * iScale);
+                float iPos = asfloat(asint(pos[i]) + (pos[i] < 0.f ? -iOff : iOff));
+                float fOff = normal[i] * fScale;
+                result[i] = std::abs(pos[i]) < origin ? pos[i] + fOff : iPos;
+            }
+            return result;
+        }
+
+        /** Shading frame of a path vertex, the subset of ShadingData used by the shifts.
+        */
+        struct ShadingVertex
+        {
+            float3 posW;
+            float3 N;               ///< Shading normal, flipped for back-facing hits on double-sided materials.
+            float3 faceN;
+            float3 V;
+            bool frontFacing;
+            const ReuseSurfaceData* pSurface;
+
+            ShadingVertex() = default;
+            ShadingVertex(const ReuseSurfaceData& s, const float3& viewDir)
+            {
+                pSurface = &s;
+                posW = s.posW;
+                faceN = s.faceN;
+                V = viewDir;
+                frontFacing = glm::dot(V, faceN) >= 0.f;
+                N = (!frontFacing && hasFlag(s, ReuseSurfaceFlags::DoubleSided)) ? -s.N : s.N;
+            }
+
+            float3 computeNewRayOrigin(bool viewside = true) const
+            {
+                return computeRayOrigin(posW, (frontFacing == viewside) ? faceN : -faceN);
+            }
+        };
+
+        /** Opaque subset of FalcorBSDF (BxDF.slang): Lambert diffuse reflection and GGX specular reflection.
+        */
+        struct OpaqueBSDF
+        {
+            float3 diffuse;
+            float3 specular;
+            float alpha;
+            float pDiffuseReflection;
+            float pSpecularReflection;
+
+            OpaqueBSDF(const ReuseSurfaceData& s, const float3& N, const float3& V)
+            {
+                diffuse = s.diffuse;
+                specular = s.specular;
+                alpha = s.linearRoughness * s.linearRoughness;
+                if (alpha < kMinGGXAlpha) alpha = 0.f;
+
+                float diffuseWeight = luminance(s.diffuse);
+                float specularWeight = luminance(evalFresnelSchlick(s.specular, glm::dot(V, N)));
+
+                pDiffuseReflection = anyPositive(s.diffuse) ? diffuseWeight * (1.f - s.metallic) : 0.f;
+                pSpecularReflection = specularWeight;
+
+                float normFactor = pDiffuseReflection + pSpecularReflection;
+                if (normFactor > 0.f)
+                {
+                    pDiffuseReflection /= normFactor;
+                    pSpecularReflection /= normFactor;
+                }
+            }
+
+            static float3 evalFresnelSchlick(const float3& f0, float cosTheta)
+            {
+                return f0 + (float3(1.f) - f0) * std::pow(std::max(1.f - cosTheta, 0.f), 5.f);
+            }
+
+            static float evalNdfGGX(float alpha, float cosTheta)
+            {
+                float a2 = alpha * alpha;
+                float d = ((cosTheta * a2 - cosTheta) * cosTheta + 1);
+                return a2 / (d * d * (float)M_PI);
+            }
+
+            static float evalLambdaGGX(float alphaSqr, float cosTheta)
+            {
+                if (cosTheta <= 0) return 0;
+                float cosThetaSqr = cosTheta * cosTheta;
+                float tanThetaSqr = std::max(1 - cosThetaSqr, 0.f) / cosThetaSqr;
+                return 0.5f * (-1 + std::sqrt(1 + alphaSqr * tanThetaSqr));
+            }
+
+            static float evalG1GGX(float alphaSqr, float cosTheta)
+            {
+                if (cosTheta <= 0) return 0;
+                float cosThetaSqr = cosTheta * cosTheta;
+                float tanThetaSqr = std::max(1 - cosThetaSqr, 0.f) / cosThetaSqr;
+                return 2 / (1 + std::sqrt(1 + alphaSqr * tanThetaSqr));
+            }
+
+            /** Evaluates the BSDF times cosine. All directions in world space, cosines taken against N.
+            */
+            float3 eval(const float3& N, const float3& V, const float3& L, uint32_t allowedSampledFlags) const
+            {
+                float woZ = glm::dot(V, N);
+                float wiZ = glm::dot(L, N);
+                if (std::min(woZ, wiZ) < kMinCosTheta) return float3(0.f);
+
+                float3 result(0.f);
+                if ((allowedSampledFlags & kDiffuseReflection) && pDiffuseReflection > 0.f) result += (float)M_1_PI * diffuse * wiZ;
+                if ((allowedSampledFlags & kSpecularReflection) && pSpecularReflection > 0.f && alpha > 0.f)
+                {
+                    float3 h = glm::normalize(V + L);
+                    float woDotH = glm::dot(V, h);
+                    float D = evalNdfGGX(alpha, glm::dot(h, N));
+                    float alphaSqr = alpha * alpha;
+                    float G = 1.f / (1.f + evalLambdaGGX(alphaSqr, woZ) + evalLambdaGGX(alphaSqr, wiZ));
+                    float3 F = evalFresnelSchlick(specular, woDotH);
+                    result += F * D * G * 0.25f / woZ;
+                }
+                return result;
+            }
+
+            /** Evaluates the sampling pdf restricted to the allowed lobes. 'pdfAll' receives the pdf over all lobes.
+            */
+            float evalPdf(const float3& N, const float3& V, const float3& L, uint32_t allowedSampledFlags, float& pdfAll) const
+            {
+                pdfAll = 0.f;
+                float woZ = glm::dot(V, N);
+                float wiZ = glm::dot(L, N);
+                if (std::min(woZ, wiZ) < kMinCosTheta) return 0.f;
+
+                float pdfSingle = 0.f;
+                if (pDiffuseReflection > 0.f)
+                {
+                    float pdf = pDiffuseReflection * (float)M_1_PI * wiZ;
+                    if (allowedSampledFlags & kDiffuseReflection) pdfSingle += pdf;
+                    pdfAll += pdf;
+                }
+                if (pSpecularReflection > 0.f && alpha > 0.f)
+                {
+                    float3 h = glm::normalize(V + L);
+                    float woDotH = glm::dot(V, h);
+                    float vndfPdf = evalG1GGX(alpha * alpha, woZ) * evalNdfGGX(alpha, glm::dot(h, N)) * std::max(0.f, woDotH) / woZ;
+                    float pdf = pSpecularReflection * vndfPdf / (4.f * woDotH);
+                    if (allowedSampledFlags & kSpecularReflection) pdfSingle += pdf;
+                    pdfAll += pdf;
+                }
+                return pdfSingle;
+            }
+
+            float evalPdf(const float3& N, const float3& V, const float3& L, uint32_t allowedSampledFlags = -1) const
+            {
+                float pdfAll;
+                return evalPdf(N, V, L, allowedSampledFlags, pdfAll);
+            }
+        };
+
+        OpaqueBSDF setupBSDF(const ShadingVertex& v)
+        {
+            return OpaqueBSDF(*v.pSurface, v.N, v.V);
+        }
+    }
+
+    /** Host version of TinyUniformSampleGenerator.
+    */
+    struct PathReuseCPU::SampleGenerator
+    {
+        uint32_t state;
+
+        SampleGenerator(uint2 pixel, uint32_t sampleNumber)
+        {
+            state = blockCipherTEA(interleave_32bit(pixel), sampleNumber).x;
+        }
+
+        float next1D()
+        {
+            state = 1664525u * state + 1013904223u;
+            return (state >> 8) * 0x1p-24f;
+        }
+
+        float2 next2D()
+        {
+            float2 sample;
+            sample.x = next1D();
+            sample.y = next1D();
+            return sample;
+        }
+    };
+
+    /** Primary hit of a pixel in the current or previous frame.
+    */
+    struct PathReuseCPU::PrimaryHit
+    {
+        uint2 pixel;
+        bool isPrevFrame = false;
+        bool valid = false;
+        ShadingVertex sd;
+    };
+
+    /** Host version of PathReservoir, restricted to the first reconnection vertex.
+    */
+    struct PathReuseCPU::Reservoir
+    {
+        ReuseReservoirData data;
+        ReuseSurfaceData rcVertex;
+
+        PathFlags pathFlags() const { return PathFlags{ data.pathFlags }; }
+        bool hasRcVertex() const { return data.rcVertexValid != 0 && hasFlag(rcVertex, ReuseSurfaceFlags::Valid); }
+
+        void init()
+        {
+            data.M = 0.f;
+            data.weight = 0.f;
+            data.pathFlags = (kMaximumPathLength & 0xf) << 4;
+            data.F = float3(0.f);
+            data.rcVertexValid = 0;
+        }
+
+        void copySample(const Reservoir& in)
+        {
+            data.pathFlags = in.data.pathFlags;
+            data.rcRandomSeed = in.data.rcRandomSeed;
+            data.initRandomSeed = in.data.initRandomSeed;
+            data.cachedJacobian = in.data.cachedJacobian;
+            data.lightPdf = in.data.lightPdf;
+            data.rcVertexWi = in.data.rcVertexWi;
+            data.rcVertexValid = in.data.rcVertexValid;
+            data.rcVertexIrradiance = in.data.rcVertexIrradiance;
+            rcVertex = in.rcVertex;
+        }
+
+        bool merge(const float3& inF, float inJacobian, const Reservoir& in, SampleGenerator& sg, float misWeight = 1.f, bool forceAdd = false)
+        {
+            float w = toScalar(inF) * inJacobian * in.data.M * in.data.weight * misWeight;
+            data.M += in.data.M;
+            if (std::isnan(w) || w == 0.f) return false;
+            data.weight += w;
+            if (forceAdd || sg.next1D() * data.weight <= w)
+            {
+                copySample(in);
+                data.F = inF;
+                return true;
+            }
+            return false;
+        }
+
+        bool mergeWithResamplingMIS(const float3& inF, float inJacobian, const Reservoir& in, SampleGenerator& sg, float misWeight = 1.f)
+        {
+            float w = toScalar(inF) * inJacobian * in.data.weight * misWeight;
+            data.M += in.data.M;
+            if (std::isnan(w) || w == 0.f) return false;
+            data.weight += w;
+            if (sg.next1D() * data.weight <= w)
+            {
+                copySample(in);
+                data.F = inF;
+                return true;
+            }
+            return false;
+        }
+
+        void prepareMerging()
+        {
+            data.weight *= toScalar(data.F) * data.M;
+        }
+
+        void finalizeRIS()
+        {
+            float pHat = toScalar(data.F);
+            if (pHat == 0.f || data.M == 0.f) data.weight = 0.f;
+            else data.weight = data.weight / (pHat * data.M);
+        }
+
+        void finalizeGRIS()
+        {
+            float pHat = toScalar(data.F);
+            if (pHat == 0.f) data.weight = 0.f;
+            else data.weight = data.weight / pHat;
+        }
+
+        void sanitize()
+        {
+            if (data.weight < 0.f || std::isinf(data.weight) || std::isnan(data.weight)) data.weight = 0.f;
+        }
+    };
+
+    PathReuseCPU::FrameData PathReuseCPU::FrameData::load(const std::filesystem::path& path)
+    {
+        std::ifstream fs(path, std::ios::binary);
+        if (fs.fail()) throw std::runtime_error("Failed to open reuse data file '" + path.string() + "'!");
+
+        FrameData frame;
+        fs.read(reinterpret_cast<char*>(&frame.header), sizeof(frame.header));
+        if (fs.fail() || frame.header.magic != kReuseDumpMagic || frame.header.version != kReuseDumpVersion)
+        {
+            throw std::runtime_error("Invalid header in reuse data file '" + path.string() + "'!");
+        }
+
+        const size_t pixelCount = frame.getPixelCount();
+        auto readArray = [&](auto& v)
+        {
+            v.resize(pixelCount);
+            fs.read(reinterpret_cast<char*>(v.data()), pixelCount * sizeof(v[0]));
+        };
+
+        readArray(frame.surfaces);
+        readArray(frame.reservoirs);
+        readArray(frame.rcVertices);
+        readArray(frame.motionVectors);
+        if (frame.header.hasTemporalData)
+        {
+            readArray(frame.prevSurfaces);
+            readArray(frame.temporalReservoirs);
+            readArray(frame.temporalRcVertices);
+        }
+        if (fs.fail()) throw std::runtime_error("Failed to read reuse data file '" + path.string() + "'!");
+
+        return frame;
+    }
+
+    void PathReuseCPU::FrameData::save(const std::filesystem::path& path) const
+    {
+        std::ofstream fs(path, std::ios::binary);
+        if (fs.fail()) throw std::runtime_error("Failed to create reuse data file '" + path.string() + "'!");
+
+        const size_t pixelCount = getPixelCount();
+        auto writeArray = [&](const auto& v)
+        {
+            if (v.size() != pixelCount) throw std::runtime_error("Reuse data array size does not match the frame dimension!");
+            fs.write(reinterpret_cast<const char*>(v.data()), pixelCount * sizeof(v[0]));
+        };
+
+        fs.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        writeArray(surfaces);
+        writeArray(reservoirs);
+        writeArray(rcVertices);
+        writeArray(motionVectors);
+        if (header.hasTemporalData)
+        {
+            writeArray(prevSurfaces);
+            writeArray(temporalReservoirs);
+            writeArray(temporalRcVertices);
+        }
+        if (fs.fail()) throw std::runtime_error("Failed to write reuse data file '" + path.string() + "'!");
+    }
+
+    PathReuseCPU::PathReuseCPU(const Options& options)
+        : mOptions(options)
+        , mNeighborOffsets(createNeighborOffsets(kNeighborOffsetCount))
+    {
+    }
+
+    std::vector<float2> PathReuseCPU::createNeighborOffsets(uint32_t sampleCount)
+    {
+        // Same R2 sequence as ReSTIRPTPass::createNeighborOffsetTexture, including the RG8Snorm quantization.
+        std::vector<float2> offsets(sampleCount);
+        const int R = 254;
+        const float phi2 = 1.f / 1.3247179572447f;
+        float u = 0.5f;
+        float v = 0.5f;
+        for (uint32_t index = 0; index < sampleCount;)
+        {
+            u += phi2;
+            v += phi2 * phi2;
+            if (u >= 1.f) u -= 1.f;
+            if (v >= 1.f) v -= 1.f;
+
+            float rSq = (u - 0.5f) * (u - 0.5f) + (v - 0.5f) * (v - 0.5f);
+            if (rSq > 0.25f) continue;
+
+            int8_t x = int8_t((u - 0.5f) * R);
+            int8_t y = int8_t((v - 0.5f) * R);
+            offsets[index++] = float2(std::max(x / 127.f, -1.f), std::max(y / 127.f, -1.f));
+        }
+        return offsets;
+    }
+
+    PathReuseCPU::Stats PathReuseCPU::getStats() const
+    {
+        Stats stats;
+        stats.shiftCount = mShiftCount.load();
+        stats.failedShiftCount = mFailedShiftCount.load();
+        stats.unsupportedShiftCount = mUnsupportedShiftCount.load();
+        return stats;
+    }
+
+    void PathReuseCPU::resetStats()
+    {
+        mShiftCount = 0;
+        mFailedShiftCount = 0;
+        mUnsupportedShiftCount = 0;
+    }
+
+    template<typename Func>
+    void PathReuseCPU::forEachTile(const uint2 frameDim, const Func& func) const
+    {
+        const uint2 tiles = (frameDim + kScreenTileDim - 1u) / kScreenTileDim;
+        Threading::parallelFor(0, tiles.x * tiles.y, [&](size_t tileIndex)
+        {
+            const uint2 tileOrigin = uint2((uint32_t)tileIndex % tiles.x, (uint32_t)tileIndex / tiles.x) * kScreenTileDim;
+            const uint2 tileEnd = glm::min(tileOrigin + kScreenTileDim, frameDim);
+            for (uint32_t y = tileOrigin.y; y < tileEnd.y; y++)
+            {
+                for (uint32_t x = tileOrigin.x; x < tileEnd.x; x++) func(uint2(x, y));
+            }
+        });
+    }
+
+    float PathReuseCPU::evalMIS(float n0, float p0, float n1, float p1) const
+    {
+        switch (mOptions.misHeuristic)
+        {
+        case MISHeuristic::PowerTwo:
+        {
+            float q0 = (n0 * p0) * (n0 * p0);
+            float q1 = (n1 * p1) * (n1 * p1);
+            return q0 / (q0 + q1);
+        }
+        case MISHeuristic::PowerExp:
+        {
+            float q0 = std::pow(n0 * p0, mOptions.misPowerExponent);
+            float q1 = std::pow(n1 * p1, mOptions.misPowerExponent);
+            return q0 / (q0 + q1);
+        }
+        default:
+        {
+            float q0 = n0 * p0;
+            float q1 = n1 * p1;
+            return q0 / (q0 + q1);
+        }
+        }
+    }
+
+    bool PathReuseCPU::evalVisibility(const float3& origin, const float3& dir, float tMax) const
+    {
+        return mVisibilityFunc ? mVisibilityFunc(origin, dir, tMax) : true;
+    }
+
+    float3 PathReuseCPU::computeTracedShift(const PrimaryHit& dstPrimary, const PrimaryHit& srcPrimary, const Reservoir& srcReservoir, float& dstJacobian)
+    {
+        dstJacobian = 0.f;
+        if (!mTracedShiftFunc)
+        {
+            mUnsupportedShiftCount.fetch_add(1, std::memory_order_relaxed);
+            return float3(0.f);
+        }
+
+        TracedShiftQuery query;
+        query.dstPixel = dstPrimary.pixel;
+        query.dstIsPrevFrame = dstPrimary.isPrevFrame;
+        query.pDstPrimary = dstPrimary.sd.pSurface;
+        query.pSrcPrimary = srcPrimary.sd.pSurface;
+        query.pSrcReservoir = &srcReservoir.data;
+        query.pSrcRcVertex = &srcReservoir.rcVertex;
+        float3 result = mTracedShiftFunc(query, dstJacobian);
+        if (std::isnan(dstJacobian) || std::isinf(dstJacobian)) dstJacobian = 0.f;
+        return result;
+    }
+
+    float3 PathReuseCPU::computeShiftedIntegrand(const PrimaryHit& dstPrimary, const PrimaryHit& srcPrimary, const Reservoir& srcReservoir, float& dstJacobian)
+    {
+        dstJacobian = 0.f;
+        if (srcReservoir.data.weight == 0.f) return float3(0.f);
+
+        mShiftCount.fetch_add(1, std::memory_order_relaxed);
+
+        // Transmission is not modeled by the host BSDF.
+        const PathFlags flags = srcReservoir.pathFlags();
+        bool needsTransmission = flags.isTransmissionEvent(true) || flags.isTransmissionEvent(false) ||
+            hasFlag(*dstPrimary.sd.pSurface, ReuseSurfaceFlags::Transmissive) || hasFlag(*srcPrimary.sd.pSurface, ReuseSurfaceFlags::Transmissive) ||
+            (srcReservoir.hasRcVertex() && hasFlag(srcReservoir.rcVertex, ReuseSurfaceFlags::Transmissive));
+
+        float3 result(0.f);
+        if (needsTransmission && mOptions.shiftStrategy != ShiftMapping::RandomReplay)
+        {
+            mUnsupportedShiftCount.fetch_add(1, std::memory_order_relaxed);
+        }
+        else if (mOptions.shiftStrategy == ShiftMapping::Reconnection)
+        {
+            result = computeShiftedIntegrandReconnection(dstPrimary, srcPrimary, srcReservoir, false, dstJacobian);
+        }
+        else if (mOptions.shiftStrategy == ShiftMapping::RandomReplay)
+        {
+            result = computeTracedShift(dstPrimary, srcPrimary, srcReservoir, dstJacobian);
+        }
+        else
+        {
+            result = computeShiftedIntegrandHybrid(dstPrimary, srcPrimary, srcReservoir, dstJacobian);
+        }
+
+        if (allZero(result)) mFailedShiftCount.fetch_add(1, std::memory_order_relaxed);
+        return result;
+    }
+
+    float3 PathReuseCPU::computeShiftedIntegrandHybrid(const PrimaryHit& dstPrimary, const PrimaryHit& srcPrimary, const Reservoir& srcReservoir, float& dstJacobian)
+    {
+        const PathFlags flags = srcReservoir.pathFlags();
+
+        // Reconnection vertices beyond the secondary hit require replaying the path prefix from the destination.
+        if (flags.rcVertexLength() > 1) return computeTracedShift(dstPrimary, srcPrimary, srcReservoir, dstJacobian);
+
+        dstJacobian = 1.f;
+        bool isRcVertexEscapedVertex = flags.pathLength() + 1 == flags.rcVertexLength();
+        float3 Tp(1.f);
+
+        if (mOptions.localStrategyType & (uint32_t)LocalStrategy::RoughnessCondition)
+        {
+            const ReuseSurfaceData& dstSurface = *dstPrimary.sd.pSurface;
+            bool isSpecularBounce = flags.isSpecularBounce(true);
+            bool isLastVertexClassifiedAsRough;
+            if (mOptions.separatePathBSDF)
+            {
+                isLastVertexClassifiedAsRough = isSpecularBounce ?
+                    dstSurface.linearRoughness > mOptions.specularRoughnessThreshold :
+                    (setupBSDF(dstPrimary.sd).pDiffuseReflection > 0.f || dstSurface.linearRoughness > 1.f);
+            }
+            else
+            {
+                isLastVertexClassifiedAsRough = dstSurface.linearRoughness > mOptions.specularRoughnessThreshold;
+            }
+            if (!isLastVertexClassifiedAsRough) Tp = float3(0.f);
+        }
+
+        float3 rcTp(1.f);
+        if (anyPositive(Tp) && (flags.rcVertexLength() <= flags.pathLength() || isRcVertexEscapedVertex))
+        {
+            float reconnectionJacobian = 1.f;
+            rcTp = computeShiftedIntegrandReconnection(dstPrimary, srcPrimary, srcReservoir, true, reconnectionJacobian);
+            dstJacobian *= reconnectionJacobian;
+        }
+
+        return Tp * rcTp;
+    }
+
+    float3 PathReuseCPU::computeShiftedIntegrandReconnection(const PrimaryHit& dstPrimaryHit, const PrimaryHit& srcPrimaryHit, const Reservoir& srcReservoir, bool useHybridShift, float& dstJacobian)
+    {
+        dstJacobian = 0.f;
+
+        const PathFlags flags = srcReservoir.pathFlags();
+        const uint32_t rcVertexLength = !useHybridShift ? 1 : flags.rcVertexLength();
+        const float3 rcVertexIrradiance = srcReservoir.data.rcVertexIrradiance;
+        const float3 rcVertexWi = srcReservoir.data.rcVertexWi;
+
+        const bool isTransmission = flags.isTransmissionEvent(true);
+        const uint32_t allowedSampledTypes1 = mOptions.separatePathBSDF ? (flags.isSpecularBounce(true) ? 0xc : 0x3) : -1;
+
+        ShadingVertex dstPrimarySd = dstPrimaryHit.sd;
+        ShadingVertex srcPrimarySd = srcPrimaryHit.sd;
+        srcPrimarySd.posW = srcPrimarySd.computeNewRayOrigin(!isTransmission);
+        dstPrimarySd.posW = dstPrimarySd.computeNewRayOrigin(!isTransmission);
+
+        const OpaqueBSDF dstPrimaryBSDF = setupBSDF(dstPrimarySd);
+        const OpaqueBSDF srcPrimaryBSDF = setupBSDF(srcPrimarySd);
+
+        if (!srcReservoir.hasRcVertex())
+        {
+            float3 dstIntegrand(0.f);
+            // Is the reconnection vertex an infinite light?
+            if (mOptions.useMIS && flags.lightType() == kLightTypeEnvMap && flags.pathLength() + 1 == rcVertexLength && !flags.lastVertexNEE())
+            {
+                const float3 wi = rcVertexWi;
+                if (evalVisibility(dstPrimarySd.posW, wi, kRayTMax))
+                {
+                    float srcPDF1 = srcPrimaryBSDF.evalPdf(srcPrimarySd.N, srcPrimarySd.V, wi);
+                    float dstPDF1All;
+                    float dstPDF1 = dstPrimaryBSDF.evalPdf(dstPrimarySd.N, dstPrimarySd.V, wi, allowedSampledTypes1, dstPDF1All);
+                    float3 dstF1 = dstPrimaryBSDF.eval(dstPrimarySd.N, dstPrimarySd.V, wi, allowedSampledTypes1);
+                    float misWeight = evalMIS(1, dstPDF1All, 1, srcReservoir.data.lightPdf);
+                    dstIntegrand = dstF1 / dstPDF1 * misWeight * rcVertexIrradiance;
+                    dstJacobian = dstPDF1 / srcPDF1;
+                }
+            }
+
+            if (isJacobianInvalid(dstJacobian)) dstJacobian = 0.f;
+            if (anyNonFinite(dstIntegrand)) return float3(0.f);
+            return dstIntegrand;
+        }
+
+        const bool isRcVertexFinal = flags.pathLength() == rcVertexLength;
+        const bool isRcVertexEscapedVertex = flags.pathLength() + 1 == rcVertexLength && !flags.lastVertexNEE();
+        const bool isRcVertexNEE = isRcVertexFinal && flags.lastVertexNEE();
+
+        // Delta bounce before/after the reconnection vertex.
+        if (flags.isDeltaEvent(true) || flags.isDeltaEvent(false)) return float3(0.f);
+
+        // Reconnection vertex as seen from the destination primary hit.
+        const ShadingVertex rcVertexSd(srcReservoir.rcVertex, glm::normalize(dstPrimarySd.posW - srcReservoir.rcVertex.posW));
+
+        const float3 dstConnectionV = -rcVertexSd.V;
+        const float3 srcConnectionV = glm::normalize(rcVertexSd.posW - srcPrimarySd.posW);
+
+        const float3 shiftedDisp = rcVertexSd.posW - dstPrimarySd.posW;
+        const float shiftedDist2 = glm::dot(shiftedDisp, shiftedDisp);
+        const float shiftedCosine = std::abs(glm::dot(rcVertexSd.faceN, -dstConnectionV));
+
+        if ((mOptions.localStrategyType & (uint32_t)LocalStrategy::DistanceCondition) && useHybridShift)
+        {
+            bool isFarField = std::sqrt(shiftedDist2) >= mOptions.nearFieldDistance;
+            if (!isFarField) return float3(0.f);
+        }
+
+        const float3 originalDisp = rcVertexSd.posW - srcPrimarySd.posW;
+        const float originalDist2 = glm::dot(originalDisp, originalDisp);
+        const float originalCosine = std::abs(glm::dot(rcVertexSd.faceN, -srcConnectionV));
+        float jacobian = shiftedCosine / shiftedDist2 * originalDist2 / originalCosine;
+        if (isJacobianInvalid(jacobian)) return float3(0.f);
+
+        float dstPDF1All = 0.f;
+        float dstPDF1 = dstPrimaryBSDF.evalPdf(dstPrimarySd.N, dstPrimarySd.V, dstConnectionV, allowedSampledTypes1, dstPDF1All);
+        float srcPDF1 = srcPrimaryBSDF.evalPdf(srcPrimarySd.N, srcPrimarySd.V, srcConnectionV, allowedSampledTypes1);
+
+        jacobian *= dstPDF1 / srcPDF1;
+        if (isJacobianInvalid(jacobian)) return float3(0.f);
+
+        float3 dstF1 = dstPrimaryBSDF.eval(dstPrimarySd.N, dstPrimarySd.V, dstConnectionV, allowedSampledTypes1);
+
+        float dstRcVertexScatterPdfAll = 0.f;
+        float dstPDF2 = 1.f;
+        float dstRcVertexScatterPdf = 1.f;
+        float srcRcVertexScatterPdf = 1.f;
+
+        const uint32_t allowedSampledTypes2 = (isRcVertexNEE || !mOptions.separatePathBSDF) ? -1 : (flags.isSpecularBounce(false) ? 0xc : 0x3);
+        const OpaqueBSDF rcVertexBSDF = setupBSDF(rcVertexSd);
+
+        float3 dstF2(1.f);
+        if (!isRcVertexEscapedVertex)
+        {
+            dstRcVertexScatterPdf = rcVertexBSDF.evalPdf(rcVertexSd.N, rcVertexSd.V, rcVertexWi, allowedSampledTypes2, dstRcVertexScatterPdfAll);
+            // Same as evalPdfBSDFWithV(): the BSDF is set up again for the changed view direction (towards the source primary hit).
+            OpaqueBSDF srcRcVertexBSDF(srcReservoir.rcVertex, rcVertexSd.N, -srcConnectionV);
+            srcRcVertexScatterPdf = srcRcVertexBSDF.evalPdf(rcVertexSd.N, -srcConnectionV, rcVertexWi, allowedSampledTypes2);
+
+            if (!isRcVertexNEE) dstPDF2 = dstRcVertexScatterPdf;
+            else dstPDF2 = srcReservoir.data.lightPdf;
+
+            dstF2 = rcVertexBSDF.eval(rcVertexSd.N, rcVertexSd.V, rcVertexWi, allowedSampledTypes2);
+        }
+
+        // Connection point behind surface.
+        if (allZero(dstF1) || allZero(dstF2)) return float3(0.f);
+
+        float3 dstIntegrand = dstF1 / dstPDF1 * (dstF2 / dstPDF2 * rcVertexIrradiance);
+
+        if (isRcVertexEscapedVertex)
+        {
+            dstIntegrand *= evalMIS(1, dstPDF1All, 1, srcReservoir.data.lightPdf);
+        }
+
+        if (isRcVertexFinal && mOptions.useMIS && flags.lightType() != kLightTypeAnalytic)
+        {
+            float lightPdf = srcReservoir.data.lightPdf;
+            float misWeight = evalMIS(1, isRcVertexNEE ? lightPdf : dstRcVertexScatterPdfAll, 1, isRcVertexNEE ? dstRcVertexScatterPdfAll : lightPdf);
+            dstIntegrand *= misWeight;
+            if (!isRcVertexNEE) jacobian *= dstRcVertexScatterPdf / srcRcVertexScatterPdf;
+        }
+
+        // Account for the non-identity Jacobian of BSDF sampling at the reconnection vertex.
+        if (!isRcVertexFinal && !isRcVertexEscapedVertex)
+        {
+            jacobian *= dstRcVertexScatterPdf / srcRcVertexScatterPdf;
+        }
+
+        if (isJacobianInvalid(jacobian)) return float3(0.f);
+
+        // Visibility between the destination primary hit and the reconnection vertex.
+        {
+            float tMax = std::sqrt(shiftedDist2);
+            if (!evalVisibility(dstPrimarySd.posW, shiftedDisp / tMax, tMax * 0.999f)) return float3(0.f);
+        }
+
+        if (anyNonFinite(dstIntegrand)) return float3(0.f);
+
+        if (mOptions.rejectShiftBasedOnJacobian)
+        {
+            if (jacobian > 0.f && std::max(jacobian, 1 / jacobian) > 1 + mOptions.jacobianRejectionThreshold)
+            {
+                jacobian = 0.f;
+                dstIntegrand = float3(0.f);
+            }
+        }
+
+        dstJacobian = jacobian;
+        return dstIntegrand;
+    }
+
+    bool PathReuseCPU::shiftAndMergeReservoir(const PrimaryHit& dstPrimary, Reservoir& dstReservoir, const PrimaryHit& srcPrimary, const Reservoir& srcReservoir,
+        SampleGenerator& sg, float& dstJacobian, float misWeight, bool forceMerge)
+    {
+        float3 dstIntegrand = computeShiftedIntegrand(dstPrimary, srcPrimary, srcReservoir, dstJacobian);
+        bool selected = dstReservoir.merge(dstIntegrand, dstJacobian, srcReservoir, sg, misWeight, forceMerge);
+
+        if (forceMerge)
+        {
+            if (!selected) dstReservoir.data.F = float3(0.f);
+            dstReservoir.data.M = srcReservoir.data.M;
+            dstReservoir.data.weight = srcReservoir.data.weight;
+        }
+
+        return selected;
+    }
+
+    void PathReuseCPU::temporalReuse(const FrameData& frame, ReservoirSet& reservoirs)
+    {
+        if (!frame.header.hasTemporalData) return;
+        forEachTile(frame.header.frameDim, [&](const uint2 pixel) { temporalReusePixel(frame, reservoirs, pixel); });
+    }
+
+    void PathReuseCPU::spatialReuse(const FrameData& frame, const ReservoirSet& input, ReservoirSet& output, uint32_t roundId)
+    {
+        output.reservoirs.resize(input.reservoirs.size());
+        output.rcVertices.resize(input.rcVertices.size());
+        forEachTile(frame.header.frameDim, [&](const uint2 pixel) { spatialReusePixel(frame, input, output, roundId, pixel); });
+    }
+
+    std::vector<float3> PathReuseCPU::execute(const FrameData& frame, ReservoirSet* pReservoirs)
+    {
+        ReservoirSet current = { frame.reservoirs, frame.rcVertices };
+
+        if (mOptions.enableTemporalReuse) temporalReuse(frame, current);
+
+        if (mOptions.enableSpatialReuse)
+        {
+            ReservoirSet next;
+            for (uint32_t roundId = 0; roundId < mOptions.numSpatialRounds; roundId++)
+            {
+                spatialReuse(frame, current, next, roundId);
+                std::swap(current, next);
+            }
+        }
+
+        std::vector<float3> color(frame.getPixelCount(), float3(0.f));
+        for (size_t i = 0; i < color.size(); i++)
+        {
+            if (!hasFlag(frame.surfaces[i], ReuseSurfaceFlags::Valid)) continue;
+            float3 c = current.reservoirs[i].F * current.reservoirs[i].weight;
+            if (anyNonFinite(c) || c.x < 0.f || c.y < 0.f || c.z < 0.f) c = float3(0.f);
+            color[i] = c;
+        }
+
+        if (pReservoirs) *pReservoirs = std::move(current);
+        return color;
+    }
+
+    void PathReuseCPU::temporalReusePixel(const FrameData& frame, ReservoirSet& reservoirs, const uint2 pixel)
+    {
+        const ReuseDumpHeader& header = frame.header;
+        const uint2 frameDim = header.frameDim;
+        SampleGenerator sg(pixel, (header.candidateSamples + 1 + mOptions.numSpatialRounds) * header.seed + header.candidateSamples);
+
+        auto getPrimaryHit = [&](const std::vector<ReuseSurfaceData>& surfaces, const uint2 p, const float3& cameraPosW, bool isPrevFrame)
+        {
+            PrimaryHit hit;
+            const ReuseSurfaceData& s = surfaces[p.y * frameDim.x + p.x];
+            hit.pixel = p;
+            hit.isPrevFrame = isPrevFrame;
+            hit.valid = hasFlag(s, ReuseSurfaceFlags::Valid);
+            if (hit.valid) hit.sd = ShadingVertex(s, glm::normalize(cameraPosW - s.posW));
+            return hit;
+        };
+
+        const uint32_t centralIndex = pixel.y * frameDim.x + pixel.x;
+        const Reservoir centralReservoir = { reservoirs.reservoirs[centralIndex], reservoirs.rcVertices[centralIndex] };
+        Reservoir dstReservoir = centralReservoir;
+        const float currentM = dstReservoir.data.M;
+
+        if (mOptions.temporalMisKind == ReSTIRMISKind::Talbot) dstReservoir.init();
+        else dstReservoir.prepareMerging();
+
+        const PrimaryHit centralPrimary = getPrimaryHit(frame.surfaces, pixel, header.cameraPosW, false);
+        if (!centralPrimary.valid) return;
+
+        int2 prevPixel = int2(pixel);
+        if (mOptions.enableTemporalReprojection)
+        {
+            prevPixel = int2(float2(pixel) + frame.motionVectors[centralIndex] * float2(frameDim) + sg.next2D());
+        }
+
+        if (prevPixel.x < 0 || prevPixel.y < 0 || prevPixel.x >= (int)frameDim.x || prevPixel.y >= (int)frameDim.y) return;
+
+        const PrimaryHit temporalPrimary = getPrimaryHit(frame.prevSurfaces, uint2(prevPixel), header.prevCameraPosW, true);
+        if (!temporalPrimary.valid) return;
+
+        const uint32_t prevIndex = prevPixel.y * frameDim.x + prevPixel.x;
+        Reservoir temporalReservoir = { frame.temporalReservoirs[prevIndex], frame.temporalRcVertices[prevIndex] };
+        temporalReservoir.data.M = std::min(mOptions.temporalHistoryLength * currentM, temporalReservoir.data.M);
+
+        float dstJacobian = 0.f;
+
+        if (mOptions.temporalMisKind == ReSTIRMISKind::Talbot)
+        {
+            const int curSampleId = -1;
+            const int prevSampleId = 0;
+
+            for (int i = curSampleId; i <= prevSampleId; i++)
+            {
+                float pSum = 0.f;
+                float pSelf = 0.f;
+
+                Reservoir tempDstReservoir = dstReservoir;
+                bool possibleToBeSelected = false;
+
+                if (i == curSampleId)
+                {
+                    tempDstReservoir = centralReservoir;
+                    dstJacobian = 1.f;
+                    possibleToBeSelected = tempDstReservoir.data.weight > 0;
+                }
+                else
+                {
+                    possibleToBeSelected = shiftAndMergeReservoir(centralPrimary, tempDstReservoir, temporalPrimary, temporalReservoir, sg, dstJacobian, 1.f, true);
+                }
+
+                if (possibleToBeSelected)
+                {
+                    for (int j = curSampleId; j <= prevSampleId; ++j)
+                    {
+                        if (j == curSampleId)
+                        {
+                            float curP = toScalar(tempDstReservoir.data.F) * currentM;
+                            pSum += curP;
+                            if (i == curSampleId) pSelf = curP;
+                        }
+                        else
+                        {
+                            if (i == j)
+                            {
+                                pSelf = toScalar(temporalReservoir.data.F) / dstJacobian * temporalReservoir.data.M;
+                                pSum += pSelf;
+                                continue;
+                            }
+
+                            float tneighborJacobian;
+                            float3 tneighborIntegrand = computeShiftedIntegrand(temporalPrimary, centralPrimary, tempDstReservoir, tneighborJacobian);
+                            pSum += toScalar(tneighborIntegrand) * tneighborJacobian * temporalReservoir.data.M;
+                        }
+                    }
+                }
+
+                float misWeight = pSum == 0.f ? 0.f : pSelf / pSum;
+                dstReservoir.mergeWithResamplingMIS(tempDstReservoir.data.F, dstJacobian, tempDstReservoir, sg, misWeight);
+            }
+
+            if (dstReservoir.data.weight > 0) dstReservoir.finalizeGRIS();
+        }
+        else
+        {
+            bool chooseCurrent = true;
+            float chosenJacobian = 1.f;
+            bool selected;
+
+            if (mOptions.noResamplingForTemporalReuse) selected = dstReservoir.merge(temporalReservoir.data.F, 1.f, temporalReservoir, sg);
+            else selected = shiftAndMergeReservoir(centralPrimary, dstReservoir, temporalPrimary, temporalReservoir, sg, dstJacobian);
+
+            if (selected)
+            {
+                chooseCurrent = false;
+                chosenJacobian = dstJacobian;
+            }
+
+            // Note: as in TemporalReuse.cs.slang, the MIS weight normalization follows the spatial MIS kind.
+            if (dstReservoir.data.weight > 0 && mOptions.temporalMisKind != ReSTIRMISKind::ConstantBiased && !mOptions.noResamplingForTemporalReuse)
+            {
+                if (chooseCurrent)
+                {
+                    float count = currentM;
+                    float prefixJacobian;
+                    float3 prefixIntegrand = computeShiftedIntegrand(temporalPrimary, centralPrimary, dstReservoir, prefixJacobian);
+                    float prefixApproxPdf = toScalar(prefixIntegrand) * prefixJacobian;
+                    if (prefixApproxPdf > 0.f) count += temporalReservoir.data.M;
+
+                    float misWeight = 1.f / std::max(1.f, count);
+                    if (mOptions.spatialMisKind == ReSTIRMISKind::Constant)
+                    {
+                        misWeight = toScalar(dstReservoir.data.F) / (toScalar(dstReservoir.data.F) * currentM + prefixApproxPdf * temporalReservoir.data.M);
+                    }
+                    dstReservoir.data.weight *= dstReservoir.data.M * misWeight;
+                }
+                else if (mOptions.spatialMisKind == ReSTIRMISKind::Constant)
+                {
+                    float sumPdf = toScalar(temporalReservoir.data.F) / chosenJacobian;
+                    float misWeight = sumPdf / (sumPdf * temporalReservoir.data.M + toScalar(dstReservoir.data.F) * currentM);
+                    dstReservoir.data.weight *= dstReservoir.data.M * misWeight;
+                }
+            }
+
+            dstReservoir.finalizeRIS();
+        }
+
+        dstReservoir.sanitize();
+        reservoirs.reservoirs[centralIndex] = dstReservoir.data;
+        reservoirs.rcVertices[centralIndex] = dstReservoir.rcVertex;
+    }
+
+    void PathReuseCPU::spatialReusePixel(const FrameData& frame, const ReservoirSet& input, ReservoirSet& output, uint32_t roundId, const uint2 pixel)
+    {
+        const ReuseDumpHeader& header = frame.header;
+        const uint2 frameDim = header.frameDim;
+        const uint32_t neighborOffsetMask = kNeighborOffsetCount - 1;
+        SampleGenerator sg(pixel, (header.candidateSamples + 1 + mOptions.numSpatialRounds) * header.seed + header.candidateSamples + 1 + roundId);
+
+        auto index = [&](const int2 p) { return p.y * frameDim.x + p.x; };
+        auto isValidScreenRegion = [&](const int2 p) { return p.x >= 0 && p.y >= 0 && p.x < (int)frameDim.x && p.y < (int)frameDim.y; };
+        auto getReservoir = [&](const int2 p) { return Reservoir{ input.reservoirs[index(p)], input.rcVertices[index(p)] }; };
+        auto getPrimaryHit = [&](const int2 p)
+        {
+            PrimaryHit hit;
+            const ReuseSurfaceData& s = frame.surfaces[index(p)];
+            hit.pixel = uint2(p);
+            hit.valid = hasFlag(s, ReuseSurfaceFlags::Valid);
+            if (hit.valid) hit.sd = ShadingVertex(s, glm::normalize(header.cameraPosW - s.posW));
+            return hit;
+        };
+        auto isValidGeometry = [&](const PrimaryHit& central, const PrimaryHit& neighbor)
+        {
+            if (!mOptions.featureBasedRejection) return true;
+            float centralDist = glm::distance(header.cameraPosW, central.sd.posW);
+            float neighborDist = glm::distance(header.cameraPosW, neighbor.sd.posW);
+            return glm::dot(central.sd.N, neighbor.sd.N) >= 0.5f && std::abs(centralDist - neighborDist) < 0.1f * centralDist;
+        };
+
+        const int smallWindowDiameter = 2 * mOptions.smallWindowRadius + 1;
+        const int neighborCount = mOptions.spatialReusePattern == SpatialReusePattern::Default ? mOptions.neighborCount : smallWindowDiameter * smallWindowDiameter;
+
+        const uint32_t centralIndex = pixel.y * frameDim.x + pixel.x;
+        const Reservoir centralReservoir = getReservoir(int2(pixel));
+        Reservoir dstReservoir = centralReservoir;
+        const float centralM = dstReservoir.data.M;
+
+        const PrimaryHit centralPrimary = getPrimaryHit(int2(pixel));
+        if (!centralPrimary.valid)
+        {
+            output.reservoirs[centralIndex] = centralReservoir.data;
+            output.rcVertices[centralIndex] = centralReservoir.rcVertex;
+            return;
+        }
+
+        if (mOptions.spatialMisKind == ReSTIRMISKind::Talbot || mOptions.spatialMisKind == ReSTIRMISKind::Pairwise) dstReservoir.init();
+        else dstReservoir.prepareMerging();
+
+        const uint32_t startIndex = uint32_t(sg.next1D() * kNeighborOffsetCount);
+
+        auto getNextNeighborPixel = [&](int i)
+        {
+            int2 neighborPixel(0);
+            if (mOptions.spatialReusePattern == SpatialReusePattern::Default)
+            {
+                uint32_t neighborIndex = (startIndex + i) & neighborOffsetMask;
+                neighborPixel = int2(pixel) + int2(mNeighborOffsets[neighborIndex] * mOptions.gatherRadius);
+            }
+            else
+            {
+                neighborPixel = int2(pixel) + int2(-mOptions.smallWindowRadius + (i % smallWindowDiameter), -mOptions.smallWindowRadius + (i / smallWindowDiameter));
+                if (neighborPixel == int2(pixel)) neighborPixel = int2(-1);
+            }
+            return neighborPixel;
+        };
+
+        if (mOptions.spatialMisKind == ReSTIRMISKind::Talbot)
+        {
+            for (int i = -1; i < neighborCount; ++i)
+            {
+                int2 neighborPixel = i == -1 ? int2(pixel) : getNextNeighborPixel(i);
+                if (!isValidScreenRegion(neighborPixel)) continue;
+                const Reservoir neighborReservoir = getReservoir(neighborPixel);
+                const PrimaryHit neighborPrimary = getPrimaryHit(neighborPixel);
+                if (!neighborPrimary.valid) continue;
+                if (!isValidGeometry(centralPrimary, neighborPrimary)) continue;
+
+                float pSum = 0.f;
+                float pSelf = 0.f;
+                float dstJacobian = 0.f;
+
+                Reservoir tempDstReservoir = dstReservoir;
+                bool possibleToBeSelected = false;
+
+                if (i == -1)
+                {
+                    tempDstReservoir = neighborReservoir;
+                    dstJacobian = 1.f;
+                    possibleToBeSelected = neighborReservoir.data.weight > 0;
+                }
+                else
+                {
+                    possibleToBeSelected = shiftAndMergeReservoir(centralPrimary, tempDstReservoir, neighborPrimary, neighborReservoir, sg, dstJacobian, 1.f, true);
+                }
+
+                if (possibleToBeSelected)
+                {
+                    for (int j = -1; j < neighborCount; ++j)
+                    {
+                        if (j == -1)
+                        {
+                            float curP = toScalar(tempDstReservoir.data.F) * centralM;
+                            pSum += curP;
+                            if (i == -1) pSelf = curP;
+                        }
+                        else
+                        {
+                            if (i == j)
+                            {
+                                pSelf = toScalar(neighborReservoir.data.F) / dstJacobian * neighborReservoir.data.M;
+                                pSum += pSelf;
+                                continue;
+                            }
+
+                            int2 tneighborPixel = getNextNeighborPixel(j);
+                            if (!isValidScreenRegion(tneighborPixel)) continue;
+                            const PrimaryHit tneighborPrimary = getPrimaryHit(tneighborPixel);
+                            if (!tneighborPrimary.valid) continue;
+                            if (!isValidGeometry(centralPrimary, tneighborPrimary)) continue;
+
+                            float tneighborJacobian;
+                            float3 tneighborIntegrand = computeShiftedIntegrand(tneighborPrimary, centralPrimary, tempDstReservoir, tneighborJacobian);
+                            pSum += toScalar(tneighborIntegrand) * tneighborJacobian * input.reservoirs[index(tneighborPixel)].M;
+                        }
+                    }
+                }
+
+                float misWeight = pSum == 0.f ? 0.f : pSelf / pSum;
+                dstReservoir.mergeWithResamplingMIS(tempDstReservoir.data.F, dstJacobian, tempDstReservoir, sg, misWeight);
+            }
+
+            if (dstReservoir.data.weight > 0) dstReservoir.finalizeGRIS();
+        }
+        else if (mOptions.spatialMisKind == ReSTIRMISKind::Pairwise)
+        {
+            int validNeighborCount = 0;
+            float canonicalWeight = 1.f;
+
+            for (int i = 0; i < neighborCount; ++i)
+            {
+                int2 neighborPixel = getNextNeighborPixel(i);
+                if (!isValidScreenRegion(neighborPixel)) continue;
+                const PrimaryHit neighborPrimary = getPrimaryHit(neighborPixel);
+                if (!neighborPrimary.valid) continue;
+                if (!isValidGeometry(centralPrimary, neighborPrimary)) continue;
+
+                const Reservoir neighborReservoir = getReservoir(neighborPixel);
+                validNeighborCount++;
+
+                float prefixJacobian;
+                float3 prefixIntegrand = computeShiftedIntegrand(neighborPrimary, centralPrimary, centralReservoir, prefixJacobian);
+                float prefixApproxPdf = toScalar(prefixIntegrand) * prefixJacobian;
+
+                canonicalWeight += 1.f;
+                if (prefixApproxPdf > 0.f)
+                {
+                    canonicalWeight -= prefixApproxPdf * neighborReservoir.data.M /
+                        (prefixApproxPdf * neighborReservoir.data.M + centralReservoir.data.M * toScalar(centralReservoir.data.F) / neighborCount);
+                }
+
+                Reservoir tempDstReservoir = dstReservoir;
+                float dstJacobian;
+                bool possibleToBeSelected = shiftAndMergeReservoir(centralPrimary, tempDstReservoir, neighborPrimary, neighborReservoir, sg, dstJacobian, 1.f, true);
+
+                float neighborWeight = 0.f;
+                if (possibleToBeSelected)
+                {
+                    float neighborPdf = toScalar(neighborReservoir.data.F) / dstJacobian;
+                    neighborWeight = neighborPdf * neighborReservoir.data.M /
+                        (neighborPdf * neighborReservoir.data.M + toScalar(tempDstReservoir.data.F) * centralReservoir.data.M / neighborCount);
+                    if (std::isnan(neighborWeight) || std::isinf(neighborWeight)) neighborWeight = 0.f;
+                }
+
+                dstReservoir.mergeWithResamplingMIS(tempDstReservoir.data.F, dstJacobian, tempDstReservoir, sg, neighborWeight);
+            }
+
+            dstReservoir.mergeWithResamplingMIS(centralReservoir.data.F, 1.f, centralReservoir, sg, canonicalWeight);
+
+            if (dstReservoir.data.weight > 0)
+            {
+                dstReservoir.finalizeGRIS();
+                dstReservoir.data.weight /= (validNeighborCount + 1); // Pairwise MIS weights are not divided by (k+1).
+            }
+        }
+        else
+        {
+            int2 chosenPixel = int2(pixel);
+            int chosenI = -1;
+            float chosenJacobian = 1.f;
+
+            for (int i = 0; i < neighborCount; ++i)
+            {
+                int2 neighborPixel = getNextNeighborPixel(i);
+                if (!isValidScreenRegion(neighborPixel)) continue;
+                const Reservoir neighborReservoir = getReservoir(neighborPixel);
+                const PrimaryHit neighborPrimary = getPrimaryHit(neighborPixel);
+                if (!neighborPrimary.valid) continue;
+                if (!isValidGeometry(centralPrimary, neighborPrimary)) continue;
+
+                float dstJacobian;
+                if (shiftAndMergeReservoir(centralPrimary, dstReservoir, neighborPrimary, neighborReservoir, sg, dstJacobian))
+                {
+                    chosenI = i;
+                    chosenPixel = neighborPixel;
+                    chosenJacobian = dstJacobian;
+                }
+            }
+
+            if (dstReservoir.data.weight > 0)
+            {
+                if (mOptions.spatialMisKind != ReSTIRMISKind::ConstantBiased)
+                {
+                    const Reservoir chosenReservoir = getReservoir(chosenPixel);
+                    float count = centralM;
+                    float chosenApproxPdf = 0.f;
+                    float sumApproxPdf = 0.f;
+
+                    if (chosenI == -1)
+                    {
+                        chosenApproxPdf = toScalar(chosenReservoir.data.F);
+                        sumApproxPdf += chosenApproxPdf * centralM;
+                    }
+                    else
+                    {
+                        sumApproxPdf += toScalar(dstReservoir.data.F) * centralM;
+                    }
+
+                    for (int i = 0; i < neighborCount; ++i)
+                    {
+                        if (i == chosenI)
+                        {
+                            chosenApproxPdf = toScalar(chosenReservoir.data.F) / chosenJacobian;
+                            sumApproxPdf += chosenApproxPdf * chosenReservoir.data.M;
+                            count += chosenReservoir.data.M;
+                            continue;
+                        }
+
+                        int2 prefixPixel = getNextNeighborPixel(i);
+                        if (!isValidScreenRegion(prefixPixel)) continue;
+                        const PrimaryHit prefixPrimary = getPrimaryHit(prefixPixel);
+                        if (!prefixPrimary.valid) continue;
+                        if (!isValidGeometry(centralPrimary, prefixPrimary)) continue;
+
+                        float prefixJacobian;
+                        float3 prefixIntegrand = computeShiftedIntegrand(prefixPrimary, centralPrimary, dstReservoir, prefixJacobian);
+                        float prefixApproxPdf = toScalar(prefixIntegrand) * prefixJacobian;
+                        float prefixM = input.reservoirs[index(prefixPixel)].M;
+
+                        if (prefixApproxPdf > 0.f) count += prefixM;
+                        sumApproxPdf += prefixApproxPdf * prefixM;
+                    }
+
+                    float misWeight = 0.f;
+                    if (sumApproxPdf > 0.f)
+                    {
+                        if (mOptions.spatialMisKind == ReSTIRMISKind::Constant) misWeight = chosenApproxPdf / sumApproxPdf;
+                        else misWeight = 1.f / count;
+                    }
+                    dstReservoir.data.weight *= dstReservoir.data.M * misWeight;
+                }
+
+                dstReservoir.finalizeRIS();
+            }
+        }
+
+        dstReservoir.sanitize();
+        output.reservoirs[centralIndex] = dstReservoir.data;
+        output.rcVertices[centralIndex] = dstReservoir.rcVertex;
+    }
+}
@@ -0,0 +1,191 @@
+/***************************************************************************
+ # Copyright (c) 2022, Daqi Lin.  All rights reserved.
+ **************************************************************************/
+#pragma once
+#include "Params.slang"
+#include "ReuseDataTypes.slang"
+#include <atomic>
+#include <filesystem>
+#include <functional>
+#include <vector>
+
+namespace Falcor
+{
+    /** CPU reference implementation of the ReSTIR PT reuse passes (TemporalReuse.cs.slang and SpatialReuse.cs.slang).
+
+        The implementation operates on reuse data dumps written by ReSTIRPTPass (see ReuseDataTypes.slang)
+        and does not need a GPU or a loaded scene. It mirrors the shader code path by path, including the
+        random number streams, so that its output can be diffed against the GPU result and individual pixels
+        can be stepped through in a debugger.
+
+        Limitations:
+        - BSDFs are evaluated with the opaque lobes of the standard material (Lambert diffuse + GGX reflection).
+          Reservoirs whose reconnection involves a transmission event are rejected.
+        - Visibility defaults to unoccluded. Set a visibility callback to provide ray queries.
+        - Random replay and the hybrid shift with a reconnection vertex beyond the secondary hit need to trace
+          rays. They are forwarded to the traced shift callback, or rejected (and counted) if none is set.
+
+        Pixels are processed in parallel in 16x16 screen tiles.
+    */
+    class PathReuseCPU
+    {
+    public:
+        /** Reuse configuration. Defaults match ReSTIRPTPass.
+        */
+        struct Options
+        {
+            ShiftMapping shiftStrategy = ShiftMapping::Hybrid;
+            ReSTIRMISKind temporalMisKind = ReSTIRMISKind::Talbot;
+            ReSTIRMISKind spatialMisKind = ReSTIRMISKind::Pairwise;
+            MISHeuristic misHeuristic = MISHeuristic::Balance;
+            float misPowerExponent = 2.f;
+            bool useMIS = true;                             ///< Path tracer uses MIS between NEE and BSDF sampling.
+            bool separatePathBSDF = true;                   ///< Path tracer samples specular and diffuse lobes as separate paths.
+
+            bool enableTemporalReuse = true;
+            bool enableSpatialReuse = true;
+            bool enableTemporalReprojection = true;
+            bool noResamplingForTemporalReuse = false;
+            float temporalHistoryLength = 20.f;             ///< Use a large value to disable history clamping.
+
+            SpatialReusePattern spatialReusePattern = SpatialReusePattern::Default;
+            uint32_t numSpatialRounds = 1;
+            int neighborCount = 3;
+            float gatherRadius = 20.f;
+            int smallWindowRadius = 2;
+            bool featureBasedRejection = true;
+
+            uint32_t localStrategyType = (uint32_t)LocalStrategy::RoughnessCondition | (uint32_t)LocalStrategy::DistanceCondition;
+            float specularRoughnessThreshold = 0.2f;
+            float nearFieldDistance = 0.1f;
+            bool rejectShiftBasedOnJacobian = false;
+            float jacobianRejectionThreshold = 10.f;
+        };
+
+        /** Contents of a reuse data dump. Arrays are indexed in scanline order.
+        */
+        struct FrameData
+        {
+            ReuseDumpHeader header;
+            std::vector<ReuseSurfaceData> surfaces;
+            std::vector<ReuseReservoirData> reservoirs;
+            std::vector<ReuseSurfaceData> rcVertices;
+            std::vector<float2> motionVectors;
+            std::vector<ReuseSurfaceData> prevSurfaces;
+            std::vector<ReuseReservoirData> temporalReservoirs;
+            std::vector<ReuseSurfaceData> temporalRcVertices;
+
+            uint32_t getPixelCount() const { return header.frameDim.x * header.frameDim.y; }
+
+            /** Load a dump from file. Throws an exception on failure.
+            */
+            static FrameData load(const std::filesystem::path& path);
+
+            /** Write the dump to file. Throws an exception on failure.
+            */
+            void save(const std::filesystem::path& path) const;
+        };
+
+        /** Reservoirs together with their reconnection vertices.
+        */
+        struct ReservoirSet
+        {
+            std::vector<ReuseReservoirData> reservoirs;
+            std::vector<ReuseSurfaceData> rcVertices;
+        };
+
+        /** Description of a shift that requires tracing rays (random replay or hybrid shift).
+        */
+        struct TracedShiftQuery
+        {
+            uint2 dstPixel;                                 ///< Pixel the reservoir is shifted to.
+            bool dstIsPrevFrame;                            ///< True if the destination is the previous frame's primary hit.
+            const ReuseSurfaceData* pDstPrimary;
+            const ReuseSurfaceData* pSrcPrimary;
+            const ReuseReservoirData* pSrcReservoir;
+            const ReuseSurfaceData* pSrcRcVertex;
+        };
+
+        /** Evaluates the visibility along a ray segment. Returns true if the segment is unoccluded.
+        */
+        using VisibilityFunction = std::function<bool(const float3& origin, const float3& dir, float tMax)>;
+
+        /** Evaluates a shift that requires tracing rays.
+            Returns the shifted integrand and writes the Jacobian; a zero integrand rejects the shift.
+        */
+        using TracedShiftFunction = std::function<float3(const TracedShiftQuery& query, float& dstJacobian)>;
+
+        struct Stats
+        {
+            uint64_t shiftCount = 0;                        ///< Number of evaluated shifts.
+            uint64_t failedShiftCount = 0;                  ///< Number of shifts that yielded a zero integrand.
+            uint64_t unsupportedShiftCount = 0;             ///< Number of shifts rejected because they need ray tracing or transmission.
+        };
+
+        PathReuseCPU(const Options& options = Options());
+
+        void setOptions(const Options& options) { mOptions = options; }
+        const Options& getOptions() const { return mOptions; }
+
+        void setVisibilityFunction(VisibilityFunction func) { mVisibilityFunc = std::move(func); }
+        void setTracedShiftFunction(TracedShiftFunction func) { mTracedShiftFunc = std::move(func); }
+
+        /** Run temporal reuse in place on 'reservoirs'. Does nothing if the frame has no temporal data.
+        */
+        void temporalReuse(const FrameData& frame, ReservoirSet& reservoirs);
+
+        /** Run one round of spatial reuse.
+            \param[in] frame Frame data (primary hits).
+            \param[in] input Reservoirs read by the round.
+            \param[out] output Reservoirs written by the round.
+            \param[in] roundId Spatial round index.
+        */
+        void spatialReuse(const FrameData& frame, const ReservoirSet& input, ReservoirSet& output, uint32_t roundId);
+
+        /** Run the full reuse chain (temporal reuse followed by all spatial rounds) as configured.
+            \param[in] frame Frame data.
+            \param[out] pReservoirs If non-null, receives the final reservoirs.
+            \return Per-pixel color F * W of the final reservoirs, in scanline order.
+        */
+        std::vector<float3> execute(const FrameData& frame, ReservoirSet* pReservoirs = nullptr);
+
+        /** Statistics accumulated since the last call to resetStats().
+        */
+        Stats getStats() const;
+        void resetStats();
+
+        /** Returns the neighbor offsets used by the default spatial reuse pattern, normalized to [-1,1].
+            This matches ReSTIRPTPass::createNeighborOffsetTexture.
+        */
+        static std::vector<float2> createNeighborOffsets(uint32_t sampleCount);
+
+    private:
+        struct PrimaryHit;
+        struct Reservoir;
+        struct SampleGenerator;
+
+        void temporalReusePixel(const FrameData& frame, ReservoirSet& reservoirs, const uint2 pixel);
+        void spatialReusePixel(const FrameData& frame, const ReservoirSet& input, ReservoirSet& output, uint32_t roundId, const uint2 pixel);
+
+        bool shiftAndMergeReservoir(const PrimaryHit& dstPrimary, Reservoir& dstReservoir, const PrimaryHit& srcPrimary, const Reservoir& srcReservoir,
+            SampleGenerator& sg, float& dstJacobian, float misWeight = 1.f, bool forceMerge = false);
+        float3 computeShiftedIntegrand(const PrimaryHit& dstPrimary, const PrimaryHit& srcPrimary, const Reservoir& srcReservoir, float& dstJacobian);
+        float3 computeShiftedIntegrandReconnection(const PrimaryHit& dstPrimary, const PrimaryHit& srcPrimary, const Reservoir& srcReservoir, bool useHybridShift, float& dstJacobian);
+        float3 computeShiftedIntegrandHybrid(const PrimaryHit& dstPrimary, const PrimaryHit& srcPrimary, const Reservoir& srcReservoir, float& dstJacobian);
+        float3 computeTracedShift(const PrimaryHit& dstPrimary, const PrimaryHit& srcPrimary, const Reservoir& srcReservoir, float& dstJacobian);
+        float evalMIS(float n0, float p0, float n1, float p1) const;
+        bool evalVisibility(const float3& origin, const float3& dir, float tMax) const;
+
+        template<typename Func>
+        void forEachTile(const uint2 frameDim, const Func& func) const;
+
+        Options mOptions;
+        VisibilityFunction mVisibilityFunc;
+        TracedShiftFunction mTracedShiftFunc;
+        std::vector<float2> mNeighborOffsets;
+
+        std::atomic<uint64_t> mShiftCount{ 0 };
+        std::atomic<uint64_t> mFailedShiftCount{ 0 };
+        std::atomic<uint64_t> mUnsupportedShiftCount{ 0 };
+    };
+}
@@ -2,8 +2,11 @@
  # Copyright (c) 2022, Daqi Lin.  All rights reserved.
  **************************************************************************/
 #include "ReSTIRPTPass.h"
+#include "PathReuseCPU.h"
 #include "RenderGraph/RenderPassHelpers.h"
 #include <fstream>
+#include <iomanip>
+#include <sstream>
 
 namespace
 {
@@ -17,6 +20,7 @@ namespace
     const std::string kSpatialPathRetraceFile = "RenderPasses/ReSTIRPTPass/SpatialPathRetrace.cs.slang";
     const std::string kTemporalPathRetraceFile = "RenderPasses/ReSTIRPTPass/TemporalPathRetrace.cs.slang";
     const std::string kComputePathReuseMISWeightsFile = "RenderPasses/ReSTIRPTPass/ComputePathReuseMISWeights.cs.slang";
+    const std::string kDumpReuseDataFile = "RenderPasses/ReSTIRPTPass/DumpReuseData.cs.slang";
 
     // Render pass inputs and outputs.
     const std::string kInputVBuffer = "vbuffer";
@@ -197,6 +201,7 @@ namespace
     const std::string kSeparatePathBSDF = "separatePathBSDF";
     const std::string kCandidateSamples = "candidateSamples";
     const std::string kTemporalUpdateForDynamicScene = "temporalUpdateForDynamicScene";
+    const std::string kCompactReservoirs = "compactReservoirs";
     const std::string kEnableRayStats = "enableRayStats";
 
     const uint32_t kNeighborOffsetCount = 8192;
@@ -282,6 +287,7 @@ void ReSTIRPTPass::registerBindings(pybind11::module& m)
         [](const ReSTIRPTPass* pt) { return pt->mParams.fixedSeed; },
         [](ReSTIRPTPass* pt, uint32_t value) { pt->mParams.fixedSeed = value; }
     );
+    pass.def("dumpReuseData", &ReSTIRPTPass::requestReuseDataDump, "path"_a);
 }
 
 std::string ReSTIRPTPass::getDesc() { return kDesc; }
@@ -439,6 +445,7 @@ bool ReSTIRPTPass::parseDictionary(const Dictionary& dict)
         else if (key == kSeparatePathBSDF) mStaticParams.separatePathBSDF = value;
         else if (key == kCandidateSamples) mStaticParams.candidateSamples = value;
         else if (key == kTemporalUpdateForDynamicScene) mStaticParams.temporalUpdateForDynamicScene = value;
+        else if (key == kCompactReservoirs) mStaticParams.compactReservoirs = value;
         else if (key == kEnableRayStats) mEnableRayStats = value;
         else logWarning("Unknown field '" + key + "' in ReSTIRPTPass dictionary");
     }
@@ -593,6 +600,7 @@ Dictionary ReSTIRPTPass::getScriptingDictionary()
     d[kSeparatePathBSDF] = mStaticParams.separatePathBSDF;
     d[kCandidateSamples] = mStaticParams.candidateSamples;
     d[kTemporalUpdateForDynamicScene] = mStaticParams.temporalUpdateForDynamicScene;
+    d[kCompactReservoirs] = mStaticParams.compactReservoirs;
     d[kEnableRayStats] = mEnableRayStats;
     // Denoising parameters
     d[kUseNRDDemodulation] = mStaticParams.useNRDDemodulation;
@@ -730,6 +738,9 @@ void ReSTIRPTPass::execute(RenderContext* pRenderContext, const RenderData& rend
 
                 // Launch main trace pass.
                 tracePass(pRenderContext, renderData, mpTracePass, "tracePass", 0);
+
+                if (restir_i == 0 && !mReuseDataDumpPath.empty() && mStaticParams.pathSamplingMode == PathSamplingMode::ReSTIR)
+                    dumpReuseData(pRenderContext, renderData);
             }
         }
 
@@ -825,6 +836,87 @@ Texture::SharedPtr ReSTIRPTPass::createNeighborOffsetTexture(uint32_t sampleCoun
     return Texture::create1D(sampleCount, ResourceFormat::RG8Snorm, 1, 1, offsets.get());
 }
 
+void ReSTIRPTPass::dumpReuseData(RenderContext* pRenderContext, const RenderData& renderData)
+{
+    PROFILE("dumpReuseData");
+
+    const std::string path = mReuseDataDumpPath;
+    mReuseDataDumpPath.clear();
+
+    Program::Desc desc;
+    desc.addShaderLibrary(kDumpReuseDataFile).csEntry("main").setShaderModel("6_5");
+    ComputePass::SharedPtr pass = ComputePass::create(desc, mStaticParams.getDefines(*this), false);
+    pass->setVars(nullptr); // Create program vars.
+
+    const uint32_t pixelCount = mParams.frameDim.x * mParams.frameDim.y;
+    const bool hasTemporalData = mEnableTemporalReuse && mReservoirFrameCount > 0;
+
+    auto var = pass->getRootVar()["CB"]["gDumpReuseData"];
+    var["params"].setBlob(mParams);
+    var["vbuffer"] = renderData[kInputVBuffer]->asTexture();
+    var["temporalVbuffer"] = mpTemporalVBuffer;
+    var["motionVectors"] = renderData[kInputMotionVectors] ? renderData[kInputMotionVectors]->asTexture() : nullptr;
+    var["outputReservoirs"] = mpOutputReservoirs;
+    var["temporalReservoirs"] = mpTemporalReservoirs[0];
+    var["gHasTemporalData"] = hasTemporalData;
+
+    auto createOutput = [&](const std::string& name)
+    {
+        auto pBuffer = Buffer::createStructured(var[name], pixelCount, ResourceBindFlags::ShaderResource | ResourceBindFlags::UnorderedAccess, Buffer::CpuAccess::None, nullptr, false);
+        var[name] = pBuffer;
+        return pBuffer;
+    };
+    auto pSurfaces = createOutput("surfaces");
+    auto pReservoirs = createOutput("reservoirs");
+    auto pRcVertices = createOutput("rcVertices");
+    auto pMotionVectors = createOutput("dumpMotionVectors");
+    auto pPrevSurfaces = createOutput("prevSurfaces");
+    auto pTemporalReservoirs = createOutput("dumpTemporalReservoirs");
+    auto pTemporalRcVertices = createOutput("temporalRcVertices");
+
+    pass["gScene"] = mpScene->getParameterBlock();
+    pass->execute(pRenderContext, { mParams.frameDim.x, mParams.frameDim.y, 1u });
+
+    PathReuseCPU::FrameData frame;
+    frame.header.frameDim = mParams.frameDim;
+    frame.header.seed = mParams.seed;
+    frame.header.hasTemporalData = hasTemporalData ? 1 : 0;
+    frame.header.shiftStrategy = (uint32_t)mStaticParams.shiftStrategy;
+    frame.header.misHeuristic = (uint32_t)mStaticParams.misHeuristic;
+    frame.header.misPowerExponent = mStaticParams.misPowerExponent;
+    frame.header.candidateSamples = mStaticParams.candidateSamples;
+    frame.header.cameraPosW = mpScene->getCamera()->getData().posW;
+    frame.header.prevCameraPosW = mpScene->getCamera()->getData().prevPosW;
+
+    auto readback = [&](const Buffer::SharedPtr& pBuffer, auto& data)
+    {
+        data.resize(pixelCount);
+        const void* pData = pBuffer->map(Buffer::MapType::Read);
+        std::memcpy(data.data(), pData, pixelCount * sizeof(data[0]));
+        pBuffer->unmap();
+    };
+    readback(pSurfaces, frame.surfaces);
+    readback(pReservoirs, frame.reservoirs);
+    readback(pRcVertices, frame.rcVertices);
+    readback(pMotionVectors, frame.motionVectors);
+    if (hasTemporalData)
+    {
+        readback(pPrevSurfaces, frame.prevSurfaces);
+        readback(pTemporalReservoirs, frame.temporalReservoirs);
+        readback(pTemporalRcVertices, frame.temporalRcVertices);
+    }
+
+    try
+    {
+        frame.save(path);
+        logInfo("Wrote reuse data to '" + path + "'.");
+    }
+    catch (const std::exception& e)
+    {
+        logError(e.what());
+    }
+}
+
 bool ReSTIRPTPass::renderRenderingUI(Gui::Widgets& widget)
 {
     bool dirty = false;
@@ -968,6 +1060,10 @@ bool ReSTIRPTPass::renderRenderingUI(Gui::Widgets& widget)
         dirty |= widget.checkbox("Use Sampled BSDFs", mStaticParams.separatePathBSDF);
         widget.tooltip("Control whether to use mixture BSDF or sampled BSDF in path tracing/path reuse.\n");
 
+        dirty |= widget.checkbox("Compact reservoirs", mStaticParams.compactReservoirs);
+        widget.tooltip("Store reservoirs in a quantized 64 B format instead of 88 B to reduce memory traffic.\n"
+            "Ignored when the path sampling mode is PathReuse (Bekaert-style path reuse), which keeps its own reservoir layout.");
+
         if (widget.var("Max bounces (override all)", mStaticParams.maxSurfaceBounces, 0u, kMaxBounces))
         {
             // Allow users to change the max surface bounce parameter in the UI to clamp all other surface bounce parameters.
@@ -1141,6 +1237,21 @@ bool ReSTIRPTPass::renderStatsUI(Gui::Widgets& widget)
     {
         // Show ray stats
         dirty |= mpPixelStats->renderUI(g);
+
+        // Show reservoir memory footprint.
+        if (mpOutputReservoirs)
+        {
+            uint64_t reservoirBytes = mpOutputReservoirs->getSize();
+            for (const auto& pBuffer : mpTemporalReservoirs) reservoirBytes += pBuffer->getSize();
+            if (mReconnectionDataBuffer) reservoirBytes += mReconnectionDataBuffer->getSize();
+            const uint32_t pixelCount = mParams.frameDim.x * mParams.frameDim.y;
+
+            std::ostringstream oss;
+            oss << "Reservoir size: " << mpOutputReservoirs->getElementSize() << " B\n"
+                << "Reservoir memory: " << std::fixed << std::setprecision(1) << (double)reservoirBytes / std::max(pixelCount, 1u) << " B/pixel ("
+                << (double)reservoirBytes / (1 << 20) << " MB)";
+            g.text(oss.str());
+        }
     }
     return dirty;
 }
@@ -1208,7 +1319,7 @@ void ReSTIRPTPass::prepareResources(RenderContext* pRenderContext, const RenderD
         if (mStaticParams.shiftStrategy != ShiftMapping::Hybrid)
             mReconnectionDataBuffer = nullptr;
 
-        uint32_t baseReservoirSize = 88;
+        uint32_t baseReservoirSize = mStaticParams.compactReservoirs ? 64 : 88;
         uint32_t pathTreeReservoirSize = 128;
 
         if (mpOutputReservoirs &&
@@ -1859,6 +1970,8 @@ Program::DefineList ReSTIRPTPass::StaticParams::getDefines(const ReSTIRPTPass& o
 
     defines.add("SEPARATE_PATH_BSDF", separatePathBSDF ? "1" : "0");
 
+    defines.add("COMPACT_PATH_RESERVOIR", compactReservoirs ? "1" : "0");
+
     defines.add("RCDATA_PATH_NUM", rcDataOfflineMode ? "12" : "6");
     defines.add("RCDATA_PAD_SIZE", rcDataOfflineMode ? "2" : "1");
 
@@ -41,6 +41,11 @@ public:
 
     const PixelStats::SharedPtr& getPixelStats() const { return mpPixelStats; }
 
+    /** Request a dump of the reuse pass inputs of the next frame, for replay with PathReuseCPU.
+        \param[in] path Output file path.
+    */
+    void requestReuseDataDump(const std::string& path) { mReuseDataDumpPath = path; }
+
     void updateDict(const Dictionary& dict) override;
     void initDict() override;
 
@@ -68,6 +73,7 @@ private:
     void PathReusePass(RenderContext* pRenderContext, uint32_t restir_i, const RenderData& renderData, bool temporalReuse = false, int spatialRoundId = 0, bool isLastRound = false);
     void PathRetracePass(RenderContext* pRenderContext, uint32_t restir_i, const RenderData& renderData, bool temporalReuse = false, int spatialRoundId = 0);
     Texture::SharedPtr createNeighborOffsetTexture(uint32_t sampleCount);
+    void dumpReuseData(RenderContext* pRenderContext, const RenderData& renderData);
 
     /** Static configuration. Changing any of these options require shader recompilation.
     */
@@ -114,6 +120,8 @@ private:
 
         bool            rcDataOfflineMode = false;
 
+        bool            compactReservoirs = false;          ///< Store reservoirs in the compact format (PackedPathReservoir). Ignored for PathSamplingMode::PathReuse.
+
 		// Denoising parameters
 		bool        useNRDDemodulation = true;                  ///< Global switch for NRD demodulation.
 
@@ -222,4 +230,6 @@ private:
     Texture::SharedPtr              mpNeighborOffsets;
 
     Buffer::SharedPtr               mNRooksPatternBuffer;
+
+    std::string                     mReuseDataDumpPath;         ///< If non-empty, the reuse pass inputs of the next frame are written to this file.
 };
@@ -0,0 +1,176 @@
+/***************************************************************************
+ # Copyright (c) 2015-21, NVIDIA CORPORATION. All rights reserved.
+ #
+ # Redistribution and use in source and binary forms, with or without
+ # modification, are permitted provided that the following conditions
+ # are met:
+ #  * Redistributions of source code must retain the above copyright
+ #    notice, this list of conditions and the following disclaimer.
+ #  * Redistributions in binary form must reproduce the above copyright
+ #    notice, this list of conditions and the following disclaimer in the
+ #    documentation and/or other materials provided with the distribution.
+ #  * Neither the name of NVIDIA CORPORATION nor the names of its
+ #    contributors may be used to endorse or promote products derived
+ #    from this software without specific prior written permission.
+ #
+ # THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS "AS IS" AND ANY
+ # EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ # IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ # PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+ # CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ # EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ # PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ # PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+ # OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ # (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ # OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ **************************************************************************/
+#include "Testing/UnitTest.h"
+#include "Utils/Sampling/SampleGenerator.h"
+#include <random>
+
+namespace Falcor
+{
+    namespace
+    {
+        /** Host mirror of PathReservoir in the default configuration (no path reuse, 88 B).
+        */
+        struct PathReservoirData
+        {
+            float M;
+            float weight;
+            uint32_t pathFlags;
+            uint32_t rcRandomSeed;
+            float3 F;
+            float lightPdf;
+            float3 cachedJacobian;
+            uint32_t initRandomSeed;
+            uint32_t rcVertexInstanceID;
+            uint32_t rcVertexPrimitiveIndex;
+            float2 rcVertexBarycentrics;
+            float3 rcVertexWi;
+            float3 rcVertexIrradiance;
+        };
+        static_assert(sizeof(PathReservoirData) == 88);
+
+        Program::DefineList getDefines()
+        {
+            // PathReservoir.slang imports the pass parameters. None of the static parameters affect the reservoir format.
+            Program::DefineList defines;
+            for (const char* name : { "SAMPLES_PER_PIXEL", "CANDIDATE_SAMPLES", "MAX_SURFACE_BOUNCES", "MAX_DIFFUSE_BOUNCES", "MAX_SPECULAR_BOUNCES",
+                "MAX_TRANSMISSON_BOUNCES", "ADJUST_SHADING_NORMALS", "USE_BSDF_SAMPLING", "USE_NEE", "USE_MIS", "USE_RUSSIAN_ROULETTE", "USE_ALPHA_TEST",
+                "USE_LIGHTS_IN_DIELECTRIC_VOLUMES", "LIMIT_TRANSMISSION", "MAX_TRANSMISSION_REFLECTION_DEPTH", "MAX_TRANSMISSION_REFRACTION_DEPTH",
+                "DISABLE_CAUSTICS", "DISABLE_DIRECT_ILLUMINATION", "PRIMARY_LOD_MODE", "COLOR_FORMAT", "MIS_HEURISTIC", "MIS_POWER_EXPONENT",
+                "SHIFT_STRATEGY", "SPATIAL_RESTIR_MIS_KIND", "TEMPORAL_RESTIR_MIS_KIND", "TEMPORAL_UPDATE_FOR_DYNAMIC_SCENE", "PATH_SAMPLING_MODE",
+                "SEPARATE_PATH_BSDF", "USE_NRD_DEMODULATION" })
+            {
+                defines.add(name, "0");
+            }
+            defines.add("BPR", "0");
+            defines.add("COMPACT_PATH_RESERVOIR", "1");
+            defines.add("RCDATA_PATH_NUM", "6");
+            defines.add("RCDATA_PAD_SIZE", "1");
+            defines.add(SampleGenerator::create(SAMPLE_GENERATOR_UNIFORM)->getDefines());
+            return defines;
+        }
+
+        std::vector<PathReservoirData> generateReservoirs()
+        {
+            std::mt19937 rng;
+            auto dist = std::uniform_real_distribution<float>();
+            auto u = [&]() { return dist(rng); };
+
+            std::vector<PathReservoirData> reservoirs(10000);
+            for (auto& r : reservoirs)
+            {
+                r.M = std::floor(u() * 20.f) + 0.25f;
+                r.weight = u() * 100.f;
+                r.pathFlags = rng();
+                r.rcRandomSeed = rng();
+                r.F = float3(u(), u(), u()) * 10.f;
+                r.lightPdf = u();
+                r.cachedJacobian = float3(std::pow(2.f, u() * 80.f - 40.f), std::pow(2.f, u() * 80.f - 40.f), std::pow(2.f, u() * 80.f - 40.f));
+                r.initRandomSeed = rng();
+                r.rcVertexInstanceID = rng();
+                r.rcVertexPrimitiveIndex = rng();
+                float b0 = u();
+                r.rcVertexBarycentrics = float2(b0, u() * (1.f - b0));
+                r.rcVertexWi = glm::normalize(float3(u(), u(), u()) * 2.f - 1.f);
+                r.rcVertexIrradiance = float3(u(), u(), u()) * std::pow(2.f, u() * 40.f - 20.f);
+            }
+
+            // Reservoirs without a reconnection vertex have zero direction, irradiance and Jacobian.
+            reservoirs[0].cachedJacobian = float3(0.f);
+            reservoirs[0].rcVertexInstanceID = 0xffffffff;
+            reservoirs[0].rcVertexBarycentrics = float2(0.f);
+            reservoirs[0].rcVertexWi = float3(0.f);
+            reservoirs[0].rcVertexIrradiance = float3(0.f);
+            return reservoirs;
+        }
+    }
+
+    GPU_TEST(PackPathReservoir)
+    {
+        std::vector<PathReservoirData> reservoirs = generateReservoirs();
+
+        ctx.createProgram("Tests/ReSTIRPTPass/PathReservoirTests.cs.slang", "testPackPathReservoir", getDefines());
+        ctx.allocateStructuredBuffer("reservoirs", (uint32_t)reservoirs.size(), reservoirs.data(), reservoirs.size() * sizeof(reservoirs[0]));
+        ctx.allocateStructuredBuffer("result", (uint32_t)reservoirs.size());
+        ctx.runProgram((uint32_t)reservoirs.size());
+
+        const PathReservoirData* result = ctx.mapBuffer<const PathReservoirData>("result");
+
+        // Unset directions decode as +z, zero values are reproduced exactly.
+        EXPECT(result[0].cachedJacobian == float3(0.f));
+        EXPECT(result[0].rcVertexBarycentrics == float2(0.f));
+        EXPECT(result[0].rcVertexWi == float3(0.f, 0.f, 1.f));
+        EXPECT(result[0].rcVertexIrradiance == float3(0.f));
+
+        for (size_t i = 0; i < reservoirs.size(); i++)
+        {
+            const PathReservoirData& r = reservoirs[i];
+            const PathReservoirData& p = result[i];
+
+            // Fields stored at full precision.
+            EXPECT_EQ(p.M, r.M) << "i = " << i;
+            EXPECT_EQ(p.weight, r.weight) << "i = " << i;
+            EXPECT_EQ(p.pathFlags, r.pathFlags) << "i = " << i;
+            EXPECT_EQ(p.rcRandomSeed, r.rcRandomSeed) << "i = " << i;
+            EXPECT(p.F == r.F) << "i = " << i;
+            EXPECT_EQ(p.lightPdf, r.lightPdf) << "i = " << i;
+            EXPECT_EQ(p.initRandomSeed, r.initRandomSeed) << "i = " << i;
+            EXPECT_EQ(p.rcVertexInstanceID, r.rcVertexInstanceID) << "i = " << i;
+            EXPECT_EQ(p.rcVertexPrimitiveIndex, r.rcVertexPrimitiveIndex) << "i = " << i;
+
+            // 21-bit log2 per component. The bound includes the error of log2/exp2 on the GPU.
+            for (int j = 0; j < 3; j++)
+            {
+                EXPECT_LE(std::abs(p.cachedJacobian[j] - r.cachedJacobian[j]), r.cachedJacobian[j] * 1e-4f) << "i = " << i << ", j = " << j;
+            }
+
+            // 16-bit unorm barycentrics are rounded to the nearest step.
+            for (int j = 0; j < 2; j++)
+            {
+                EXPECT_LE(std::abs(p.rcVertexBarycentrics[j] - r.rcVertexBarycentrics[j]), 0.5f / 65535.f + 1e-7f) << "i = " << i << ", j = " << j;
+            }
+
+            // 16-bit octahedral directions: half a step in the octahedral map amplified by the map distortion.
+            if (i > 0)
+            {
+                EXPECT_LE(glm::length(p.rcVertexWi - r.rcVertexWi), 1e-4f) << "i = " << i;
+                EXPECT_LE(std::abs(glm::length(p.rcVertexWi) - 1.f), 1e-5f) << "i = " << i;
+            }
+
+            // LogLuv has about 1% error relative to the largest component, as in the LogLuvHDR test.
+            float threshold = std::max(std::max(r.rcVertexIrradiance.x, r.rcVertexIrradiance.y), r.rcVertexIrradiance.z) * 0.0105f;
+            for (int j = 0; j < 3; j++)
+            {
+                float expMin = r.rcVertexIrradiance[j] > 1e-5f ? std::max(0.f, r.rcVertexIrradiance[j] - threshold) : 0.f;
+                EXPECT_GE(p.rcVertexIrradiance[j], expMin) << "i = " << i << ", j = " << j;
+                EXPECT_LE(p.rcVertexIrradiance[j], r.rcVertexIrradiance[j] + threshold) << "i = " << i << ", j = " << j;
+            }
+        }
+
+        ctx.unmapBuffer("result");
+    }
+}
@@ -0,0 +1,211 @@
+/***************************************************************************
+ # Copyright (c) 2015-21, NVIDIA CORPORATION. All rights reserved.
+ #
+ # Redistribution and use in source and binary forms, with or without
+ # modification, are permitted provided that the following conditions
+ # are met:
+ #  * Redistributions of source code must retain the above copyright
+ #    notice, this list of conditions and the following disclaimer.
+ #  * Redistributions in binary form must reproduce the above copyright
+ #    notice, this list of conditions and the following disclaimer in the
+ #    documentation and/or other materials provided with the distribution.
+ #  * Neither the name of NVIDIA CORPORATION nor the names of its
+ #    contributors may be used to endorse or promote products derived
+ #    from this software without specific prior written permission.
+ #
+ # THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS "AS IS" AND ANY
+ # EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ # IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ # PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+ # CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ # EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ # PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ # PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+ # OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ # (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ # OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ **************************************************************************/
+#include "Testing/UnitTest.h"
+#include "../../../../RenderPasses/ReSTIRPTPass/PathReuseCPU.h"
+#include <cstring>
+#include <random>
+
+namespace Falcor
+{
+    namespace
+    {
+        const std::filesystem::path kTestDirectory = std::filesystem::temp_directory_path() / "PathReuseCPUTests";
+
+        const uint2 kFrameDim = { 40, 24 };
+        const float3 kIrradiance = { 2.f, 1.f, 0.5f };
+        const float3 kDiffuse = { 0.5f, 0.5f, 0.5f };
+        const float kWeight = 0.75f;
+
+        bool isHole(uint32_t index) { return index % 5 == 0; }
+
+        /** Creates a dump of a diffuse plane lit by an environment map, seen from far above.
+            Every pixel holds a one-bounce path escaping in a random direction with the same radiance, so all
+            shifts between pixels (and to the identical previous frame) are exact and reuse is a fixed point.
+            Every fifth pixel is a hole without a primary hit.
+        */
+        PathReuseCPU::FrameData createFrame()
+        {
+            PathReuseCPU::FrameData frame;
+            frame.header.frameDim = kFrameDim;
+            frame.header.seed = 17;
+            frame.header.hasTemporalData = 1;
+            frame.header.shiftStrategy = (uint32_t)ShiftMapping::Hybrid;
+            frame.header.cameraPosW = float3(0.f, 1e4f, 0.f);
+            frame.header.prevCameraPosW = frame.header.cameraPosW;
+
+            const uint32_t pixelCount = frame.getPixelCount();
+            frame.surfaces.resize(pixelCount);
+            frame.reservoirs.resize(pixelCount);
+            frame.rcVertices.resize(pixelCount);
+            frame.motionVectors.resize(pixelCount, float2(0.f));
+
+            std::mt19937 rng(0);
+            std::uniform_real_distribution<float> u(-1.f, 1.f);
+
+            for (uint32_t i = 0; i < pixelCount; i++)
+            {
+                if (isHole(i)) continue;
+
+                const uint2 pixel = { i % kFrameDim.x, i / kFrameDim.x };
+                ReuseSurfaceData& s = frame.surfaces[i];
+                s.posW = float3(2.f * (pixel.x + 0.5f) / kFrameDim.x - 1.f, 0.f, 2.f * (pixel.y + 0.5f) / kFrameDim.y - 1.f);
+                s.flags = (uint32_t)ReuseSurfaceFlags::Valid | (uint32_t)ReuseSurfaceFlags::FrontFacing;
+                s.N = float3(0.f, 1.f, 0.f);
+                s.faceN = s.N;
+                s.linearRoughness = 0.005f; // Below the GGX threshold, the specular lobe is disabled.
+                s.diffuse = kDiffuse;
+                s.specular = float3(0.f);
+
+                // Path length 0 with the reconnection vertex on the environment map, sampled by the BSDF.
+                ReuseReservoirData& r = frame.reservoirs[i];
+                r.M = 1.f;
+                r.weight = kWeight;
+                r.pathFlags = 1 << 4;
+                r.rcVertexWi = glm::normalize(float3(u(rng), 0.2f + 0.4f * (u(rng) + 1.f), u(rng)));
+                r.rcVertexIrradiance = kIrradiance;
+                r.F = kDiffuse * kIrradiance;
+                r.initRandomSeed = (uint32_t)rng();
+                r.rcRandomSeed = (uint32_t)rng();
+            }
+
+            frame.prevSurfaces = frame.surfaces;
+            frame.temporalReservoirs = frame.reservoirs;
+            frame.temporalRcVertices = frame.rcVertices;
+            return frame;
+        }
+
+        void testFixedPoint(CPUUnitTestContext& ctx, PathReuseCPU& reuse, const PathReuseCPU::FrameData& frame)
+        {
+            reuse.resetStats();
+            std::vector<float3> color = reuse.execute(frame);
+            EXPECT_EQ(color.size(), (size_t)frame.getPixelCount());
+
+            for (uint32_t i = 0; i < frame.getPixelCount() && i < color.size(); i++)
+            {
+                float3 expected = isHole(i) ? float3(0.f) : kDiffuse * kIrradiance * kWeight;
+                for (int c = 0; c < 3; c++)
+                {
+                    EXPECT_LE(std::abs(color[i][c] - expected[c]), 1e-4f * expected[c]) << "i = " << i << ", c = " << c;
+                }
+            }
+        }
+    }
+
+    CPU_TEST(PathReuseCPU_FixedPoint)
+    {
+        const PathReuseCPU::FrameData frame = createFrame();
+
+        // Default configuration: hybrid shift, Talbot temporal and pairwise spatial MIS.
+        PathReuseCPU reuse;
+        testFixedPoint(ctx, reuse, frame);
+        PathReuseCPU::Stats stats = reuse.getStats();
+        EXPECT_GT(stats.shiftCount, 0ull);
+        EXPECT_EQ(stats.failedShiftCount, 0ull);
+        EXPECT_EQ(stats.unsupportedShiftCount, 0ull);
+
+        // Reconnection shift with the other spatial MIS kinds, over several rounds.
+        PathReuseCPU::Options options;
+        options.shiftStrategy = ShiftMapping::Reconnection;
+        options.numSpatialRounds = 2;
+        for (auto misKind : { ReSTIRMISKind::Talbot, ReSTIRMISKind::Constant })
+        {
+            options.spatialMisKind = misKind;
+            reuse.setOptions(options);
+            testFixedPoint(ctx, reuse, frame);
+            stats = reuse.getStats();
+            EXPECT_GT(stats.shiftCount, 0ull);
+            EXPECT_EQ(stats.failedShiftCount, 0ull);
+        }
+    }
+
+    CPU_TEST(PathReuseCPU_FailedShifts)
+    {
+        const PathReuseCPU::FrameData frame = createFrame();
+
+        // With everything occluded all shifts fail and each pixel keeps its own sample.
+        PathReuseCPU reuse;
+        reuse.setVisibilityFunction([](const float3&, const float3&, float) { return false; });
+        testFixedPoint(ctx, reuse, frame);
+        PathReuseCPU::Stats stats = reuse.getStats();
+        EXPECT_GT(stats.shiftCount, 0ull);
+        EXPECT_EQ(stats.failedShiftCount, stats.shiftCount);
+        EXPECT_EQ(stats.unsupportedShiftCount, 0ull);
+
+        // Random replay needs to trace rays and is rejected without a traced shift callback.
+        PathReuseCPU::Options options;
+        options.shiftStrategy = ShiftMapping::RandomReplay;
+        reuse.setOptions(options);
+        reuse.setVisibilityFunction(nullptr);
+        testFixedPoint(ctx, reuse, frame);
+        stats = reuse.getStats();
+        EXPECT_GT(stats.shiftCount, 0ull);
+        EXPECT_EQ(stats.failedShiftCount, stats.shiftCount);
+        EXPECT_EQ(stats.unsupportedShiftCount, stats.shiftCount);
+
+        // Replaying the paths leaves them unchanged on this frame.
+        std::atomic<uint64_t> tracedShiftCount{ 0 };
+        reuse.setTracedShiftFunction([&](const PathReuseCPU::TracedShiftQuery& query, float& dstJacobian)
+        {
+            tracedShiftCount++;
+            dstJacobian = 1.f;
+            return query.pSrcReservoir->F;
+        });
+        testFixedPoint(ctx, reuse, frame);
+        stats = reuse.getStats();
+        EXPECT_GT(stats.shiftCount, 0ull);
+        EXPECT_EQ(tracedShiftCount.load(), stats.shiftCount);
+        EXPECT_EQ(stats.failedShiftCount, 0ull);
+        EXPECT_EQ(stats.unsupportedShiftCount, 0ull);
+    }
+
+    CPU_TEST(PathReuseCPU_DumpFile)
+    {
+        const PathReuseCPU::FrameData frame = createFrame();
+
+        std::filesystem::create_directories(kTestDirectory);
+        const auto path = kTestDirectory / "frame.bin";
+        frame.save(path);
+        const PathReuseCPU::FrameData loaded = PathReuseCPU::FrameData::load(path);
+
+        EXPECT(std::memcmp(&loaded.header, &frame.header, sizeof(frame.header)) == 0);
+        auto equal = [](const auto& a, const auto& b) { return a.size() == b.size() && std::memcmp(a.data(), b.data(), a.size() * sizeof(a[0])) == 0; };
+        EXPECT(equal(loaded.surfaces, frame.surfaces));
+        EXPECT(equal(loaded.reservoirs, frame.reservoirs));
+        EXPECT(equal(loaded.rcVertices, frame.rcVertices));
+        EXPECT(equal(loaded.motionVectors, frame.motionVectors));
+        EXPECT(equal(loaded.prevSurfaces, frame.prevSurfaces));
+        EXPECT(equal(loaded.temporalReservoirs, frame.temporalReservoirs));
+        EXPECT(equal(loaded.temporalRcVertices, frame.temporalRcVertices));
+
+        // Replaying the loaded dump gives the same result as the original.
+        PathReuseCPU reuse;
+        EXPECT(reuse.execute(loaded) == reuse.execute(frame));
+
+        std::filesystem::remove_all(kTestDirectory);
+    }
+}
@@ -0,0 +1,126 @@
+/***************************************************************************
+ # Copyright (c) 2015-21, NVIDIA CORPORATION. All rights reserved.
+ #
+ # Redistribution and use in source and binary forms, with or without
+ # modification, are permitted provided that the following conditions
+ # are met:
+ #  * Redistributions of source code must retain the above copyright
+ #    notice, this list of conditions and the following disclaimer.
+ #  * Redistributions in binary form must reproduce the above copyright
+ #    notice, this list of conditions and the following disclaimer in the
+ #    documentation and/or other materials provided with the distribution.
+ #  * Neither the name of NVIDIA CORPORATION nor the names of its
+ #    contributors may be used to endorse or promote products derived
+ #    from this software without specific prior written permission.
+ #
+ # THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS "AS IS" AND ANY
+ # EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ # IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ # PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+ # CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ # EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ # PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ # PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+ # OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ # (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ # OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ **************************************************************************/
+#include "Testing/UnitTest.h"
+#include "Rendering/Lights/EnvMapImportanceBuilder.h"
+
+namespace Falcor
+{
+    CPU_TEST(EnvMapImportanceBuilder_Luminance)
+    {
+        // Five texels to cover both the vectorized and the scalar path.
+        std::vector<float> rgba =
+        {
+            1.f, 0.f, 0.f, 7.f,
+            0.f, 1.f, 0.f, 7.f,
+            0.f, 0.f, 1.f, 7.f,
+            1.f, 1.f, 1.f, 7.f,
+            2.f, 4.f, 8.f, 7.f,
+        };
+        auto luminance = EnvMapImportanceBuilder::computeLuminance(rgba.data(), ResourceFormat::RGBA32Float, 5, 1);
+        EXPECT_EQ(luminance.size(), 5u);
+        if (luminance.size() != 5) return;
+
+        for (uint32_t i = 0; i < 5; i++)
+        {
+            float expected = 0.2126f * rgba[4 * i] + 0.7152f * rgba[4 * i + 1] + 0.0722f * rgba[4 * i + 2];
+            EXPECT_LE(std::abs(luminance[i] - expected), 1e-6f * std::max(1.f, expected)) << "i = " << i;
+        }
+
+        // Non-float formats are not supported.
+        std::vector<uint8_t> rgba8(4);
+        EXPECT(EnvMapImportanceBuilder::computeLuminance(rgba8.data(), ResourceFormat::RGBA8Unorm, 1, 1).empty());
+    }
+
+    CPU_TEST(EnvMapImportanceBuilder_Build)
+    {
+        // A constant environment map gives a constant importance map at all mips.
+        const uint32_t width = 64, height = 32;
+        std::vector<float> constant(width * height, 2.f);
+        auto mips = EnvMapImportanceBuilder::build(constant.data(), width, height, 16, 4);
+        EXPECT_EQ(mips.size(), 5u);
+        for (uint32_t mip = 0; mip < mips.size(); mip++)
+        {
+            uint32_t dim = 16 >> mip;
+            EXPECT_EQ(mips[mip].size(), dim * dim);
+            for (float L : mips[mip]) EXPECT_EQ(L, 2.f) << "mip = " << mip;
+        }
+
+        // An environment map lit from the upper hemisphere (+y) only. The octahedral map has +z at its center,
+        // so the lower half of the importance map (+y) is lit and the upper half (-y) is dark.
+        std::vector<float> upper(width * height, 0.f);
+        for (uint32_t i = 0; i < width * height / 2; i++) upper[i] = 1.f;
+        mips = EnvMapImportanceBuilder::build(upper.data(), width, height, 16, 4);
+        EXPECT_EQ(mips.size(), 5u);
+        if (mips.size() != 5) return;
+
+        for (uint32_t y = 0; y < 16; y++)
+        {
+            for (uint32_t x = 0; x < 16; x++)
+            {
+                float expected = y < 8 ? 0.f : 1.f;
+                EXPECT_LE(std::abs(mips[0][y * 16 + x] - expected), 1e-5f) << "x = " << x << ", y = " << y;
+            }
+        }
+
+        // Each coarser mip averages 2x2 texels.
+        for (uint32_t mip = 1; mip < mips.size(); mip++)
+        {
+            uint32_t dim = 16 >> mip;
+            for (uint32_t y = 0; y < dim; y++)
+            {
+                for (uint32_t x = 0; x < dim; x++)
+                {
+                    const auto& src = mips[mip - 1];
+                    float expected = ((src[2 * y * 2 * dim + 2 * x] + src[(2 * y + 1) * 2 * dim + 2 * x]) + (src[2 * y * 2 * dim + 2 * x + 1] + src[(2 * y + 1) * 2 * dim + 2 * x + 1])) * 0.25f;
+                    EXPECT_EQ(mips[mip][y * dim + x], expected);
+                }
+            }
+        }
+    }
+
+    CPU_TEST(EnvMapImportanceBuilder_Cache)
+    {
+        std::vector<float> luminance(8 * 4, 1.f);
+        luminance[3] = 5.f;
+        auto mips = EnvMapImportanceBuilder::build(luminance.data(), 8, 4, 8, 1);
+
+        auto cachePath = std::filesystem::temp_directory_path() / "EnvMapImportanceBuilderTests.importance";
+        EXPECT(EnvMapImportanceBuilder::writeCache(cachePath, 42, mips));
+
+        EnvMapImportanceBuilder::MipChain cached;
+        EXPECT(EnvMapImportanceBuilder::readCache(cachePath, 42, 8, cached));
+        EXPECT(cached == mips);
+
+        // A different key or dimension invalidates the cache.
+        EXPECT(!EnvMapImportanceBuilder::readCache(cachePath, 43, 8, cached));
+        EXPECT(!EnvMapImportanceBuilder::readCache(cachePath, 42, 16, cached));
+
+        std::filesystem::remove(cachePath);
+        EXPECT(!EnvMapImportanceBuilder::readCache(cachePath, 42, 8, cached));
+    }
+}
@@ -0,0 +1,459 @@
+/***************************************************************************
+ # Copyright (c) 2015-21, NVIDIA CORPORATION. All rights reserved.
+ #
+ # Redistribution and use in source and binary forms, with or without
+ # modification, are permitted provided that the following conditions
+ # are met:
+ #  * Redistributions of source code must retain the above copyright
+ #    notice, this list of conditions and the following disclaimer.
+ #  * Redistributions in binary form must reproduce the above copyright
+ #    notice, this list of conditions and the following disclaimer in the
+ #    documentation and/or other materials provided with the distribution.
+ #  * Neither the name of NVIDIA CORPORATION nor the names of its
+ #    contributors may be used to endorse or promote products derived
+ #    from this software without specific prior written permission.
+ #
+ # THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS "AS IS" AND ANY
+ # EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ # IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ # PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+ # CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ # EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ # PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ # PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+ # OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ # (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ # OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ **************************************************************************/
+#include "Testing/UnitTest.h"
+#include "Rendering/Lights/LightBVHBuilder.h"
+#include "LightTestUtils.h"
+#include <iomanip>
+#include <numeric>
+#include <random>
+#include <unordered_map>
+
+namespace Falcor
+{
+    namespace
+    {
+        void validateBVH(CPUUnitTestContext& ctx, const LightBVHBuilder::Options& options, const std::vector<LightCollection::MeshLightTriangle>& triangles,
+            const std::vector<PackedNode>& nodes, const std::vector<uint32_t>& triangleIndices, const std::vector<uint64_t>& triangleBitmasks)
+        {
+            EXPECT_EQ(triangleBitmasks.size(), triangles.size());
+
+            std::vector<uint32_t> visitCount(triangles.size(), 0);
+
+            // Traverse the tree and check that all triangles are referenced once with a matching bitmask,
+            // and that the lighting cones of all nodes contain the normals of their triangles.
+            struct StackEntry { uint32_t nodeIndex; uint32_t depth; uint64_t bitmask; };
+            std::vector<StackEntry> stack = { { 0, 0, 0 } };
+            std::vector<std::pair<uint32_t, uint32_t>> nodeTriangleRanges(nodes.size());
+
+            // Collect the range of leaf triangles below each node. Nodes are in depth-first order, so the range is contiguous.
+            std::function<std::pair<uint32_t, uint32_t>(uint32_t)> collect = [&](uint32_t nodeIndex)
+            {
+                const auto& node = nodes[nodeIndex];
+                std::pair<uint32_t, uint32_t> range;
+                if (node.isLeaf())
+                {
+                    auto leaf = node.getLeafNode();
+                    range = { leaf.triangleOffset, leaf.triangleOffset + leaf.triangleCount };
+                }
+                else
+                {
+                    auto left = collect(nodeIndex + 1);
+                    auto right = collect(node.getInternalNode().rightChildIdx);
+                    EXPECT_EQ(left.second, right.first);
+                    range = { left.first, right.second };
+                }
+                nodeTriangleRanges[nodeIndex] = range;
+                return range;
+            };
+            collect(0);
+
+            while (!stack.empty())
+            {
+                auto entry = stack.back();
+                stack.pop_back();
+                const auto& node = nodes[entry.nodeIndex];
+
+                auto attribs = node.getNodeAttributes();
+                auto range = nodeTriangleRanges[entry.nodeIndex];
+                if (attribs.cosConeAngle != kInvalidCosConeAngle)
+                {
+                    for (uint32_t i = range.first; i < range.second; i++)
+                    {
+                        float cosAngle = glm::dot(attribs.coneDirection, triangles[triangleIndices[i]].normal);
+                        EXPECT_GE(cosAngle, attribs.cosConeAngle - 1e-3f) << "node = " << entry.nodeIndex;
+                    }
+                }
+
+                if (node.isLeaf())
+                {
+                    auto leaf = node.getLeafNode();
+                    EXPECT_LE(leaf.triangleCount, options.maxTriangleCountPerLeaf);
+                    for (uint32_t i = leaf.triangleOffset; i < leaf.triangleOffset + leaf.triangleCount; i++)
+                    {
+                        uint32_t triangleIndex = triangleIndices[i];
+                        visitCount[triangleIndex]++;
+                        EXPECT_EQ(triangleBitmasks[triangleIndex], entry.bitmask) << "triangleIndex = " << triangleIndex;
+                    }
+                }
+                else
+                {
+                    auto internal = node.getInternalNode();
+                    EXPECT_GT(internal.rightChildIdx, entry.nodeIndex + 1);
+                    stack.push_back({ entry.nodeIndex + 1, entry.depth + 1, entry.bitmask });
+                    stack.push_back({ internal.rightChildIdx, entry.depth + 1, entry.bitmask | (1ull << entry.depth) });
+                }
+            }
+
+            // Triangles with zero flux are culled when using pre-integration.
+            for (size_t i = 0; i < triangles.size(); i++)
+            {
+                bool included = !options.usePreintegration || triangles[i].flux > 0.f;
+                EXPECT_EQ(visitCount[i], included ? 1u : 0u) << "i = " << i;
+            }
+        }
+    }
+
+    CPU_TEST(LightBVHBuilder_Build)
+    {
+        // Use enough triangles to exercise the parallel build.
+        const auto triangles = createLightTriangles(200000, 1);
+
+        for (auto heuristic : { LightBVHBuilder::SplitHeuristic::Equal, LightBVHBuilder::SplitHeuristic::BinnedSAH, LightBVHBuilder::SplitHeuristic::BinnedSAOH })
+        {
+            LightBVHBuilder::Options options;
+            options.splitHeuristicSelection = heuristic;
+            auto pBuilder = LightBVHBuilder::create(options);
+
+            std::vector<PackedNode> nodes;
+            std::vector<uint32_t> triangleIndices;
+            std::vector<uint64_t> triangleBitmasks;
+            pBuilder->build(triangles, nodes, triangleIndices, triangleBitmasks);
+            EXPECT(!nodes.empty());
+            validateBVH(ctx, options, triangles, nodes, triangleIndices, triangleBitmasks);
+
+            // The result must not depend on the scheduling of the parallel build.
+            std::vector<PackedNode> nodes2;
+            std::vector<uint32_t> triangleIndices2;
+            std::vector<uint64_t> triangleBitmasks2;
+            pBuilder->build(triangles, nodes2, triangleIndices2, triangleBitmasks2);
+            EXPECT(nodes.size() == nodes2.size() && std::memcmp(nodes.data(), nodes2.data(), nodes.size() * sizeof(PackedNode)) == 0);
+            EXPECT(triangleIndices == triangleIndices2);
+            EXPECT(triangleBitmasks == triangleBitmasks2);
+        }
+
+        // Building with all triangles culled results in an empty BVH.
+        auto culled = createLightTriangles(100, 2);
+        for (auto& tri : culled) tri.flux = 0.f;
+        std::vector<PackedNode> nodes;
+        std::vector<uint32_t> triangleIndices;
+        std::vector<uint64_t> triangleBitmasks;
+        LightBVHBuilder::create({})->build(culled, nodes, triangleIndices, triangleBitmasks);
+        EXPECT(nodes.empty());
+    }
+
+    CPU_TEST(LightBVHBuilder_Collapse)
+    {
+        const auto triangles = createLightTriangles(50000, 3);
+
+        LightBVHBuilder::Options options;
+        std::vector<PackedNode> nodes;
+        std::vector<uint32_t> triangleIndices;
+        std::vector<uint64_t> triangleBitmasks;
+        LightBVHBuilder::create(options)->build(triangles, nodes, triangleIndices, triangleBitmasks);
+
+        // The wide BVH reuses the leaf nodes of the binary BVH, which are identified by their triangle offset.
+        std::unordered_map<uint32_t, uint32_t> leafNodeByOffset;
+        for (uint32_t nodeIndex = 0; nodeIndex < nodes.size(); nodeIndex++)
+        {
+            if (nodes[nodeIndex].isLeaf()) leafNodeByOffset[nodes[nodeIndex].getLeafNode().triangleOffset] = nodeIndex;
+        }
+
+        for (uint32_t branchingFactor : { 4u, 8u })
+        {
+            std::vector<PackedWideNode> wideNodes;
+            std::vector<uint64_t> wideTriangleBitmasks;
+            LightBVHBuilder::collapse(branchingFactor, nodes, triangleIndices, (uint32_t)triangles.size(), wideNodes, wideTriangleBitmasks);
+            EXPECT(!wideNodes.empty());
+            EXPECT_EQ(wideTriangleBitmasks.size(), triangles.size());
+
+            // Traverse the wide tree and check that all triangles are referenced once with a matching bitmask,
+            // and that the quantized attributes of the leaf children enclose the attributes of the binary leaves.
+            const uint32_t bitsPerLevel = branchingFactor > 4 ? 3 : 2;
+            std::vector<uint32_t> visitCount(triangles.size(), 0);
+            uint32_t wideNodeCount = 0;
+
+            struct StackEntry { uint32_t nodeIndex; uint32_t depth; uint64_t bitmask; };
+            std::vector<StackEntry> stack = { { 0, 0, 0 } };
+            while (!stack.empty())
+            {
+                auto entry = stack.back();
+                stack.pop_back();
+                wideNodeCount++;
+
+                const PackedWideNode& node = wideNodes[entry.nodeIndex];
+                const uint32_t childCount = node.getChildCount();
+                EXPECT_GE(childCount, 2u);
+                EXPECT_LE(childCount, branchingFactor);
+
+                for (uint32_t i = 0; i < childCount; i++)
+                {
+                    const uint64_t bitmask = entry.bitmask | ((uint64_t)i << (entry.depth * bitsPerLevel));
+                    if (!node.isChildLeaf(i))
+                    {
+                        EXPECT_GT(node.getChildNodeIndex(i), entry.nodeIndex);
+                        stack.push_back({ node.getChildNodeIndex(i), entry.depth + 1, bitmask });
+                        continue;
+                    }
+
+                    const LeafNode leaf = node.getChildLeafNode(i);
+                    auto it = leafNodeByOffset.find(leaf.triangleOffset);
+                    EXPECT(it != leafNodeByOffset.end()) << "triangleOffset = " << leaf.triangleOffset;
+                    if (it == leafNodeByOffset.end()) continue;
+
+                    const LeafNode binaryLeaf = nodes[it->second].getLeafNode();
+                    EXPECT_EQ(leaf.triangleCount, binaryLeaf.triangleCount);
+
+                    float3 wideMin, wideMax, binaryMin, binaryMax;
+                    SharedNodeAttributes wideAttribs = leaf.attribs;
+                    SharedNodeAttributes binaryAttribs = binaryLeaf.attribs;
+                    wideAttribs.getAABB(wideMin, wideMax);
+                    binaryAttribs.getAABB(binaryMin, binaryMax);
+                    EXPECT(glm::all(glm::lessThanEqual(wideMin, binaryMin)) && glm::all(glm::greaterThanEqual(wideMax, binaryMax))) << "triangleOffset = " << leaf.triangleOffset;
+                    EXPECT_EQ(wideAttribs.flux > 0.f, binaryAttribs.flux > 0.f);
+
+                    if (binaryAttribs.cosConeAngle == kInvalidCosConeAngle)
+                    {
+                        EXPECT_EQ(wideAttribs.cosConeAngle, kInvalidCosConeAngle);
+                    }
+                    else if (wideAttribs.cosConeAngle != kInvalidCosConeAngle)
+                    {
+                        const float directionAngle = std::acos(std::clamp(glm::dot(wideAttribs.coneDirection, binaryAttribs.coneDirection), -1.f, 1.f));
+                        EXPECT_LE(directionAngle + std::acos(binaryAttribs.cosConeAngle), std::acos(wideAttribs.cosConeAngle) + 1e-4f) << "triangleOffset = " << leaf.triangleOffset;
+                    }
+
+                    for (uint32_t j = leaf.triangleOffset; j < leaf.triangleOffset + leaf.triangleCount; j++)
+                    {
+                        uint32_t triangleIndex = triangleIndices[j];
+                        visitCount[triangleIndex]++;
+                        EXPECT_EQ(wideTriangleBitmasks[triangleIndex], bitmask) << "triangleIndex = " << triangleIndex;
+                    }
+                }
+            }
+            EXPECT_EQ(wideNodeCount, wideNodes.size());
+
+            for (size_t i = 0; i < triangles.size(); i++)
+            {
+                bool included = triangles[i].flux > 0.f;
+                EXPECT_EQ(visitCount[i], included ? 1u : 0u) << "i = " << i;
+            }
+        }
+
+        // A binary BVH consisting of a single leaf collapses into a root node with a single leaf child.
+        auto single = createLightTriangles(3, 4);
+        for (auto& tri : single) tri.flux = 1.f;
+        LightBVHBuilder::create(options)->build(single, nodes, triangleIndices, triangleBitmasks);
+        EXPECT_EQ(nodes.size(), 1u);
+
+        std::vector<PackedWideNode> wideNodes;
+        std::vector<uint64_t> wideTriangleBitmasks;
+        LightBVHBuilder::collapse(8, nodes, triangleIndices, (uint32_t)single.size(), wideNodes, wideTriangleBitmasks);
+        EXPECT_EQ(wideNodes.size(), 1u);
+        EXPECT_EQ(wideNodes[0].getChildCount(), 1u);
+        EXPECT(wideNodes[0].isChildLeaf(0));
+        for (auto bitmask : wideTriangleBitmasks) EXPECT_EQ(bitmask, 0ull);
+    }
+
+    CPU_TEST(LightBVHBuilder_Refit)
+    {
+        auto triangles = createLightTriangles(20000, 5);
+
+        LightBVHBuilder::Options options;
+        options.useCPURefit = true;
+        options.rebuildCostThreshold = 1.2f;
+        auto pBuilder = LightBVHBuilder::create(options);
+
+        std::vector<PackedNode> nodes;
+        std::vector<uint32_t> triangleIndices;
+        std::vector<uint64_t> triangleBitmasks;
+        LightBVH::CPURefitData refitData;
+        pBuilder->build(triangles, nodes, triangleIndices, triangleBitmasks);
+        pBuilder->initRefitData(nodes, triangleIndices, (uint32_t)triangles.size(), refitData);
+
+        // Refit all nodes once. Unlike the build, the refit computes the lighting cones of internal nodes from the packed cones of their children.
+        std::vector<uint32_t> allTriangles(triangles.size());
+        std::iota(allTriangles.begin(), allTriangles.end(), 0);
+        auto stats = pBuilder->refit(triangles, allTriangles, nodes, triangleIndices, triangleBitmasks, refitData);
+        EXPECT_EQ(stats.refitNodeCount, nodes.size());
+        EXPECT_EQ(stats.rebuiltSubtreeCount, 0u);
+
+        // Checks that the leaf nodes enclose their triangles and that the refit data matches the tree.
+        auto validateRefit = [&]()
+        {
+            validateBVH(ctx, options, triangles, nodes, triangleIndices, triangleBitmasks);
+
+            for (const auto& node : nodes)
+            {
+                if (!node.isLeaf()) continue;
+                auto leaf = node.getLeafNode();
+                float3 aabbMin, aabbMax;
+                leaf.attribs.getAABB(aabbMin, aabbMax);
+                for (uint32_t i = leaf.triangleOffset; i < leaf.triangleOffset + leaf.triangleCount; i++)
+                {
+                    for (const auto& vtx : triangles[triangleIndices[i]].vtx)
+                    {
+                        EXPECT(glm::all(glm::greaterThanEqual(vtx.pos, aabbMin - 1e-2f)) && glm::all(glm::lessThanEqual(vtx.pos, aabbMax + 1e-2f))) << "triangleIndex = " << triangleIndices[i];
+                    }
+                }
+            }
+
+            LightBVH::CPURefitData expected;
+            pBuilder->initRefitData(nodes, triangleIndices, (uint32_t)triangles.size(), expected);
+            EXPECT(refitData.parentIndices == expected.parentIndices);
+            EXPECT(refitData.triangleLeafIndices == expected.triangleLeafIndices);
+            EXPECT_EQ(refitData.subtreeCosts.size(), expected.subtreeCosts.size());
+            for (size_t i = 0; i < std::min(refitData.subtreeCosts.size(), expected.subtreeCosts.size()); i++)
+            {
+                EXPECT_LE(std::abs(refitData.subtreeCosts[i] - expected.subtreeCosts[i]), 1e-4f * expected.subtreeCosts[i]) << "node = " << i;
+            }
+        };
+
+        // Move the triangles of a single cluster a bit and refit the nodes above them. This does not degrade the tree.
+        const uint32_t clusterCount = (uint32_t)triangles.size() / 1000;
+        std::vector<uint32_t> dirtyTriangles;
+        for (uint32_t i = 0; i < triangles.size(); i += clusterCount) dirtyTriangles.push_back(i);
+        for (uint32_t i : dirtyTriangles)
+        {
+            for (auto& vtx : triangles[i].vtx) vtx.pos += float3(0.5f, 0.f, 0.f);
+        }
+
+        stats = pBuilder->refit(triangles, dirtyTriangles, nodes, triangleIndices, triangleBitmasks, refitData);
+        EXPECT_GT(stats.refitNodeCount, 0u);
+        EXPECT_LT(stats.refitNodeCount, nodes.size());
+        EXPECT_EQ(stats.rebuiltSubtreeCount, 0u);
+        validateRefit();
+
+        // Refitting only the dirty nodes gives the same result as refitting all nodes.
+        auto fullNodes = nodes;
+        auto fullTriangleIndices = triangleIndices;
+        auto fullTriangleBitmasks = triangleBitmasks;
+        auto fullRefitData = refitData;
+        pBuilder->refit(triangles, allTriangles, fullNodes, fullTriangleIndices, fullTriangleBitmasks, fullRefitData);
+        EXPECT(std::memcmp(nodes.data(), fullNodes.data(), nodes.size() * sizeof(PackedNode)) == 0);
+
+        // Move half of the cluster far away. This bloats the leaf nodes mixing moved and static triangles,
+        // which degrades the subtrees containing them so that they are rebuilt.
+        dirtyTriangles.clear();
+        for (uint32_t i = 0; i < triangles.size(); i += 2 * clusterCount) dirtyTriangles.push_back(i);
+        for (uint32_t i : dirtyTriangles)
+        {
+            for (auto& vtx : triangles[i].vtx) vtx.pos += float3(200.f, 0.f, 0.f);
+        }
+
+        auto refitOnlyNodes = nodes;
+        auto refitOnlyTriangleIndices = triangleIndices;
+        auto refitOnlyTriangleBitmasks = triangleBitmasks;
+        auto refitOnlyData = refitData;
+        LightBVHBuilder::Options refitOnlyOptions = options;
+        refitOnlyOptions.rebuildCostThreshold = 0.f;
+        LightBVHBuilder::create(refitOnlyOptions)->refit(triangles, dirtyTriangles, refitOnlyNodes, refitOnlyTriangleIndices, refitOnlyTriangleBitmasks, refitOnlyData);
+
+        stats = pBuilder->refit(triangles, dirtyTriangles, nodes, triangleIndices, triangleBitmasks, refitData);
+        EXPECT_GT(stats.rebuiltSubtreeCount, 0u);
+        EXPECT_GT(stats.rebuiltTriangleCount, 0u);
+        validateRefit();
+
+        // The partial rebuild improves the quality of the tree.
+        EXPECT_LT(refitData.subtreeCosts[0], refitOnlyData.subtreeCosts[0]);
+    }
+
+    CPU_TEST(LightBVHBuilder_RefitWide)
+    {
+        auto triangles = createLightTriangles(20000, 6);
+
+        LightBVHBuilder::Options options;
+        options.useCPURefit = true;
+        options.rebuildCostThreshold = 0.f;
+        auto pBuilder = LightBVHBuilder::create(options);
+
+        std::vector<PackedNode> nodes;
+        std::vector<uint32_t> triangleIndices;
+        std::vector<uint64_t> triangleBitmasks;
+        LightBVH::CPURefitData refitData;
+        pBuilder->build(triangles, nodes, triangleIndices, triangleBitmasks);
+        pBuilder->initRefitData(nodes, triangleIndices, (uint32_t)triangles.size(), refitData);
+
+        const uint32_t clusterCount = (uint32_t)triangles.size() / 1000;
+        for (uint32_t branchingFactor : { 4u, 8u })
+        {
+            std::vector<PackedWideNode> wideNodes;
+            std::vector<uint64_t> wideTriangleBitmasks;
+            LightBVHBuilder::collapse(branchingFactor, nodes, triangleIndices, (uint32_t)triangles.size(), wideNodes, wideTriangleBitmasks, &refitData);
+            EXPECT_EQ(refitData.wideChildIndices.size(), wideNodes.size() * PackedWideNode::kMaxChildCount);
+            EXPECT_EQ(refitData.wideParentIndices.size(), nodes.size());
+
+            // Move the triangles of a single cluster and refit the binary nodes above them.
+            std::vector<uint32_t> dirtyTriangles;
+            for (uint32_t i = 0; i < triangles.size(); i += clusterCount) dirtyTriangles.push_back(i);
+            for (uint32_t i : dirtyTriangles)
+            {
+                for (auto& vtx : triangles[i].vtx) vtx.pos += float3(0.f, 0.5f, 0.f);
+            }
+
+            std::vector<uint32_t> refitNodes;
+            auto stats = pBuilder->refit(triangles, dirtyTriangles, nodes, triangleIndices, triangleBitmasks, refitData, &refitNodes);
+            EXPECT_EQ(stats.rebuiltSubtreeCount, 0u);
+            EXPECT_EQ(refitNodes.size(), stats.refitNodeCount);
+
+            // Only the wide nodes with refitted children are updated.
+            auto wideNodeIndices = LightBVHBuilder::refitWideNodes(nodes, refitNodes, refitData, wideNodes);
+            EXPECT_GT(wideNodeIndices.size(), 0u);
+            EXPECT_LT(wideNodeIndices.size(), wideNodes.size());
+            EXPECT(std::is_sorted(wideNodeIndices.begin(), wideNodeIndices.end()));
+
+            // The result is the same as collapsing the refitted binary BVH again.
+            std::vector<PackedWideNode> expectedWideNodes;
+            std::vector<uint64_t> expectedWideTriangleBitmasks;
+            LightBVHBuilder::collapse(branchingFactor, nodes, triangleIndices, (uint32_t)triangles.size(), expectedWideNodes, expectedWideTriangleBitmasks);
+            EXPECT_EQ(wideNodes.size(), expectedWideNodes.size());
+            if (wideNodes.size() != expectedWideNodes.size()) continue;
+            EXPECT(std::memcmp(wideNodes.data(), expectedWideNodes.data(), wideNodes.size() * sizeof(PackedWideNode)) == 0);
+            EXPECT(wideTriangleBitmasks == expectedWideTriangleBitmasks);
+        }
+    }
+
+    CPU_TEST(LightBVHBuilder_Benchmark, "Disabled for performance reasons")
+    {
+        std::cout << "LightBVHBuilder build time" << std::endl;
+        std::cout << "  triangles  heuristic   time (ms)      nodes" << std::endl;
+
+        for (uint32_t triangleCount : { 1000000u, 4000000u, 10000000u })
+        {
+            const auto triangles = createLightTriangles(triangleCount, 1);
+
+            for (auto heuristic : { LightBVHBuilder::SplitHeuristic::BinnedSAH, LightBVHBuilder::SplitHeuristic::BinnedSAOH })
+            {
+                LightBVHBuilder::Options options;
+                options.splitHeuristicSelection = heuristic;
+                auto pBuilder = LightBVHBuilder::create(options);
+
+                std::vector<PackedNode> nodes;
+                std::vector<uint32_t> triangleIndices;
+                std::vector<uint64_t> triangleBitmasks;
+
+                auto t0 = CpuTimer::getCurrentTimePoint();
+                pBuilder->build(triangles, nodes, triangleIndices, triangleBitmasks);
+                auto t1 = CpuTimer::getCurrentTimePoint();
+
+                std::cout << std::setw(11) << triangleCount
+                    << std::setw(11) << (heuristic == LightBVHBuilder::SplitHeuristic::BinnedSAH ? "SAH" : "SAOH")
+                    << std::setw(12) << std::fixed << std::setprecision(1) << CpuTimer::calcDuration(t0, t1)
+                    << std::setw(11) << nodes.size() << std::endl;
+            }
+        }
+    }
+}
@@ -0,0 +1,195 @@
+/***************************************************************************
+ # Copyright (c) 2015-21, NVIDIA CORPORATION. All rights reserved.
+ #
+ # Redistribution and use in source and binary forms, with or without
+ # modification, are permitted provided that the following conditions
+ # are met:
+ #  * Redistributions of source code must retain the above copyright
+ #    notice, this list of conditions and the following disclaimer.
+ #  * Redistributions in binary form must reproduce the above copyright
+ #    notice, this list of conditions and the following disclaimer in the
+ #    documentation and/or other materials provided with the distribution.
+ #  * Neither the name of NVIDIA CORPORATION nor the names of its
+ #    contributors may be used to endorse or promote products derived
+ #    from this software without specific prior written permission.
+ #
+ # THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS "AS IS" AND ANY
+ # EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ # IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ # PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+ # CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ # EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ # PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ # PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+ # OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ # (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ # OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ **************************************************************************/
+#include "Testing/UnitTest.h"
+#include "Rendering/Lights/LightBVHBuilder.h"
+#include "Rendering/Lights/LightBVHSamplerCPU.h"
+#include "LightTestUtils.h"
+#include <random>
+
+namespace Falcor
+{
+    namespace
+    {
+        struct ShadingPoint
+        {
+            float3 posW;
+            float3 normalW;
+        };
+
+        std::vector<ShadingPoint> createShadingPoints(uint32_t count, uint32_t seed)
+        {
+            std::mt19937 rng(seed);
+            std::uniform_real_distribution<float> u(-20.f, 120.f);
+            std::normal_distribution<float> n;
+
+            std::vector<ShadingPoint> points(count);
+            for (auto& p : points)
+            {
+                p.posW = float3(u(rng), u(rng), u(rng));
+                p.normalW = glm::normalize(float3(n(rng), n(rng), n(rng)));
+            }
+            return points;
+        }
+
+        /** Creates the reference samplers for the binary BVH and the 4-wide and 8-wide BVHs collapsed from it.
+        */
+        std::vector<LightBVHSamplerCPU> createSamplers(const LightBVHSampler::Options& options, const std::vector<LightCollection::MeshLightTriangle>& triangles)
+        {
+            std::vector<PackedNode> nodes;
+            std::vector<uint32_t> triangleIndices;
+            std::vector<uint64_t> triangleBitmasks;
+            LightBVHBuilder::create(options.buildOptions)->build(triangles, nodes, triangleIndices, triangleBitmasks);
+
+            std::vector<LightBVHSamplerCPU> samplers;
+            samplers.emplace_back(options, triangles, nodes, triangleIndices, triangleBitmasks);
+            for (uint32_t branchingFactor : { 4u, 8u })
+            {
+                std::vector<PackedWideNode> wideNodes;
+                std::vector<uint64_t> wideTriangleBitmasks;
+                LightBVHBuilder::collapse(branchingFactor, nodes, triangleIndices, (uint32_t)triangles.size(), wideNodes, wideTriangleBitmasks);
+                samplers.emplace_back(options, branchingFactor, triangles, std::move(wideNodes), triangleIndices, std::move(wideTriangleBitmasks));
+            }
+            return samplers;
+        }
+
+        /** Evaluates the selection PDFs of all triangles and checks that they match the PDFs returned by sampling.
+            \return Sum of the selection PDFs.
+        */
+        double validatePdfs(CPUUnitTestContext& ctx, const LightBVHSamplerCPU& sampler, const ShadingPoint& p, size_t triangleCount, std::vector<float>& pdfs)
+        {
+            pdfs.resize(triangleCount);
+            double pdfSum = 0.0;
+            for (uint32_t i = 0; i < triangleCount; i++)
+            {
+                pdfs[i] = sampler.evalTriangleSelectionPdf(p.posW, p.normalW, true, i);
+                EXPECT_GE(pdfs[i], 0.f);
+                pdfSum += pdfs[i];
+            }
+
+            const uint32_t sampleCount = 256;
+            for (uint32_t i = 0; i < sampleCount; i++)
+            {
+                float pdf;
+                uint32_t triangleIndex;
+                if (!sampler.sampleTriangle(p.posW, p.normalW, true, (i + 0.5f) / sampleCount, pdf, triangleIndex)) continue;
+
+                EXPECT_LT(triangleIndex, triangleCount);
+                if (triangleIndex >= triangleCount) continue;
+                EXPECT_GT(pdf, 0.f);
+                EXPECT_LE(std::abs(pdf - pdfs[triangleIndex]), 1e-5f * pdf) << "branchingFactor = " << sampler.getBranchingFactor() << ", triangleIndex = " << triangleIndex;
+            }
+            return pdfSum;
+        }
+    }
+
+    CPU_TEST(LightBVHSamplerCPU_Pdf)
+    {
+        const auto triangles = createLightTriangles(2000, 1, 100, 0.5f);
+        const auto points = createShadingPoints(16, 2);
+        std::vector<float> pdfs, binaryPdfs;
+
+        // Without lighting cones and with uniform triangle sampling, all nodes with flux have non-zero importance.
+        // The PDFs of all trees sum to one and the wide trees reach exactly the triangles of the binary tree.
+        {
+            LightBVHSampler::Options options;
+            options.useBoundingCone = false;
+            options.useLightingCone = false;
+            options.useUniformTriangleSampling = true;
+            const auto samplers = createSamplers(options, triangles);
+
+            for (const auto& p : points)
+            {
+                validatePdfs(ctx, samplers[0], p, triangles.size(), binaryPdfs);
+                for (const auto& sampler : samplers)
+                {
+                    double pdfSum = validatePdfs(ctx, sampler, p, triangles.size(), pdfs);
+                    EXPECT_LE(std::abs(pdfSum - 1.0), 1e-3) << "branchingFactor = " << sampler.getBranchingFactor();
+                    for (size_t i = 0; i < triangles.size(); i++)
+                    {
+                        EXPECT_EQ(pdfs[i] > 0.f, binaryPdfs[i] > 0.f) << "branchingFactor = " << sampler.getBranchingFactor() << ", i = " << i;
+                    }
+                }
+            }
+        }
+
+        // With the default options and with box bounds and importance sampled triangles, subtrees and triangles may be culled,
+        // in which case sampling fails with the culled probability mass.
+        {
+            LightBVHSampler::Options defaultOptions;
+            LightBVHSampler::Options boxOptions;
+            boxOptions.solidAngleBoundMethod = SolidAngleBoundMethod::BoxToAverage;
+            boxOptions.useUniformTriangleSampling = false;
+
+            for (const auto& options : { defaultOptions, boxOptions })
+            {
+                const auto samplers = createSamplers(options, triangles);
+                for (const auto& p : points)
+                {
+                    for (const auto& sampler : samplers)
+                    {
+                        double pdfSum = validatePdfs(ctx, sampler, p, triangles.size(), pdfs);
+                        EXPECT_LE(pdfSum, 1.0 + 1e-3) << "branchingFactor = " << sampler.getBranchingFactor();
+                    }
+                }
+            }
+        }
+    }
+
+    CPU_TEST(LightBVHSamplerCPU_Histogram)
+    {
+        const auto triangles = createLightTriangles(2000, 3, 100, 0.5f);
+        const ShadingPoint p = { float3(50.f, -10.f, 50.f), float3(0.f, 1.f, 0.f) };
+
+        LightBVHSampler::Options options;
+        options.useUniformTriangleSampling = false;
+        const auto samplers = createSamplers(options, triangles);
+
+        // Compare the histogram of sampled triangles against the evaluated PDFs.
+        const uint32_t sampleCount = 200000;
+        for (const auto& sampler : samplers)
+        {
+            std::mt19937 rng(4);
+            std::uniform_real_distribution<float> u(0.f, 1.f);
+
+            std::vector<uint32_t> histogram(triangles.size(), 0);
+            for (uint32_t i = 0; i < sampleCount; i++)
+            {
+                float pdf;
+                uint32_t triangleIndex;
+                if (sampler.sampleTriangle(p.posW, p.normalW, true, u(rng), pdf, triangleIndex)) histogram[triangleIndex]++;
+            }
+
+            for (uint32_t i = 0; i < triangles.size(); i++)
+            {
+                const float expected = sampler.evalTriangleSelectionPdf(p.posW, p.normalW, true, i) * sampleCount;
+                if (expected == 0.f) EXPECT_EQ(histogram[i], 0u) << "branchingFactor = " << sampler.getBranchingFactor() << ", i = " << i;
+                else EXPECT_LE(std::abs(histogram[i] - expected), 5.f * std::sqrt(expected) + 1.f) << "branchingFactor = " << sampler.getBranchingFactor() << ", i = " << i;
+            }
+        }
+    }
+}
@@ -0,0 +1,66 @@
+/***************************************************************************
+ # Copyright (c) 2015-21, NVIDIA CORPORATION. All rights reserved.
+ #
+ # Redistribution and use in source and binary forms, with or without
+ # modification, are permitted provided that the following conditions
+ # are met:
+ #  * Redistributions of source code must retain the above copyright
+ #    notice, this list of conditions and the following disclaimer.
+ #  * Redistributions in binary form must reproduce the above copyright
+ #    notice, this list of conditions and the following disclaimer in the
+ #    documentation and/or other materials provided with the distribution.
+ #  * Neither the name of NVIDIA CORPORATION nor the names of its
+ #    contributors may be used to endorse or promote products derived
+ #    from this software without specific prior written permission.
+ #
+ # THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS "AS IS" AND ANY
+ # EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ # IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ # PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+ # CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ # EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ # PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ # PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+ # OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ # (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ # OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ **************************************************************************/
+#pragma once
+#include "Scene/Lights/LightCollection.h"
+#include <random>
+
+namespace Falcor
+{
+    /** Creates emissive triangles scattered in clusters, with normals biased towards +y.
+        About 5% of the triangles have zero flux.
+        \param[in] triangleCount Number of triangles.
+        \param[in] seed Seed of the random number generator.
+        \param[in] trianglesPerCluster Number of triangles per cluster. The clusters are placed in a box of size 100.
+        \param[in] triangleSize Size of the box the vertices of a triangle are placed in.
+        \return The triangles.
+    */
+    inline std::vector<LightCollection::MeshLightTriangle> createLightTriangles(uint32_t triangleCount, uint32_t seed, uint32_t trianglesPerCluster = 1000, float triangleSize = 0.1f)
+    {
+        std::mt19937 rng(seed);
+        std::uniform_real_distribution<float> u(0.f, 1.f);
+
+        const uint32_t clusterCount = std::max(1u, triangleCount / trianglesPerCluster);
+        std::vector<float3> clusters(clusterCount);
+        for (auto& c : clusters) c = float3(u(rng), u(rng), u(rng)) * 100.f;
+
+        std::vector<LightCollection::MeshLightTriangle> triangles(triangleCount);
+        for (uint32_t i = 0; i < triangleCount; i++)
+        {
+            auto& tri = triangles[i];
+            const float3 center = clusters[i % clusterCount] + float3(u(rng), u(rng), u(rng)) * 5.f;
+            for (uint32_t j = 0; j < 3; j++) tri.vtx[j].pos = center + (float3(u(rng), u(rng), u(rng)) - 0.5f) * triangleSize;
+
+            const float3 n = glm::cross(tri.vtx[1].pos - tri.vtx[0].pos, tri.vtx[2].pos - tri.vtx[0].pos);
+            tri.area = 0.5f * glm::length(n);
+            tri.normal = tri.area > 0.f ? glm::normalize(n) : float3(0.f, 1.f, 0.f);
+            if (tri.normal.y < 0.f && u(rng) < 0.8f) tri.normal = -tri.normal;
+            tri.flux = u(rng) < 0.05f ? 0.f : tri.area * u(rng);
+        }
+        return triangles;
+    }
+}
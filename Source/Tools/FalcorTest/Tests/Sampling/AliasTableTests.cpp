@@ -34,7 +34,67 @@ namespace Falcor
 {
     namespace
     {
-        void testAliasTable(GPUUnitTestContext& ctx, uint32_t N, std::vector<float> specificWeights = {})
+        void testSampling(GPUUnitTestContext& ctx, const AliasTable::SharedPtr& aliasTable, const std::vector<float>& weights, uint32_t samplesPerWeight, std::mt19937& rng)
+        {
+            std::uniform_real_distribution<float> uniform;
+
+            const uint32_t N = (uint32_t)weights.size();
+            double weightSum = 0.0;
+            for (const auto& weight : weights) weightSum += weight;
+
+            // Two-level tables need three random numbers per sample.
+            const bool twoLevel = aliasTable->getBlockCount() > 0;
+            const uint32_t randomPerSample = twoLevel ? 3 : 2;
+
+            uint32_t resultCount = N * samplesPerWeight;
+            uint32_t randomCount = resultCount * randomPerSample;
+
+            // Create uniform random numbers as input.
+            std::vector<float> random(randomCount);
+            std::generate(random.begin(), random.end(), [&uniform, &rng]() { return uniform(rng); });
+
+            // Setup and run GPU test.
+            ctx.createProgram("Tests/Sampling/AliasTableTests.cs.slang", twoLevel ? "testAliasTableSample3" : "testAliasTableSample");
+            ctx.allocateStructuredBuffer("sampleResult", resultCount);
+            ctx.allocateStructuredBuffer("random", randomCount, random.data());
+            aliasTable->setShaderData(ctx["CB"]["aliasTable"]);
+            ctx["CB"]["resultCount"] = resultCount;
+            ctx.runProgram(resultCount);
+
+            // Build histogram.
+            std::vector<uint32_t> histogram(N, 0);
+            const uint32_t* result = ctx.mapBuffer<const uint32_t>("sampleResult");
+            for (uint32_t i = 0; i < resultCount; ++i)
+            {
+                uint32_t item = result[i];
+                EXPECT(item >= 0u && item < N);
+                if (item < N) histogram[item]++;
+            }
+            ctx.unmapBuffer("sampleResult");
+
+            // Verify histogram using a chi-square test.
+            std::vector<double> expFrequencies(N);
+            std::vector<double> obsFrequencies(N);
+            for (uint32_t i = 0; i < N; ++i)
+            {
+                expFrequencies[i] = (weights[i] / weightSum) * N * samplesPerWeight;
+                obsFrequencies[i] = (double)histogram[i];
+            }
+
+            // Special case for N == 1
+            if (N == 1)
+            {
+                EXPECT(histogram[0] == samplesPerWeight);
+            }
+            else
+            {
+                const auto& [success, report] = hypothesis::chi2_test(N, obsFrequencies.data(), expFrequencies.data(), N * samplesPerWeight, 5, 0.1);
+                if (!success) std::cout << report << std::endl;
+                EXPECT(success);
+            }
+        }
+
+        void testAliasTable(GPUUnitTestContext& ctx, uint32_t N, std::vector<float> specificWeights = {}, AliasTable::Options options = {}, uint32_t samplesPerWeight = 10000)
         {
             std::mt19937 rng;
             std::uniform_real_distribution<float> uniform;
@@ -50,7 +110,7 @@ namespace Falcor
             }
 
             // Create alias table.
-            auto aliasTable = AliasTable::create(weights, rng);
+            auto aliasTable = AliasTable::create(weights, rng, options);
             EXPECT(aliasTable != nullptr);
 
             // Compute weight sum.
@@ -58,59 +118,20 @@ namespace Falcor
             for (const auto& weight : weights) weightSum += weight;
 
             EXPECT_EQ(aliasTable->getCount(), weights.size());
-            EXPECT_EQ(aliasTable->getWeightSum(), weightSum);
 
-            // Test sampling the alias table.
+            // Large and two-level tables sum the weights in a different order.
+            if (N < (1u << 16) && options.blockSize == 0)
             {
-                const uint32_t samplesPerWeight = 10000;
-                uint32_t resultCount = N * samplesPerWeight;
-                uint32_t randomCount = resultCount * 2;
-
-                // Create uniform random numbers as input.
-                std::vector<float> random(randomCount);
-                std::generate(random.begin(), random.end(), [&uniform, &rng]() { return uniform(rng); });
-
-                // Setup and run GPU test.
-                ctx.createProgram("Tests/Sampling/AliasTableTests.cs.slang", "testAliasTableSample");
-                ctx.allocateStructuredBuffer("sampleResult", resultCount);
-                ctx.allocateStructuredBuffer("random", randomCount, random.data());
-                aliasTable->setShaderData(ctx["CB"]["aliasTable"]);
-                ctx["CB"]["resultCount"] = resultCount;
-                ctx.runProgram(resultCount);
-
-                // Build histogram.
-                std::vector<uint32_t> histogram(N, 0);
-                const uint32_t* result = ctx.mapBuffer<const uint32_t>("sampleResult");
-                for (uint32_t i = 0; i < resultCount; ++i)
-                {
-                    uint32_t item = result[i];
-                    EXPECT(item >= 0u && item < N);
-                    histogram[item]++;
-                }
-                ctx.unmapBuffer("sampleResult");
-
-                // Verify histogram using a chi-square test.
-                std::vector<double> expFrequencies(N);
-                std::vector<double> obsFrequencies(N);
-                for (uint32_t i = 0; i < N; ++i)
-                {
-                    expFrequencies[i] = (weights[i] / weightSum) * N * samplesPerWeight;
-                    obsFrequencies[i] = (double)histogram[i];
-                }
-
-                // Special case for N == 1
-                if (N == 1)
-                {
-                    EXPECT(histogram[0] == samplesPerWeight);
-                }
-                else
-                {
-                    const auto& [success, report] = hypothesis::chi2_test(N, obsFrequencies.data(), expFrequencies.data(), N * samplesPerWeight, 5, 0.1);
-                    if (!success) std::cout << report << std::endl;
-                    EXPECT(success);
-                }
+                EXPECT_EQ(aliasTable->getWeightSum(), weightSum);
+            }
+            else
+            {
+                EXPECT(std::abs(aliasTable->getWeightSum() - weightSum) <= 1e-9 * weightSum);
             }
 
+            // Test sampling the alias table.
+            testSampling(ctx, aliasTable, weights, samplesPerWeight, rng);
+
             // Test getting weights.
             {
                 uint32_t resultCount = N;
@@ -139,5 +160,69 @@ namespace Falcor
         testAliasTable(ctx, 2, { 1.f, 2.f });
         testAliasTable(ctx, 100);
         testAliasTable(ctx, 1000);
+
+        // Large enough to use the parallel build.
+        testAliasTable(ctx, 100000, {}, {}, 100);
+    }
+
+    GPU_TEST(AliasTableTwoLevel)
+    {
+        AliasTable::Options options;
+        options.blockSize = 64;
+        testAliasTable(ctx, 100, {}, options);
+        testAliasTable(ctx, 1000, {}, options);
+        testAliasTable(ctx, 1000, std::vector<float>(1000, 1.f), options);
+
+        options.blockSize = 1000;
+        testAliasTable(ctx, 100000, {}, options, 100);
+    }
+
+    GPU_TEST(AliasTableUpdateWeights)
+    {
+        const uint32_t N = 10000;
+
+        std::mt19937 rng;
+        std::uniform_real_distribution<float> uniform;
+
+        std::vector<float> weights(N);
+        for (auto& weight : weights) weight = uniform(rng);
+
+        AliasTable::Options options;
+        options.blockSize = 256;
+        auto aliasTable = AliasTable::create(weights, rng, options);
+
+        // Update a few weights, including zeroing out a full block.
+        std::vector<uint32_t> indices;
+        std::vector<float> newWeights;
+        for (uint32_t i = 0; i < 100; ++i)
+        {
+            indices.push_back(std::min(N - 1, (uint32_t)(uniform(rng) * N)));
+            newWeights.push_back(4.f * uniform(rng));
+        }
+        for (uint32_t i = 512; i < 768; ++i)
+        {
+            indices.push_back(i);
+            newWeights.push_back(0.f);
+        }
+        for (size_t i = 0; i < indices.size(); ++i) weights[indices[i]] = newWeights[i];
+        aliasTable->updateWeights(indices, newWeights);
+
+        // The updated table should match a table built from scratch.
+        auto refTable = AliasTable::create(weights, rng, options);
+        EXPECT_EQ(aliasTable->getWeightSum(), refTable->getWeightSum());
+        const uint32_t gridSize = 32;
+        for (uint32_t z = 0; z < gridSize; ++z)
+        {
+            for (uint32_t y = 0; y < gridSize; ++y)
+            {
+                for (uint32_t x = 0; x < gridSize; ++x)
+                {
+                    float3 rnd = (float3(x, y, z) + 0.5f) / float(gridSize);
+                    EXPECT_EQ(aliasTable->sample(rnd), refTable->sample(rnd));
+                }
+            }
+        }
+
+        testSampling(ctx, aliasTable, weights, 1000, rng);
     }
 }
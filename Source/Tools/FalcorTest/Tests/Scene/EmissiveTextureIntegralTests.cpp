@@ -0,0 +1,152 @@
+/***************************************************************************
+ # Copyright (c) 2015-21, NVIDIA CORPORATION. All rights reserved.
+ #
+ # Redistribution and use in source and binary forms, with or without
+ # modification, are permitted provided that the following conditions
+ # are met:
+ #  * Redistributions of source code must retain the above copyright
+ #    notice, this list of conditions and the following disclaimer.
+ #  * Redistributions in binary form must reproduce the above copyright
+ #    notice, this list of conditions and the following disclaimer in the
+ #    documentation and/or other materials provided with the distribution.
+ #  * Neither the name of NVIDIA CORPORATION nor the names of its
+ #    contributors may be used to endorse or promote products derived
+ #    from this software without specific prior written permission.
+ #
+ # THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS "AS IS" AND ANY
+ # EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ # IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ # PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+ # CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ # EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ # PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ # PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+ # OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ # (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ # OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ **************************************************************************/
+#include "Testing/UnitTest.h"
+#include "Scene/Lights/EmissiveTextureIntegral.h"
+#include "Utils/Image/Bitmap.h"
+
+namespace Falcor
+{
+    namespace
+    {
+        const std::filesystem::path kTestDirectory = std::filesystem::temp_directory_path() / "EmissiveTextureIntegralTests";
+
+        // 8x8 texture with the left half lit and a bright texel in the top-left corner.
+        EmissiveTextureIntegral::SharedConstPtr createHalfLitTexture()
+        {
+            const uint32_t n = 8;
+            std::vector<float3> texels(n * n, float3(0.f));
+            for (uint32_t y = 0; y < n; y++)
+            {
+                for (uint32_t x = 0; x < n / 2; x++) texels[y * n + x] = float3(1.f);
+            }
+            texels[0] = float3(5.f, 3.f, 1.f);
+            return EmissiveTextureIntegral::create(n, n, texels);
+        }
+
+        float3 integrate(const EmissiveTextureIntegral& integral, float2 a, float2 b, float2 c, Sampler::AddressMode mode = Sampler::AddressMode::Wrap)
+        {
+            const float2 uv[3] = { a, b, c };
+            return integral.integrateTriangle(uv, mode, mode);
+        }
+    }
+
+    CPU_TEST(EmissiveTextureIntegral_Pyramid)
+    {
+        auto pIntegral = createHalfLitTexture();
+        EXPECT_EQ(pIntegral->getWidth(), 8u);
+        EXPECT_EQ(pIntegral->getHeight(), 8u);
+        EXPECT_EQ(pIntegral->getLevelCount(), 4u);
+        EXPECT(pIntegral->getAverage() == float3(36.f, 34.f, 32.f) / 64.f);
+
+        // Large textures are box filtered to the max base resolution.
+        std::vector<float3> texels(3000 * 3, float3(2.f));
+        pIntegral = EmissiveTextureIntegral::create(3000, 3, texels);
+        EXPECT_EQ(pIntegral->getWidth(), 750u);
+        EXPECT_EQ(pIntegral->getHeight(), 1u);
+        EXPECT(pIntegral->getAverage() == float3(2.f));
+    }
+
+    CPU_TEST(EmissiveTextureIntegral_Triangle)
+    {
+        auto pIntegral = createHalfLitTexture();
+
+        // Triangles inside the lit and unlit halves, excluding the bright texel.
+        EXPECT(integrate(*pIntegral, float2(0.2f, 0.2f), float2(0.45f, 0.2f), float2(0.2f, 0.95f)) == float3(1.f));
+        EXPECT(integrate(*pIntegral, float2(0.55f, 0.05f), float2(0.95f, 0.05f), float2(0.55f, 0.95f)) == float3(0.f));
+
+        // The result does not depend on the winding.
+        EXPECT(integrate(*pIntegral, float2(0.2f, 0.2f), float2(0.2f, 0.95f), float2(0.45f, 0.2f)) == float3(1.f));
+
+        // Texture coordinates wrap or clamp according to the address mode.
+        EXPECT(integrate(*pIntegral, float2(3.2f, -1.8f), float2(3.45f, -1.8f), float2(3.2f, -1.05f)) == float3(1.f));
+        EXPECT(integrate(*pIntegral, float2(1.2f, 0.2f), float2(1.45f, 0.2f), float2(1.2f, 0.95f), Sampler::AddressMode::Clamp) == float3(0.f));
+        EXPECT(integrate(*pIntegral, float2(-0.8f, 0.2f), float2(-0.55f, 0.2f), float2(-0.8f, 0.95f), Sampler::AddressMode::Border) == float3(0.f));
+
+        // A triangle that does not cover any texel center takes the texels at its vertices.
+        EXPECT(integrate(*pIntegral, float2(0.01f, 0.01f), float2(0.02f, 0.01f), float2(0.01f, 0.02f)) == float3(5.f, 3.f, 1.f));
+        EXPECT(integrate(*pIntegral, float2(0.1f, 0.1f), float2(0.1f, 0.1f), float2(0.1f, 0.1f)) == float3(5.f, 3.f, 1.f));
+
+        // Triangles covering many repetitions of the texture get the texture average.
+        EXPECT(integrate(*pIntegral, float2(0.f, 0.f), float2(1000.f, 0.f), float2(0.f, 1000.f)) == pIntegral->getAverage());
+    }
+
+    CPU_TEST(EmissiveTextureIntegral_Cache)
+    {
+        auto pIntegral = createHalfLitTexture();
+        const float2 uv[3] = { float2(0.1f, 0.1f), float2(0.9f, 0.2f), float2(0.3f, 0.8f) };
+
+        std::filesystem::create_directories(kTestDirectory);
+        auto cachePath = kTestDirectory / "integral.cache";
+        EXPECT(pIntegral->writeCache(cachePath));
+
+        auto pCached = EmissiveTextureIntegral::readCache(cachePath);
+        EXPECT(pCached != nullptr);
+        if (!pCached) return;
+        EXPECT_EQ(pCached->getWidth(), 8u);
+        EXPECT_EQ(pCached->getHeight(), 8u);
+        EXPECT_EQ(pCached->getLevelCount(), 4u);
+        EXPECT(pCached->getAverage() == pIntegral->getAverage());
+        EXPECT(pCached->integrateTriangle(uv) == pIntegral->integrateTriangle(uv));
+
+        std::filesystem::remove(cachePath);
+        EXPECT(EmissiveTextureIntegral::readCache(cachePath) == nullptr);
+
+        // Texture files with the same content share a cache entry, the sRGB flag is part of the key.
+        std::vector<uint8_t> texels(4 * 4 * 4);
+        for (size_t i = 0; i < texels.size(); i++) texels[i] = i % 4 == 3 ? 255 : (uint8_t)(i * 13);
+        const std::string pathA = (kTestDirectory / "a.png").string();
+        const std::string pathB = (kTestDirectory / "b.png").string();
+        Bitmap::saveImage(pathA, 4, 4, Bitmap::FileFormat::PngFile, Bitmap::ExportFlags::ExportAlpha, ResourceFormat::RGBA8Unorm, true, texels.data());
+        Bitmap::saveImage(pathB, 4, 4, Bitmap::FileFormat::PngFile, Bitmap::ExportFlags::ExportAlpha, ResourceFormat::RGBA8Unorm, true, texels.data());
+
+        SHA1::MD keyA, keyB, keySrgb;
+        EXPECT(EmissiveTextureIntegral::computeCacheKey(pathA, false, keyA));
+        EXPECT(EmissiveTextureIntegral::computeCacheKey(pathB, false, keyB));
+        EXPECT(EmissiveTextureIntegral::computeCacheKey(pathA, true, keySrgb));
+        EXPECT(keyA == keyB);
+        EXPECT(keyA != keySrgb);
+
+        // Loading a file writes the cache, which is then used for the other file.
+        std::filesystem::remove(EmissiveTextureIntegral::getCachePath(keyA));
+        float3 average = float3(0.f);
+        {
+            auto pFromFile = EmissiveTextureIntegral::createFromFile(pathA, false);
+            EXPECT(pFromFile != nullptr);
+            if (!pFromFile) return;
+            average = pFromFile->getAverage();
+        }
+        EXPECT(std::filesystem::exists(EmissiveTextureIntegral::getCachePath(keyA)));
+
+        auto pFromCache = EmissiveTextureIntegral::createFromFile(pathB, false);
+        EXPECT(pFromCache != nullptr);
+        if (pFromCache) EXPECT(pFromCache->getAverage() == average);
+
+        std::filesystem::remove(EmissiveTextureIntegral::getCachePath(keyA));
+        std::filesystem::remove_all(kTestDirectory);
+    }
+}
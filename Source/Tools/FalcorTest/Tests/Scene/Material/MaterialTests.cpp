@@ -0,0 +1,65 @@
+/***************************************************************************
+ # Copyright (c) 2015-21, NVIDIA CORPORATION. All rights reserved.
+ #
+ # Redistribution and use in source and binary forms, with or without
+ # modification, are permitted provided that the following conditions
+ # are met:
+ #  * Redistributions of source code must retain the above copyright
+ #    notice, this list of conditions and the following disclaimer.
+ #  * Redistributions in binary form must reproduce the above copyright
+ #    notice, this list of conditions and the following disclaimer in the
+ #    documentation and/or other materials provided with the distribution.
+ #  * Neither the name of NVIDIA CORPORATION nor the names of its
+ #    contributors may be used to endorse or promote products derived
+ #    from this software without specific prior written permission.
+ #
+ # THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS "AS IS" AND ANY
+ # EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ # IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ # PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+ # CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ # EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ # PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ # PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+ # OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ # (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ # OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ **************************************************************************/
+#include "Testing/UnitTest.h"
+
+namespace Falcor
+{
+    GPU_TEST(Material_Hash)
+    {
+        auto pA = StandardMaterial::create("A");
+        auto pB = StandardMaterial::create("B");
+
+        // Identical materials with different names are equal and have the same hash.
+        EXPECT(pA->isEqual(pB));
+        EXPECT_EQ(pA->computeHash(), pB->computeHash());
+
+        pA->setBaseColor(float4(0.5f, 0.25f, 0.f, 1.f));
+        pB->setBaseColor(float4(0.5f, 0.25f, -0.f, 1.f));
+        EXPECT(pA->isEqual(pB));
+        EXPECT_EQ(pA->computeHash(), pB->computeHash());
+
+        // Changing any parameter makes the materials different.
+        pB->setRoughness(0.75f);
+        EXPECT(!pA->isEqual(pB));
+        EXPECT_NE(pA->computeHash(), pB->computeHash());
+
+        pA->setRoughness(0.75f);
+        EXPECT(pA->isEqual(pB));
+        EXPECT_EQ(pA->computeHash(), pB->computeHash());
+
+        pA->setDoubleSided(true);
+        EXPECT(!pA->isEqual(pB));
+        EXPECT_NE(pA->computeHash(), pB->computeHash());
+
+        // Materials of different types are different.
+        auto pHair = HairMaterial::create("A");
+        auto pCloth = ClothMaterial::create("A");
+        EXPECT(!pHair->isEqual(pCloth));
+        EXPECT_NE(pHair->computeHash(), pCloth->computeHash());
+    }
+}
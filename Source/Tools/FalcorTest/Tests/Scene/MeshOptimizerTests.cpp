@@ -0,0 +1,138 @@
+/***************************************************************************
+ # Copyright (c) 2015-21, NVIDIA CORPORATION. All rights reserved.
+ #
+ # Redistribution and use in source and binary forms, with or without
+ # modification, are permitted provided that the following conditions
+ # are met:
+ #  * Redistributions of source code must retain the above copyright
+ #    notice, this list of conditions and the following disclaimer.
+ #  * Redistributions in binary form must reproduce the above copyright
+ #    notice, this list of conditions and the following disclaimer in the
+ #    documentation and/or other materials provided with the distribution.
+ #  * Neither the name of NVIDIA CORPORATION nor the names of its
+ #    contributors may be used to endorse or promote products derived
+ #    from this software without specific prior written permission.
+ #
+ # THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS "AS IS" AND ANY
+ # EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ # IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ # PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+ # CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ # EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ # PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ # PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+ # OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ # (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ # OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ **************************************************************************/
+#include "Testing/UnitTest.h"
+#include "Scene/MeshOptimizer.h"
+#include <random>
+
+namespace Falcor
+{
+    namespace
+    {
+        void createGrid(uint32_t n, std::vector<float3>& positions, std::vector<uint32_t>& indices)
+        {
+            positions.clear();
+            indices.clear();
+            for (uint32_t y = 0; y <= n; y++)
+            {
+                for (uint32_t x = 0; x <= n; x++) positions.push_back(float3(x, y, 0.f));
+            }
+            for (uint32_t y = 0; y < n; y++)
+            {
+                for (uint32_t x = 0; x < n; x++)
+                {
+                    uint32_t i = y * (n + 1) + x;
+                    indices.insert(indices.end(), { i, i + 1, i + n + 2, i, i + n + 2, i + n + 1 });
+                }
+            }
+        }
+
+        void shuffleTriangles(std::vector<uint32_t>& indices, uint32_t seed)
+        {
+            std::vector<std::array<uint32_t, 3>> triangles(indices.size() / 3);
+            std::memcpy(triangles.data(), indices.data(), indices.size() * sizeof(uint32_t));
+            std::shuffle(triangles.begin(), triangles.end(), std::mt19937(seed));
+            std::memcpy(indices.data(), triangles.data(), indices.size() * sizeof(uint32_t));
+        }
+
+        std::vector<std::array<uint32_t, 3>> getSortedTriangles(const std::vector<uint32_t>& indices)
+        {
+            std::vector<std::array<uint32_t, 3>> triangles(indices.size() / 3);
+            std::memcpy(triangles.data(), indices.data(), indices.size() * sizeof(uint32_t));
+            std::sort(triangles.begin(), triangles.end());
+            return triangles;
+        }
+    }
+
+    CPU_TEST(MeshOptimizer_ComputeACMR)
+    {
+        // A single triangle always misses three times.
+        EXPECT_EQ(MeshOptimizer::computeACMR({ 0, 1, 2 }, 3), 3.f);
+        // A quad shares two vertices between its triangles.
+        EXPECT_EQ(MeshOptimizer::computeACMR({ 0, 1, 2, 0, 2, 3 }, 4), 2.f);
+        // The same triangle repeated only misses once.
+        EXPECT_EQ(MeshOptimizer::computeACMR({ 0, 1, 2, 0, 1, 2 }, 3), 1.5f);
+        // Vertices are evicted in FIFO order.
+        EXPECT_EQ(MeshOptimizer::computeACMR({ 0, 1, 2, 3, 4, 5, 0, 1, 2 }, 6, 3), 3.f);
+        EXPECT_EQ(MeshOptimizer::computeACMR({}, 0), 0.f);
+    }
+
+    CPU_TEST(MeshOptimizer_OptimizeVertexCache)
+    {
+        std::vector<float3> positions;
+        std::vector<uint32_t> indices;
+        createGrid(100, positions, indices);
+        shuffleTriangles(indices, 0);
+        const uint32_t vertexCount = (uint32_t)positions.size();
+
+        float acmrBefore = MeshOptimizer::computeACMR(indices, vertexCount);
+        EXPECT_GT(acmrBefore, 2.f);
+
+        auto optimized = indices;
+        MeshOptimizer::optimizeVertexCache(optimized, vertexCount);
+        EXPECT(getSortedTriangles(optimized) == getSortedTriangles(indices));
+        EXPECT_LT(MeshOptimizer::computeACMR(optimized, vertexCount), 0.75f);
+
+        // Spatial ordering improves locality on its own and is a good starting point for the vertex cache optimization.
+        auto sorted = indices;
+        MeshOptimizer::sortTrianglesSpatially(sorted, positions);
+        EXPECT(getSortedTriangles(sorted) == getSortedTriangles(indices));
+        EXPECT_LT(MeshOptimizer::computeACMR(sorted, vertexCount), 1.f);
+
+        MeshOptimizer::optimizeVertexCache(sorted, vertexCount);
+        EXPECT(getSortedTriangles(sorted) == getSortedTriangles(indices));
+        EXPECT_LT(MeshOptimizer::computeACMR(sorted, vertexCount), 0.75f);
+    }
+
+    CPU_TEST(MeshOptimizer_OptimizeVertexFetch)
+    {
+        std::vector<float3> positions;
+        std::vector<uint32_t> indices;
+        createGrid(50, positions, indices);
+        shuffleTriangles(indices, 1);
+
+        // Add an unreferenced vertex.
+        const uint32_t vertexCount = (uint32_t)positions.size() + 1;
+
+        auto remapped = indices;
+        auto vertexOrder = MeshOptimizer::optimizeVertexFetch(remapped, vertexCount);
+        EXPECT_EQ(vertexOrder.size(), vertexCount);
+        EXPECT_EQ(vertexOrder.back(), vertexCount - 1);
+
+        // Remapped indices reference the same vertices.
+        for (size_t i = 0; i < indices.size(); i++) EXPECT_EQ(vertexOrder[remapped[i]], indices[i]);
+
+        // Vertices are numbered in the order of first use.
+        uint32_t nextVertex = 0;
+        for (uint32_t index : remapped)
+        {
+            EXPECT_LE(index, nextVertex);
+            if (index == nextVertex) nextVertex++;
+        }
+        EXPECT_EQ(nextVertex, vertexCount - 1);
+    }
+}
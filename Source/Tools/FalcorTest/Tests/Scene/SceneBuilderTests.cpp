@@ -0,0 +1,486 @@
+/***************************************************************************
+ # Copyright (c) 2015-21, NVIDIA CORPORATION. All rights reserved.
+ #
+ # Redistribution and use in source and binary forms, with or without
+ # modification, are permitted provided that the following conditions
+ # are met:
+ #  * Redistributions of source code must retain the above copyright
+ #    notice, this list of conditions and the following disclaimer.
+ #  * Redistributions in binary form must reproduce the above copyright
+ #    notice, this list of conditions and the following disclaimer in the
+ #    documentation and/or other materials provided with the distribution.
+ #  * Neither the name of NVIDIA CORPORATION nor the names of its
+ #    contributors may be used to endorse or promote products derived
+ #    from this software without specific prior written permission.
+ #
+ # THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS "AS IS" AND ANY
+ # EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ # IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ # PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+ # CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ # EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ # PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ # PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+ # OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ # (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ # OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ **************************************************************************/
+#include "Testing/UnitTest.h"
+#include "Scene/SceneBuilder.h"
+#include <array>
+#include <iomanip>
+#include <numeric>
+#include <random>
+
+namespace Falcor
+{
+    /** Gives the tests access to the geometry optimization helpers of SceneBuilder.
+    */
+    struct SceneBuilderTestAccess
+    {
+        using Triangle = std::array<float, 9>;
+
+        static void calculateMeshBoundingBoxes(SceneBuilder& builder) { builder.calculateMeshBoundingBoxes(); }
+        static std::pair<std::optional<uint32_t>, std::optional<uint32_t>> splitMesh(SceneBuilder& builder, uint32_t meshID, int axis, float pos) { return builder.splitMesh(meshID, axis, pos); }
+        static const auto& getMesh(const SceneBuilder& builder, uint32_t meshID) { return builder.mMeshes.at(meshID); }
+        static void setMaxTrianglesPerBLAS(SceneBuilder& builder, size_t maxTriangles) { builder.mMaxTrianglesPerBLAS = maxTriangles; }
+
+        /** Partition a mesh group with the SAH splitter.
+            \return List of the mesh IDs of each resulting group.
+        */
+        static std::vector<std::vector<uint32_t>> splitMeshGroupSAH(const SceneBuilder& builder, const std::vector<uint32_t>& meshList)
+        {
+            SceneBuilder::MeshGroup meshGroup{ meshList, true };
+            std::vector<std::vector<uint32_t>> groups;
+            for (auto& group : builder.splitMeshGroupSAH(meshGroup)) groups.push_back(std::move(group.meshList));
+            return groups;
+        }
+
+        /** Returns the sorted list of triangle positions of a mesh.
+        */
+        static std::vector<Triangle> getTriangles(const SceneBuilder& builder, uint32_t meshID)
+        {
+            const auto& mesh = builder.mMeshes.at(meshID);
+            std::vector<Triangle> triangles(mesh.getTriangleCount());
+            for (size_t t = 0; t < triangles.size(); t++)
+            {
+                for (size_t k = 0; k < 3; k++)
+                {
+                    uint32_t index = mesh.indexCount > 0 ? mesh.getIndex(3 * t + k) : (uint32_t)(3 * t + k);
+                    const float3& p = mesh.staticData[index].position;
+                    for (size_t c = 0; c < 3; c++) triangles[t][3 * k + c] = p[c];
+                }
+            }
+            std::sort(triangles.begin(), triangles.end());
+            return triangles;
+        }
+    };
+
+    namespace
+    {
+        /** Synthetic mesh data for testing SceneBuilder::processMesh().
+        */
+        struct TestMesh
+        {
+            std::vector<uint32_t> indices;
+            std::vector<float3> positions;
+            std::vector<float3> normals;
+            std::vector<float2> texCrds;
+            float4 tangent = float4(1.f, 0.f, 0.f, 1.f);
+
+            SceneBuilder::Mesh getMesh(const Material::SharedPtr& pMaterial, SceneBuilder::Mesh::AttributeFrequency positionFrequency, SceneBuilder::Mesh::AttributeFrequency normalFrequency) const
+            {
+                SceneBuilder::Mesh mesh;
+                mesh.name = "TestMesh";
+                mesh.faceCount = (uint32_t)indices.size() / 3;
+                mesh.vertexCount = positionFrequency == SceneBuilder::Mesh::AttributeFrequency::FaceVarying ? (uint32_t)indices.size() : (uint32_t)positions.size();
+                mesh.indexCount = (uint32_t)indices.size();
+                mesh.pIndices = indices.data();
+                mesh.topology = Vao::Topology::TriangleList;
+                mesh.pMaterial = pMaterial;
+                mesh.positions = { positions.data(), positionFrequency };
+                mesh.normals = { normals.data(), normalFrequency };
+                mesh.tangents = { &tangent, SceneBuilder::Mesh::AttributeFrequency::Constant };
+                if (!texCrds.empty()) mesh.texCrds = { texCrds.data(), SceneBuilder::Mesh::AttributeFrequency::Uniform };
+                mesh.useOriginalTangentSpace = true;
+                return mesh;
+            }
+        };
+
+        /** Create a triangle fan around vertex 0 with one normal per face.
+        */
+        TestMesh createFan(uint32_t faceCount)
+        {
+            TestMesh m;
+            m.positions.push_back(float3(0.f));
+            for (uint32_t i = 0; i <= faceCount; i++)
+            {
+                float phi = (float)(2.0 * M_PI) * i / faceCount;
+                m.positions.push_back(float3(std::cos(phi), std::sin(phi), 0.f));
+            }
+            for (uint32_t i = 0; i < faceCount; i++)
+            {
+                m.indices.insert(m.indices.end(), { 0, i + 1, i + 2 });
+                float phi = (float)(2.0 * M_PI) * (i + 0.5f) / faceCount;
+                m.normals.push_back(glm::normalize(float3(0.1f * std::cos(phi), 0.1f * std::sin(phi), 1.f)));
+            }
+            return m;
+        }
+
+        /** Create a grid of quads with one normal per face (flat shading), as imported from OBJ files with per-face normals.
+        */
+        TestMesh createFlatGrid(uint32_t faceCount)
+        {
+            TestMesh m;
+            const uint32_t n = std::max(1u, (uint32_t)std::sqrt(faceCount / 2.0));
+            for (uint32_t y = 0; y <= n; y++)
+            {
+                for (uint32_t x = 0; x <= n; x++)
+                {
+                    float h = 0.1f * std::sin(0.37f * x) * std::cos(0.23f * y);
+                    m.positions.push_back(float3(x, y, h));
+                }
+            }
+            auto addFace = [&m](uint32_t i0, uint32_t i1, uint32_t i2)
+            {
+                m.indices.insert(m.indices.end(), { i0, i1, i2 });
+                m.normals.push_back(glm::normalize(glm::cross(m.positions[i1] - m.positions[i0], m.positions[i2] - m.positions[i0])));
+            };
+            for (uint32_t y = 0; y < n; y++)
+            {
+                for (uint32_t x = 0; x < n; x++)
+                {
+                    uint32_t i = y * (n + 1) + x;
+                    addFace(i, i + 1, i + n + 2);
+                    addFace(i, i + n + 2, i + n + 1);
+                }
+            }
+            return m;
+        }
+
+        /** De-index the positions of a mesh and expand per-face normals to per-vertex normals, as written by exporters of non-indexed meshes.
+        */
+        TestMesh deindex(const TestMesh& m)
+        {
+            TestMesh result;
+            result.indices.resize(m.indices.size());
+            for (size_t i = 0; i < m.indices.size(); i++)
+            {
+                result.indices[i] = (uint32_t)i;
+                result.positions.push_back(m.positions[m.indices[i]]);
+                result.normals.push_back(m.normals[i / 3]);
+            }
+            return result;
+        }
+
+        /** Translate all positions of a mesh.
+        */
+        TestMesh translate(TestMesh m, const float3& offset)
+        {
+            for (auto& p : m.positions) p += offset;
+            return m;
+        }
+
+        /** Check that all indices of a processed mesh reference the original vertex data.
+        */
+        bool validateProcessedMesh(const SceneBuilder::ProcessedMesh& processedMesh, const SceneBuilder::Mesh& mesh)
+        {
+            if (processedMesh.indexCount != mesh.indexCount || processedMesh.use16BitIndices) return false;
+            for (uint32_t face = 0; face < mesh.faceCount; face++)
+            {
+                for (uint32_t vert = 0; vert < 3; vert++)
+                {
+                    uint32_t index = processedMesh.indexData[face * 3 + vert];
+                    if (index >= processedMesh.staticData.size()) return false;
+                    const auto& v = processedMesh.staticData[index];
+                    if (v.position != mesh.getPosition(face, vert)) return false;
+                    if (glm::any(glm::greaterThan(glm::abs(v.normal - mesh.getNormal(face, vert)), float3(1e-6f)))) return false;
+                }
+            }
+            return true;
+        }
+    }
+
+    GPU_TEST(SceneBuilder_ProcessMesh)
+    {
+        using Frequency = SceneBuilder::Mesh::AttributeFrequency;
+
+        // Keep the triangle order so that processed triangles can be compared to the input faces.
+        auto pBuilder = SceneBuilder::create(SceneBuilder::Flags::Force32BitIndices | SceneBuilder::Flags::DontOptimizeVertexCache);
+        auto pMaterial = StandardMaterial::create("TestMaterial");
+        const uint32_t faceCount = 1000;
+
+        // Distinct per-face normals around a shared vertex are not merged.
+        {
+            auto m = createFan(faceCount);
+            auto mesh = m.getMesh(pMaterial, Frequency::Vertex, Frequency::Uniform);
+            auto processedMesh = pBuilder->processMesh(mesh);
+            EXPECT_EQ(processedMesh.staticData.size(), 3 * faceCount);
+            EXPECT(validateProcessedMesh(processedMesh, mesh));
+        }
+
+        // Identical and near-identical vertices using the same original index are merged.
+        {
+            auto m = createFan(faceCount);
+            for (uint32_t i = 0; i < faceCount; i++)
+            {
+                m.normals[i] = float3(0.f, 0.f, 1.f);
+                m.texCrds.push_back(float2(0.25f + 1e-7f * (i % 4), 0.75f));
+            }
+            auto mesh = m.getMesh(pMaterial, Frequency::Vertex, Frequency::Uniform);
+            auto processedMesh = pBuilder->processMesh(mesh);
+            EXPECT_EQ(processedMesh.staticData.size(), m.positions.size());
+            EXPECT(validateProcessedMesh(processedMesh, mesh));
+        }
+
+        // Flat shaded grid. Each grid vertex is split once per distinct adjacent face normal.
+        {
+            auto m = createFlatGrid(2 * faceCount);
+            auto mesh = m.getMesh(pMaterial, Frequency::Vertex, Frequency::Uniform);
+            auto processedMesh = pBuilder->processMesh(mesh);
+            EXPECT_LE(processedMesh.staticData.size(), m.indices.size());
+            EXPECT_GT(processedMesh.staticData.size(), m.positions.size());
+            EXPECT(validateProcessedMesh(processedMesh, mesh));
+        }
+
+        // Vertices are only merged if they use the same original index, so non-indexed meshes are kept as is.
+        {
+            auto m = deindex(createFan(faceCount));
+            auto mesh = m.getMesh(pMaterial, Frequency::Vertex, Frequency::Vertex);
+            auto processedMesh = pBuilder->processMesh(mesh);
+            EXPECT_EQ(processedMesh.staticData.size(), m.indices.size());
+            EXPECT(validateProcessedMesh(processedMesh, mesh));
+        }
+    }
+
+    GPU_TEST(SceneBuilder_OptimizeVertexCache)
+    {
+        using Frequency = SceneBuilder::Mesh::AttributeFrequency;
+
+        auto pMaterial = StandardMaterial::create("TestMaterial");
+        auto m = createFlatGrid(20000);
+        m.normals.assign(m.positions.size(), float3(0.f, 0.f, 1.f));
+
+        // Shuffle the triangles to get a mesh with poor locality.
+        std::mt19937 rng(0);
+        std::vector<uint32_t> order(m.indices.size() / 3);
+        std::iota(order.begin(), order.end(), 0);
+        std::shuffle(order.begin(), order.end(), rng);
+        TestMesh shuffled = m;
+        for (size_t i = 0; i < order.size(); i++)
+        {
+            for (size_t k = 0; k < 3; k++) shuffled.indices[3 * i + k] = m.indices[3 * order[i] + k];
+        }
+        auto mesh = shuffled.getMesh(pMaterial, Frequency::Vertex, Frequency::Vertex);
+
+        // Returns the sorted list of triangle positions of a processed mesh.
+        auto getTriangles = [](const SceneBuilder::ProcessedMesh& processedMesh)
+        {
+            std::vector<std::array<float, 9>> triangles(processedMesh.indexCount / 3);
+            for (size_t t = 0; t < triangles.size(); t++)
+            {
+                for (size_t k = 0; k < 3; k++)
+                {
+                    const float3& p = processedMesh.staticData[processedMesh.indexData[3 * t + k]].position;
+                    for (size_t c = 0; c < 3; c++) triangles[t][3 * k + c] = p[c];
+                }
+            }
+            std::sort(triangles.begin(), triangles.end());
+            return triangles;
+        };
+
+        auto pReference = SceneBuilder::create(SceneBuilder::Flags::Force32BitIndices | SceneBuilder::Flags::DontOptimizeVertexCache);
+        auto reference = pReference->processMesh(mesh);
+        EXPECT_EQ(reference.acmrAfter, 0.f);
+
+        for (auto flags : { SceneBuilder::Flags::None, SceneBuilder::Flags::UseSpatialTriangleOrder })
+        {
+            auto pBuilder = SceneBuilder::create(SceneBuilder::Flags::Force32BitIndices | flags);
+            auto processedMesh = pBuilder->processMesh(mesh);
+
+            // The optimization only changes the order of triangles and vertices.
+            EXPECT_EQ(processedMesh.staticData.size(), reference.staticData.size());
+            EXPECT(getTriangles(processedMesh) == getTriangles(reference));
+            EXPECT_GT(processedMesh.acmrBefore, 2.f);
+            EXPECT_LT(processedMesh.acmrAfter, 1.f);
+
+            // Vertices are stored in the order they are first used.
+            uint32_t nextVertex = 0;
+            for (uint32_t index : processedMesh.indexData)
+            {
+                EXPECT_LE(index, nextVertex);
+                if (index == nextVertex) nextVertex++;
+            }
+        }
+    }
+
+    GPU_TEST(SceneBuilder_SplitNonIndexedMesh)
+    {
+        using Frequency = SceneBuilder::Mesh::AttributeFrequency;
+        using Access = SceneBuilderTestAccess;
+
+        auto pBuilder = SceneBuilder::create(SceneBuilder::Flags::NonIndexedVertices | SceneBuilder::Flags::DontOptimizeVertexCache);
+        auto pMaterial = StandardMaterial::create("TestMaterial");
+        auto m = createFlatGrid(2000);
+        const uint32_t meshID = pBuilder->addMesh(m.getMesh(pMaterial, Frequency::Vertex, Frequency::Uniform));
+        Access::calculateMeshBoundingBoxes(*pBuilder);
+
+        const auto& mesh = Access::getMesh(*pBuilder, meshID);
+        EXPECT_EQ(mesh.indexCount, 0u);
+        EXPECT(mesh.indexData.empty());
+        const uint32_t triangleCount = mesh.getTriangleCount();
+        const auto triangles = Access::getTriangles(*pBuilder, meshID);
+
+        // Planes outside the mesh bounds keep the mesh as is.
+        const AABB bb = mesh.boundingBox;
+        auto outside = Access::splitMesh(*pBuilder, meshID, 0, bb.maxPoint.x + 1.f);
+        EXPECT(outside.first == meshID && !outside.second);
+        outside = Access::splitMesh(*pBuilder, meshID, 0, bb.minPoint.x);
+        EXPECT(!outside.first && outside.second == meshID);
+
+        // The grid vertices are at integer coordinates, so no triangle centroid is on the splitting plane.
+        const float pos = std::floor(bb.center().x) + 0.5f;
+        auto [leftMeshID, rightMeshID] = Access::splitMesh(*pBuilder, meshID, 0, pos);
+        EXPECT(leftMeshID && rightMeshID);
+        if (!leftMeshID || !rightMeshID) return;
+        EXPECT_EQ(*leftMeshID, meshID);
+
+        for (uint32_t sideID : { *leftMeshID, *rightMeshID })
+        {
+            const auto& side = Access::getMesh(*pBuilder, sideID);
+            EXPECT_EQ(side.indexCount, 0u);
+            EXPECT(side.indexData.empty());
+            EXPECT_EQ(side.vertexCount, side.staticData.size());
+            EXPECT_EQ(side.vertexCount, 3 * side.getTriangleCount());
+
+            AABB sideBB;
+            for (const auto& v : side.staticData) sideBB.include(v.position);
+            EXPECT(sideBB == side.boundingBox);
+
+            // Each triangle is placed on the side of its centroid, with its vertices kept in order.
+            for (size_t i = 0; i < side.staticData.size(); i += 3)
+            {
+                float centroid = (side.staticData[i].position.x + side.staticData[i + 1].position.x + side.staticData[i + 2].position.x) / 3.f;
+                EXPECT_EQ(centroid < pos, sideID == *leftMeshID) << "triangle " << i / 3 << " of mesh " << sideID;
+            }
+        }
+
+        // No triangles were added or removed.
+        EXPECT_EQ(Access::getMesh(*pBuilder, *leftMeshID).getTriangleCount() + Access::getMesh(*pBuilder, *rightMeshID).getTriangleCount(), triangleCount);
+        auto splitTriangles = Access::getTriangles(*pBuilder, *leftMeshID);
+        auto rightTriangles = Access::getTriangles(*pBuilder, *rightMeshID);
+        splitTriangles.insert(splitTriangles.end(), rightTriangles.begin(), rightTriangles.end());
+        std::sort(splitTriangles.begin(), splitTriangles.end());
+        EXPECT(splitTriangles == triangles);
+    }
+
+    GPU_TEST(SceneBuilder_SplitMeshGroupSAH)
+    {
+        using Frequency = SceneBuilder::Mesh::AttributeFrequency;
+        using Access = SceneBuilderTestAccess;
+
+        auto pBuilder = SceneBuilder::create(SceneBuilder::Flags::DontOptimizeVertexCache);
+        auto pMaterial = StandardMaterial::create("TestMaterial");
+
+        // Two clusters of four stacked grids each, far apart along the x-axis.
+        const auto grid = createFlatGrid(200);
+        const size_t trianglesPerMesh = grid.indices.size() / 3;
+        std::vector<uint32_t> meshIDs;
+        std::vector<uint32_t> clusters;
+        for (uint32_t cluster = 0; cluster < 2; cluster++)
+        {
+            for (uint32_t i = 0; i < 4; i++)
+            {
+                auto m = translate(grid, float3(100.f * cluster, 0.f, (float)i));
+                meshIDs.push_back(pBuilder->addMesh(m.getMesh(pMaterial, Frequency::Vertex, Frequency::Uniform)));
+                clusters.push_back(cluster);
+            }
+        }
+        Access::calculateMeshBoundingBoxes(*pBuilder);
+
+        auto split = [&](size_t maxTriangles, const std::vector<uint32_t>& meshList)
+        {
+            Access::setMaxTrianglesPerBLAS(*pBuilder, maxTriangles);
+            auto groups = Access::splitMeshGroupSAH(*pBuilder, meshList);
+
+            // Each mesh ends up in exactly one group, and groups of multiple meshes are within the limit.
+            std::vector<uint32_t> groupedMeshIDs;
+            for (const auto& group : groups)
+            {
+                EXPECT(!group.empty());
+                if (group.size() > 1) EXPECT_LE(group.size() * trianglesPerMesh, maxTriangles);
+                groupedMeshIDs.insert(groupedMeshIDs.end(), group.begin(), group.end());
+            }
+            std::sort(groupedMeshIDs.begin(), groupedMeshIDs.end());
+            EXPECT(groupedMeshIDs == meshList);
+            return groups;
+        };
+
+        // Groups within the limit are kept as is.
+        EXPECT_EQ(split(meshIDs.size() * trianglesPerMesh, meshIDs).size(), 1u);
+
+        // The clusters are separated before any cluster is split.
+        auto groups = split(4 * trianglesPerMesh, meshIDs);
+        EXPECT_EQ(groups.size(), 2u);
+        for (const auto& group : groups)
+        {
+            for (auto meshID : group) EXPECT_EQ(clusters[meshID], clusters[group[0]]);
+        }
+
+        // The clusters are split evenly into stacks of two grids.
+        groups = split(2 * trianglesPerMesh + 1, meshIDs);
+        EXPECT_EQ(groups.size(), 4u);
+        for (const auto& group : groups) EXPECT_EQ(group.size(), 2u);
+
+        // Individual meshes are not split.
+        EXPECT_EQ(split(trianglesPerMesh / 2, meshIDs).size(), meshIDs.size());
+
+        // Meshes with coincident centroids cannot be partitioned.
+        std::vector<uint32_t> stackedMeshIDs;
+        for (uint32_t i = 0; i < 4; i++) stackedMeshIDs.push_back(pBuilder->addMesh(grid.getMesh(pMaterial, Frequency::Vertex, Frequency::Uniform)));
+        Access::calculateMeshBoundingBoxes(*pBuilder);
+        EXPECT_EQ(split(trianglesPerMesh, stackedMeshIDs).size(), 1u);
+    }
+
+    GPU_TEST(SceneBuilder_ProcessMeshBenchmark, "Disabled for performance reasons")
+    {
+        using Frequency = SceneBuilder::Mesh::AttributeFrequency;
+
+        auto pBuilder = SceneBuilder::create(SceneBuilder::Flags::Force32BitIndices);
+        auto pMaterial = StandardMaterial::create("TestMaterial");
+
+        auto run = [&](const std::string& name, const TestMesh& m, Frequency positionFrequency, Frequency normalFrequency)
+        {
+            auto mesh = m.getMesh(pMaterial, positionFrequency, normalFrequency);
+            auto t0 = CpuTimer::getCurrentTimePoint();
+            auto processedMesh = pBuilder->processMesh(mesh);
+            auto t1 = CpuTimer::getCurrentTimePoint();
+            double ms = CpuTimer::calcDuration(t0, t1);
+
+            std::cout << std::left << std::setw(24) << name << std::right
+                << std::setw(12) << mesh.faceCount
+                << std::setw(12) << mesh.vertexCount
+                << std::setw(12) << processedMesh.staticData.size()
+                << std::setw(12) << std::fixed << std::setprecision(1) << ms
+                << std::setw(12) << std::setprecision(2) << mesh.faceCount / (ms * 1e3) << std::endl;
+        };
+
+        std::cout << std::left << std::setw(24) << "mesh" << std::right
+            << std::setw(12) << "faces" << std::setw(12) << "vertices" << std::setw(12) << "processed"
+            << std::setw(12) << "ms" << std::setw(12) << "Mtris/s" << std::endl;
+
+        for (uint32_t faceCount : { 1u << 20, 10u << 20, 50u << 20 })
+        {
+            // Flat shaded grid with shared positions and per-face normals.
+            run("flat grid", createFlatGrid(faceCount), Frequency::Vertex, Frequency::Uniform);
+            // Non-indexed triangle soup.
+            run("non-indexed grid", deindex(createFlatGrid(faceCount)), Frequency::Vertex, Frequency::Vertex);
+        }
+
+        // Large fan-in around a single vertex.
+        for (uint32_t faceCount : { 1u << 16, 1u << 20 })
+        {
+            run("fan", createFan(faceCount), Frequency::Vertex, Frequency::Uniform);
+        }
+    }
+}
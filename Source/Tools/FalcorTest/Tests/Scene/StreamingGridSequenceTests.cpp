@@ -0,0 +1,156 @@
+/***************************************************************************
+ # Copyright (c) 2015-21, NVIDIA CORPORATION. All rights reserved.
+ #
+ # Redistribution and use in source and binary forms, with or without
+ # modification, are permitted provided that the following conditions
+ # are met:
+ #  * Redistributions of source code must retain the above copyright
+ #    notice, this list of conditions and the following disclaimer.
+ #  * Redistributions in binary form must reproduce the above copyright
+ #    notice, this list of conditions and the following disclaimer in the
+ #    documentation and/or other materials provided with the distribution.
+ #  * Neither the name of NVIDIA CORPORATION nor the names of its
+ #    contributors may be used to endorse or promote products derived
+ #    from this software without specific prior written permission.
+ #
+ # THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS "AS IS" AND ANY
+ # EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ # IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ # PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+ # CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ # EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ # PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ # PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+ # OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ # (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ # OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ **************************************************************************/
+#include "Testing/UnitTest.h"
+#include "Scene/Volume/StreamingGridSequence.h"
+#pragma warning(disable:4146 4244 4267 4275 4996)
+#include <nanovdb/util/IO.h>
+#pragma warning(default:4146 4244 4267 4275 4996)
+#include <filesystem>
+
+namespace Falcor
+{
+    namespace
+    {
+        const std::filesystem::path kTestDirectory = std::filesystem::temp_directory_path() / "StreamingGridSequenceTests";
+
+        /** Write a sequence of identical sphere grids to NanoVDB files, so that all frames have the same resident size.
+            \param[in] frameCount Number of frames.
+            \param[out] gridname Name of the grid in the files.
+            \return The file paths.
+        */
+        std::vector<std::string> writeSphereSequence(uint32_t frameCount, std::string& gridname)
+        {
+            auto pGrid = Grid::createSphere(8.f, 0.5f);
+            gridname = pGrid->getGridHandle().grid<float>()->gridName();
+
+            std::filesystem::create_directories(kTestDirectory);
+            std::vector<std::string> paths;
+            for (uint32_t i = 0; i < frameCount; i++)
+            {
+                paths.push_back((kTestDirectory / ("sphere" + std::to_string(i) + ".nvdb")).string());
+                nanovdb::io::writeGrid(paths.back(), pGrid->getGridHandle());
+            }
+            return paths;
+        }
+    }
+
+    GPU_TEST(StreamingGridSequence_Eviction)
+    {
+        std::string gridname;
+        auto paths = writeSphereSequence(4, gridname);
+        auto pSequence = StreamingGridSequence::create(paths, gridname);
+        pSequence->setPrefetchFrameCount(0);
+        EXPECT_EQ(pSequence->getFrameCount(), 4u);
+
+        // Frames that are not resident are loaded on the calling thread.
+        EXPECT(pSequence->getFrame(0) != nullptr);
+        EXPECT_EQ(pSequence->getStats().stallCount, 1);
+        EXPECT_EQ(pSequence->getStats().loadCount, 1);
+        const uint64_t frameSize = pSequence->getResidentBytes();
+        EXPECT_GE(frameSize, 1u);
+
+        // Budget for two frames.
+        pSequence->setMaxResidentBytes(2 * frameSize);
+        EXPECT(pSequence->getFrame(1) != nullptr);
+        EXPECT(pSequence->getFrame(0) != nullptr);
+        EXPECT_EQ(pSequence->getStats().hitCount, 1);
+        EXPECT_EQ(pSequence->getResidentFrameCount(), 2u);
+        EXPECT_EQ(pSequence->getStats().evictionCount, 0);
+
+        // Loading a third frame evicts the least recently used frame 1, not frame 0.
+        EXPECT(pSequence->getFrame(2) != nullptr);
+        EXPECT_EQ(pSequence->getResidentFrameCount(), 2u);
+        EXPECT_EQ(pSequence->getResidentBytes(), 2 * frameSize);
+        EXPECT_EQ(pSequence->getStats().evictionCount, 1);
+        EXPECT(pSequence->getFrame(0) != nullptr);
+        EXPECT_EQ(pSequence->getStats().hitCount, 2);
+        EXPECT_EQ(pSequence->getStats().loadCount, 3);
+
+        // Frame 1 was evicted and has to be loaded again, which evicts frame 2.
+        EXPECT(pSequence->getFrame(1) != nullptr);
+        EXPECT_EQ(pSequence->getStats().loadCount, 4);
+        EXPECT_EQ(pSequence->getStats().stallCount, 4);
+        EXPECT_EQ(pSequence->getStats().evictionCount, 2);
+
+        std::filesystem::remove_all(kTestDirectory);
+    }
+
+    GPU_TEST(StreamingGridSequence_KeepCurrentFrame)
+    {
+        std::string gridname;
+        auto paths = writeSphereSequence(3, gridname);
+        auto pSequence = StreamingGridSequence::create(paths, gridname);
+        pSequence->setPrefetchFrameCount(0);
+
+        for (uint32_t frame = 0; frame < 3; frame++) EXPECT(pSequence->getFrame(frame) != nullptr);
+        EXPECT_EQ(pSequence->getResidentFrameCount(), 3u);
+
+        // A budget smaller than a single frame evicts all frames but the current one.
+        pSequence->setMaxResidentBytes(1);
+        EXPECT_EQ(pSequence->getResidentFrameCount(), 1u);
+        EXPECT_EQ(pSequence->getStats().evictionCount, 2);
+
+        auto pGrid = pSequence->getFrame(2);
+        EXPECT(pGrid != nullptr);
+        EXPECT_EQ(pSequence->getStats().hitCount, 1);
+        EXPECT_EQ(pSequence->getResidentFrameCount(), 1u);
+
+        // Switching frames evicts the previous frame and keeps the new current frame.
+        EXPECT(pSequence->getFrame(0) != nullptr);
+        EXPECT_EQ(pSequence->getResidentFrameCount(), 1u);
+        EXPECT_EQ(pSequence->getStats().evictionCount, 3);
+
+        std::filesystem::remove_all(kTestDirectory);
+    }
+
+    GPU_TEST(StreamingGridSequence_Prefetch)
+    {
+        std::string gridname;
+        auto paths = writeSphereSequence(4, gridname);
+        paths.push_back((kTestDirectory / "missing.nvdb").string());
+        auto pSequence = StreamingGridSequence::create(paths, gridname);
+        pSequence->setPrefetchFrameCount(2);
+
+        EXPECT(pSequence->getFrame(0) != nullptr);
+        pSequence->prefetch(0, 1);
+        EXPECT_EQ(pSequence->getStats().prefetchCount, 2);
+
+        // Prefetched frames are either resident (a hit) or still loading (a stall), but are loaded only once.
+        EXPECT(pSequence->getFrame(1) != nullptr);
+        EXPECT(pSequence->getFrame(2) != nullptr);
+        auto stats = pSequence->getStats();
+        EXPECT_EQ(stats.loadCount, 3);
+        EXPECT_EQ(stats.hitCount + stats.stallCount, 3);
+
+        // Missing frames fail without loading.
+        EXPECT(pSequence->getFrame(4) == nullptr);
+        EXPECT_EQ(pSequence->getStats().loadCount, 3);
+
+        std::filesystem::remove_all(kTestDirectory);
+    }
+}
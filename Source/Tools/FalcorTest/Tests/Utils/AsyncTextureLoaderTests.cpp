@@ -0,0 +1,334 @@
+/***************************************************************************
+ # Copyright (c) 2015-21, NVIDIA CORPORATION. All rights reserved.
+ #
+ # Redistribution and use in source and binary forms, with or without
+ # modification, are permitted provided that the following conditions
+ # are met:
+ #  * Redistributions of source code must retain the above copyright
+ #    notice, this list of conditions and the following disclaimer.
+ #  * Redistributions in binary form must reproduce the above copyright
+ #    notice, this list of conditions and the following disclaimer in the
+ #    documentation and/or other materials provided with the distribution.
+ #  * Neither the name of NVIDIA CORPORATION nor the names of its
+ #    contributors may be used to endorse or promote products derived
+ #    from this software without specific prior written permission.
+ #
+ # THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS "AS IS" AND ANY
+ # EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ # IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ # PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+ # CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ # EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ # PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ # PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+ # OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ # (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ # OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ **************************************************************************/
+#include "Testing/UnitTest.h"
+#include "Utils/AsyncTextureLoader.h"
+#include "Utils/Color/ColorHelpers.slang"
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+#include <random>
+
+namespace Falcor
+{
+    namespace
+    {
+        const std::filesystem::path kTestDirectory = std::filesystem::temp_directory_path() / "AsyncTextureLoaderTests";
+
+        /** Write an RGBA8 PNG file with random texels.
+            \param[in] name File name in the test directory.
+            \param[in] dim Width and height in texels.
+            \param[in] seed Seed of the texel values.
+            \param[in] opaque Set all alpha values to 255.
+            \return The full path of the file.
+        */
+        std::string writeTestImage(const std::string& name, uint32_t dim, uint32_t seed, bool opaque = true)
+        {
+            std::mt19937 rng(seed);
+            std::vector<uint8_t> texels(dim * dim * 4);
+            for (size_t i = 0; i < texels.size(); i++) texels[i] = (i % 4 == 3 && opaque) ? 255 : (uint8_t)rng();
+
+            std::filesystem::create_directories(kTestDirectory);
+            std::string path = (kTestDirectory / name).string();
+            Bitmap::saveImage(path, dim, dim, Bitmap::FileFormat::PngFile, Bitmap::ExportFlags::ExportAlpha, ResourceFormat::RGBA8Unorm, true, texels.data());
+            return path;
+        }
+
+        template<typename T>
+        Bitmap::UniqueConstPtr createBitmap(uint32_t width, uint32_t height, ResourceFormat format, const std::vector<T>& texels)
+        {
+            return Bitmap::create(width, height, format, reinterpret_cast<const uint8_t*>(texels.data()));
+        }
+    }
+
+    CPU_TEST(AsyncTextureLoader_SelectCompressionMode)
+    {
+        using CompressionMode = ImageIO::CompressionMode;
+        using Compression = AsyncTextureLoader::Compression;
+
+        std::vector<uint8_t> opaque(8 * 8 * 4, 255);
+        std::vector<uint8_t> translucent(8 * 8 * 4, 255);
+        translucent[3] = 128;
+
+        auto pOpaque = createBitmap(8, 8, ResourceFormat::BGRA8Unorm, opaque);
+        auto pTranslucent = createBitmap(8, 8, ResourceFormat::BGRA8Unorm, translucent);
+        EXPECT(AsyncTextureLoader::selectCompressionMode(*pOpaque, Compression::Color, false) == CompressionMode::BC1);
+        EXPECT(AsyncTextureLoader::selectCompressionMode(*pTranslucent, Compression::Color, false) == CompressionMode::BC3);
+        EXPECT(AsyncTextureLoader::selectCompressionMode(*pTranslucent, Compression::Color, true) == CompressionMode::BC7);
+        EXPECT(AsyncTextureLoader::selectCompressionMode(*pOpaque, Compression::Normal, true) == CompressionMode::BC5);
+        EXPECT(AsyncTextureLoader::selectCompressionMode(*createBitmap(8, 8, ResourceFormat::BGRX8Unorm, translucent), Compression::Color, false) == CompressionMode::BC1);
+
+        // Single and two channel formats.
+        std::vector<uint8_t> r8(8 * 8), rg8(8 * 8 * 2);
+        EXPECT(AsyncTextureLoader::selectCompressionMode(*createBitmap(8, 8, ResourceFormat::R8Unorm, r8), Compression::Color, false) == CompressionMode::BC4);
+        EXPECT(AsyncTextureLoader::selectCompressionMode(*createBitmap(8, 8, ResourceFormat::RG8Unorm, rg8), Compression::Color, false) == CompressionMode::BC5);
+
+        // HDR images are compressed to BC6H only if they are opaque, as BC6H has no alpha channel.
+        std::vector<float> hdr(8 * 8 * 4, 1.f);
+        EXPECT(AsyncTextureLoader::selectCompressionMode(*createBitmap(8, 8, ResourceFormat::RGBA32Float, hdr), Compression::Color, false) == CompressionMode::BC6);
+        EXPECT(AsyncTextureLoader::selectCompressionMode(*createBitmap(8, 8, ResourceFormat::RGBA32Float, hdr), Compression::Normal, false) == CompressionMode::None);
+        hdr[3] = 0.5f;
+        EXPECT(AsyncTextureLoader::selectCompressionMode(*createBitmap(8, 8, ResourceFormat::RGBA32Float, hdr), Compression::Color, false) == CompressionMode::None);
+
+        // 16-bit unorm data and dimensions that are not a multiple of the block size are kept uncompressed.
+        std::vector<uint16_t> r16(8 * 8);
+        EXPECT(AsyncTextureLoader::selectCompressionMode(*createBitmap(8, 8, ResourceFormat::R16Unorm, r16), Compression::Color, false) == CompressionMode::None);
+        std::vector<uint8_t> odd(6 * 8 * 4, 255);
+        EXPECT(AsyncTextureLoader::selectCompressionMode(*createBitmap(6, 8, ResourceFormat::BGRA8Unorm, odd), Compression::Color, false) == CompressionMode::None);
+    }
+
+    CPU_TEST(AsyncTextureLoader_GenerateMipChain)
+    {
+        // Float texels: each mip of a power-of-two image is the 2x2 box filtered previous mip.
+        const uint32_t dim = 16, mipCount = 5;
+        std::mt19937 rng(3);
+        std::uniform_real_distribution<float> dist(0.f, 4.f);
+        std::vector<float> texels(dim * dim * 4);
+        for (auto& v : texels) v = dist(rng);
+
+        auto data = AsyncTextureLoader::generateMipChain(*createBitmap(dim, dim, ResourceFormat::RGBA32Float, texels), false, mipCount);
+        size_t expectedSize = 0;
+        for (uint32_t mip = 0; mip < mipCount; mip++) expectedSize += (dim >> mip) * (dim >> mip) * 4 * sizeof(float);
+        EXPECT_EQ(data.size(), expectedSize);
+        if (data.size() != expectedSize) return;
+
+        const float* pSrc = reinterpret_cast<const float*>(data.data());
+        EXPECT(std::equal(texels.begin(), texels.end(), pSrc));
+        for (uint32_t mip = 1; mip < mipCount; mip++)
+        {
+            const uint32_t srcDim = dim >> (mip - 1), dstDim = dim >> mip;
+            const float* pDst = pSrc + srcDim * srcDim * 4;
+            for (uint32_t y = 0; y < dstDim; y++)
+            {
+                for (uint32_t x = 0; x < dstDim; x++)
+                {
+                    for (uint32_t c = 0; c < 4; c++)
+                    {
+                        auto src = [&](uint32_t sx, uint32_t sy) { return pSrc[(sy * srcDim + sx) * 4 + c]; };
+                        float expected = (src(2 * x, 2 * y) + src(2 * x + 1, 2 * y) + src(2 * x, 2 * y + 1) + src(2 * x + 1, 2 * y + 1)) * 0.25f;
+                        EXPECT_LE(std::abs(pDst[(y * dstDim + x) * 4 + c] - expected), 1e-5f) << "mip = " << mip << ", x = " << x << ", y = " << y;
+                    }
+                }
+            }
+            pSrc = pDst;
+        }
+
+        // 8-bit texels: the color channels of sRGB images are filtered in linear space, alpha is filtered as is.
+        std::vector<uint8_t> checker(2 * 2 * 4);
+        for (uint32_t i = 0; i < 4; i++)
+        {
+            uint8_t v = (i == 0 || i == 3) ? 255 : 0;
+            for (uint32_t c = 0; c < 4; c++) checker[i * 4 + c] = v;
+        }
+        auto linear = AsyncTextureLoader::generateMipChain(*createBitmap(2, 2, ResourceFormat::BGRA8Unorm, checker), false, 2);
+        auto srgb = AsyncTextureLoader::generateMipChain(*createBitmap(2, 2, ResourceFormat::BGRA8Unorm, checker), true, 2);
+        EXPECT_EQ(linear.size(), 20);
+        EXPECT_EQ(srgb.size(), 20);
+        if (linear.size() != 20 || srgb.size() != 20) return;
+        const uint8_t srgbHalf = (uint8_t)(linearToSRGB(0.5f) * 255.f + 0.5f);
+        for (uint32_t c = 0; c < 3; c++)
+        {
+            EXPECT_EQ((uint32_t)linear[16 + c], 128u);
+            EXPECT_EQ((uint32_t)srgb[16 + c], (uint32_t)srgbHalf);
+        }
+        EXPECT_EQ((uint32_t)srgb[19], 128u);
+
+        // Odd dimensions: mips are rounded down and the chain ends at 1x1.
+        std::vector<float> odd(5 * 3 * 4, 1.f);
+        auto oddData = AsyncTextureLoader::generateMipChain(*createBitmap(5, 3, ResourceFormat::RGBA32Float, odd), false, 3);
+        EXPECT_EQ(oddData.size(), (5 * 3 + 2 * 1 + 1 * 1) * 4 * sizeof(float));
+    }
+
+    GPU_TEST(AsyncTextureLoader_Dedup)
+    {
+        const std::string path = writeTestImage("dedup.png", 32, 1);
+
+        AsyncTextureLoader loader;
+        auto future0 = loader.loadFromFile(path, true, false);
+        auto future1 = loader.loadFromFile(path, true, false);
+        auto future2 = loader.loadFromFile(path, true, true); // Different flags are a different texture.
+
+        auto pTexture0 = future0.get();
+        auto pTexture1 = future1.get();
+        auto pTexture2 = future2.get();
+        EXPECT(pTexture0 != nullptr);
+        EXPECT(pTexture0 == pTexture1);
+        EXPECT(pTexture2 != nullptr && pTexture2 != pTexture0);
+
+        // Requests for a completed texture are served immediately.
+        EXPECT(loader.loadFromFile(path, true, false).get() == pTexture0);
+
+        auto stats = loader.getStats();
+        EXPECT_EQ(stats.requestCount, 4);
+        EXPECT_EQ(stats.duplicateCount, 2);
+        EXPECT_EQ(stats.read.itemCount, 2);
+        EXPECT_EQ(stats.failedCount, 0);
+    }
+
+    GPU_TEST(AsyncTextureLoader_Priority)
+    {
+        const uint32_t count = 16;
+        std::vector<std::string> paths;
+        for (uint32_t i = 0; i < count; i++) paths.push_back(writeTestImage("priority" + std::to_string(i) + ".png", 256, i));
+
+        // Process one texture at a time, so that the queued requests are ordered by priority.
+        AsyncTextureLoader::Options options;
+        options.readThreadCount = 1;
+        options.maxTexturesInFlight = 1;
+        AsyncTextureLoader loader(options);
+
+        std::vector<std::future<Texture::SharedPtr>> futures;
+        for (const auto& path : paths) futures.push_back(loader.loadFromFile(path, false, false, Resource::BindFlags::ShaderResource, AsyncTextureLoader::Priority::Low));
+
+        // Raise the priority of the last request. It is loaded next, before the low priority requests submitted before it.
+        // Allow for the few requests that may have been in flight already.
+        auto pHigh = loader.loadFromFile(paths.back(), false, false, Resource::BindFlags::ShaderResource, AsyncTextureLoader::Priority::High).get();
+        EXPECT(pHigh != nullptr);
+        uint32_t doneCount = 0;
+        for (uint32_t i = 0; i < count - 1; i++)
+        {
+            if (futures[i].wait_for(std::chrono::seconds(0)) == std::future_status::ready) doneCount++;
+        }
+        EXPECT_LE(doneCount, 4u);
+
+        EXPECT(futures.back().get() == pHigh);
+        for (auto& future : futures) future.wait();
+        EXPECT_EQ(loader.getStats().duplicateCount, 1);
+    }
+
+    GPU_TEST(AsyncTextureLoader_Budget)
+    {
+        const uint32_t count = 8;
+        std::vector<std::string> paths;
+        for (uint32_t i = 0; i < count; i++) paths.push_back(writeTestImage("budget" + std::to_string(i) + ".png", 64, i));
+
+        auto loadAll = [&](const AsyncTextureLoader::Options& options)
+        {
+            AsyncTextureLoader loader(options);
+            std::vector<std::future<Texture::SharedPtr>> futures;
+            for (const auto& path : paths) futures.push_back(loader.loadFromFile(path, true, false));
+            for (auto& future : futures) EXPECT(future.get() != nullptr);
+            return loader.getStats();
+        };
+
+        // The number of textures in flight is bounded.
+        AsyncTextureLoader::Options options;
+        options.maxTexturesInFlight = 2;
+        auto stats = loadAll(options);
+        EXPECT_GE(stats.peakTexturesInFlight, 1u);
+        EXPECT_LE(stats.peakTexturesInFlight, 2u);
+
+        // A byte budget smaller than a single texture admits one texture at a time.
+        options.maxTexturesInFlight = 64;
+        options.maxBytesInFlight = 1;
+        stats = loadAll(options);
+        EXPECT_EQ(stats.peakTexturesInFlight, 1u);
+        EXPECT_EQ(stats.upload.itemCount, count);
+    }
+
+    GPU_TEST(AsyncTextureLoader_Failed)
+    {
+        std::filesystem::create_directories(kTestDirectory);
+        const std::string corruptPath = (kTestDirectory / "corrupt.png").string();
+        {
+            std::ofstream fs(corruptPath, std::ios::binary);
+            fs << "This is not a PNG file.";
+        }
+
+        AsyncTextureLoader loader;
+
+        // Missing files fail immediately.
+        EXPECT(loader.loadFromFile((kTestDirectory / "missing.png").string(), true, false).get() == nullptr);
+
+        // Files that fail to decode resolve the promises of all requests for them.
+        auto future0 = loader.loadFromFile(corruptPath, true, false);
+        auto future1 = loader.loadFromFile(corruptPath, true, false, Resource::BindFlags::ShaderResource, AsyncTextureLoader::Priority::High);
+        EXPECT(future0.get() == nullptr);
+        EXPECT(future1.get() == nullptr);
+        EXPECT(loader.loadFromFile(corruptPath, true, false).get() == nullptr);
+
+        auto stats = loader.getStats();
+        EXPECT_EQ(stats.failedCount, 1);
+        EXPECT_EQ(stats.duplicateCount, 2);
+    }
+
+    GPU_TEST(AsyncTextureLoader_Cache)
+    {
+        const std::string path = writeTestImage("cache.png", 64, 1);
+        const auto cacheDirectory = kTestDirectory / "cache";
+        std::filesystem::remove_all(cacheDirectory);
+
+        AsyncTextureLoader::Options options;
+        options.cacheDirectory = cacheDirectory.string();
+
+        // The first load transcodes the texture and writes it to the cache.
+        Texture::SharedPtr pTranscoded;
+        {
+            AsyncTextureLoader loader(options);
+            pTranscoded = loader.loadCompressedFromFile(path, false, AsyncTextureLoader::Compression::Color).get();
+            auto stats = loader.getStats();
+            EXPECT_EQ(stats.cacheHitCount, 0);
+            EXPECT_EQ(stats.transcode.itemCount, 1);
+        }
+        EXPECT(pTranscoded != nullptr);
+        if (!pTranscoded) return;
+        EXPECT(pTranscoded->getFormat() == ResourceFormat::BC1Unorm);
+        EXPECT_EQ(pTranscoded->getMipCount(), 7);
+
+        // Only the final cache file is left, no temporary files.
+        size_t fileCount = 0;
+        for (const auto& entry : std::filesystem::directory_iterator(cacheDirectory))
+        {
+            EXPECT(entry.path().extension() == ".dds") << entry.path().string();
+            fileCount++;
+        }
+        EXPECT_EQ(fileCount, 1);
+
+        // The second load reads the texture from the cache.
+        {
+            AsyncTextureLoader loader(options);
+            auto pCached = loader.loadCompressedFromFile(path, false, AsyncTextureLoader::Compression::Color).get();
+            auto stats = loader.getStats();
+            EXPECT_EQ(stats.cacheHitCount, 1);
+            EXPECT_EQ(stats.transcode.itemCount, 0);
+            EXPECT(pCached != nullptr);
+            if (pCached)
+            {
+                EXPECT(pCached->getFormat() == pTranscoded->getFormat());
+                EXPECT_EQ(pCached->getWidth(), pTranscoded->getWidth());
+                EXPECT_EQ(pCached->getMipCount(), pTranscoded->getMipCount());
+            }
+
+            // Different flags are a cache miss.
+            auto pNormal = loader.loadCompressedFromFile(path, false, AsyncTextureLoader::Compression::Normal).get();
+            EXPECT_EQ(loader.getStats().cacheHitCount, 1);
+            EXPECT(pNormal != nullptr && pNormal->getFormat() == ResourceFormat::BC5Unorm);
+        }
+
+        std::filesystem::remove_all(kTestDirectory);
+    }
+}
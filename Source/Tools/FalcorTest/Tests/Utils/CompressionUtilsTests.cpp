@@ -0,0 +1,149 @@
+/***************************************************************************
+ # Copyright (c) 2015-21, NVIDIA CORPORATION. All rights reserved.
+ #
+ # Redistribution and use in source and binary forms, with or without
+ # modification, are permitted provided that the following conditions
+ # are met:
+ #  * Redistributions of source code must retain the above copyright
+ #    notice, this list of conditions and the following disclaimer.
+ #  * Redistributions in binary form must reproduce the above copyright
+ #    notice, this list of conditions and the following disclaimer in the
+ #    documentation and/or other materials provided with the distribution.
+ #  * Neither the name of NVIDIA CORPORATION nor the names of its
+ #    contributors may be used to endorse or promote products derived
+ #    from this software without specific prior written permission.
+ #
+ # THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS "AS IS" AND ANY
+ # EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ # IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ # PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+ # CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ # EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ # PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ # PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+ # OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ # (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ # OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ **************************************************************************/
+#include "Testing/UnitTest.h"
+#include "Utils/CompressionUtils.h"
+#include <iomanip>
+#include <random>
+
+namespace Falcor
+{
+    namespace
+    {
+        /** Generate compressible test data (runs of random bytes mixed with noise).
+        */
+        std::vector<uint8_t> generateData(size_t size, uint32_t seed)
+        {
+            std::mt19937 rng(seed);
+            std::vector<uint8_t> data(size);
+            size_t i = 0;
+            while (i < size)
+            {
+                size_t runLength = std::min<size_t>(rng() % 64 + 1, size - i);
+                uint8_t value = (uint8_t)rng();
+                bool noise = rng() % 4 == 0;
+                for (size_t j = 0; j < runLength; ++j) data[i++] = noise ? (uint8_t)rng() : value;
+            }
+            return data;
+        }
+    }
+
+    CPU_TEST(ParallelLZ4)
+    {
+        const size_t sizes[] = { 0, 1, 1000, 1 << 20, (5 << 20) + 17 };
+        const size_t frameSizes[] = { 1 << 12, 1 << 16, ParallelLZ4::kDefaultFrameSize };
+        const uint32_t threadCounts[] = { 1, 3, 0 };
+
+        for (size_t size : sizes)
+        {
+            auto data = generateData(size, (uint32_t)size);
+
+            for (size_t frameSize : frameSizes)
+            {
+                for (uint32_t threadCount : threadCounts)
+                {
+                    std::vector<ParallelLZ4::Frame> frames;
+                    auto compressedData = ParallelLZ4::compress(data.data(), data.size(), frames, frameSize, threadCount);
+                    EXPECT_EQ(frames.size(), div_round_up(size, frameSize));
+                    EXPECT_EQ(ParallelLZ4::getDecompressedSize(frames), size);
+
+                    // Frames are stored back to back.
+                    uint64_t offset = 0;
+                    for (const auto& frame : frames)
+                    {
+                        EXPECT_EQ(frame.offset, offset);
+                        offset += frame.compressedSize;
+                    }
+                    EXPECT_EQ(offset, compressedData.size());
+
+                    std::vector<uint8_t> result(size);
+                    ParallelLZ4::decompress(compressedData.data(), compressedData.size(), frames, result.data(), threadCount);
+                    EXPECT(result == data);
+                }
+            }
+        }
+
+        // Truncated data must be rejected.
+        {
+            auto data = generateData(1 << 20, 0);
+            std::vector<ParallelLZ4::Frame> frames;
+            auto compressedData = ParallelLZ4::compress(data.data(), data.size(), frames, 1 << 16);
+            std::vector<uint8_t> result(data.size());
+            bool threw = false;
+            try
+            {
+                ParallelLZ4::decompress(compressedData.data(), compressedData.size() - 1, frames, result.data());
+            }
+            catch (const std::exception&)
+            {
+                threw = true;
+            }
+            EXPECT(threw);
+        }
+    }
+
+    CPU_TEST(ParallelLZ4_Benchmark, "Disabled for performance reasons")
+    {
+        const size_t kSize = 256ull << 20;
+        const uint32_t kIterations = 4;
+
+        auto data = generateData(kSize, 0);
+        std::vector<uint8_t> result(kSize);
+
+        std::cout << "ParallelLZ4 throughput (" << (kSize >> 20) << " MB, frame size " << (ParallelLZ4::kDefaultFrameSize >> 20) << " MB)" << std::endl;
+        std::cout << "threads  compress MB/s  decompress MB/s  ratio" << std::endl;
+
+        const uint32_t maxThreadCount = Threading::getLogicalThreadCount();
+        for (uint32_t threadCount = 1;; threadCount = std::min(threadCount * 2, maxThreadCount))
+        {
+            std::vector<ParallelLZ4::Frame> frames;
+            std::vector<uint8_t> compressedData;
+            double compressTime = 0.0;
+            double decompressTime = 0.0;
+
+            for (uint32_t i = 0; i < kIterations; ++i)
+            {
+                auto t0 = CpuTimer::getCurrentTimePoint();
+                compressedData = ParallelLZ4::compress(data.data(), data.size(), frames, ParallelLZ4::kDefaultFrameSize, threadCount);
+                auto t1 = CpuTimer::getCurrentTimePoint();
+                ParallelLZ4::decompress(compressedData.data(), compressedData.size(), frames, result.data(), threadCount);
+                auto t2 = CpuTimer::getCurrentTimePoint();
+                compressTime += CpuTimer::calcDuration(t0, t1);
+                decompressTime += CpuTimer::calcDuration(t1, t2);
+            }
+            EXPECT(result == data);
+
+            const double megabytes = (double)kSize / (1 << 20) * kIterations;
+            std::cout << std::setw(7) << threadCount
+                << std::setw(15) << std::fixed << std::setprecision(1) << megabytes / (compressTime * 1e-3)
+                << std::setw(17) << megabytes / (decompressTime * 1e-3)
+                << std::setw(7) << std::setprecision(2) << (double)kSize / compressedData.size() << std::endl;
+
+            if (threadCount == maxThreadCount) break;
+        }
+    }
+}
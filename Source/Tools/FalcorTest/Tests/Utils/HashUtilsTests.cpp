@@ -26,6 +26,7 @@
  # OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
  **************************************************************************/
 #include "Testing/UnitTest.h"
+#include "Utils/Math/HashUtils.h"
 #include <vector>
 
 // The perfect hash tests are disabled by default as they take a really long time to run.
@@ -114,4 +115,45 @@ namespace Falcor
         }
         pResultBuffer->unmap();
     }
+
+    CPU_TEST(HashUtils_CPU)
+    {
+        // Hashes of memory blocks depend on the contents and size only.
+        std::vector<uint8_t> data(1000);
+        for (size_t i = 0; i < data.size(); i++) data[i] = (uint8_t)(i * 7);
+        std::vector<uint8_t> copy = data;
+        EXPECT_EQ(hashBytes(data.data(), data.size()), hashBytes(copy.data(), copy.size()));
+        EXPECT_NE(hashBytes(data.data(), data.size()), hashBytes(data.data(), data.size() - 1));
+
+        // Hashing in chunks is deterministic.
+        EXPECT_EQ(hashBytes(data.data() + 500, 500, hashBytes(data.data(), 500)), hashBytes(copy.data() + 500, 500, hashBytes(copy.data(), 500)));
+
+        // Single byte changes at any position change the hash.
+        uint64_t ref = hashBytes(data.data(), data.size());
+        for (size_t i = 0; i < data.size(); i++)
+        {
+            copy[i] ^= 1;
+            EXPECT_NE(ref, hashBytes(copy.data(), copy.size())) << "i = " << i;
+            copy[i] ^= 1;
+        }
+
+        // Float hashes are consistent with float comparison.
+        uint64_t h0 = 0, h1 = 0;
+        hashCombine(h0, 0.f);
+        hashCombine(h1, -0.f);
+        EXPECT_EQ(h0, h1);
+
+        uint64_t h2 = 0, h3 = 0;
+        hashCombine(h2, float3(1.f, 2.f, 3.f));
+        hashCombine(h3, float3(1.f, 3.f, 2.f));
+        EXPECT_NE(h2, h3);
+
+        // Hash combination is order dependent.
+        uint64_t h4 = 0, h5 = 0;
+        hashCombine(h4, 1u);
+        hashCombine(h4, 2u);
+        hashCombine(h5, 2u);
+        hashCombine(h5, 1u);
+        EXPECT_NE(h4, h5);
+    }
 }
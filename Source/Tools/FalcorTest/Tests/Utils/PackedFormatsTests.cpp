@@ -26,7 +26,9 @@
  # OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
  **************************************************************************/
 #include "Testing/UnitTest.h"
+#include "Utils/Math/PackedFormats.h"
 #include <glm/gtx/io.hpp>
+#include <limits>
 #include <random>
 
 namespace Falcor
@@ -43,6 +45,93 @@ namespace Falcor
             { 1e30f, 1e30f, 1e30f },
             // We'll append random data here at runtime.
         };
+
+        std::vector<float3> generateLogTestData()
+        {
+            std::mt19937 rng;
+            auto dist = std::uniform_real_distribution<float>();
+            auto u = [&]() { return dist(rng); };
+
+            std::vector<float3> data =
+            {
+                // Values that are stored exactly as zero or clamped.
+                { 0.f, -1.f, std::numeric_limits<float>::quiet_NaN() },
+                { 1e-30f, 1e30f, std::numeric_limits<float>::infinity() },
+            };
+
+            // Components with unrelated magnitudes within the supported range.
+            for (size_t i = 0; i < 10000; i++)
+            {
+                data.push_back(float3(std::pow(2.f, u() * 120.f - 60.f), std::pow(2.f, u() * 120.f - 60.f), std::pow(2.f, u() * 120.f - 60.f)));
+            }
+            return data;
+        }
+
+        void verifyLogFloat3x21(UnitTestContext& ctx, const std::vector<float3>& data, const float3* result)
+        {
+            const float kMaxRelativeError = 1e-4f; // Quantization error plus the error of log2/exp2 on the GPU.
+
+            EXPECT_EQ(result[0], float3(0.f));
+            EXPECT_EQ(result[1].x, 0.f);
+            EXPECT_GE(result[1].y, 1.8e19f);
+            EXPECT_GE(result[1].z, 1.8e19f);
+
+            for (size_t i = 2; i < data.size(); i++)
+            {
+                for (int j = 0; j < 3; j++)
+                {
+                    EXPECT_LE(std::abs(result[i][j] - data[i][j]), data[i][j] * kMaxRelativeError) << "i = " << i << ", j = " << j;
+                }
+            }
+        }
+    }
+
+    CPU_TEST(LogLuvHDRHost)
+    {
+        std::mt19937 rng;
+        auto dist = std::uniform_real_distribution<float>();
+        auto u = [&]() { return dist(rng); };
+
+        EXPECT_EQ(decodeLogLuvHDR(encodeLogLuvHDR(float3(0.f))), float3(0.f));
+        EXPECT_EQ(decodeLogLuvHDR(encodeLogLuvHDR(float3(1e-10f))), float3(0.f));
+
+        for (size_t i = 0; i < 10000; i++)
+        {
+            float scale = std::pow(2.f, u() * 40.f - 20.f);
+            float3 c = float3(u(), u(), u()) * scale;
+            float3 result = decodeLogLuvHDR(encodeLogLuvHDR(c));
+
+            float threshold = std::max(std::max(c.x, c.y), c.z) * 0.0105f;
+            for (int j = 0; j < 3; j++)
+            {
+                float expMin = c[j] > 1e-5f ? std::max(0.f, c[j] - threshold) : 0.f;
+                EXPECT_GE(result[j], expMin) << "i = " << i;
+                EXPECT_LE(result[j], c[j] + threshold) << "i = " << i;
+            }
+        }
+    }
+
+    CPU_TEST(LogFloat3x21Host)
+    {
+        std::vector<float3> data = generateLogTestData();
+        std::vector<float3> result(data.size());
+        for (size_t i = 0; i < data.size(); i++) result[i] = decodeLogFloat3x21(encodeLogFloat3x21(data[i]));
+
+        verifyLogFloat3x21(ctx, data, result.data());
+    }
+
+    GPU_TEST(LogFloat3x21)
+    {
+        std::vector<float3> data = generateLogTestData();
+
+        ctx.createProgram("Tests/Utils/PackedFormatsTests.cs.slang", "testLogFloat3x21");
+        ctx.allocateStructuredBuffer("testLogData", (uint32_t)data.size(), data.data(), data.size() * sizeof(data[0]));
+        ctx.allocateStructuredBuffer("logResult", (uint32_t)data.size());
+        ctx.runProgram((uint32_t)data.size());
+
+        const float3* result = ctx.mapBuffer<const float3>("logResult");
+        verifyLogFloat3x21(ctx, data, result);
+        ctx.unmapBuffer("logResult");
     }
 
     GPU_TEST(LogLuvHDR)
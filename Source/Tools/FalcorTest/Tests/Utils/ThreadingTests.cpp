@@ -0,0 +1,148 @@
+/***************************************************************************
+ # Copyright (c) 2015-21, NVIDIA CORPORATION. All rights reserved.
+ #
+ # Redistribution and use in source and binary forms, with or without
+ # modification, are permitted provided that the following conditions
+ # are met:
+ #  * Redistributions of source code must retain the above copyright
+ #    notice, this list of conditions and the following disclaimer.
+ #  * Redistributions in binary form must reproduce the above copyright
+ #    notice, this list of conditions and the following disclaimer in the
+ #    documentation and/or other materials provided with the distribution.
+ #  * Neither the name of NVIDIA CORPORATION nor the names of its
+ #    contributors may be used to endorse or promote products derived
+ #    from this software without specific prior written permission.
+ #
+ # THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS "AS IS" AND ANY
+ # EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ # IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ # PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+ # CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ # EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ # PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ # PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+ # OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ # (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ # OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ **************************************************************************/
+#include "Testing/UnitTest.h"
+#include <numeric>
+
+namespace Falcor
+{
+    CPU_TEST(Threading_ParallelFor)
+    {
+        std::vector<uint32_t> values(100000, 0);
+        Threading::parallelFor(0, values.size(), [&](size_t i) { values[i] += (uint32_t)i; });
+        for (size_t i = 0; i < values.size(); i++) EXPECT_EQ(values[i], (uint32_t)i);
+
+        // Empty and single-chunk ranges run on the calling thread.
+        Threading::parallelFor(10, 10, [&](size_t i) { EXPECT(false); });
+        std::thread::id caller = std::this_thread::get_id();
+        Threading::parallelFor(0, 8, [&](size_t i) { EXPECT(std::this_thread::get_id() == caller); }, 8);
+
+        // Nested loops wait for their inner loops without deadlocking the pool.
+        std::atomic<uint32_t> count = 0;
+        Threading::parallelFor(0, 64, [&](size_t) { Threading::parallelFor(0, 1000, [&](size_t) { count++; }, 10); }, 1);
+        EXPECT_EQ(count.load(), 64000u);
+
+        // Exceptions are rethrown on the calling thread.
+        bool caught = false;
+        try
+        {
+            Threading::parallelFor(0, 100, [](size_t i) { if (i == 50) throw std::runtime_error("test"); }, 1);
+        }
+        catch (const std::runtime_error&)
+        {
+            caught = true;
+        }
+        EXPECT(caught);
+    }
+
+    CPU_TEST(Threading_ParallelReduce)
+    {
+        std::vector<uint64_t> values(100003);
+        std::iota(values.begin(), values.end(), 0);
+        auto sum = [&](size_t begin, size_t end) { return std::accumulate(values.begin() + begin, values.begin() + end, uint64_t(0)); };
+        auto add = [](uint64_t a, uint64_t b) { return a + b; };
+
+        const uint64_t expected = std::accumulate(values.begin(), values.end(), uint64_t(0));
+        EXPECT_EQ(Threading::parallelReduce(0, values.size(), uint64_t(0), sum, add), expected);
+        EXPECT_EQ(Threading::parallelReduce(0, values.size(), uint64_t(0), sum, add, 7), expected);
+        EXPECT_EQ(Threading::parallelReduce(5, 5, uint64_t(42), sum, add), 42ull);
+
+        // Partial results are combined in order.
+        auto concat = [](std::string a, std::string b) { return a + b; };
+        auto digits = [](size_t begin, size_t end) { std::string s; for (size_t i = begin; i < end; i++) s += char('0' + i); return s; };
+        EXPECT_EQ(Threading::parallelReduce(0, 10, std::string(), digits, concat, 3), std::string("0123456789"));
+    }
+
+    CPU_TEST(Threading_Tasks)
+    {
+        auto future = Threading::async([]() { return 42; });
+        EXPECT(future.isValid());
+        EXPECT_EQ(future.get(), 42);
+
+        std::atomic<bool> done = false;
+        auto task = Threading::dispatchTask([&]() { done = true; });
+        task.finish();
+        EXPECT(done.load());
+        EXPECT(!task.isRunning());
+        EXPECT(!Threading::Task().isRunning());
+
+        auto failing = Threading::async([]() -> int { throw std::runtime_error("test"); });
+        bool caught = false;
+        try
+        {
+            failing.get();
+        }
+        catch (const std::runtime_error&)
+        {
+            caught = true;
+        }
+        EXPECT(caught);
+
+        // Tasks may add tasks to their group while it is waited on.
+        std::atomic<uint32_t> count = 0;
+        Threading::TaskGroup group;
+        for (uint32_t i = 0; i < 16; i++)
+        {
+            group.run([&]()
+            {
+                count++;
+                group.run([&]() { count++; });
+            });
+        }
+        group.wait();
+        EXPECT_EQ(count.load(), 32u);
+    }
+
+    CPU_TEST(Threading_ScratchArena)
+    {
+        ScratchArena arena(256);
+
+        void* pFirst = nullptr;
+        {
+            ScratchArena::Scope scope(arena);
+            pFirst = arena.allocate(10, 64);
+            EXPECT_EQ(reinterpret_cast<uintptr_t>(pFirst) % 64, 0u);
+
+            // Allocations larger than the block size get their own block.
+            uint32_t* pLarge = arena.allocate<uint32_t>(1000);
+            pLarge[999] = 1;
+            EXPECT_EQ(pLarge[999], 1u);
+        }
+
+        // Memory is reused after the scope ends.
+        EXPECT_EQ(arena.allocate(10, 64), pFirst);
+        arena.reset();
+        EXPECT_EQ(arena.allocate(10, 64), pFirst);
+
+        // Allocations made by tasks are released when the task finishes.
+        Threading::parallelFor(0, 100, [](size_t)
+        {
+            float* p = Threading::getScratchArena().allocate<float>(1 << 16);
+            p[0] = 1.f;
+        }, 1);
+    }
+}
@@ -28,13 +28,28 @@
 #include <FreeImage.h>
 #include <args.hxx>
 
+#include <immintrin.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <iomanip>
 #include <iostream>
+#include <limits>
+#include <map>
 #include <memory>
+#include <mutex>
+#include <sstream>
+#include <stdexcept>
 #include <string>
+#include <thread>
 #include <vector>
-#include <stdexcept>
-#include <map>
-#include <functional>
+
+namespace fs = std::filesystem;
 
 template<typename T>
 T sqr(T x) { return x * x; }
@@ -45,6 +60,13 @@ T lerp(T a, T b, T t) { return a + t * (b - a); }
 template<typename T>
 T clamp(T x, T lo, T hi) { return std::max(lo, std::min(hi, x)); }
 
+/** Number of pixels per band of rows. Images are streamed in bands, so the amount of
+    float data held in memory is bounded by the number of threads times the band size.
+*/
+static const size_t kBandPixelCount = 1 << 20;
+
+static const std::vector<std::string> kImageExtensions = { ".png", ".jpg", ".tga", ".bmp", ".pfm", ".exr" };
+
 class Image
 {
 public:
@@ -57,34 +79,6 @@ public:
 
     static SharedPtr create(uint32_t width, uint32_t height) { return SharedPtr(new Image(width, height)); }
 
-    static SharedPtr loadFromFile(const std::string& filename)
-    {
-        FREE_IMAGE_FORMAT fifFormat = FIF_UNKNOWN;
-
-        // Determine file format.
-        fifFormat = FreeImage_GetFileType(filename.c_str(), 0);
-        if (fifFormat == FIF_UNKNOWN) fifFormat = FreeImage_GetFIFFromFilename(filename.c_str());
-        if (fifFormat == FIF_UNKNOWN) throw std::runtime_error("Unknown image format");
-        if (!FreeImage_FIFSupportsReading(fifFormat)) throw std::runtime_error("Unsupported image format");
-
-        // Read image.
-        FIBITMAP* srcBitmap = FreeImage_Load(fifFormat, filename.c_str());
-        if (!srcBitmap) throw std::runtime_error("Cannot read image");
-
-        // Convert to RGBA32F.
-        FIBITMAP* floatBitmap = FreeImage_ConvertToRGBAF(srcBitmap);
-        FreeImage_Unload(srcBitmap);
-        if (!floatBitmap) throw std::runtime_error("Cannot convert to RGBA float format");
-
-        // Create image.
-        auto image = create(FreeImage_GetWidth(floatBitmap), FreeImage_GetHeight(floatBitmap));
-        int bytesPerPixel = 4 * sizeof(float);
-        FreeImage_ConvertToRawBits(reinterpret_cast<BYTE*>(image->getData()), floatBitmap, bytesPerPixel * image->getWidth(), bytesPerPixel * 8, FI_RGBA_RED_MASK, FI_RGBA_GREEN_MASK, FI_RGBA_BLUE_MASK, true);
-        FreeImage_Unload(floatBitmap);
-
-        return image;
-    }
-
     void saveToFile(const std::string& filename, bool writeAlpha = true) const
     {
         FREE_IMAGE_FORMAT fifFormat = FIF_UNKNOWN;
@@ -159,70 +153,398 @@ private:
     {}
 };
 
+/** Reader providing the rows of an image converted to RGBA32F.
+*/
+class ImageReader
+{
+public:
+    using UniquePtr = std::unique_ptr<ImageReader>;
+
+    virtual ~ImageReader() = default;
+
+    uint32_t getWidth() const { return mWidth; }
+    uint32_t getHeight() const { return mHeight; }
+
+    /** Read a band of rows converted to RGBA32F. Rows are numbered from the top of the image.
+        Can be called concurrently from multiple threads.
+        \param[in] y First row.
+        \param[in] rowCount Number of rows.
+        \param[out] dst Destination buffer holding rowCount * width * 4 floats.
+    */
+    virtual void readRows(uint32_t y, uint32_t rowCount, float* dst) = 0;
+
+    /** Open an image file. Throws std::runtime_error on failure.
+    */
+    static UniquePtr open(const std::string& filename);
+
+protected:
+    uint32_t mWidth = 0;
+    uint32_t mHeight = 0;
+};
+
+/** Reader for PFM images. Rows are streamed from the file, so only the requested rows are held in memory.
+*/
+class PfmReader : public ImageReader
+{
+public:
+    static UniquePtr open(const std::string& filename)
+    {
+        auto reader = std::unique_ptr<PfmReader>(new PfmReader());
+        auto& stream = reader->mStream;
+        stream.open(filename, std::ios::binary);
+        if (!stream) throw std::runtime_error("Cannot open file");
+
+        std::string magic;
+        float scale = 0.f;
+        stream >> magic >> reader->mWidth >> reader->mHeight >> scale;
+        if (!stream || (magic != "PF" && magic != "Pf") || reader->mWidth == 0 || reader->mHeight == 0 || scale == 0.f)
+        {
+            throw std::runtime_error("Invalid PFM header");
+        }
+        stream.get(); // Single whitespace character before the data.
+
+        reader->mChannelCount = magic == "PF" ? 3 : 1;
+        reader->mBigEndian = scale > 0.f;
+        reader->mDataOffset = stream.tellg();
+
+        stream.seekg(0, std::ios::end);
+        if (stream.tellg() - reader->mDataOffset < (std::streamoff)reader->getRowSize() * reader->mHeight) throw std::runtime_error("Truncated PFM file");
+
+        return reader;
+    }
+
+    void readRows(uint32_t y, uint32_t rowCount, float* dst) override
+    {
+        // PFM stores rows from the bottom to the top of the image.
+        const size_t rowSize = getRowSize();
+        std::vector<uint8_t> data(rowSize * rowCount);
+        {
+            std::lock_guard<std::mutex> lock(mMutex);
+            mStream.seekg(mDataOffset + (std::streamoff)rowSize * (mHeight - y - rowCount));
+            mStream.read(reinterpret_cast<char*>(data.data()), data.size());
+            if (!mStream) throw std::runtime_error("Cannot read PFM data");
+        }
+
+        const size_t valueCount = (size_t)rowCount * mWidth * mChannelCount;
+        if (mBigEndian)
+        {
+            for (size_t i = 0; i < valueCount; i++) std::reverse(data.data() + i * 4, data.data() + i * 4 + 4);
+        }
+
+        for (uint32_t r = 0; r < rowCount; r++)
+        {
+            const float* src = reinterpret_cast<const float*>(data.data() + rowSize * (rowCount - 1 - r));
+            for (uint32_t x = 0; x < mWidth; x++)
+            {
+                dst[0] = src[0];
+                dst[1] = src[mChannelCount == 3 ? 1 : 0];
+                dst[2] = src[mChannelCount == 3 ? 2 : 0];
+                dst[3] = 1.f;
+                src += mChannelCount;
+                dst += 4;
+            }
+        }
+    }
+
+private:
+    PfmReader() = default;
+
+    size_t getRowSize() const { return (size_t)mWidth * mChannelCount * sizeof(float); }
+
+    std::ifstream mStream;
+    std::streamoff mDataOffset = 0;
+    uint32_t mChannelCount = 0;
+    bool mBigEndian = false;
+    std::mutex mMutex;
+};
+
+/** Reader for all other formats supported by FreeImage.
+    The image is decoded in its native pixel format and rows are converted to RGBA32F on demand.
+*/
+class FreeImageReader : public ImageReader
+{
+public:
+    ~FreeImageReader() override
+    {
+        if (mBitmap) FreeImage_Unload(mBitmap);
+    }
+
+    static UniquePtr open(const std::string& filename)
+    {
+        FREE_IMAGE_FORMAT fifFormat = FIF_UNKNOWN;
+
+        // Determine file format.
+        fifFormat = FreeImage_GetFileType(filename.c_str(), 0);
+        if (fifFormat == FIF_UNKNOWN) fifFormat = FreeImage_GetFIFFromFilename(filename.c_str());
+        if (fifFormat == FIF_UNKNOWN) throw std::runtime_error("Unknown image format");
+        if (!FreeImage_FIFSupportsReading(fifFormat)) throw std::runtime_error("Unsupported image format");
+
+        // Read image.
+        auto reader = std::unique_ptr<FreeImageReader>(new FreeImageReader());
+        reader->mBitmap = FreeImage_Load(fifFormat, filename.c_str());
+        if (!reader->mBitmap) throw std::runtime_error("Cannot read image");
+
+        // Convert pixel formats that are not handled directly. Low bit depth formats are expanded
+        // to 32 bits per pixel, all others are converted to RGBA32F.
+        reader->mType = FreeImage_GetImageType(reader->mBitmap);
+        FIBITMAP* converted = nullptr;
+        if (reader->mType == FIT_BITMAP && FreeImage_GetBPP(reader->mBitmap) != 24 && FreeImage_GetBPP(reader->mBitmap) != 32)
+        {
+            converted = FreeImage_ConvertTo32Bits(reader->mBitmap);
+        }
+        else if (!isSupportedType(reader->mType))
+        {
+            converted = FreeImage_ConvertToRGBAF(reader->mBitmap);
+        }
+        if (converted || !isSupportedType(reader->mType))
+        {
+            FreeImage_Unload(reader->mBitmap);
+            reader->mBitmap = converted;
+            if (!reader->mBitmap) throw std::runtime_error("Cannot convert to RGBA float format");
+            reader->mType = FreeImage_GetImageType(reader->mBitmap);
+        }
+
+        reader->mWidth = FreeImage_GetWidth(reader->mBitmap);
+        reader->mHeight = FreeImage_GetHeight(reader->mBitmap);
+        reader->mBytesPerPixel = FreeImage_GetBPP(reader->mBitmap) / 8;
+        return reader;
+    }
+
+    void readRows(uint32_t y, uint32_t rowCount, float* dst) override
+    {
+        for (uint32_t r = 0; r < rowCount; r++)
+        {
+            // FreeImage stores scanlines from the bottom to the top of the image.
+            const BYTE* src = FreeImage_GetScanLine(mBitmap, mHeight - 1 - (y + r));
+            convertRow(src, dst);
+            dst += (size_t)mWidth * 4;
+        }
+    }
+
+private:
+    FreeImageReader() = default;
+
+    static bool isSupportedType(FREE_IMAGE_TYPE type)
+    {
+        switch (type)
+        {
+        case FIT_BITMAP:
+        case FIT_UINT16:
+        case FIT_RGB16:
+        case FIT_RGBA16:
+        case FIT_FLOAT:
+        case FIT_RGBF:
+        case FIT_RGBAF:
+            return true;
+        default:
+            return false;
+        }
+    }
+
+    /** Convert a scanline to RGBA32F. The conversion matches FreeImage_ConvertToRGBAF().
+    */
+    void convertRow(const BYTE* src, float* dst) const
+    {
+        switch (mType)
+        {
+        case FIT_BITMAP:
+            for (uint32_t x = 0; x < mWidth; x++, src += mBytesPerPixel, dst += 4)
+            {
+                dst[0] = src[FI_RGBA_RED] / 255.f;
+                dst[1] = src[FI_RGBA_GREEN] / 255.f;
+                dst[2] = src[FI_RGBA_BLUE] / 255.f;
+                dst[3] = mBytesPerPixel == 4 ? src[FI_RGBA_ALPHA] / 255.f : 1.f;
+            }
+            break;
+        case FIT_UINT16:
+        case FIT_RGB16:
+        case FIT_RGBA16:
+            convertRow<uint16_t>(reinterpret_cast<const uint16_t*>(src), dst, 1.f / 65535.f);
+            break;
+        case FIT_FLOAT:
+        case FIT_RGBF:
+        case FIT_RGBAF:
+            convertRow<float>(reinterpret_cast<const float*>(src), dst, 1.f);
+            break;
+        default:
+            throw std::runtime_error("Unsupported pixel format");
+        }
+    }
+
+    template<typename T>
+    void convertRow(const T* src, float* dst, float scale) const
+    {
+        const uint32_t channelCount = mBytesPerPixel / sizeof(T);
+        for (uint32_t x = 0; x < mWidth; x++, src += channelCount, dst += 4)
+        {
+            dst[0] = src[0] * scale;
+            dst[1] = src[channelCount >= 3 ? 1 : 0] * scale;
+            dst[2] = src[channelCount >= 3 ? 2 : 0] * scale;
+            dst[3] = channelCount == 4 ? src[3] * scale : 1.f;
+        }
+    }
+
+    FIBITMAP* mBitmap = nullptr;
+    FREE_IMAGE_TYPE mType = FIT_UNKNOWN;
+    uint32_t mBytesPerPixel = 0;
+};
+
+ImageReader::UniquePtr ImageReader::open(const std::string& filename)
+{
+    std::string extension = fs::path(filename).extension().string();
+    std::transform(extension.begin(), extension.end(), extension.begin(), [] (char c) { return (char)std::tolower(c); });
+    if (extension == ".pfm") return PfmReader::open(filename);
+    return FreeImageReader::open(filename);
+}
+
+// Error metrics. Each metric evaluates the per-channel error of one RGBA pixel.
+// The error of a pixel is the mean over its channels, the error of an image the mean over its pixels.
+
 struct MSE
 {
-    double operator()(const float* a, const float* b, size_t count) const
+    static constexpr double kScale = 1.0;
+    static __m128 eval(__m128 a, __m128 b)
     {
-        double error = 0.0;
-        for (size_t i = 0; i < count; ++i) { error += sqr(a[i] - b[i]); }
-        return error / count;
+        __m128 d = _mm_sub_ps(a, b);
+        return _mm_mul_ps(d, d);
     }
 };
 
 struct RMSE
 {
-    double operator()(const float* a, const float* b, size_t count) const
+    static constexpr double kScale = 1.0;
+    static __m128 eval(__m128 a, __m128 b)
     {
-        double error = 0.0;
-        for (size_t i = 0; i < count; ++i) { error += sqr(a[i] - b[i]) / (sqr(a[i]) + 1e-3); }
-        return error / count;
+        __m128 d = _mm_sub_ps(a, b);
+        return _mm_div_ps(_mm_mul_ps(d, d), _mm_add_ps(_mm_mul_ps(a, a), _mm_set1_ps(1e-3f)));
     }
 };
 
 struct MAE
 {
-    double operator()(const float* a, const float* b, size_t count) const
+    static constexpr double kScale = 1.0;
+    static __m128 eval(__m128 a, __m128 b)
     {
-        double error = 0.0;
-        for (size_t i = 0; i < count; ++i) { error += std::fabs(sqr(a[i] - b[i])); }
-        return error / count;
+        __m128 d = _mm_sub_ps(a, b);
+        return _mm_mul_ps(d, d);
     }
 };
 
 struct MAPE
 {
-    double operator()(const float* a, const float* b, size_t count) const
+    static constexpr double kScale = 100.0;
+    static __m128 eval(__m128 a, __m128 b)
     {
-        double error = 0.0;
-        for (size_t i = 0; i < count; ++i) { error += std::fabs((a[i] - b[i]) / (a[i] + 1e-3)); }
-        return 100.0 * error / count;
+        __m128 e = _mm_div_ps(_mm_sub_ps(a, b), _mm_add_ps(a, _mm_set1_ps(1e-3f)));
+        return _mm_andnot_ps(_mm_set1_ps(-0.f), e);
     }
 };
 
+/** Evaluate a metric over a span of RGBA32F pixels.
+    \param[in] a Pixels of the first image.
+    \param[in] b Pixels of the second image.
+    \param[in] pixelCount Number of pixels.
+    \param[in] alpha Include the alpha channel.
+    \param[out] errorMap Optional per-pixel errors.
+    \return Sum of the per-pixel errors.
+*/
 template<typename Metric>
-double compare(const Image& imageA, const Image& imageB, bool alpha, float* errorMap)
+double evalMetric(const float* a, const float* b, size_t pixelCount, bool alpha, float* errorMap)
 {
-    Metric metric;
+    const __m128 mask = _mm_castsi128_ps(_mm_set_epi32(alpha ? -1 : 0, -1, -1, -1));
+    const float channelScale = float(Metric::kScale / (alpha ? 4.0 : 3.0));
+    const __m128 scale = _mm_set1_ps(channelScale);
+
+    // Process four pixels at a time. The transpose turns the per-channel errors of four pixels into
+    // per-pixel vectors, so a pixel's channels are summed without horizontal adds.
+    __m128d sum = _mm_setzero_pd();
+    size_t i = 0;
+    for (; i + 4 <= pixelCount; i += 4, a += 16, b += 16)
+    {
+        __m128 e0 = _mm_and_ps(Metric::eval(_mm_loadu_ps(a + 0), _mm_loadu_ps(b + 0)), mask);
+        __m128 e1 = _mm_and_ps(Metric::eval(_mm_loadu_ps(a + 4), _mm_loadu_ps(b + 4)), mask);
+        __m128 e2 = _mm_and_ps(Metric::eval(_mm_loadu_ps(a + 8), _mm_loadu_ps(b + 8)), mask);
+        __m128 e3 = _mm_and_ps(Metric::eval(_mm_loadu_ps(a + 12), _mm_loadu_ps(b + 12)), mask);
+        _MM_TRANSPOSE4_PS(e0, e1, e2, e3);
+        __m128 pixelSum = _mm_add_ps(_mm_add_ps(e0, e1), _mm_add_ps(e2, e3));
+        if (errorMap) _mm_storeu_ps(errorMap + i, _mm_mul_ps(pixelSum, scale));
+        sum = _mm_add_pd(sum, _mm_add_pd(_mm_cvtps_pd(pixelSum), _mm_cvtps_pd(_mm_movehl_ps(pixelSum, pixelSum))));
+    }
+
+    double total = _mm_cvtsd_f64(sum) + _mm_cvtsd_f64(_mm_unpackhi_pd(sum, sum));
+    for (; i < pixelCount; i++, a += 4, b += 4)
+    {
+        alignas(16) float e[4];
+        _mm_store_ps(e, _mm_and_ps(Metric::eval(_mm_loadu_ps(a), _mm_loadu_ps(b)), mask));
+        float pixelSum = (e[0] + e[1]) + (e[2] + e[3]);
+        if (errorMap) errorMap[i] = pixelSum * channelScale;
+        total += pixelSum;
+    }
+
+    return total * (Metric::kScale / (alpha ? 4.0 : 3.0));
+}
+
+/** Compare two images band by band using multiple threads.
+    \param[in] readerA Reader of the first image.
+    \param[in] readerB Reader of the second image.
+    \param[in] alpha Include the alpha channel.
+    \param[out] errorMap Optional per-pixel errors (width * height floats).
+    \param[in] threadCount Number of threads to use.
+    \return Mean error over all pixels.
+*/
+template<typename Metric>
+double compare(ImageReader& readerA, ImageReader& readerB, bool alpha, float* errorMap, uint32_t threadCount)
+{
+    const uint32_t width = readerA.getWidth();
+    const uint32_t height = readerA.getHeight();
+    const uint32_t bandHeight = (uint32_t)clamp<size_t>(kBandPixelCount / width, 1, height);
+    const uint32_t bandCount = (height + bandHeight - 1) / bandHeight;
+
+    // Band sums are combined in order afterwards, so the result doesn't depend on the thread count.
+    std::vector<double> bandSums(bandCount, 0.0);
+    std::atomic<uint32_t> nextBand = 0;
+    std::exception_ptr exception;
+    std::mutex exceptionMutex;
+
+    auto worker = [&] ()
+    {
+        std::vector<float> a((size_t)bandHeight * width * 4);
+        std::vector<float> b((size_t)bandHeight * width * 4);
+        try
+        {
+            for (uint32_t band = nextBand++; band < bandCount; band = nextBand++)
+            {
+                const uint32_t y = band * bandHeight;
+                const uint32_t rowCount = std::min(bandHeight, height - y);
+                readerA.readRows(y, rowCount, a.data());
+                readerB.readRows(y, rowCount, b.data());
+                bandSums[band] = evalMetric<Metric>(a.data(), b.data(), (size_t)rowCount * width, alpha, errorMap ? errorMap + (size_t)y * width : nullptr);
+            }
+        }
+        catch (...)
+        {
+            std::lock_guard<std::mutex> lock(exceptionMutex);
+            if (!exception) exception = std::current_exception();
+            nextBand = bandCount;
+        }
+    };
+
+    std::vector<std::thread> threads;
+    for (uint32_t i = 1; i < std::min(threadCount, bandCount); i++) threads.emplace_back(worker);
+    worker();
+    for (auto& thread : threads) thread.join();
+    if (exception) std::rethrow_exception(exception);
+
     double sum = 0.0;
-    const float* a = imageA.getData();
-    const float* b = imageB.getData();
-    size_t count = imageA.getWidth() * imageA.getHeight();
-    for (size_t i = 0; i < count; ++i)
-    {
-        double error = metric(a, b, alpha ? 4 : 3);
-        if (errorMap) *errorMap++ = float(error);
-        sum += error;
-        a += 4;
-        b += 4;
-    }
-    return sum / count;
+    for (double bandSum : bandSums) sum += bandSum;
+    return sum / ((double)width * height);
 }
 
 struct ErrorMetric
 {
     std::string name;
     std::string desc;
-    std::function<double(const Image& imageA, const Image& imageB, bool alpha, float* errorMap)> compare;
+    std::function<double(ImageReader& readerA, ImageReader& readerB, bool alpha, float* errorMap, uint32_t threadCount)> compare;
 };
 
 static const std::vector<ErrorMetric> errorMetrics =
@@ -264,66 +586,216 @@ static Image::SharedPtr generateHeatMap(uint32_t width, uint32_t height, const f
     return image;
 }
 
-static bool compareImages(const std::string& filenameA, const std::string& filenameB, ErrorMetric metric, float threshold, bool alpha, const std::string& heatMapFilename)
+struct CompareResult
 {
-    auto loadImage = [] (const std::string& filename)
+    bool success = false;   ///< True if the images were compared and the error is within the threshold.
+    double error = std::numeric_limits<double>::quiet_NaN();
+    std::string message;    ///< Error message if the images could not be compared.
+};
+
+static CompareResult compareImages(const std::string& filenameA, const std::string& filenameB, const ErrorMetric& metric, float threshold, bool alpha, const std::string& heatMapFilename, uint32_t threadCount)
+{
+    CompareResult result;
+
+    auto openImage = [&result] (const std::string& filename)
     {
         try
         {
-            return Image::loadFromFile(filename);
+            return ImageReader::open(filename);
         }
         catch (const std::runtime_error& e)
         {
-            std::cerr << "Cannot load image from '" << filename << "' (Error: " << e.what() << ")." << std::endl;
-            return Image::SharedPtr();
+            result.message = "Cannot load image from '" + filename + "' (Error: " + e.what() + ").";
+            return ImageReader::UniquePtr();
         }
     };
 
-    auto saveImage = [] (const Image& image, const std::string& filename)
+    // Open images.
+    auto imageA = openImage(filenameA);
+    if (!imageA) return result;
+    auto imageB = openImage(filenameB);
+    if (!imageB) return result;
+
+    // Check resolution.
+    if (imageA->getWidth() != imageB->getWidth() || imageA->getHeight() != imageB->getHeight())
+    {
+        result.message = "Cannot compare images with different resolutions.";
+        return result;
+    }
+
+    uint32_t width = imageA->getWidth();
+    uint32_t height = imageA->getHeight();
+
+    // Compare images.
+    std::unique_ptr<float[]> errorMap = heatMapFilename.empty() ? nullptr : std::make_unique<float[]>((size_t)width * height);
+    try
     {
+        result.error = metric.compare(*imageA, *imageB, alpha, errorMap.get(), threadCount);
+    }
+    catch (const std::runtime_error& e)
+    {
+        result.message = "Cannot compare images (Error: " + std::string(e.what()) + ").";
+        return result;
+    }
+
+    // Generate heat map.
+    if (errorMap)
+    {
+        auto heatMap = generateHeatMap(width, height, errorMap.get());
         try
         {
-            image.saveToFile(filename);
+            heatMap->saveToFile(heatMapFilename);
         }
         catch (const std::runtime_error& e)
         {
-            std::cerr << "Cannot save image to '" << filename << "' (Error: " << e.what() << ")." << std::endl;
+            std::cerr << "Cannot save image to '" << heatMapFilename << "' (Error: " << e.what() << ")." << std::endl;
         }
-    };
+    }
 
-    // Load images.
-    auto imageA = loadImage(filenameA);
-    if (!imageA) return false;
-    auto imageB = loadImage(filenameB);
-    if (!imageB) return false;
+    // Treat nans and infs as errors.
+    result.success = std::isfinite(result.error) && result.error <= threshold;
+    return result;
+}
 
-    // Check resolution.
-    if (imageA->getWidth() != imageB->getWidth() || imageA->getHeight() != imageB->getHeight())
+static std::string toJsonString(const std::string& str)
+{
+    std::ostringstream ss;
+    ss << '"';
+    for (char c : str)
+    {
+        switch (c)
+        {
+        case '"': ss << "\\\""; break;
+        case '\\': ss << "\\\\"; break;
+        case '\n': ss << "\\n"; break;
+        case '\t': ss << "\\t"; break;
+        default:
+            if ((unsigned char)c < 0x20) ss << "\\u" << std::hex << std::setw(4) << std::setfill('0') << (int)c << std::dec;
+            else ss << c;
+        }
+    }
+    ss << '"';
+    return ss.str();
+}
+
+template<typename T>
+static std::string toJsonNumber(T value)
+{
+    // Non-finite values use the extended syntax accepted by Python's json module.
+    if (std::isnan(value)) return "NaN";
+    if (std::isinf(value)) return value > 0.0 ? "Infinity" : "-Infinity";
+    std::ostringstream ss;
+    ss << std::setprecision(std::numeric_limits<T>::max_digits10) << value;
+    return ss.str();
+}
+
+/** Collect the image files in a directory. Returns filenames relative to the directory, sorted by name.
+*/
+static std::vector<std::string> collectImages(const fs::path& dir, const std::string& heatMapSuffix)
+{
+    std::vector<std::string> images;
+    for (const auto& entry : fs::directory_iterator(dir))
     {
-        std::cerr << "Cannot compare images with different resolutions." << std::endl;
+        if (!entry.is_regular_file()) continue;
+        std::string name = entry.path().filename().string();
+        if (!heatMapSuffix.empty() && name.size() >= heatMapSuffix.size() && name.compare(name.size() - heatMapSuffix.size(), heatMapSuffix.size(), heatMapSuffix) == 0) continue;
+        std::string extension = entry.path().extension().string();
+        std::transform(extension.begin(), extension.end(), extension.begin(), [] (char c) { return (char)std::tolower(c); });
+        if (std::find(kImageExtensions.begin(), kImageExtensions.end(), extension) == kImageExtensions.end()) continue;
+        images.push_back(name);
+    }
+    std::sort(images.begin(), images.end());
+    return images;
+}
+
+/** Compare all images in a result directory with the images of the same name in a reference directory.
+    Writes a JSON report and returns true if all images are within the threshold and no images are missing.
+*/
+static bool compareDirectories(const std::string& refDir, const std::string& resultDir, const ErrorMetric& metric, float threshold, bool alpha, const std::string& heatMapSuffix, const std::string& reportFilename, uint32_t threadCount)
+{
+    std::vector<std::string> refImages, resultImages;
+    try
+    {
+        refImages = collectImages(refDir, heatMapSuffix);
+        resultImages = collectImages(resultDir, heatMapSuffix);
+    }
+    catch (const fs::filesystem_error& e)
+    {
+        std::cerr << "Cannot read directory (Error: " << e.what() << ")." << std::endl;
         return false;
     }
 
-    uint32_t width = imageA->getWidth();
-    uint32_t height = imageB->getHeight();
+    std::vector<std::string> images, missingReferences, missingResults;
+    std::set_intersection(resultImages.begin(), resultImages.end(), refImages.begin(), refImages.end(), std::back_inserter(images));
+    std::set_difference(resultImages.begin(), resultImages.end(), refImages.begin(), refImages.end(), std::back_inserter(missingReferences));
+    std::set_difference(refImages.begin(), refImages.end(), resultImages.begin(), resultImages.end(), std::back_inserter(missingResults));
 
-    // Compare images.
-    std::unique_ptr<float[]> errorMap = heatMapFilename.empty() ? nullptr : std::make_unique<float[]>(width * height);
-    double error = metric.compare(*imageA, *imageB, alpha, errorMap.get());
+    // Compare whole images in parallel if there are enough of them, otherwise use all threads for each image.
+    std::vector<CompareResult> results(images.size());
+    const uint32_t workerCount = (uint32_t)std::min<size_t>(threadCount, images.size());
+    const uint32_t imageThreadCount = images.size() >= threadCount ? 1 : threadCount;
+    std::atomic<size_t> nextImage = 0;
 
-    // Generate heat map.
-    if (errorMap)
+    auto worker = [&] ()
     {
-        auto heatMap = generateHeatMap(width, height, errorMap.get());
-        saveImage(*heatMap, heatMapFilename);
+        for (size_t i = nextImage++; i < images.size(); i = nextImage++)
+        {
+            const std::string refFile = (fs::path(refDir) / images[i]).string();
+            const std::string resultFile = (fs::path(resultDir) / images[i]).string();
+            const std::string heatMapFile = heatMapSuffix.empty() ? "" : resultFile + heatMapSuffix;
+            results[i] = compareImages(refFile, resultFile, metric, threshold, alpha, heatMapFile, imageThreadCount);
+        }
+    };
+
+    std::vector<std::thread> threads;
+    for (uint32_t i = 1; i < workerCount; i++) threads.emplace_back(worker);
+    worker();
+    for (auto& thread : threads) thread.join();
+
+    // Write report.
+    bool success = missingReferences.empty() && missingResults.empty();
+    std::ostringstream report;
+    report << "{\n";
+    report << "  \"metric\": " << toJsonString(metric.name) << ",\n";
+    report << "  \"threshold\": " << toJsonNumber(threshold) << ",\n";
+    report << "  \"images\": [";
+    for (size_t i = 0; i < images.size(); i++)
+    {
+        const auto& result = results[i];
+        success &= result.success;
+        report << (i > 0 ? ",\n" : "\n") << "    { \"name\": " << toJsonString(images[i]) << ", \"success\": " << (result.success ? "true" : "false") << ", \"error\": " << toJsonNumber(result.error);
+        if (!result.message.empty()) report << ", \"message\": " << toJsonString(result.message);
+        report << " }";
     }
+    report << (images.empty() ? "],\n" : "\n  ],\n");
 
-    std::cout << error << std::endl;
+    auto writeList = [&report] (const char* name, const std::vector<std::string>& list, bool last)
+    {
+        report << "  \"" << name << "\": [";
+        for (size_t i = 0; i < list.size(); i++) report << (i > 0 ? ", " : "") << toJsonString(list[i]);
+        report << "]" << (last ? "\n" : ",\n");
+    };
+    writeList("missingReferences", missingReferences, false);
+    writeList("missingResults", missingResults, false);
+    report << "  \"success\": " << (success ? "true" : "false") << "\n";
+    report << "}\n";
 
-    // Treat nans and infs as errors.
-    if (std::isnan(error) || std::isinf(error)) return false;
+    if (reportFilename.empty())
+    {
+        std::cout << report.str();
+    }
+    else
+    {
+        std::ofstream file(reportFilename);
+        file << report.str();
+        if (!file)
+        {
+            std::cerr << "Cannot write report to '" << reportFilename << "'." << std::endl;
+            return false;
+        }
+    }
 
-    return error <= threshold;
+    return success;
 }
 
 static void printMetrics(std::ostream &stream = std::cout)
@@ -337,16 +809,19 @@ static void printMetrics(std::ostream &stream = std::cout)
 
 int main(int argc, char** argv)
 {
-    args::ArgumentParser parser("Utility to compare images.");
+    args::ArgumentParser parser("Utility to compare images.", "In batch mode, all images in the result directory are compared with the images of the same name in the reference directory and a JSON report is written.");
     parser.helpParams.programName = "ImageCompare";
     args::HelpFlag helpFlag(parser, "help", "Display this help menu.", {'h', "help"});
     args::Flag listMetricsFlag(parser, "", "List available error metrics.", {'l'});
     args::ValueFlag<std::string> metricFlag(parser, "metric", "The error metric.", {'m'});
     args::ValueFlag<float> thresholdFlag(parser, "threshold", "The error threshold.", {'t'});
     args::Flag alphaFlag(parser, "", "Include alpha channel.", {'a'});
-    args::ValueFlag<std::string> heatMapFlag(parser, "filename", "Generate error heat map.", {'e'});
-    args::Positional<std::string> image1(parser, "image1", "The first image.", args::Options::Required);
-    args::Positional<std::string> image2(parser, "image2", "The second image.", args::Options::Required);
+    args::ValueFlag<std::string> heatMapFlag(parser, "filename", "Generate error heat map. In batch mode, this is the suffix appended to the result image filenames.", {'e'});
+    args::Flag batchFlag(parser, "", "Batch mode. Compare the images in two directories.", {'b'});
+    args::ValueFlag<std::string> reportFlag(parser, "filename", "Write the batch mode JSON report to a file instead of stdout.", {'r'});
+    args::ValueFlag<uint32_t> threadsFlag(parser, "threads", "Number of threads (default: number of logical processors).", {'j'});
+    args::Positional<std::string> image1(parser, "image1", "The first image (reference directory in batch mode).", args::Options::Required);
+    args::Positional<std::string> image2(parser, "image2", "The second image (result directory in batch mode).", args::Options::Required);
     args::CompletionFlag completionFlag(parser, {"complete"});
 
     try
@@ -396,12 +871,24 @@ int main(int argc, char** argv)
         metric = *it;
     }
 
-    return compareImages(
-        args::get(image1),
-        args::get(image2),
-        metric,
-        thresholdFlag ? args::get(thresholdFlag) : 0.f,
-        alphaFlag ? args::get(alphaFlag) : false,
-        heatMapFlag ? args::get(heatMapFlag) : ""
-    ) ? 0 : 1;
+    float threshold = thresholdFlag ? args::get(thresholdFlag) : 0.f;
+    bool alpha = alphaFlag ? args::get(alphaFlag) : false;
+    std::string heatMap = heatMapFlag ? args::get(heatMapFlag) : "";
+    uint32_t threadCount = threadsFlag ? args::get(threadsFlag) : std::thread::hardware_concurrency();
+    threadCount = std::max(1u, threadCount);
+
+    if (batchFlag)
+    {
+        return compareDirectories(args::get(image1), args::get(image2), metric, threshold, alpha, heatMap, reportFlag ? args::get(reportFlag) : "", threadCount) ? 0 : 1;
+    }
+
+    auto result = compareImages(args::get(image1), args::get(image2), metric, threshold, alpha, heatMap, threadCount);
+    if (!result.message.empty())
+    {
+        std::cerr << result.message << std::endl;
+        return 1;
+    }
+
+    std::cout << result.error << std::endl;
+    return result.success ? 0 : 1;
 }
@@ -178,18 +178,19 @@ class Test:
 
         return Test.Result.PASSED, []
 
-    def compare_image(self, ref_file, result_file, error_file, tolerance, image_compare_exe):
+    def compare_image_dirs(self, ref_dir, result_dir, tolerance, image_compare_exe):
         '''
-        Compare two images using ImageCompare.
-        Returns a tuple containing the a boolean to indicate success and the measured error.
+        Compare all images in two directories using ImageCompare in batch mode.
+        Error images are written next to the result images.
+        Returns the parsed JSON report.
         '''
-        args = [str(image_compare_exe), '-m', 'mse', '-t', str(tolerance), str(ref_file), str(result_file)]
-        if error_file:
-            args += ['-e', str(error_file)]
-        process = subprocess.Popen(args, stdout=subprocess.PIPE, stderr=subprocess.STDOUT)
-        output = process.communicate()[0]
-        error = float(output.strip())
-        return process.returncode == 0, error
+        args = [str(image_compare_exe), '-b', '-m', 'mse', '-t', str(tolerance), '-e', config.ERROR_IMAGE_SUFFIX, str(ref_dir), str(result_dir)]
+        process = subprocess.Popen(args, stdout=subprocess.PIPE, stderr=subprocess.PIPE)
+        output, errors = process.communicate()
+        try:
+            return json.loads(output)
+        except json.JSONDecodeError:
+            raise RuntimeError(f'ImageCompare failed: {errors.decode().strip()}')
 
     def compare_images(self, ref_dir, result_dir, image_compare_exe):
         '''
@@ -211,45 +212,41 @@ class Test:
         elif not result_dir.exists():
             return Test.Result.FAILED, [f'Result directory "{result_dir}" does not exist.'], []
 
-        # Collect all reference and result images.
-        ref_images = self.collect_images(ref_dir)
-        result_images = self.collect_images(result_dir)
-
         # Bail out if no images have been generated.
-        if len(result_images) == 0:
+        if len(self.collect_images(result_dir)) == 0:
             return Test.Result.FAILED, ['Test did not generate any images.'], []
 
+        # Compare every result image with the corresponding reference image.
+        try:
+            report = self.compare_image_dirs(ref_dir, result_dir, self.tolerance, image_compare_exe)
+        except RuntimeError as e:
+            return Test.Result.FAILED, [str(e)], []
+
         result = Test.Result.PASSED
         messages = []
         image_reports = []
 
-        # Compare every result image with the corresponding reference image and report missing references.
-        for image in result_images:
-            if not image in ref_images:
-                result = Test.Result.FAILED
-                messages.append(f'Test has generated image "{image}" with no corresponding reference image.')
-                continue
-
-            ref_file = ref_dir / image
-            result_file = result_dir / image
-            error_file = result_dir / (str(image) + config.ERROR_IMAGE_SUFFIX)
-            compare_success, compare_error = self.compare_image(ref_file, result_file, error_file, self.tolerance, image_compare_exe)
-            if not compare_success:
+        for image in report['images']:
+            if not image['success']:
                 result = Test.Result.FAILED
-                messages.append(f'Test image "{image}" failed with error {compare_error}.')
+                messages.append(f'Test image "{image["name"]}" failed with error {image["error"]}.')
+                if 'message' in image:
+                    messages.append(image['message'])
 
             image_reports.append({
-                'name': str(image),
-                'success': compare_success,
-                'error': compare_error,
+                'name': image['name'],
+                'success': image['success'],
+                'error': image['error'],
                 'tolerance': self.tolerance
             })
 
-        # Report missing result images for existing reference images.
-        for image in ref_images:
-            if not image in result_images:
-                result = Test.Result.FAILED
-                messages.append(f'Test has not generated an image for the corresponding reference image "{image}".')
+        # Report result images without references and missing result images for existing reference images.
+        for image in report['missingReferences']:
+            result = Test.Result.FAILED
+            messages.append(f'Test has generated image "{image}" with no corresponding reference image.')
+        for image in report['missingResults']:
+            result = Test.Result.FAILED
+            messages.append(f'Test has not generated an image for the corresponding reference image "{image}".')
 
         return result, messages, image_reports
 